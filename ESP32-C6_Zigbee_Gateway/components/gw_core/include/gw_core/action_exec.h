@@ -6,6 +6,7 @@
 #include "esp_err.h"
 
 #include "gw_core/automation_compiled.h"
+#include "gw_core/cbor.h"
 #include "gw_core/types.h"
 
 #ifdef __cplusplus
@@ -17,10 +18,9 @@ extern "C" {
 esp_err_t gw_action_exec_cbor(const uint8_t *buf, size_t len, char *err, size_t err_size);
 
 // Fast-path executor for compiled rules (avoids dynamic allocations at runtime).
-// Currently supports the MVP zigbee commands used by Automations UI:
-// - onoff.on / onoff.off / onoff.toggle
-// - level.move_to_level (arg0_u32=level 0..254, arg1_u32=transition_ms)
-esp_err_t gw_action_exec_compiled_zigbee(const char *cmd,
+// Sends one unicast On/Off, Level or Color opcode; arguments are as the compiler
+// laid them out (see gw_auto_act_op_t) and are not range-checked again.
+esp_err_t gw_action_exec_compiled_zigbee(gw_auto_act_op_t op,
                                         const gw_device_uid_t *device_uid,
                                         uint8_t endpoint,
                                         uint32_t arg0_u32,
@@ -30,12 +30,67 @@ esp_err_t gw_action_exec_compiled_zigbee(const char *cmd,
                                         size_t err_size);
 
 // Execute a compiled action record from a `.gwar` file.
-// This is the main runtime path for automations (no JSON parsing).
+// This is the main runtime path for automations: a switch over the record's opcode,
+// no JSON parsing or command strings.
 esp_err_t gw_action_exec_compiled(const gw_auto_compiled_t *compiled,
                                  const gw_auto_bin_action_v2_t *action,
                                  char *err,
                                  size_t err_size);
 
+// Action planner: folds adjacent actions of one automation into fewer Zigbee frames
+// when the devices end up in the same state. Actions are never reordered.
+// - onoff.on next to level.move_to_level (level > 0) on the same endpoint is sent as
+//   one level.move_to_level_with_on_off;
+// - a repeated onoff.on / onoff.off to the endpoint just addressed is dropped;
+// - a run of identical onoff.* or level.move_to_level actions that addresses every
+//   member of an automatic Zigbee group (see gw_zb_model_group_size()) is groupcast.
+typedef enum {
+    GW_ACTION_STEP_SINGLE = 0,       // `lead` as written, plus dropped repeats
+    GW_ACTION_STEP_LEVEL_WITH_ONOFF, // `lead` is the level action
+    GW_ACTION_STEP_GROUP,            // `lead` sent to `group_id`
+} gw_action_step_kind_t;
+
+typedef struct {
+    gw_action_step_kind_t kind;
+    uint32_t count;    // actions covered, starting at the planned position
+    uint32_t lead;     // index of the covered action whose cmd/args are sent
+    uint16_t group_id; // GW_ACTION_STEP_GROUP only
+} gw_action_step_t;
+
+// Plan the step starting at `actions[pos]` (pos < count). Always covers at least one action.
+void gw_action_plan_step(const gw_auto_compiled_t *compiled,
+                         const gw_auto_bin_action_v2_t *actions,
+                         uint32_t count,
+                         uint32_t pos,
+                         gw_action_step_t *out);
+
+// Execute a planned step. A groupcast the Zigbee side refuses (ESP_ERR_NOT_SUPPORTED) is
+// replayed action by action. `frames_saved` (optional) gets the frames the step avoided.
+esp_err_t gw_action_exec_step(const gw_auto_compiled_t *compiled,
+                              const gw_auto_bin_action_v2_t *actions,
+                              const gw_action_step_t *step,
+                              uint32_t *frames_saved,
+                              char *err,
+                              size_t err_size);
+
+// Batch execution: a list of action payloads (each as for gw_action_exec_cbor()) goes
+// through the planner above in order and out over a pipelined Zigbee link, so adjacent
+// actions share frames and the commands do not wait for each other's replies. Entries
+// that fail to decode are reported and skipped; the others still run.
+#define GW_ACTION_BATCH_MAX 64
+
+typedef struct {
+    esp_err_t rc;
+    char err[48];
+} gw_action_result_t;
+
+// `results[i]` receives the outcome of `items[i]`; `frames` (optional) the number of Zigbee
+// commands sent. Returns an error only if the batch could not run at all.
+esp_err_t gw_action_exec_batch_cbor(const gw_cbor_slice_t *items,
+                                    uint32_t count,
+                                    gw_action_result_t *results,
+                                    uint32_t *frames);
+
 #ifdef __cplusplus
 }
 #endif
@@ -44,6 +44,50 @@ bool gw_cbor_slice_to_f64(const gw_cbor_slice_t *s, double *out);
 bool gw_cbor_slice_to_bool(const gw_cbor_slice_t *s, bool *out);
 bool gw_cbor_slice_to_text_span(const gw_cbor_slice_t *s, const uint8_t **out_ptr, size_t *out_len);
 
+// Schema-driven map decoding: gw_cbor_decode_map() walks a map once and stores each
+// listed key into a struct member, instead of one gw_cbor_map_find() scan per key.
+// Keys that are not listed are skipped; for a repeated key the first one wins.
+typedef enum {
+    GW_CBOR_FIELD_ITEM = 0, // any item, as a gw_cbor_slice_t of its encoding
+    GW_CBOR_FIELD_TEXT,     // text string into a char array, NUL-terminated
+    GW_CBOR_FIELD_BOOL,
+    GW_CBOR_FIELD_U8,       // integers are range-checked, see gw_cbor_field_t
+    GW_CBOR_FIELD_U16,
+    GW_CBOR_FIELD_U32,
+    GW_CBOR_FIELD_I16,
+    GW_CBOR_FIELD_I32,
+    GW_CBOR_FIELD_I64,
+    GW_CBOR_FIELD_F64,      // float or integer into a double
+} gw_cbor_field_type_t;
+
+typedef struct {
+    const char *key;
+    gw_cbor_field_type_t type;
+    uint16_t offset; // of the destination member
+    uint16_t size;   // of the destination member (TEXT: buffer size incl. NUL)
+    int64_t min;     // integers: inclusive range; 0/0 = the destination type's range
+    int64_t max;
+} gw_cbor_field_t;
+
+#define GW_CBOR_FIELD(key_, type_, st_, member_) \
+    {(key_), (type_), (uint16_t)offsetof(st_, member_), (uint16_t)sizeof(((st_ *)0)->member_), 0, 0}
+#define GW_CBOR_FIELD_RANGE(key_, type_, st_, member_, min_, max_) \
+    {(key_), (type_), (uint16_t)offsetof(st_, member_), (uint16_t)sizeof(((st_ *)0)->member_), (min_), (max_)}
+
+#define GW_CBOR_MAX_FIELDS 32
+
+// Decode the map in `buf` into `out` by `fields` (at most GW_CBOR_MAX_FIELDS). Members of
+// absent keys are left untouched. Bit i of `*out_present` is set when fields[i] was found.
+// Returns false when `buf` is not a well-formed map or a listed key holds a value of the
+// wrong type or range; `*out_bad` is then that field's index, or -1 for the map itself.
+bool gw_cbor_decode_map(const uint8_t *buf,
+                        size_t len,
+                        const gw_cbor_field_t *fields,
+                        size_t n_fields,
+                        void *out,
+                        uint32_t *out_present,
+                        int *out_bad);
+
 // Writer
 void gw_cbor_writer_init(gw_cbor_writer_t *w);
 void gw_cbor_writer_free(gw_cbor_writer_t *w);
@@ -48,11 +48,12 @@ typedef enum {
     GW_UART_MSG_EVT      = 0x20, /* асинхронное событие C6 -> S3 */
     GW_UART_MSG_SNAPSHOT = 0x21, /* пакет состояния при синхронизации */
     GW_UART_MSG_DEVICE_FB = 0x22, /* сырой device FlatBuffer chunk C6 -> S3 */
+    GW_UART_MSG_RULES_BUNDLE = 0x23, /* GWAR chunk of C6-local automations S3 -> C6 */
 } gw_uart_msg_type_t;
 
 typedef enum {
     GW_UART_CMD_ONOFF      = 1, /* param0: 0=off,1=on,2=toggle */
-    GW_UART_CMD_LEVEL      = 2, /* param0: level(0..254), param1: transition_ds */
+    GW_UART_CMD_LEVEL      = 2, /* param0: level(0..254), param1: transition_ds, param2: 1 = with On/Off */
     GW_UART_CMD_COLOR_XY   = 3, /* param0: x(0..65535), param1: y(0..65535), param2: transition_ds */
     GW_UART_CMD_COLOR_TEMP = 4, /* param0: mired, param1: transition_ds */
     GW_UART_CMD_PERMIT_JOIN= 5, /* param0: seconds */
@@ -65,8 +66,17 @@ typedef enum {
     GW_UART_CMD_REMOVE_DEVICE = 12, /* device_uid */
     GW_UART_CMD_WIFI_CONFIG_SET = 13, /* deprecated on C6 (unsupported) */
     GW_UART_CMD_NET_SERVICES_START = 14, /* deprecated on C6 (unsupported) */
+    GW_UART_CMD_BIND = 15, /* src: device_uid/endpoint/cluster_id, dst: value_text uid + param0 endpoint */
+    GW_UART_CMD_UNBIND = 16, /* same fields as BIND */
+    GW_UART_CMD_RULES_COMMIT = 17, /* param0: transfer_id, param1: total_len, param2: crc32 of the bundle */
+    GW_UART_CMD_GROUP_ONOFF = 18, /* short_addr: group id, params as ONOFF */
+    GW_UART_CMD_GROUP_LEVEL = 19, /* short_addr: group id, params as LEVEL */
+    GW_UART_CMD_READ_ATTRS = 20, /* cluster_id, param0: count, value_blob: attr ids (u16 LE) */
 } gw_uart_cmd_id_t;
 
+/* READ_ATTRS: максимум атрибутов одного кластера в одном кадре ZCL Read Attributes. */
+#define GW_UART_READ_ATTRS_MAX 8
+
 typedef enum {
     GW_UART_EVT_ATTR_REPORT = 1,
     GW_UART_EVT_COMMAND     = 2,
@@ -202,7 +212,8 @@ typedef struct {
     uint64_t state_ts_ms;
 } GW_UART_PROTO_PACKED gw_uart_snapshot_v1_t;
 
-/* Chunk сырого device buffer (FlatBuffer) C6 -> S3. */
+/* Chunk сырого device buffer (FlatBuffer) C6 -> S3.
+ * The same layout carries GW_UART_MSG_RULES_BUNDLE S3 -> C6. */
 #define GW_UART_DEVICE_FB_FLAG_BEGIN 0x01u
 #define GW_UART_DEVICE_FB_FLAG_END   0x02u
 
@@ -1,5 +1,8 @@
 #pragma once
 
+#include <stddef.h>
+#include <stdint.h>
+
 #include "esp_err.h"
 #include "gw_core/event_bus.h"
 
@@ -8,9 +11,11 @@ extern "C" {
 #endif
 
 esp_err_t gw_rules_init(void);
-esp_err_t gw_rules_handle_event(gw_event_id_t id, const void *data, size_t data_size);
+
+// Replace the automations run on the C6 with a packed GWAR bundle pushed by the S3
+// (len 0 clears them). The bundle is kept in NVS and reloaded at boot.
+esp_err_t gw_rules_load_bundle(const uint8_t *buf, size_t len);
 
 #ifdef __cplusplus
 }
 #endif
-
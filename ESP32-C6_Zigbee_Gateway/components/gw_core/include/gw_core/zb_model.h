@@ -36,6 +36,11 @@ size_t gw_zb_model_list_endpoints(const gw_device_uid_t *uid, gw_zb_endpoint_t *
 size_t gw_zb_model_list_all_endpoints(gw_zb_endpoint_t *out_eps, size_t max_eps);
 bool gw_zb_model_find_uid_by_short(uint16_t short_addr, gw_device_uid_t *out_uid);
 
+// Automatic group membership (see gw_zb_endpoint_auto_group()) as seen by the model:
+// the group of one endpoint (0 if none or unknown), and how many endpoints are in a group.
+uint16_t gw_zb_model_endpoint_group(const gw_device_uid_t *uid, uint8_t endpoint);
+size_t gw_zb_model_group_size(uint16_t group_id);
+
 #ifdef __cplusplus
 }
 #endif
@@ -5,9 +5,11 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 
 #include "gw_core/cbor.h"
 #include "gw_core/types.h"
+#include "gw_core/zb_model.h"
 #include "gw_zigbee/gw_zigbee.h"
 
 static void set_err(char *err, size_t err_size, const char *msg)
@@ -23,335 +25,273 @@ static void set_err(char *err, size_t err_size, const char *msg)
     err[err_size - 1] = '\0';
 }
 
-static bool cbor_get_text0(const uint8_t *buf, size_t len, const char *key, char *out, size_t out_size)
+// Everything an action payload may carry; decoded in one pass over the map.
+typedef struct {
+    char type[16];
+    char cmd[64];
+    char device_uid[GW_DEVICE_UID_STRLEN];
+    char uid[GW_DEVICE_UID_STRLEN];
+    char src_device_uid[GW_DEVICE_UID_STRLEN];
+    char src_uid[GW_DEVICE_UID_STRLEN];
+    char dst_device_uid[GW_DEVICE_UID_STRLEN];
+    char dst_uid[GW_DEVICE_UID_STRLEN];
+    uint16_t group_id;
+    uint16_t cluster_id;
+    uint16_t transition_ms;
+    uint16_t x;
+    uint16_t y;
+    uint16_t mireds;
+    uint8_t scene_id;
+    uint8_t endpoint;
+    uint8_t src_endpoint;
+    uint8_t dst_endpoint;
+    uint8_t level;
+} action_req_t;
+
+enum {
+    F_TYPE,
+    F_CMD,
+    F_DEVICE_UID,
+    F_UID,
+    F_SRC_DEVICE_UID,
+    F_SRC_UID,
+    F_DST_DEVICE_UID,
+    F_DST_UID,
+    F_GROUP_ID,
+    F_CLUSTER_ID,
+    F_TRANSITION_MS,
+    F_X,
+    F_Y,
+    F_MIREDS,
+    F_SCENE_ID,
+    F_ENDPOINT,
+    F_SRC_ENDPOINT,
+    F_DST_ENDPOINT,
+    F_LEVEL,
+    F_COUNT,
+};
+
+static const gw_cbor_field_t s_action_fields[F_COUNT] = {
+    [F_TYPE] = GW_CBOR_FIELD("type", GW_CBOR_FIELD_TEXT, action_req_t, type),
+    [F_CMD] = GW_CBOR_FIELD("cmd", GW_CBOR_FIELD_TEXT, action_req_t, cmd),
+    [F_DEVICE_UID] = GW_CBOR_FIELD("device_uid", GW_CBOR_FIELD_TEXT, action_req_t, device_uid),
+    [F_UID] = GW_CBOR_FIELD("uid", GW_CBOR_FIELD_TEXT, action_req_t, uid),
+    [F_SRC_DEVICE_UID] = GW_CBOR_FIELD("src_device_uid", GW_CBOR_FIELD_TEXT, action_req_t, src_device_uid),
+    [F_SRC_UID] = GW_CBOR_FIELD("src_uid", GW_CBOR_FIELD_TEXT, action_req_t, src_uid),
+    [F_DST_DEVICE_UID] = GW_CBOR_FIELD("dst_device_uid", GW_CBOR_FIELD_TEXT, action_req_t, dst_device_uid),
+    [F_DST_UID] = GW_CBOR_FIELD("dst_uid", GW_CBOR_FIELD_TEXT, action_req_t, dst_uid),
+    [F_GROUP_ID] = GW_CBOR_FIELD_RANGE("group_id", GW_CBOR_FIELD_U16, action_req_t, group_id, 1, 0xFFFE),
+    [F_CLUSTER_ID] = GW_CBOR_FIELD_RANGE("cluster_id", GW_CBOR_FIELD_U16, action_req_t, cluster_id, 1, 0xFFFF),
+    [F_TRANSITION_MS] = GW_CBOR_FIELD_RANGE("transition_ms", GW_CBOR_FIELD_U16, action_req_t, transition_ms, 0, GW_AUTO_TRANSITION_MAX_MS),
+    [F_X] = GW_CBOR_FIELD("x", GW_CBOR_FIELD_U16, action_req_t, x),
+    [F_Y] = GW_CBOR_FIELD("y", GW_CBOR_FIELD_U16, action_req_t, y),
+    [F_MIREDS] = GW_CBOR_FIELD_RANGE("mireds", GW_CBOR_FIELD_U16, action_req_t, mireds, 1, 1000),
+    [F_SCENE_ID] = GW_CBOR_FIELD_RANGE("scene_id", GW_CBOR_FIELD_U8, action_req_t, scene_id, 1, 255),
+    [F_ENDPOINT] = GW_CBOR_FIELD_RANGE("endpoint", GW_CBOR_FIELD_U8, action_req_t, endpoint, 1, 240),
+    [F_SRC_ENDPOINT] = GW_CBOR_FIELD_RANGE("src_endpoint", GW_CBOR_FIELD_U8, action_req_t, src_endpoint, 1, 240),
+    [F_DST_ENDPOINT] = GW_CBOR_FIELD_RANGE("dst_endpoint", GW_CBOR_FIELD_U8, action_req_t, dst_endpoint, 1, 240),
+    [F_LEVEL] = GW_CBOR_FIELD_RANGE("level", GW_CBOR_FIELD_U8, action_req_t, level, 0, 254),
+};
+
+// First non-empty of two uid spellings ("device_uid"/"uid", ...).
+static bool pick_uid(const char *a, const char *b, gw_device_uid_t *out)
 {
-    if (!out || out_size == 0) return false;
-    out[0] = '\0';
-    gw_cbor_slice_t s = {0};
-    if (!gw_cbor_map_find(buf, len, key, &s)) return false;
-    const uint8_t *p = NULL;
-    size_t n = 0;
-    if (!gw_cbor_slice_to_text_span(&s, &p, &n)) return false;
-    if (n + 1 > out_size) return false;
-    memcpy(out, p, n);
-    out[n] = '\0';
-    return true;
-}
-
-static bool cbor_has_key(const uint8_t *buf, size_t len, const char *key)
-{
-    gw_cbor_slice_t s = {0};
-    return gw_cbor_map_find(buf, len, key, &s);
-}
-
-static bool cbor_get_u64(const uint8_t *buf, size_t len, const char *key, uint64_t *out)
-{
-    gw_cbor_slice_t s = {0};
-    if (!gw_cbor_map_find(buf, len, key, &s)) return false;
-    return gw_cbor_slice_to_u64(&s, out);
-}
-
-static bool cbor_get_i64(const uint8_t *buf, size_t len, const char *key, int64_t *out)
-{
-    gw_cbor_slice_t s = {0};
-    if (!gw_cbor_map_find(buf, len, key, &s)) return false;
-    return gw_cbor_slice_to_i64(&s, out);
-}
-
-static bool cbor_get_u16(const uint8_t *buf, size_t len, const char *key, uint16_t *out)
-{
-    uint64_t v = 0;
-    if (!cbor_get_u64(buf, len, key, &v)) {
-        int64_t iv = 0;
-        if (!cbor_get_i64(buf, len, key, &iv)) return false;
-        if (iv < 0 || iv > 65535) return false;
-        v = (uint64_t)iv;
-    }
-    if (v > 65535) return false;
-    *out = (uint16_t)v;
-    return true;
-}
-
-static bool cbor_get_u8(const uint8_t *buf, size_t len, const char *key, uint8_t *out, uint8_t min_v, uint8_t max_v)
-{
-    uint64_t v = 0;
-    if (!cbor_get_u64(buf, len, key, &v)) {
-        int64_t iv = 0;
-        if (!cbor_get_i64(buf, len, key, &iv)) return false;
-        if (iv < 0) return false;
-        v = (uint64_t)iv;
-    }
-    if (v < min_v || v > max_v) return false;
-    *out = (uint8_t)v;
+    const char *s = a[0] ? a : b;
+    if (s[0] == '\0') return false;
+    memset(out, 0, sizeof(*out));
+    strlcpy(out->uid, s, sizeof(out->uid));
     return true;
 }
 
-static bool cbor_get_u16_ms_opt(const uint8_t *buf, size_t len, const char *key, uint16_t *out, uint16_t max_v)
-{
-    if (!cbor_has_key(buf, len, key)) {
-        *out = 0;
-        return true;
-    }
-    uint16_t v = 0;
-    if (!cbor_get_u16(buf, len, key, &v)) return false;
-    if (v > max_v) return false;
-    *out = v;
-    return true;
-}
+// String table for action records built from request payloads (uids only).
+typedef struct {
+    char *buf;
+    uint32_t len;
+    uint32_t cap;
+} str_tab_t;
 
-static bool cbor_get_uid(const uint8_t *buf, size_t len, const char *key, gw_device_uid_t *out)
+static uint32_t str_tab_add(str_tab_t *t, const char *s)
 {
-    if (!out) return false;
-    char tmp[GW_DEVICE_UID_STRLEN] = {0};
-    if (!cbor_get_text0(buf, len, key, tmp, sizeof(tmp))) return false;
-    if (tmp[0] == '\0') return false;
-    memset(out, 0, sizeof(*out));
-    strlcpy(out->uid, tmp, sizeof(out->uid));
-    return true;
+    const size_t n = strlen(s) + 1;
+    if (t->len + n > t->cap) return 0;
+    memcpy(t->buf + t->len, s, n);
+    const uint32_t off = t->len;
+    t->len += (uint32_t)n;
+    return off;
 }
 
-esp_err_t gw_action_exec_cbor(const uint8_t *buf, size_t len, char *err, size_t err_size)
+// Decode one action payload into the record the compiled executor takes; uids go into `tab`,
+// which must have room for two of them.
+static esp_err_t action_from_cbor(const uint8_t *buf,
+                                  size_t len,
+                                  str_tab_t *tab,
+                                  gw_auto_bin_action_v2_t *a,
+                                  char *err,
+                                  size_t err_size)
 {
-    set_err(err, err_size, NULL);
+    memset(a, 0, sizeof(*a));
     if (!buf || len == 0) {
         set_err(err, err_size, "bad action");
         return ESP_ERR_INVALID_ARG;
     }
 
-    char type[16] = {0};
-    if (!cbor_get_text0(buf, len, "type", type, sizeof(type))) {
+    action_req_t req = {0};
+    uint32_t has = 0;
+    int bad = -1;
+    if (!gw_cbor_decode_map(buf, len, s_action_fields, F_COUNT, &req, &has, &bad)) {
+        if (bad < 0) {
+            set_err(err, err_size, "bad action");
+        } else if (err && err_size) {
+            snprintf(err, err_size, "bad %s", s_action_fields[bad].key);
+        }
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (req.type[0] == '\0') {
         set_err(err, err_size, "missing type");
         return ESP_ERR_INVALID_ARG;
     }
-    if (strcmp(type, "zigbee") != 0) {
+    if (strcmp(req.type, "zigbee") != 0) {
         set_err(err, err_size, "unsupported type");
         return ESP_ERR_NOT_SUPPORTED;
     }
-
-    char cmd[64] = {0};
-    if (!cbor_get_text0(buf, len, "cmd", cmd, sizeof(cmd))) {
+    if (req.cmd[0] == '\0') {
         set_err(err, err_size, "missing cmd");
         return ESP_ERR_INVALID_ARG;
     }
 
-    const bool has_group = cbor_has_key(buf, len, "group_id");
-    const bool has_uid = cbor_has_key(buf, len, "device_uid") || cbor_has_key(buf, len, "uid");
-
-    // Scenes
-    if (strcmp(cmd, "scene.store") == 0 || strcmp(cmd, "scene.recall") == 0) {
-        uint16_t gid = 0;
-        uint8_t sid = 0;
-        if (!cbor_get_u16(buf, len, "group_id", &gid) || gid == 0 || gid == 0xFFFF) {
-            set_err(err, err_size, "bad group_id");
-            return ESP_ERR_INVALID_ARG;
-        }
-        if (!cbor_get_u8(buf, len, "scene_id", &sid, 1, 255)) {
-            set_err(err, err_size, "bad scene_id");
-            return ESP_ERR_INVALID_ARG;
-        }
-        return (strcmp(cmd, "scene.store") == 0) ? gw_zigbee_scene_store(gid, sid) : gw_zigbee_scene_recall(gid, sid);
-    }
-
-    // Bind/unbind
-    if (strcmp(cmd, "bind") == 0 || strcmp(cmd, "unbind") == 0) {
-        gw_device_uid_t src_uid = {0};
-        gw_device_uid_t dst_uid = {0};
-        if (!cbor_get_uid(buf, len, "src_device_uid", &src_uid) && !cbor_get_uid(buf, len, "src_uid", &src_uid)) {
-            set_err(err, err_size, "missing src_device_uid");
-            return ESP_ERR_INVALID_ARG;
-        }
-        if (!cbor_get_uid(buf, len, "dst_device_uid", &dst_uid) && !cbor_get_uid(buf, len, "dst_uid", &dst_uid)) {
-            set_err(err, err_size, "missing dst_device_uid");
-            return ESP_ERR_INVALID_ARG;
-        }
-
-        uint8_t src_ep = 0;
-        uint8_t dst_ep = 0;
-        uint16_t cluster_id = 0;
-        if (!cbor_get_u8(buf, len, "src_endpoint", &src_ep, 1, 240)) {
-            set_err(err, err_size, "bad src_endpoint");
-            return ESP_ERR_INVALID_ARG;
-        }
-        if (!cbor_get_u8(buf, len, "dst_endpoint", &dst_ep, 1, 240)) {
-            set_err(err, err_size, "bad dst_endpoint");
-            return ESP_ERR_INVALID_ARG;
-        }
-        if (!cbor_get_u16(buf, len, "cluster_id", &cluster_id) || cluster_id == 0) {
-            set_err(err, err_size, "bad cluster_id");
-            return ESP_ERR_INVALID_ARG;
-        }
-
-        return (strcmp(cmd, "bind") == 0) ? gw_zigbee_bind(&src_uid, src_ep, cluster_id, &dst_uid, dst_ep)
-                                           : gw_zigbee_unbind(&src_uid, src_ep, cluster_id, &dst_uid, dst_ep);
-    }
-
-    // On/off
-    if (strncmp(cmd, "onoff.", 6) == 0 || (strcmp(cmd, "on") == 0 || strcmp(cmd, "off") == 0 || strcmp(cmd, "toggle") == 0)) {
-        const char *use_cmd = cmd;
-        if (strcmp(cmd, "on") == 0) use_cmd = "onoff.on";
-        else if (strcmp(cmd, "off") == 0) use_cmd = "onoff.off";
-        else if (strcmp(cmd, "toggle") == 0) use_cmd = "onoff.toggle";
-
-        gw_zigbee_onoff_cmd_t ocmd = GW_ZIGBEE_ONOFF_CMD_TOGGLE;
-        if (strcmp(use_cmd, "onoff.off") == 0) ocmd = GW_ZIGBEE_ONOFF_CMD_OFF;
-        else if (strcmp(use_cmd, "onoff.on") == 0) ocmd = GW_ZIGBEE_ONOFF_CMD_ON;
-        else if (strcmp(use_cmd, "onoff.toggle") == 0) ocmd = GW_ZIGBEE_ONOFF_CMD_TOGGLE;
-        else {
-            set_err(err, err_size, "bad cmd");
-            return ESP_ERR_INVALID_ARG;
-        }
-
-        if (has_group) {
-            uint16_t gid = 0;
-            if (!cbor_get_u16(buf, len, "group_id", &gid) || gid == 0 || gid == 0xFFFF) {
+    // Same opcodes and argument layout as compiled rules.
+    a->op = (uint8_t)gw_auto_act_op_from_cmd(req.cmd);
+    switch (a->op) {
+        case GW_AUTO_ACT_OP_SCENE_STORE:
+        case GW_AUTO_ACT_OP_SCENE_RECALL:
+            if (!(has & (1u << F_GROUP_ID))) {
                 set_err(err, err_size, "bad group_id");
                 return ESP_ERR_INVALID_ARG;
             }
-            return gw_zigbee_group_onoff_cmd(gid, ocmd);
-        }
-
-        if (!has_uid) {
-            set_err(err, err_size, "missing device_uid");
-            return ESP_ERR_INVALID_ARG;
-        }
-
-        gw_device_uid_t uid = {0};
-        if (!cbor_get_uid(buf, len, "device_uid", &uid) && !cbor_get_uid(buf, len, "uid", &uid)) {
-            set_err(err, err_size, "missing device_uid");
-            return ESP_ERR_INVALID_ARG;
-        }
-        uint8_t endpoint = 0;
-        if (!cbor_get_u8(buf, len, "endpoint", &endpoint, 1, 240)) {
-            set_err(err, err_size, "bad endpoint");
-            return ESP_ERR_INVALID_ARG;
-        }
-        return gw_zigbee_onoff_cmd(&uid, endpoint, ocmd);
-    }
-
-    // Level
-    if (strncmp(cmd, "level.", 6) == 0) {
-        if (strcmp(cmd, "level.move_to_level") != 0) {
-            set_err(err, err_size, "bad cmd");
-            return ESP_ERR_INVALID_ARG;
-        }
-
-        uint8_t level = 0;
-        if (!cbor_get_u8(buf, len, "level", &level, 0, 254)) {
-            set_err(err, err_size, "bad level");
-            return ESP_ERR_INVALID_ARG;
-        }
-        uint16_t transition_ms = 0;
-        if (!cbor_get_u16_ms_opt(buf, len, "transition_ms", &transition_ms, 60000)) {
-            set_err(err, err_size, "bad transition_ms");
-            return ESP_ERR_INVALID_ARG;
-        }
-
-        if (has_group) {
-            uint16_t gid = 0;
-            if (!cbor_get_u16(buf, len, "group_id", &gid) || gid == 0 || gid == 0xFFFF) {
-                set_err(err, err_size, "bad group_id");
+            if (!(has & (1u << F_SCENE_ID))) {
+                set_err(err, err_size, "bad scene_id");
                 return ESP_ERR_INVALID_ARG;
             }
-            gw_zigbee_level_t p = {.level = level, .transition_ms = transition_ms};
-            return gw_zigbee_group_level_move_to_level(gid, p);
-        }
-
-        gw_device_uid_t uid = {0};
-        if (!cbor_get_uid(buf, len, "device_uid", &uid) && !cbor_get_uid(buf, len, "uid", &uid)) {
-            set_err(err, err_size, "missing device_uid");
-            return ESP_ERR_INVALID_ARG;
-        }
-        uint8_t endpoint = 0;
-        if (!cbor_get_u8(buf, len, "endpoint", &endpoint, 1, 240)) {
-            set_err(err, err_size, "bad endpoint");
-            return ESP_ERR_INVALID_ARG;
-        }
-        gw_zigbee_level_t p = {.level = level, .transition_ms = transition_ms};
-        return gw_zigbee_level_move_to_level(&uid, endpoint, p);
-    }
-
-    // Color
-    if (strncmp(cmd, "color.", 6) == 0) {
-        uint16_t transition_ms = 0;
-        if (!cbor_get_u16_ms_opt(buf, len, "transition_ms", &transition_ms, 60000)) {
-            set_err(err, err_size, "bad transition_ms");
-            return ESP_ERR_INVALID_ARG;
-        }
-
-        if (has_group) {
-            uint16_t gid = 0;
-            if (!cbor_get_u16(buf, len, "group_id", &gid) || gid == 0 || gid == 0xFFFF) {
-                set_err(err, err_size, "bad group_id");
+            a->kind = GW_AUTO_ACT_SCENE;
+            a->u16_0 = req.group_id;
+            a->u16_1 = req.scene_id;
+            return ESP_OK;
+        case GW_AUTO_ACT_OP_BIND:
+        case GW_AUTO_ACT_OP_UNBIND: {
+            gw_device_uid_t src_uid = {0};
+            gw_device_uid_t dst_uid = {0};
+            if (!pick_uid(req.src_device_uid, req.src_uid, &src_uid)) {
+                set_err(err, err_size, "missing src_device_uid");
                 return ESP_ERR_INVALID_ARG;
             }
-            if (strcmp(cmd, "color.move_to_color_xy") == 0) {
-                uint16_t x = 0, y = 0;
-                if (!cbor_get_u16(buf, len, "x", &x)) {
-                    set_err(err, err_size, "bad x");
-                    return ESP_ERR_INVALID_ARG;
-                }
-                if (!cbor_get_u16(buf, len, "y", &y)) {
-                    set_err(err, err_size, "bad y");
-                    return ESP_ERR_INVALID_ARG;
-                }
-                gw_zigbee_color_xy_t p = {.x = x, .y = y, .transition_ms = transition_ms};
-                return gw_zigbee_group_color_move_to_xy(gid, p);
+            if (!pick_uid(req.dst_device_uid, req.dst_uid, &dst_uid)) {
+                set_err(err, err_size, "missing dst_device_uid");
+                return ESP_ERR_INVALID_ARG;
             }
-            if (strcmp(cmd, "color.move_to_color_temperature") == 0) {
-                uint16_t mireds = 0;
-                if (!cbor_get_u16(buf, len, "mireds", &mireds) || mireds < 1 || mireds > 1000) {
-                    set_err(err, err_size, "bad mireds");
-                    return ESP_ERR_INVALID_ARG;
-                }
-                gw_zigbee_color_temp_t p = {.mireds = mireds, .transition_ms = transition_ms};
-                return gw_zigbee_group_color_move_to_temp(gid, p);
+            if (!(has & (1u << F_SRC_ENDPOINT))) {
+                set_err(err, err_size, "bad src_endpoint");
+                return ESP_ERR_INVALID_ARG;
             }
-            set_err(err, err_size, "bad cmd");
-            return ESP_ERR_INVALID_ARG;
-        }
-
-        gw_device_uid_t uid = {0};
-        if (!cbor_get_uid(buf, len, "device_uid", &uid) && !cbor_get_uid(buf, len, "uid", &uid)) {
-            set_err(err, err_size, "missing device_uid");
-            return ESP_ERR_INVALID_ARG;
-        }
-        uint8_t endpoint = 0;
-        if (!cbor_get_u8(buf, len, "endpoint", &endpoint, 1, 240)) {
-            set_err(err, err_size, "bad endpoint");
-            return ESP_ERR_INVALID_ARG;
-        }
-
-        if (strcmp(cmd, "color.move_to_color_xy") == 0) {
-            uint16_t x = 0, y = 0;
-            if (!cbor_get_u16(buf, len, "x", &x)) {
+            if (!(has & (1u << F_DST_ENDPOINT))) {
+                set_err(err, err_size, "bad dst_endpoint");
+                return ESP_ERR_INVALID_ARG;
+            }
+            if (!(has & (1u << F_CLUSTER_ID))) {
+                set_err(err, err_size, "bad cluster_id");
+                return ESP_ERR_INVALID_ARG;
+            }
+            a->kind = GW_AUTO_ACT_BIND;
+            a->uid_off = str_tab_add(tab, src_uid.uid);
+            a->uid2_off = str_tab_add(tab, dst_uid.uid);
+            a->endpoint = req.src_endpoint;
+            a->aux_ep = req.dst_endpoint;
+            a->u16_0 = req.cluster_id;
+            return ESP_OK;
+        }
+        case GW_AUTO_ACT_OP_ONOFF_OFF:
+        case GW_AUTO_ACT_OP_ONOFF_ON:
+        case GW_AUTO_ACT_OP_ONOFF_TOGGLE:
+            break;
+        case GW_AUTO_ACT_OP_LEVEL_MOVE:
+        case GW_AUTO_ACT_OP_LEVEL_MOVE_ONOFF:
+            if (!(has & (1u << F_LEVEL))) {
+                set_err(err, err_size, "bad level");
+                return ESP_ERR_INVALID_ARG;
+            }
+            a->arg0_u32 = req.level;
+            a->arg1_u32 = req.transition_ms;
+            break;
+        case GW_AUTO_ACT_OP_COLOR_XY:
+            if (!(has & (1u << F_X))) {
                 set_err(err, err_size, "bad x");
                 return ESP_ERR_INVALID_ARG;
             }
-            if (!cbor_get_u16(buf, len, "y", &y)) {
+            if (!(has & (1u << F_Y))) {
                 set_err(err, err_size, "bad y");
                 return ESP_ERR_INVALID_ARG;
             }
-            gw_zigbee_color_xy_t p = {.x = x, .y = y, .transition_ms = transition_ms};
-            return gw_zigbee_color_move_to_xy(&uid, endpoint, p);
-        }
-        if (strcmp(cmd, "color.move_to_color_temperature") == 0) {
-            uint16_t mireds = 0;
-            if (!cbor_get_u16(buf, len, "mireds", &mireds) || mireds < 1 || mireds > 1000) {
+            a->arg0_u32 = req.x;
+            a->arg1_u32 = req.y;
+            a->arg2_u32 = req.transition_ms;
+            break;
+        case GW_AUTO_ACT_OP_COLOR_TEMP:
+            if (!(has & (1u << F_MIREDS))) {
                 set_err(err, err_size, "bad mireds");
                 return ESP_ERR_INVALID_ARG;
             }
-            gw_zigbee_color_temp_t p = {.mireds = mireds, .transition_ms = transition_ms};
-            return gw_zigbee_color_move_to_temp(&uid, endpoint, p);
-        }
+            a->arg0_u32 = req.mireds;
+            a->arg1_u32 = req.transition_ms;
+            break;
+        default:
+            set_err(err, err_size, "unknown cmd");
+            return ESP_ERR_NOT_SUPPORTED;
+    }
 
-        set_err(err, err_size, "bad cmd");
+    if (has & (1u << F_GROUP_ID)) {
+        a->kind = GW_AUTO_ACT_GROUP;
+        a->u16_0 = req.group_id;
+        return ESP_OK;
+    }
+
+    gw_device_uid_t uid = {0};
+    if (!pick_uid(req.device_uid, req.uid, &uid)) {
+        set_err(err, err_size, "missing device_uid");
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!(has & (1u << F_ENDPOINT))) {
+        set_err(err, err_size, "bad endpoint");
         return ESP_ERR_INVALID_ARG;
     }
+    a->kind = GW_AUTO_ACT_DEVICE;
+    a->uid_off = str_tab_add(tab, uid.uid);
+    a->endpoint = req.endpoint;
+    return ESP_OK;
+}
 
-    set_err(err, err_size, "unknown cmd");
-    return ESP_ERR_NOT_SUPPORTED;
+esp_err_t gw_action_exec_cbor(const uint8_t *buf, size_t len, char *err, size_t err_size)
+{
+    set_err(err, err_size, NULL);
+    char strings[1 + 2 * GW_DEVICE_UID_STRLEN] = {0};
+    str_tab_t tab = {.buf = strings, .len = 1, .cap = sizeof(strings)};
+    gw_auto_bin_action_v2_t a;
+    esp_err_t rc = action_from_cbor(buf, len, &tab, &a, err, err_size);
+    if (rc != ESP_OK) {
+        return rc;
+    }
+    gw_auto_compiled_t c = {.strings = strings};
+    c.hdr.strings_size = tab.len;
+    return gw_action_exec_compiled(&c, &a, err, err_size);
+}
+
+static gw_zigbee_onoff_cmd_t onoff_cmd_of(uint8_t op)
+{
+    if (op == GW_AUTO_ACT_OP_ONOFF_OFF) return GW_ZIGBEE_ONOFF_CMD_OFF;
+    if (op == GW_AUTO_ACT_OP_ONOFF_ON) return GW_ZIGBEE_ONOFF_CMD_ON;
+    return GW_ZIGBEE_ONOFF_CMD_TOGGLE;
 }
-esp_err_t gw_action_exec_compiled_zigbee(const char *cmd,
+
+esp_err_t gw_action_exec_compiled_zigbee(gw_auto_act_op_t op,
                                         const gw_device_uid_t *device_uid,
                                         uint8_t endpoint,
                                         uint32_t arg0_u32,
@@ -360,13 +300,7 @@ esp_err_t gw_action_exec_compiled_zigbee(const char *cmd,
                                         char *err,
                                         size_t err_size)
 {
-    (void)arg2_u32;
-
     set_err(err, err_size, NULL);
-    if (!cmd || cmd[0] == '\0') {
-        set_err(err, err_size, "missing cmd");
-        return ESP_ERR_INVALID_ARG;
-    }
     if (!device_uid || device_uid->uid[0] == '\0') {
         set_err(err, err_size, "missing device_uid");
         return ESP_ERR_INVALID_ARG;
@@ -376,41 +310,59 @@ esp_err_t gw_action_exec_compiled_zigbee(const char *cmd,
         return ESP_ERR_INVALID_ARG;
     }
 
-    if (strncmp(cmd, "onoff.", 6) == 0) {
-        gw_zigbee_onoff_cmd_t ocmd = GW_ZIGBEE_ONOFF_CMD_TOGGLE;
-        if (strcmp(cmd, "onoff.off") == 0) ocmd = GW_ZIGBEE_ONOFF_CMD_OFF;
-        else if (strcmp(cmd, "onoff.on") == 0) ocmd = GW_ZIGBEE_ONOFF_CMD_ON;
-        else if (strcmp(cmd, "onoff.toggle") == 0) ocmd = GW_ZIGBEE_ONOFF_CMD_TOGGLE;
-        else {
-            set_err(err, err_size, "bad cmd");
-            return ESP_ERR_INVALID_ARG;
-        }
-        return gw_zigbee_onoff_cmd(device_uid, endpoint, ocmd);
+    switch (op) {
+        case GW_AUTO_ACT_OP_ONOFF_OFF:
+        case GW_AUTO_ACT_OP_ONOFF_ON:
+        case GW_AUTO_ACT_OP_ONOFF_TOGGLE:
+            return gw_zigbee_onoff_cmd(device_uid, endpoint, onoff_cmd_of(op));
+        case GW_AUTO_ACT_OP_LEVEL_MOVE:
+        case GW_AUTO_ACT_OP_LEVEL_MOVE_ONOFF: {
+            gw_zigbee_level_t p = {.level = (uint8_t)arg0_u32,
+                                   .transition_ms = (uint16_t)arg1_u32,
+                                   .with_onoff = op == GW_AUTO_ACT_OP_LEVEL_MOVE_ONOFF};
+            return gw_zigbee_level_move_to_level(device_uid, endpoint, p);
+        }
+        case GW_AUTO_ACT_OP_COLOR_XY: {
+            gw_zigbee_color_xy_t p = {.x = (uint16_t)arg0_u32, .y = (uint16_t)arg1_u32, .transition_ms = (uint16_t)arg2_u32};
+            return gw_zigbee_color_move_to_xy(device_uid, endpoint, p);
+        }
+        case GW_AUTO_ACT_OP_COLOR_TEMP: {
+            gw_zigbee_color_temp_t p = {.mireds = (uint16_t)arg0_u32, .transition_ms = (uint16_t)arg1_u32};
+            return gw_zigbee_color_move_to_temp(device_uid, endpoint, p);
+        }
+        default:
+            set_err(err, err_size, "unsupported cmd");
+            return ESP_ERR_NOT_SUPPORTED;
     }
+}
 
-    if (strcmp(cmd, "level.move_to_level") == 0) {
-        if (arg0_u32 > 254) {
-            set_err(err, err_size, "bad level");
-            return ESP_ERR_INVALID_ARG;
+static esp_err_t exec_compiled_group(const gw_auto_bin_action_v2_t *action, char *err, size_t err_size)
+{
+    const uint16_t group_id = action->u16_0;
+    switch (action->op) {
+        case GW_AUTO_ACT_OP_ONOFF_OFF:
+        case GW_AUTO_ACT_OP_ONOFF_ON:
+        case GW_AUTO_ACT_OP_ONOFF_TOGGLE:
+            return gw_zigbee_group_onoff_cmd(group_id, onoff_cmd_of(action->op));
+        case GW_AUTO_ACT_OP_LEVEL_MOVE:
+        case GW_AUTO_ACT_OP_LEVEL_MOVE_ONOFF: {
+            gw_zigbee_level_t p = {.level = (uint8_t)action->arg0_u32,
+                                   .transition_ms = (uint16_t)action->arg1_u32,
+                                   .with_onoff = action->op == GW_AUTO_ACT_OP_LEVEL_MOVE_ONOFF};
+            return gw_zigbee_group_level_move_to_level(group_id, p);
         }
-        if (arg1_u32 > 60000) {
-            set_err(err, err_size, "bad transition_ms");
-            return ESP_ERR_INVALID_ARG;
+        case GW_AUTO_ACT_OP_COLOR_XY: {
+            gw_zigbee_color_xy_t p = {.x = (uint16_t)action->arg0_u32, .y = (uint16_t)action->arg1_u32, .transition_ms = (uint16_t)action->arg2_u32};
+            return gw_zigbee_group_color_move_to_xy(group_id, p);
         }
-        gw_zigbee_level_t p = {.level = (uint8_t)arg0_u32, .transition_ms = (uint16_t)arg1_u32};
-        return gw_zigbee_level_move_to_level(device_uid, endpoint, p);
+        case GW_AUTO_ACT_OP_COLOR_TEMP: {
+            gw_zigbee_color_temp_t p = {.mireds = (uint16_t)action->arg0_u32, .transition_ms = (uint16_t)action->arg1_u32};
+            return gw_zigbee_group_color_move_to_temp(group_id, p);
+        }
+        default:
+            set_err(err, err_size, "unsupported group cmd");
+            return ESP_ERR_NOT_SUPPORTED;
     }
-
-    set_err(err, err_size, "unsupported cmd");
-    return ESP_ERR_NOT_SUPPORTED;
-}
-
-static const char *strtab_at(const gw_auto_compiled_t *c, uint32_t off)
-{
-    if (!c || !c->strings) return "";
-    if (off == 0) return "";
-    if (off >= c->hdr.strings_size) return "";
-    return c->strings + off;
 }
 
 esp_err_t gw_action_exec_compiled(const gw_auto_compiled_t *compiled,
@@ -424,44 +376,36 @@ esp_err_t gw_action_exec_compiled(const gw_auto_compiled_t *compiled,
         return ESP_ERR_INVALID_ARG;
     }
 
-    const char *cmd = strtab_at(compiled, action->cmd_off);
-    if (!cmd || cmd[0] == '\0') {
-        set_err(err, err_size, "missing cmd");
-        return ESP_ERR_INVALID_ARG;
+    // The compiler paired the opcode with the action kind and range-checked its arguments.
+    switch (action->op) {
+        case GW_AUTO_ACT_OP_NONE:
+            set_err(err, err_size, "unsupported cmd");
+            return ESP_ERR_NOT_SUPPORTED;
+        case GW_AUTO_ACT_OP_SCENE_STORE:
+            return gw_zigbee_scene_store(action->u16_0, (uint8_t)action->u16_1);
+        case GW_AUTO_ACT_OP_SCENE_RECALL:
+            return gw_zigbee_scene_recall(action->u16_0, (uint8_t)action->u16_1);
+        case GW_AUTO_ACT_OP_BIND:
+        case GW_AUTO_ACT_OP_UNBIND: {
+            gw_device_uid_t src = {0};
+            gw_device_uid_t dst = {0};
+            strlcpy(src.uid, gw_auto_compiled_str(compiled, action->uid_off), sizeof(src.uid));
+            strlcpy(dst.uid, gw_auto_compiled_str(compiled, action->uid2_off), sizeof(dst.uid));
+            return action->op == GW_AUTO_ACT_OP_UNBIND
+                       ? gw_zigbee_unbind(&src, action->endpoint, action->u16_0, &dst, action->aux_ep)
+                       : gw_zigbee_bind(&src, action->endpoint, action->u16_0, &dst, action->aux_ep);
+        }
+        default:
+            break;
     }
 
-    // Device (unicast)
+    if (action->kind == GW_AUTO_ACT_GROUP) {
+        return exec_compiled_group(action, err, err_size);
+    }
     if (action->kind == GW_AUTO_ACT_DEVICE) {
-        const char *uid_s = strtab_at(compiled, action->uid_off);
         gw_device_uid_t uid = {0};
-        strlcpy(uid.uid, uid_s, sizeof(uid.uid));
-
-        if (strcmp(cmd, "color.move_to_color_xy") == 0) {
-            if (action->arg0_u32 > 65535 || action->arg1_u32 > 65535) {
-                set_err(err, err_size, "bad x/y");
-                return ESP_ERR_INVALID_ARG;
-            }
-            if (action->arg2_u32 > 60000) {
-                set_err(err, err_size, "bad transition_ms");
-                return ESP_ERR_INVALID_ARG;
-            }
-            gw_zigbee_color_xy_t p = {.x = (uint16_t)action->arg0_u32, .y = (uint16_t)action->arg1_u32, .transition_ms = (uint16_t)action->arg2_u32};
-            return gw_zigbee_color_move_to_xy(&uid, action->endpoint, p);
-        }
-        if (strcmp(cmd, "color.move_to_color_temperature") == 0) {
-            if (action->arg0_u32 < 1 || action->arg0_u32 > 1000) {
-                set_err(err, err_size, "bad mireds");
-                return ESP_ERR_INVALID_ARG;
-            }
-            if (action->arg1_u32 > 60000) {
-                set_err(err, err_size, "bad transition_ms");
-                return ESP_ERR_INVALID_ARG;
-            }
-            gw_zigbee_color_temp_t p = {.mireds = (uint16_t)action->arg0_u32, .transition_ms = (uint16_t)action->arg1_u32};
-            return gw_zigbee_color_move_to_temp(&uid, action->endpoint, p);
-        }
-
-        return gw_action_exec_compiled_zigbee(cmd,
+        strlcpy(uid.uid, gw_auto_compiled_str(compiled, action->uid_off), sizeof(uid.uid));
+        return gw_action_exec_compiled_zigbee((gw_auto_act_op_t)action->op,
                                              &uid,
                                              action->endpoint,
                                              action->arg0_u32,
@@ -471,120 +415,285 @@ esp_err_t gw_action_exec_compiled(const gw_auto_compiled_t *compiled,
                                              err_size);
     }
 
-    // Group (groupcast)
-    if (action->kind == GW_AUTO_ACT_GROUP) {
-        const uint16_t group_id = action->u16_0;
-        if (group_id == 0 || group_id == 0xFFFF) {
-            set_err(err, err_size, "bad group_id");
-            return ESP_ERR_INVALID_ARG;
-        }
+    set_err(err, err_size, "unsupported action.kind");
+    return ESP_ERR_NOT_SUPPORTED;
+}
 
-        if (strncmp(cmd, "onoff.", 6) == 0) {
-            gw_zigbee_onoff_cmd_t ocmd = GW_ZIGBEE_ONOFF_CMD_TOGGLE;
-            if (strcmp(cmd, "onoff.off") == 0) ocmd = GW_ZIGBEE_ONOFF_CMD_OFF;
-            else if (strcmp(cmd, "onoff.on") == 0) ocmd = GW_ZIGBEE_ONOFF_CMD_ON;
-            else if (strcmp(cmd, "onoff.toggle") == 0) ocmd = GW_ZIGBEE_ONOFF_CMD_TOGGLE;
-            else {
-                set_err(err, err_size, "bad cmd");
-                return ESP_ERR_INVALID_ARG;
-            }
-            return gw_zigbee_group_onoff_cmd(group_id, ocmd);
-        }
+static bool same_target(const gw_auto_compiled_t *c, const gw_auto_bin_action_v2_t *a, const gw_auto_bin_action_v2_t *b)
+{
+    return a->kind == GW_AUTO_ACT_DEVICE && b->kind == GW_AUTO_ACT_DEVICE && a->endpoint == b->endpoint &&
+           strcasecmp(gw_auto_compiled_str(c, a->uid_off), gw_auto_compiled_str(c, b->uid_off)) == 0;
+}
 
-        if (strcmp(cmd, "level.move_to_level") == 0) {
-            if (action->arg0_u32 > 254) {
-                set_err(err, err_size, "bad level");
-                return ESP_ERR_INVALID_ARG;
-            }
-            if (action->arg1_u32 > 60000) {
-                set_err(err, err_size, "bad transition_ms");
-                return ESP_ERR_INVALID_ARG;
-            }
-            gw_zigbee_level_t p = {.level = (uint8_t)action->arg0_u32, .transition_ms = (uint16_t)action->arg1_u32};
-            return gw_zigbee_group_level_move_to_level(group_id, p);
-        }
+static bool same_command(const gw_auto_bin_action_v2_t *a, const gw_auto_bin_action_v2_t *b)
+{
+    return a->op == b->op && a->arg0_u32 == b->arg0_u32 && a->arg1_u32 == b->arg1_u32 && a->arg2_u32 == b->arg2_u32;
+}
 
-        if (strcmp(cmd, "color.move_to_color_xy") == 0) {
-            if (action->arg0_u32 > 65535 || action->arg1_u32 > 65535) {
-                set_err(err, err_size, "bad x/y");
-                return ESP_ERR_INVALID_ARG;
-            }
-            if (action->arg2_u32 > 60000) {
-                set_err(err, err_size, "bad transition_ms");
-                return ESP_ERR_INVALID_ARG;
-            }
-            gw_zigbee_color_xy_t p = {.x = (uint16_t)action->arg0_u32, .y = (uint16_t)action->arg1_u32, .transition_ms = (uint16_t)action->arg2_u32};
-            return gw_zigbee_group_color_move_to_xy(group_id, p);
-        }
+// A level move that leaves the light on, so an adjacent onoff.on adds nothing.
+static bool level_turns_on(const gw_auto_bin_action_v2_t *a)
+{
+    return a->op == GW_AUTO_ACT_OP_LEVEL_MOVE && a->arg0_u32 > 0;
+}
 
-        if (strcmp(cmd, "color.move_to_color_temperature") == 0) {
-            if (action->arg0_u32 < 1 || action->arg0_u32 > 1000) {
-                set_err(err, err_size, "bad mireds");
-                return ESP_ERR_INVALID_ARG;
-            }
-            if (action->arg1_u32 > 60000) {
-                set_err(err, err_size, "bad transition_ms");
-                return ESP_ERR_INVALID_ARG;
+static uint16_t action_group(const gw_auto_compiled_t *c, const gw_auto_bin_action_v2_t *a)
+{
+    gw_device_uid_t uid = {0};
+    strlcpy(uid.uid, gw_auto_compiled_str(c, a->uid_off), sizeof(uid.uid));
+    return gw_zb_model_endpoint_group(&uid, a->endpoint);
+}
+
+// Group id when the run of one command starting at `pos` reaches every member of an
+// automatic group exactly once; 0 otherwise.
+static uint16_t plan_group_run(const gw_auto_compiled_t *c,
+                               const gw_auto_bin_action_v2_t *actions,
+                               uint32_t count,
+                               uint32_t pos,
+                               uint32_t *run_len)
+{
+    const gw_auto_bin_action_v2_t *lead = &actions[pos];
+    if (lead->kind != GW_AUTO_ACT_DEVICE) {
+        return 0;
+    }
+    if (lead->op != GW_AUTO_ACT_OP_ONOFF_ON && lead->op != GW_AUTO_ACT_OP_ONOFF_OFF &&
+        lead->op != GW_AUTO_ACT_OP_ONOFF_TOGGLE && lead->op != GW_AUTO_ACT_OP_LEVEL_MOVE) {
+        return 0;
+    }
+    const uint16_t group_id = action_group(c, lead);
+    const size_t members = group_id ? gw_zb_model_group_size(group_id) : 0;
+    if (members < 2 || members > count - pos) {
+        return 0;
+    }
+
+    uint32_t n = 1;
+    while (n < members) {
+        const gw_auto_bin_action_v2_t *a = &actions[pos + n];
+        if (a->kind != GW_AUTO_ACT_DEVICE || !same_command(lead, a) || action_group(c, a) != group_id) {
+            return 0;
+        }
+        for (uint32_t k = pos; k < pos + n; k++) {
+            if (same_target(c, &actions[k], a)) {
+                return 0;
             }
-            gw_zigbee_color_temp_t p = {.mireds = (uint16_t)action->arg0_u32, .transition_ms = (uint16_t)action->arg1_u32};
-            return gw_zigbee_group_color_move_to_temp(group_id, p);
         }
+        n++;
+    }
+    *run_len = n;
+    return group_id;
+}
 
-        set_err(err, err_size, "unsupported group cmd");
-        return ESP_ERR_NOT_SUPPORTED;
+void gw_action_plan_step(const gw_auto_compiled_t *compiled,
+                         const gw_auto_bin_action_v2_t *actions,
+                         uint32_t count,
+                         uint32_t pos,
+                         gw_action_step_t *out)
+{
+    if (!out) {
+        return;
+    }
+    memset(out, 0, sizeof(*out));
+    out->kind = GW_ACTION_STEP_SINGLE;
+    out->count = 1;
+    out->lead = pos;
+    if (!compiled || !actions || pos >= count) {
+        return;
+    }
+
+    uint32_t run = 0;
+    const uint16_t group_id = plan_group_run(compiled, actions, count, pos, &run);
+    if (group_id) {
+        out->kind = GW_ACTION_STEP_GROUP;
+        out->count = run;
+        out->group_id = group_id;
+        return;
     }
 
-    // Scenes (group-based)
-    if (action->kind == GW_AUTO_ACT_SCENE) {
-        const uint16_t group_id = action->u16_0;
-        const uint8_t scene_id = (uint8_t)action->u16_1;
-        if (group_id == 0 || group_id == 0xFFFF) {
-            set_err(err, err_size, "bad group_id");
-            return ESP_ERR_INVALID_ARG;
+    const gw_auto_bin_action_v2_t *a = &actions[pos];
+    if (pos + 1 < count && same_target(compiled, a, &actions[pos + 1])) {
+        const gw_auto_bin_action_v2_t *b = &actions[pos + 1];
+        if (a->op == GW_AUTO_ACT_OP_ONOFF_ON && level_turns_on(b)) {
+            out->kind = GW_ACTION_STEP_LEVEL_WITH_ONOFF;
+            out->count = 2;
+            out->lead = pos + 1;
+            return;
         }
-        if (scene_id == 0) {
-            set_err(err, err_size, "bad scene_id");
-            return ESP_ERR_INVALID_ARG;
+        if (level_turns_on(a) && b->op == GW_AUTO_ACT_OP_ONOFF_ON) {
+            out->kind = GW_ACTION_STEP_LEVEL_WITH_ONOFF;
+            out->count = 2;
+            return;
         }
+    }
 
-        if (strcmp(cmd, "scene.store") == 0) {
-            return gw_zigbee_scene_store(group_id, scene_id);
+    if (a->op == GW_AUTO_ACT_OP_ONOFF_ON || a->op == GW_AUTO_ACT_OP_ONOFF_OFF) {
+        while (pos + out->count < count && same_target(compiled, a, &actions[pos + out->count]) &&
+               same_command(a, &actions[pos + out->count])) {
+            out->count++;
         }
-        if (strcmp(cmd, "scene.recall") == 0) {
-            return gw_zigbee_scene_recall(group_id, scene_id);
+    }
+}
+
+esp_err_t gw_action_exec_step(const gw_auto_compiled_t *compiled,
+                              const gw_auto_bin_action_v2_t *actions,
+                              const gw_action_step_t *step,
+                              uint32_t *frames_saved,
+                              char *err,
+                              size_t err_size)
+{
+    if (frames_saved) {
+        *frames_saved = 0;
+    }
+    if (!compiled || !actions || !step || step->count == 0) {
+        set_err(err, err_size, "bad args");
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    const gw_auto_bin_action_v2_t *lead = &actions[step->lead];
+    esp_err_t rc = ESP_OK;
+    if (step->kind == GW_ACTION_STEP_GROUP) {
+        gw_auto_bin_action_v2_t g = *lead;
+        g.kind = GW_AUTO_ACT_GROUP;
+        g.u16_0 = step->group_id;
+        rc = gw_action_exec_compiled(compiled, &g, err, err_size);
+        if (rc == ESP_ERR_NOT_SUPPORTED) {
+            // No groupcast on this link: send what the group stood for.
+            rc = ESP_OK;
+            for (uint32_t i = 0; i < step->count && rc == ESP_OK; i++) {
+                rc = gw_action_exec_compiled(compiled, &lead[i], err, err_size);
+            }
+            return rc;
         }
-        set_err(err, err_size, "bad cmd");
+    } else if (step->kind == GW_ACTION_STEP_LEVEL_WITH_ONOFF) {
+        gw_device_uid_t uid = {0};
+        strlcpy(uid.uid, gw_auto_compiled_str(compiled, lead->uid_off), sizeof(uid.uid));
+        rc = gw_action_exec_compiled_zigbee(GW_AUTO_ACT_OP_LEVEL_MOVE_ONOFF, &uid, lead->endpoint, lead->arg0_u32,
+                                            lead->arg1_u32, 0, err, err_size);
+    } else {
+        rc = gw_action_exec_compiled(compiled, lead, err, err_size);
+    }
+
+    if (rc == ESP_OK && frames_saved) {
+        *frames_saved = step->count - 1;
+    }
+    return rc;
+}
+
+// Scratch for one batch; a single allocation sized for GW_ACTION_BATCH_MAX.
+typedef struct {
+    gw_auto_bin_action_v2_t actions[GW_ACTION_BATCH_MAX];
+    uint32_t item[GW_ACTION_BATCH_MAX]; // action -> request item
+    gw_action_step_t steps[GW_ACTION_BATCH_MAX];
+    uint32_t step_pos[GW_ACTION_BATCH_MAX];
+    esp_err_t step_rc[GW_ACTION_BATCH_MAX];
+    uint32_t slot_begin[GW_ACTION_BATCH_MAX]; // pipeline entries taken by the step
+    uint32_t slot_end[GW_ACTION_BATCH_MAX];
+    esp_err_t pipe[GW_ACTION_BATCH_MAX];     // one per command at most
+    char strings[1 + GW_ACTION_BATCH_MAX * 2 * GW_DEVICE_UID_STRLEN];
+} batch_ctx_t;
+
+static void batch_set_result(gw_action_result_t *r, esp_err_t rc, const char *err)
+{
+    r->rc = rc;
+    if (rc == ESP_OK) {
+        r->err[0] = '\0';
+        return;
+    }
+    set_err(r->err, sizeof(r->err), (err && err[0]) ? err : esp_err_to_name(rc));
+}
+
+esp_err_t gw_action_exec_batch_cbor(const gw_cbor_slice_t *items,
+                                    uint32_t count,
+                                    gw_action_result_t *results,
+                                    uint32_t *frames)
+{
+    if (frames) {
+        *frames = 0;
+    }
+    if (!items || !results || count == 0 || count > GW_ACTION_BATCH_MAX) {
         return ESP_ERR_INVALID_ARG;
     }
+    batch_ctx_t *b = (batch_ctx_t *)calloc(1, sizeof(*b));
+    if (!b) {
+        return ESP_ERR_NO_MEM;
+    }
 
-    // Binding / unbinding (ZDO)
-    if (action->kind == GW_AUTO_ACT_BIND) {
-        const char *src_uid_s = strtab_at(compiled, action->uid_off);
-        const char *dst_uid_s = strtab_at(compiled, action->uid2_off);
-        gw_device_uid_t src = {0};
-        gw_device_uid_t dst = {0};
-        strlcpy(src.uid, src_uid_s, sizeof(src.uid));
-        strlcpy(dst.uid, dst_uid_s, sizeof(dst.uid));
+    // Decode everything first: a bad entry is reported and left out, the rest still run.
+    str_tab_t tab = {.buf = b->strings, .len = 1, .cap = sizeof(b->strings)};
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        memset(&results[i], 0, sizeof(results[i]));
+        results[i].rc = action_from_cbor(items[i].ptr, items[i].len, &tab, &b->actions[n], results[i].err,
+                                         sizeof(results[i].err));
+        if (results[i].rc == ESP_OK) {
+            b->item[n++] = i;
+        }
+    }
+    if (n == 0) {
+        free(b);
+        return ESP_OK;
+    }
+    gw_auto_compiled_t c = {.strings = b->strings};
+    c.hdr.strings_size = tab.len;
 
-        if (src.uid[0] == '\0' || dst.uid[0] == '\0') {
-            set_err(err, err_size, "missing device uid");
-            return ESP_ERR_INVALID_ARG;
+    esp_err_t rc = gw_zigbee_pipeline_begin(b->pipe, sizeof(b->pipe) / sizeof(b->pipe[0]));
+    if (rc != ESP_OK) {
+        for (uint32_t k = 0; k < n; k++) {
+            batch_set_result(&results[b->item[k]], rc, "zigbee link busy");
         }
-        if (action->endpoint == 0 || action->aux_ep == 0) {
-            set_err(err, err_size, "bad endpoint");
-            return ESP_ERR_INVALID_ARG;
+        free(b);
+        return rc;
+    }
+
+    // Plan and send in order; with the pipeline open the commands do not wait for replies.
+    uint32_t steps = 0;
+    uint32_t sent = 0;
+    char err[sizeof(results[0].err)];
+    for (uint32_t pos = 0; pos < n; steps++) {
+        gw_action_step_t *st = &b->steps[steps];
+        gw_action_plan_step(&c, b->actions, n, pos, st);
+        uint32_t saved = 0;
+        err[0] = '\0';
+        b->step_pos[steps] = pos;
+        b->slot_begin[steps] = (uint32_t)gw_zigbee_pipeline_next();
+        b->step_rc[steps] = gw_action_exec_step(&c, b->actions, st, &saved, err, sizeof(err));
+        b->slot_end[steps] = (uint32_t)gw_zigbee_pipeline_next();
+        if (b->step_rc[steps] == ESP_OK) {
+            sent += st->count - saved;
+        } else {
+            for (uint32_t k = pos; k < pos + st->count; k++) {
+                batch_set_result(&results[b->item[k]], b->step_rc[steps], err);
+            }
         }
-        if (action->u16_0 == 0) {
-            set_err(err, err_size, "bad cluster_id");
-            return ESP_ERR_INVALID_ARG;
+        pos += st->count;
+    }
+    gw_zigbee_pipeline_end();
+
+    // A step fails when any of its pipelined commands did.
+    for (uint32_t s = 0; s < steps; s++) {
+        const gw_action_step_t *st = &b->steps[s];
+        const uint32_t pos = b->step_pos[s];
+        esp_err_t step_rc = b->step_rc[s];
+        for (uint32_t e = b->slot_begin[s]; e < b->slot_end[s] && step_rc == ESP_OK; e++) {
+            step_rc = b->pipe[e];
+        }
+        if (step_rc == ESP_ERR_NOT_SUPPORTED && st->kind == GW_ACTION_STEP_GROUP && b->step_rc[s] == ESP_OK) {
+            // The groupcast was refused on the far side: send what the group stood for.
+            sent += st->count;
+            for (uint32_t k = pos; k < pos + st->count; k++) {
+                err[0] = '\0';
+                const esp_err_t one = gw_action_exec_compiled(&c, &b->actions[k], err, sizeof(err));
+                batch_set_result(&results[b->item[k]], one, err);
+            }
+            continue;
+        }
+        if (b->step_rc[s] == ESP_OK) {
+            for (uint32_t k = pos; k < pos + st->count; k++) {
+                batch_set_result(&results[b->item[k]], step_rc, NULL);
+            }
         }
-
-        const bool unbind = (action->flags & GW_AUTO_ACT_FLAG_UNBIND) != 0;
-        return unbind ? gw_zigbee_unbind(&src, action->endpoint, action->u16_0, &dst, action->aux_ep)
-                      : gw_zigbee_bind(&src, action->endpoint, action->u16_0, &dst, action->aux_ep);
     }
-
-    set_err(err, err_size, "unsupported action.kind");
-    return ESP_ERR_NOT_SUPPORTED;
+    if (frames) {
+        *frames = sent;
+    }
+    free(b);
+    return ESP_OK;
 }
-
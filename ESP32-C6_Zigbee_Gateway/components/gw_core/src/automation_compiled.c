@@ -9,7 +9,18 @@
 #include "gw_core/cbor.h"
 #include "esp_log.h"
 
+#if defined(ESP_PLATFORM)
+#include "esp_partition.h"
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 #define MAGIC_GWAR 0x52415747u // 'GWAR'
+// Sections start 8-byte aligned so a blob can be used in place (conditions hold a double).
+#define GWAR_ALIGN(x) (((x) + 7u) & ~(size_t)7u)
 
 static void set_err(char *out, size_t out_size, const char *msg)
 {
@@ -99,11 +110,26 @@ typedef struct {
     char *buf;
     size_t len;
     size_t cap;
+    // Open-addressing dedup index over string offsets (0 = empty slot).
+    uint32_t *slots;
+    size_t slots_cap;
+    size_t slots_used;
 } strtab_t;
 
+static uint32_t strtab_hash(const uint8_t *s, size_t n)
+{
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < n; i++) {
+        h ^= s[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
 static esp_err_t strtab_init(strtab_t *t)
 {
     if (!t) return ESP_ERR_INVALID_ARG;
+    *t = (strtab_t){0};
     t->buf = (char *)calloc(1, 1);
     if (!t->buf) return ESP_ERR_NO_MEM;
     t->len = 1; // offset 0 => ""
@@ -115,21 +141,42 @@ static void strtab_free(strtab_t *t)
 {
     if (!t) return;
     free(t->buf);
+    free(t->slots);
     *t = (strtab_t){0};
 }
 
+static bool strtab_grow_slots(strtab_t *t)
+{
+    size_t next = t->slots_cap ? t->slots_cap * 2 : 32;
+    uint32_t *ns = (uint32_t *)calloc(next, sizeof(*ns));
+    if (!ns) return false;
+    for (size_t i = 0; i < t->slots_cap; i++) {
+        uint32_t off = t->slots[i];
+        if (!off) continue;
+        const char *cur = t->buf + off;
+        size_t pos = strtab_hash((const uint8_t *)cur, strlen(cur)) & (next - 1);
+        while (ns[pos]) pos = (pos + 1) & (next - 1);
+        ns[pos] = off;
+    }
+    free(t->slots);
+    t->slots = ns;
+    t->slots_cap = next;
+    return true;
+}
+
 static uint32_t strtab_add_n(strtab_t *t, const uint8_t *s, size_t n)
 {
     if (!t || !t->buf || !s || n == 0) return 0;
 
-    // de-dupe: linear scan
-    for (size_t off = 0; off < t->len;) {
-        const char *cur = t->buf + off;
-        size_t cur_n = strlen(cur);
-        if (cur_n == n && memcmp(cur, s, n) == 0) {
-            return (uint32_t)off;
+    if ((t->slots_used + 1) * 2 > t->slots_cap && !strtab_grow_slots(t)) return 0;
+
+    size_t pos = strtab_hash(s, n) & (t->slots_cap - 1);
+    while (t->slots[pos]) {
+        const char *cur = t->buf + t->slots[pos];
+        if (strncmp(cur, (const char *)s, n) == 0 && cur[n] == '\0') {
+            return t->slots[pos];
         }
-        off += cur_n + 1;
+        pos = (pos + 1) & (t->slots_cap - 1);
     }
 
     const size_t add_n = n + 1;
@@ -145,6 +192,8 @@ static uint32_t strtab_add_n(strtab_t *t, const uint8_t *s, size_t n)
     memcpy(t->buf + t->len, s, n);
     t->buf[t->len + n] = '\0';
     t->len += add_n;
+    t->slots[pos] = off;
+    t->slots_used++;
     return off;
 }
 
@@ -200,10 +249,145 @@ static bool cbor_text_is_uid(const gw_cbor_slice_t *s)
     return is_valid_uid_span(p, n);
 }
 
-static bool cbor_map_find_val(const gw_cbor_slice_t *map, const char *key, gw_cbor_slice_t *out)
+// Each compile step reads the keys it knows in one pass over its map (gw_cbor_decode_map());
+// the slice of an absent key stays empty.
+#define KEY(st_, key_, m_) GW_CBOR_FIELD(key_, GW_CBOR_FIELD_ITEM, st_, m_)
+
+typedef struct {
+    gw_cbor_slice_t id;
+    gw_cbor_slice_t name;
+    gw_cbor_slice_t enabled;
+    gw_cbor_slice_t triggers;
+    gw_cbor_slice_t conditions;
+    gw_cbor_slice_t actions;
+    gw_cbor_slice_t mode;
+    gw_cbor_slice_t max_runs;
+    gw_cbor_slice_t debounce_ms;
+    gw_cbor_slice_t throttle_ms;
+} root_keys_t;
+
+static const gw_cbor_field_t s_root_keys[] = {
+    KEY(root_keys_t, "id", id),
+    KEY(root_keys_t, "name", name),
+    KEY(root_keys_t, "enabled", enabled),
+    KEY(root_keys_t, "triggers", triggers),
+    KEY(root_keys_t, "conditions", conditions),
+    KEY(root_keys_t, "actions", actions),
+    KEY(root_keys_t, "mode", mode),
+    KEY(root_keys_t, "max_runs", max_runs),
+    KEY(root_keys_t, "debounce_ms", debounce_ms),
+    KEY(root_keys_t, "throttle_ms", throttle_ms),
+};
+
+typedef struct {
+    gw_cbor_slice_t type;
+    gw_cbor_slice_t at;
+    gw_cbor_slice_t days;
+    gw_cbor_slice_t event_type;
+    gw_cbor_slice_t for_s;
+    gw_cbor_slice_t match;
+} trigger_keys_t;
+
+static const gw_cbor_field_t s_trigger_keys[] = {
+    KEY(trigger_keys_t, "type", type),
+    KEY(trigger_keys_t, "at", at),
+    KEY(trigger_keys_t, "days", days),
+    KEY(trigger_keys_t, "event_type", event_type),
+    KEY(trigger_keys_t, "for_s", for_s),
+    KEY(trigger_keys_t, "match", match),
+};
+
+typedef struct {
+    gw_cbor_slice_t device_uid;
+    gw_cbor_slice_t endpoint;
+    gw_cbor_slice_t cmd;
+    gw_cbor_slice_t cluster;
+    gw_cbor_slice_t attr;
+} match_keys_t;
+
+static const gw_cbor_field_t s_match_keys[] = {
+    KEY(match_keys_t, "device_uid", device_uid),
+    KEY(match_keys_t, "payload.endpoint", endpoint),
+    KEY(match_keys_t, "payload.cmd", cmd),
+    KEY(match_keys_t, "payload.cluster", cluster),
+    KEY(match_keys_t, "payload.attr", attr),
+};
+
+typedef struct {
+    gw_cbor_slice_t type;
+    gw_cbor_slice_t op;
+    gw_cbor_slice_t ref;
+    gw_cbor_slice_t value;
+} cond_keys_t;
+
+static const gw_cbor_field_t s_cond_keys[] = {
+    KEY(cond_keys_t, "type", type),
+    KEY(cond_keys_t, "op", op),
+    KEY(cond_keys_t, "ref", ref),
+    KEY(cond_keys_t, "value", value),
+};
+
+typedef struct {
+    gw_cbor_slice_t device_uid;
+    gw_cbor_slice_t key;
+} ref_keys_t;
+
+static const gw_cbor_field_t s_ref_keys[] = {
+    KEY(ref_keys_t, "device_uid", device_uid),
+    KEY(ref_keys_t, "key", key),
+};
+
+typedef struct {
+    gw_cbor_slice_t type;
+    gw_cbor_slice_t ms;
+    gw_cbor_slice_t cmd;
+    gw_cbor_slice_t device_uid;
+    gw_cbor_slice_t endpoint;
+    gw_cbor_slice_t group_id;
+    gw_cbor_slice_t scene_id;
+    gw_cbor_slice_t src_device_uid;
+    gw_cbor_slice_t src_endpoint;
+    gw_cbor_slice_t dst_device_uid;
+    gw_cbor_slice_t dst_endpoint;
+    gw_cbor_slice_t cluster_id;
+    gw_cbor_slice_t level;
+    gw_cbor_slice_t x;
+    gw_cbor_slice_t y;
+    gw_cbor_slice_t mireds;
+    gw_cbor_slice_t transition_ms;
+} action_keys_t;
+
+static const gw_cbor_field_t s_action_keys[] = {
+    KEY(action_keys_t, "type", type),
+    KEY(action_keys_t, "ms", ms),
+    KEY(action_keys_t, "cmd", cmd),
+    KEY(action_keys_t, "device_uid", device_uid),
+    KEY(action_keys_t, "endpoint", endpoint),
+    KEY(action_keys_t, "group_id", group_id),
+    KEY(action_keys_t, "scene_id", scene_id),
+    KEY(action_keys_t, "src_device_uid", src_device_uid),
+    KEY(action_keys_t, "src_endpoint", src_endpoint),
+    KEY(action_keys_t, "dst_device_uid", dst_device_uid),
+    KEY(action_keys_t, "dst_endpoint", dst_endpoint),
+    KEY(action_keys_t, "cluster_id", cluster_id),
+    KEY(action_keys_t, "level", level),
+    KEY(action_keys_t, "x", x),
+    KEY(action_keys_t, "y", y),
+    KEY(action_keys_t, "mireds", mireds),
+    KEY(action_keys_t, "transition_ms", transition_ms),
+};
+
+static bool cbor_map_keys(const gw_cbor_slice_t *map, const gw_cbor_field_t *keys, size_t n, void *out)
+{
+    return map && map->ptr && map->len && gw_cbor_decode_map(map->ptr, map->len, keys, n, out, NULL, NULL);
+}
+
+#define CBOR_MAP_KEYS(map_, table_, out_) cbor_map_keys((map_), (table_), sizeof(table_) / sizeof((table_)[0]), (out_))
+
+static bool key_val(const gw_cbor_slice_t *key, gw_cbor_slice_t *out)
 {
-    if (!map || !map->ptr || map->len == 0 || !key || !out) return false;
-    return gw_cbor_map_find(map->ptr, map->len, key, out);
+    *out = *key;
+    return key->ptr != NULL;
 }
 
 static bool cbor_array_slices(const gw_cbor_slice_t *arr, gw_cbor_slice_t **out_items, uint32_t *out_count)
@@ -244,12 +428,6 @@ static bool cbor_array_slices(const gw_cbor_slice_t *arr, gw_cbor_slice_t **out_
     return true;
 }
 
-static bool cbor_is_map(const gw_cbor_slice_t *s)
-{
-    uint64_t pairs = 0;
-    return s && s->ptr && s->len && gw_cbor_top_is_map(s->ptr, s->len, &pairs);
-}
-
 static bool cbor_get_text_span(const gw_cbor_slice_t *s, const uint8_t **out_p, size_t *out_n)
 {
     if (out_p) *out_p = NULL;
@@ -290,6 +468,53 @@ static bool cbor_slice_to_double(const gw_cbor_slice_t *s, double *out)
     return false;
 }
 
+// {"type":"time","at":"HH:MM","days":[0..6]}: days are tm_wday numbers (0 = Sunday),
+// no "days" means every day.
+static esp_err_t compile_time_trigger(const trigger_keys_t *tk, gw_auto_bin_trigger_v2_t *trig, char *err, size_t err_size)
+{
+    gw_cbor_slice_t at_s = {0};
+    const uint8_t *p = NULL;
+    size_t n = 0;
+    if (!key_val(&tk->at, &at_s) || !cbor_get_text_span(&at_s, &p, &n) || !p || n != 5 || p[2] != ':' ||
+        p[0] < '0' || p[0] > '9' || p[1] < '0' || p[1] > '9' || p[3] < '0' || p[3] > '9' || p[4] < '0' || p[4] > '9') {
+        set_err(err, err_size, "bad trigger.at");
+        return ESP_ERR_INVALID_ARG;
+    }
+    const unsigned hh = (unsigned)(p[0] - '0') * 10u + (unsigned)(p[1] - '0');
+    const unsigned mm = (unsigned)(p[3] - '0') * 10u + (unsigned)(p[4] - '0');
+    if (hh > 23 || mm > 59) {
+        set_err(err, err_size, "bad trigger.at");
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    uint8_t days = 0;
+    gw_cbor_slice_t days_s = {0};
+    if (key_val(&tk->days, &days_s)) {
+        gw_cbor_slice_t *items = NULL;
+        uint32_t count = 0;
+        if (!cbor_array_slices(&days_s, &items, &count)) {
+            set_err(err, err_size, "bad trigger.days");
+            return ESP_ERR_INVALID_ARG;
+        }
+        for (uint32_t i = 0; i < count; i++) {
+            bool ok = false;
+            uint32_t d = parse_u32_any_cbor(&items[i], &ok);
+            if (!ok || d > 6) {
+                free(items);
+                set_err(err, err_size, "bad trigger.days");
+                return ESP_ERR_INVALID_ARG;
+            }
+            days |= (uint8_t)(1u << d);
+        }
+        free(items);
+    }
+
+    trig->event_type = GW_AUTO_EVT_TIME;
+    trig->attr_id = (uint16_t)(hh * 60u + mm);
+    trig->endpoint = days == 0x7f ? 0 : days;
+    return ESP_OK;
+}
+
 static esp_err_t compile_triggers(const gw_cbor_slice_t *trigger_items,
                                   uint32_t trigger_count,
                                   gw_auto_bin_trigger_v2_t *trigs,
@@ -302,7 +527,8 @@ static esp_err_t compile_triggers(const gw_cbor_slice_t *trigger_items,
 
     for (uint32_t i = 0; i < trigger_count; i++) {
         const gw_cbor_slice_t *t = &trigger_items[i];
-        if (!cbor_is_map(t)) {
+        trigger_keys_t tk = {0};
+        if (!CBOR_MAP_KEYS(t, s_trigger_keys, &tk)) {
             set_err(err, err_size, "trigger must be object");
             return ESP_ERR_INVALID_ARG;
         }
@@ -310,11 +536,17 @@ static esp_err_t compile_triggers(const gw_cbor_slice_t *trigger_items,
         gw_cbor_slice_t type_s = {0};
         gw_cbor_slice_t event_type_s = {0};
         gw_cbor_slice_t match_s = {0};
-        if (!cbor_map_find_val(t, "type", &type_s) || !cbor_text_equals(&type_s, "event")) {
+        memset(&trigs[i], 0, sizeof(trigs[i]));
+        if (key_val(&tk.type, &type_s) && cbor_text_equals(&type_s, "time")) {
+            esp_err_t rc = compile_time_trigger(&tk, &trigs[i], err, err_size);
+            if (rc != ESP_OK) return rc;
+            continue;
+        }
+        if (!type_s.ptr || !cbor_text_equals(&type_s, "event")) {
             set_err(err, err_size, "unsupported trigger.type");
             return ESP_ERR_INVALID_ARG;
         }
-        if (!cbor_map_find_val(t, "event_type", &event_type_s)) {
+        if (!key_val(&tk.event_type, &event_type_s)) {
             set_err(err, err_size, "missing trigger.event_type");
             return ESP_ERR_INVALID_ARG;
         }
@@ -344,9 +576,21 @@ static esp_err_t compile_triggers(const gw_cbor_slice_t *trigger_items,
         trigs[i].cluster_id = 0;
         trigs[i].attr_id = 0;
 
-        if (cbor_map_find_val(t, "match", &match_s) && cbor_is_map(&match_s)) {
+        gw_cbor_slice_t for_s = {0};
+        if (key_val(&tk.for_s, &for_s)) {
+            bool ok_for = false;
+            uint32_t secs = parse_u32_any_cbor(&for_s, &ok_for);
+            if (!ok_for || secs > UINT16_MAX) {
+                set_err(err, err_size, "bad trigger.for_s");
+                return ESP_ERR_INVALID_ARG;
+            }
+            trigs[i].for_s = (uint16_t)secs;
+        }
+
+        match_keys_t mk = {0};
+        if (key_val(&tk.match, &match_s) && CBOR_MAP_KEYS(&match_s, s_match_keys, &mk)) {
             gw_cbor_slice_t uid_m = {0};
-            if (cbor_map_find_val(&match_s, "device_uid", &uid_m)) {
+            if (key_val(&mk.device_uid, &uid_m)) {
                 if (!cbor_text_is_uid(&uid_m)) {
                     set_err(err, err_size, "bad trigger.device_uid");
                     return ESP_ERR_INVALID_ARG;
@@ -358,7 +602,7 @@ static esp_err_t compile_triggers(const gw_cbor_slice_t *trigger_items,
             }
 
             gw_cbor_slice_t ep_m = {0};
-            if (cbor_map_find_val(&match_s, "payload.endpoint", &ep_m)) {
+            if (key_val(&mk.endpoint, &ep_m)) {
                 bool ok16 = false;
                 uint16_t v = parse_u16_any_cbor(&ep_m, &ok16);
                 if (ok16 && v <= 240) {
@@ -368,14 +612,14 @@ static esp_err_t compile_triggers(const gw_cbor_slice_t *trigger_items,
 
             if (et == GW_AUTO_EVT_ZIGBEE_COMMAND) {
                 gw_cbor_slice_t cmd_m = {0};
-                if (cbor_map_find_val(&match_s, "payload.cmd", &cmd_m)) {
+                if (key_val(&mk.cmd, &cmd_m)) {
                     uint32_t off = 0;
                     if (cbor_text_to_strtab(&cmd_m, st, &off)) {
                         trigs[i].cmd_off = off;
                     }
                 }
                 gw_cbor_slice_t cluster_m = {0};
-                if (cbor_map_find_val(&match_s, "payload.cluster", &cluster_m)) {
+                if (key_val(&mk.cluster, &cluster_m)) {
                     bool ok16 = false;
                     uint16_t cid = parse_u16_any_cbor(&cluster_m, &ok16);
                     if (ok16) trigs[i].cluster_id = cid;
@@ -385,11 +629,11 @@ static esp_err_t compile_triggers(const gw_cbor_slice_t *trigger_items,
                 gw_cbor_slice_t attr_m = {0};
                 bool okc = false;
                 bool oka = false;
-                if (cbor_map_find_val(&match_s, "payload.cluster", &cluster_m)) {
+                if (key_val(&mk.cluster, &cluster_m)) {
                     uint16_t cid = parse_u16_any_cbor(&cluster_m, &okc);
                     if (okc) trigs[i].cluster_id = cid;
                 }
-                if (cbor_map_find_val(&match_s, "payload.attr", &attr_m)) {
+                if (key_val(&mk.attr, &attr_m)) {
                     uint16_t aid = parse_u16_any_cbor(&attr_m, &oka);
                     if (oka) trigs[i].attr_id = aid;
                 }
@@ -412,7 +656,8 @@ static esp_err_t compile_conditions(const gw_cbor_slice_t *cond_items,
 
     for (uint32_t i = 0; i < cond_count; i++) {
         const gw_cbor_slice_t *c = &cond_items[i];
-        if (!cbor_is_map(c)) {
+        cond_keys_t ck = {0};
+        if (!CBOR_MAP_KEYS(c, s_cond_keys, &ck)) {
             set_err(err, err_size, "condition must be object");
             return ESP_ERR_INVALID_ARG;
         }
@@ -420,21 +665,22 @@ static esp_err_t compile_conditions(const gw_cbor_slice_t *cond_items,
         gw_cbor_slice_t op_s = {0};
         gw_cbor_slice_t ref_s = {0};
         gw_cbor_slice_t value_s = {0};
-        if (!cbor_map_find_val(c, "type", &type_s) || !cbor_text_equals(&type_s, "state")) {
+        if (!key_val(&ck.type, &type_s) || !cbor_text_equals(&type_s, "state")) {
             set_err(err, err_size, "unsupported condition.type");
             return ESP_ERR_INVALID_ARG;
         }
-        if (!cbor_map_find_val(c, "op", &op_s)) {
+        if (!key_val(&ck.op, &op_s)) {
             set_err(err, err_size, "missing condition.op");
             return ESP_ERR_INVALID_ARG;
         }
-        if (!cbor_map_find_val(c, "ref", &ref_s) || !cbor_is_map(&ref_s)) {
+        ref_keys_t rfk = {0};
+        if (!key_val(&ck.ref, &ref_s) || !CBOR_MAP_KEYS(&ref_s, s_ref_keys, &rfk)) {
             set_err(err, err_size, "missing condition.ref");
             return ESP_ERR_INVALID_ARG;
         }
         gw_cbor_slice_t uid_s = {0};
         gw_cbor_slice_t key_s = {0};
-        if (!cbor_map_find_val(&ref_s, "device_uid", &uid_s) || !uid_s.ptr) {
+        if (!key_val(&rfk.device_uid, &uid_s) || !uid_s.ptr) {
             set_err(err, err_size, "missing condition.ref.device_uid");
             return ESP_ERR_INVALID_ARG;
         }
@@ -442,7 +688,7 @@ static esp_err_t compile_conditions(const gw_cbor_slice_t *cond_items,
             set_err(err, err_size, "bad condition.ref.device_uid");
             return ESP_ERR_INVALID_ARG;
         }
-        if (!cbor_map_find_val(&ref_s, "key", &key_s) || !key_s.ptr) {
+        if (!key_val(&rfk.key, &key_s) || !key_s.ptr) {
             set_err(err, err_size, "missing condition.ref.key");
             return ESP_ERR_INVALID_ARG;
         }
@@ -476,7 +722,7 @@ static esp_err_t compile_conditions(const gw_cbor_slice_t *cond_items,
             return ESP_ERR_INVALID_ARG;
         }
 
-        if (cbor_map_find_val(c, "value", &value_s)) {
+        if (key_val(&ck.value, &value_s)) {
             bool vb = false;
             if (gw_cbor_slice_to_bool(&value_s, &vb)) {
                 conds[i].val_type = GW_AUTO_VAL_BOOL;
@@ -517,6 +763,84 @@ static esp_err_t compile_conditions(const gw_cbor_slice_t *cond_items,
     return ESP_OK;
 }
 
+static const struct {
+    const char *cmd;
+    uint8_t op;
+} s_act_ops[] = {
+    {"onoff.off", GW_AUTO_ACT_OP_ONOFF_OFF},
+    {"off", GW_AUTO_ACT_OP_ONOFF_OFF},
+    {"onoff.on", GW_AUTO_ACT_OP_ONOFF_ON},
+    {"on", GW_AUTO_ACT_OP_ONOFF_ON},
+    {"onoff.toggle", GW_AUTO_ACT_OP_ONOFF_TOGGLE},
+    {"toggle", GW_AUTO_ACT_OP_ONOFF_TOGGLE},
+    {"level.move_to_level", GW_AUTO_ACT_OP_LEVEL_MOVE},
+    {"level.move_to_level_with_on_off", GW_AUTO_ACT_OP_LEVEL_MOVE_ONOFF},
+    {"color.move_to_color_xy", GW_AUTO_ACT_OP_COLOR_XY},
+    {"color.move_to_color_temperature", GW_AUTO_ACT_OP_COLOR_TEMP},
+    {"scene.store", GW_AUTO_ACT_OP_SCENE_STORE},
+    {"scene.recall", GW_AUTO_ACT_OP_SCENE_RECALL},
+    {"bind", GW_AUTO_ACT_OP_BIND},
+    {"bindings.bind", GW_AUTO_ACT_OP_BIND},
+    {"unbind", GW_AUTO_ACT_OP_UNBIND},
+    {"bindings.unbind", GW_AUTO_ACT_OP_UNBIND},
+    {"delay", GW_AUTO_ACT_OP_DELAY},
+};
+
+static gw_auto_act_op_t act_op_from_span(const uint8_t *p, size_t n)
+{
+    for (size_t i = 0; i < sizeof(s_act_ops) / sizeof(s_act_ops[0]); i++) {
+        if (strlen(s_act_ops[i].cmd) == n && memcmp(s_act_ops[i].cmd, p, n) == 0) {
+            return (gw_auto_act_op_t)s_act_ops[i].op;
+        }
+    }
+    return GW_AUTO_ACT_OP_NONE;
+}
+
+gw_auto_act_op_t gw_auto_act_op_from_cmd(const char *cmd)
+{
+    return cmd ? act_op_from_span((const uint8_t *)cmd, strlen(cmd)) : GW_AUTO_ACT_OP_NONE;
+}
+
+// NULL when the executor can run the record as is, else what is wrong with it.
+// The executor relies on this and does no range checks of its own.
+static const char *act_record_error(const gw_auto_bin_action_v2_t *a)
+{
+    const bool light = a->kind == GW_AUTO_ACT_DEVICE || a->kind == GW_AUTO_ACT_GROUP;
+    switch (a->op) {
+        case GW_AUTO_ACT_OP_ONOFF_OFF:
+        case GW_AUTO_ACT_OP_ONOFF_ON:
+        case GW_AUTO_ACT_OP_ONOFF_TOGGLE:
+            return light ? NULL : "unsupported action.cmd";
+        case GW_AUTO_ACT_OP_LEVEL_MOVE:
+        case GW_AUTO_ACT_OP_LEVEL_MOVE_ONOFF:
+            if (!light) return "unsupported action.cmd";
+            if (a->arg0_u32 > 254) return "bad action.level";
+            return a->arg1_u32 > GW_AUTO_TRANSITION_MAX_MS ? "bad action.transition_ms" : NULL;
+        case GW_AUTO_ACT_OP_COLOR_XY:
+            if (!light) return "unsupported action.cmd";
+            if (a->arg0_u32 > 65535) return "bad action.x";
+            if (a->arg1_u32 > 65535) return "bad action.y";
+            return a->arg2_u32 > GW_AUTO_TRANSITION_MAX_MS ? "bad action.transition_ms" : NULL;
+        case GW_AUTO_ACT_OP_COLOR_TEMP:
+            if (!light) return "unsupported action.cmd";
+            if (a->arg0_u32 < 1 || a->arg0_u32 > 1000) return "bad action.mireds";
+            return a->arg1_u32 > GW_AUTO_TRANSITION_MAX_MS ? "bad action.transition_ms" : NULL;
+        case GW_AUTO_ACT_OP_SCENE_STORE:
+        case GW_AUTO_ACT_OP_SCENE_RECALL:
+            if (a->kind != GW_AUTO_ACT_SCENE) return "unsupported action.cmd";
+            if (a->u16_0 == 0 || a->u16_0 == 0xFFFF) return "bad action.group_id";
+            return (a->u16_1 == 0 || a->u16_1 > 255) ? "bad action.scene_id" : NULL;
+        case GW_AUTO_ACT_OP_BIND:
+        case GW_AUTO_ACT_OP_UNBIND:
+            return a->kind == GW_AUTO_ACT_BIND ? NULL : "unsupported action.cmd";
+        case GW_AUTO_ACT_OP_DELAY:
+            if (a->kind != GW_AUTO_ACT_DELAY) return "unsupported action.cmd";
+            return (a->arg0_u32 == 0 || a->arg0_u32 > GW_AUTO_DELAY_MAX_MS) ? "bad action.ms" : NULL;
+        default:
+            return "unsupported action.cmd";
+    }
+}
+
 static esp_err_t compile_actions(const gw_cbor_slice_t *action_items,
                                  uint32_t action_count,
                                  gw_auto_bin_action_v2_t *acts,
@@ -529,18 +853,36 @@ static esp_err_t compile_actions(const gw_cbor_slice_t *action_items,
 
     for (uint32_t i = 0; i < action_count; i++) {
         const gw_cbor_slice_t *a = &action_items[i];
-        if (!cbor_is_map(a)) {
+        action_keys_t ak = {0};
+        if (!CBOR_MAP_KEYS(a, s_action_keys, &ak)) {
             set_err(err, err_size, "action must be object");
             return ESP_ERR_INVALID_ARG;
         }
 
         gw_cbor_slice_t type_s = {0};
         gw_cbor_slice_t cmd_s = {0};
-        if (!cbor_map_find_val(a, "type", &type_s) || !cbor_text_equals(&type_s, "zigbee")) {
+        if (key_val(&ak.type, &type_s) && cbor_text_equals(&type_s, "delay")) {
+            gw_cbor_slice_t ms_s = {0};
+            bool ok_ms = false;
+            uint32_t ms = 0;
+            if (key_val(&ak.ms, &ms_s)) {
+                ms = parse_u32_any_cbor(&ms_s, &ok_ms);
+            }
+            if (!ok_ms || ms == 0 || ms > GW_AUTO_DELAY_MAX_MS) {
+                set_err(err, err_size, "bad action.ms");
+                return ESP_ERR_INVALID_ARG;
+            }
+            acts[i].kind = GW_AUTO_ACT_DELAY;
+            acts[i].op = GW_AUTO_ACT_OP_DELAY;
+            acts[i].cmd_off = strtab_add_n(st, (const uint8_t *)"delay", 5);
+            acts[i].arg0_u32 = ms;
+            continue;
+        }
+        if (!type_s.ptr || !cbor_text_equals(&type_s, "zigbee")) {
             set_err(err, err_size, "unsupported action.type");
             return ESP_ERR_INVALID_ARG;
         }
-        if (!cbor_map_find_val(a, "cmd", &cmd_s)) {
+        if (!key_val(&ak.cmd, &cmd_s)) {
             set_err(err, err_size, "missing action.cmd");
             return ESP_ERR_INVALID_ARG;
         }
@@ -552,21 +894,25 @@ static esp_err_t compile_actions(const gw_cbor_slice_t *action_items,
         }
 
         acts[i].cmd_off = strtab_add_n(st, cmd_p, cmd_n);
+        acts[i].op = act_op_from_span(cmd_p, cmd_n);
+        if (acts[i].op == GW_AUTO_ACT_OP_NONE) {
+            set_err(err, err_size, "unsupported action.cmd");
+            return ESP_ERR_INVALID_ARG;
+        }
 
         // 1) Binding / unbinding (ZDO)
-        if (cbor_text_equals(&cmd_s, "bind") || cbor_text_equals(&cmd_s, "unbind") ||
-            cbor_text_equals(&cmd_s, "bindings.bind") || cbor_text_equals(&cmd_s, "bindings.unbind")) {
+        if (acts[i].op == GW_AUTO_ACT_OP_BIND || acts[i].op == GW_AUTO_ACT_OP_UNBIND) {
             gw_cbor_slice_t src_uid_s = {0};
             gw_cbor_slice_t src_ep_s = {0};
             gw_cbor_slice_t cluster_s = {0};
             gw_cbor_slice_t dst_uid_s = {0};
             gw_cbor_slice_t dst_ep_s = {0};
 
-            if (!cbor_map_find_val(a, "src_device_uid", &src_uid_s) || !src_uid_s.ptr) {
+            if (!key_val(&ak.src_device_uid, &src_uid_s) || !src_uid_s.ptr) {
                 set_err(err, err_size, "missing action.src_device_uid");
                 return ESP_ERR_INVALID_ARG;
             }
-            if (!cbor_map_find_val(a, "dst_device_uid", &dst_uid_s) || !dst_uid_s.ptr) {
+            if (!key_val(&ak.dst_device_uid, &dst_uid_s) || !dst_uid_s.ptr) {
                 set_err(err, err_size, "missing action.dst_device_uid");
                 return ESP_ERR_INVALID_ARG;
             }
@@ -581,7 +927,7 @@ static esp_err_t compile_actions(const gw_cbor_slice_t *action_items,
 
             bool ok_src_ep = false;
             uint16_t src_ep = 0;
-            if (cbor_map_find_val(a, "src_endpoint", &src_ep_s)) {
+            if (key_val(&ak.src_endpoint, &src_ep_s)) {
                 src_ep = parse_u16_any_cbor(&src_ep_s, &ok_src_ep);
             }
             if (!ok_src_ep || src_ep == 0 || src_ep > 240) {
@@ -591,7 +937,7 @@ static esp_err_t compile_actions(const gw_cbor_slice_t *action_items,
 
             bool ok_dst_ep = false;
             uint16_t dst_ep = 0;
-            if (cbor_map_find_val(a, "dst_endpoint", &dst_ep_s)) {
+            if (key_val(&ak.dst_endpoint, &dst_ep_s)) {
                 dst_ep = parse_u16_any_cbor(&dst_ep_s, &ok_dst_ep);
             }
             if (!ok_dst_ep || dst_ep == 0 || dst_ep > 240) {
@@ -601,7 +947,7 @@ static esp_err_t compile_actions(const gw_cbor_slice_t *action_items,
 
             bool ok_cluster = false;
             uint16_t cluster_id = 0;
-            if (cbor_map_find_val(a, "cluster_id", &cluster_s)) {
+            if (key_val(&ak.cluster_id, &cluster_s)) {
                 cluster_id = parse_u16_any_cbor(&cluster_s, &ok_cluster);
             }
             if (!ok_cluster || cluster_id == 0) {
@@ -621,19 +967,17 @@ static esp_err_t compile_actions(const gw_cbor_slice_t *action_items,
             acts[i].endpoint = (uint8_t)src_ep;
             acts[i].aux_ep = (uint8_t)dst_ep;
             acts[i].u16_0 = cluster_id;
-            acts[i].flags = (cbor_text_equals(&cmd_s, "unbind") || cbor_text_equals(&cmd_s, "bindings.unbind"))
-                                ? GW_AUTO_ACT_FLAG_UNBIND
-                                : 0;
+            acts[i].flags = acts[i].op == GW_AUTO_ACT_OP_UNBIND ? GW_AUTO_ACT_FLAG_UNBIND : 0;
             continue;
         }
 
         // 2) Scenes (group-based)
-        if (cbor_text_equals(&cmd_s, "scene.store") || cbor_text_equals(&cmd_s, "scene.recall")) {
+        if (acts[i].op == GW_AUTO_ACT_OP_SCENE_STORE || acts[i].op == GW_AUTO_ACT_OP_SCENE_RECALL) {
             gw_cbor_slice_t group_s = {0};
             gw_cbor_slice_t scene_s = {0};
             bool ok_gid = false;
             uint16_t group_id = 0;
-            if (cbor_map_find_val(a, "group_id", &group_s)) {
+            if (key_val(&ak.group_id, &group_s)) {
                 group_id = parse_u16_any_cbor(&group_s, &ok_gid);
             }
             if (!ok_gid || group_id == 0 || group_id == 0xFFFF) {
@@ -643,7 +987,7 @@ static esp_err_t compile_actions(const gw_cbor_slice_t *action_items,
 
             bool ok_scene = false;
             uint32_t scene_id = 0;
-            if (cbor_map_find_val(a, "scene_id", &scene_s)) {
+            if (key_val(&ak.scene_id, &scene_s)) {
                 scene_id = parse_u32_any_cbor(&scene_s, &ok_scene);
             }
             if (!ok_scene || scene_id == 0 || scene_id > 255) {
@@ -661,19 +1005,19 @@ static esp_err_t compile_actions(const gw_cbor_slice_t *action_items,
         gw_cbor_slice_t group_s = {0};
         bool ok_gid = false;
         uint16_t group_id = 0;
-        if (cbor_map_find_val(a, "group_id", &group_s)) {
+        if (key_val(&ak.group_id, &group_s)) {
             group_id = parse_u16_any_cbor(&group_s, &ok_gid);
         }
         if (ok_gid && group_id != 0 && group_id != 0xFFFF) {
             acts[i].kind = GW_AUTO_ACT_GROUP;
             acts[i].u16_0 = group_id;
 
-            if (cbor_text_equals(&cmd_s, "level.move_to_level")) {
+            if (acts[i].op == GW_AUTO_ACT_OP_LEVEL_MOVE || acts[i].op == GW_AUTO_ACT_OP_LEVEL_MOVE_ONOFF) {
                 gw_cbor_slice_t lvl_s = {0};
                 gw_cbor_slice_t tr_s = {0};
                 bool ok_lvl = false;
                 uint32_t lvl = 0;
-                if (cbor_map_find_val(a, "level", &lvl_s)) {
+                if (key_val(&ak.level, &lvl_s)) {
                     lvl = parse_u32_any_cbor(&lvl_s, &ok_lvl);
                 }
                 if (!ok_lvl || lvl > 254) {
@@ -682,12 +1026,12 @@ static esp_err_t compile_actions(const gw_cbor_slice_t *action_items,
                 }
                 bool ok_tr = false;
                 uint32_t tr = 0;
-                if (cbor_map_find_val(a, "transition_ms", &tr_s)) {
+                if (key_val(&ak.transition_ms, &tr_s)) {
                     tr = parse_u32_any_cbor(&tr_s, &ok_tr);
                 }
                 acts[i].arg0_u32 = lvl;
                 acts[i].arg1_u32 = ok_tr ? tr : 0;
-            } else if (cbor_text_equals(&cmd_s, "color.move_to_color_xy")) {
+            } else if (acts[i].op == GW_AUTO_ACT_OP_COLOR_XY) {
                 gw_cbor_slice_t x_s = {0};
                 gw_cbor_slice_t y_s = {0};
                 gw_cbor_slice_t tr_s = {0};
@@ -696,10 +1040,10 @@ static esp_err_t compile_actions(const gw_cbor_slice_t *action_items,
                 bool ok_y = false;
                 uint32_t x = 0;
                 uint32_t y = 0;
-                if (cbor_map_find_val(a, "x", &x_s)) {
+                if (key_val(&ak.x, &x_s)) {
                     x = parse_u32_any_cbor(&x_s, &ok_x);
                 }
-                if (cbor_map_find_val(a, "y", &y_s)) {
+                if (key_val(&ak.y, &y_s)) {
                     y = parse_u32_any_cbor(&y_s, &ok_y);
                 }
                 if (!ok_x || x > 65535) {
@@ -712,19 +1056,19 @@ static esp_err_t compile_actions(const gw_cbor_slice_t *action_items,
                 }
                 bool ok_tr = false;
                 uint32_t tr = 0;
-                if (cbor_map_find_val(a, "transition_ms", &tr_s)) {
+                if (key_val(&ak.transition_ms, &tr_s)) {
                     tr = parse_u32_any_cbor(&tr_s, &ok_tr);
                 }
                 acts[i].arg0_u32 = x;
                 acts[i].arg1_u32 = y;
                 acts[i].arg2_u32 = ok_tr ? tr : 0;
-            } else if (cbor_text_equals(&cmd_s, "color.move_to_color_temperature")) {
+            } else if (acts[i].op == GW_AUTO_ACT_OP_COLOR_TEMP) {
                 gw_cbor_slice_t m_s = {0};
                 gw_cbor_slice_t tr_s = {0};
 
                 bool ok_m = false;
                 uint32_t mireds = 0;
-                if (cbor_map_find_val(a, "mireds", &m_s)) {
+                if (key_val(&ak.mireds, &m_s)) {
                     mireds = parse_u32_any_cbor(&m_s, &ok_m);
                 }
                 if (!ok_m || mireds < 1 || mireds > 1000) {
@@ -733,7 +1077,7 @@ static esp_err_t compile_actions(const gw_cbor_slice_t *action_items,
                 }
                 bool ok_tr = false;
                 uint32_t tr = 0;
-                if (cbor_map_find_val(a, "transition_ms", &tr_s)) {
+                if (key_val(&ak.transition_ms, &tr_s)) {
                     tr = parse_u32_any_cbor(&tr_s, &ok_tr);
                 }
                 acts[i].arg0_u32 = mireds;
@@ -745,7 +1089,7 @@ static esp_err_t compile_actions(const gw_cbor_slice_t *action_items,
         // 4) Device actions (unicast)
         gw_cbor_slice_t uid_s = {0};
         gw_cbor_slice_t ep_s = {0};
-        if (!cbor_map_find_val(a, "device_uid", &uid_s) || !uid_s.ptr) {
+        if (!key_val(&ak.device_uid, &uid_s) || !uid_s.ptr) {
             set_err(err, err_size, "missing action.device_uid");
             return ESP_ERR_INVALID_ARG;
         }
@@ -755,7 +1099,7 @@ static esp_err_t compile_actions(const gw_cbor_slice_t *action_items,
         }
         bool ok_ep = false;
         uint16_t ep = 0;
-        if (cbor_map_find_val(a, "endpoint", &ep_s)) {
+        if (key_val(&ak.endpoint, &ep_s)) {
             ep = parse_u16_any_cbor(&ep_s, &ok_ep);
         }
         if (!ok_ep || ep == 0 || ep > 240) {
@@ -770,12 +1114,12 @@ static esp_err_t compile_actions(const gw_cbor_slice_t *action_items,
         }
         acts[i].endpoint = (uint8_t)ep;
 
-        if (cbor_text_equals(&cmd_s, "level.move_to_level")) {
+        if (acts[i].op == GW_AUTO_ACT_OP_LEVEL_MOVE || acts[i].op == GW_AUTO_ACT_OP_LEVEL_MOVE_ONOFF) {
             gw_cbor_slice_t lvl_s = {0};
             gw_cbor_slice_t tr_s = {0};
             bool ok_lvl = false;
             uint32_t lvl = 0;
-            if (cbor_map_find_val(a, "level", &lvl_s)) {
+            if (key_val(&ak.level, &lvl_s)) {
                 lvl = parse_u32_any_cbor(&lvl_s, &ok_lvl);
             }
             if (!ok_lvl || lvl > 254) {
@@ -784,12 +1128,12 @@ static esp_err_t compile_actions(const gw_cbor_slice_t *action_items,
             }
             bool ok_tr = false;
             uint32_t tr = 0;
-            if (cbor_map_find_val(a, "transition_ms", &tr_s)) {
+            if (key_val(&ak.transition_ms, &tr_s)) {
                 tr = parse_u32_any_cbor(&tr_s, &ok_tr);
             }
             acts[i].arg0_u32 = lvl;
             acts[i].arg1_u32 = ok_tr ? tr : 0;
-        } else if (cbor_text_equals(&cmd_s, "color.move_to_color_xy")) {
+        } else if (acts[i].op == GW_AUTO_ACT_OP_COLOR_XY) {
             gw_cbor_slice_t x_s = {0};
             gw_cbor_slice_t y_s = {0};
             gw_cbor_slice_t tr_s = {0};
@@ -798,10 +1142,10 @@ static esp_err_t compile_actions(const gw_cbor_slice_t *action_items,
             bool ok_y = false;
             uint32_t x = 0;
             uint32_t y = 0;
-            if (cbor_map_find_val(a, "x", &x_s)) {
+            if (key_val(&ak.x, &x_s)) {
                 x = parse_u32_any_cbor(&x_s, &ok_x);
             }
-            if (cbor_map_find_val(a, "y", &y_s)) {
+            if (key_val(&ak.y, &y_s)) {
                 y = parse_u32_any_cbor(&y_s, &ok_y);
             }
             if (!ok_x || x > 65535) {
@@ -814,19 +1158,19 @@ static esp_err_t compile_actions(const gw_cbor_slice_t *action_items,
             }
             bool ok_tr = false;
             uint32_t tr = 0;
-            if (cbor_map_find_val(a, "transition_ms", &tr_s)) {
+            if (key_val(&ak.transition_ms, &tr_s)) {
                 tr = parse_u32_any_cbor(&tr_s, &ok_tr);
             }
             acts[i].arg0_u32 = x;
             acts[i].arg1_u32 = y;
             acts[i].arg2_u32 = ok_tr ? tr : 0;
-        } else if (cbor_text_equals(&cmd_s, "color.move_to_color_temperature")) {
+        } else if (acts[i].op == GW_AUTO_ACT_OP_COLOR_TEMP) {
             gw_cbor_slice_t m_s = {0};
             gw_cbor_slice_t tr_s = {0};
 
             bool ok_m = false;
             uint32_t mireds = 0;
-            if (cbor_map_find_val(a, "mireds", &m_s)) {
+            if (key_val(&ak.mireds, &m_s)) {
                 mireds = parse_u32_any_cbor(&m_s, &ok_m);
             }
             if (!ok_m || mireds < 1 || mireds > 1000) {
@@ -835,7 +1179,7 @@ static esp_err_t compile_actions(const gw_cbor_slice_t *action_items,
             }
             bool ok_tr = false;
             uint32_t tr = 0;
-            if (cbor_map_find_val(a, "transition_ms", &tr_s)) {
+            if (key_val(&ak.transition_ms, &tr_s)) {
                 tr = parse_u32_any_cbor(&tr_s, &ok_tr);
             }
             acts[i].arg0_u32 = mireds;
@@ -843,6 +1187,78 @@ static esp_err_t compile_actions(const gw_cbor_slice_t *action_items,
         }
     }
 
+    // Kind/opcode pairing and the remaining argument limits (transition times).
+    for (uint32_t i = 0; i < action_count; i++) {
+        const char *msg = act_record_error(&acts[i]);
+        if (msg) {
+            set_err(err, err_size, msg);
+            return ESP_ERR_INVALID_ARG;
+        }
+    }
+    return ESP_OK;
+}
+
+static const char *const s_mode_names[] = {
+    [GW_AUTO_MODE_SINGLE] = "single",
+    [GW_AUTO_MODE_RESTART] = "restart",
+    [GW_AUTO_MODE_QUEUED] = "queued",
+    [GW_AUTO_MODE_PARALLEL] = "parallel",
+};
+
+const char *gw_auto_mode_to_str(uint8_t mode)
+{
+    if (mode < GW_AUTO_MODE_SINGLE || mode > GW_AUTO_MODE_PARALLEL) return "single";
+    return s_mode_names[mode];
+}
+
+// Optional "mode", "max_runs", "debounce_ms", "throttle_ms" keys of the root map.
+static esp_err_t compile_run_policy(const root_keys_t *rk,
+                                    uint8_t *mode,
+                                    uint16_t *max_runs,
+                                    uint32_t *debounce_ms,
+                                    uint32_t *throttle_ms,
+                                    char *err,
+                                    size_t err_size)
+{
+    gw_cbor_slice_t v = {0};
+    if (key_val(&rk->mode, &v)) {
+        uint8_t m = 0;
+        for (uint8_t i = GW_AUTO_MODE_SINGLE; i <= GW_AUTO_MODE_PARALLEL; i++) {
+            if (cbor_text_equals(&v, s_mode_names[i])) m = i;
+        }
+        if (!m) {
+            set_err(err, err_size, "bad mode");
+            return ESP_ERR_INVALID_ARG;
+        }
+        *mode = m;
+    }
+    const bool multi = *mode == GW_AUTO_MODE_QUEUED || *mode == GW_AUTO_MODE_PARALLEL;
+    *max_runs = multi ? GW_AUTO_MAX_RUNS_DEFAULT : 1;
+
+    bool ok = true;
+    // Single and restart always allow one run; a leftover max_runs is ignored there.
+    if (multi && key_val(&rk->max_runs, &v)) {
+        uint32_t n = parse_u32_any_cbor(&v, &ok);
+        if (!ok || n == 0 || n > UINT16_MAX) {
+            set_err(err, err_size, "bad max_runs");
+            return ESP_ERR_INVALID_ARG;
+        }
+        *max_runs = (uint16_t)n;
+    }
+    if (key_val(&rk->debounce_ms, &v)) {
+        *debounce_ms = parse_u32_any_cbor(&v, &ok);
+        if (!ok) {
+            set_err(err, err_size, "bad debounce_ms");
+            return ESP_ERR_INVALID_ARG;
+        }
+    }
+    if (key_val(&rk->throttle_ms, &v)) {
+        *throttle_ms = parse_u32_any_cbor(&v, &ok);
+        if (!ok) {
+            set_err(err, err_size, "bad throttle_ms");
+            return ESP_ERR_INVALID_ARG;
+        }
+    }
     return ESP_OK;
 }
 
@@ -864,30 +1280,50 @@ static esp_err_t compile_from_root_cbor(const uint8_t *buf, size_t len, gw_auto_
     }
 
     const gw_cbor_slice_t root = { .ptr = buf, .len = len };
+    root_keys_t rk = {0};
     gw_cbor_slice_t id_s = {0};
     gw_cbor_slice_t name_s = {0};
     gw_cbor_slice_t enabled_s = {0};
     gw_cbor_slice_t triggers_s = {0};
     gw_cbor_slice_t conds_s = {0};
     gw_cbor_slice_t actions_s = {0};
+    // Freed at done:, which the early exits reach too.
+    gw_cbor_slice_t *trigger_items = NULL;
+    gw_cbor_slice_t *cond_items = NULL;
+    gw_cbor_slice_t *action_items = NULL;
+    uint32_t trigger_count = 0;
+    uint32_t cond_count = 0;
+    uint32_t action_count = 0;
 
-    if (!cbor_map_find_val(&root, "id", &id_s) || !cbor_map_find_val(&root, "name", &name_s)) {
+    if (!CBOR_MAP_KEYS(&root, s_root_keys, &rk)) {
+        set_err(err, err_size, "root must be map");
+        rc = ESP_ERR_INVALID_ARG;
+        goto done;
+    }
+    if (!key_val(&rk.id, &id_s) || !key_val(&rk.name, &name_s)) {
         set_err(err, err_size, "missing id/name");
         rc = ESP_ERR_INVALID_ARG;
         goto done;
     }
-    if (!cbor_map_find_val(&root, "triggers", &triggers_s)) {
+    if (!key_val(&rk.triggers, &triggers_s)) {
         set_err(err, err_size, "missing triggers");
         rc = ESP_ERR_INVALID_ARG;
         goto done;
     }
-    if (!cbor_map_find_val(&root, "actions", &actions_s)) {
+    if (!key_val(&rk.actions, &actions_s)) {
         set_err(err, err_size, "missing actions");
         rc = ESP_ERR_INVALID_ARG;
         goto done;
     }
-    (void)cbor_map_find_val(&root, "enabled", &enabled_s);
-    (void)cbor_map_find_val(&root, "conditions", &conds_s);
+    (void)key_val(&rk.enabled, &enabled_s);
+    (void)key_val(&rk.conditions, &conds_s);
+
+    uint8_t mode = GW_AUTO_MODE_SINGLE;
+    uint16_t max_runs = 1;
+    uint32_t debounce_ms = 0;
+    uint32_t throttle_ms = 0;
+    rc = compile_run_policy(&rk, &mode, &max_runs, &debounce_ms, &throttle_ms, err, err_size);
+    if (rc != ESP_OK) goto done;
 
     const uint8_t *id_p = NULL;
     size_t id_n = 0;
@@ -904,13 +1340,6 @@ static esp_err_t compile_from_root_cbor(const uint8_t *buf, size_t len, gw_auto_
         goto done;
     }
 
-    gw_cbor_slice_t *trigger_items = NULL;
-    gw_cbor_slice_t *cond_items = NULL;
-    gw_cbor_slice_t *action_items = NULL;
-    uint32_t trigger_count = 0;
-    uint32_t cond_count = 0;
-    uint32_t action_count = 0;
-
     if (!cbor_array_slices(&triggers_s, &trigger_items, &trigger_count)) {
         set_err(err, err_size, "bad triggers");
         rc = ESP_ERR_INVALID_ARG;
@@ -950,8 +1379,10 @@ static esp_err_t compile_from_root_cbor(const uint8_t *buf, size_t len, gw_auto_
             auto_rec->enabled = b ? 1 : 0;
         }
     }
-    // Only single-run mode is supported in current runtime.
-    auto_rec->mode = 1;
+    auto_rec->mode = mode;
+    auto_rec->max_runs = max_runs;
+    auto_rec->debounce_ms = debounce_ms;
+    auto_rec->throttle_ms = throttle_ms;
     auto_rec->triggers_index = 0;
     auto_rec->triggers_count = trigger_count;
     auto_rec->conditions_index = 0;
@@ -970,7 +1401,7 @@ static esp_err_t compile_from_root_cbor(const uint8_t *buf, size_t len, gw_auto_
     // Populate output (single automation bundle)
     memset(out, 0, sizeof(*out));
     out->hdr.magic = MAGIC_GWAR;
-    out->hdr.version = 2;
+    out->hdr.version = GW_AUTO_BIN_VERSION;
     out->hdr.automation_count = 1;
     out->hdr.trigger_count_total = trigger_count;
     out->hdr.condition_count_total = cond_count;
@@ -1012,6 +1443,19 @@ esp_err_t gw_auto_compile_cbor(const uint8_t *buf, size_t len, gw_auto_compiled_
 void gw_auto_compiled_free(gw_auto_compiled_t *c)
 {
     if (!c) return;
+    if (c->blob) {
+        if (c->blob_mapped) {
+#if defined(ESP_PLATFORM)
+            esp_partition_munmap((esp_partition_mmap_handle_t)c->map_handle);
+#else
+            (void)munmap(c->blob, c->blob_len);
+#endif
+        } else if (c->blob_owned) {
+            free(c->blob);
+        }
+        *c = (gw_auto_compiled_t){0};
+        return;
+    }
     free(c->autos);
     free(c->triggers);
     free(c->conditions);
@@ -1023,7 +1467,7 @@ void gw_auto_compiled_free(gw_auto_compiled_t *c)
 esp_err_t gw_auto_compiled_serialize(const gw_auto_compiled_t *c, uint8_t **out_buf, size_t *out_len)
 {
     if (!c || !out_buf || !out_len) return ESP_ERR_INVALID_ARG;
-    if (c->hdr.magic != MAGIC_GWAR || c->hdr.version != 2) return ESP_ERR_INVALID_ARG;
+    if (c->hdr.magic != MAGIC_GWAR || c->hdr.version != GW_AUTO_BIN_VERSION) return ESP_ERR_INVALID_ARG;
 
     const size_t hdr_sz = sizeof(gw_auto_bin_header_v2_t);
     const size_t autos_sz = (size_t)c->hdr.automation_count * sizeof(gw_auto_bin_automation_v2_t);
@@ -1033,75 +1477,560 @@ esp_err_t gw_auto_compiled_serialize(const gw_auto_compiled_t *c, uint8_t **out_
     const size_t st_sz = (size_t)c->hdr.strings_size;
 
     gw_auto_bin_header_v2_t hdr = c->hdr;
-    hdr.automations_off = (uint32_t)hdr_sz;
-    hdr.triggers_off = (uint32_t)(hdr_sz + autos_sz);
-    hdr.conditions_off = (uint32_t)(hdr.triggers_off + tr_sz);
-    hdr.actions_off = (uint32_t)(hdr.conditions_off + co_sz);
-    hdr.strings_off = (uint32_t)(hdr.actions_off + ac_sz);
+    hdr.automations_off = (uint32_t)GWAR_ALIGN(hdr_sz);
+    hdr.triggers_off = (uint32_t)GWAR_ALIGN(hdr.automations_off + autos_sz);
+    hdr.conditions_off = (uint32_t)GWAR_ALIGN(hdr.triggers_off + tr_sz);
+    hdr.actions_off = (uint32_t)GWAR_ALIGN(hdr.conditions_off + co_sz);
+    hdr.strings_off = (uint32_t)GWAR_ALIGN(hdr.actions_off + ac_sz);
     hdr.strings_size = (uint32_t)st_sz;
 
-    const size_t total = hdr_sz + autos_sz + tr_sz + co_sz + ac_sz + st_sz;
+    const size_t total = hdr.strings_off + st_sz;
     uint8_t *buf = (uint8_t *)calloc(1, total);
     if (!buf) return ESP_ERR_NO_MEM;
 
     // Header: memcpy is OK (same target arch), but keep magic/version explicit to avoid surprises.
     memcpy(buf, &hdr, sizeof(hdr));
-    memcpy(buf + hdr.automations_off, c->autos, autos_sz);
-    memcpy(buf + hdr.triggers_off, c->triggers, tr_sz);
-    memcpy(buf + hdr.conditions_off, c->conditions, co_sz);
-    memcpy(buf + hdr.actions_off, c->actions, ac_sz);
-    memcpy(buf + hdr.strings_off, c->strings, st_sz);
+    if (autos_sz) memcpy(buf + hdr.automations_off, c->autos, autos_sz);
+    if (tr_sz) memcpy(buf + hdr.triggers_off, c->triggers, tr_sz);
+    if (co_sz) memcpy(buf + hdr.conditions_off, c->conditions, co_sz);
+    if (ac_sz) memcpy(buf + hdr.actions_off, c->actions, ac_sz);
+    if (st_sz) memcpy(buf + hdr.strings_off, c->strings, st_sz);
 
     *out_buf = buf;
     *out_len = total;
     return ESP_OK;
 }
 
-esp_err_t gw_auto_compiled_deserialize(const uint8_t *buf, size_t len, gw_auto_compiled_t *out)
+// On/Off opcode a trigger command names, or NONE.
+static gw_auto_act_op_t onoff_cmd_op(const char *cmd)
 {
-    if (!buf || !out || len < sizeof(gw_auto_bin_header_v2_t)) return ESP_ERR_INVALID_ARG;
+    const gw_auto_act_op_t op = gw_auto_act_op_from_cmd(cmd);
+    return (op == GW_AUTO_ACT_OP_ONOFF_OFF || op == GW_AUTO_ACT_OP_ONOFF_ON || op == GW_AUTO_ACT_OP_ONOFF_TOGGLE)
+               ? op
+               : GW_AUTO_ACT_OP_NONE;
+}
 
-    gw_auto_bin_header_v2_t hdr = {0};
-    memcpy(&hdr, buf, sizeof(hdr));
-    if (hdr.magic != MAGIC_GWAR || hdr.version != 2) return ESP_ERR_INVALID_ARG;
+// Trigger and On/Off opcode of automation `idx` if it has the shape of a binding:
+// "endpoint sends X -> device endpoints do X", nothing decided per press.
+static const gw_auto_bin_trigger_v2_t *binding_shape(const gw_auto_compiled_t *c, uint32_t idx, size_t cap,
+                                                      gw_auto_act_op_t *out_op)
+{
+    const gw_auto_bin_automation_v2_t *a = &c->autos[idx];
+    if (!a->enabled || a->triggers_count != 1 || a->conditions_count != 0 || a->actions_count == 0 ||
+        a->actions_count > cap || a->debounce_ms || a->throttle_ms) {
+        return NULL;
+    }
+    const gw_auto_bin_trigger_v2_t *t = &c->triggers[a->triggers_index];
+    if (t->event_type != GW_AUTO_EVT_ZIGBEE_COMMAND || !t->device_uid_off || !t->endpoint || t->for_s ||
+        (t->cluster_id && t->cluster_id != 0x0006)) {
+        return NULL;
+    }
+    const gw_auto_act_op_t op = onoff_cmd_op(gw_auto_compiled_str(c, t->cmd_off));
+    if (op == GW_AUTO_ACT_OP_NONE) return NULL;
+
+    const char *src_uid = gw_auto_compiled_str(c, t->device_uid_off);
+    for (uint32_t i = 0; i < a->actions_count; i++) {
+        const gw_auto_bin_action_v2_t *act = &c->actions[a->actions_index + i];
+        if (act->kind != GW_AUTO_ACT_DEVICE || !act->uid_off || !act->endpoint || act->op != op) {
+            return NULL;
+        }
+        if (act->endpoint == t->endpoint && strcmp(gw_auto_compiled_str(c, act->uid_off), src_uid) == 0) {
+            return NULL;
+        }
+    }
+    *out_op = op;
+    return t;
+}
 
-    // Basic bounds checks
-    if (hdr.strings_off > len || hdr.strings_size > len || hdr.strings_off + hdr.strings_size > len) return ESP_ERR_INVALID_ARG;
+static bool same_source(const gw_auto_compiled_t *c, const gw_auto_bin_trigger_v2_t *a,
+                        const gw_auto_bin_trigger_v2_t *b)
+{
+    return a->endpoint == b->endpoint &&
+           strcmp(gw_auto_compiled_str(c, a->device_uid_off), gw_auto_compiled_str(c, b->device_uid_off)) == 0;
+}
 
-    const size_t autos_sz = (size_t)hdr.automation_count * sizeof(gw_auto_bin_automation_v2_t);
-    const size_t tr_sz = (size_t)hdr.trigger_count_total * sizeof(gw_auto_bin_trigger_v2_t);
-    const size_t co_sz = (size_t)hdr.condition_count_total * sizeof(gw_auto_bin_condition_v2_t);
-    const size_t ac_sz = (size_t)hdr.action_count_total * sizeof(gw_auto_bin_action_v2_t);
+// Whether some binding-shaped automation turns command `op` from `src` into `op` on `dst`.
+static bool source_forwards(const gw_auto_compiled_t *c, const gw_auto_bin_trigger_v2_t *src, gw_auto_act_op_t op,
+                            const gw_auto_bin_action_v2_t *dst)
+{
+    const char *dst_uid = gw_auto_compiled_str(c, dst->uid_off);
+    for (uint32_t j = 0; j < c->hdr.automation_count; j++) {
+        gw_auto_act_op_t op_j = GW_AUTO_ACT_OP_NONE;
+        const gw_auto_bin_trigger_v2_t *t = binding_shape(c, j, SIZE_MAX, &op_j);
+        if (!t || op_j != op || !same_source(c, t, src)) continue;
+        const gw_auto_bin_automation_v2_t *a = &c->autos[j];
+        for (uint32_t i = 0; i < a->actions_count; i++) {
+            const gw_auto_bin_action_v2_t *act = &c->actions[a->actions_index + i];
+            if (act->endpoint == dst->endpoint && strcmp(gw_auto_compiled_str(c, act->uid_off), dst_uid) == 0) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
 
-    if ((size_t)hdr.automations_off + autos_sz > len) return ESP_ERR_INVALID_ARG;
-    if ((size_t)hdr.triggers_off + tr_sz > len) return ESP_ERR_INVALID_ARG;
-    if ((size_t)hdr.conditions_off + co_sz > len) return ESP_ERR_INVALID_ARG;
-    if ((size_t)hdr.actions_off + ac_sz > len) return ESP_ERR_INVALID_ARG;
+size_t gw_auto_compiled_bindings(const gw_auto_compiled_t *c, uint32_t idx, gw_auto_binding_t *out, size_t cap)
+{
+    if (!c || !out || idx >= c->hdr.automation_count) return 0;
+    gw_auto_act_op_t op = GW_AUTO_ACT_OP_NONE;
+    const gw_auto_bin_trigger_v2_t *t = binding_shape(c, idx, cap, &op);
+    if (!t) return 0;
+
+    // A binding forwards every On/Off command the source endpoint sends, not just the
+    // one the rule names. Offload only when the endpoint's rules, taken together, map
+    // on, off and toggle alike onto the same targets.
+    static const gw_auto_act_op_t k_onoff_ops[] = {
+        GW_AUTO_ACT_OP_ONOFF_ON, GW_AUTO_ACT_OP_ONOFF_OFF, GW_AUTO_ACT_OP_ONOFF_TOGGLE,
+    };
+    for (uint32_t j = 0; j < c->hdr.automation_count; j++) {
+        gw_auto_act_op_t op_j = GW_AUTO_ACT_OP_NONE;
+        const gw_auto_bin_trigger_v2_t *t_j = binding_shape(c, j, SIZE_MAX, &op_j);
+        if (!t_j || !same_source(c, t_j, t)) continue;
+        const gw_auto_bin_automation_v2_t *a_j = &c->autos[j];
+        for (uint32_t i = 0; i < a_j->actions_count; i++) {
+            for (size_t k = 0; k < sizeof(k_onoff_ops) / sizeof(k_onoff_ops[0]); k++) {
+                if (!source_forwards(c, t, k_onoff_ops[k], &c->actions[a_j->actions_index + i])) return 0;
+            }
+        }
+    }
 
+    const gw_auto_bin_automation_v2_t *a = &c->autos[idx];
+    for (uint32_t i = 0; i < a->actions_count; i++) {
+        const gw_auto_bin_action_v2_t *act = &c->actions[a->actions_index + i];
+        out[i].src_uid_off = t->device_uid_off;
+        out[i].src_endpoint = t->endpoint;
+        out[i].cluster_id = 0x0006;
+        out[i].dst_uid_off = act->uid_off;
+        out[i].dst_endpoint = act->endpoint;
+    }
+    return a->actions_count;
+}
+
+bool gw_auto_compiled_device_local(const gw_auto_compiled_t *c, uint32_t idx)
+{
+    if (!c || idx >= c->hdr.automation_count) return false;
+    const gw_auto_bin_automation_v2_t *a = &c->autos[idx];
+    // Run policy state and condition state live on the gateway side only.
+    if (!a->enabled || a->triggers_count == 0 || a->conditions_count != 0 || a->actions_count == 0 ||
+        a->debounce_ms || a->throttle_ms) {
+        return false;
+    }
+    for (uint32_t i = 0; i < a->triggers_count; i++) {
+        if (c->triggers[a->triggers_index + i].for_s) {
+            return false; // "for" waits need the gateway timers
+        }
+        switch (c->triggers[a->triggers_index + i].event_type) {
+            case GW_AUTO_EVT_ZIGBEE_COMMAND:
+            case GW_AUTO_EVT_ZIGBEE_ATTR_REPORT:
+            case GW_AUTO_EVT_DEVICE_JOIN:
+            case GW_AUTO_EVT_DEVICE_LEAVE:
+                break;
+            default:
+                return false;
+        }
+    }
+    for (uint32_t i = 0; i < a->actions_count; i++) {
+        switch (c->actions[a->actions_index + i].kind) {
+            case GW_AUTO_ACT_DEVICE:
+            case GW_AUTO_ACT_GROUP:
+            case GW_AUTO_ACT_SCENE:
+            case GW_AUTO_ACT_BIND:
+                break;
+            default:
+                return false;
+        }
+    }
+    return true;
+}
+
+static bool section_ok(const uint8_t *buf, size_t len, uint32_t off, size_t n, size_t elem, size_t align)
+{
+    if (n && elem > (SIZE_MAX / n)) return false;
+    const size_t sz = n * elem;
+    if ((size_t)off > len || sz > len - (size_t)off) return false;
+    return (((uintptr_t)(buf + off)) & (align - 1)) == 0;
+}
+
+// Version 2 automation record: same as the current one without the run policy.
+typedef struct {
+    uint32_t id_off;
+    uint32_t name_off;
+    uint8_t enabled;
+    uint8_t mode;
+    uint16_t reserved;
+    uint32_t triggers_index;
+    uint32_t triggers_count;
+    uint32_t conditions_index;
+    uint32_t conditions_count;
+    uint32_t actions_index;
+    uint32_t actions_count;
+} gwar_v2_automation_t;
+
+// Version 3 action record: same as the current one without the resolved opcode.
+typedef struct {
+    uint8_t kind;
+    uint8_t endpoint;
+    uint8_t aux_ep;
+    uint8_t flags;
+    uint16_t u16_0;
+    uint16_t u16_1;
+    uint32_t cmd_off;
+    uint32_t uid_off;
+    uint32_t uid2_off;
+    uint32_t arg0_u32;
+    uint32_t arg1_u32;
+    uint32_t arg2_u32;
+} gwar_v3_action_t;
+
+// Upgrade a version 2 or 3 blob: widen the records that grew since and resolve
+// action opcodes from their command strings; everything else is copied as is.
+static esp_err_t upgrade_old(const uint8_t *buf, size_t len, gw_auto_compiled_t *out)
+{
+    gw_auto_bin_header_v2_t hdr = {0};
+    memcpy(&hdr, buf, sizeof(hdr));
+    const size_t auto_size = hdr.version == 2 ? sizeof(gwar_v2_automation_t) : sizeof(gw_auto_bin_automation_v2_t);
+    if (!section_ok(buf, len, hdr.automations_off, hdr.automation_count, auto_size, 1) ||
+        !section_ok(buf, len, hdr.triggers_off, hdr.trigger_count_total, sizeof(gw_auto_bin_trigger_v2_t), 1) ||
+        !section_ok(buf, len, hdr.conditions_off, hdr.condition_count_total, sizeof(gw_auto_bin_condition_v2_t), 1) ||
+        !section_ok(buf, len, hdr.actions_off, hdr.action_count_total, sizeof(gwar_v3_action_t), 1) ||
+        !section_ok(buf, len, hdr.strings_off, hdr.strings_size, 1, 1) ||
+        hdr.strings_size == 0 || buf[hdr.strings_off + hdr.strings_size - 1] != '\0') {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    // Point the untouched sections into the old blob for one serialize pass; view() checks the result.
     gw_auto_compiled_t c = {0};
     c.hdr = hdr;
+    c.hdr.version = GW_AUTO_BIN_VERSION;
+    c.triggers = (gw_auto_bin_trigger_v2_t *)(buf + hdr.triggers_off);
+    c.conditions = (gw_auto_bin_condition_v2_t *)(buf + hdr.conditions_off);
+    c.strings = (char *)(buf + hdr.strings_off);
     c.autos = hdr.automation_count ? (gw_auto_bin_automation_v2_t *)calloc(hdr.automation_count, sizeof(*c.autos)) : NULL;
-    c.triggers = hdr.trigger_count_total ? (gw_auto_bin_trigger_v2_t *)calloc(hdr.trigger_count_total, sizeof(*c.triggers)) : NULL;
-    c.conditions = hdr.condition_count_total ? (gw_auto_bin_condition_v2_t *)calloc(hdr.condition_count_total, sizeof(*c.conditions)) : NULL;
     c.actions = hdr.action_count_total ? (gw_auto_bin_action_v2_t *)calloc(hdr.action_count_total, sizeof(*c.actions)) : NULL;
-    c.strings = hdr.strings_size ? (char *)calloc(1, hdr.strings_size) : NULL;
-
-    if ((hdr.automation_count && !c.autos) || (hdr.trigger_count_total && !c.triggers) || (hdr.condition_count_total && !c.conditions) ||
-        (hdr.action_count_total && !c.actions) || (hdr.strings_size && !c.strings)) {
-        gw_auto_compiled_free(&c);
+    if ((hdr.automation_count && !c.autos) || (hdr.action_count_total && !c.actions)) {
+        free(c.autos);
+        free(c.actions);
         return ESP_ERR_NO_MEM;
     }
 
-    memcpy(c.autos, buf + hdr.automations_off, autos_sz);
-    memcpy(c.triggers, buf + hdr.triggers_off, tr_sz);
-    memcpy(c.conditions, buf + hdr.conditions_off, co_sz);
-    memcpy(c.actions, buf + hdr.actions_off, ac_sz);
-    memcpy(c.strings, buf + hdr.strings_off, hdr.strings_size);
+    for (uint32_t i = 0; i < hdr.automation_count; i++) {
+        gw_auto_bin_automation_v2_t *a = &c.autos[i];
+        if (hdr.version != 2) {
+            memcpy(a, buf + hdr.automations_off + i * sizeof(*a), sizeof(*a));
+            continue;
+        }
+        gwar_v2_automation_t o;
+        memcpy(&o, buf + hdr.automations_off + i * sizeof(o), sizeof(o));
+        a->id_off = o.id_off;
+        a->name_off = o.name_off;
+        a->enabled = o.enabled;
+        a->mode = GW_AUTO_MODE_SINGLE;
+        a->max_runs = 1;
+        a->triggers_index = o.triggers_index;
+        a->triggers_count = o.triggers_count;
+        a->conditions_index = o.conditions_index;
+        a->conditions_count = o.conditions_count;
+        a->actions_index = o.actions_index;
+        a->actions_count = o.actions_count;
+    }
+
+    for (uint32_t i = 0; i < hdr.action_count_total; i++) {
+        gwar_v3_action_t o;
+        memcpy(&o, buf + hdr.actions_off + i * sizeof(o), sizeof(o));
+        gw_auto_bin_action_v2_t *a = &c.actions[i];
+        a->kind = o.kind;
+        a->endpoint = o.endpoint;
+        a->aux_ep = o.aux_ep;
+        a->flags = o.flags;
+        a->u16_0 = o.u16_0;
+        a->u16_1 = o.u16_1;
+        a->cmd_off = o.cmd_off;
+        a->uid_off = o.uid_off;
+        a->uid2_off = o.uid2_off;
+        a->arg0_u32 = o.arg0_u32;
+        a->arg1_u32 = o.arg1_u32;
+        a->arg2_u32 = o.arg2_u32;
+        // Old compilers let some commands through unchecked; those now report "unsupported" when run.
+        a->op = gw_auto_act_op_from_cmd(gw_auto_compiled_str(&c, o.cmd_off));
+        if (act_record_error(a)) a->op = GW_AUTO_ACT_OP_NONE;
+    }
+
+    esp_err_t err = gw_auto_compiled_pack(&c, out);
+    free(c.autos);
+    free(c.actions);
+    return err;
+}
+
+esp_err_t gw_auto_compiled_deserialize(const uint8_t *buf, size_t len, gw_auto_compiled_t *out)
+{
+    if (!buf || !out || len < sizeof(gw_auto_bin_header_v2_t)) return ESP_ERR_INVALID_ARG;
+
+    gw_auto_bin_header_v2_t hdr = {0};
+    memcpy(&hdr, buf, sizeof(hdr));
+    if (hdr.magic == MAGIC_GWAR && (hdr.version == 2 || hdr.version == 3)) {
+        return upgrade_old(buf, len, out);
+    }
+
+    // One copy into an aligned heap block, then use it in place.
+    uint8_t *copy = (uint8_t *)malloc(len);
+    if (!copy) return ESP_ERR_NO_MEM;
+    memcpy(copy, buf, len);
+    esp_err_t err = gw_auto_compiled_view(copy, len, out);
+    if (err != ESP_OK) {
+        free(copy);
+        return err;
+    }
+    out->blob_owned = true;
+    return ESP_OK;
+}
+
+const char *gw_auto_compiled_str(const gw_auto_compiled_t *c, uint32_t off)
+{
+    if (!c || !c->strings) return "";
+    if (off == 0) return "";
+    if (off >= c->hdr.strings_size) return "";
+    return c->strings + off;
+}
+
+int gw_auto_compiled_find(const gw_auto_compiled_t *c, const char *id)
+{
+    if (!c || !c->autos || !id || !id[0]) return -1;
+    for (uint32_t i = 0; i < c->hdr.automation_count; i++) {
+        if (strcmp(gw_auto_compiled_str(c, c->autos[i].id_off), id) == 0) {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+esp_err_t gw_auto_compiled_view(const uint8_t *buf, size_t len, gw_auto_compiled_t *out)
+{
+    if (!buf || !out || len < sizeof(gw_auto_bin_header_v2_t)) return ESP_ERR_INVALID_ARG;
 
+    gw_auto_bin_header_v2_t hdr = {0};
+    memcpy(&hdr, buf, sizeof(hdr));
+    if (hdr.magic != MAGIC_GWAR) return ESP_ERR_INVALID_ARG;
+    if (hdr.version != GW_AUTO_BIN_VERSION) {
+        return (hdr.version == 2 || hdr.version == 3) ? ESP_ERR_INVALID_VERSION : ESP_ERR_INVALID_ARG;
+    }
+
+    if (!section_ok(buf, len, hdr.automations_off, hdr.automation_count, sizeof(gw_auto_bin_automation_v2_t), 4) ||
+        !section_ok(buf, len, hdr.triggers_off, hdr.trigger_count_total, sizeof(gw_auto_bin_trigger_v2_t), 4) ||
+        !section_ok(buf, len, hdr.conditions_off, hdr.condition_count_total, sizeof(gw_auto_bin_condition_v2_t), 8) ||
+        !section_ok(buf, len, hdr.actions_off, hdr.action_count_total, sizeof(gw_auto_bin_action_v2_t), 4) ||
+        !section_ok(buf, len, hdr.strings_off, hdr.strings_size, 1, 1)) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    // String pool must start with "" and be NUL-terminated so lookups never run off the end.
+    if (hdr.strings_size == 0 || buf[hdr.strings_off] != '\0' || buf[hdr.strings_off + hdr.strings_size - 1] != '\0') {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    const gw_auto_bin_automation_v2_t *autos = (const gw_auto_bin_automation_v2_t *)(buf + hdr.automations_off);
+    for (uint32_t i = 0; i < hdr.automation_count; i++) {
+        const gw_auto_bin_automation_v2_t *a = &autos[i];
+        if (a->triggers_index > hdr.trigger_count_total || a->triggers_count > hdr.trigger_count_total - a->triggers_index ||
+            a->conditions_index > hdr.condition_count_total || a->conditions_count > hdr.condition_count_total - a->conditions_index ||
+            a->actions_index > hdr.action_count_total || a->actions_count > hdr.action_count_total - a->actions_index) {
+            return ESP_ERR_INVALID_SIZE;
+        }
+    }
+    // Opcodes are trusted by the executor, so a mapped blob gets the compiler's checks once.
+    const gw_auto_bin_action_v2_t *acts = (const gw_auto_bin_action_v2_t *)(buf + hdr.actions_off);
+    for (uint32_t i = 0; i < hdr.action_count_total; i++) {
+        if (acts[i].op != GW_AUTO_ACT_OP_NONE && act_record_error(&acts[i])) {
+            return ESP_ERR_INVALID_ARG;
+        }
+    }
+
+    gw_auto_compiled_t c = {0};
+    c.hdr = hdr;
+    c.autos = (gw_auto_bin_automation_v2_t *)(buf + hdr.automations_off);
+    c.triggers = (gw_auto_bin_trigger_v2_t *)(buf + hdr.triggers_off);
+    c.conditions = (gw_auto_bin_condition_v2_t *)(buf + hdr.conditions_off);
+    c.actions = (gw_auto_bin_action_v2_t *)(buf + hdr.actions_off);
+    c.strings = (char *)(buf + hdr.strings_off);
+    c.blob = (uint8_t *)buf;
+    c.blob_len = len;
+    c.blob_owned = false;
     *out = c;
     return ESP_OK;
 }
 
+esp_err_t gw_auto_compiled_pack(const gw_auto_compiled_t *c, gw_auto_compiled_t *out)
+{
+    if (!c || !out) return ESP_ERR_INVALID_ARG;
+    uint8_t *buf = NULL;
+    size_t len = 0;
+    esp_err_t err = gw_auto_compiled_serialize(c, &buf, &len);
+    if (err != ESP_OK) return err;
+    err = gw_auto_compiled_view(buf, len, out);
+    if (err != ESP_OK) {
+        free(buf);
+        return err;
+    }
+    out->blob_owned = true;
+    return ESP_OK;
+}
+
+static esp_err_t intern_off(strtab_t *st, const gw_auto_compiled_t *src, uint32_t off, uint32_t *out_off)
+{
+    const char *s = gw_auto_compiled_str(src, off);
+    if (!s[0]) {
+        *out_off = 0;
+        return ESP_OK;
+    }
+    *out_off = strtab_add_n(st, (const uint8_t *)s, strlen(s));
+    return *out_off ? ESP_OK : ESP_ERR_NO_MEM;
+}
+
+static esp_err_t merge_copy_one(gw_auto_compiled_t *dst, strtab_t *st, const gw_auto_compiled_t *src, uint32_t idx)
+{
+    const gw_auto_bin_automation_v2_t *sa = &src->autos[idx];
+    gw_auto_bin_automation_v2_t *da = &dst->autos[dst->hdr.automation_count++];
+    *da = *sa;
+
+    esp_err_t rc = intern_off(st, src, sa->id_off, &da->id_off);
+    if (rc == ESP_OK) rc = intern_off(st, src, sa->name_off, &da->name_off);
+
+    da->triggers_index = dst->hdr.trigger_count_total;
+    for (uint32_t i = 0; rc == ESP_OK && i < sa->triggers_count; i++) {
+        gw_auto_bin_trigger_v2_t *t = &dst->triggers[dst->hdr.trigger_count_total++];
+        *t = src->triggers[sa->triggers_index + i];
+        rc = intern_off(st, src, t->device_uid_off, &t->device_uid_off);
+        if (rc == ESP_OK) rc = intern_off(st, src, t->cmd_off, &t->cmd_off);
+    }
+
+    da->conditions_index = dst->hdr.condition_count_total;
+    for (uint32_t i = 0; rc == ESP_OK && i < sa->conditions_count; i++) {
+        gw_auto_bin_condition_v2_t *co = &dst->conditions[dst->hdr.condition_count_total++];
+        *co = src->conditions[sa->conditions_index + i];
+        rc = intern_off(st, src, co->device_uid_off, &co->device_uid_off);
+        if (rc == ESP_OK) rc = intern_off(st, src, co->key_off, &co->key_off);
+    }
+
+    da->actions_index = dst->hdr.action_count_total;
+    for (uint32_t i = 0; rc == ESP_OK && i < sa->actions_count; i++) {
+        gw_auto_bin_action_v2_t *a = &dst->actions[dst->hdr.action_count_total++];
+        *a = src->actions[sa->actions_index + i];
+        rc = intern_off(st, src, a->cmd_off, &a->cmd_off);
+        if (rc == ESP_OK) rc = intern_off(st, src, a->uid_off, &a->uid_off);
+        if (rc == ESP_OK) rc = intern_off(st, src, a->uid2_off, &a->uid2_off);
+    }
+    return rc;
+}
+
+// Output arrays of a merge/select, sized up front; merge_copy_one() fills them.
+static esp_err_t merge_begin(gw_auto_compiled_t *tmp, strtab_t *st, uint32_t n_autos, uint32_t n_tr, uint32_t n_co, uint32_t n_ac)
+{
+    memset(tmp, 0, sizeof(*tmp));
+    tmp->hdr.magic = MAGIC_GWAR;
+    tmp->hdr.version = GW_AUTO_BIN_VERSION;
+    tmp->autos = n_autos ? (gw_auto_bin_automation_v2_t *)calloc(n_autos, sizeof(*tmp->autos)) : NULL;
+    tmp->triggers = n_tr ? (gw_auto_bin_trigger_v2_t *)calloc(n_tr, sizeof(*tmp->triggers)) : NULL;
+    tmp->conditions = n_co ? (gw_auto_bin_condition_v2_t *)calloc(n_co, sizeof(*tmp->conditions)) : NULL;
+    tmp->actions = n_ac ? (gw_auto_bin_action_v2_t *)calloc(n_ac, sizeof(*tmp->actions)) : NULL;
+    esp_err_t rc = strtab_init(st);
+    if (rc == ESP_OK && ((n_autos && !tmp->autos) || (n_tr && !tmp->triggers) || (n_co && !tmp->conditions) || (n_ac && !tmp->actions))) {
+        rc = ESP_ERR_NO_MEM;
+    }
+    return rc;
+}
+
+// Pack the filled arrays into `out` (if rc is still ESP_OK) and free them.
+static esp_err_t merge_end(gw_auto_compiled_t *tmp, strtab_t *st, esp_err_t rc, gw_auto_compiled_t *out)
+{
+    if (rc == ESP_OK) {
+        tmp->strings = st->buf;
+        tmp->hdr.strings_size = (uint32_t)st->len;
+        rc = gw_auto_compiled_pack(tmp, out);
+        tmp->strings = NULL;
+    }
+
+    free(tmp->autos);
+    free(tmp->triggers);
+    free(tmp->conditions);
+    free(tmp->actions);
+    strtab_free(st);
+    return rc;
+}
+
+static bool merge_keep(const gw_auto_compiled_t *c, uint32_t i, const char *remove_id)
+{
+    return !(remove_id && remove_id[0] && strcmp(gw_auto_compiled_str(c, c->autos[i].id_off), remove_id) == 0);
+}
+
+esp_err_t gw_auto_compiled_merge(const gw_auto_compiled_t *set,
+                                 const gw_auto_compiled_t *add,
+                                 const char *remove_id,
+                                 gw_auto_compiled_t *out)
+{
+    if (!out) return ESP_ERR_INVALID_ARG;
+    const uint32_t set_n = (set && set->autos) ? set->hdr.automation_count : 0;
+    const uint32_t add_n = (add && add->autos) ? add->hdr.automation_count : 0;
+
+    // Size the output: kept set entries (replaced ones take the size of their replacement) + new ones.
+    uint32_t n_autos = 0, n_tr = 0, n_co = 0, n_ac = 0;
+    for (uint32_t i = 0; i < set_n; i++) {
+        if (!merge_keep(set, i, remove_id)) continue;
+        int ai = add_n ? gw_auto_compiled_find(add, gw_auto_compiled_str(set, set->autos[i].id_off)) : -1;
+        const gw_auto_bin_automation_v2_t *a = ai >= 0 ? &add->autos[ai] : &set->autos[i];
+        n_autos++;
+        n_tr += a->triggers_count;
+        n_co += a->conditions_count;
+        n_ac += a->actions_count;
+    }
+    for (uint32_t i = 0; i < add_n; i++) {
+        if (gw_auto_compiled_find(set, gw_auto_compiled_str(add, add->autos[i].id_off)) >= 0 && merge_keep(add, i, remove_id)) {
+            continue; // replaced in place above
+        }
+        n_autos++;
+        n_tr += add->autos[i].triggers_count;
+        n_co += add->autos[i].conditions_count;
+        n_ac += add->autos[i].actions_count;
+    }
+
+    gw_auto_compiled_t tmp;
+    strtab_t st = {0};
+    esp_err_t rc = merge_begin(&tmp, &st, n_autos, n_tr, n_co, n_ac);
+
+    for (uint32_t i = 0; rc == ESP_OK && i < set_n; i++) {
+        if (!merge_keep(set, i, remove_id)) continue;
+        int ai = add_n ? gw_auto_compiled_find(add, gw_auto_compiled_str(set, set->autos[i].id_off)) : -1;
+        rc = ai >= 0 ? merge_copy_one(&tmp, &st, add, (uint32_t)ai) : merge_copy_one(&tmp, &st, set, i);
+    }
+    for (uint32_t i = 0; rc == ESP_OK && i < add_n; i++) {
+        if (gw_auto_compiled_find(set, gw_auto_compiled_str(add, add->autos[i].id_off)) >= 0 && merge_keep(add, i, remove_id)) {
+            continue;
+        }
+        rc = merge_copy_one(&tmp, &st, add, i);
+    }
+    return merge_end(&tmp, &st, rc, out);
+}
+
+esp_err_t gw_auto_compiled_select(const gw_auto_compiled_t *set, const bool *keep, gw_auto_compiled_t *out)
+{
+    if (!out || !keep) return ESP_ERR_INVALID_ARG;
+    const uint32_t set_n = (set && set->autos) ? set->hdr.automation_count : 0;
+
+    uint32_t n_autos = 0, n_tr = 0, n_co = 0, n_ac = 0;
+    for (uint32_t i = 0; i < set_n; i++) {
+        if (!keep[i]) continue;
+        n_autos++;
+        n_tr += set->autos[i].triggers_count;
+        n_co += set->autos[i].conditions_count;
+        n_ac += set->autos[i].actions_count;
+    }
+
+    gw_auto_compiled_t tmp;
+    strtab_t st = {0};
+    esp_err_t rc = merge_begin(&tmp, &st, n_autos, n_tr, n_co, n_ac);
+    for (uint32_t i = 0; rc == ESP_OK && i < set_n; i++) {
+        if (keep[i]) rc = merge_copy_one(&tmp, &st, set, i);
+    }
+    return merge_end(&tmp, &st, rc, out);
+}
+
 esp_err_t gw_auto_compiled_write_file(const char *path, const gw_auto_compiled_t *c)
 {
     if (!path || !c) return ESP_ERR_INVALID_ARG;
@@ -1139,7 +2068,7 @@ esp_err_t gw_auto_compiled_read_file(const char *path, gw_auto_compiled_t *out)
         fclose(f);
         return ESP_FAIL;
     }
-    uint8_t *buf = (uint8_t *)calloc(1, (size_t)sz);
+    uint8_t *buf = (uint8_t *)malloc((size_t)sz);
     if (!buf) {
         fclose(f);
         return ESP_ERR_NO_MEM;
@@ -1150,7 +2079,59 @@ esp_err_t gw_auto_compiled_read_file(const char *path, gw_auto_compiled_t *out)
         free(buf);
         return ESP_FAIL;
     }
-    esp_err_t err = gw_auto_compiled_deserialize(buf, (size_t)sz, out);
-    free(buf);
-    return err;
+    // The read buffer becomes the blob; sections are not copied out again.
+    esp_err_t err = gw_auto_compiled_view(buf, (size_t)sz, out);
+    if (err != ESP_OK) {
+        free(buf);
+        return err;
+    }
+    out->blob_owned = true;
+    return ESP_OK;
+}
+
+#if defined(ESP_PLATFORM)
+esp_err_t gw_auto_compiled_map_partition(const char *label, size_t offset, size_t len, gw_auto_compiled_t *out)
+{
+    if (!label || !out || len < sizeof(gw_auto_bin_header_v2_t)) return ESP_ERR_INVALID_ARG;
+    const esp_partition_t *part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, label);
+    if (!part) return ESP_ERR_NOT_FOUND;
+    if (offset > part->size || len > part->size - offset) return ESP_ERR_INVALID_SIZE;
+
+    const void *ptr = NULL;
+    esp_partition_mmap_handle_t handle = 0;
+    esp_err_t err = esp_partition_mmap(part, offset, len, ESP_PARTITION_MMAP_DATA, &ptr, &handle);
+    if (err != ESP_OK) return err;
+
+    err = gw_auto_compiled_view((const uint8_t *)ptr, len, out);
+    if (err != ESP_OK) {
+        esp_partition_munmap(handle);
+        return err;
+    }
+    out->blob_mapped = true;
+    out->map_handle = (uint32_t)handle;
+    return ESP_OK;
+}
+#else
+esp_err_t gw_auto_compiled_map_file(const char *path, gw_auto_compiled_t *out)
+{
+    if (!path || !out) return ESP_ERR_INVALID_ARG;
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return ESP_ERR_NOT_FOUND;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+        close(fd);
+        return ESP_FAIL;
+    }
+    void *ptr = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (ptr == MAP_FAILED) return ESP_FAIL;
+
+    esp_err_t err = gw_auto_compiled_view((const uint8_t *)ptr, (size_t)st.st_size, out);
+    if (err != ESP_OK) {
+        (void)munmap(ptr, (size_t)st.st_size);
+        return err;
+    }
+    out->blob_mapped = true;
+    return ESP_OK;
 }
+#endif
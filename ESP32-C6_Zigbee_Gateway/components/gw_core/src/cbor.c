@@ -281,6 +281,124 @@ bool gw_cbor_slice_to_text_span(const gw_cbor_slice_t *s, const uint8_t **out_pt
     return true;
 }
 
+// ---- schema-driven map decoding ----
+
+static bool decode_int_range(const gw_cbor_field_t *f, int64_t v)
+{
+    int64_t lo = 0;
+    int64_t hi = 0;
+    switch (f->type) {
+        case GW_CBOR_FIELD_U8: hi = UINT8_MAX; break;
+        case GW_CBOR_FIELD_U16: hi = UINT16_MAX; break;
+        case GW_CBOR_FIELD_U32: hi = UINT32_MAX; break;
+        case GW_CBOR_FIELD_I16: lo = INT16_MIN; hi = INT16_MAX; break;
+        case GW_CBOR_FIELD_I32: lo = INT32_MIN; hi = INT32_MAX; break;
+        default: lo = INT64_MIN; hi = INT64_MAX; break;
+    }
+    if (f->min || f->max) {
+        lo = f->min;
+        hi = f->max;
+    }
+    return v >= lo && v <= hi;
+}
+
+static bool decode_field(const gw_cbor_field_t *f, const gw_cbor_slice_t *v, uint8_t *dst)
+{
+    switch (f->type) {
+        case GW_CBOR_FIELD_ITEM:
+            memcpy(dst, v, sizeof(*v));
+            return true;
+        case GW_CBOR_FIELD_TEXT: {
+            const uint8_t *p = NULL;
+            size_t n = 0;
+            if (!gw_cbor_slice_to_text_span(v, &p, &n) || n + 1 > f->size) return false;
+            memcpy(dst, p, n);
+            dst[n] = '\0';
+            return true;
+        }
+        case GW_CBOR_FIELD_BOOL: {
+            bool b = false;
+            if (!gw_cbor_slice_to_bool(v, &b)) return false;
+            memcpy(dst, &b, sizeof(b));
+            return true;
+        }
+        case GW_CBOR_FIELD_F64: {
+            double d = 0.0;
+            if (!gw_cbor_slice_to_f64(v, &d)) return false;
+            memcpy(dst, &d, sizeof(d));
+            return true;
+        }
+        default:
+            break;
+    }
+
+    int64_t iv = 0;
+    uint64_t uv = 0;
+    if (gw_cbor_slice_to_u64(v, &uv)) {
+        if (uv > INT64_MAX) return false;
+        iv = (int64_t)uv;
+    } else if (!gw_cbor_slice_to_i64(v, &iv)) {
+        return false;
+    }
+    if (!decode_int_range(f, iv)) return false;
+    switch (f->type) {
+        case GW_CBOR_FIELD_U8: *dst = (uint8_t)iv; break;
+        case GW_CBOR_FIELD_U16: { uint16_t x = (uint16_t)iv; memcpy(dst, &x, sizeof(x)); break; }
+        case GW_CBOR_FIELD_U32: { uint32_t x = (uint32_t)iv; memcpy(dst, &x, sizeof(x)); break; }
+        case GW_CBOR_FIELD_I16: { int16_t x = (int16_t)iv; memcpy(dst, &x, sizeof(x)); break; }
+        case GW_CBOR_FIELD_I32: { int32_t x = (int32_t)iv; memcpy(dst, &x, sizeof(x)); break; }
+        case GW_CBOR_FIELD_I64: memcpy(dst, &iv, sizeof(iv)); break;
+        default: return false;
+    }
+    return true;
+}
+
+bool gw_cbor_decode_map(const uint8_t *buf,
+                        size_t len,
+                        const gw_cbor_field_t *fields,
+                        size_t n_fields,
+                        void *out,
+                        uint32_t *out_present,
+                        int *out_bad)
+{
+    if (out_bad) *out_bad = -1;
+    if (out_present) *out_present = 0;
+    if (!buf || len == 0 || (!fields && n_fields) || n_fields > GW_CBOR_MAX_FIELDS || !out) return false;
+
+    gw_cbor_reader_t r = {0};
+    gw_cbor_reader_init(&r, buf, len);
+    uint8_t ib = 0;
+    if (!gw_cbor_read_u8(&r, &ib) || (ib >> 5) != 5) return false;
+    uint64_t pairs = 0;
+    if (!gw_cbor_read_uint_arg(&r, (uint8_t)(ib & 0x1f), &pairs)) return false;
+
+    uint32_t present = 0;
+    for (uint64_t i = 0; i < pairs; i++) {
+        uint8_t kb = 0;
+        if (!gw_cbor_read_u8(&r, &kb) || (kb >> 5) != 3) return false;
+        const uint8_t *kptr = NULL;
+        size_t klen = 0;
+        if (!gw_cbor_read_text_span(&r, (uint8_t)(kb & 0x1f), &kptr, &klen)) return false;
+
+        const uint8_t *vstart = r.p;
+        if (!gw_cbor_skip_item(&r)) return false;
+
+        for (size_t f = 0; f < n_fields; f++) {
+            if (strlen(fields[f].key) != klen || memcmp(fields[f].key, kptr, klen) != 0) continue;
+            if (present & (1u << f)) break;
+            const gw_cbor_slice_t v = {.ptr = vstart, .len = (size_t)(r.p - vstart)};
+            if (!decode_field(&fields[f], &v, (uint8_t *)out + fields[f].offset)) {
+                if (out_bad) *out_bad = (int)f;
+                return false;
+            }
+            present |= 1u << f;
+            break;
+        }
+    }
+    if (out_present) *out_present = present;
+    return true;
+}
+
 // ---- writer ----
 
 static esp_err_t wr_reserve(gw_cbor_writer_t *w, size_t add)
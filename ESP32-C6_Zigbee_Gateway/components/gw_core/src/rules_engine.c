@@ -1,49 +1,47 @@
 #include "gw_core/rules_engine.h"
 
-#include <math.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "esp_err.h"
 #include "esp_log.h"
-#include "esp_timer.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/queue.h"
+#include "freertos/semphr.h"
 #include "freertos/task.h"
+#include "nvs.h"
 
 #include "gw_core/action_exec.h"
-#include "gw_core/automation_store.h"
+#include "gw_core/automation_compiled.h"
 #include "gw_core/event_bus.h"
+#include "gw_core/rules_index.h"
 #include "gw_core/state_store.h"
 #include "gw_core/types.h"
 
 static const char *TAG = "gw_rules";
 
-#define GW_AUTOMATION_CAP 32
 #define GW_RULES_EVENT_Q_CAP 96
 #define GW_RULES_TASK_PRIO 7
+#define GW_RULES_NVS_NAMESPACE "rules"
+#define GW_RULES_NVS_KEY "bundle"
 
-static portMUX_TYPE s_cache_lock = portMUX_INITIALIZER_UNLOCKED;
-static gw_automation_entry_t s_cache_a[GW_AUTOMATION_CAP];
-static gw_automation_entry_t s_cache_b[GW_AUTOMATION_CAP];
-static gw_automation_entry_t *s_cache = s_cache_a;
-static size_t s_cache_count;
-static bool s_cache_use_a = true;
+// Automations the S3 placed on the C6: the packed set followed by its trigger
+// index (see gw_core/rules_index.h) in one heap block, replaced as a whole.
+typedef struct {
+    gw_auto_compiled_t set;
+    gw_rules_index_t ix;
+} rules_bundle_t;
+
+static SemaphoreHandle_t s_lock;
+static rules_bundle_t *s_bundle;
 
 static bool s_inited;
 static QueueHandle_t s_q;
 static TaskHandle_t s_task;
 
-static const char *strtab_at(const gw_automation_entry_t *entry, uint32_t off)
-{
-    if (!entry) return "";
-    if (off == 0) return "";
-    if (off >= entry->string_table_size) return "";
-    return entry->string_table + off;
-}
-
 static void publish_rules_fired(const gw_event_t *e, const char *automation_id)
 {
     char msg[128];
@@ -51,188 +49,179 @@ static void publish_rules_fired(const gw_event_t *e, const char *automation_id)
     gw_event_bus_publish("rules.fired", "rules", e ? e->device_uid : "", e ? e->short_addr : 0, msg);
 }
 
-static void publish_rules_action(const char *automation_id, size_t idx, bool ok, const char *err)
+// `idx` is the first action of the planned step; `frames_saved` counts the Zigbee frames
+// the planner folded away (see gw_action_plan_step()).
+static void publish_rules_action(const char *automation_id, size_t idx, const char *err, uint32_t frames_saved)
 {
     char msg[192];
     if (err) {
         snprintf(msg, sizeof(msg), "automation_id=%s idx=%u ok=0 err=%s", automation_id, (unsigned)idx, err);
     } else {
-        snprintf(msg, sizeof(msg), "automation_id=%s idx=%u ok=1", automation_id, (unsigned)idx);
+        snprintf(msg, sizeof(msg), "automation_id=%s idx=%u ok=1 frames_saved=%u", automation_id, (unsigned)idx,
+                 (unsigned)frames_saved);
     }
     gw_event_bus_publish("rules.action", "rules", "", 0, msg);
 }
 
-typedef struct {
-    uint8_t endpoint;
-    bool has_endpoint;
-    char cmd_buf[32];
-    const char *cmd;
-    bool has_cmd;
-    uint16_t cluster_id;
-    bool has_cluster;
-    uint16_t attr_id;
-    bool has_attr;
-} event_payload_view_t;
-
-static void build_payload_view_from_event(const gw_event_t *e, event_payload_view_t *out)
+static void rules_bundle_free(rules_bundle_t *b)
 {
-    memset(out, 0, sizeof(*out));
-    if (!e) return;
-
-    if (e->payload_flags & GW_EVENT_PAYLOAD_HAS_ENDPOINT) {
-        out->endpoint = e->payload_endpoint;
-        out->has_endpoint = true;
-    }
-    if (e->payload_flags & GW_EVENT_PAYLOAD_HAS_CMD) {
-        strlcpy(out->cmd_buf, e->payload_cmd, sizeof(out->cmd_buf));
-        out->cmd = out->cmd_buf;
-        out->has_cmd = out->cmd_buf[0] != '\0';
+    if (!b) {
+        return;
     }
-    if (e->payload_flags & GW_EVENT_PAYLOAD_HAS_CLUSTER) {
-        out->cluster_id = e->payload_cluster;
-        out->has_cluster = true;
+    gw_auto_compiled_free(&b->set);
+    free(b);
+}
+
+static esp_err_t rules_bundle_build(const uint8_t *buf, size_t len, rules_bundle_t **out)
+{
+    gw_auto_compiled_t set = {0};
+    esp_err_t err = gw_auto_compiled_deserialize(buf, len, &set);
+    if (err != ESP_OK) {
+        return err;
     }
-    if (e->payload_flags & GW_EVENT_PAYLOAD_HAS_ATTR) {
-        out->attr_id = e->payload_attr;
-        out->has_attr = true;
+
+    size_t index_cap = 0;
+    size_t mask_words = 0;
+    gw_rules_index_geometry(&set, &index_cap, &mask_words);
+    rules_bundle_t *b = (rules_bundle_t *)calloc(1, sizeof(*b) + gw_rules_index_block_size(index_cap, mask_words));
+    if (!b) {
+        gw_auto_compiled_free(&set);
+        return ESP_ERR_NO_MEM;
     }
+    b->set = set;
+    gw_rules_index_attach(&b->ix, b + 1, index_cap, mask_words);
+    gw_rules_index_fill(&b->ix, &b->set);
+    *out = b;
+    return ESP_OK;
 }
 
-static gw_auto_evt_type_t evt_type_from_event(const gw_event_t *e)
+static void rules_bundle_swap(rules_bundle_t *next)
 {
-    if (strcmp(e->type, "zigbee.command") == 0) return GW_AUTO_EVT_ZIGBEE_COMMAND;
-    if (strcmp(e->type, "zigbee.attr_report") == 0) return GW_AUTO_EVT_ZIGBEE_ATTR_REPORT;
-    if (strcmp(e->type, "device.join") == 0) return GW_AUTO_EVT_DEVICE_JOIN;
-    if (strcmp(e->type, "device.leave") == 0) return GW_AUTO_EVT_DEVICE_LEAVE;
-    return 0;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    rules_bundle_t *old = s_bundle;
+    s_bundle = next;
+    xSemaphoreGive(s_lock);
+    rules_bundle_free(old);
+    ESP_LOGI(TAG, "rules bundle: %u automations", next ? (unsigned)next->set.hdr.automation_count : 0u);
 }
 
-static bool trigger_matches(const gw_automation_entry_t *entry, const gw_auto_bin_trigger_v2_t *t, gw_auto_evt_type_t evt_type, const gw_event_t *e, const event_payload_view_t *pv)
+static esp_err_t rules_bundle_save(const uint8_t *buf, size_t len)
 {
-    if (t->event_type != evt_type) return false;
-    if (t->device_uid_off && strcmp(strtab_at(entry, t->device_uid_off), e->device_uid) != 0) return false;
-    if (t->endpoint && (!pv->has_endpoint || pv->endpoint != t->endpoint)) return false;
-
-    if (evt_type == GW_AUTO_EVT_ZIGBEE_COMMAND) {
-        if (t->cmd_off && (!pv->has_cmd || strcmp(strtab_at(entry, t->cmd_off), pv->cmd) != 0)) return false;
-        if (t->cluster_id && (!pv->has_cluster || pv->cluster_id != t->cluster_id)) return false;
-    } else if (evt_type == GW_AUTO_EVT_ZIGBEE_ATTR_REPORT) {
-        if (t->cluster_id && (!pv->has_cluster || pv->cluster_id != t->cluster_id)) return false;
-        if (t->attr_id && (!pv->has_attr || pv->attr_id != t->attr_id)) return false;
+    nvs_handle_t handle;
+    esp_err_t err = nvs_open(GW_RULES_NVS_NAMESPACE, NVS_READWRITE, &handle);
+    if (err != ESP_OK) {
+        return err;
+    }
+    if (len > 0) {
+        err = nvs_set_blob(handle, GW_RULES_NVS_KEY, buf, len);
+    } else {
+        err = nvs_erase_key(handle, GW_RULES_NVS_KEY);
+        if (err == ESP_ERR_NVS_NOT_FOUND) {
+            err = ESP_OK;
+        }
     }
-    return true;
+    if (err == ESP_OK) {
+        err = nvs_commit(handle);
+    }
+    nvs_close(handle);
+    return err;
 }
 
-static bool state_to_number_bool(const gw_state_item_t *s, double *out_n, bool *out_b)
+static void rules_bundle_load_saved(void)
 {
-    if (!s) return false;
-    switch (s->value_type) {
-    case GW_STATE_VALUE_BOOL: *out_n = s->value_bool ? 1.0 : 0.0; *out_b = s->value_bool; return true;
-    case GW_STATE_VALUE_F32:  *out_n = s->value_f32; *out_b = fabs(s->value_f32) > 1e-6; return true;
-    case GW_STATE_VALUE_U32:  *out_n = s->value_u32; *out_b = s->value_u32 != 0; return true;
-    case GW_STATE_VALUE_U64:  *out_n = s->value_u64; *out_b = s->value_u64 != 0; return true;
-    default: return false;
+    nvs_handle_t handle;
+    if (nvs_open(GW_RULES_NVS_NAMESPACE, NVS_READONLY, &handle) != ESP_OK) {
+        return; // nothing pushed yet
     }
-}
+    size_t len = 0;
+    uint8_t *buf = NULL;
+    esp_err_t err = nvs_get_blob(handle, GW_RULES_NVS_KEY, NULL, &len);
+    if (err == ESP_OK && len > 0) {
+        buf = (uint8_t *)malloc(len);
+        err = buf ? nvs_get_blob(handle, GW_RULES_NVS_KEY, buf, &len) : ESP_ERR_NO_MEM;
+    }
+    nvs_close(handle);
 
-static bool conditions_pass(const gw_automation_entry_t *entry)
-{
-    if (entry->conditions_count == 0) return true;
-
-    for (uint8_t i = 0; i < entry->conditions_count; i++) {
-        const gw_auto_bin_condition_v2_t *co = &entry->conditions[i];
-        const char *uid_s = strtab_at(entry, co->device_uid_off);
-        const char *key = strtab_at(entry, co->key_off);
-        if (!uid_s[0] || !key[0]) return false;
-
-        gw_device_uid_t uid = {0};
-        strlcpy(uid.uid, uid_s, sizeof(uid.uid));
-        gw_state_item_t st = {0};
-        if (gw_state_store_get(&uid, key, &st) != ESP_OK) return false;
-
-        double actual_n = 0;
-        bool actual_b = false;
-        if (!state_to_number_bool(&st, &actual_n, &actual_b)) return false;
-
-        const gw_auto_op_t op = (gw_auto_op_t)co->op;
-        if (co->val_type == GW_AUTO_VAL_BOOL) {
-            bool exp = co->v.b != 0;
-            if ((op == GW_AUTO_OP_EQ && actual_b != exp) || (op == GW_AUTO_OP_NE && actual_b == exp)) return false;
-        } else {
-            double exp = co->v.f64;
-            double act = actual_n;
-            if ((op == GW_AUTO_OP_EQ && fabs(act - exp) > 1e-6) || (op == GW_AUTO_OP_NE && fabs(act - exp) < 1e-6) ||
-                (op == GW_AUTO_OP_GT && act <= exp) || (op == GW_AUTO_OP_LT && act >= exp) ||
-                (op == GW_AUTO_OP_GE && act < exp) || (op == GW_AUTO_OP_LE && act > exp)) return false;
-        }
+    rules_bundle_t *b = NULL;
+    if (err == ESP_OK && buf) {
+        err = rules_bundle_build(buf, len, &b);
+    }
+    free(buf);
+    if (err != ESP_OK && err != ESP_ERR_NVS_NOT_FOUND) {
+        ESP_LOGW(TAG, "saved rules bundle not loaded: %s", esp_err_to_name(err));
+        return;
+    }
+    if (b) {
+        rules_bundle_swap(b);
     }
-    return true;
 }
 
-static void reload_automation_cache(void)
+static void execute_actions(const rules_bundle_t *b, const gw_auto_bin_automation_v2_t *a, const gw_event_t *e)
 {
-    gw_automation_entry_t *dst = s_cache_use_a ? s_cache_b : s_cache_a;
-    size_t count = gw_automation_store_list(dst, GW_AUTOMATION_CAP);
-    portENTER_CRITICAL(&s_cache_lock);
-    s_cache = dst;
-    s_cache_count = count;
-    s_cache_use_a = !s_cache_use_a;
-    portEXIT_CRITICAL(&s_cache_lock);
+    const char *automation_id = gw_auto_compiled_str(&b->set, a->id_off);
+    publish_rules_fired(e, automation_id);
+
+    const gw_auto_bin_action_v2_t *actions = &b->set.actions[a->actions_index];
+    gw_action_step_t step;
+    for (uint32_t ai = 0; ai < a->actions_count; ai += step.count) {
+        char errbuf[96] = {0};
+        uint32_t saved = 0;
+        gw_action_plan_step(&b->set, actions, a->actions_count, ai, &step);
+        esp_err_t rc = gw_action_exec_step(&b->set, actions, &step, &saved, errbuf, sizeof(errbuf));
+        if (rc != ESP_OK) {
+            publish_rules_action(automation_id, ai, errbuf[0] ? errbuf : "exec failed", 0);
+            break; // Stop actions on first failure for this rule
+        }
+        publish_rules_action(automation_id, ai, NULL, saved);
+    }
 }
 
-static void process_event(const gw_event_t *e)
+static void process_event_bundle(const rules_bundle_t *b, const gw_event_t *e, gw_auto_evt_type_t evt_type)
 {
-    if (!e || !e->type[0] || strcmp(e->source, "rules") == 0) return;
-
-    const gw_auto_evt_type_t evt_type = evt_type_from_event(e);
-    if (!evt_type) return;
+    if (b->set.hdr.automation_count == 0) {
+        return;
+    }
 
-    gw_automation_entry_t *all_autos = NULL;
-    size_t auto_count = 0;
-    portENTER_CRITICAL(&s_cache_lock);
-    all_autos = s_cache;
-    auto_count = s_cache_count;
-    portEXIT_CRITICAL(&s_cache_lock);
+    gw_rules_event_view_t pv;
+    gw_rules_event_view(e, &pv);
 
-    if (auto_count == 0 || !all_autos) {
+    if (!gw_rules_index_candidates(&b->ix, e, &pv, evt_type)) {
         return;
     }
 
-    event_payload_view_t pv;
-    build_payload_view_from_event(e, &pv);
-
-    for (size_t i = 0; i < auto_count; i++) {
-        const gw_automation_entry_t *entry = &all_autos[i];
-        if (!entry->enabled) continue;
+    for (uint32_t slot = 0; slot < b->ix.slot_cap; slot++) {
+        if ((b->ix.candidates[slot / 32u] & (1u << (slot % 32u))) == 0) {
+            continue;
+        }
+        const uint32_t auto_idx = b->ix.slot_auto[slot];
+        if (auto_idx >= b->set.hdr.automation_count) {
+            continue;
+        }
 
-        bool matched = false;
-        for (uint8_t ti = 0; ti < entry->triggers_count; ti++) {
-            if (trigger_matches(entry, &entry->triggers[ti], evt_type, e, &pv)) {
-                matched = true;
-                break;
-            }
+        const gw_auto_bin_automation_v2_t *a = &b->set.autos[auto_idx];
+        if (!a->enabled || !gw_rules_triggers_match(&b->set, a, evt_type, e, &pv)) {
+            continue;
         }
-        if (!matched) continue;
-        if (!conditions_pass(entry)) continue;
-
-        publish_rules_fired(e, entry->id);
-
-        for (uint8_t ai = 0; ai < entry->actions_count; ai++) {
-            char errbuf[96] = {0};
-            gw_auto_compiled_t temp_compiled = {
-                .strings = (char*)entry->string_table,
-                .hdr.strings_size = entry->string_table_size
-            };
-
-            esp_err_t rc = gw_action_exec_compiled(&temp_compiled, &entry->actions[ai], errbuf, sizeof(errbuf));
-            if (rc != ESP_OK) {
-                publish_rules_action(entry->id, ai, false, errbuf[0] ? errbuf : "exec failed");
-                break; // Stop actions on first failure for this rule
-            }
-            publish_rules_action(entry->id, ai, true, NULL);
+        if (!gw_rules_conditions_pass(&b->set, a, gw_state_store_get)) {
+            continue;
         }
+        execute_actions(b, a, e);
     }
+}
+
+static void process_event(const gw_event_t *e)
+{
+    if (!e) return;
+
+    const gw_auto_evt_type_t evt_type = gw_rules_evt_type(e);
+    if (evt_type == 0) return;
 
+    // Actions run under the lock, so a bundle swap waits for the current event.
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    if (s_bundle) {
+        process_event_bundle(s_bundle, e, evt_type);
+    }
+    xSemaphoreGive(s_lock);
 }
 
 static void rules_task(void *arg)
@@ -247,32 +236,58 @@ static void rules_task(void *arg)
 
 static void rules_event_listener(const gw_event_t *event, void *user_ctx)
 {
-    if (event && (strcmp(event->type, "automation_saved") == 0 ||
-                  strcmp(event->type, "automation_removed") == 0 ||
-                  strcmp(event->type, "automation_enabled") == 0)) {
-        reload_automation_cache();
+    (void)user_ctx;
+    if (!s_inited || !s_q || !event || gw_rules_evt_type(event) == 0) {
+        return;
+    }
+    if (xQueueSend(s_q, event, 0) != pdTRUE) {
+        ESP_LOGW(TAG, "rules event queue overflow");
+    }
+}
+
+esp_err_t gw_rules_load_bundle(const uint8_t *buf, size_t len)
+{
+    if (!s_lock || (!buf && len > 0)) {
+        return ESP_ERR_INVALID_STATE;
     }
-    if (s_inited && s_q && event) {
-        if (xQueueSend(s_q, event, 0) != pdTRUE) {
-            ESP_LOGW(TAG, "rules event queue overflow");
+
+    rules_bundle_t *next = NULL;
+    if (len > 0) {
+        esp_err_t err = rules_bundle_build(buf, len, &next);
+        if (err != ESP_OK) {
+            ESP_LOGW(TAG, "rules bundle rejected: %s", esp_err_to_name(err));
+            return err;
         }
     }
+
+    // Run the new rules even if saving fails; they are pushed again after a reboot.
+    esp_err_t err = rules_bundle_save(buf, len);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "rules bundle save failed: %s", esp_err_to_name(err));
+    }
+    rules_bundle_swap(next);
+    return ESP_OK;
 }
 
 esp_err_t gw_rules_init(void)
 {
     if (s_inited) return ESP_OK;
 
+    s_lock = xSemaphoreCreateMutex();
+    if (!s_lock) return ESP_ERR_NO_MEM;
+
     s_q = xQueueCreate(GW_RULES_EVENT_Q_CAP, sizeof(gw_event_t));
     if (!s_q) return ESP_ERR_NO_MEM;
 
+    rules_bundle_load_saved();
+
     if (xTaskCreate(rules_task, "rules", 4096, NULL, GW_RULES_TASK_PRIO, &s_task) != pdPASS) {
         vQueueDelete(s_q);
+        s_q = NULL;
         return ESP_FAIL;
     }
 
     gw_event_bus_add_listener(rules_event_listener, NULL);
-    reload_automation_cache();
 
     s_inited = true;
     ESP_LOGI(TAG, "rules engine initialized");
@@ -0,0 +1,197 @@
+#include "gw_core/zb_attr_map.h"
+
+#include <math.h>
+#include <string.h>
+
+// Sorted by (cluster, attr): gw_zb_attr_find() bisects it.
+static const gw_zb_attr_desc_t s_attrs[] = {
+    {0x0001, 0x0020, GW_ZCL_TYPE_U8, 0, GW_ZB_ATTR_SCALE_MUL100, GW_ZB_ATTR_KIND_U32, 0, "battery_mv"},
+    {0x0001, 0x0021, GW_ZCL_TYPE_U8, 0, GW_ZB_ATTR_SCALE_DIV2, GW_ZB_ATTR_KIND_U32, GW_ZB_ATTR_F_SENSOR, "battery_pct"},
+    {0x0006, 0x0000, GW_ZCL_TYPE_BOOL, GW_ZCL_TYPE_U8, GW_ZB_ATTR_SCALE_RAW, GW_ZB_ATTR_KIND_BOOL, 0, "onoff"},
+    {0x0008, 0x0000, GW_ZCL_TYPE_U8, 0, GW_ZB_ATTR_SCALE_RAW, GW_ZB_ATTR_KIND_U32, GW_ZB_ATTR_F_SENSOR, "level"},
+    {0x0300, 0x0003, GW_ZCL_TYPE_U16, 0, GW_ZB_ATTR_SCALE_RAW, GW_ZB_ATTR_KIND_U32, GW_ZB_ATTR_F_SENSOR, "color_x"},
+    {0x0300, 0x0004, GW_ZCL_TYPE_U16, 0, GW_ZB_ATTR_SCALE_RAW, GW_ZB_ATTR_KIND_U32, GW_ZB_ATTR_F_SENSOR, "color_y"},
+    {0x0300, 0x0007, GW_ZCL_TYPE_U16, 0, GW_ZB_ATTR_SCALE_RAW, GW_ZB_ATTR_KIND_U32, GW_ZB_ATTR_F_SENSOR, "color_temp_mireds"},
+    {0x0400, 0x0000, GW_ZCL_TYPE_U16, 0, GW_ZB_ATTR_SCALE_RAW, GW_ZB_ATTR_KIND_U32, GW_ZB_ATTR_F_SENSOR, "illuminance_raw"},
+    {0x0402, 0x0000, GW_ZCL_TYPE_S16, 0, GW_ZB_ATTR_SCALE_DIV100, GW_ZB_ATTR_KIND_F32, GW_ZB_ATTR_F_SENSOR, "temperature_c"},
+    {0x0403, 0x0000, GW_ZCL_TYPE_S16, 0, GW_ZB_ATTR_SCALE_RAW, GW_ZB_ATTR_KIND_F32, GW_ZB_ATTR_F_SENSOR, "pressure_raw"},
+    {0x0405, 0x0000, GW_ZCL_TYPE_U16, 0, GW_ZB_ATTR_SCALE_DIV100, GW_ZB_ATTR_KIND_F32, GW_ZB_ATTR_F_SENSOR, "humidity_pct"},
+    {0x0406, 0x0000, GW_ZCL_TYPE_BITMAP8, GW_ZCL_TYPE_U8, GW_ZB_ATTR_SCALE_BIT0, GW_ZB_ATTR_KIND_BOOL, 0, "occupancy"},
+};
+
+#define ATTR_KEY(cluster_, attr_) (((uint32_t)(cluster_) << 16) | (uint32_t)(attr_))
+
+const gw_zb_attr_desc_t *gw_zb_attr_find(uint16_t cluster, uint16_t attr)
+{
+    const uint32_t key = ATTR_KEY(cluster, attr);
+    size_t lo = 0;
+    size_t hi = sizeof(s_attrs) / sizeof(s_attrs[0]);
+    while (lo < hi) {
+        const size_t mid = lo + (hi - lo) / 2;
+        const uint32_t k = ATTR_KEY(s_attrs[mid].cluster, s_attrs[mid].attr);
+        if (k == key) {
+            return &s_attrs[mid];
+        }
+        if (k < key) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return NULL;
+}
+
+const gw_zb_attr_desc_t *gw_zb_attr_table(size_t *out_count)
+{
+    if (out_count) {
+        *out_count = sizeof(s_attrs) / sizeof(s_attrs[0]);
+    }
+    return s_attrs;
+}
+
+static double normalize(const gw_zb_attr_desc_t *d, int32_t raw)
+{
+    switch ((gw_zb_attr_scale_t)d->scale) {
+        case GW_ZB_ATTR_SCALE_DIV2:
+            return (double)(raw / 2);
+        case GW_ZB_ATTR_SCALE_DIV100:
+            return (double)raw / 100.0;
+        case GW_ZB_ATTR_SCALE_MUL100:
+            return (double)raw * 100.0;
+        case GW_ZB_ATTR_SCALE_BIT0:
+            return (double)(raw & 0x01);
+        case GW_ZB_ATTR_SCALE_RAW:
+        default:
+            break;
+    }
+    if (d->kind == GW_ZB_ATTR_KIND_BOOL) {
+        return raw != 0 ? 1.0 : 0.0;
+    }
+    return (double)raw;
+}
+
+static int32_t denormalize(const gw_zb_attr_desc_t *d, double value)
+{
+    switch ((gw_zb_attr_scale_t)d->scale) {
+        case GW_ZB_ATTR_SCALE_DIV2:
+            return (int32_t)lround(value * 2.0);
+        case GW_ZB_ATTR_SCALE_DIV100:
+            return (int32_t)lround(value * 100.0);
+        case GW_ZB_ATTR_SCALE_MUL100:
+            return (int32_t)lround(value / 100.0);
+        case GW_ZB_ATTR_SCALE_BIT0:
+        case GW_ZB_ATTR_SCALE_RAW:
+        default:
+            return (int32_t)lround(value);
+    }
+}
+
+bool gw_zb_attr_decode(uint16_t cluster,
+                       uint16_t attr,
+                       uint8_t zcl_type,
+                       const void *data,
+                       size_t size,
+                       gw_zb_attr_value_t *out)
+{
+    if (!data || !out) {
+        return false;
+    }
+    const gw_zb_attr_desc_t *d = gw_zb_attr_find(cluster, attr);
+    if (!d || (zcl_type != d->zcl_type && (d->zcl_type_alt == 0 || zcl_type != d->zcl_type_alt))) {
+        return false;
+    }
+
+    int32_t raw = 0;
+    switch (zcl_type) {
+        case GW_ZCL_TYPE_BOOL:
+        case GW_ZCL_TYPE_BITMAP8:
+        case GW_ZCL_TYPE_U8:
+            if (size < 1) return false;
+            raw = *(const uint8_t *)data;
+            break;
+        case GW_ZCL_TYPE_U16: {
+            if (size < 2) return false;
+            uint16_t u = 0;
+            memcpy(&u, data, sizeof(u));
+            raw = u;
+            break;
+        }
+        case GW_ZCL_TYPE_S16: {
+            if (size < 2) return false;
+            int16_t s = 0;
+            memcpy(&s, data, sizeof(s));
+            raw = s;
+            break;
+        }
+        default:
+            return false;
+    }
+
+    out->desc = d;
+    out->raw = raw;
+    out->value = normalize(d, raw);
+    return true;
+}
+
+bool gw_zb_attr_from_event(uint16_t cluster,
+                           uint16_t attr,
+                           gw_event_value_type_t type,
+                           bool vbool,
+                           int64_t vi64,
+                           double vf64,
+                           gw_zb_attr_value_t *out)
+{
+    if (!out) {
+        return false;
+    }
+    const gw_zb_attr_desc_t *d = gw_zb_attr_find(cluster, attr);
+    if (!d) {
+        return false;
+    }
+
+    double value = 0.0;
+    switch (type) {
+        case GW_EVENT_VALUE_BOOL:
+            value = vbool ? 1.0 : 0.0;
+            break;
+        case GW_EVENT_VALUE_I64:
+            value = (double)vi64;
+            break;
+        case GW_EVENT_VALUE_F64:
+            value = vf64;
+            break;
+        default:
+            return false;
+    }
+    if (d->kind == GW_ZB_ATTR_KIND_BOOL) {
+        value = (value != 0.0) ? 1.0 : 0.0;
+    } else if (d->kind == GW_ZB_ATTR_KIND_U32 && value < 0.0) {
+        return false;
+    }
+
+    out->desc = d;
+    out->raw = denormalize(d, value);
+    out->value = value;
+    return true;
+}
+
+void gw_zb_attr_to_event(const gw_zb_attr_value_t *v,
+                         gw_event_value_type_t *out_type,
+                         bool *out_bool,
+                         int64_t *out_i64,
+                         double *out_f64)
+{
+    if (!v || !v->desc || !out_type || !out_bool || !out_i64 || !out_f64) {
+        return;
+    }
+    if (v->desc->kind == GW_ZB_ATTR_KIND_BOOL) {
+        *out_type = GW_EVENT_VALUE_BOOL;
+        *out_bool = (v->value != 0.0);
+    } else if (v->desc->scale == GW_ZB_ATTR_SCALE_DIV100) {
+        *out_type = GW_EVENT_VALUE_F64;
+        *out_f64 = v->value;
+    } else {
+        *out_type = GW_EVENT_VALUE_I64;
+        *out_i64 = (int64_t)v->value;
+    }
+}
@@ -1,4 +1,5 @@
 #include "gw_core/zb_model.h"
+#include "gw_core/zb_classify.h"
 
 #include <stdbool.h>
 #include <string.h>
@@ -85,3 +86,30 @@ bool gw_zb_model_find_uid_by_short(uint16_t short_addr, gw_device_uid_t *out_uid
     }
     return false;
 }
+
+uint16_t gw_zb_model_endpoint_group(const gw_device_uid_t *uid, uint8_t endpoint)
+{
+    if (!s_inited || uid == NULL) {
+        return 0;
+    }
+    for (size_t i = 0; i < s_ep_count; i++) {
+        if (s_eps[i].endpoint == endpoint && uid_equals(&s_eps[i].uid, uid)) {
+            return gw_zb_endpoint_auto_group(&s_eps[i]);
+        }
+    }
+    return 0;
+}
+
+size_t gw_zb_model_group_size(uint16_t group_id)
+{
+    if (!s_inited || group_id == 0) {
+        return 0;
+    }
+    size_t n = 0;
+    for (size_t i = 0; i < s_ep_count; i++) {
+        if (gw_zb_endpoint_auto_group(&s_eps[i]) == group_id) {
+            n++;
+        }
+    }
+    return n;
+}
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 #include "esp_err.h"
@@ -20,6 +21,7 @@ typedef enum {
 typedef struct {
     uint8_t level;          // 0..254
     uint16_t transition_ms; // 0 = immediate
+    bool with_onoff;        // send Move to Level (with On/Off): level 0 turns off, above 0 turns on
 } gw_zigbee_level_t;
 
 typedef struct {
@@ -68,6 +70,57 @@ esp_err_t gw_zigbee_group_color_move_to_temp(uint16_t group_id, gw_zigbee_color_
 esp_err_t gw_zigbee_read_onoff_state(const gw_device_uid_t *uid, uint8_t endpoint);
 // Request current value for any attribute from a specific endpoint.
 esp_err_t gw_zigbee_read_attr(const gw_device_uid_t *uid, uint8_t endpoint, uint16_t cluster_id, uint16_t attr_id);
+// Request several attributes of one cluster in a single ZCL Read Attributes frame.
+// ESP_ERR_NO_MEM: reads already fill their share of the command queue, ask again later.
+#define GW_ZIGBEE_READ_ATTRS_MAX 8
+esp_err_t gw_zigbee_read_attrs(const gw_device_uid_t *uid, uint8_t endpoint, uint16_t cluster_id, const uint16_t *attr_ids, size_t count);
+
+// Pipelined commands. Between begin and end, the commands the calling task issues go
+// out without waiting for their response, several in flight at once; other tasks'
+// commands wait until end. Each command left in flight takes the next entry of `results`
+// (see gw_zigbee_pipeline_next()), which holds its final status once end returns. A
+// command whose status is already final when it returns (e.g. it failed before being
+// sent) takes no entry.
+esp_err_t gw_zigbee_pipeline_begin(esp_err_t *results, size_t cap);
+size_t gw_zigbee_pipeline_next(void);
+void gw_zigbee_pipeline_end(void);
+
+// Command scheduler. Commands and ZDO requests are queued and sent from Zigbee context,
+// most urgent class first, with a bounded number in flight per destination. An entry
+// completes on its APS confirm (ZCL send status) or ZDO response; failures are retried
+// with backoff where repeating the command is harmless.
+typedef enum {
+    GW_ZIGBEE_CMD_CLASS_USER = 0,   // device control
+    GW_ZIGBEE_CMD_CLASS_AUTOMATION, // reserved: UART requests do not carry their origin yet
+    GW_ZIGBEE_CMD_CLASS_DISCOVERY,  // IEEE lookup, bind/unbind, leave
+    GW_ZIGBEE_CMD_CLASS_POLL,       // attribute reads
+    GW_ZIGBEE_CMD_CLASS_COUNT,
+} gw_zigbee_cmd_class_t;
+
+typedef struct {
+    uint16_t queued;      // waiting to be sent (including retry backoff)
+    uint16_t inflight;    // sent, waiting for completion
+    uint32_t sent;        // sends, retries included
+    uint32_t ok;
+    uint32_t failed;      // final negative completion
+    uint32_t retries;
+    uint32_t dropped;     // refused or displaced because the queue was full
+    uint32_t leaked;      // no completion before the deadline
+    uint32_t wait_avg_ms; // enqueue -> first send
+    uint32_t wait_max_ms;
+    uint32_t done_avg_ms; // enqueue -> completion
+    uint32_t done_max_ms;
+} gw_zigbee_cmd_class_stats_t;
+
+typedef struct {
+    gw_zigbee_cmd_class_stats_t cls[GW_ZIGBEE_CMD_CLASS_COUNT];
+    uint32_t stale; // completions that matched no live entry
+} gw_zigbee_sched_stats_t;
+
+void gw_zigbee_sched_get_stats(gw_zigbee_sched_stats_t *out);
+
+// Called from the ZCL command send status handler (Zigbee context).
+void gw_zigbee_on_zcl_send_status(uint8_t tsn, esp_err_t status);
 
 // Scenes (group-based).
 esp_err_t gw_zigbee_scene_store(uint16_t group_id, uint8_t scene_id);
@@ -28,6 +28,8 @@
 #include "gw_core/zb_classify.h"
 #include "gw_core/zb_model.h"
 
+#include "zb_sched.h"
+
 static const char *TAG = "gw_zigbee";
 
 static void publish_cbor_payload(const char *type,
@@ -47,10 +49,6 @@ static void publish_cbor_payload(const char *type,
 // Keep in sync with main/esp_zigbee_gateway.h (ESP_ZB_GATEWAY_ENDPOINT).
 #define GW_ZIGBEE_GATEWAY_ENDPOINT 1
 
-// Fixed groups by device "type". Can be extended/configured later via UI.
-#define GW_ZIGBEE_GROUP_SWITCHES 0x0002
-#define GW_ZIGBEE_GROUP_LIGHTS   0x0003
-
 static const int16_t s_report_change_temp_01c = 10;    // 0.10°C (temp is 0.01°C units)
 static const uint16_t s_report_change_hum_01pct = 100; // 1.00%RH (humidity is 0.01% units)
 static const uint8_t s_report_change_batt_halfpct = 2; // 1% (battery is 0.5% units)
@@ -112,6 +110,7 @@ typedef struct {
     uint8_t dst_ep;
     bool unbind;
     char dst_uid[GW_DEVICE_UID_STRLEN];
+    uint16_t sched_token; // 0 when not sent through the scheduler
 } gw_zb_bind_ctx_t;
 
 static void bind_resp_cb(esp_zb_zdp_status_t zdo_status, void *user_ctx)
@@ -120,6 +119,15 @@ static void bind_resp_cb(esp_zb_zdp_status_t zdo_status, void *user_ctx)
     if (ctx == NULL) {
         return;
     }
+    if (ctx->sched_token != 0) {
+        void *req = NULL;
+        if (!zb_sched_zdo_done(ctx->sched_token, zdo_status, &req)) {
+            // Retrying: the next attempt reports.
+            free(ctx);
+            return;
+        }
+        free(req);
+    }
 
     char msg[64];
     (void)snprintf(msg,
@@ -263,7 +271,7 @@ static void simple_desc_cb(esp_zb_zdp_status_t zdo_status, esp_zb_af_simple_desc
 
     // Auto-register into a type group if supported.
     if (has_groups_srv && (is_switch || is_light)) {
-        const uint16_t group_id = is_switch ? GW_ZIGBEE_GROUP_SWITCHES : GW_ZIGBEE_GROUP_LIGHTS;
+        const uint16_t group_id = is_switch ? GW_ZB_GROUP_SWITCHES : GW_ZB_GROUP_LIGHTS;
 
         esp_zb_zcl_groups_add_group_cmd_t cmd = {0};
         cmd.zcl_basic_cmd.dst_addr_u.addr_short = ctx->short_addr;
@@ -677,16 +685,13 @@ typedef struct {
     esp_zb_zdo_mgmt_leave_req_param_t req;
 } gw_zb_leave_ctx_t;
 
-static gw_zb_leave_ctx_t *s_leave_ctx_by_token[256];
-static uint8_t s_leave_token;
-static portMUX_TYPE s_leave_lock = portMUX_INITIALIZER_UNLOCKED;
-
 static void leave_resp_cb(esp_zb_zdp_status_t zdo_status, void *user_ctx)
 {
-    gw_zb_leave_ctx_t *ctx = (gw_zb_leave_ctx_t *)user_ctx;
-    if (ctx == NULL) {
+    void *p = NULL;
+    if (!zb_sched_zdo_done((uint16_t)(uintptr_t)user_ctx, zdo_status, &p) || p == NULL) {
         return;
     }
+    gw_zb_leave_ctx_t *ctx = (gw_zb_leave_ctx_t *)p;
 
     char msg[64];
     (void)snprintf(msg, sizeof(msg), "status=0x%02x rejoin=%u", (unsigned)zdo_status, ctx->rejoin ? 1U : 0U);
@@ -711,31 +716,32 @@ static void leave_resp_cb(esp_zb_zdp_status_t zdo_status, void *user_ctx)
     free(ctx);
 }
 
-static void leave_send_cb(uint8_t token)
+static uint8_t leave_send(void *p, uint16_t token)
 {
-    gw_zb_leave_ctx_t *ctx = NULL;
-
-    portENTER_CRITICAL(&s_leave_lock);
-    ctx = s_leave_ctx_by_token[token];
-    s_leave_ctx_by_token[token] = NULL;
-    portEXIT_CRITICAL(&s_leave_lock);
-
-    if (ctx == NULL) {
-        return;
-    }
+    gw_zb_leave_ctx_t *ctx = (gw_zb_leave_ctx_t *)p;
+    esp_zb_zdo_device_leave_req(&ctx->req, leave_resp_cb, (void *)(uintptr_t)token);
+    return 0;
+}
 
-    esp_zb_zdo_device_leave_req(&ctx->req, leave_resp_cb, ctx);
+static void leave_done(void *p, uint16_t token, esp_err_t status)
+{
+    gw_zb_leave_ctx_t *ctx = (gw_zb_leave_ctx_t *)p;
+    gw_event_bus_publish("zigbee_leave_failed", "zigbee", ctx->uid.uid, ctx->short_addr, esp_err_to_name(status));
+    free(ctx);
 }
 
+static const zb_sched_ops_t s_leave_ops = {
+    .name = "leave",
+    .zdo = true,
+    .send = leave_send,
+    .done = leave_done,
+};
+
 typedef struct {
     uint16_t short_addr;
     esp_zb_zdo_ieee_addr_req_param_t req;
 } gw_zb_ieee_lookup_ctx_t;
 
-static gw_zb_ieee_lookup_ctx_t *s_ieee_ctx_by_token[256];
-static uint8_t s_ieee_token;
-static portMUX_TYPE s_ieee_lock = portMUX_INITIALIZER_UNLOCKED;
-
 static bool should_throttle_discovery(uint16_t short_addr)
 {
     typedef struct {
@@ -765,13 +771,16 @@ static bool should_throttle_discovery(uint16_t short_addr)
 
 static void ieee_addr_cb(esp_zb_zdp_status_t zdo_status, esp_zb_zdo_ieee_addr_rsp_t *resp, void *user_ctx)
 {
-    gw_zb_ieee_lookup_ctx_t *ctx = (gw_zb_ieee_lookup_ctx_t *)user_ctx;
-    if (ctx == NULL) {
+    // ctx is NULL for a late response to an entry that already ended; the address is still good.
+    gw_zb_ieee_lookup_ctx_t *ctx = NULL;
+    if (!zb_sched_zdo_done((uint16_t)(uintptr_t)user_ctx, zdo_status, (void **)&ctx)) {
         return;
     }
 
     if (zdo_status != ESP_ZB_ZDP_STATUS_SUCCESS || resp == NULL) {
-        gw_event_bus_publish("zigbee_ieee_lookup_failed", "zigbee", "", ctx->short_addr, "ieee_addr_req failed");
+        if (ctx) {
+            gw_event_bus_publish("zigbee_ieee_lookup_failed", "zigbee", "", ctx->short_addr, "ieee_addr_req failed");
+        }
         free(ctx);
         return;
     }
@@ -792,22 +801,27 @@ static void ieee_addr_cb(esp_zb_zdp_status_t zdo_status, esp_zb_zdo_ieee_addr_rs
     free(ctx);
 }
 
-static void ieee_lookup_send_cb(uint8_t token)
+static uint8_t ieee_lookup_send(void *p, uint16_t token)
 {
-    gw_zb_ieee_lookup_ctx_t *ctx = NULL;
-
-    portENTER_CRITICAL(&s_ieee_lock);
-    ctx = s_ieee_ctx_by_token[token];
-    s_ieee_ctx_by_token[token] = NULL;
-    portEXIT_CRITICAL(&s_ieee_lock);
-
-    if (ctx == NULL) {
-        return;
-    }
+    gw_zb_ieee_lookup_ctx_t *ctx = (gw_zb_ieee_lookup_ctx_t *)p;
+    esp_zb_zdo_ieee_addr_req(&ctx->req, ieee_addr_cb, (void *)(uintptr_t)token);
+    return 0;
+}
 
-    esp_zb_zdo_ieee_addr_req(&ctx->req, ieee_addr_cb, ctx);
+static void ieee_lookup_done(void *p, uint16_t token, esp_err_t status)
+{
+    gw_zb_ieee_lookup_ctx_t *ctx = (gw_zb_ieee_lookup_ctx_t *)p;
+    gw_event_bus_publish("zigbee_ieee_lookup_failed", "zigbee", "", ctx->short_addr, esp_err_to_name(status));
+    free(ctx);
 }
 
+static const zb_sched_ops_t s_ieee_lookup_ops = {
+    .name = "ieee_lookup",
+    .zdo = true,
+    .send = ieee_lookup_send,
+    .done = ieee_lookup_done,
+};
+
 esp_err_t gw_zigbee_discover_by_short(uint16_t short_addr)
 {
     if (short_addr == 0 || short_addr == 0xFFFF) {
@@ -829,26 +843,14 @@ esp_err_t gw_zigbee_discover_by_short(uint16_t short_addr)
     ctx->req.request_type = 0;
     ctx->req.start_index = 0;
 
-    uint8_t token = 0;
-    portENTER_CRITICAL(&s_ieee_lock);
-    s_ieee_token++;
-    if (s_ieee_token == 0) {
-        s_ieee_token++;
-    }
-    token = s_ieee_token;
-    if (s_ieee_ctx_by_token[token] != NULL) {
-        portEXIT_CRITICAL(&s_ieee_lock);
+    // Sent from Zigbee context by the scheduler.
+    esp_err_t err = zb_sched_submit(GW_ZIGBEE_CMD_CLASS_DISCOVERY, false, short_addr, 2, &s_ieee_lookup_ops, ctx, NULL);
+    if (err != ESP_OK) {
         free(ctx);
-        return ESP_FAIL;
+        return err;
     }
-    s_ieee_ctx_by_token[token] = ctx;
-    portEXIT_CRITICAL(&s_ieee_lock);
 
     gw_event_bus_publish("zigbee_ieee_lookup_requested", "zigbee", "", short_addr, "ieee_addr_req");
-    // Schedule into Zigbee context.
-    zb_lock();
-    esp_zb_scheduler_alarm(ieee_lookup_send_cb, token, 0);
-    zb_unlock();
     return ESP_OK;
 }
 
@@ -926,27 +928,14 @@ esp_err_t gw_zigbee_device_leave(const gw_device_uid_t *uid, uint16_t short_addr
     ctx->req.remove_children = 0;
     ctx->req.rejoin = rejoin ? 1 : 0;
 
-    uint8_t token = 0;
-    portENTER_CRITICAL(&s_leave_lock);
-    s_leave_token++;
-    if (s_leave_token == 0) {
-        s_leave_token++;
-    }
-    token = s_leave_token;
-    if (s_leave_ctx_by_token[token] != NULL) {
-        portEXIT_CRITICAL(&s_leave_lock);
+    // Sent from Zigbee context by the scheduler.
+    esp_err_t err = zb_sched_submit(GW_ZIGBEE_CMD_CLASS_DISCOVERY, false, short_addr, 2, &s_leave_ops, ctx, NULL);
+    if (err != ESP_OK) {
         free(ctx);
-        return ESP_FAIL;
+        return err;
     }
-    s_leave_ctx_by_token[token] = ctx;
-    portEXIT_CRITICAL(&s_leave_lock);
 
     gw_event_bus_publish("zigbee_leave_requested", "zigbee", uid->uid, short_addr, rejoin ? "rejoin=1" : "rejoin=0");
-
-    // Schedule into Zigbee context.
-    zb_lock();
-    esp_zb_scheduler_alarm(leave_send_cb, token, 0);
-    zb_unlock();
     return ESP_OK;
 }
 
@@ -986,6 +975,7 @@ typedef struct {
         struct {
             uint8_t level;
             uint16_t transition_ds;
+            bool with_onoff;
         } level;
         struct {
             uint16_t x;
@@ -1003,10 +993,6 @@ typedef struct {
     } u;
 } gw_zb_action_ctx_t;
 
-static gw_zb_action_ctx_t *s_action_ctx_by_token[256];
-static uint8_t s_action_token;
-static portMUX_TYPE s_action_lock = portMUX_INITIALIZER_UNLOCKED;
-
 static uint16_t transition_ms_to_ds(uint16_t ms)
 {
     // ZCL uses tenths of a second.
@@ -1018,18 +1004,9 @@ static uint16_t transition_ms_to_ds(uint16_t ms)
     return (uint16_t)ds;
 }
 
-static void action_send_cb(uint8_t token)
+static uint8_t action_send(void *p, uint16_t token)
 {
-    gw_zb_action_ctx_t *ctx = NULL;
-    portENTER_CRITICAL(&s_action_lock);
-    ctx = s_action_ctx_by_token[token];
-    s_action_ctx_by_token[token] = NULL;
-    portEXIT_CRITICAL(&s_action_lock);
-
-    if (ctx == NULL) {
-        return;
-    }
-
+    gw_zb_action_ctx_t *ctx = (gw_zb_action_ctx_t *)p;
     uint8_t tsn = 0;
     gw_cbor_writer_t w;
     gw_cbor_writer_init(&w);
@@ -1081,7 +1058,8 @@ static void action_send_cb(uint8_t token)
         cmd.level = ctx->u.level.level;
         cmd.transition_time = ctx->u.level.transition_ds;
 
-        tsn = esp_zb_zcl_level_move_to_level_cmd_req(&cmd);
+        tsn = ctx->u.level.with_onoff ? esp_zb_zcl_level_move_to_level_with_onoff_cmd_req(&cmd)
+                                      : esp_zb_zcl_level_move_to_level_cmd_req(&cmd);
 
         esp_err_t rc = gw_cbor_writer_map(&w, 7);
         if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, "token");
@@ -1089,7 +1067,7 @@ static void action_send_cb(uint8_t token)
         if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, "tsn");
         if (rc == ESP_OK) rc = gw_cbor_writer_u64(&w, tsn);
         if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, "cmd");
-        if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, "move_to_level");
+        if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, ctx->u.level.with_onoff ? "move_to_level_with_on_off" : "move_to_level");
         if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, "endpoint");
         if (rc == ESP_OK) rc = gw_cbor_writer_u64(&w, ctx->endpoint);
         if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, "cluster");
@@ -1221,19 +1199,92 @@ static void action_send_cb(uint8_t token)
 
     publish_cbor_payload("zigbee.cmd_sent", "zigbee", ctx->uid.uid, ctx->short_addr, "", &w);
     gw_cbor_writer_free(&w);
+    return tsn;
+}
 
+static void action_done(void *p, uint16_t token, esp_err_t status)
+{
+    gw_zb_action_ctx_t *ctx = (gw_zb_action_ctx_t *)p;
+    if (status != ESP_OK) {
+        char msg[48];
+        (void)snprintf(msg, sizeof(msg), "token=%u %s", (unsigned)token, esp_err_to_name(status));
+        gw_event_bus_publish("zigbee.cmd_failed", "zigbee", ctx->uid.uid, ctx->short_addr, msg);
+    }
     free(ctx);
 }
 
+static const zb_sched_ops_t s_action_ops = {
+    .name = "action",
+    .zdo = false,
+    .send = action_send,
+    .done = action_done,
+};
+
+// A toggle is not repeated: its APS ack may be the only part that got lost.
+static uint8_t action_attempts(const gw_zb_action_ctx_t *ctx)
+{
+    return (ctx->type == GW_ZB_ACTION_ONOFF && ctx->u.onoff.cmd == GW_ZIGBEE_ONOFF_CMD_TOGGLE) ? 1 : 3;
+}
+
 esp_err_t gw_zigbee_read_onoff_state(const gw_device_uid_t *uid, uint8_t endpoint)
 {
     return gw_zigbee_read_attr(uid, endpoint, ESP_ZB_ZCL_CLUSTER_ID_ON_OFF, ESP_ZB_ZCL_ATTR_ON_OFF_ON_OFF_ID);
 }
 
 esp_err_t gw_zigbee_read_attr(const gw_device_uid_t *uid, uint8_t endpoint, uint16_t cluster_id, uint16_t attr_id)
+{
+    return gw_zigbee_read_attrs(uid, endpoint, cluster_id, &attr_id, 1);
+}
+
+typedef struct {
+    uint16_t short_addr;
+    uint8_t endpoint;
+    uint16_t cluster_id;
+    uint8_t count;
+    uint16_t attr_ids[GW_ZIGBEE_READ_ATTRS_MAX];
+} gw_zb_read_ctx_t;
+
+static uint8_t read_attrs_send(void *p, uint16_t token)
+{
+    gw_zb_read_ctx_t *ctx = (gw_zb_read_ctx_t *)p;
+    esp_zb_zcl_read_attr_cmd_t r = {0};
+    r.zcl_basic_cmd.dst_addr_u.addr_short = ctx->short_addr;
+    r.zcl_basic_cmd.dst_endpoint = ctx->endpoint;
+    r.zcl_basic_cmd.src_endpoint = GW_ZIGBEE_GATEWAY_ENDPOINT;
+    r.address_mode = ESP_ZB_APS_ADDR_MODE_16_ENDP_PRESENT;
+    r.clusterID = ctx->cluster_id;
+    r.direction = ESP_ZB_ZCL_CMD_DIRECTION_TO_SRV;
+    r.attr_number = ctx->count;
+    r.attr_field = ctx->attr_ids;
+    return esp_zb_zcl_read_attr_cmd_req(&r);
+}
+
+static void read_attrs_done(void *p, uint16_t token, esp_err_t status)
+{
+    gw_zb_read_ctx_t *ctx = (gw_zb_read_ctx_t *)p;
+    if (status != ESP_OK) {
+        ESP_LOGD(TAG,
+                 "read attrs failed: short=0x%04x ep=%u cluster=0x%04x: %s",
+                 (unsigned)ctx->short_addr,
+                 (unsigned)ctx->endpoint,
+                 (unsigned)ctx->cluster_id,
+                 esp_err_to_name(status));
+    }
+    free(ctx);
+}
+
+static const zb_sched_ops_t s_read_attrs_ops = {
+    .name = "read_attrs",
+    .zdo = false,
+    .send = read_attrs_send,
+    .done = read_attrs_done,
+};
+
+esp_err_t gw_zigbee_read_attrs(const gw_device_uid_t *uid, uint8_t endpoint, uint16_t cluster_id, const uint16_t *attr_ids, size_t count)
 {
     // attr_id can be 0x0000 for many valid attributes (e.g. OnOff, Level current value).
-    if (uid == NULL || uid->uid[0] == '\0' || endpoint == 0 || cluster_id == 0) {
+    if (uid == NULL || uid->uid[0] == '\0' || endpoint == 0 || cluster_id == 0 || attr_ids == NULL || count == 0 ||
+        count > GW_ZIGBEE_READ_ATTRS_MAX) {
         return ESP_ERR_INVALID_ARG;
     }
 
@@ -1246,21 +1297,22 @@ esp_err_t gw_zigbee_read_attr(const gw_device_uid_t *uid, uint8_t endpoint, uint
         return ESP_ERR_INVALID_STATE;
     }
 
-    uint16_t attrs[] = {attr_id};
-    esp_zb_zcl_read_attr_cmd_t r = {0};
-    r.zcl_basic_cmd.dst_addr_u.addr_short = d.short_addr;
-    r.zcl_basic_cmd.dst_endpoint = endpoint;
-    r.zcl_basic_cmd.src_endpoint = GW_ZIGBEE_GATEWAY_ENDPOINT;
-    r.address_mode = ESP_ZB_APS_ADDR_MODE_16_ENDP_PRESENT;
-    r.clusterID = cluster_id;
-    r.direction = ESP_ZB_ZCL_CMD_DIRECTION_TO_SRV;
-    r.attr_number = 1;
-    r.attr_field = attrs;
+    gw_zb_read_ctx_t *ctx = (gw_zb_read_ctx_t *)calloc(1, sizeof(*ctx));
+    if (ctx == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    ctx->short_addr = d.short_addr;
+    ctx->endpoint = endpoint;
+    ctx->cluster_id = cluster_id;
+    ctx->count = (uint8_t)count;
+    memcpy(ctx->attr_ids, attr_ids, count * sizeof(ctx->attr_ids[0]));
 
-    zb_lock();
-    (void)esp_zb_zcl_read_attr_cmd_req(&r);
-    zb_unlock();
-    return ESP_OK;
+    // Reads yield to control commands and are only attempted twice: the next poll asks again.
+    err = zb_sched_submit(GW_ZIGBEE_CMD_CLASS_POLL, false, d.short_addr, 2, &s_read_attrs_ops, ctx, NULL);
+    if (err != ESP_OK) {
+        free(ctx);
+    }
+    return err;
 }
 
 esp_err_t gw_zigbee_permit_join(uint8_t seconds)
@@ -1302,20 +1354,13 @@ esp_err_t gw_zigbee_onoff_cmd(const gw_device_uid_t *uid, uint8_t endpoint, gw_z
     ctx->type = GW_ZB_ACTION_ONOFF;
     ctx->u.onoff.cmd = cmd;
 
-    uint8_t token = 0;
-    portENTER_CRITICAL(&s_action_lock);
-    s_action_token++;
-    if (s_action_token == 0) {
-        s_action_token++;
-    }
-    token = s_action_token;
-    if (s_action_ctx_by_token[token] != NULL) {
-        portEXIT_CRITICAL(&s_action_lock);
+    // Sent from Zigbee context by the scheduler, which owns ctx from here on.
+    uint16_t token = 0;
+    err = zb_sched_submit(GW_ZIGBEE_CMD_CLASS_USER, false, d.short_addr, action_attempts(ctx), &s_action_ops, ctx, &token);
+    if (err != ESP_OK) {
         free(ctx);
-        return ESP_FAIL;
+        return err;
     }
-    s_action_ctx_by_token[token] = ctx;
-    portEXIT_CRITICAL(&s_action_lock);
 
     {
         const char *cmd_str = (cmd == GW_ZIGBEE_ONOFF_CMD_OFF) ? "off"
@@ -1335,9 +1380,6 @@ esp_err_t gw_zigbee_onoff_cmd(const gw_device_uid_t *uid, uint8_t endpoint, gw_z
         gw_cbor_writer_free(&w);
     }
 
-    zb_lock();
-    esp_zb_scheduler_alarm(action_send_cb, token, 0);
-    zb_unlock();
     return ESP_OK;
 }
 
@@ -1370,19 +1412,16 @@ esp_err_t gw_zigbee_level_move_to_level(const gw_device_uid_t *uid, uint8_t endp
     ctx->type = GW_ZB_ACTION_LEVEL_MOVE_TO_LEVEL;
     ctx->u.level.level = level.level;
     ctx->u.level.transition_ds = transition_ms_to_ds(level.transition_ms);
+    ctx->u.level.with_onoff = level.with_onoff;
 
-    uint8_t token = 0;
-    portENTER_CRITICAL(&s_action_lock);
-    s_action_token++;
-    if (s_action_token == 0) s_action_token++;
-    token = s_action_token;
-    if (s_action_ctx_by_token[token] != NULL) {
-        portEXIT_CRITICAL(&s_action_lock);
+    // Sent from Zigbee context by the scheduler, which owns ctx from here on.
+    const gw_zb_action_ctx_t req = *ctx;
+    uint16_t token = 0;
+    err = zb_sched_submit(GW_ZIGBEE_CMD_CLASS_USER, false, d.short_addr, action_attempts(ctx), &s_action_ops, ctx, &token);
+    if (err != ESP_OK) {
         free(ctx);
-        return ESP_FAIL;
+        return err;
     }
-    s_action_ctx_by_token[token] = ctx;
-    portEXIT_CRITICAL(&s_action_lock);
 
     {
         gw_cbor_writer_t w;
@@ -1391,20 +1430,19 @@ esp_err_t gw_zigbee_level_move_to_level(const gw_device_uid_t *uid, uint8_t endp
         if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, "token");
         if (rc == ESP_OK) rc = gw_cbor_writer_u64(&w, token);
         if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, "cmd");
-        if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, "move_to_level");
+        if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, req.u.level.with_onoff ? "move_to_level_with_on_off" : "move_to_level");
         if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, "endpoint");
         if (rc == ESP_OK) rc = gw_cbor_writer_u64(&w, endpoint);
         if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, "cluster");
         if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, "0x0008");
         if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, "level");
-        if (rc == ESP_OK) rc = gw_cbor_writer_u64(&w, ctx->u.level.level);
+        if (rc == ESP_OK) rc = gw_cbor_writer_u64(&w, req.u.level.level);
         if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, "transition_ds");
-        if (rc == ESP_OK) rc = gw_cbor_writer_u64(&w, ctx->u.level.transition_ds);
+        if (rc == ESP_OK) rc = gw_cbor_writer_u64(&w, req.u.level.transition_ds);
         publish_cbor_payload("zigbee.cmd_queue", "zigbee", uid->uid, d.short_addr, "", &w);
         gw_cbor_writer_free(&w);
     }
 
-    esp_zb_scheduler_alarm(action_send_cb, token, 0);
     return ESP_OK;
 }
 
@@ -1436,18 +1474,14 @@ esp_err_t gw_zigbee_color_move_to_xy(const gw_device_uid_t *uid, uint8_t endpoin
     ctx->u.color_xy.y = color.y;
     ctx->u.color_xy.transition_ds = transition_ms_to_ds(color.transition_ms);
 
-    uint8_t token = 0;
-    portENTER_CRITICAL(&s_action_lock);
-    s_action_token++;
-    if (s_action_token == 0) s_action_token++;
-    token = s_action_token;
-    if (s_action_ctx_by_token[token] != NULL) {
-        portEXIT_CRITICAL(&s_action_lock);
+    // Sent from Zigbee context by the scheduler, which owns ctx from here on.
+    const gw_zb_action_ctx_t req = *ctx;
+    uint16_t token = 0;
+    err = zb_sched_submit(GW_ZIGBEE_CMD_CLASS_USER, false, d.short_addr, action_attempts(ctx), &s_action_ops, ctx, &token);
+    if (err != ESP_OK) {
         free(ctx);
-        return ESP_FAIL;
+        return err;
     }
-    s_action_ctx_by_token[token] = ctx;
-    portEXIT_CRITICAL(&s_action_lock);
 
     {
         gw_cbor_writer_t w;
@@ -1462,16 +1496,15 @@ esp_err_t gw_zigbee_color_move_to_xy(const gw_device_uid_t *uid, uint8_t endpoin
         if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, "cluster");
         if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, "0x0300");
         if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, "x");
-        if (rc == ESP_OK) rc = gw_cbor_writer_u64(&w, ctx->u.color_xy.x);
+        if (rc == ESP_OK) rc = gw_cbor_writer_u64(&w, req.u.color_xy.x);
         if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, "y");
-        if (rc == ESP_OK) rc = gw_cbor_writer_u64(&w, ctx->u.color_xy.y);
+        if (rc == ESP_OK) rc = gw_cbor_writer_u64(&w, req.u.color_xy.y);
         if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, "transition_ds");
-        if (rc == ESP_OK) rc = gw_cbor_writer_u64(&w, ctx->u.color_xy.transition_ds);
+        if (rc == ESP_OK) rc = gw_cbor_writer_u64(&w, req.u.color_xy.transition_ds);
         publish_cbor_payload("zigbee.cmd_queue", "zigbee", uid->uid, d.short_addr, "", &w);
         gw_cbor_writer_free(&w);
     }
 
-    esp_zb_scheduler_alarm(action_send_cb, token, 0);
     return ESP_OK;
 }
 
@@ -1502,18 +1535,14 @@ esp_err_t gw_zigbee_color_move_to_temp(const gw_device_uid_t *uid, uint8_t endpo
     ctx->u.color_temp.mireds = temp.mireds;
     ctx->u.color_temp.transition_ds = transition_ms_to_ds(temp.transition_ms);
 
-    uint8_t token = 0;
-    portENTER_CRITICAL(&s_action_lock);
-    s_action_token++;
-    if (s_action_token == 0) s_action_token++;
-    token = s_action_token;
-    if (s_action_ctx_by_token[token] != NULL) {
-        portEXIT_CRITICAL(&s_action_lock);
+    // Sent from Zigbee context by the scheduler, which owns ctx from here on.
+    const gw_zb_action_ctx_t req = *ctx;
+    uint16_t token = 0;
+    err = zb_sched_submit(GW_ZIGBEE_CMD_CLASS_USER, false, d.short_addr, action_attempts(ctx), &s_action_ops, ctx, &token);
+    if (err != ESP_OK) {
         free(ctx);
-        return ESP_FAIL;
+        return err;
     }
-    s_action_ctx_by_token[token] = ctx;
-    portEXIT_CRITICAL(&s_action_lock);
 
     {
         gw_cbor_writer_t w;
@@ -1528,16 +1557,13 @@ esp_err_t gw_zigbee_color_move_to_temp(const gw_device_uid_t *uid, uint8_t endpo
         if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, "cluster");
         if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, "0x0300");
         if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, "mireds");
-        if (rc == ESP_OK) rc = gw_cbor_writer_u64(&w, ctx->u.color_temp.mireds);
+        if (rc == ESP_OK) rc = gw_cbor_writer_u64(&w, req.u.color_temp.mireds);
         if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, "transition_ds");
-        if (rc == ESP_OK) rc = gw_cbor_writer_u64(&w, ctx->u.color_temp.transition_ds);
+        if (rc == ESP_OK) rc = gw_cbor_writer_u64(&w, req.u.color_temp.transition_ds);
         publish_cbor_payload("zigbee.cmd_queue", "zigbee", uid->uid, d.short_addr, "", &w);
         gw_cbor_writer_free(&w);
     }
 
-    zb_lock();
-    esp_zb_scheduler_alarm(action_send_cb, token, 0);
-    zb_unlock();
     return ESP_OK;
 }
 
@@ -1552,22 +1578,7 @@ static esp_err_t schedule_group_action(uint16_t group_id, gw_zb_action_ctx_t *ct
     ctx->address_mode = ESP_ZB_APS_ADDR_MODE_16_GROUP_ENDP_NOT_PRESENT;
     ctx->uid.uid[0] = '\0';
 
-    uint8_t token = 0;
-    portENTER_CRITICAL(&s_action_lock);
-    s_action_token++;
-    if (s_action_token == 0) s_action_token++;
-    token = s_action_token;
-    if (s_action_ctx_by_token[token] != NULL) {
-        portEXIT_CRITICAL(&s_action_lock);
-        return ESP_FAIL;
-    }
-    s_action_ctx_by_token[token] = ctx;
-    portEXIT_CRITICAL(&s_action_lock);
-
-    zb_lock();
-    esp_zb_scheduler_alarm(action_send_cb, token, 0);
-    zb_unlock();
-    return ESP_OK;
+    return zb_sched_submit(GW_ZIGBEE_CMD_CLASS_USER, true, group_id, action_attempts(ctx), &s_action_ops, ctx, NULL);
 }
 
 esp_err_t gw_zigbee_group_onoff_cmd(uint16_t group_id, gw_zigbee_onoff_cmd_t cmd)
@@ -1621,6 +1632,7 @@ esp_err_t gw_zigbee_group_level_move_to_level(uint16_t group_id, gw_zigbee_level
     ctx->type = GW_ZB_ACTION_LEVEL_MOVE_TO_LEVEL;
     ctx->u.level.level = level.level;
     ctx->u.level.transition_ds = transition_ms_to_ds(level.transition_ms);
+    ctx->u.level.with_onoff = level.with_onoff;
 
     {
         char group_buf[8];
@@ -1633,7 +1645,7 @@ esp_err_t gw_zigbee_group_level_move_to_level(uint16_t group_id, gw_zigbee_level
         if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, "group_id");
         if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, group_buf);
         if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, "cmd");
-        if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, "move_to_level");
+        if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, ctx->u.level.with_onoff ? "move_to_level_with_on_off" : "move_to_level");
         if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, "cluster");
         if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, "0x0008");
         if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, "level");
@@ -1734,6 +1746,22 @@ esp_err_t gw_zigbee_group_color_move_to_temp(uint16_t group_id, gw_zigbee_color_
     return err;
 }
 
+// Commands are handed to the Zigbee stack and return their final status right away, so
+// there is nothing to keep in flight: no command ever takes a result entry.
+esp_err_t gw_zigbee_pipeline_begin(esp_err_t *results, size_t cap)
+{
+    return (results && cap > 0) ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+size_t gw_zigbee_pipeline_next(void)
+{
+    return 0;
+}
+
+void gw_zigbee_pipeline_end(void)
+{
+}
+
 esp_err_t gw_zigbee_scene_store(uint16_t group_id, uint8_t scene_id)
 {
     if (group_id == 0 || group_id == 0xFFFF || scene_id == 0) {
@@ -1830,21 +1858,9 @@ typedef struct {
     esp_zb_ieee_addr_t dst_ieee;
 } gw_zb_bind_req_ctx_t;
 
-static gw_zb_bind_req_ctx_t *s_bind_req_ctx_by_token[256];
-static uint8_t s_bind_req_token;
-static portMUX_TYPE s_bind_req_lock = portMUX_INITIALIZER_UNLOCKED;
-
-static void bind_req_send_cb(uint8_t token)
+static uint8_t bind_req_send(void *p, uint16_t token)
 {
-    gw_zb_bind_req_ctx_t *ctx = NULL;
-    portENTER_CRITICAL(&s_bind_req_lock);
-    ctx = s_bind_req_ctx_by_token[token];
-    s_bind_req_ctx_by_token[token] = NULL;
-    portEXIT_CRITICAL(&s_bind_req_lock);
-
-    if (!ctx) {
-        return;
-    }
+    gw_zb_bind_req_ctx_t *ctx = (gw_zb_bind_req_ctx_t *)p;
 
     char msg[160];
     (void)snprintf(msg,
@@ -1860,8 +1876,10 @@ static void bind_req_send_cb(uint8_t token)
     gw_zb_bind_ctx_t *bctx = (gw_zb_bind_ctx_t *)calloc(1, sizeof(*bctx));
     if (!bctx) {
         gw_event_bus_publish(ctx->unbind ? "zigbee_unbind_failed" : "zigbee_bind_failed", "zigbee", ctx->src_uid.uid, ctx->src_short, "no mem for bind ctx");
-        free(ctx);
-        return;
+        void *req = NULL;
+        (void)zb_sched_zdo_finish(token, ESP_ERR_NO_MEM, false, &req);
+        free(req);
+        return 0;
     }
     bctx->uid = ctx->src_uid;
     bctx->short_addr = ctx->src_short;
@@ -1870,6 +1888,7 @@ static void bind_req_send_cb(uint8_t token)
     bctx->dst_ep = ctx->dst_ep;
     bctx->unbind = ctx->unbind;
     strlcpy(bctx->dst_uid, ctx->dst_uid.uid, sizeof(bctx->dst_uid));
+    bctx->sched_token = token;
 
     esp_zb_zdo_bind_req_param_t bind = {0};
     memcpy(bind.src_address, ctx->src_ieee, sizeof(bind.src_address));
@@ -1885,10 +1904,23 @@ static void bind_req_send_cb(uint8_t token)
     } else {
         esp_zb_zdo_device_bind_req(&bind, bind_resp_cb, bctx);
     }
+    return 0;
+}
 
+static void bind_req_done(void *p, uint16_t token, esp_err_t status)
+{
+    gw_zb_bind_req_ctx_t *ctx = (gw_zb_bind_req_ctx_t *)p;
+    gw_event_bus_publish(ctx->unbind ? "zigbee_unbind_failed" : "zigbee_bind_failed", "zigbee", ctx->src_uid.uid, ctx->src_short, esp_err_to_name(status));
     free(ctx);
 }
 
+static const zb_sched_ops_t s_bind_req_ops = {
+    .name = "bind",
+    .zdo = true,
+    .send = bind_req_send,
+    .done = bind_req_done,
+};
+
 static esp_err_t schedule_bind_req(const gw_zb_bind_req_ctx_t *in)
 {
     if (!in) return ESP_ERR_INVALID_ARG;
@@ -1899,23 +1931,11 @@ static esp_err_t schedule_bind_req(const gw_zb_bind_req_ctx_t *in)
     }
     *ctx = *in;
 
-    uint8_t token = 0;
-    portENTER_CRITICAL(&s_bind_req_lock);
-    s_bind_req_token++;
-    if (s_bind_req_token == 0) s_bind_req_token++;
-    token = s_bind_req_token;
-    if (s_bind_req_ctx_by_token[token] != NULL) {
-        portEXIT_CRITICAL(&s_bind_req_lock);
+    esp_err_t err = zb_sched_submit(GW_ZIGBEE_CMD_CLASS_DISCOVERY, false, ctx->src_short, 3, &s_bind_req_ops, ctx, NULL);
+    if (err != ESP_OK) {
         free(ctx);
-        return ESP_FAIL;
     }
-    s_bind_req_ctx_by_token[token] = ctx;
-    portEXIT_CRITICAL(&s_bind_req_lock);
-
-    zb_lock();
-    esp_zb_scheduler_alarm(bind_req_send_cb, token, 0);
-    zb_unlock();
-    return ESP_OK;
+    return err;
 }
 
 esp_err_t gw_zigbee_bind(const gw_device_uid_t *src_uid,
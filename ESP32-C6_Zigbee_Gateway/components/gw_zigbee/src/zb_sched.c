@@ -0,0 +1,492 @@
+#include "zb_sched.h"
+
+#include <inttypes.h>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+
+#include "esp_zigbee_core.h"
+
+static const char *TAG = "gw_zigbee";
+
+#define ZB_SCHED_SLOTS 32
+#define ZB_SCHED_POLL_SLOTS 16      // polls never hold more, the rest stays free for control
+#define ZB_SCHED_SLOT_BITS 5
+#define ZB_SCHED_GEN_MASK 0x07FFu
+#define ZB_SCHED_MAX_INFLIGHT 6     // bounded by the stack's APS buffers
+#define ZB_SCHED_DST_INFLIGHT 1     // per device: sleepy children and slow routers
+#define ZB_SCHED_GROUP_INFLIGHT 1   // per group: broadcasts are rate limited network-wide
+#define ZB_SCHED_DEADLINE_MS 15000  // APS retries plus a sleepy child's poll period
+#define ZB_SCHED_BACKOFF_MS 250     // doubled per attempt
+#define ZB_SCHED_TICK_MS 100
+#define ZB_SCHED_STATS_LOG_MS 60000
+
+typedef enum {
+    ZB_SCHED_FREE = 0,
+    ZB_SCHED_QUEUED,
+    ZB_SCHED_INFLIGHT,
+} zb_sched_state_t;
+
+typedef struct {
+    uint8_t state; // zb_sched_state_t
+    uint8_t cls;   // gw_zigbee_cmd_class_t
+    uint8_t attempts;
+    uint8_t max_attempts;
+    uint8_t tsn;
+    bool group;
+    uint16_t dst; // short address or group id
+    uint16_t gen;
+    uint32_t seq;
+    uint64_t queued_ms;
+    uint64_t sent_ms;
+    uint64_t due_ms; // retry backoff
+    const zb_sched_ops_t *ops;
+    void *ctx;
+} zb_sched_slot_t;
+
+static zb_sched_slot_t s_sched[ZB_SCHED_SLOTS];
+static gw_zigbee_sched_stats_t s_sched_stats;
+static uint64_t s_sched_wait_sum_ms[GW_ZIGBEE_CMD_CLASS_COUNT];
+static uint64_t s_sched_done_sum_ms[GW_ZIGBEE_CMD_CLASS_COUNT];
+static uint32_t s_sched_wait_n[GW_ZIGBEE_CMD_CLASS_COUNT];
+static uint32_t s_sched_seq;
+static bool s_sched_kick_armed;
+static bool s_sched_tick_armed;
+static uint64_t s_sched_log_ms;
+static uint32_t s_sched_log_sent;
+static portMUX_TYPE s_sched_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static const char *const s_sched_class_name[GW_ZIGBEE_CMD_CLASS_COUNT] = {"user", "automation", "discovery", "poll"};
+
+static void zb_sched_pump_cb(uint8_t tick);
+
+static uint16_t zb_sched_token(const zb_sched_slot_t *s)
+{
+    return (uint16_t)((s->gen << ZB_SCHED_SLOT_BITS) | (uint16_t)(s - s_sched));
+}
+
+// Lock held.
+static zb_sched_slot_t *zb_sched_by_token(uint16_t token)
+{
+    zb_sched_slot_t *s = &s_sched[token & (ZB_SCHED_SLOTS - 1)];
+    return (s->state != ZB_SCHED_FREE && zb_sched_token(s) == token) ? s : NULL;
+}
+
+// Lock held. Frees the slot and returns its context; the token of a freed slot never
+// matches again until the generation wraps.
+static void *zb_sched_release(zb_sched_slot_t *s)
+{
+    void *ctx = s->ctx;
+    s->state = ZB_SCHED_FREE;
+    s->ctx = NULL;
+    s->ops = NULL;
+    s->gen = (uint16_t)((s->gen + 1) & ZB_SCHED_GEN_MASK);
+    if (s->gen == 0) {
+        s->gen = 1;
+    }
+    return ctx;
+}
+
+// Lock held. Returns the context when the entry is final, NULL when it was requeued.
+static void *zb_sched_complete(zb_sched_slot_t *s, esp_err_t status, bool retryable, uint64_t now_ms)
+{
+    gw_zigbee_cmd_class_stats_t *st = &s_sched_stats.cls[s->cls];
+    if (status != ESP_OK && retryable && s->attempts < s->max_attempts) {
+        st->retries++;
+        s->state = ZB_SCHED_QUEUED;
+        s->due_ms = now_ms + ((uint64_t)ZB_SCHED_BACKOFF_MS << (s->attempts - 1));
+        return NULL;
+    }
+
+    if (status == ESP_OK) {
+        st->ok++;
+    } else {
+        st->failed++;
+    }
+    const uint64_t done_ms = now_ms - s->queued_ms;
+    s_sched_done_sum_ms[s->cls] += done_ms;
+    if (done_ms > st->done_max_ms) {
+        st->done_max_ms = (uint32_t)done_ms;
+    }
+    return zb_sched_release(s);
+}
+
+static void zb_sched_kick(void)
+{
+    bool arm = false;
+    portENTER_CRITICAL(&s_sched_lock);
+    if (!s_sched_kick_armed) {
+        s_sched_kick_armed = true;
+        arm = true;
+    }
+    portEXIT_CRITICAL(&s_sched_lock);
+
+    if (arm) {
+        // Submitters run on other tasks; the stack is not thread-safe.
+        esp_zb_lock_acquire(portMAX_DELAY);
+        esp_zb_scheduler_alarm(zb_sched_pump_cb, 0, 0);
+        esp_zb_lock_release();
+    }
+}
+
+esp_err_t zb_sched_submit(gw_zigbee_cmd_class_t cls,
+                          bool group,
+                          uint16_t dst,
+                          uint8_t max_attempts,
+                          const zb_sched_ops_t *ops,
+                          void *ctx,
+                          uint16_t *out_token)
+{
+    const uint64_t now_ms = (uint64_t)(esp_timer_get_time() / 1000);
+    const zb_sched_ops_t *evicted_ops = NULL;
+    void *evicted_ctx = NULL;
+    uint16_t evicted_token = 0;
+    zb_sched_slot_t *s = NULL;
+
+    portENTER_CRITICAL(&s_sched_lock);
+    size_t polls = 0;
+    for (size_t i = 0; i < ZB_SCHED_SLOTS; i++) {
+        if (s_sched[i].state == ZB_SCHED_FREE) {
+            if (s == NULL) {
+                s = &s_sched[i];
+            }
+        } else if (s_sched[i].cls == GW_ZIGBEE_CMD_CLASS_POLL) {
+            polls++;
+        }
+    }
+    if (cls == GW_ZIGBEE_CMD_CLASS_POLL && polls >= ZB_SCHED_POLL_SLOTS) {
+        // Refused rather than queued: the S3 warm-up sends a refused read again later.
+        s = NULL;
+    } else if (s == NULL) {
+        // Full: a more urgent command displaces the newest queued entry of the least urgent class.
+        for (size_t i = 0; i < ZB_SCHED_SLOTS; i++) {
+            zb_sched_slot_t *v = &s_sched[i];
+            if (v->state != ZB_SCHED_QUEUED || v->cls <= (uint8_t)cls) {
+                continue;
+            }
+            if (s == NULL || v->cls > s->cls || (v->cls == s->cls && v->seq > s->seq)) {
+                s = v;
+            }
+        }
+        if (s != NULL) {
+            s_sched_stats.cls[s->cls].dropped++;
+            evicted_ops = s->ops;
+            evicted_token = zb_sched_token(s);
+            evicted_ctx = zb_sched_release(s);
+        }
+    }
+    if (s == NULL) {
+        s_sched_stats.cls[cls].dropped++;
+        portEXIT_CRITICAL(&s_sched_lock);
+        return ESP_ERR_NO_MEM;
+    }
+
+    if (s->gen == 0) {
+        s->gen = 1;
+    }
+    s->state = ZB_SCHED_QUEUED;
+    s->cls = (uint8_t)cls;
+    s->attempts = 0;
+    s->max_attempts = max_attempts ? max_attempts : 1;
+    s->tsn = 0;
+    s->group = group;
+    s->dst = dst;
+    s->seq = ++s_sched_seq;
+    s->queued_ms = now_ms;
+    s->sent_ms = 0;
+    s->due_ms = now_ms;
+    s->ops = ops;
+    s->ctx = ctx;
+    const uint16_t token = zb_sched_token(s);
+    portEXIT_CRITICAL(&s_sched_lock);
+
+    if (evicted_ctx) {
+        ESP_LOGW(TAG, "cmd queue full: dropped %s token=%u", evicted_ops->name, (unsigned)evicted_token);
+        evicted_ops->done(evicted_ctx, evicted_token, ESP_ERR_NO_MEM);
+    }
+    if (out_token) {
+        *out_token = token;
+    }
+    zb_sched_kick();
+    return ESP_OK;
+}
+
+// Lock held.
+static bool zb_sched_dst_ready(const zb_sched_slot_t *s)
+{
+    size_t busy = 0;
+    for (size_t i = 0; i < ZB_SCHED_SLOTS; i++) {
+        const zb_sched_slot_t *o = &s_sched[i];
+        if (o == s || o->state == ZB_SCHED_FREE || o->group != s->group || o->dst != s->dst) {
+            continue;
+        }
+        if (o->state == ZB_SCHED_INFLIGHT) {
+            busy++;
+        } else if (o->cls <= s->cls && o->seq < s->seq) {
+            // Keep per-destination order: an older entry waiting out its backoff holds newer ones back.
+            return false;
+        }
+    }
+    return busy < (s->group ? ZB_SCHED_GROUP_INFLIGHT : ZB_SCHED_DST_INFLIGHT);
+}
+
+// Lock held.
+static zb_sched_slot_t *zb_sched_pick(uint64_t now_ms)
+{
+    size_t inflight = 0;
+    for (size_t i = 0; i < ZB_SCHED_SLOTS; i++) {
+        if (s_sched[i].state == ZB_SCHED_INFLIGHT) {
+            inflight++;
+        }
+    }
+    if (inflight >= ZB_SCHED_MAX_INFLIGHT) {
+        return NULL;
+    }
+
+    zb_sched_slot_t *best = NULL;
+    for (size_t i = 0; i < ZB_SCHED_SLOTS; i++) {
+        zb_sched_slot_t *s = &s_sched[i];
+        if (s->state != ZB_SCHED_QUEUED || s->due_ms > now_ms) {
+            continue;
+        }
+        if (best && (s->cls > best->cls || (s->cls == best->cls && s->seq > best->seq))) {
+            continue;
+        }
+        if (zb_sched_dst_ready(s)) {
+            best = s;
+        }
+    }
+    return best;
+}
+
+static void zb_sched_log_stats(void)
+{
+    gw_zigbee_sched_stats_t st;
+    gw_zigbee_sched_get_stats(&st);
+    for (int c = 0; c < GW_ZIGBEE_CMD_CLASS_COUNT; c++) {
+        const gw_zigbee_cmd_class_stats_t *x = &st.cls[c];
+        if (x->sent == 0 && x->dropped == 0) {
+            continue;
+        }
+        ESP_LOGI(TAG,
+                 "cmd %s: queued=%u inflight=%u sent=%" PRIu32 " ok=%" PRIu32 " failed=%" PRIu32 " retries=%" PRIu32
+                 " dropped=%" PRIu32 " leaked=%" PRIu32 " wait=%" PRIu32 "/%" PRIu32 "ms done=%" PRIu32 "/%" PRIu32 "ms",
+                 s_sched_class_name[c],
+                 (unsigned)x->queued,
+                 (unsigned)x->inflight,
+                 x->sent,
+                 x->ok,
+                 x->failed,
+                 x->retries,
+                 x->dropped,
+                 x->leaked,
+                 x->wait_avg_ms,
+                 x->wait_max_ms,
+                 x->done_avg_ms,
+                 x->done_max_ms);
+    }
+}
+
+static void zb_sched_pump_cb(uint8_t tick)
+{
+    const uint64_t now_ms = (uint64_t)(esp_timer_get_time() / 1000);
+
+    // Reclaim entries whose completion never came (leaked tokens).
+    for (size_t i = 0; i < ZB_SCHED_SLOTS; i++) {
+        const zb_sched_ops_t *ops = NULL;
+        void *ctx = NULL;
+        uint16_t token = 0;
+        uint16_t dst = 0;
+        uint8_t attempts = 0;
+
+        portENTER_CRITICAL(&s_sched_lock);
+        zb_sched_slot_t *s = &s_sched[i];
+        if (s->state == ZB_SCHED_INFLIGHT && now_ms - s->sent_ms >= ZB_SCHED_DEADLINE_MS) {
+            s_sched_stats.cls[s->cls].leaked++;
+            ops = s->ops;
+            token = zb_sched_token(s);
+            dst = s->dst;
+            attempts = s->attempts;
+            ctx = zb_sched_complete(s, ESP_ERR_TIMEOUT, false, now_ms);
+        }
+        portEXIT_CRITICAL(&s_sched_lock);
+
+        if (ctx) {
+            ESP_LOGW(TAG,
+                     "cmd leaked: %s token=%u dst=0x%04x attempts=%u (no completion in %ums)",
+                     ops->name,
+                     (unsigned)token,
+                     (unsigned)dst,
+                     (unsigned)attempts,
+                     (unsigned)ZB_SCHED_DEADLINE_MS);
+            ops->done(ctx, token, ESP_ERR_TIMEOUT);
+        }
+    }
+
+    bool busy = false;
+    portENTER_CRITICAL(&s_sched_lock);
+    if (tick) {
+        s_sched_tick_armed = false;
+    } else {
+        s_sched_kick_armed = false;
+    }
+    portEXIT_CRITICAL(&s_sched_lock);
+
+    for (;;) {
+        portENTER_CRITICAL(&s_sched_lock);
+        zb_sched_slot_t *s = zb_sched_pick(now_ms);
+        if (s == NULL) {
+            for (size_t i = 0; i < ZB_SCHED_SLOTS && !busy; i++) {
+                busy = (s_sched[i].state != ZB_SCHED_FREE);
+            }
+            portEXIT_CRITICAL(&s_sched_lock);
+            break;
+        }
+        gw_zigbee_cmd_class_stats_t *st = &s_sched_stats.cls[s->cls];
+        if (s->attempts == 0) {
+            const uint64_t wait_ms = now_ms - s->queued_ms;
+            s_sched_wait_sum_ms[s->cls] += wait_ms;
+            s_sched_wait_n[s->cls]++;
+            if (wait_ms > st->wait_max_ms) {
+                st->wait_max_ms = (uint32_t)wait_ms;
+            }
+        }
+        st->sent++;
+        s->attempts++;
+        s->state = ZB_SCHED_INFLIGHT;
+        s->sent_ms = now_ms;
+        const zb_sched_ops_t *ops = s->ops;
+        void *ctx = s->ctx;
+        const uint16_t token = zb_sched_token(s);
+        portEXIT_CRITICAL(&s_sched_lock);
+
+        const uint8_t tsn = ops->send(ctx, token);
+
+        portENTER_CRITICAL(&s_sched_lock);
+        s = zb_sched_by_token(token);
+        if (s) {
+            s->tsn = tsn;
+        }
+        portEXIT_CRITICAL(&s_sched_lock);
+    }
+
+    if (busy) {
+        bool arm = false;
+        portENTER_CRITICAL(&s_sched_lock);
+        if (!s_sched_tick_armed) {
+            s_sched_tick_armed = true;
+            arm = true;
+        }
+        portEXIT_CRITICAL(&s_sched_lock);
+        if (arm) {
+            esp_zb_scheduler_alarm(zb_sched_pump_cb, 1, ZB_SCHED_TICK_MS);
+        }
+    }
+
+    if (now_ms - s_sched_log_ms >= ZB_SCHED_STATS_LOG_MS) {
+        uint32_t sent = 0;
+        portENTER_CRITICAL(&s_sched_lock);
+        for (int c = 0; c < GW_ZIGBEE_CMD_CLASS_COUNT; c++) {
+            sent += s_sched_stats.cls[c].sent;
+        }
+        portEXIT_CRITICAL(&s_sched_lock);
+        if (sent != s_sched_log_sent) {
+            s_sched_log_sent = sent;
+            zb_sched_log_stats();
+        }
+        s_sched_log_ms = now_ms;
+    }
+}
+
+// Completion of a ZDO request by token. Returns false when a retry was queued (the caller
+// drops this response); otherwise the entry is over and *out_ctx gets its context, or NULL
+// when the response is stale (the entry already ended).
+bool zb_sched_zdo_finish(uint16_t token, esp_err_t status, bool retryable, void **out_ctx)
+{
+    const uint64_t now_ms = (uint64_t)(esp_timer_get_time() / 1000);
+    void *ctx = NULL;
+    bool final = true;
+
+    portENTER_CRITICAL(&s_sched_lock);
+    zb_sched_slot_t *s = zb_sched_by_token(token);
+    if (s == NULL || s->state != ZB_SCHED_INFLIGHT || !s->ops->zdo) {
+        s_sched_stats.stale++;
+    } else {
+        ctx = zb_sched_complete(s, status, retryable, now_ms);
+        final = (ctx != NULL);
+    }
+    portEXIT_CRITICAL(&s_sched_lock);
+
+    *out_ctx = ctx;
+    zb_sched_kick();
+    return final;
+}
+
+// From a ZDO response callback. Only a timeout is worth repeating: any other status is the
+// device's final answer.
+bool zb_sched_zdo_done(uint16_t token, esp_zb_zdp_status_t zdo_status, void **out_ctx)
+{
+    return zb_sched_zdo_finish(token,
+                               (zdo_status == ESP_ZB_ZDP_STATUS_SUCCESS) ? ESP_OK : ESP_FAIL,
+                               zdo_status == ESP_ZB_ZDP_STATUS_TIMEOUT,
+                               out_ctx);
+}
+
+void gw_zigbee_on_zcl_send_status(uint8_t tsn, esp_err_t status)
+{
+    const uint64_t now_ms = (uint64_t)(esp_timer_get_time() / 1000);
+    const zb_sched_ops_t *ops = NULL;
+    void *ctx = NULL;
+    uint16_t token = 0;
+
+    portENTER_CRITICAL(&s_sched_lock);
+    zb_sched_slot_t *s = NULL;
+    for (size_t i = 0; i < ZB_SCHED_SLOTS; i++) {
+        zb_sched_slot_t *c = &s_sched[i];
+        if (c->state == ZB_SCHED_INFLIGHT && !c->ops->zdo && c->tsn == tsn) {
+            s = c;
+            break;
+        }
+    }
+    if (s == NULL) {
+        // Frames sent outside the scheduler (discovery, reporting setup) land here too.
+        s_sched_stats.stale++;
+        portEXIT_CRITICAL(&s_sched_lock);
+        return;
+    }
+    ops = s->ops;
+    token = zb_sched_token(s);
+    ctx = zb_sched_complete(s, status, true, now_ms);
+    portEXIT_CRITICAL(&s_sched_lock);
+
+    if (ctx) {
+        ops->done(ctx, token, status);
+    }
+    zb_sched_kick();
+}
+
+void gw_zigbee_sched_get_stats(gw_zigbee_sched_stats_t *out)
+{
+    if (out == NULL) {
+        return;
+    }
+
+    portENTER_CRITICAL(&s_sched_lock);
+    *out = s_sched_stats;
+    for (size_t i = 0; i < ZB_SCHED_SLOTS; i++) {
+        const zb_sched_slot_t *s = &s_sched[i];
+        if (s->state == ZB_SCHED_QUEUED) {
+            out->cls[s->cls].queued++;
+        } else if (s->state == ZB_SCHED_INFLIGHT) {
+            out->cls[s->cls].inflight++;
+        }
+    }
+    for (int c = 0; c < GW_ZIGBEE_CMD_CLASS_COUNT; c++) {
+        gw_zigbee_cmd_class_stats_t *x = &out->cls[c];
+        const uint32_t done_n = x->ok + x->failed;
+        x->wait_avg_ms = s_sched_wait_n[c] ? (uint32_t)(s_sched_wait_sum_ms[c] / s_sched_wait_n[c]) : 0;
+        x->done_avg_ms = done_n ? (uint32_t)(s_sched_done_sum_ms[c] / done_n) : 0;
+    }
+    portEXIT_CRITICAL(&s_sched_lock);
+}
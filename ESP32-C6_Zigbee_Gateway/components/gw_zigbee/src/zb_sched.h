@@ -0,0 +1,45 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "zdo/esp_zigbee_zdo_common.h"
+
+#include "gw_zigbee/gw_zigbee.h"
+
+// Command scheduler: one queue for every command and ZDO request gw_zigbee.c sends. The
+// pump runs in Zigbee context and sends the most urgent queued entry (class, then FIFO)
+// whose destination is below its in-flight limit. An entry stays in flight until its
+// completion: the ZCL send status matched by TSN (APS ack for unicast), or the ZDO
+// response matched by token. Entries that never complete are reclaimed at the deadline.
+// gw_zigbee_on_zcl_send_status() and gw_zigbee_sched_get_stats() are implemented here too.
+
+typedef struct {
+    const char *name;
+    bool zdo; // completes via zb_sched_zdo_done(), else via the ZCL send status
+    // Zigbee context. Returns the TSN of the ZCL frame (ignored for ZDO requests).
+    uint8_t (*send)(void *ctx, uint16_t token);
+    // The scheduler ended the entry itself (final ZCL status, deadline, queue full).
+    void (*done)(void *ctx, uint16_t token, esp_err_t status);
+} zb_sched_ops_t;
+
+// Queues a request for `dst` (a group id when `group`). `ctx` belongs to the scheduler
+// until ops->done() runs or a ZDO completion hands it back. ESP_ERR_NO_MEM when the queue
+// is full of equally or more urgent entries, or a poll is over its share of the slots.
+esp_err_t zb_sched_submit(gw_zigbee_cmd_class_t cls,
+                          bool group,
+                          uint16_t dst,
+                          uint8_t max_attempts,
+                          const zb_sched_ops_t *ops,
+                          void *ctx,
+                          uint16_t *out_token);
+
+// Completion of a ZDO request by token. Returns false when a retry was queued (the caller
+// drops this response); otherwise the entry is over and *out_ctx gets its context, or NULL
+// when the response is stale (the entry already ended).
+bool zb_sched_zdo_finish(uint16_t token, esp_err_t status, bool retryable, void **out_ctx);
+
+// From a ZDO response callback. Only a timeout is worth repeating: any other status is the
+// device's final answer.
+bool zb_sched_zdo_done(uint16_t token, esp_zb_zdp_status_t zdo_status, void **out_ctx);
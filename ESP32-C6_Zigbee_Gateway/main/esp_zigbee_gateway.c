@@ -31,8 +31,10 @@
 #include "gw_zigbee/gw_zigbee.h"
 #include "gw_core/event_bus.h"
 #include "gw_core/device_registry.h"
+#include "gw_core/rules_engine.h"
 #include "gw_core/sensor_store.h"
 #include "gw_core/state_store.h"
+#include "gw_core/zb_attr_map.h"
 #include "gw_core/zb_model.h"
 #include "gw_uart_link.h"
 
@@ -49,13 +51,6 @@ static const char *TAG = "ESP_ZB_GATEWAY";
 
 #define GW_TASK_PRIO_ZIGBEE 8
 
-#define GW_ZB_CLUSTER_ILLUMINANCE_MEASUREMENT 0x0400
-#define GW_ZB_CLUSTER_PRESSURE_MEASUREMENT    0x0403
-#define GW_ZB_CLUSTER_OCCUPANCY_SENSING       0x0406
-#define GW_ZB_ATTR_MEASURED_VALUE             0x0000
-#define GW_ZB_ATTR_OCCUPANCY                  0x0000
-#define GW_ZB_ATTR_BATTERY_VOLTAGE            0x0020
-
 static const char *zb_cmd_name(uint16_t cluster_id, uint8_t cmd_id)
 {
     if (cluster_id == ESP_ZB_ZCL_CLUSTER_ID_ON_OFF) {
@@ -96,6 +91,49 @@ static void gw_log_heap_task(void *arg)
     vTaskDelete(NULL);
 }
 
+// Mirror a decoded attribute into the sensor store (raw wire value) and the state store
+// (normalized value under the descriptor's key).
+static void zb_attr_store(const gw_device_uid_t *uid, uint16_t short_addr, uint8_t endpoint, const gw_zb_attr_value_t *av, uint64_t ts_ms)
+{
+    const gw_zb_attr_desc_t *d = av->desc;
+    if (d->flags & GW_ZB_ATTR_F_SENSOR) {
+        gw_sensor_value_t v = {0};
+        v.uid = *uid;
+        v.short_addr = short_addr;
+        v.endpoint = endpoint;
+        v.cluster_id = d->cluster;
+        v.attr_id = d->attr;
+        v.ts_ms = ts_ms;
+        if (d->zcl_type == GW_ZCL_TYPE_S16) {
+            v.value_type = GW_SENSOR_VALUE_I32;
+            v.value_i32 = av->raw;
+        } else {
+            v.value_type = GW_SENSOR_VALUE_U32;
+            v.value_u32 = (uint32_t)av->raw;
+        }
+        (void)gw_sensor_store_upsert(&v);
+    }
+
+    switch ((gw_zb_attr_kind_t)d->kind) {
+        case GW_ZB_ATTR_KIND_BOOL:
+            (void)gw_state_store_set_bool(uid, d->state_key, av->value != 0.0, ts_ms);
+            break;
+        case GW_ZB_ATTR_KIND_U32:
+            (void)gw_state_store_set_u32(uid, d->state_key, (uint32_t)av->value, ts_ms);
+            break;
+        case GW_ZB_ATTR_KIND_F32:
+            (void)gw_state_store_set_f32(uid, d->state_key, (float)av->value, ts_ms);
+            break;
+    }
+}
+
+// APS confirm (or send result for groupcast) of every ZCL command we send: completes the
+// scheduler's in-flight entries.
+static void zb_cmd_send_status_handler(esp_zb_zcl_command_send_status_message_t message)
+{
+    gw_zigbee_on_zcl_send_status(message.tsn, message.status);
+}
+
 static esp_err_t zb_core_action_handler(esp_zb_core_action_callback_id_t callback_id, const void *message)
 {
     if (callback_id == ESP_ZB_CORE_REPORT_ATTR_CB_ID) {
@@ -114,103 +152,26 @@ static esp_err_t zb_core_action_handler(esp_zb_core_action_callback_id_t callbac
             (void)gw_zigbee_discover_by_short(src_short);
         }
 
-        // Persist interesting sensor values for UI/debugging.
+        // Decode once; the stores and the event all use the same normalized value.
         const uint16_t cluster_id = m->cluster;
         const uint16_t attr_id = m->attribute.id;
+        const uint64_t now_ms = (uint64_t)(esp_timer_get_time() / 1000);
+        gw_zb_attr_value_t av = {0};
+        const bool decoded = gw_zb_attr_decode(cluster_id,
+                                               attr_id,
+                                               (uint8_t)m->attribute.data.type,
+                                               m->attribute.data.value,
+                                               m->attribute.data.size,
+                                               &av);
+
+        // Persist interesting sensor values for UI/debugging.
         if (uid.uid[0] != '\0' && m->attribute.data.value != NULL) {
-            gw_sensor_value_t v = {0};
-            v.uid = uid;
-            v.short_addr = src_short;
-            v.endpoint = m->src_endpoint;
-            v.cluster_id = cluster_id;
-            v.attr_id = attr_id;
-            v.ts_ms = (uint64_t)(esp_timer_get_time() / 1000);
-
-            if (cluster_id == ESP_ZB_ZCL_CLUSTER_ID_TEMP_MEASUREMENT && attr_id == ESP_ZB_ZCL_ATTR_TEMP_MEASUREMENT_VALUE_ID &&
-                m->attribute.data.type == ESP_ZB_ZCL_ATTR_TYPE_S16 && m->attribute.data.size >= 2) {
-                v.value_type = GW_SENSOR_VALUE_I32;
-                v.value_i32 = *((const int16_t *)m->attribute.data.value);
-                (void)gw_sensor_store_upsert(&v);
-
-                // Normalized state key for automations.
-                (void)gw_state_store_set_f32(&uid, "temperature_c", ((float)v.value_i32) / 100.0f, v.ts_ms);
-            } else if (cluster_id == ESP_ZB_ZCL_CLUSTER_ID_REL_HUMIDITY_MEASUREMENT && attr_id == ESP_ZB_ZCL_ATTR_REL_HUMIDITY_MEASUREMENT_VALUE_ID &&
-                       m->attribute.data.type == ESP_ZB_ZCL_ATTR_TYPE_U16 && m->attribute.data.size >= 2) {
-                v.value_type = GW_SENSOR_VALUE_U32;
-                v.value_u32 = *((const uint16_t *)m->attribute.data.value);
-                (void)gw_sensor_store_upsert(&v);
-
-                (void)gw_state_store_set_f32(&uid, "humidity_pct", ((float)v.value_u32) / 100.0f, v.ts_ms);
-            } else if (cluster_id == ESP_ZB_ZCL_CLUSTER_ID_POWER_CONFIG && attr_id == ESP_ZB_ZCL_ATTR_POWER_CONFIG_BATTERY_PERCENTAGE_REMAINING_ID &&
-                       m->attribute.data.type == ESP_ZB_ZCL_ATTR_TYPE_U8 && m->attribute.data.size >= 1) {
-                v.value_type = GW_SENSOR_VALUE_U32;
-                v.value_u32 = *((const uint8_t *)m->attribute.data.value);
-                (void)gw_sensor_store_upsert(&v);
-
-                // Battery percentage is 0.5% units. Normalize to integer percent.
-                (void)gw_state_store_set_u32(&uid, "battery_pct", (uint32_t)(v.value_u32 / 2u), v.ts_ms);
-            } else if (cluster_id == ESP_ZB_ZCL_CLUSTER_ID_ON_OFF && attr_id == ESP_ZB_ZCL_ATTR_ON_OFF_ON_OFF_ID &&
-                       (m->attribute.data.type == ESP_ZB_ZCL_ATTR_TYPE_BOOL || m->attribute.data.type == ESP_ZB_ZCL_ATTR_TYPE_U8) &&
-                       m->attribute.data.size >= 1) {
-                uint8_t onoff = *((const uint8_t *)m->attribute.data.value);
-                (void)gw_state_store_set_bool(&uid, "onoff", onoff != 0, v.ts_ms);
-            } else if (cluster_id == GW_ZB_CLUSTER_OCCUPANCY_SENSING &&
-                       attr_id == GW_ZB_ATTR_OCCUPANCY &&
-                       (m->attribute.data.type == ESP_ZB_ZCL_ATTR_TYPE_8BITMAP || m->attribute.data.type == ESP_ZB_ZCL_ATTR_TYPE_U8) &&
-                       m->attribute.data.size >= 1) {
-                uint8_t occ = *((const uint8_t *)m->attribute.data.value);
-                (void)gw_state_store_set_bool(&uid, "occupancy", (occ & 0x01u) != 0, v.ts_ms);
-            } else if (cluster_id == GW_ZB_CLUSTER_ILLUMINANCE_MEASUREMENT &&
-                       attr_id == GW_ZB_ATTR_MEASURED_VALUE &&
-                       m->attribute.data.type == ESP_ZB_ZCL_ATTR_TYPE_U16 &&
-                       m->attribute.data.size >= 2) {
-                v.value_type = GW_SENSOR_VALUE_U32;
-                v.value_u32 = *((const uint16_t *)m->attribute.data.value);
-                (void)gw_sensor_store_upsert(&v);
-                (void)gw_state_store_set_u32(&uid, "illuminance_raw", v.value_u32, v.ts_ms);
-            } else if (cluster_id == GW_ZB_CLUSTER_PRESSURE_MEASUREMENT &&
-                       attr_id == GW_ZB_ATTR_MEASURED_VALUE &&
-                       m->attribute.data.type == ESP_ZB_ZCL_ATTR_TYPE_S16 &&
-                       m->attribute.data.size >= 2) {
-                v.value_type = GW_SENSOR_VALUE_I32;
-                v.value_i32 = *((const int16_t *)m->attribute.data.value);
-                (void)gw_sensor_store_upsert(&v);
-                (void)gw_state_store_set_f32(&uid, "pressure_raw", (float)v.value_i32, v.ts_ms);
-            } else if (cluster_id == ESP_ZB_ZCL_CLUSTER_ID_POWER_CONFIG &&
-                       attr_id == GW_ZB_ATTR_BATTERY_VOLTAGE &&
-                       m->attribute.data.type == ESP_ZB_ZCL_ATTR_TYPE_U8 &&
-                       m->attribute.data.size >= 1) {
-                uint32_t mv = (uint32_t)(*((const uint8_t *)m->attribute.data.value)) * 100u;
-                (void)gw_state_store_set_u32(&uid, "battery_mv", mv, v.ts_ms);
-            } else if (cluster_id == ESP_ZB_ZCL_CLUSTER_ID_LEVEL_CONTROL &&
-                       attr_id == ESP_ZB_ZCL_ATTR_LEVEL_CONTROL_CURRENT_LEVEL_ID &&
-                       m->attribute.data.type == ESP_ZB_ZCL_ATTR_TYPE_U8 &&
-                       m->attribute.data.size >= 1) {
-                v.value_type = GW_SENSOR_VALUE_U32;
-                v.value_u32 = *((const uint8_t *)m->attribute.data.value);
-                (void)gw_sensor_store_upsert(&v);
-                (void)gw_state_store_set_u32(&uid, "level", v.value_u32, v.ts_ms);
-            } else if (cluster_id == ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL &&
-                       m->attribute.data.type == ESP_ZB_ZCL_ATTR_TYPE_U16 &&
-                       m->attribute.data.size >= 2 &&
-                       (attr_id == ESP_ZB_ZCL_ATTR_COLOR_CONTROL_CURRENT_X_ID ||
-                        attr_id == ESP_ZB_ZCL_ATTR_COLOR_CONTROL_CURRENT_Y_ID ||
-                        attr_id == ESP_ZB_ZCL_ATTR_COLOR_CONTROL_COLOR_TEMPERATURE_ID)) {
-                const uint16_t raw = *((const uint16_t *)m->attribute.data.value);
-                v.value_type = GW_SENSOR_VALUE_U32;
-                v.value_u32 = raw;
-                (void)gw_sensor_store_upsert(&v);
-                if (attr_id == ESP_ZB_ZCL_ATTR_COLOR_CONTROL_CURRENT_X_ID) {
-                    (void)gw_state_store_set_u32(&uid, "color_x", (uint32_t)raw, v.ts_ms);
-                } else if (attr_id == ESP_ZB_ZCL_ATTR_COLOR_CONTROL_CURRENT_Y_ID) {
-                    (void)gw_state_store_set_u32(&uid, "color_y", (uint32_t)raw, v.ts_ms);
-                } else {
-                    (void)gw_state_store_set_u32(&uid, "color_temp_mireds", (uint32_t)raw, v.ts_ms);
-                }
+            if (decoded) {
+                zb_attr_store(&uid, src_short, m->src_endpoint, &av, now_ms);
             }
 
             // Keep last seen fresh on any attribute report.
-            (void)gw_state_store_set_u64(&uid, "last_seen_ms", v.ts_ms, v.ts_ms);
+            (void)gw_state_store_set_u64(&uid, "last_seen_ms", now_ms, now_ms);
         }
 
         // Normalized event: zigbee.attr_report (msg + structured payload)
@@ -220,61 +181,8 @@ static esp_err_t zb_core_action_handler(esp_zb_core_action_callback_id_t callbac
             int64_t vi64 = 0;
             double vf64 = 0.0;
             const char *vtext = NULL;
-            if (m->attribute.data.value != NULL) {
-                if (cluster_id == ESP_ZB_ZCL_CLUSTER_ID_ON_OFF && attr_id == ESP_ZB_ZCL_ATTR_ON_OFF_ON_OFF_ID &&
-                    (m->attribute.data.type == ESP_ZB_ZCL_ATTR_TYPE_BOOL || m->attribute.data.type == ESP_ZB_ZCL_ATTR_TYPE_U8) &&
-                    m->attribute.data.size >= 1) {
-                    vtype = GW_EVENT_VALUE_BOOL;
-                    vbool = (*((const uint8_t *)m->attribute.data.value) != 0);
-                } else if (cluster_id == ESP_ZB_ZCL_CLUSTER_ID_TEMP_MEASUREMENT &&
-                           attr_id == ESP_ZB_ZCL_ATTR_TEMP_MEASUREMENT_VALUE_ID &&
-                           m->attribute.data.type == ESP_ZB_ZCL_ATTR_TYPE_S16 && m->attribute.data.size >= 2) {
-                    vtype = GW_EVENT_VALUE_F64;
-                    vf64 = ((double)(*((const int16_t *)m->attribute.data.value))) / 100.0;
-                } else if (cluster_id == ESP_ZB_ZCL_CLUSTER_ID_REL_HUMIDITY_MEASUREMENT &&
-                           attr_id == ESP_ZB_ZCL_ATTR_REL_HUMIDITY_MEASUREMENT_VALUE_ID &&
-                           m->attribute.data.type == ESP_ZB_ZCL_ATTR_TYPE_U16 && m->attribute.data.size >= 2) {
-                    vtype = GW_EVENT_VALUE_F64;
-                    vf64 = ((double)(*((const uint16_t *)m->attribute.data.value))) / 100.0;
-                } else if (cluster_id == ESP_ZB_ZCL_CLUSTER_ID_POWER_CONFIG &&
-                           attr_id == ESP_ZB_ZCL_ATTR_POWER_CONFIG_BATTERY_PERCENTAGE_REMAINING_ID &&
-                           m->attribute.data.type == ESP_ZB_ZCL_ATTR_TYPE_U8 && m->attribute.data.size >= 1) {
-                    vtype = GW_EVENT_VALUE_I64;
-                    vi64 = (int64_t)(*((const uint8_t *)m->attribute.data.value) / 2u);
-                } else if (cluster_id == ESP_ZB_ZCL_CLUSTER_ID_POWER_CONFIG &&
-                           attr_id == GW_ZB_ATTR_BATTERY_VOLTAGE &&
-                           m->attribute.data.type == ESP_ZB_ZCL_ATTR_TYPE_U8 && m->attribute.data.size >= 1) {
-                    vtype = GW_EVENT_VALUE_I64;
-                    vi64 = (int64_t)(*((const uint8_t *)m->attribute.data.value)) * 100;
-                } else if (cluster_id == GW_ZB_CLUSTER_OCCUPANCY_SENSING &&
-                           attr_id == GW_ZB_ATTR_OCCUPANCY &&
-                           (m->attribute.data.type == ESP_ZB_ZCL_ATTR_TYPE_8BITMAP || m->attribute.data.type == ESP_ZB_ZCL_ATTR_TYPE_U8) &&
-                           m->attribute.data.size >= 1) {
-                    vtype = GW_EVENT_VALUE_BOOL;
-                    vbool = ((*((const uint8_t *)m->attribute.data.value) & 0x01u) != 0);
-                } else if (cluster_id == GW_ZB_CLUSTER_ILLUMINANCE_MEASUREMENT &&
-                           attr_id == GW_ZB_ATTR_MEASURED_VALUE &&
-                           m->attribute.data.type == ESP_ZB_ZCL_ATTR_TYPE_U16 && m->attribute.data.size >= 2) {
-                    vtype = GW_EVENT_VALUE_I64;
-                    vi64 = (int64_t)(*((const uint16_t *)m->attribute.data.value));
-                } else if (cluster_id == GW_ZB_CLUSTER_PRESSURE_MEASUREMENT &&
-                           attr_id == GW_ZB_ATTR_MEASURED_VALUE &&
-                           m->attribute.data.type == ESP_ZB_ZCL_ATTR_TYPE_S16 && m->attribute.data.size >= 2) {
-                    vtype = GW_EVENT_VALUE_I64;
-                    vi64 = (int64_t)(*((const int16_t *)m->attribute.data.value));
-                } else if (cluster_id == ESP_ZB_ZCL_CLUSTER_ID_LEVEL_CONTROL &&
-                           attr_id == ESP_ZB_ZCL_ATTR_LEVEL_CONTROL_CURRENT_LEVEL_ID &&
-                           m->attribute.data.type == ESP_ZB_ZCL_ATTR_TYPE_U8 && m->attribute.data.size >= 1) {
-                    vtype = GW_EVENT_VALUE_I64;
-                    vi64 = (int64_t)(*((const uint8_t *)m->attribute.data.value));
-                } else if (cluster_id == ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL &&
-                           m->attribute.data.type == ESP_ZB_ZCL_ATTR_TYPE_U16 && m->attribute.data.size >= 2 &&
-                           (attr_id == ESP_ZB_ZCL_ATTR_COLOR_CONTROL_CURRENT_X_ID ||
-                            attr_id == ESP_ZB_ZCL_ATTR_COLOR_CONTROL_CURRENT_Y_ID ||
-                            attr_id == ESP_ZB_ZCL_ATTR_COLOR_CONTROL_COLOR_TEMPERATURE_ID)) {
-                    vtype = GW_EVENT_VALUE_I64;
-                    vi64 = (int64_t)(*((const uint16_t *)m->attribute.data.value));
-                }
+            if (decoded) {
+                gw_zb_attr_to_event(&av, &vtype, &vbool, &vi64, &vf64);
             }
             char msg[96];
             (void)snprintf(msg,
@@ -325,149 +233,42 @@ static esp_err_t zb_core_action_handler(esp_zb_core_action_callback_id_t callbac
         for (esp_zb_zcl_read_attr_resp_variable_t *it = m->variables; it != NULL; it = it->next) {
             const uint16_t cluster_id = m->info.cluster;
             const uint16_t attr_id = it->attribute.id;
+
+            if (uid.uid[0] == '\0' || it->status != ESP_ZB_ZCL_STATUS_SUCCESS) {
+                continue;
+            }
+            gw_zb_attr_value_t av = {0};
+            if (!gw_zb_attr_decode(cluster_id,
+                                   attr_id,
+                                   (uint8_t)it->attribute.data.type,
+                                   it->attribute.data.value,
+                                   it->attribute.data.size,
+                                   &av)) {
+                continue;
+            }
+            zb_attr_store(&uid, src_short, m->info.src_endpoint, &av, (uint64_t)(esp_timer_get_time() / 1000));
+
             gw_event_value_type_t vtype = GW_EVENT_VALUE_NONE;
             bool vbool = false;
             int64_t vi64 = 0;
             double vf64 = 0.0;
-            bool has_state_update = false;
-
-            if (uid.uid[0] != '\0' && it->status == ESP_ZB_ZCL_STATUS_SUCCESS && it->attribute.data.value != NULL) {
-                gw_sensor_value_t v = {0};
-                v.uid = uid;
-                v.short_addr = src_short;
-                v.endpoint = m->info.src_endpoint;
-                v.cluster_id = cluster_id;
-                v.attr_id = attr_id;
-                v.ts_ms = (uint64_t)(esp_timer_get_time() / 1000);
-
-                if (cluster_id == ESP_ZB_ZCL_CLUSTER_ID_TEMP_MEASUREMENT && attr_id == ESP_ZB_ZCL_ATTR_TEMP_MEASUREMENT_VALUE_ID &&
-                    it->attribute.data.type == ESP_ZB_ZCL_ATTR_TYPE_S16 && it->attribute.data.size >= 2) {
-                    v.value_type = GW_SENSOR_VALUE_I32;
-                    v.value_i32 = *((const int16_t *)it->attribute.data.value);
-                    (void)gw_sensor_store_upsert(&v);
-                    vtype = GW_EVENT_VALUE_F64;
-                    vf64 = ((double)v.value_i32) / 100.0;
-                    has_state_update = true;
-                } else if (cluster_id == ESP_ZB_ZCL_CLUSTER_ID_REL_HUMIDITY_MEASUREMENT &&
-                           attr_id == ESP_ZB_ZCL_ATTR_REL_HUMIDITY_MEASUREMENT_VALUE_ID && it->attribute.data.type == ESP_ZB_ZCL_ATTR_TYPE_U16 &&
-                           it->attribute.data.size >= 2) {
-                    v.value_type = GW_SENSOR_VALUE_U32;
-                    v.value_u32 = *((const uint16_t *)it->attribute.data.value);
-                    (void)gw_sensor_store_upsert(&v);
-                    vtype = GW_EVENT_VALUE_F64;
-                    vf64 = ((double)v.value_u32) / 100.0;
-                    has_state_update = true;
-                } else if (cluster_id == ESP_ZB_ZCL_CLUSTER_ID_POWER_CONFIG &&
-                           attr_id == ESP_ZB_ZCL_ATTR_POWER_CONFIG_BATTERY_PERCENTAGE_REMAINING_ID && it->attribute.data.type == ESP_ZB_ZCL_ATTR_TYPE_U8 &&
-                           it->attribute.data.size >= 1) {
-                    v.value_type = GW_SENSOR_VALUE_U32;
-                    v.value_u32 = *((const uint8_t *)it->attribute.data.value);
-                    (void)gw_sensor_store_upsert(&v);
-                    vtype = GW_EVENT_VALUE_I64;
-                    vi64 = (int64_t)(v.value_u32 / 2u);
-                    has_state_update = true;
-                } else if (cluster_id == ESP_ZB_ZCL_CLUSTER_ID_ON_OFF &&
-                           attr_id == ESP_ZB_ZCL_ATTR_ON_OFF_ON_OFF_ID &&
-                           (it->attribute.data.type == ESP_ZB_ZCL_ATTR_TYPE_BOOL || it->attribute.data.type == ESP_ZB_ZCL_ATTR_TYPE_U8) &&
-                           it->attribute.data.size >= 1) {
-                    uint8_t onoff = *((const uint8_t *)it->attribute.data.value);
-                    (void)gw_state_store_set_bool(&uid, "onoff", onoff != 0, v.ts_ms);
-                    vtype = GW_EVENT_VALUE_BOOL;
-                    vbool = (onoff != 0);
-                    has_state_update = true;
-                } else if (cluster_id == GW_ZB_CLUSTER_OCCUPANCY_SENSING &&
-                           attr_id == GW_ZB_ATTR_OCCUPANCY &&
-                           (it->attribute.data.type == ESP_ZB_ZCL_ATTR_TYPE_8BITMAP || it->attribute.data.type == ESP_ZB_ZCL_ATTR_TYPE_U8) &&
-                           it->attribute.data.size >= 1) {
-                    uint8_t occ = *((const uint8_t *)it->attribute.data.value);
-                    bool occupied = ((occ & 0x01u) != 0);
-                    (void)gw_state_store_set_bool(&uid, "occupancy", occupied, v.ts_ms);
-                    vtype = GW_EVENT_VALUE_BOOL;
-                    vbool = occupied;
-                    has_state_update = true;
-                } else if (cluster_id == GW_ZB_CLUSTER_ILLUMINANCE_MEASUREMENT &&
-                           attr_id == GW_ZB_ATTR_MEASURED_VALUE &&
-                           it->attribute.data.type == ESP_ZB_ZCL_ATTR_TYPE_U16 &&
-                           it->attribute.data.size >= 2) {
-                    v.value_type = GW_SENSOR_VALUE_U32;
-                    v.value_u32 = *((const uint16_t *)it->attribute.data.value);
-                    (void)gw_sensor_store_upsert(&v);
-                    (void)gw_state_store_set_u32(&uid, "illuminance_raw", v.value_u32, v.ts_ms);
-                    vtype = GW_EVENT_VALUE_I64;
-                    vi64 = (int64_t)v.value_u32;
-                    has_state_update = true;
-                } else if (cluster_id == GW_ZB_CLUSTER_PRESSURE_MEASUREMENT &&
-                           attr_id == GW_ZB_ATTR_MEASURED_VALUE &&
-                           it->attribute.data.type == ESP_ZB_ZCL_ATTR_TYPE_S16 &&
-                           it->attribute.data.size >= 2) {
-                    v.value_type = GW_SENSOR_VALUE_I32;
-                    v.value_i32 = *((const int16_t *)it->attribute.data.value);
-                    (void)gw_sensor_store_upsert(&v);
-                    (void)gw_state_store_set_f32(&uid, "pressure_raw", (float)v.value_i32, v.ts_ms);
-                    vtype = GW_EVENT_VALUE_I64;
-                    vi64 = (int64_t)v.value_i32;
-                    has_state_update = true;
-                } else if (cluster_id == ESP_ZB_ZCL_CLUSTER_ID_POWER_CONFIG &&
-                           attr_id == GW_ZB_ATTR_BATTERY_VOLTAGE &&
-                           it->attribute.data.type == ESP_ZB_ZCL_ATTR_TYPE_U8 &&
-                           it->attribute.data.size >= 1) {
-                    uint32_t mv = (uint32_t)(*((const uint8_t *)it->attribute.data.value)) * 100u;
-                    (void)gw_state_store_set_u32(&uid, "battery_mv", mv, v.ts_ms);
-                    vtype = GW_EVENT_VALUE_I64;
-                    vi64 = (int64_t)mv;
-                    has_state_update = true;
-                } else if (cluster_id == ESP_ZB_ZCL_CLUSTER_ID_LEVEL_CONTROL &&
-                           attr_id == ESP_ZB_ZCL_ATTR_LEVEL_CONTROL_CURRENT_LEVEL_ID &&
-                           it->attribute.data.type == ESP_ZB_ZCL_ATTR_TYPE_U8 &&
-                           it->attribute.data.size >= 1) {
-                    v.value_type = GW_SENSOR_VALUE_U32;
-                    v.value_u32 = *((const uint8_t *)it->attribute.data.value);
-                    (void)gw_sensor_store_upsert(&v);
-                    (void)gw_state_store_set_u32(&uid, "level", v.value_u32, v.ts_ms);
-                    vtype = GW_EVENT_VALUE_I64;
-                    vi64 = (int64_t)v.value_u32;
-                    has_state_update = true;
-                } else if (cluster_id == ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL &&
-                           it->attribute.data.type == ESP_ZB_ZCL_ATTR_TYPE_U16 &&
-                           it->attribute.data.size >= 2 &&
-                           (attr_id == ESP_ZB_ZCL_ATTR_COLOR_CONTROL_CURRENT_X_ID ||
-                            attr_id == ESP_ZB_ZCL_ATTR_COLOR_CONTROL_CURRENT_Y_ID ||
-                            attr_id == ESP_ZB_ZCL_ATTR_COLOR_CONTROL_COLOR_TEMPERATURE_ID)) {
-                    const uint16_t raw = *((const uint16_t *)it->attribute.data.value);
-                    v.value_type = GW_SENSOR_VALUE_U32;
-                    v.value_u32 = raw;
-                    (void)gw_sensor_store_upsert(&v);
-                    if (attr_id == ESP_ZB_ZCL_ATTR_COLOR_CONTROL_CURRENT_X_ID) {
-                        (void)gw_state_store_set_u32(&uid, "color_x", (uint32_t)raw, v.ts_ms);
-                    } else if (attr_id == ESP_ZB_ZCL_ATTR_COLOR_CONTROL_CURRENT_Y_ID) {
-                        (void)gw_state_store_set_u32(&uid, "color_y", (uint32_t)raw, v.ts_ms);
-                    } else {
-                        (void)gw_state_store_set_u32(&uid, "color_temp_mireds", (uint32_t)raw, v.ts_ms);
-                    }
-                    vtype = GW_EVENT_VALUE_I64;
-                    vi64 = (int64_t)raw;
-                    has_state_update = true;
-                }
-
-                if (has_state_update) {
-                    gw_event_bus_publish_zb("zigbee.attr_read",
-                                            "zigbee",
-                                            uid.uid,
-                                            src_short,
-                                            "read_attr state",
-                                            m->info.src_endpoint,
-                                            NULL,
-                                            cluster_id,
-                                            attr_id,
-                                            vtype,
-                                            vbool,
-                                            vi64,
-                                            vf64,
-                                            NULL,
-                                            NULL,
-                                            0);
-                }
-            }
+            gw_zb_attr_to_event(&av, &vtype, &vbool, &vi64, &vf64);
+            gw_event_bus_publish_zb("zigbee.attr_read",
+                                    "zigbee",
+                                    uid.uid,
+                                    src_short,
+                                    "read_attr state",
+                                    m->info.src_endpoint,
+                                    NULL,
+                                    cluster_id,
+                                    attr_id,
+                                    vtype,
+                                    vbool,
+                                    vi64,
+                                    vf64,
+                                    NULL,
+                                    NULL,
+                                    0);
         }
 
         gw_event_bus_publish("zigbee_read_attr_resp", "zigbee", uid.uid, src_short, "read attr response received");
@@ -688,6 +489,7 @@ static void esp_zb_task(void *pvParameters)
 
     // Allow the application to observe controller commands as "privilege command" callbacks.
     esp_zb_core_action_handler_register(zb_core_action_handler);
+    esp_zb_zcl_command_send_status_handler_register(zb_cmd_send_status_handler);
     (void)esp_zb_zcl_add_privilege_command(ESP_ZB_GATEWAY_ENDPOINT, ESP_ZB_ZCL_CLUSTER_ID_ON_OFF, ESP_ZB_ZCL_CMD_ON_OFF_OFF_ID);
     (void)esp_zb_zcl_add_privilege_command(ESP_ZB_GATEWAY_ENDPOINT, ESP_ZB_ZCL_CLUSTER_ID_ON_OFF, ESP_ZB_ZCL_CMD_ON_OFF_ON_ID);
     (void)esp_zb_zcl_add_privilege_command(ESP_ZB_GATEWAY_ENDPOINT, ESP_ZB_ZCL_CLUSTER_ID_ON_OFF, ESP_ZB_ZCL_CMD_ON_OFF_TOGGLE_ID);
@@ -726,6 +528,7 @@ void app_main(void)
     ESP_ERROR_CHECK(gw_sensor_store_init());
     ESP_ERROR_CHECK(gw_state_store_init());
     ESP_ERROR_CHECK(gw_device_registry_init());
+    ESP_ERROR_CHECK(gw_rules_init());
     ESP_ERROR_CHECK(gw_uart_link_start());
     gw_event_bus_publish("boot", "system", "", 0, "c6 thin zigbee router started");
 #if CONFIG_ESP_CONSOLE_USB_SERIAL_JTAG
@@ -13,12 +13,14 @@
 #include "freertos/task.h"
 #include "esp_check.h"
 #include "esp_log.h"
+#include "esp_rom_crc.h"
 
 #include "esp_zigbee_gateway.h"
 #include "gw_core/device_registry.h"
 #include "gw_core/device_storage.h"
 #include "gw_core/event_bus.h"
 #include "gw_core/gw_uart_proto.h"
+#include "gw_core/rules_engine.h"
 #include "gw_core/types.h"
 #include "gw_zigbee/gw_zigbee.h"
 
@@ -28,6 +30,7 @@
 #define GW_UART_TX_BUF_SIZE 1024
 #define GW_UART_EVT_Q_LEN 16
 #define GW_UART_TX_EVENT_Q 24
+#define GW_RULES_BUNDLE_MAX (16 * 1024)
 
 static const char *TAG = "gw_uart";
 
@@ -41,6 +44,13 @@ static volatile bool s_snapshot_requested;
 static volatile bool s_device_fb_requested;
 static volatile bool s_snapshot_tx_active;
 
+// Automation bundle from the S3 being received (rx task only); it only replaces
+// the running rules on GW_UART_CMD_RULES_COMMIT.
+static uint8_t *s_rules_rx_buf;
+static uint32_t s_rules_rx_len;
+static uint32_t s_rules_rx_got;
+static uint16_t s_rules_rx_id;
+
 static bool uart_write_all(const uint8_t *data, size_t len)
 {
     if (!data || len == 0) {
@@ -99,6 +109,8 @@ static const char *msg_type_name(uint8_t t)
             return "SNAPSHOT";
         case GW_UART_MSG_DEVICE_FB:
             return "DEVICE_FB";
+        case GW_UART_MSG_RULES_BUNDLE:
+            return "RULES_BUNDLE";
         default:
             return "UNKNOWN";
     }
@@ -619,6 +631,58 @@ static void on_event(const gw_event_t *event, void *user_ctx)
     (void)xQueueSend(s_evt_q, event, 0);
 }
 
+static void rules_rx_reset(void)
+{
+    free(s_rules_rx_buf);
+    s_rules_rx_buf = NULL;
+    s_rules_rx_len = 0;
+    s_rules_rx_got = 0;
+}
+
+static void rules_rx_chunk(const gw_uart_device_fb_chunk_v1_t *ch)
+{
+    if (ch->flags & GW_UART_DEVICE_FB_FLAG_BEGIN) {
+        rules_rx_reset();
+        if (ch->total_len == 0 || ch->total_len > GW_RULES_BUNDLE_MAX) {
+            ESP_LOGW(TAG, "rules bundle too large: %u", (unsigned)ch->total_len);
+            return;
+        }
+        s_rules_rx_buf = (uint8_t *)malloc(ch->total_len);
+        if (!s_rules_rx_buf) {
+            ESP_LOGW(TAG, "rules bundle alloc failed: %u", (unsigned)ch->total_len);
+            return;
+        }
+        s_rules_rx_id = ch->transfer_id;
+        s_rules_rx_len = ch->total_len;
+    }
+    // Chunks arrive in order; any gap drops the transfer and the commit is refused.
+    if (!s_rules_rx_buf || ch->transfer_id != s_rules_rx_id || ch->offset != s_rules_rx_got ||
+        ch->chunk_len > sizeof(ch->data) || ch->chunk_len > s_rules_rx_len - s_rules_rx_got) {
+        rules_rx_reset();
+        return;
+    }
+    memcpy(s_rules_rx_buf + ch->offset, ch->data, ch->chunk_len);
+    s_rules_rx_got += ch->chunk_len;
+}
+
+static esp_err_t rules_rx_commit(const gw_uart_cmd_req_v1_t *req)
+{
+    const uint32_t len = (uint32_t)req->param1;
+    esp_err_t err;
+    if (len == 0) {
+        err = gw_rules_load_bundle(NULL, 0);
+    } else if (!s_rules_rx_buf || (uint16_t)req->param0 != s_rules_rx_id || len != s_rules_rx_len ||
+               s_rules_rx_got != len) {
+        err = ESP_ERR_INVALID_STATE;
+    } else if (esp_rom_crc32_le(0, s_rules_rx_buf, len) != (uint32_t)req->param2) {
+        err = ESP_ERR_INVALID_CRC;
+    } else {
+        err = gw_rules_load_bundle(s_rules_rx_buf, len);
+    }
+    rules_rx_reset();
+    return err;
+}
+
 static esp_err_t exec_cmd_req(const gw_uart_cmd_req_v1_t *req)
 {
     gw_device_uid_t uid = {0};
@@ -650,10 +714,30 @@ static esp_err_t exec_cmd_req(const gw_uart_cmd_req_v1_t *req)
             gw_zigbee_level_t lv = {
                 .level = (uint8_t)req->param0,
                 .transition_ms = clamp_u16_i32(req->param1 * 100),
+                .with_onoff = req->param2 == 1,
             };
             return gw_zigbee_level_move_to_level(&uid, req->endpoint, lv);
         }
 
+        case GW_UART_CMD_GROUP_ONOFF: {
+            if (req->short_addr == 0 || req->short_addr == 0xFFFF || req->param0 < 0 || req->param0 > 2) {
+                return ESP_ERR_INVALID_ARG;
+            }
+            return gw_zigbee_group_onoff_cmd(req->short_addr, (gw_zigbee_onoff_cmd_t)req->param0);
+        }
+
+        case GW_UART_CMD_GROUP_LEVEL: {
+            if (req->short_addr == 0 || req->short_addr == 0xFFFF || req->param0 < 0 || req->param0 > 254 || req->param1 < 0) {
+                return ESP_ERR_INVALID_ARG;
+            }
+            gw_zigbee_level_t lv = {
+                .level = (uint8_t)req->param0,
+                .transition_ms = clamp_u16_i32(req->param1 * 100),
+                .with_onoff = req->param2 == 1,
+            };
+            return gw_zigbee_group_level_move_to_level(req->short_addr, lv);
+        }
+
         case GW_UART_CMD_COLOR_XY: {
             if (!has_uid || req->endpoint == 0 || req->param0 < 0 || req->param1 < 0 || req->param2 < 0) {
                 return ESP_ERR_INVALID_ARG;
@@ -685,6 +769,18 @@ static esp_err_t exec_cmd_req(const gw_uart_cmd_req_v1_t *req)
             return gw_zigbee_read_attr(&uid, req->endpoint, req->cluster_id, req->attr_id);
         }
 
+        case GW_UART_CMD_READ_ATTRS: {
+            if (!has_uid || req->endpoint == 0 || req->cluster_id == 0 || req->param0 <= 0 ||
+                req->param0 > GW_UART_READ_ATTRS_MAX) {
+                return ESP_ERR_INVALID_ARG;
+            }
+            uint16_t attrs[GW_UART_READ_ATTRS_MAX];
+            for (int32_t i = 0; i < req->param0; i++) {
+                attrs[i] = (uint16_t)((uint8_t)req->value_blob[2 * i] | ((uint16_t)(uint8_t)req->value_blob[2 * i + 1] << 8));
+            }
+            return gw_zigbee_read_attrs(&uid, req->endpoint, req->cluster_id, attrs, (size_t)req->param0);
+        }
+
         case GW_UART_CMD_WRITE_ATTR:
         case GW_UART_CMD_IDENTIFY:
             return ESP_ERR_NOT_SUPPORTED;
@@ -721,6 +817,20 @@ static esp_err_t exec_cmd_req(const gw_uart_cmd_req_v1_t *req)
             return ESP_ERR_NOT_SUPPORTED;
         case GW_UART_CMD_NET_SERVICES_START:
             return ESP_ERR_NOT_SUPPORTED;
+        case GW_UART_CMD_BIND:
+        case GW_UART_CMD_UNBIND: {
+            if (!has_uid || req->endpoint == 0 || req->cluster_id == 0 || req->value_text[0] == '\0' ||
+                req->param0 <= 0 || req->param0 > 240) {
+                return ESP_ERR_INVALID_ARG;
+            }
+            gw_device_uid_t dst = {0};
+            strlcpy(dst.uid, req->value_text, sizeof(dst.uid));
+            return (req->cmd_id == GW_UART_CMD_BIND)
+                       ? gw_zigbee_bind(&uid, req->endpoint, req->cluster_id, &dst, (uint8_t)req->param0)
+                       : gw_zigbee_unbind(&uid, req->endpoint, req->cluster_id, &dst, (uint8_t)req->param0);
+        }
+        case GW_UART_CMD_RULES_COMMIT:
+            return rules_rx_commit(req);
         default:
             return ESP_ERR_NOT_SUPPORTED;
     }
@@ -779,6 +889,13 @@ static void handle_rx_frame(const gw_uart_proto_frame_t *frame)
         case GW_UART_MSG_CMD_REQ:
             handle_cmd_req(frame);
             break;
+        case GW_UART_MSG_RULES_BUNDLE: {
+            gw_uart_device_fb_chunk_v1_t ch = {0};
+            size_t n = frame->payload_len < sizeof(ch) ? frame->payload_len : sizeof(ch);
+            memcpy(&ch, frame->payload, n);
+            rules_rx_chunk(&ch);
+            break;
+        }
         default:
             break;
     }
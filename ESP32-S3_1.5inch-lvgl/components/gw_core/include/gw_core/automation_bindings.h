@@ -0,0 +1,31 @@
+#pragma once
+
+#include <stdbool.h>
+
+#include "esp_err.h"
+#include "gw_core/automation_compiled.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Automations that only forward a switch's On/Off command to lights are offloaded to
+// ZDO bindings (see gw_auto_compiled_bindings()), so presses skip the gateway round trip.
+// Installed bindings are persisted so they can be removed when the rule changes.
+//
+// Sync and lookups are meant for the rules task only.
+
+esp_err_t gw_auto_bindings_init(void);
+
+// Bring installed bindings in line with `set`: unbind what no rule wants anymore,
+// bind what is newly eligible. Returns false if some request failed (retry later);
+// rules whose bindings are not all in place keep running on the gateway.
+bool gw_auto_bindings_sync(const gw_auto_compiled_t *set);
+
+// True when every binding of the automation is installed, i.e. the gateway must not
+// execute it as well.
+bool gw_auto_bindings_offloaded(const char *automation_id);
+
+#ifdef __cplusplus
+}
+#endif
@@ -19,11 +19,22 @@ This file defines the in-memory representation of a compiled automation,
 and the functions to compile/serialize/deserialize them.
 
 The fundamental binary structs (trigger, condition, action) are defined in types.h.
+
+A compiled value is either a set of separately allocated arrays (compiler output)
+or a view into one packed GWAR blob (header, records, then a shared string pool).
+Packed sets are what the automation store keeps and persists: memory is
+proportional to actual rule size and every string is stored once.
+
+A packed blob may also be a read-only flash (or host file) mapping: it is
+validated once when mapped and then used in place through the offsets above,
+so loading a bundle costs no heap copies.
 */
 
+#define GW_AUTO_BIN_VERSION 4 // 4: resolved action opcode; 3: run policy (2 and 3 are upgraded on load)
+
 typedef struct {
     uint32_t magic;   // 'GWAR' = 0x52415747
-    uint16_t version; // 2
+    uint16_t version; // GW_AUTO_BIN_VERSION
     uint16_t reserved;
 
     uint32_t automation_count;
@@ -39,12 +50,23 @@ typedef struct {
     uint32_t strings_size;    // size of string table in bytes
 } gw_auto_bin_header_v2_t;
 
+// What a trigger does while a run of the same automation is still in progress.
+typedef enum {
+    GW_AUTO_MODE_SINGLE = 1,   // ignore the trigger
+    GW_AUTO_MODE_RESTART = 2,  // cancel the running one and start over
+    GW_AUTO_MODE_QUEUED = 3,   // run after the current one, up to max_runs waiting
+    GW_AUTO_MODE_PARALLEL = 4, // start another run, up to max_runs at once
+} gw_auto_mode_t;
+
+#define GW_AUTO_MAX_RUNS_DEFAULT 10
+#define GW_AUTO_DELAY_MAX_MS     (24u * 60u * 60u * 1000u) // longest "delay" action
+
 typedef struct {
     uint32_t id_off;   // string table offset
     uint32_t name_off; // string table offset
     uint8_t enabled;   // 0/1
-    uint8_t mode;      // reserved for future (single/parallel/etc)
-    uint16_t reserved;
+    uint8_t mode;      // gw_auto_mode_t
+    uint16_t max_runs; // queued/parallel limit; 1 for single/restart
 
     uint32_t triggers_index;    // base index into triggers array
     uint32_t triggers_count;
@@ -52,6 +74,9 @@ typedef struct {
     uint32_t conditions_count;
     uint32_t actions_index;     // base index into actions array
     uint32_t actions_count;
+
+    uint32_t debounce_ms; // run only once triggers have been quiet this long (0 = off)
+    uint32_t throttle_ms; // at most one run per window, extra triggers dropped (0 = off)
 } gw_auto_bin_automation_v2_t;
 
 typedef struct {
@@ -62,6 +87,13 @@ typedef struct {
     gw_auto_bin_condition_v2_t *conditions;
     gw_auto_bin_action_v2_t *actions;
     char *strings; // string table bytes
+
+    // Set when the section pointers above point into one packed GWAR blob.
+    uint8_t *blob;
+    size_t blob_len;
+    bool blob_owned;  // blob is freed by gw_auto_compiled_free()
+    bool blob_mapped; // blob is a read-only mapping, unmapped by gw_auto_compiled_free()
+    uint32_t map_handle;
 } gw_auto_compiled_t;
 
 // Compile an automation definition from CBOR map (same schema as UI sends, but CBOR encoding).
@@ -73,13 +105,75 @@ void gw_auto_compiled_free(gw_auto_compiled_t *c);
 // Serialize compiled representation into a contiguous binary buffer (malloc'ed).
 esp_err_t gw_auto_compiled_serialize(const gw_auto_compiled_t *c, uint8_t **out_buf, size_t *out_len);
 
-// Deserialize a compiled buffer into heap-owned structures (use gw_auto_compiled_free()).
+// Deserialize a compiled buffer into one heap-owned packed copy (use gw_auto_compiled_free()).
+// Version 2 buffers are upgraded to the current record layout with default run policy.
 esp_err_t gw_auto_compiled_deserialize(const uint8_t *buf, size_t len, gw_auto_compiled_t *out);
 
+// Validate a packed GWAR blob and point `out` into it without copying.
+// `buf` must stay alive and 8-byte aligned while the view is used.
+// Blobs of an older version return ESP_ERR_INVALID_VERSION (deserialize them instead).
+esp_err_t gw_auto_compiled_view(const uint8_t *buf, size_t len, gw_auto_compiled_t *out);
+
+// Copy any compiled value into a single owned packed blob (also used as "dup").
+esp_err_t gw_auto_compiled_pack(const gw_auto_compiled_t *c, gw_auto_compiled_t *out);
+
+// Build a new packed set: `set` without `remove_id` (may be NULL), with every
+// automation of `add` (may be NULL) replacing the same id in place or appended.
+// Strings are re-interned into one deduplicated pool, dropping unused ones.
+esp_err_t gw_auto_compiled_merge(const gw_auto_compiled_t *set,
+                                 const gw_auto_compiled_t *add,
+                                 const char *remove_id,
+                                 gw_auto_compiled_t *out);
+
+// Build a new packed set with only the automations of `set` whose `keep[i]` is true.
+esp_err_t gw_auto_compiled_select(const gw_auto_compiled_t *set, const bool *keep, gw_auto_compiled_t *out);
+
+// Index of the automation with `id`, or -1.
+int gw_auto_compiled_find(const gw_auto_compiled_t *c, const char *id);
+
+// String table lookup; returns "" for offset 0 or out-of-range offsets.
+const char *gw_auto_compiled_str(const gw_auto_compiled_t *c, uint32_t off);
+
+// "single"/"restart"/"queued"/"parallel" for a gw_auto_mode_t value.
+const char *gw_auto_mode_to_str(uint8_t mode);
+
+// Opcode for an action command string ("onoff.on", "scene.recall", ...); NONE if unknown.
+gw_auto_act_op_t gw_auto_act_op_from_cmd(const char *cmd);
+
+// A ZDO binding that carries an automation's action without the gateway in the path.
+typedef struct {
+    uint32_t src_uid_off; // string table offsets into the set
+    uint32_t dst_uid_off;
+    uint16_t cluster_id;
+    uint8_t src_endpoint;
+    uint8_t dst_endpoint;
+} gw_auto_binding_t;
+
+// Optimiser pass: if automation `idx` only forwards the On/Off command that triggers it
+// to device endpoints (one trigger, no conditions, no debounce/throttle), fill `out` with
+// one binding per action and return how many. A binding carries every On/Off command of
+// the source endpoint, so the rules of that endpoint must also forward on, off and toggle
+// alike to the same targets. Returns 0 when the rule is not eligible.
+size_t gw_auto_compiled_bindings(const gw_auto_compiled_t *c, uint32_t idx, gw_auto_binding_t *out, size_t cap);
+
+// Placement pass: true if automation `idx` only reacts to Zigbee events and only
+// sends Zigbee commands, with no conditions, delays, "for" waits or debounce/throttle, so the Zigbee
+// coprocessor can run it next to the stack without the gateway's state.
+bool gw_auto_compiled_device_local(const gw_auto_compiled_t *c, uint32_t idx);
+
 // Convenience: read/write compiled automations file.
 esp_err_t gw_auto_compiled_write_file(const char *path, const gw_auto_compiled_t *c);
 esp_err_t gw_auto_compiled_read_file(const char *path, gw_auto_compiled_t *out);
 
+#if defined(ESP_PLATFORM)
+// Map `len` bytes at `offset` of data partition `label` into the data cache and
+// view them in place. The result is read-only; gw_auto_compiled_free() unmaps it.
+esp_err_t gw_auto_compiled_map_partition(const char *label, size_t offset, size_t len, gw_auto_compiled_t *out);
+#else
+// Host builds: mmap a compiled file read-only and view it in place.
+esp_err_t gw_auto_compiled_map_file(const char *path, gw_auto_compiled_t *out);
+#endif
+
 #ifdef __cplusplus
 }
 #endif
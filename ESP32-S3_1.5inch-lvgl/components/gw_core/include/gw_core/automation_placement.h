@@ -0,0 +1,26 @@
+#pragma once
+
+#include <stdbool.h>
+
+#include "gw_core/automation_compiled.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Device-local automations (see gw_auto_compiled_device_local()) are pushed to the C6
+// as one GWAR bundle and run there next to the Zigbee stack, so a trigger-to-command
+// path no longer crosses the UART twice. Rules already offloaded to bindings are left out.
+//
+// Sync and lookups are meant for the rules task only.
+
+// Bring the C6 bundle in line with `set`. Returns false if the push failed (retry later);
+// the last acknowledged placement stays in effect, since the C6 keeps running that bundle.
+bool gw_auto_placement_sync(const gw_auto_compiled_t *set);
+
+// True when the C6 runs the automation, i.e. the gateway must not execute it as well.
+bool gw_auto_placement_on_c6(const char *automation_id);
+
+#ifdef __cplusplus
+}
+#endif
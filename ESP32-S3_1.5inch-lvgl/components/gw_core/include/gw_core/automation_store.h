@@ -1,4 +1,4 @@
-// automation_store.h - Now using universal storage backend
+// automation_store.h - packed GWAR automation set, mapped in place from flash
 #pragma once
 
 #include <stdbool.h>
@@ -6,15 +6,21 @@
 #include <stdint.h>
 #include "esp_err.h"
 #include "gw_core/types.h"
+#include "gw_core/automation_compiled.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 esp_err_t gw_automation_store_init(void);
-size_t gw_automation_store_list(gw_automation_entry_t *out, size_t max_out);
 size_t gw_automation_store_list_meta(gw_automation_meta_t *out, size_t max_out);
-esp_err_t gw_automation_store_get(const char *id, gw_automation_entry_t *out);
+// Zero-copy, read-only view of the current automation set (mapped from flash).
+// Every acquire must be paired with gw_automation_store_release(); the view
+// stays valid until then even if the set is replaced meanwhile.
+const gw_auto_compiled_t *gw_automation_store_acquire(void);
+void gw_automation_store_release(const gw_auto_compiled_t *set);
+// Monotonic version of an acquired set; consecutive changes differ by exactly one.
+uint32_t gw_automation_store_version(const gw_auto_compiled_t *set);
 esp_err_t gw_automation_store_put_cbor(const uint8_t *buf, size_t len);
 esp_err_t gw_automation_store_remove(const char *id);
 esp_err_t gw_automation_store_set_enabled(const char *id, bool enabled);
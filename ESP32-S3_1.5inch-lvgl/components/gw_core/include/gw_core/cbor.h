@@ -1,4 +1,4 @@
-// cbor.h - small CBOR reader/writer (definite-length only).
+// cbor.h - small CBOR reader/writer.
 // This module is meant to replace JSON usage on the ESP32.
 #pragma once
 
@@ -22,10 +22,18 @@ typedef struct {
     const uint8_t *end;
 } gw_cbor_reader_t;
 
+// Streaming sink: receives the encoded bytes in order, one window at a time.
+typedef esp_err_t (*gw_cbor_sink_fn)(void *ctx, const uint8_t *data, size_t len);
+
 typedef struct {
     uint8_t *buf;
     size_t len;
     size_t cap;
+    gw_cbor_sink_fn sink; // NULL: buf holds the whole document
+    void *sink_ctx;
+    size_t flushed;       // bytes already handed to the sink
+    bool fixed;           // buf belongs to the caller: never grown, never freed
+    bool measure;         // size pass: len counts the bytes, nothing is stored
 } gw_cbor_writer_t;
 
 // Reader
@@ -44,11 +52,74 @@ bool gw_cbor_slice_to_f64(const gw_cbor_slice_t *s, double *out);
 bool gw_cbor_slice_to_bool(const gw_cbor_slice_t *s, bool *out);
 bool gw_cbor_slice_to_text_span(const gw_cbor_slice_t *s, const uint8_t **out_ptr, size_t *out_len);
 
+// Schema-driven map decoding: gw_cbor_decode_map() walks a map once and stores each
+// listed key into a struct member, instead of one gw_cbor_map_find() scan per key.
+// Keys that are not listed are skipped; for a repeated key the first one wins.
+typedef enum {
+    GW_CBOR_FIELD_ITEM = 0, // any item, as a gw_cbor_slice_t of its encoding
+    GW_CBOR_FIELD_TEXT,     // text string into a char array, NUL-terminated
+    GW_CBOR_FIELD_BOOL,
+    GW_CBOR_FIELD_U8,       // integers are range-checked, see gw_cbor_field_t
+    GW_CBOR_FIELD_U16,
+    GW_CBOR_FIELD_U32,
+    GW_CBOR_FIELD_I16,
+    GW_CBOR_FIELD_I32,
+    GW_CBOR_FIELD_I64,
+    GW_CBOR_FIELD_F64,      // float or integer into a double
+} gw_cbor_field_type_t;
+
+typedef struct {
+    const char *key;
+    gw_cbor_field_type_t type;
+    uint16_t offset; // of the destination member
+    uint16_t size;   // of the destination member (TEXT: buffer size incl. NUL)
+    int64_t min;     // integers: inclusive range; 0/0 = the destination type's range
+    int64_t max;
+} gw_cbor_field_t;
+
+#define GW_CBOR_FIELD(key_, type_, st_, member_) \
+    {(key_), (type_), (uint16_t)offsetof(st_, member_), (uint16_t)sizeof(((st_ *)0)->member_), 0, 0}
+#define GW_CBOR_FIELD_RANGE(key_, type_, st_, member_, min_, max_) \
+    {(key_), (type_), (uint16_t)offsetof(st_, member_), (uint16_t)sizeof(((st_ *)0)->member_), (min_), (max_)}
+
+#define GW_CBOR_MAX_FIELDS 32
+
+// Decode the map in `buf` into `out` by `fields` (at most GW_CBOR_MAX_FIELDS). Members of
+// absent keys are left untouched. Bit i of `*out_present` is set when fields[i] was found.
+// Returns false when `buf` is not a well-formed map or a listed key holds a value of the
+// wrong type or range; `*out_bad` is then that field's index, or -1 for the map itself.
+bool gw_cbor_decode_map(const uint8_t *buf,
+                        size_t len,
+                        const gw_cbor_field_t *fields,
+                        size_t n_fields,
+                        void *out,
+                        uint32_t *out_present,
+                        int *out_bad);
+
 // Writer
 void gw_cbor_writer_init(gw_cbor_writer_t *w);
+// Streaming writer: encodes into a fixed window of `window_size` bytes (allocated on
+// first use) and hands it to `sink` whenever it fills up, so memory stays flat no matter
+// how large the document gets. Call gw_cbor_writer_flush() at the end for the tail.
+void gw_cbor_writer_init_stream(gw_cbor_writer_t *w, size_t window_size, gw_cbor_sink_fn sink, void *ctx);
+// Same, but the window is caller memory (stack, arena, a frame buffer): no heap at all.
+// `cap` must hold at least 16 bytes.
+void gw_cbor_writer_init_stream_buf(gw_cbor_writer_t *w, uint8_t *buf, size_t cap, gw_cbor_sink_fn sink, void *ctx);
+// Fixed writer: encodes into `buf` and never allocates; running out of room fails with
+// ESP_ERR_INVALID_SIZE and leaves the writer unusable for that document.
+void gw_cbor_writer_init_fixed(gw_cbor_writer_t *w, uint8_t *buf, size_t cap);
+// Size pass: runs the same encode calls without storing anything; afterwards w->len is
+// the exact encoded size, e.g. to allocate the destination once.
+void gw_cbor_writer_init_measure(gw_cbor_writer_t *w);
+esp_err_t gw_cbor_writer_flush(gw_cbor_writer_t *w);
 void gw_cbor_writer_free(gw_cbor_writer_t *w);
 esp_err_t gw_cbor_writer_map(gw_cbor_writer_t *w, uint64_t pairs);
 esp_err_t gw_cbor_writer_array(gw_cbor_writer_t *w, uint64_t items);
+// Indefinite-length containers, for streams whose item count is not known up front.
+// Each one is closed by gw_cbor_writer_break().
+esp_err_t gw_cbor_writer_map_indef(gw_cbor_writer_t *w);
+esp_err_t gw_cbor_writer_array_indef(gw_cbor_writer_t *w);
+esp_err_t gw_cbor_writer_break(gw_cbor_writer_t *w);
 esp_err_t gw_cbor_writer_text(gw_cbor_writer_t *w, const char *s);
 esp_err_t gw_cbor_writer_text_n(gw_cbor_writer_t *w, const uint8_t *s, size_t n);
 esp_err_t gw_cbor_writer_bytes(gw_cbor_writer_t *w, const uint8_t *s, size_t n);
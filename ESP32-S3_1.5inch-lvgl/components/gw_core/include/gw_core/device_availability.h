@@ -0,0 +1,27 @@
+#pragma once
+
+#include <stdbool.h>
+
+#include "esp_err.h"
+#include "gw_core/types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Offline detection: every Zigbee event from a device re-arms one timer for it on the
+// shared timer service. When it runs out, "device.offline" is published; the next
+// event from the device publishes "device.online".
+
+// Longer than the 24 h maximum reporting interval sleepy end devices are configured with.
+#define GW_DEVICE_OFFLINE_TIMEOUT_MS (25u * 60u * 60u * 1000u)
+
+esp_err_t gw_device_availability_init(void);
+
+// False once the device has been silent for the timeout. Devices not heard from since
+// boot count as online.
+bool gw_device_availability_online(const gw_device_uid_t *uid);
+
+#ifdef __cplusplus
+}
+#endif
@@ -13,6 +13,8 @@ esp_err_t gw_device_fb_store_init(void);
 esp_err_t gw_device_fb_store_set(const uint8_t *buf, size_t len);
 const uint8_t *gw_device_fb_store_get(size_t *out_len);
 esp_err_t gw_device_fb_store_copy(uint8_t **out_buf, size_t *out_len);
+// Bumped by every set (conditional GETs); 0 until the first one. Restarts on boot.
+uint32_t gw_device_fb_store_version(void);
 
 #ifdef __cplusplus
 }
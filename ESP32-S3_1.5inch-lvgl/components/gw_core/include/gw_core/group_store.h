@@ -14,6 +14,8 @@ esp_err_t gw_group_store_init(void);
 
 size_t gw_group_store_list(gw_group_entry_t *out, size_t max_out);
 size_t gw_group_store_list_items(gw_group_item_t *out, size_t max_out);
+// Changes whenever groups or group items do (conditional GETs); restarts on boot.
+uint32_t gw_group_store_version(void);
 
 esp_err_t gw_group_store_create(const char *id_opt, const char *name, gw_group_entry_t *out_created);
 esp_err_t gw_group_store_rename(const char *id, const char *name);
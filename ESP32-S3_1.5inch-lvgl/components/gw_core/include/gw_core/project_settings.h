@@ -20,6 +20,8 @@ typedef struct {
 esp_err_t gw_project_settings_init(void);
 esp_err_t gw_project_settings_get(gw_project_settings_t *out);
 esp_err_t gw_project_settings_set(const gw_project_settings_t *in);
+// Changes on every set (conditional GETs); restarts on boot.
+uint32_t gw_project_settings_version(void);
 void gw_project_settings_get_defaults(gw_project_settings_t *out);
 bool gw_project_settings_validate(const gw_project_settings_t *in);
 
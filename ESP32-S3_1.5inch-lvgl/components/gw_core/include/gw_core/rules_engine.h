@@ -1,7 +1,11 @@
 #pragma once
 
+#include <stddef.h>
+#include <stdint.h>
+
 #include "esp_err.h"
 #include "gw_core/event_bus.h"
+#include "gw_core/types.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -10,6 +14,34 @@ extern "C" {
 esp_err_t gw_rules_init(void);
 esp_err_t gw_rules_handle_event(gw_event_id_t id, const void *data, size_t data_size);
 
+// Per-automation execution counters, kept by the rules task since boot or the last
+// gw_rules_stats_reset(). Rules offloaded to bindings or the C6 only count candidates
+// and matches.
+#define GW_RULES_LATENCY_BUCKETS 16
+
+typedef struct {
+    uint32_t candidates;      // events the trigger index offered this automation
+    uint32_t matches;         // ...of which a trigger matched (time triggers: each occurrence)
+    uint32_t cond_rejects;    // matched, but the conditions did not hold
+    uint32_t fires;           // runs started
+    uint32_t action_failures; // actions (delays included) that failed
+    // Latency from the triggering event (or the timer, for runs started or resumed by
+    // a wait) to the last action of that step: bucket 0 is under 1 ms, bucket i is
+    // [2^(i-1), 2^i) ms, the last one is open-ended.
+    uint32_t latency_hist[GW_RULES_LATENCY_BUCKETS];
+} gw_rules_counters_t;
+
+typedef struct {
+    char id[GW_AUTOMATION_ID_MAX];
+    gw_rules_counters_t counters;
+} gw_rules_stats_t;
+
+// Copy up to `max_out` entries (any order) and return how many there are in total.
+// Counters are read while the rules task keeps updating them, so fields of one entry
+// may be a few events apart.
+size_t gw_rules_stats_snapshot(gw_rules_stats_t *out, size_t max_out);
+void gw_rules_stats_reset(void);
+
 #ifdef __cplusplus
 }
 #endif
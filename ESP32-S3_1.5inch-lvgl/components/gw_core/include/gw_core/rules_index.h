@@ -0,0 +1,103 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "gw_core/automation_compiled.h"
+#include "gw_core/event_bus.h"
+#include "gw_core/state_store.h"
+#include "gw_core/types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Matching core of the rules engine, built by both the S3 and the C6 firmware
+// (keep the two copies identical): trigger index over a compiled automation set,
+// trigger and condition checks. It never allocates; the caller owns the index
+// block and decides how it is shared between versions.
+
+#define GW_RULE_NO_AUTO UINT32_MAX
+
+typedef struct {
+    uint8_t evt_type;
+    uint8_t endpoint;
+    uint16_t cluster_id;
+    uint16_t attr_id;
+    uint32_t uid_hash;
+    uint32_t cmd_hash;
+    uint8_t has_uid;
+    uint8_t has_endpoint;
+    uint8_t has_cluster;
+    uint8_t has_attr;
+    uint8_t has_cmd;
+} gw_rules_trigger_key_t;
+
+typedef struct {
+    bool used;
+    gw_rules_trigger_key_t key;
+} gw_rules_index_slot_t;
+
+// Views into one flat block: index slots, index_cap * mask_words bitmask words, a
+// scratch mask, then the rule slot table. Index bits address stable rule slots (not
+// set positions), so a rule edit only touches that rule's triggers, and a flat copy
+// of the block (plus gw_rules_index_attach()) is a valid copy of the index.
+typedef struct {
+    gw_rules_index_slot_t *slots;
+    size_t index_cap; // power of two
+    size_t index_used;
+    uint32_t *masks;
+    size_t mask_words;
+    uint32_t *candidates; // matcher scratch, mask_words long
+    uint32_t *slot_auto;  // rule slot -> automation index in the set, GW_RULE_NO_AUTO if free
+    size_t slot_cap;      // mask_words * 32
+} gw_rules_index_t;
+
+typedef struct {
+    uint8_t endpoint;
+    bool has_endpoint;
+    char cmd_buf[32];
+    const char *cmd;
+    bool has_cmd;
+    uint16_t cluster_id;
+    bool has_cluster;
+    uint16_t attr_id;
+    bool has_attr;
+} gw_rules_event_view_t;
+
+// Endpoint-agnostic state lookup used by conditions (each firmware has its own store).
+typedef esp_err_t (*gw_rules_state_get_fn)(const gw_device_uid_t *uid, const char *key, gw_state_item_t *out);
+
+// Index geometry for `set`: at most half full, with rule slot headroom so adding a
+// rule rarely forces a rebuild.
+void gw_rules_index_geometry(const gw_auto_compiled_t *set, size_t *index_cap, size_t *mask_words);
+size_t gw_rules_index_block_size(size_t index_cap, size_t mask_words);
+// Point `ix` at `block` (gw_rules_index_block_size() bytes). Does not touch the contents.
+void gw_rules_index_attach(gw_rules_index_t *ix, void *block, size_t index_cap, size_t mask_words);
+
+// Fill a zeroed index with every automation of `set`, rule slot == set position.
+void gw_rules_index_fill(gw_rules_index_t *ix, const gw_auto_compiled_t *set);
+// Add (or clear) the index bits of automation `auto_idx` of `set` for `rule_slot`.
+void gw_rules_index_automation(gw_rules_index_t *ix, const gw_auto_compiled_t *set, uint32_t auto_idx, uint32_t rule_slot, bool add);
+// Rule slot holding `auto_idx` (GW_RULE_NO_AUTO finds a free one), or -1.
+int gw_rules_index_slot_of(const gw_rules_index_t *ix, uint32_t auto_idx);
+
+void gw_rules_event_view(const gw_event_t *e, gw_rules_event_view_t *out);
+// Automation event type of a bus event, 0 if no trigger can match it.
+gw_auto_evt_type_t gw_rules_evt_type(const gw_event_t *e);
+
+// Set ix->candidates to the rule slots whose trigger keys match the event; false if none.
+// The scratch mask is written, so one caller at a time per index block.
+bool gw_rules_index_candidates(const gw_rules_index_t *ix, const gw_event_t *e, const gw_rules_event_view_t *pv, gw_auto_evt_type_t evt_type);
+
+// Full checks on a candidate: any trigger matches / all conditions hold.
+// gw_rules_matching_trigger() returns the first trigger that matches, or NULL.
+const gw_auto_bin_trigger_v2_t *gw_rules_matching_trigger(const gw_auto_compiled_t *set, const gw_auto_bin_automation_v2_t *a, gw_auto_evt_type_t evt_type, const gw_event_t *e, const gw_rules_event_view_t *pv);
+bool gw_rules_triggers_match(const gw_auto_compiled_t *set, const gw_auto_bin_automation_v2_t *a, gw_auto_evt_type_t evt_type, const gw_event_t *e, const gw_rules_event_view_t *pv);
+bool gw_rules_conditions_pass(const gw_auto_compiled_t *set, const gw_auto_bin_automation_v2_t *a, gw_rules_state_get_fn get_state);
+
+#ifdef __cplusplus
+}
+#endif
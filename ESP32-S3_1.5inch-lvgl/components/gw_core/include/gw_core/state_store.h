@@ -25,6 +25,7 @@ extern "C" {
 #define GW_STATE_TEXT_MAX 64
 
 typedef enum {
+    GW_STATE_VALUE_REMOVED = 0, // only in change pages: the item is gone
     GW_STATE_VALUE_BOOL = 1,
     GW_STATE_VALUE_F32 = 2,
     GW_STATE_VALUE_U32 = 3,
@@ -43,6 +44,7 @@ typedef struct {
     uint64_t value_u64;
     char value_text[GW_STATE_TEXT_MAX];
     uint64_t ts_ms;
+    uint32_t version; // store version of the last value change (a refresh of the same value keeps it)
 } gw_state_item_t;
 
 esp_err_t gw_state_store_init(void);
@@ -58,6 +60,23 @@ esp_err_t gw_state_store_get(const gw_device_uid_t *uid, uint8_t endpoint, const
 esp_err_t gw_state_store_get_any(const gw_device_uid_t *uid, const char *key, gw_state_item_t *out);
 size_t gw_state_store_list(const gw_device_uid_t *uid, uint8_t endpoint, gw_state_item_t *out, size_t max_out);
 size_t gw_state_store_list_uid(const gw_device_uid_t *uid, gw_state_item_t *out, size_t max_out);
+// Walk the whole store a page at a time: start with *cursor = 0, stop when it returns 0.
+// Items are never removed (evictions reuse the slot), so a walk visits every slot once
+// without holding the lock between pages.
+size_t gw_state_store_list_page(size_t *cursor, gw_state_item_t *out, size_t max_out);
+
+// Every value change, insert and removal takes the next store-wide version.
+uint32_t gw_state_store_version(void);
+
+// Page through what changed after version *cursor, oldest first: each changed item once
+// with its current value, removed and evicted items with value_type
+// GW_STATE_VALUE_REMOVED. Advances *cursor; done when *out_count is 0. Cost follows the
+// number of changes, not the store size. ESP_ERR_INVALID_STATE: the change log no
+// longer reaches back to *cursor, so the caller has to start over from a full listing.
+esp_err_t gw_state_store_changes_page(uint32_t *cursor, gw_state_item_t *out, size_t max_out, size_t *out_count);
+
+// Drop every item of a device (removed from the network); deltas report them as removed.
+size_t gw_state_store_remove_uid(const gw_device_uid_t *uid);
 
 #ifdef __cplusplus
 }
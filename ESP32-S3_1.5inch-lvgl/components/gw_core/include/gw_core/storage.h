@@ -35,6 +35,7 @@ typedef struct {
     void *data;                         // In-memory cache
     size_t count;                       // Current item count
     portMUX_TYPE lock;                  // Thread safety
+    uint32_t content_version;           // Bumped by every gw_storage_save(), i.e. after each change
 } gw_storage_t;
 
 // Initialize storage system
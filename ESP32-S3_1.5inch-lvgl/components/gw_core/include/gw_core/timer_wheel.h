@@ -0,0 +1,66 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Hierarchical hashed timing wheel: O(1) arm and cancel, amortised O(1) per tick.
+// Four levels of 64 slots; with a 10 ms tick it covers ~46 h, longer delays are
+// clamped to the range. Timers are intrusive nodes owned by the caller, so the
+// wheel never allocates.
+//
+// The wheel itself is not thread-safe: one owner calls every function (see
+// gw_core/timers.h for the shared, locked instance).
+
+#define GW_TIMER_WHEEL_LEVELS    4
+#define GW_TIMER_WHEEL_SLOT_BITS 6
+#define GW_TIMER_WHEEL_SLOTS     (1u << GW_TIMER_WHEEL_SLOT_BITS)
+#define GW_TIMER_WHEEL_MAX_TICKS ((1ull << (GW_TIMER_WHEEL_LEVELS * GW_TIMER_WHEEL_SLOT_BITS)) - 1)
+
+typedef struct gw_timer gw_timer_t;
+typedef void (*gw_timer_cb_t)(gw_timer_t *timer, void *arg);
+
+struct gw_timer {
+    gw_timer_t *next;
+    gw_timer_t **pprev; // NULL while not armed
+    uint64_t expires;   // wheel tick
+    gw_timer_cb_t cb;
+    void *arg;
+};
+
+typedef struct {
+    gw_timer_t *slots[GW_TIMER_WHEEL_LEVELS][GW_TIMER_WHEEL_SLOTS];
+    uint64_t next_tick; // first tick not processed yet
+    uint32_t tick_ms;
+    size_t armed;
+} gw_timer_wheel_t;
+
+void gw_timer_wheel_init(gw_timer_wheel_t *w, uint32_t tick_ms, uint64_t now_ms);
+
+// (Re)arm `t` to call `cb(t, arg)` once `delay_ms` has passed since `now_ms`
+// (rounded up to whole ticks, at least one). Re-arming an armed timer moves it.
+void gw_timer_wheel_arm(gw_timer_wheel_t *w, gw_timer_t *t, uint64_t now_ms, uint32_t delay_ms, gw_timer_cb_t cb, void *arg);
+// No-op if `t` is not armed. Safe from a callback, also for a timer due in the same tick.
+void gw_timer_wheel_cancel(gw_timer_wheel_t *w, gw_timer_t *t);
+
+static inline bool gw_timer_armed(const gw_timer_t *t)
+{
+    return t && t->pprev != NULL;
+}
+
+// Run every timer due by `now_ms`, in tick order. A callback may arm or cancel any
+// timer, including its own. Returns the number of callbacks run.
+size_t gw_timer_wheel_advance(gw_timer_wheel_t *w, uint64_t now_ms);
+
+// Earliest time (ms, tick aligned) at which advance() has work to do: a timer due or
+// an upper level to cascade. UINT64_MAX when nothing is armed. Scans each level once,
+// so a driver can sleep until then instead of ticking.
+uint64_t gw_timer_wheel_next_due_ms(const gw_timer_wheel_t *w);
+
+#ifdef __cplusplus
+}
+#endif
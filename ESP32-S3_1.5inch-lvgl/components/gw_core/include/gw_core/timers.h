@@ -0,0 +1,34 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "gw_core/timer_wheel.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Shared timer service: one timing wheel (10 ms ticks) driven by a single one-shot
+// FreeRTOS timer that is reprogrammed to the next due time, so an idle gateway takes
+// no ticks at all.
+//
+// Callbacks run one at a time on the "timers" task with the service lock held. Keep
+// them short and non-blocking (set a flag, post to the owner's queue). Because of the
+// lock, once gw_timers_cancel() returns the timer's callback is neither running nor
+// pending, so its memory can be freed.
+
+#define GW_TIMERS_TICK_MS 10
+
+esp_err_t gw_timers_init(void);
+
+// (Re)arm `t`; re-arming an armed timer moves it. `t` must stay valid until it fires
+// or is cancelled. May be called from a timer callback.
+esp_err_t gw_timers_arm(gw_timer_t *t, uint32_t delay_ms, gw_timer_cb_t cb, void *arg);
+void gw_timers_cancel(gw_timer_t *t);
+bool gw_timers_pending(const gw_timer_t *t);
+
+#ifdef __cplusplus
+}
+#endif
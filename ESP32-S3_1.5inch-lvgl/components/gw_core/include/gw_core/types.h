@@ -26,13 +26,6 @@ typedef struct {
 #define GW_AUTOMATION_ID_MAX   32
 #define GW_AUTOMATION_NAME_MAX 48
 
-// These limits are a trade-off between flexibility and memory usage.
-// They can be tuned after analyzing typical use cases.
-#define GW_AUTO_MAX_TRIGGERS           4
-#define GW_AUTO_MAX_CONDITIONS         8
-#define GW_AUTO_MAX_ACTIONS            8
-#define GW_AUTO_MAX_STRING_TABLE_BYTES 256
-
 // --- Low-level binary structs and enums for automations (moved from automation_compiled.h) ---
 
 typedef enum {
@@ -40,6 +33,7 @@ typedef enum {
     GW_AUTO_EVT_ZIGBEE_ATTR_REPORT = 2,
     GW_AUTO_EVT_DEVICE_JOIN = 3,
     GW_AUTO_EVT_DEVICE_LEAVE = 4,
+    GW_AUTO_EVT_TIME = 5, // wall clock: attr_id = minute of day, endpoint = weekday mask (bit 0 = Sunday, 0 = every day)
 } gw_auto_evt_type_t;
 
 typedef enum {
@@ -62,6 +56,7 @@ typedef enum {
     GW_AUTO_ACT_SCENE = 3,
     GW_AUTO_ACT_BIND = 4,
     GW_AUTO_ACT_MGMT = 5,
+    GW_AUTO_ACT_DELAY = 6, // wait arg0_u32 ms before the next action (rules engine only)
 } gw_auto_act_kind_t;
 
 typedef enum {
@@ -69,10 +64,31 @@ typedef enum {
     GW_AUTO_ACT_FLAG_REJOIN = 1 << 1, // MGMT leave: request rejoin
 } gw_auto_act_flag_t;
 
+// What an action does, resolved from its command string at compile time so the
+// executor never parses strings. Arguments are validated by the compiler.
+typedef enum {
+    GW_AUTO_ACT_OP_NONE = 0,         // unknown command (only in upgraded old blobs)
+    GW_AUTO_ACT_OP_ONOFF_OFF,
+    GW_AUTO_ACT_OP_ONOFF_ON,
+    GW_AUTO_ACT_OP_ONOFF_TOGGLE,
+    GW_AUTO_ACT_OP_LEVEL_MOVE,       // arg0 = level 0..254, arg1 = transition_ms
+    GW_AUTO_ACT_OP_LEVEL_MOVE_ONOFF, // same args; level 0 turns the light off
+    GW_AUTO_ACT_OP_COLOR_XY,         // arg0 = x, arg1 = y, arg2 = transition_ms
+    GW_AUTO_ACT_OP_COLOR_TEMP,       // arg0 = mireds 1..1000, arg1 = transition_ms
+    GW_AUTO_ACT_OP_SCENE_STORE,
+    GW_AUTO_ACT_OP_SCENE_RECALL,
+    GW_AUTO_ACT_OP_BIND,
+    GW_AUTO_ACT_OP_UNBIND,
+    GW_AUTO_ACT_OP_DELAY,            // arg0 = ms
+    GW_AUTO_ACT_OP_COUNT,
+} gw_auto_act_op_t;
+
+#define GW_AUTO_TRANSITION_MAX_MS 60000
+
 typedef struct {
     uint8_t event_type; // gw_auto_evt_type_t
     uint8_t endpoint;   // 0 = any
-    uint16_t reserved;
+    uint16_t for_s;     // fire only once conditions still hold this many seconds later (0 = at once)
     uint32_t device_uid_off; // string table offset (0 = any)
     uint32_t cmd_off;    // string table offset (0 = any)
     uint16_t cluster_id; // 0 = any
@@ -104,31 +120,12 @@ typedef struct {
     uint32_t arg0_u32;
     uint32_t arg1_u32;
     uint32_t arg2_u32;
+    uint8_t op;       // gw_auto_act_op_t, resolved from cmd by the compiler
+    uint8_t reserved[3];
 } gw_auto_bin_action_v2_t;
 
 // --- End of moved structs ---
 
-// New, self-contained structure representing a single compiled automation.
-// It has a fixed size and contains no pointers, which simplifies serialization.
-typedef struct {
-    char id[GW_AUTOMATION_ID_MAX];
-    char name[GW_AUTOMATION_NAME_MAX];
-    bool enabled;
-    uint8_t reserved; // Padding/alignment
-
-    uint8_t triggers_count;
-    uint8_t conditions_count;
-    uint8_t actions_count;
-    uint8_t reserved2; // Padding/alignment
-
-    gw_auto_bin_trigger_v2_t triggers[GW_AUTO_MAX_TRIGGERS];
-    gw_auto_bin_condition_v2_t conditions[GW_AUTO_MAX_CONDITIONS];
-    gw_auto_bin_action_v2_t actions[GW_AUTO_MAX_ACTIONS];
-
-    uint16_t string_table_size;
-    char string_table[GW_AUTO_MAX_STRING_TABLE_BYTES];
-} gw_automation_entry_t;
-
 // Lightweight metadata view for UI/status, does not need the full compiled body.
 typedef struct {
     char id[GW_AUTOMATION_ID_MAX];
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "gw_core/event_bus.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// ZCL attribute data types the map understands (values from the ZCL spec).
+#define GW_ZCL_TYPE_BOOL    0x10
+#define GW_ZCL_TYPE_BITMAP8 0x18
+#define GW_ZCL_TYPE_U8      0x20
+#define GW_ZCL_TYPE_U16     0x21
+#define GW_ZCL_TYPE_S16     0x29
+
+// How the wire value becomes the normalized state value.
+typedef enum {
+    GW_ZB_ATTR_SCALE_RAW = 0,
+    GW_ZB_ATTR_SCALE_DIV2,   // half units, e.g. battery percentage
+    GW_ZB_ATTR_SCALE_DIV100, // hundredths, e.g. temperature, humidity
+    GW_ZB_ATTR_SCALE_MUL100, // 100 mV units, e.g. battery voltage
+    GW_ZB_ATTR_SCALE_BIT0,   // bitmap, bit 0 is the state
+} gw_zb_attr_scale_t;
+
+// Type of the normalized value in the state store.
+typedef enum {
+    GW_ZB_ATTR_KIND_BOOL = 0,
+    GW_ZB_ATTR_KIND_U32,
+    GW_ZB_ATTR_KIND_F32,
+} gw_zb_attr_kind_t;
+
+#define GW_ZB_ATTR_F_SENSOR 0x01 // also kept in the sensor store (raw wire value)
+
+// One known attribute. Supporting a new cluster/attribute is a new row in the table.
+typedef struct {
+    uint16_t cluster;
+    uint16_t attr;
+    uint8_t zcl_type;     // expected wire type
+    uint8_t zcl_type_alt; // also accepted, 0 = none
+    uint8_t scale;        // gw_zb_attr_scale_t
+    uint8_t kind;         // gw_zb_attr_kind_t
+    uint8_t flags;        // GW_ZB_ATTR_F_*
+    const char *state_key;
+} gw_zb_attr_desc_t;
+
+// A decoded attribute: the wire value plus its normalized form.
+typedef struct {
+    const gw_zb_attr_desc_t *desc;
+    int32_t raw;  // as sent by the device
+    double value; // normalized, in the units of desc->state_key
+} gw_zb_attr_value_t;
+
+// Descriptor for cluster/attr, NULL when the attribute is not mapped.
+const gw_zb_attr_desc_t *gw_zb_attr_find(uint16_t cluster, uint16_t attr);
+
+// The whole table, sorted by (cluster, attr): the rows of one cluster are adjacent.
+const gw_zb_attr_desc_t *gw_zb_attr_table(size_t *out_count);
+
+// Decode a ZCL attribute value as received over the air. Returns false when the attribute
+// is not mapped, or its type or size does not match the descriptor.
+bool gw_zb_attr_decode(uint16_t cluster,
+                       uint16_t attr,
+                       uint8_t zcl_type,
+                       const void *data,
+                       size_t size,
+                       gw_zb_attr_value_t *out);
+
+// Rebuild a decoded value from an already normalized event value (the form that
+// gw_zb_attr_to_event() produces). Returns false when the attribute is not mapped or the
+// value type does not fit.
+bool gw_zb_attr_from_event(uint16_t cluster,
+                           uint16_t attr,
+                           gw_event_value_type_t type,
+                           bool vbool,
+                           int64_t vi64,
+                           double vf64,
+                           gw_zb_attr_value_t *out);
+
+// Event payload for a decoded value: BOOL for flags, F64 for scaled fractions, else I64.
+void gw_zb_attr_to_event(const gw_zb_attr_value_t *v,
+                         gw_event_value_type_t *out_type,
+                         bool *out_bool,
+                         int64_t *out_i64,
+                         double *out_f64);
+
+#ifdef __cplusplus
+}
+#endif
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <stddef.h>
+#include <stdint.h>
 
 #include "gw_core/zb_model.h"
 
@@ -8,6 +9,10 @@
 extern "C" {
 #endif
 
+// Zigbee groups the C6 enrols endpoints in at discovery (Groups server required).
+#define GW_ZB_GROUP_SWITCHES 0x0002
+#define GW_ZB_GROUP_LIGHTS   0x0003
+
 // A human-friendly classification for a single endpoint, derived from its Simple Descriptor.
 //
 // Note: "device type" is profile-specific; this is a practical heuristic based on ZCL clusters
@@ -20,6 +25,9 @@ size_t gw_zb_endpoint_accepts(const gw_zb_endpoint_t *ep, const char **out, size
 size_t gw_zb_endpoint_emits(const gw_zb_endpoint_t *ep, const char **out, size_t max_out);
 size_t gw_zb_endpoint_reports(const gw_zb_endpoint_t *ep, const char **out, size_t max_out);
 
+// Automatic group of the endpoint (GW_ZB_GROUP_*), 0 if it is not enrolled in one.
+uint16_t gw_zb_endpoint_auto_group(const gw_zb_endpoint_t *ep);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,220 @@
+#include "gw_core/automation_bindings.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "esp_log.h"
+#include "gw_core/storage.h"
+#include "gw_core/types.h"
+#include "gw_zigbee/gw_zigbee.h"
+
+static const char *TAG = "gw_autobind";
+
+static const uint32_t AUTO_BINDINGS_MAGIC = 0x42444E41; // ANDB
+static const uint16_t AUTO_BINDINGS_VERSION = 1;
+#define AUTO_BINDINGS_MAX 32
+#define AUTO_BINDINGS_PER_RULE 8
+
+// One installed binding and the automation it was made for.
+typedef struct {
+    char automation_id[GW_AUTOMATION_ID_MAX];
+    char src_uid[GW_DEVICE_UID_STRLEN];
+    char dst_uid[GW_DEVICE_UID_STRLEN];
+    uint16_t cluster_id;
+    uint8_t src_endpoint;
+    uint8_t dst_endpoint;
+} auto_binding_entry_t;
+
+static const gw_storage_desc_t s_bindings_desc = {
+    .key = "autobind",
+    .item_size = sizeof(auto_binding_entry_t),
+    .max_items = AUTO_BINDINGS_MAX,
+    .magic = AUTO_BINDINGS_MAGIC,
+    .version = AUTO_BINDINGS_VERSION,
+    .namespace = "autos",
+};
+
+static gw_storage_t s_storage;
+static bool s_initialized;
+
+// Automation ids whose bindings were all in place after the last sync.
+static char (*s_offloaded)[GW_AUTOMATION_ID_MAX];
+static size_t s_offloaded_count;
+
+static bool same_link(const auto_binding_entry_t *a, const auto_binding_entry_t *b)
+{
+    return a->cluster_id == b->cluster_id && a->src_endpoint == b->src_endpoint && a->dst_endpoint == b->dst_endpoint &&
+           strcasecmp(a->src_uid, b->src_uid) == 0 && strcasecmp(a->dst_uid, b->dst_uid) == 0;
+}
+
+static bool same_entry(const auto_binding_entry_t *a, const auto_binding_entry_t *b)
+{
+    return same_link(a, b) && strcmp(a->automation_id, b->automation_id) == 0;
+}
+
+static bool contains(const auto_binding_entry_t *list, size_t n, const auto_binding_entry_t *e, bool link_only)
+{
+    for (size_t i = 0; i < n; i++) {
+        if (link_only ? same_link(&list[i], e) : same_entry(&list[i], e)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static esp_err_t link_request(const auto_binding_entry_t *e, bool unbind)
+{
+    gw_device_uid_t src = {0};
+    gw_device_uid_t dst = {0};
+    strlcpy(src.uid, e->src_uid, sizeof(src.uid));
+    strlcpy(dst.uid, e->dst_uid, sizeof(dst.uid));
+    return unbind ? gw_zigbee_unbind(&src, e->src_endpoint, e->cluster_id, &dst, e->dst_endpoint)
+                  : gw_zigbee_bind(&src, e->src_endpoint, e->cluster_id, &dst, e->dst_endpoint);
+}
+
+// Every binding any eligible automation in `set` asks for, grouped by automation.
+static size_t collect_wanted(const gw_auto_compiled_t *set, auto_binding_entry_t **out)
+{
+    *out = NULL;
+    const uint32_t n = set ? set->hdr.automation_count : 0;
+    if (n == 0) {
+        return 0;
+    }
+    auto_binding_entry_t *wanted = (auto_binding_entry_t *)calloc((size_t)n * AUTO_BINDINGS_PER_RULE, sizeof(*wanted));
+    if (!wanted) {
+        return 0;
+    }
+    size_t count = 0;
+    gw_auto_binding_t plan[AUTO_BINDINGS_PER_RULE];
+    for (uint32_t i = 0; i < n; i++) {
+        const size_t k = gw_auto_compiled_bindings(set, i, plan, AUTO_BINDINGS_PER_RULE);
+        for (size_t j = 0; j < k; j++) {
+            auto_binding_entry_t *e = &wanted[count++];
+            strlcpy(e->automation_id, gw_auto_compiled_str(set, set->autos[i].id_off), sizeof(e->automation_id));
+            strlcpy(e->src_uid, gw_auto_compiled_str(set, plan[j].src_uid_off), sizeof(e->src_uid));
+            strlcpy(e->dst_uid, gw_auto_compiled_str(set, plan[j].dst_uid_off), sizeof(e->dst_uid));
+            e->cluster_id = plan[j].cluster_id;
+            e->src_endpoint = plan[j].src_endpoint;
+            e->dst_endpoint = plan[j].dst_endpoint;
+        }
+    }
+    *out = wanted;
+    return count;
+}
+
+esp_err_t gw_auto_bindings_init(void)
+{
+    if (s_initialized) {
+        return ESP_OK;
+    }
+    esp_err_t err = gw_storage_init(&s_storage, &s_bindings_desc, GW_STORAGE_NVS);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "bindings storage init failed: %s", esp_err_to_name(err));
+        return err;
+    }
+    s_initialized = true;
+    return ESP_OK;
+}
+
+bool gw_auto_bindings_sync(const gw_auto_compiled_t *set)
+{
+    if (!s_initialized) {
+        return true;
+    }
+
+    auto_binding_entry_t *wanted = NULL;
+    const size_t wanted_count = collect_wanted(set, &wanted);
+    auto_binding_entry_t *installed = (auto_binding_entry_t *)s_storage.data;
+    bool complete = true;
+    bool dirty = false;
+
+    // Drop bindings no rule asks for. The link itself stays if another rule still uses it.
+    for (size_t i = 0; i < s_storage.count;) {
+        auto_binding_entry_t *e = &installed[i];
+        if (contains(wanted, wanted_count, e, false)) {
+            i++;
+            continue;
+        }
+        if (!contains(wanted, wanted_count, e, true)) {
+            esp_err_t err = link_request(e, true);
+            // INVALID_STATE: the source device is gone, and so is its binding table.
+            if (err != ESP_OK && err != ESP_ERR_INVALID_STATE) {
+                ESP_LOGW(TAG, "unbind %s ep%u -> %s ep%u failed: %s", e->src_uid, (unsigned)e->src_endpoint,
+                         e->dst_uid, (unsigned)e->dst_endpoint, esp_err_to_name(err));
+                complete = false;
+                i++;
+                continue;
+            }
+        }
+        installed[i] = installed[--s_storage.count];
+        dirty = true;
+    }
+
+    // Install what is newly eligible. Failures leave the rule on the gateway.
+    for (size_t i = 0; i < wanted_count; i++) {
+        const auto_binding_entry_t *w = &wanted[i];
+        if (contains(installed, s_storage.count, w, false)) {
+            continue;
+        }
+        if (s_storage.count >= AUTO_BINDINGS_MAX) {
+            break;
+        }
+        if (!contains(installed, s_storage.count, w, true)) {
+            esp_err_t err = link_request(w, false);
+            if (err != ESP_OK) {
+                ESP_LOGW(TAG, "bind %s ep%u -> %s ep%u failed: %s", w->src_uid, (unsigned)w->src_endpoint, w->dst_uid,
+                         (unsigned)w->dst_endpoint, esp_err_to_name(err));
+                complete = false;
+                continue;
+            }
+            ESP_LOGI(TAG, "automation %s offloaded: %s ep%u -> %s ep%u", w->automation_id, w->src_uid,
+                     (unsigned)w->src_endpoint, w->dst_uid, (unsigned)w->dst_endpoint);
+        }
+        installed[s_storage.count++] = *w;
+        dirty = true;
+    }
+
+    if (dirty) {
+        esp_err_t err = gw_storage_save(&s_storage);
+        if (err != ESP_OK) {
+            ESP_LOGW(TAG, "bindings save failed: %s", esp_err_to_name(err));
+        }
+    }
+
+    // A rule is offloaded only when all of its bindings made it.
+    free(s_offloaded);
+    s_offloaded = NULL;
+    s_offloaded_count = 0;
+    if (wanted_count) {
+        s_offloaded = calloc(wanted_count, sizeof(*s_offloaded));
+    }
+    for (size_t i = 0; s_offloaded && i < wanted_count;) {
+        size_t end = i;
+        bool all = true;
+        while (end < wanted_count && strcmp(wanted[end].automation_id, wanted[i].automation_id) == 0) {
+            all = all && contains(installed, s_storage.count, &wanted[end], false);
+            end++;
+        }
+        if (all) {
+            strlcpy(s_offloaded[s_offloaded_count++], wanted[i].automation_id, GW_AUTOMATION_ID_MAX);
+        }
+        i = end;
+    }
+
+    free(wanted);
+    return complete;
+}
+
+bool gw_auto_bindings_offloaded(const char *automation_id)
+{
+    if (!automation_id) {
+        return false;
+    }
+    for (size_t i = 0; i < s_offloaded_count; i++) {
+        if (strcmp(s_offloaded[i], automation_id) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
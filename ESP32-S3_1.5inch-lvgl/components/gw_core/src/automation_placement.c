@@ -0,0 +1,79 @@
+#include "gw_core/automation_placement.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_log.h"
+#include "esp_rom_crc.h"
+#include "gw_core/automation_bindings.h"
+#include "gw_core/types.h"
+#include "gw_zigbee/gw_zigbee.h"
+
+static const char *TAG = "gw_autoplace";
+
+// Last bundle the C6 acknowledged, and the automation ids in it.
+static bool s_pushed;
+static uint32_t s_pushed_crc;
+static char (*s_on_c6)[GW_AUTOMATION_ID_MAX];
+static size_t s_on_c6_count;
+
+static void set_on_c6(const gw_auto_compiled_t *set, const bool *keep, size_t count)
+{
+    free(s_on_c6);
+    s_on_c6 = count ? calloc(count, sizeof(*s_on_c6)) : NULL;
+    s_on_c6_count = 0;
+    for (uint32_t i = 0; s_on_c6 && i < set->hdr.automation_count; i++) {
+        if (keep[i]) {
+            strlcpy(s_on_c6[s_on_c6_count++], gw_auto_compiled_str(set, set->autos[i].id_off), GW_AUTOMATION_ID_MAX);
+        }
+    }
+}
+
+bool gw_auto_placement_sync(const gw_auto_compiled_t *set)
+{
+    const uint32_t n = set ? set->hdr.automation_count : 0;
+    bool *keep = n ? (bool *)calloc(n, sizeof(*keep)) : NULL;
+    if (n && !keep) {
+        return false;
+    }
+    size_t count = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        keep[i] = gw_auto_compiled_device_local(set, i) &&
+                  !gw_auto_bindings_offloaded(gw_auto_compiled_str(set, set->autos[i].id_off));
+        count += keep[i] ? 1 : 0;
+    }
+
+    gw_auto_compiled_t bundle = {0};
+    esp_err_t err = count ? gw_auto_compiled_select(set, keep, &bundle) : ESP_OK;
+    const uint32_t crc = (err == ESP_OK && count) ? esp_rom_crc32_le(0, bundle.blob, bundle.blob_len) : 0;
+    if (err == ESP_OK && (!s_pushed || crc != s_pushed_crc)) {
+        err = gw_zigbee_rules_push(bundle.blob, count ? bundle.blob_len : 0);
+        if (err == ESP_OK) {
+            s_pushed = true;
+            s_pushed_crc = crc;
+            ESP_LOGI(TAG, "%u automations run on the C6 (%u bytes)", (unsigned)count, (unsigned)bundle.blob_len);
+        } else {
+            ESP_LOGW(TAG, "rules bundle push failed: %s", esp_err_to_name(err));
+        }
+    }
+    if (err == ESP_OK) {
+        set_on_c6(set, keep, count);
+    }
+
+    gw_auto_compiled_free(&bundle);
+    free(keep);
+    return err == ESP_OK;
+}
+
+bool gw_auto_placement_on_c6(const char *automation_id)
+{
+    if (!automation_id) {
+        return false;
+    }
+    for (size_t i = 0; i < s_on_c6_count; i++) {
+        if (strcmp(s_on_c6[i], automation_id) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
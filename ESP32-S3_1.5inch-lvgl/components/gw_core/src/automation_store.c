@@ -1,6 +1,5 @@
-// automation_store.c - Now using universal storage backend
+// automation_store.c - packed GWAR automation set, mapped in place from flash
 #include "gw_core/automation_store.h"
-#include "gw_core/storage.h"
 #include "gw_core/automation_compiled.h"
 
 #include <stdio.h>
@@ -8,157 +7,548 @@
 #include <string.h>
 
 #include "esp_log.h"
+#include "esp_partition.h"
+#include "esp_rom_crc.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "nvs.h"
 
 static const char *TAG = "gw_autos";
 
-// Automation storage configuration
-static const uint32_t AUTOMATION_STORAGE_MAGIC = 0x4155544f; // 'AUTO'
-static const uint16_t AUTOMATION_STORAGE_VERSION = 2;
-static const size_t AUTOMATION_STORAGE_MAX_ITEMS = 32;
-
-static gw_storage_t s_automation_storage;
+// Bundles live in a raw data partition split into two slots. A save writes the
+// inactive slot (body first, slot header last) and maps it; the newest valid
+// slot wins at boot. Readers use the mapping in place, so nothing is copied.
+#define AUTOMATION_PARTITION_LABEL "gw_autos"
+#define AUTOMATION_SLOT_MAGIC      0x53415747u // 'GWAS'
+#define AUTOMATION_SLOT_HDR_SIZE   16
+#define AUTOMATION_SLOT_WAIT_MS    2000
+
+// Fallback when the partition table has no gw_autos entry: heap copy persisted
+// in NVS, sized to leave room for other keys in the 24 KB NVS partition.
+#define AUTOMATION_NVS_NAMESPACE "autos"
+#define AUTOMATION_NVS_KEY       "gwar"
+#define AUTOMATION_NVS_MAX_BYTES (12 * 1024)
+
+// Legacy fixed-slot layout ('AUTO' v2 blob under key "autos"), kept only for migration.
+#define LEGACY_NVS_KEY       "autos"
+#define LEGACY_MAGIC         0x4155544fu
+#define LEGACY_VERSION       2
+#define LEGACY_MAX_TRIGGERS   4
+#define LEGACY_MAX_CONDITIONS 8
+#define LEGACY_MAX_ACTIONS    8
+#define LEGACY_MAX_STRINGS    256
+
+typedef struct {
+    char id[GW_AUTOMATION_ID_MAX];
+    char name[GW_AUTOMATION_NAME_MAX];
+    bool enabled;
+    uint8_t reserved;
+    uint8_t triggers_count;
+    uint8_t conditions_count;
+    uint8_t actions_count;
+    uint8_t reserved2;
+    gw_auto_bin_trigger_v2_t triggers[LEGACY_MAX_TRIGGERS];
+    gw_auto_bin_condition_v2_t conditions[LEGACY_MAX_CONDITIONS];
+    gw_auto_bin_action_v2_t actions[LEGACY_MAX_ACTIONS];
+    uint16_t string_table_size;
+    char string_table[LEGACY_MAX_STRINGS];
+} legacy_automation_entry_t;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t seq;
+    uint32_t len; // blob bytes following the slot header
+    uint32_t crc; // esp_rom_crc32_le over the blob
+} automation_slot_hdr_t;
+
+// One published version of the set. `set` is first so acquire() can hand it out directly.
+typedef struct {
+    gw_auto_compiled_t set;
+    uint32_t refs;
+    uint32_t version; // bumped on every publish
+    int slot;         // flash slot backing the mapping, -1 for a heap blob
+} automation_gen_t;
+
+static SemaphoreHandle_t s_lock; // serializes writers
+static portMUX_TYPE s_gen_lock = portMUX_INITIALIZER_UNLOCKED;
+static automation_gen_t *s_gen;
+static automation_gen_t *s_slot_users[2];
+static const esp_partition_t *s_part;
+static size_t s_slot_size;
+static uint32_t s_seq;
+static uint32_t s_version;
 static bool s_initialized = false;
 
-static bool automation_storage_ready(void)
+static automation_gen_t *gen_new(gw_auto_compiled_t *set, int slot)
 {
-    return s_initialized &&
-           s_automation_storage.desc &&
-           s_automation_storage.desc->key &&
-           s_automation_storage.desc->key[0] != '\0' &&
-           s_automation_storage.data != NULL;
+    automation_gen_t *gen = (automation_gen_t *)calloc(1, sizeof(*gen));
+    if (!gen) {
+        return NULL;
+    }
+    gen->set = *set;
+    gen->refs = 1; // the store's own reference while current
+    gen->slot = slot;
+    *set = (gw_auto_compiled_t){0};
+    if (slot >= 0) {
+        portENTER_CRITICAL(&s_gen_lock);
+        s_slot_users[slot] = gen;
+        portEXIT_CRITICAL(&s_gen_lock);
+    }
+    return gen;
 }
 
-static esp_err_t automation_storage_save_locked(void)
+static void gen_release(automation_gen_t *gen)
 {
-    if (!automation_storage_ready()) {
-        ESP_LOGE(TAG,
-                 "Automation storage not ready for save (init=%d desc=%p key=%p data=%p)",
-                 s_initialized,
-                 s_automation_storage.desc,
-                 s_automation_storage.desc ? (const void *)s_automation_storage.desc->key : NULL,
-                 s_automation_storage.data);
-        return ESP_ERR_INVALID_STATE;
-    }
-    return gw_storage_save(&s_automation_storage);
+    if (!gen) {
+        return;
+    }
+    portENTER_CRITICAL(&s_gen_lock);
+    bool last = --gen->refs == 0;
+    if (last && gen->slot >= 0 && s_slot_users[gen->slot] == gen) {
+        s_slot_users[gen->slot] = NULL;
+    }
+    portEXIT_CRITICAL(&s_gen_lock);
+
+    if (last) {
+        gw_auto_compiled_free(&gen->set);
+        free(gen);
+    }
 }
 
-// Storage descriptor
-static const gw_storage_desc_t s_automation_storage_desc = {
-    .key = "autos",
-    .item_size = sizeof(gw_automation_entry_t),
-    .max_items = AUTOMATION_STORAGE_MAX_ITEMS,
-    .magic = AUTOMATION_STORAGE_MAGIC,
-    .version = AUTOMATION_STORAGE_VERSION,
-    .namespace = "autos"
-};
+static void gen_publish(automation_gen_t *gen)
+{
+    portENTER_CRITICAL(&s_gen_lock);
+    automation_gen_t *old = s_gen;
+    gen->version = ++s_version;
+    s_gen = gen;
+    portEXIT_CRITICAL(&s_gen_lock);
+    gen_release(old);
+}
 
-// Internal helper functions
-static size_t find_automation_index_by_id(const char *id);
-static esp_err_t compile_automation_cbor(const uint8_t *buf, size_t len, gw_automation_entry_t *out_entry);
+static esp_err_t automation_nvs_save(const gw_auto_compiled_t *set)
+{
+    nvs_handle_t handle;
+    esp_err_t err = nvs_open(AUTOMATION_NVS_NAMESPACE, NVS_READWRITE, &handle);
+    if (err != ESP_OK) return err;
+    err = nvs_set_blob(handle, AUTOMATION_NVS_KEY, set->blob, set->blob_len);
+    if (err == ESP_OK) {
+        err = nvs_commit(handle);
+    }
+    nvs_close(handle);
+    return err;
+}
 
-esp_err_t gw_automation_store_init(void)
+static esp_err_t automation_nvs_load(gw_auto_compiled_t *out)
 {
-    if (s_initialized) {
-        return ESP_OK;
+    nvs_handle_t handle;
+    esp_err_t err = nvs_open(AUTOMATION_NVS_NAMESPACE, NVS_READONLY, &handle);
+    if (err != ESP_OK) return err;
+
+    size_t len = 0;
+    err = nvs_get_blob(handle, AUTOMATION_NVS_KEY, NULL, &len);
+    if (err != ESP_OK || len == 0) {
+        nvs_close(handle);
+        return err != ESP_OK ? err : ESP_ERR_NVS_NOT_FOUND;
+    }
+    uint8_t *buf = (uint8_t *)malloc(len);
+    if (!buf) {
+        nvs_close(handle);
+        return ESP_ERR_NO_MEM;
+    }
+    err = nvs_get_blob(handle, AUTOMATION_NVS_KEY, buf, &len);
+    nvs_close(handle);
+    if (err == ESP_OK) {
+        err = gw_auto_compiled_view(buf, len, out);
+    }
+    if (err != ESP_OK) {
+        free(buf);
+        return err;
+    }
+    out->blob_owned = true;
+    return ESP_OK;
+}
+
+static void automation_nvs_erase(const char *key)
+{
+    nvs_handle_t handle;
+    if (nvs_open(AUTOMATION_NVS_NAMESPACE, NVS_READWRITE, &handle) != ESP_OK) {
+        return;
+    }
+    if (nvs_erase_key(handle, key) == ESP_OK) {
+        (void)nvs_commit(handle);
+    }
+    nvs_close(handle);
+}
+
+// Convert one legacy fixed slot into a single-automation compiled value.
+// id/name lived outside the slot string table, so they are appended to a copy of it.
+static esp_err_t legacy_entry_to_compiled(const legacy_automation_entry_t *e, gw_auto_compiled_t *out)
+{
+    char strings[LEGACY_MAX_STRINGS + GW_AUTOMATION_ID_MAX + GW_AUTOMATION_NAME_MAX];
+    size_t st_len = e->string_table_size <= LEGACY_MAX_STRINGS ? e->string_table_size : LEGACY_MAX_STRINGS;
+    if (st_len == 0) {
+        strings[0] = '\0';
+        st_len = 1;
+    } else {
+        memcpy(strings, e->string_table, st_len);
+        strings[st_len - 1] = '\0';
     }
 
-    // S3 architecture now keeps automations in NVS only.
-    esp_err_t err = gw_storage_init(&s_automation_storage, &s_automation_storage_desc, GW_STORAGE_NVS);
+    gw_auto_bin_automation_v2_t rec = {0};
+    rec.id_off = (uint32_t)st_len;
+    st_len += strlcpy(strings + st_len, e->id, GW_AUTOMATION_ID_MAX) + 1;
+    rec.name_off = (uint32_t)st_len;
+    st_len += strlcpy(strings + st_len, e->name, GW_AUTOMATION_NAME_MAX) + 1;
+    rec.enabled = e->enabled ? 1 : 0;
+    rec.mode = GW_AUTO_MODE_SINGLE;
+    rec.max_runs = 1;
+    rec.triggers_count = e->triggers_count <= LEGACY_MAX_TRIGGERS ? e->triggers_count : LEGACY_MAX_TRIGGERS;
+    rec.conditions_count = e->conditions_count <= LEGACY_MAX_CONDITIONS ? e->conditions_count : LEGACY_MAX_CONDITIONS;
+    rec.actions_count = e->actions_count <= LEGACY_MAX_ACTIONS ? e->actions_count : LEGACY_MAX_ACTIONS;
+
+    gw_auto_compiled_t one = {
+        .hdr = {
+            .magic = 0x52415747u, // 'GWAR'
+            .version = GW_AUTO_BIN_VERSION,
+            .automation_count = 1,
+            .trigger_count_total = rec.triggers_count,
+            .condition_count_total = rec.conditions_count,
+            .action_count_total = rec.actions_count,
+            .strings_size = (uint32_t)st_len,
+        },
+        .autos = &rec,
+        .triggers = (gw_auto_bin_trigger_v2_t *)e->triggers,
+        .conditions = (gw_auto_bin_condition_v2_t *)e->conditions,
+        .actions = (gw_auto_bin_action_v2_t *)e->actions,
+        .strings = strings,
+    };
+    return gw_auto_compiled_pack(&one, out);
+}
+
+// Convert the legacy "autos" blob into `set`. Returns ESP_ERR_NVS_NOT_FOUND when there is none.
+static esp_err_t automation_migrate_legacy(gw_auto_compiled_t *set)
+{
+    nvs_handle_t handle;
+    esp_err_t err = nvs_open(AUTOMATION_NVS_NAMESPACE, NVS_READONLY, &handle);
+    if (err != ESP_OK) return err;
+
+    size_t len = 0;
+    err = nvs_get_blob(handle, LEGACY_NVS_KEY, NULL, &len);
     if (err != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to initialize automation storage (NVS): %s", esp_err_to_name(err));
+        nvs_close(handle);
         return err;
     }
+    uint8_t *blob = (uint8_t *)malloc(len);
+    if (!blob) {
+        nvs_close(handle);
+        return ESP_ERR_NO_MEM;
+    }
+    err = nvs_get_blob(handle, LEGACY_NVS_KEY, blob, &len);
+    nvs_close(handle);
+
+    uint32_t magic = 0;
+    uint16_t version = 0;
+    uint16_t count = 0;
+    const size_t hdr_len = sizeof(magic) + sizeof(version) + sizeof(count);
+    if (err == ESP_OK && len >= hdr_len) {
+        memcpy(&magic, blob, sizeof(magic));
+        memcpy(&version, blob + 4, sizeof(version));
+        memcpy(&count, blob + 6, sizeof(count));
+    }
 
-    s_initialized = true;
-    ESP_LOGI(TAG, "Automation storage initialized with %zu automations", s_automation_storage.count);
-    return ESP_OK;
+    size_t migrated = 0;
+    if (err == ESP_OK && magic == LEGACY_MAGIC && version == LEGACY_VERSION) {
+        for (uint16_t i = 0; i < count && hdr_len + (size_t)(i + 1) * sizeof(legacy_automation_entry_t) <= len; i++) {
+            legacy_automation_entry_t e;
+            memcpy(&e, blob + hdr_len + (size_t)i * sizeof(e), sizeof(e));
+            e.id[sizeof(e.id) - 1] = '\0';
+            e.name[sizeof(e.name) - 1] = '\0';
+            if (!e.id[0]) continue;
+
+            gw_auto_compiled_t one = {0};
+            gw_auto_compiled_t next = {0};
+            esp_err_t rc = legacy_entry_to_compiled(&e, &one);
+            if (rc == ESP_OK) rc = gw_auto_compiled_merge(set, &one, NULL, &next);
+            gw_auto_compiled_free(&one);
+            if (rc != ESP_OK) {
+                ESP_LOGW(TAG, "Skipping legacy automation %s: %s", e.id, esp_err_to_name(rc));
+                continue;
+            }
+            gw_auto_compiled_free(set);
+            *set = next;
+            migrated++;
+        }
+        ESP_LOGI(TAG, "Migrated %u legacy automations", (unsigned)migrated);
+    } else if (err == ESP_OK) {
+        ESP_LOGW(TAG, "Legacy automation blob magic/version mismatch, dropping it");
+    }
+    free(blob);
+    return err;
 }
 
-static size_t find_automation_index_by_id(const char *id)
+// Validate slot `slot` once (header, CRC, section bounds) and map it in place.
+static esp_err_t automation_slot_read_upgrade(size_t base, const automation_slot_hdr_t *hdr, gw_auto_compiled_t *out)
 {
-    if (!id || !s_initialized) {
-        return (size_t)-1;
+    uint8_t *buf = (uint8_t *)malloc(hdr->len);
+    if (!buf) return ESP_ERR_NO_MEM;
+    esp_err_t err = esp_partition_read(s_part, base + AUTOMATION_SLOT_HDR_SIZE, buf, hdr->len);
+    if (err == ESP_OK && esp_rom_crc32_le(0, buf, hdr->len) != hdr->crc) err = ESP_ERR_INVALID_CRC;
+    if (err == ESP_OK) err = gw_auto_compiled_deserialize(buf, hdr->len, out);
+    free(buf);
+    return err;
+}
+
+static esp_err_t automation_slot_map(int slot, gw_auto_compiled_t *out, uint32_t *out_seq)
+{
+    automation_slot_hdr_t hdr = {0};
+    const size_t base = (size_t)slot * s_slot_size;
+    esp_err_t err = esp_partition_read(s_part, base, &hdr, sizeof(hdr));
+    if (err != ESP_OK) return err;
+    if (hdr.magic != AUTOMATION_SLOT_MAGIC || hdr.len == 0 || hdr.len > s_slot_size - AUTOMATION_SLOT_HDR_SIZE) {
+        return ESP_ERR_NOT_FOUND;
     }
 
-    gw_automation_entry_t *automations = (gw_automation_entry_t *)s_automation_storage.data;
-    for (size_t i = 0; i < s_automation_storage.count; i++) {
-        if (strncmp(id, automations[i].id, GW_AUTOMATION_ID_MAX) == 0) {
-            return i;
+    err = gw_auto_compiled_map_partition(AUTOMATION_PARTITION_LABEL, base + AUTOMATION_SLOT_HDR_SIZE, hdr.len, out);
+    if (err == ESP_ERR_INVALID_VERSION) {
+        // Older format: upgrade into a heap copy; init rewrites it to a slot.
+        err = automation_slot_read_upgrade(base, &hdr, out);
+        if (err != ESP_OK) return err;
+        *out_seq = hdr.seq;
+        return ESP_OK;
+    }
+    if (err != ESP_OK) return err;
+    if (esp_rom_crc32_le(0, out->blob, hdr.len) != hdr.crc) {
+        gw_auto_compiled_free(out);
+        return ESP_ERR_INVALID_CRC;
+    }
+    *out_seq = hdr.seq;
+    return ESP_OK;
+}
+
+static esp_err_t automation_slot_write(int slot, const gw_auto_compiled_t *set, uint32_t seq)
+{
+    const size_t base = (size_t)slot * s_slot_size;
+    const size_t used = AUTOMATION_SLOT_HDR_SIZE + set->blob_len;
+    const size_t erase = (used + s_part->erase_size - 1) / s_part->erase_size * s_part->erase_size;
+    automation_slot_hdr_t hdr = {
+        .magic = AUTOMATION_SLOT_MAGIC,
+        .seq = seq,
+        .len = (uint32_t)set->blob_len,
+        .crc = esp_rom_crc32_le(0, set->blob, set->blob_len),
+    };
+
+    esp_err_t err = esp_partition_erase_range(s_part, base, erase);
+    if (err == ESP_OK) err = esp_partition_write(s_part, base + AUTOMATION_SLOT_HDR_SIZE, set->blob, set->blob_len);
+    if (err == ESP_OK) err = esp_partition_write(s_part, base, &hdr, sizeof(hdr));
+    return err;
+}
+
+// A slot can only be rewritten once no reader still holds the version mapped from it.
+static bool automation_slot_wait_free(int slot)
+{
+    for (int waited = 0; waited < AUTOMATION_SLOT_WAIT_MS; waited += 10) {
+        portENTER_CRITICAL(&s_gen_lock);
+        bool busy = s_slot_users[slot] != NULL;
+        portEXIT_CRITICAL(&s_gen_lock);
+        if (!busy) {
+            return true;
         }
+        vTaskDelay(pdMS_TO_TICKS(10));
     }
-    return (size_t)-1;
+    return false;
 }
 
-static esp_err_t compile_automation_cbor(const uint8_t *buf, size_t len, gw_automation_entry_t *out_entry)
+// Persist `next` (heap packed set) and publish it. Takes ownership of `next` in all cases.
+static esp_err_t automation_commit_locked(gw_auto_compiled_t *next)
 {
-    if (!buf || len == 0 || !out_entry) {
-        return ESP_ERR_INVALID_ARG;
+    const size_t max_bytes = s_part ? s_slot_size - AUTOMATION_SLOT_HDR_SIZE : AUTOMATION_NVS_MAX_BYTES;
+    if (next->blob_len > max_bytes) {
+        ESP_LOGW(TAG, "Automation set too large (%u > %u bytes)", (unsigned)next->blob_len, (unsigned)max_bytes);
+        gw_auto_compiled_free(next);
+        return ESP_ERR_NO_MEM;
     }
 
-    gw_auto_compiled_t compiled = {0};
-    char err_buf[256] = {0};
+    esp_err_t err = ESP_OK;
+    automation_gen_t *gen = NULL;
+    if (s_part) {
+        const int cur = s_gen ? s_gen->slot : -1;
+        const int slot = cur == 0 ? 1 : 0;
+        gw_auto_compiled_t mapped = {0};
+        if (!automation_slot_wait_free(slot)) {
+            err = ESP_ERR_TIMEOUT;
+        }
+        if (err == ESP_OK) err = automation_slot_write(slot, next, s_seq + 1);
+        if (err == ESP_OK) err = gw_auto_compiled_map_partition(AUTOMATION_PARTITION_LABEL,
+                                                                (size_t)slot * s_slot_size + AUTOMATION_SLOT_HDR_SIZE,
+                                                                next->blob_len,
+                                                                &mapped);
+        gw_auto_compiled_free(next);
+        if (err == ESP_OK) {
+            gen = gen_new(&mapped, slot);
+            if (!gen) {
+                gw_auto_compiled_free(&mapped);
+                err = ESP_ERR_NO_MEM;
+            }
+        }
+        if (err == ESP_OK) {
+            s_seq++;
+        }
+    } else {
+        err = automation_nvs_save(next);
+        if (err == ESP_OK) {
+            gen = gen_new(next, -1);
+            if (!gen) err = ESP_ERR_NO_MEM;
+        }
+        gw_auto_compiled_free(next);
+    }
 
-    esp_err_t err = gw_auto_compile_cbor(buf, len, &compiled, err_buf, sizeof(err_buf));
     if (err != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to compile automation: %s", err_buf);
+        ESP_LOGE(TAG, "Failed to persist automations: %s", esp_err_to_name(err));
         return err;
     }
+    gen_publish(gen);
+    return ESP_OK;
+}
 
-    // Convert to storage format
-    memset(out_entry, 0, sizeof(*out_entry));
+// Load the newest valid flash slot, if any.
+static automation_gen_t *automation_load_flash(void)
+{
+    gw_auto_compiled_t best = {0};
+    int best_slot = -1;
+    for (int slot = 0; slot < 2; slot++) {
+        gw_auto_compiled_t set = {0};
+        uint32_t seq = 0;
+        esp_err_t err = automation_slot_map(slot, &set, &seq);
+        if (err != ESP_OK) {
+            if (err != ESP_ERR_NOT_FOUND) {
+                ESP_LOGW(TAG, "Automation slot %d invalid: %s", slot, esp_err_to_name(err));
+            }
+            continue;
+        }
+        if (best_slot < 0 || (int32_t)(seq - s_seq) > 0) {
+            gw_auto_compiled_free(&best);
+            best = set;
+            best_slot = slot;
+            s_seq = seq;
+        } else {
+            gw_auto_compiled_free(&set);
+        }
+    }
+    if (best_slot < 0) {
+        return NULL;
+    }
+    automation_gen_t *gen = gen_new(&best, best.blob_mapped ? best_slot : -1);
+    if (!gen) {
+        gw_auto_compiled_free(&best);
+    }
+    return gen;
+}
 
-    if (compiled.hdr.automation_count > 0) {
-        const gw_auto_bin_automation_v2_t *src_auto = &compiled.autos[0];
-        const char *id = compiled.strings + src_auto->id_off;
-        const char *name = compiled.strings + src_auto->name_off;
+esp_err_t gw_automation_store_init(void)
+{
+    if (s_initialized) {
+        return ESP_OK;
+    }
 
-        // Copy metadata
-        strlcpy(out_entry->id, id ? id : "", sizeof(out_entry->id));
-        strlcpy(out_entry->name, name ? name : "", sizeof(out_entry->name));
-        out_entry->enabled = src_auto->enabled ? true : false;
+    s_lock = xSemaphoreCreateMutex();
+    if (!s_lock) {
+        return ESP_ERR_NO_MEM;
+    }
 
-        // Copy arrays (limited by storage format)
-        out_entry->triggers_count = src_auto->triggers_count < GW_AUTO_MAX_TRIGGERS ?
-                                  src_auto->triggers_count : GW_AUTO_MAX_TRIGGERS;
-        for (uint8_t i = 0; i < out_entry->triggers_count; i++) {
-            out_entry->triggers[i] = compiled.triggers[src_auto->triggers_index + i];
+    s_part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, AUTOMATION_PARTITION_LABEL);
+    if (s_part) {
+        s_slot_size = (s_part->size / 2) / s_part->erase_size * s_part->erase_size;
+        automation_gen_t *loaded = automation_load_flash();
+        if (loaded) {
+            gen_publish(loaded);
         }
-
-        out_entry->conditions_count = src_auto->conditions_count < GW_AUTO_MAX_CONDITIONS ?
-                                   src_auto->conditions_count : GW_AUTO_MAX_CONDITIONS;
-        for (uint8_t i = 0; i < out_entry->conditions_count; i++) {
-            out_entry->conditions[i] = compiled.conditions[src_auto->conditions_index + i];
+        if (loaded && loaded->slot < 0) {
+            // Upgraded from an older format: write it back so the next boot maps it in place.
+            gw_auto_compiled_t copy = {0};
+            esp_err_t err = gw_auto_compiled_pack(&loaded->set, &copy);
+            if (err == ESP_OK) err = automation_commit_locked(&copy);
+            if (err != ESP_OK) {
+                ESP_LOGW(TAG, "Automation format upgrade not persisted: %s", esp_err_to_name(err));
+            }
         }
+    } else {
+        ESP_LOGW(TAG, "No '%s' partition, keeping automations in NVS", AUTOMATION_PARTITION_LABEL);
+    }
 
-        out_entry->actions_count = src_auto->actions_count < GW_AUTO_MAX_ACTIONS ?
-                                 src_auto->actions_count : GW_AUTO_MAX_ACTIONS;
-        for (uint8_t i = 0; i < out_entry->actions_count; i++) {
-            out_entry->actions[i] = compiled.actions[src_auto->actions_index + i];
+    if (!s_gen) {
+        // Nothing mapped yet: pick up an NVS copy (packed or legacy fixed-slot) or start empty.
+        gw_auto_compiled_t set = {0};
+        const char *migrated_key = AUTOMATION_NVS_KEY;
+        bool legacy = false;
+        esp_err_t err = automation_nvs_load(&set);
+        if (err == ESP_ERR_NVS_NOT_FOUND) {
+            migrated_key = LEGACY_NVS_KEY;
+            legacy = true;
+            err = automation_migrate_legacy(&set);
+        }
+        if (err != ESP_OK && err != ESP_ERR_NVS_NOT_FOUND) {
+            ESP_LOGW(TAG, "Persisted automations unreadable (%s), starting empty", esp_err_to_name(err));
+        }
+        const bool found = err == ESP_OK;
+        if (!set.blob) {
+            gw_auto_compiled_free(&set);
+            err = gw_auto_compiled_merge(NULL, NULL, NULL, &set);
+        } else {
+            err = ESP_OK;
+        }
+        if (err == ESP_OK && found && (s_part || legacy)) {
+            // Move it to its new home, then drop the old NVS copy.
+            err = automation_commit_locked(&set);
+            if (err == ESP_OK) {
+                automation_nvs_erase(migrated_key);
+            }
+        } else if (err == ESP_OK) {
+            automation_gen_t *gen = gen_new(&set, -1);
+            if (gen) {
+                gen_publish(gen);
+            } else {
+                gw_auto_compiled_free(&set);
+                err = ESP_ERR_NO_MEM;
+            }
+        }
+        if (err != ESP_OK) {
+            return err;
         }
-
-        // Copy string table (truncated if needed)
-        size_t string_size = compiled.hdr.strings_size < GW_AUTO_MAX_STRING_TABLE_BYTES ?
-                           compiled.hdr.strings_size : GW_AUTO_MAX_STRING_TABLE_BYTES;
-        out_entry->string_table_size = string_size;
-        memcpy(out_entry->string_table, compiled.strings, string_size);
     }
 
-    gw_auto_compiled_free(&compiled);
+    s_initialized = true;
+    ESP_LOGI(TAG, "Automation storage initialized with %u automations (%u bytes, %s)",
+             (unsigned)s_gen->set.hdr.automation_count,
+             (unsigned)s_gen->set.blob_len,
+             s_gen->slot >= 0 ? "mapped" : "heap");
     return ESP_OK;
 }
 
-size_t gw_automation_store_list(gw_automation_entry_t *out, size_t max_out)
+const gw_auto_compiled_t *gw_automation_store_acquire(void)
 {
-    if (!s_initialized || !out || max_out == 0) {
-        return 0;
+    if (!s_initialized) {
+        return NULL;
     }
+    portENTER_CRITICAL(&s_gen_lock);
+    automation_gen_t *gen = s_gen;
+    if (gen) {
+        gen->refs++;
+    }
+    portEXIT_CRITICAL(&s_gen_lock);
+    return gen ? &gen->set : NULL;
+}
 
-    portENTER_CRITICAL(&s_automation_storage.lock);
-    size_t count = s_automation_storage.count < max_out ? s_automation_storage.count : max_out;
-    memcpy(out, s_automation_storage.data, count * sizeof(gw_automation_entry_t));
-    portEXIT_CRITICAL(&s_automation_storage.lock);
-    
-    return count;
+uint32_t gw_automation_store_version(const gw_auto_compiled_t *set)
+{
+    return set ? ((const automation_gen_t *)set)->version : 0;
+}
+
+void gw_automation_store_release(const gw_auto_compiled_t *set)
+{
+    if (set) {
+        gen_release((automation_gen_t *)set);
+    }
 }
 
 size_t gw_automation_store_list_meta(gw_automation_meta_t *out, size_t max_out)
@@ -167,79 +557,53 @@ size_t gw_automation_store_list_meta(gw_automation_meta_t *out, size_t max_out)
         return 0;
     }
 
-    portENTER_CRITICAL(&s_automation_storage.lock);
-    gw_automation_entry_t *automations = (gw_automation_entry_t *)s_automation_storage.data;
-    size_t count = s_automation_storage.count < max_out ? s_automation_storage.count : max_out;
-    
+    const gw_auto_compiled_t *set = gw_automation_store_acquire();
+    if (!set) {
+        return 0;
+    }
+    size_t count = set->hdr.automation_count < max_out ? set->hdr.automation_count : max_out;
     for (size_t i = 0; i < count; i++) {
-        strlcpy(out[i].id, automations[i].id, sizeof(out[i].id));
-        strlcpy(out[i].name, automations[i].name, sizeof(out[i].name));
-        out[i].enabled = automations[i].enabled;
+        const gw_auto_bin_automation_v2_t *a = &set->autos[i];
+        strlcpy(out[i].id, gw_auto_compiled_str(set, a->id_off), sizeof(out[i].id));
+        strlcpy(out[i].name, gw_auto_compiled_str(set, a->name_off), sizeof(out[i].name));
+        out[i].enabled = a->enabled != 0;
     }
-    
-    portEXIT_CRITICAL(&s_automation_storage.lock);
+    gw_automation_store_release(set);
     return count;
 }
 
-esp_err_t gw_automation_store_get(const char *id, gw_automation_entry_t *out)
-{
-    if (!s_initialized || !id || !out) {
-        return ESP_ERR_INVALID_ARG;
-    }
-
-    portENTER_CRITICAL(&s_automation_storage.lock);
-    size_t idx = find_automation_index_by_id(id);
-    if (idx == (size_t)-1) {
-        portEXIT_CRITICAL(&s_automation_storage.lock);
-        return ESP_ERR_NOT_FOUND;
-    }
-    
-    gw_automation_entry_t *automations = (gw_automation_entry_t *)s_automation_storage.data;
-    *out = automations[idx];
-    portEXIT_CRITICAL(&s_automation_storage.lock);
-    
-    return ESP_OK;
-}
-
 esp_err_t gw_automation_store_put_cbor(const uint8_t *buf, size_t len)
 {
     if (!s_initialized || !buf || len == 0) {
         return ESP_ERR_INVALID_ARG;
     }
-    gw_automation_entry_t compiled_entry;
-    esp_err_t err = compile_automation_cbor(buf, len, &compiled_entry);
+
+    gw_auto_compiled_t one = {0};
+    char err_buf[256] = {0};
+    esp_err_t err = gw_auto_compile_cbor(buf, len, &one, err_buf, sizeof(err_buf));
     if (err != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to compile automation: %s", esp_err_to_name(err));
+        ESP_LOGE(TAG, "Failed to compile automation: %s", err_buf);
         return err;
     }
 
-    if (compiled_entry.id[0] == '\0' || compiled_entry.name[0] == '\0') {
-        return ESP_ERR_INVALID_ARG;
-    }
-    if (strlen(compiled_entry.id) >= GW_AUTOMATION_ID_MAX || strlen(compiled_entry.name) >= GW_AUTOMATION_NAME_MAX) {
+    const char *id = gw_auto_compiled_str(&one, one.autos[0].id_off);
+    const char *name = gw_auto_compiled_str(&one, one.autos[0].name_off);
+    if (id[0] == '\0' || name[0] == '\0' ||
+        strlen(id) >= GW_AUTOMATION_ID_MAX || strlen(name) >= GW_AUTOMATION_NAME_MAX) {
+        gw_auto_compiled_free(&one);
         return ESP_ERR_INVALID_ARG;
     }
 
-    portENTER_CRITICAL(&s_automation_storage.lock);
-    
-    size_t idx = find_automation_index_by_id(compiled_entry.id);
-    gw_automation_entry_t *automations = (gw_automation_entry_t *)s_automation_storage.data;
-    
-    if (idx != (size_t)-1) {
-        // Update existing automation
-        automations[idx] = compiled_entry;
-    } else {
-        // Add new automation
-        if (s_automation_storage.count >= AUTOMATION_STORAGE_MAX_ITEMS) {
-            portEXIT_CRITICAL(&s_automation_storage.lock);
-            return ESP_ERR_NO_MEM;
-        }
-        automations[s_automation_storage.count++] = compiled_entry;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    gw_auto_compiled_t next = {0};
+    err = gw_auto_compiled_merge(&s_gen->set, &one, NULL, &next);
+    if (err == ESP_OK) {
+        err = automation_commit_locked(&next);
     }
-    
-    portEXIT_CRITICAL(&s_automation_storage.lock);
-    
-    return automation_storage_save_locked();
+    xSemaphoreGive(s_lock);
+
+    gw_auto_compiled_free(&one);
+    return err;
 }
 
 esp_err_t gw_automation_store_remove(const char *id)
@@ -248,24 +612,18 @@ esp_err_t gw_automation_store_remove(const char *id)
         return ESP_ERR_INVALID_ARG;
     }
 
-    portENTER_CRITICAL(&s_automation_storage.lock);
-    size_t idx = find_automation_index_by_id(id);
-    if (idx == (size_t)-1) {
-        portEXIT_CRITICAL(&s_automation_storage.lock);
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    if (gw_auto_compiled_find(&s_gen->set, id) < 0) {
+        xSemaphoreGive(s_lock);
         return ESP_ERR_NOT_FOUND;
     }
-    
-    // Shift remaining automations down
-    gw_automation_entry_t *automations = (gw_automation_entry_t *)s_automation_storage.data;
-    for (size_t i = idx + 1; i < s_automation_storage.count; i++) {
-        automations[i - 1] = automations[i];
-    }
-    s_automation_storage.count--;
-    memset(&automations[s_automation_storage.count], 0, sizeof(gw_automation_entry_t));
-    
-    portEXIT_CRITICAL(&s_automation_storage.lock);
-    
-    return automation_storage_save_locked();
+    gw_auto_compiled_t next = {0};
+    esp_err_t err = gw_auto_compiled_merge(&s_gen->set, NULL, id, &next);
+    if (err == ESP_OK) {
+        err = automation_commit_locked(&next);
+    }
+    xSemaphoreGive(s_lock);
+    return err;
 }
 
 esp_err_t gw_automation_store_set_enabled(const char *id, bool enabled)
@@ -274,17 +632,19 @@ esp_err_t gw_automation_store_set_enabled(const char *id, bool enabled)
         return ESP_ERR_INVALID_ARG;
     }
 
-    portENTER_CRITICAL(&s_automation_storage.lock);
-    size_t idx = find_automation_index_by_id(id);
-    if (idx == (size_t)-1) {
-        portEXIT_CRITICAL(&s_automation_storage.lock);
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    int idx = gw_auto_compiled_find(&s_gen->set, id);
+    if (idx < 0) {
+        xSemaphoreGive(s_lock);
         return ESP_ERR_NOT_FOUND;
     }
-    
-    gw_automation_entry_t *automations = (gw_automation_entry_t *)s_automation_storage.data;
-    automations[idx].enabled = enabled;
-    
-    portEXIT_CRITICAL(&s_automation_storage.lock);
-
-    return automation_storage_save_locked();
+    // Toggling does not change the layout: patch a packed heap copy.
+    gw_auto_compiled_t next = {0};
+    esp_err_t err = gw_auto_compiled_pack(&s_gen->set, &next);
+    if (err == ESP_OK) {
+        next.autos[idx].enabled = enabled ? 1 : 0;
+        err = automation_commit_locked(&next);
+    }
+    xSemaphoreGive(s_lock);
+    return err;
 }
@@ -1,4 +1,4 @@
-// cbor.c - small CBOR reader/writer (definite-length only).
+// cbor.c - small CBOR reader/writer.
 
 #include "gw_core/cbor.h"
 
@@ -350,12 +350,151 @@ bool gw_cbor_slice_to_text_span(const gw_cbor_slice_t *s, const uint8_t **out_pt
     return true;
 }
 
+// ---- schema-driven map decoding ----
+
+static bool decode_int_range(const gw_cbor_field_t *f, int64_t v)
+{
+    int64_t lo = 0;
+    int64_t hi = 0;
+    switch (f->type) {
+        case GW_CBOR_FIELD_U8: hi = UINT8_MAX; break;
+        case GW_CBOR_FIELD_U16: hi = UINT16_MAX; break;
+        case GW_CBOR_FIELD_U32: hi = UINT32_MAX; break;
+        case GW_CBOR_FIELD_I16: lo = INT16_MIN; hi = INT16_MAX; break;
+        case GW_CBOR_FIELD_I32: lo = INT32_MIN; hi = INT32_MAX; break;
+        default: lo = INT64_MIN; hi = INT64_MAX; break;
+    }
+    if (f->min || f->max) {
+        lo = f->min;
+        hi = f->max;
+    }
+    return v >= lo && v <= hi;
+}
+
+static bool decode_field(const gw_cbor_field_t *f, const gw_cbor_slice_t *v, uint8_t *dst)
+{
+    switch (f->type) {
+        case GW_CBOR_FIELD_ITEM:
+            memcpy(dst, v, sizeof(*v));
+            return true;
+        case GW_CBOR_FIELD_TEXT: {
+            const uint8_t *p = NULL;
+            size_t n = 0;
+            if (!gw_cbor_slice_to_text_span(v, &p, &n) || n + 1 > f->size) return false;
+            memcpy(dst, p, n);
+            dst[n] = '\0';
+            return true;
+        }
+        case GW_CBOR_FIELD_BOOL: {
+            bool b = false;
+            if (!gw_cbor_slice_to_bool(v, &b)) return false;
+            memcpy(dst, &b, sizeof(b));
+            return true;
+        }
+        case GW_CBOR_FIELD_F64: {
+            double d = 0.0;
+            if (!gw_cbor_slice_to_f64(v, &d)) return false;
+            memcpy(dst, &d, sizeof(d));
+            return true;
+        }
+        default:
+            break;
+    }
+
+    int64_t iv = 0;
+    uint64_t uv = 0;
+    if (gw_cbor_slice_to_u64(v, &uv)) {
+        if (uv > INT64_MAX) return false;
+        iv = (int64_t)uv;
+    } else if (!gw_cbor_slice_to_i64(v, &iv)) {
+        return false;
+    }
+    if (!decode_int_range(f, iv)) return false;
+    switch (f->type) {
+        case GW_CBOR_FIELD_U8: *dst = (uint8_t)iv; break;
+        case GW_CBOR_FIELD_U16: { uint16_t x = (uint16_t)iv; memcpy(dst, &x, sizeof(x)); break; }
+        case GW_CBOR_FIELD_U32: { uint32_t x = (uint32_t)iv; memcpy(dst, &x, sizeof(x)); break; }
+        case GW_CBOR_FIELD_I16: { int16_t x = (int16_t)iv; memcpy(dst, &x, sizeof(x)); break; }
+        case GW_CBOR_FIELD_I32: { int32_t x = (int32_t)iv; memcpy(dst, &x, sizeof(x)); break; }
+        case GW_CBOR_FIELD_I64: memcpy(dst, &iv, sizeof(iv)); break;
+        default: return false;
+    }
+    return true;
+}
+
+bool gw_cbor_decode_map(const uint8_t *buf,
+                        size_t len,
+                        const gw_cbor_field_t *fields,
+                        size_t n_fields,
+                        void *out,
+                        uint32_t *out_present,
+                        int *out_bad)
+{
+    if (out_bad) *out_bad = -1;
+    if (out_present) *out_present = 0;
+    if (!buf || len == 0 || (!fields && n_fields) || n_fields > GW_CBOR_MAX_FIELDS || !out) return false;
+
+    gw_cbor_reader_t r = {0};
+    gw_cbor_reader_init(&r, buf, len);
+    uint8_t ib = 0;
+    if (!gw_cbor_read_u8(&r, &ib) || (ib >> 5) != 5) return false;
+    const uint8_t ai = (uint8_t)(ib & 0x1f);
+    const bool indefinite = (ai == 31);
+    uint64_t pairs = 0;
+    if (!indefinite && !gw_cbor_read_uint_arg(&r, ai, &pairs)) return false;
+
+    uint32_t present = 0;
+    for (uint64_t i = 0; indefinite || i < pairs; i++) {
+        if (indefinite) {
+            uint8_t pb = 0;
+            if (!rd_peek_u8(&r, &pb)) return false;
+            if (pb == 0xff) break;
+        }
+        uint8_t kb = 0;
+        if (!gw_cbor_read_u8(&r, &kb) || (kb >> 5) != 3) return false;
+        const uint8_t *kptr = NULL;
+        size_t klen = 0;
+        if (!gw_cbor_read_text_span(&r, (uint8_t)(kb & 0x1f), &kptr, &klen)) return false;
+
+        const uint8_t *vstart = r.p;
+        if (!gw_cbor_skip_item(&r)) return false;
+
+        for (size_t f = 0; f < n_fields; f++) {
+            if (strlen(fields[f].key) != klen || memcmp(fields[f].key, kptr, klen) != 0) continue;
+            if (present & (1u << f)) break;
+            const gw_cbor_slice_t v = {.ptr = vstart, .len = (size_t)(r.p - vstart)};
+            if (!decode_field(&fields[f], &v, (uint8_t *)out + fields[f].offset)) {
+                if (out_bad) *out_bad = (int)f;
+                return false;
+            }
+            present |= 1u << f;
+            break;
+        }
+    }
+    if (out_present) *out_present = present;
+    return true;
+}
+
 // ---- writer ----
 
+#define GW_CBOR_MIN_WINDOW 16 // the largest head (1 + 8 bytes) must always fit
+
 static esp_err_t wr_reserve(gw_cbor_writer_t *w, size_t add)
 {
     if (!w) return ESP_ERR_INVALID_ARG;
+    if (w->sink) {
+        if (!w->buf) {
+            if (w->fixed) return ESP_ERR_INVALID_SIZE;
+            w->buf = (uint8_t *)malloc(w->cap);
+            if (!w->buf) return ESP_ERR_NO_MEM;
+        }
+        if (w->len + add <= w->cap) return ESP_OK;
+        esp_err_t err = gw_cbor_writer_flush(w);
+        if (err != ESP_OK) return err;
+        return add <= w->cap ? ESP_OK : ESP_ERR_INVALID_SIZE;
+    }
     if (w->len + add <= w->cap) return ESP_OK;
+    if (w->fixed) return ESP_ERR_INVALID_SIZE;
     size_t new_cap = w->cap ? w->cap : 256;
     while (new_cap < w->len + add) new_cap *= 2;
     uint8_t *nb = (uint8_t *)realloc(w->buf, new_cap);
@@ -367,6 +506,10 @@ static esp_err_t wr_reserve(gw_cbor_writer_t *w, size_t add)
 
 static esp_err_t wr_u8(gw_cbor_writer_t *w, uint8_t v)
 {
+    if (w && w->measure) {
+        w->len++;
+        return ESP_OK;
+    }
     esp_err_t err = wr_reserve(w, 1);
     if (err != ESP_OK) return err;
     w->buf[w->len++] = v;
@@ -375,6 +518,19 @@ static esp_err_t wr_u8(gw_cbor_writer_t *w, uint8_t v)
 
 static esp_err_t wr_mem(gw_cbor_writer_t *w, const void *src, size_t n)
 {
+    if (w && w->measure) {
+        w->len += n;
+        return ESP_OK;
+    }
+    if (w && w->sink && n > w->cap) {
+        // Larger than the window: flush what is buffered and pass it straight through.
+        esp_err_t err = gw_cbor_writer_flush(w);
+        if (err != ESP_OK) return err;
+        err = w->sink(w->sink_ctx, (const uint8_t *)src, n);
+        if (err != ESP_OK) return err;
+        w->flushed += n;
+        return ESP_OK;
+    }
     esp_err_t err = wr_reserve(w, n);
     if (err != ESP_OK) return err;
     memcpy(w->buf + w->len, src, n);
@@ -418,15 +574,65 @@ void gw_cbor_writer_init(gw_cbor_writer_t *w)
     *w = (gw_cbor_writer_t){0};
 }
 
+void gw_cbor_writer_init_stream(gw_cbor_writer_t *w, size_t window_size, gw_cbor_sink_fn sink, void *ctx)
+{
+    if (!w) return;
+    *w = (gw_cbor_writer_t){0};
+    w->cap = window_size < GW_CBOR_MIN_WINDOW ? GW_CBOR_MIN_WINDOW : window_size;
+    w->sink = sink;
+    w->sink_ctx = ctx;
+}
+
+void gw_cbor_writer_init_stream_buf(gw_cbor_writer_t *w, uint8_t *buf, size_t cap, gw_cbor_sink_fn sink, void *ctx)
+{
+    if (!w) return;
+    *w = (gw_cbor_writer_t){0};
+    w->buf = buf;
+    w->cap = buf ? cap : 0;
+    w->sink = sink;
+    w->sink_ctx = ctx;
+    w->fixed = true;
+}
+
+void gw_cbor_writer_init_fixed(gw_cbor_writer_t *w, uint8_t *buf, size_t cap)
+{
+    if (!w) return;
+    *w = (gw_cbor_writer_t){0};
+    w->buf = buf;
+    w->cap = buf ? cap : 0;
+    w->fixed = true;
+}
+
+void gw_cbor_writer_init_measure(gw_cbor_writer_t *w)
+{
+    if (!w) return;
+    *w = (gw_cbor_writer_t){0};
+    w->measure = true;
+}
+
+esp_err_t gw_cbor_writer_flush(gw_cbor_writer_t *w)
+{
+    if (!w) return ESP_ERR_INVALID_ARG;
+    if (!w->sink || w->len == 0) return ESP_OK;
+    esp_err_t err = w->sink(w->sink_ctx, w->buf, w->len);
+    if (err != ESP_OK) return err;
+    w->flushed += w->len;
+    w->len = 0;
+    return ESP_OK;
+}
+
 void gw_cbor_writer_free(gw_cbor_writer_t *w)
 {
     if (!w) return;
-    free(w->buf);
+    if (!w->fixed) free(w->buf);
     *w = (gw_cbor_writer_t){0};
 }
 
 esp_err_t gw_cbor_writer_map(gw_cbor_writer_t *w, uint64_t pairs) { return wr_uint(w, 5, pairs); }
 esp_err_t gw_cbor_writer_array(gw_cbor_writer_t *w, uint64_t items) { return wr_uint(w, 4, items); }
+esp_err_t gw_cbor_writer_map_indef(gw_cbor_writer_t *w) { return wr_u8(w, (uint8_t)((5 << 5) | 31)); }
+esp_err_t gw_cbor_writer_array_indef(gw_cbor_writer_t *w) { return wr_u8(w, (uint8_t)((4 << 5) | 31)); }
+esp_err_t gw_cbor_writer_break(gw_cbor_writer_t *w) { return wr_u8(w, 0xff); }
 
 esp_err_t gw_cbor_writer_text(gw_cbor_writer_t *w, const char *s)
 {
@@ -0,0 +1,144 @@
+#include "gw_core/device_availability.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+
+#include "gw_core/device_storage.h"
+#include "gw_core/event_bus.h"
+#include "gw_core/timers.h"
+
+static const char *TAG = "gw_avail";
+
+typedef struct {
+    gw_timer_t timer;
+    char uid[GW_DEVICE_UID_STRLEN];
+    uint16_t short_addr;
+    bool used;
+    bool offline;
+} avail_entry_t;
+
+// Slots are claimed by the event listener and released on leave. A timer left armed
+// on a released slot finds it unused and does nothing.
+static avail_entry_t s_entries[GW_DEVICE_MAX_DEVICES];
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+static bool s_inited;
+
+// Called with s_lock held.
+static avail_entry_t *entry_find(const char *uid, bool claim)
+{
+    avail_entry_t *free_slot = NULL;
+    for (size_t i = 0; i < GW_DEVICE_MAX_DEVICES; i++) {
+        avail_entry_t *en = &s_entries[i];
+        if (en->used && strcmp(en->uid, uid) == 0) {
+            return en;
+        }
+        if (!en->used && !free_slot) {
+            free_slot = en;
+        }
+    }
+    if (!claim || !free_slot) {
+        return NULL;
+    }
+    free_slot->used = true;
+    free_slot->offline = false;
+    strlcpy(free_slot->uid, uid, sizeof(free_slot->uid));
+    return free_slot;
+}
+
+static void offline_cb(gw_timer_t *timer, void *arg)
+{
+    (void)timer;
+    avail_entry_t *en = (avail_entry_t *)arg;
+    char uid[GW_DEVICE_UID_STRLEN] = {0};
+    uint16_t short_addr = 0;
+    bool report = false;
+
+    portENTER_CRITICAL(&s_lock);
+    if (en->used && !en->offline) {
+        en->offline = true;
+        strlcpy(uid, en->uid, sizeof(uid));
+        short_addr = en->short_addr;
+        report = true;
+    }
+    portEXIT_CRITICAL(&s_lock);
+
+    if (report) {
+        char msg[48];
+        snprintf(msg, sizeof(msg), "silent_ms=%u", (unsigned)GW_DEVICE_OFFLINE_TIMEOUT_MS);
+        gw_event_bus_publish("device.offline", "availability", uid, short_addr, msg);
+    }
+}
+
+static bool is_leave(const char *type)
+{
+    return strcmp(type, "device.leave") == 0 || strcmp(type, "zigbee.device_leave") == 0;
+}
+
+static void availability_listener(const gw_event_t *e, void *user_ctx)
+{
+    (void)user_ctx;
+    // Live traffic only: snapshot replays and our own events prove nothing.
+    if (!e || !e->device_uid[0] || strcmp(e->source, "zigbee-uart") != 0) {
+        return;
+    }
+
+    if (is_leave(e->type)) {
+        portENTER_CRITICAL(&s_lock);
+        avail_entry_t *en = entry_find(e->device_uid, false);
+        if (en) {
+            en->used = false;
+        }
+        portEXIT_CRITICAL(&s_lock);
+        if (en) {
+            gw_timers_cancel(&en->timer);
+        }
+        return;
+    }
+
+    bool was_offline = false;
+    portENTER_CRITICAL(&s_lock);
+    avail_entry_t *en = entry_find(e->device_uid, true);
+    if (en) {
+        was_offline = en->offline;
+        en->offline = false;
+        en->short_addr = e->short_addr;
+    }
+    portEXIT_CRITICAL(&s_lock);
+    if (!en) {
+        return;
+    }
+
+    (void)gw_timers_arm(&en->timer, GW_DEVICE_OFFLINE_TIMEOUT_MS, offline_cb, en);
+    if (was_offline) {
+        gw_event_bus_publish("device.online", "availability", e->device_uid, e->short_addr, "");
+    }
+}
+
+esp_err_t gw_device_availability_init(void)
+{
+    if (s_inited) {
+        return ESP_OK;
+    }
+    esp_err_t err = gw_event_bus_add_listener(availability_listener, NULL);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "listener registration failed: %s", esp_err_to_name(err));
+        return err;
+    }
+    s_inited = true;
+    return ESP_OK;
+}
+
+bool gw_device_availability_online(const gw_device_uid_t *uid)
+{
+    if (!uid || !uid->uid[0]) {
+        return true;
+    }
+    portENTER_CRITICAL(&s_lock);
+    const avail_entry_t *en = entry_find(uid->uid, false);
+    const bool online = !en || !en->offline;
+    portEXIT_CRITICAL(&s_lock);
+    return online;
+}
@@ -11,6 +11,7 @@
 static SemaphoreHandle_t s_lock;
 static uint8_t *s_buf;
 static size_t s_len;
+static uint32_t s_version;
 static bool s_inited;
 
 esp_err_t gw_device_fb_store_init(void)
@@ -42,6 +43,7 @@ esp_err_t gw_device_fb_store_set(const uint8_t *buf, size_t len)
     uint8_t *old = s_buf;
     s_buf = copy;
     s_len = len;
+    s_version++;
     xSemaphoreGive(s_lock);
     free(old);
     return ESP_OK;
@@ -67,6 +69,17 @@ const uint8_t *gw_device_fb_store_get(size_t *out_len)
     return ptr;
 }
 
+uint32_t gw_device_fb_store_version(void)
+{
+    if (!s_inited || !s_lock) {
+        return 0;
+    }
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    const uint32_t v = s_version;
+    xSemaphoreGive(s_lock);
+    return v;
+}
+
 esp_err_t gw_device_fb_store_copy(uint8_t **out_buf, size_t *out_len)
 {
     if (!out_buf || !out_len || !s_inited || !s_lock) {
@@ -1,5 +1,6 @@
 #include "gw_core/device_registry.h"
 #include "gw_core/device_storage_bridge.h"
+#include "gw_core/state_store.h"
 
 #include <stdlib.h>
 #include <string.h>
@@ -53,6 +54,7 @@ esp_err_t gw_device_registry_set_name(const gw_device_uid_t *uid, const char *na
 
 esp_err_t gw_device_registry_remove(const gw_device_uid_t *uid)
 {
+    (void)gw_state_store_remove_uid(uid); // its state goes with it
     return gw_device_storage_remove(uid);
 }
 
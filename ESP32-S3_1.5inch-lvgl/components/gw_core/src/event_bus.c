@@ -21,7 +21,7 @@ static uint32_t s_next_id = 1;
 static portMUX_TYPE s_id_lock = portMUX_INITIALIZER_UNLOCKED;
 
 // Optional listeners called on publish.
-#define GW_EVENT_LISTENER_CAP 4
+#define GW_EVENT_LISTENER_CAP 6
 typedef struct {
     gw_event_bus_listener_t cb;
     void *user_ctx;
@@ -42,6 +42,9 @@ static bool event_should_go_to_out_queue(const char *type)
     if (strcmp(type, "device.join") == 0 || strcmp(type, "device.leave") == 0) {
         return true;
     }
+    if (strcmp(type, "device.offline") == 0 || strcmp(type, "device.online") == 0) {
+        return true;
+    }
     if (strcmp(type, "device.changed") == 0 || strcmp(type, "automation.changed") == 0) {
         return true;
     }
@@ -121,6 +121,19 @@ size_t gw_group_store_list_items(gw_group_item_t *out, size_t max_out)
     return count;
 }
 
+uint32_t gw_group_store_version(void)
+{
+    if (!ready()) return 0;
+    // Every change saves at least one of the two, so the sum moves on each one.
+    portENTER_CRITICAL(&s_groups_storage.lock);
+    uint32_t v = s_groups_storage.content_version;
+    portEXIT_CRITICAL(&s_groups_storage.lock);
+    portENTER_CRITICAL(&s_items_storage.lock);
+    v += s_items_storage.content_version;
+    portEXIT_CRITICAL(&s_items_storage.lock);
+    return v;
+}
+
 esp_err_t gw_group_store_create(const char *id_opt, const char *name, gw_group_entry_t *out_created)
 {
     if (!ready() || !name) return ESP_ERR_INVALID_ARG;
@@ -148,6 +148,17 @@ esp_err_t gw_project_settings_get(gw_project_settings_t *out)
     return ESP_OK;
 }
 
+uint32_t gw_project_settings_version(void)
+{
+    if (!s_inited) {
+        return 0;
+    }
+    portENTER_CRITICAL(&s_settings_storage.lock);
+    const uint32_t v = s_settings_storage.content_version;
+    portEXIT_CRITICAL(&s_settings_storage.lock);
+    return v;
+}
+
 esp_err_t gw_project_settings_set(const gw_project_settings_t *in)
 {
     if (!s_inited || !in) {
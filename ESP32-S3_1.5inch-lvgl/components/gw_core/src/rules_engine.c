@@ -1,575 +1,1042 @@
 ﻿#include "gw_core/rules_engine.h"
 
-#include <math.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 #include "esp_err.h"
 #include "esp_heap_caps.h"
 #include "esp_log.h"
-#include "esp_attr.h"
+#include "esp_timer.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/queue.h"
 #include "freertos/task.h"
 #include "freertos/idf_additions.h"
 
 #include "gw_core/action_exec.h"
+#include "gw_core/automation_bindings.h"
+#include "gw_core/automation_placement.h"
+#include "gw_core/automation_compiled.h"
 #include "gw_core/automation_store.h"
 #include "gw_core/event_bus.h"
+#include "gw_core/net_time.h"
+#include "gw_core/rules_index.h"
 #include "gw_core/state_store.h"
+#include "gw_core/timers.h"
 #include "gw_core/types.h"
 
 static const char *TAG = "gw_rules";
 
-#define GW_AUTOMATION_CAP 32
 #define GW_RULES_EVENT_Q_CAP 96
 #define GW_RULES_TASK_PRIO 7
 
-#define GW_RULE_INDEX_CAP 256
+#define GW_RULES_BIND_RETRY_MS 60000
+#define GW_RULES_CLOCK_RETRY_MS 60000             // time triggers while the clock is not synced
+#define GW_RULES_TIME_MAX_WAIT_MS (6u * 3600000u) // re-check the wall clock at least this often
 
+// One heap block per cache version: this header, then the shared index block
+// (see gw_core/rules_index.h). `set` is the store's zero-copy view; the cache
+// holds a reference on it.
 typedef struct {
-    uint8_t evt_type;
-    uint8_t endpoint;
-    uint16_t cluster_id;
-    uint16_t attr_id;
-    uint32_t uid_hash;
-    uint32_t cmd_hash;
-    uint8_t has_uid;
-    uint8_t has_endpoint;
-    uint8_t has_cluster;
-    uint8_t has_attr;
-    uint8_t has_cmd;
-} trigger_key_t;
+    const gw_auto_compiled_t *set;
+    uint32_t set_version;
+    uint32_t refs; // s_cache_lock; the published pointer owns one
+    size_t block_size;
+    gw_rules_index_t ix;
+} rules_cache_t;
 
+// Per-automation run bookkeeping for mode/max_runs/throttle, plus the execution
+// stats. Owned by the rules task and keyed by id, so it survives cache rebuilds.
 typedef struct {
-    bool used;
-    trigger_key_t key;
-    uint32_t auto_mask;
-} trigger_index_slot_t;
-
-typedef struct {
-    gw_automation_entry_t autos[GW_AUTOMATION_CAP];
-    size_t count;
-    trigger_index_slot_t index[GW_RULE_INDEX_CAP];
-} rules_cache_t;
+    char id[GW_AUTOMATION_ID_MAX];
+    uint16_t running;     // runs in progress (a run stays in progress across its delays)
+    uint16_t queued;      // queued-mode runs waiting for the current one
+    uint64_t last_run_ms; // start of the current throttle window
+    uint32_t stats_epoch; // counters are stale (zero) unless this matches s_stats_epoch
+    gw_rules_counters_t counters;
+} rule_run_t;
+
+// Only the rules task writes the records. s_runs_lock covers the array itself
+// (growing, removing) against gw_rules_stats_snapshot(); counters are bumped without it.
+static portMUX_TYPE s_runs_lock = portMUX_INITIALIZER_UNLOCKED;
+static rule_run_t *s_runs;
+static size_t s_runs_count;
+static size_t s_runs_cap;
+// A reset just moves the epoch, so it never races with the rules task's increments.
+static volatile uint32_t s_stats_epoch;
+// When the run being executed was triggered: event timestamp or timer firing.
+static uint64_t s_run_origin_ms;
+
+// Something an automation waits for on the shared timer service (gw_core/timers.h).
+// The timer callback only marks the record and wakes the rules task, which owns the
+// list and does the actual work.
+typedef enum {
+    RULE_WAIT_DEBOUNCE = 1, // run once triggers have been quiet for debounce_ms
+    RULE_WAIT_FOR,          // run if conditions still hold for the trigger's for_s
+    RULE_WAIT_DELAY,        // resume a run at `next_action` after a delay action
+    RULE_WAIT_TIME,         // next occurrence of the automation's time triggers
+    RULE_WAIT_QUEUED,       // origin of a queued-mode run until it starts; never armed
+} rule_wait_kind_t;
+
+typedef struct rule_wait {
+    struct rule_wait *next;
+    gw_timer_t timer;
+    uint8_t kind; // rule_wait_kind_t
+    volatile bool fired;
+    char id[GW_AUTOMATION_ID_MAX];
+    char device_uid[GW_DEVICE_UID_STRLEN];
+    uint16_t short_addr;
+    uint32_t next_action; // DELAY
+    time_t due_wall;      // TIME: 0 while the clock is not synced
+} rule_wait_t;
+
+static rule_wait_t *s_waits;
+static volatile bool s_waits_fired;
+static gw_event_t s_timer_wake; // posted to the rules queue by timer callbacks
+static bool s_time_dirty;       // time triggers need re-arming (cache or clock change)
+
+// Binding offload and C6 placement are resynced on the rules task after every
+// cache change and retried while some bind/unbind request or push is still failing.
+static bool s_bindings_dirty;
+static uint64_t s_bindings_retry_ms;
 
 static portMUX_TYPE s_cache_lock = portMUX_INITIALIZER_UNLOCKED;
-EXT_RAM_BSS_ATTR static rules_cache_t s_cache_a;
-EXT_RAM_BSS_ATTR static rules_cache_t s_cache_b;
-static rules_cache_t *s_cache = &s_cache_a;
-static bool s_cache_use_a = true;
+static rules_cache_t *s_cache;
+// Set when an automation change could not be queued; the rules task then rebuilds.
+static volatile bool s_resync_pending;
 
 static bool s_inited;
 static QueueHandle_t s_q;
 static bool s_q_caps_alloc;
 static TaskHandle_t s_task;
 
-static const char *strtab_at(const gw_automation_entry_t *entry, uint32_t off)
+static const char *strtab_at(const rules_cache_t *cache, uint32_t off)
+{
+    return gw_auto_compiled_str(cache->set, off);
+}
+
+static void publish_rules_fired(const char *device_uid, uint16_t short_addr, const char *automation_id)
+{
+    char msg[128];
+    snprintf(msg, sizeof(msg), "automation_id=%s", automation_id ? automation_id : "");
+    gw_event_bus_publish("rules.fired", "rules", device_uid ? device_uid : "", short_addr, msg);
+}
+
+// `idx` is the first action of the planned step; `frames_saved` counts the Zigbee frames
+// the planner folded away (see gw_action_plan_step()).
+static void publish_rules_action(const char *automation_id, size_t idx, const char *err, uint32_t frames_saved)
+{
+    char msg[192];
+    if (err) {
+        snprintf(msg, sizeof(msg), "automation_id=%s idx=%u ok=0 err=%s", automation_id, (unsigned)idx, err);
+    } else {
+        snprintf(msg, sizeof(msg), "automation_id=%s idx=%u ok=1 frames_saved=%u", automation_id, (unsigned)idx,
+                 (unsigned)frames_saved);
+    }
+    gw_event_bus_publish("rules.action", "rules", "", 0, msg);
+}
+
+static rules_cache_t *rules_cache_get(void)
 {
-    if (!entry) return "";
-    if (off == 0) return "";
-    if (off >= entry->string_table_size) return "";
-    return entry->string_table + off;
+    portENTER_CRITICAL(&s_cache_lock);
+    rules_cache_t *cache = s_cache;
+    if (cache) {
+        cache->refs++;
+    }
+    portEXIT_CRITICAL(&s_cache_lock);
+    return cache;
 }
 
-static uint32_t fnv1a32(const char *s)
+static void rules_cache_put(rules_cache_t *cache)
 {
-    uint32_t h = 2166136261u;
-    if (!s) {
-        return h;
+    if (!cache) {
+        return;
     }
-    while (*s) {
-        h ^= (uint8_t)(*s++);
-        h *= 16777619u;
+    portENTER_CRITICAL(&s_cache_lock);
+    bool last = --cache->refs == 0;
+    portEXIT_CRITICAL(&s_cache_lock);
+    if (last) {
+        gw_automation_store_release(cache->set);
+        heap_caps_free(cache);
     }
-    return h;
 }
 
-static bool trigger_key_equals(const trigger_key_t *a, const trigger_key_t *b)
+// Publish `next` and drop the published reference on the old version. The old
+// version (and the store generation it pins) is reclaimed once the last reader
+// that picked it up before the swap has put it back: that is the grace period.
+static void rules_cache_publish(rules_cache_t *next)
 {
-    return a->evt_type == b->evt_type &&
-           a->endpoint == b->endpoint &&
-           a->cluster_id == b->cluster_id &&
-           a->attr_id == b->attr_id &&
-           a->uid_hash == b->uid_hash &&
-           a->cmd_hash == b->cmd_hash &&
-           a->has_uid == b->has_uid &&
-           a->has_endpoint == b->has_endpoint &&
-           a->has_cluster == b->has_cluster &&
-           a->has_attr == b->has_attr &&
-           a->has_cmd == b->has_cmd;
+    portENTER_CRITICAL(&s_cache_lock);
+    rules_cache_t *old = s_cache;
+    s_cache = next;
+    portEXIT_CRITICAL(&s_cache_lock);
+    rules_cache_put(old);
+    s_bindings_dirty = true;
+    s_time_dirty = true;
 }
 
-static uint32_t trigger_key_hash(const trigger_key_t *k)
+static rules_cache_t *rules_cache_alloc(size_t index_cap, size_t mask_words)
 {
-    uint32_t h = 2166136261u;
-    const uint8_t *p = (const uint8_t *)k;
-    for (size_t i = 0; i < sizeof(*k); i++) {
-        h ^= p[i];
-        h *= 16777619u;
+    const size_t total = sizeof(rules_cache_t) + gw_rules_index_block_size(index_cap, mask_words);
+
+    uint8_t *mem = heap_caps_calloc(1, total, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (!mem) {
+        mem = heap_caps_calloc(1, total, MALLOC_CAP_8BIT);
     }
-    return h;
+    if (!mem) {
+        return NULL;
+    }
+
+    rules_cache_t *cache = (rules_cache_t *)mem;
+    cache->refs = 1;
+    cache->block_size = total;
+    gw_rules_index_attach(&cache->ix, mem + sizeof(rules_cache_t), index_cap, mask_words);
+    return cache;
 }
 
-static void trigger_index_clear(rules_cache_t *cache)
+// Copy-on-write: same geometry, flat copy of the index block, pointers rebased.
+static rules_cache_t *rules_cache_clone(const rules_cache_t *src)
 {
-    memset(cache->index, 0, sizeof(cache->index));
+    rules_cache_t *cache = rules_cache_alloc(src->ix.index_cap, src->ix.mask_words);
+    if (!cache) {
+        return NULL;
+    }
+    const size_t hdr = sizeof(rules_cache_t);
+    memcpy((uint8_t *)cache + hdr, (const uint8_t *)src + hdr, src->block_size - hdr);
+    cache->ix.index_used = src->ix.index_used;
+    return cache;
 }
 
-static void trigger_index_insert(rules_cache_t *cache, const trigger_key_t *key, uint8_t auto_idx)
+static rules_cache_t *rules_cache_build(const gw_auto_compiled_t *set)
 {
-    if (!cache || !key || auto_idx >= 32) {
-        return;
+    size_t index_cap = 0;
+    size_t mask_words = 0;
+    gw_rules_index_geometry(set, &index_cap, &mask_words);
+
+    rules_cache_t *cache = rules_cache_alloc(index_cap, mask_words);
+    if (!cache) {
+        return NULL;
     }
+    cache->set = set;
+    cache->set_version = gw_automation_store_version(set);
+    gw_rules_index_fill(&cache->ix, set);
+    return cache;
+}
 
-    uint32_t h = trigger_key_hash(key);
-    uint32_t pos = h & (GW_RULE_INDEX_CAP - 1);
-    for (size_t i = 0; i < GW_RULE_INDEX_CAP; i++) {
-        trigger_index_slot_t *slot = &cache->index[pos];
-        if (!slot->used) {
-            slot->used = true;
-            slot->key = *key;
-            slot->auto_mask = (1u << auto_idx);
-            return;
-        }
-        if (trigger_key_equals(&slot->key, key)) {
-            slot->auto_mask |= (1u << auto_idx);
-            return;
-        }
-        pos = (pos + 1u) & (GW_RULE_INDEX_CAP - 1);
+// Full rebuild from the current store version. Used at init and whenever a
+// delta cannot be applied (missed version, capacity growth).
+static void reload_automation_cache(void)
+{
+    const gw_auto_compiled_t *set = gw_automation_store_acquire();
+    rules_cache_t *next = set ? rules_cache_build(set) : NULL;
+    if (!next) {
+        gw_automation_store_release(set);
+        ESP_LOGE(TAG, "rules cache reload failed, keeping previous rules");
+        return;
     }
 
-    // Should never happen with current caps, but keep deterministic behavior.
-    ESP_LOGW(TAG, "trigger index full, auto_idx=%u dropped", (unsigned)auto_idx);
+    rules_cache_publish(next);
+    ESP_LOGI(TAG, "rules cache: %u automations, %u index slots",
+             (unsigned)set->hdr.automation_count, (unsigned)next->ix.index_cap);
 }
 
-static uint32_t trigger_index_lookup(const rules_cache_t *cache, const trigger_key_t *key)
+// Apply the change of one automation (`id`) as a delta against the published
+// cache. Cost is one flat copy of the index block plus hashing the old and new
+// triggers of that rule; nothing else is re-read from the store.
+static bool apply_automation_delta(const char *id)
 {
-    if (!cache || !key) {
-        return 0;
+    rules_cache_t *cur = rules_cache_get();
+    const gw_auto_compiled_t *set = gw_automation_store_acquire();
+    bool ok = false;
+    rules_cache_t *next = NULL;
+
+    if (!cur || !set || !id || !id[0]) {
+        goto out;
+    }
+    const uint32_t version = gw_automation_store_version(set);
+    if (version == cur->set_version) {
+        ok = true; // already folded in by an earlier rebuild
+        goto out;
+    }
+    if (version != cur->set_version + 1u) {
+        goto out;
     }
 
-    uint32_t h = trigger_key_hash(key);
-    uint32_t pos = h & (GW_RULE_INDEX_CAP - 1);
-    for (size_t i = 0; i < GW_RULE_INDEX_CAP; i++) {
-        const trigger_index_slot_t *slot = &cache->index[pos];
-        if (!slot->used) {
-            return 0;
+    const int old_idx = gw_auto_compiled_find(cur->set, id);
+    const int new_idx = gw_auto_compiled_find(set, id);
+    const int old_slot = old_idx >= 0 ? gw_rules_index_slot_of(&cur->ix, (uint32_t)old_idx) : -1;
+    if (old_idx >= 0 && old_slot < 0) {
+        goto out;
+    }
+    int new_slot = old_slot;
+    if (new_idx >= 0 && new_slot < 0) {
+        new_slot = gw_rules_index_slot_of(&cur->ix, GW_RULE_NO_AUTO);
+        if (new_slot < 0) {
+            goto out; // out of rule slots
         }
-        if (trigger_key_equals(&slot->key, key)) {
-            return slot->auto_mask;
+    }
+    if (new_idx >= 0 && (cur->ix.index_used + set->autos[new_idx].triggers_count) * 2u > cur->ix.index_cap) {
+        goto out; // index would get too dense
+    }
+
+    next = rules_cache_clone(cur);
+    if (!next) {
+        goto out;
+    }
+    if (old_idx >= 0) {
+        gw_rules_index_automation(&next->ix, cur->set, (uint32_t)old_idx, (uint32_t)old_slot, false);
+    }
+    if (new_idx < 0 && old_idx >= 0) {
+        // Removal shifts later automations down by one in the packed set.
+        next->ix.slot_auto[old_slot] = GW_RULE_NO_AUTO;
+        for (size_t i = 0; i < next->ix.slot_cap; i++) {
+            if (next->ix.slot_auto[i] != GW_RULE_NO_AUTO && next->ix.slot_auto[i] > (uint32_t)old_idx) {
+                next->ix.slot_auto[i]--;
+            }
         }
-        pos = (pos + 1u) & (GW_RULE_INDEX_CAP - 1);
     }
-    return 0;
+    if (new_idx >= 0) {
+        next->ix.slot_auto[new_slot] = (uint32_t)new_idx;
+        gw_rules_index_automation(&next->ix, set, (uint32_t)new_idx, (uint32_t)new_slot, true);
+    }
+    next->set = set;
+    next->set_version = version;
+    set = NULL; // now owned by `next`
+    rules_cache_publish(next);
+    ok = true;
+
+out:
+    gw_automation_store_release(set);
+    rules_cache_put(cur);
+    return ok;
 }
 
-static void publish_rules_fired(const gw_event_t *e, const char *automation_id)
+// "id=<id> ..." (saved/enabled) or a bare id (removed).
+static void automation_id_from_msg(const char *msg, char *out, size_t out_size)
 {
-    char msg[128];
-    snprintf(msg, sizeof(msg), "automation_id=%s", automation_id ? automation_id : "");
-    gw_event_bus_publish("rules.fired", "rules", e ? e->device_uid : "", e ? e->short_addr : 0, msg);
+    out[0] = '\0';
+    if (!msg) {
+        return;
+    }
+    if (strncmp(msg, "id=", 3) == 0) {
+        msg += 3;
+    }
+    size_t n = strcspn(msg, " ");
+    if (n >= out_size) {
+        return;
+    }
+    memcpy(out, msg, n);
+    out[n] = '\0';
 }
 
-static void publish_rules_action(const char *automation_id, size_t idx, bool ok, const char *err)
+static void rule_run_drop(const char *id, bool forget);
+
+static void handle_automation_change(const gw_event_t *e)
 {
-    char msg[192];
-    if (err) {
-        snprintf(msg, sizeof(msg), "automation_id=%s idx=%u ok=0 err=%s", automation_id, (unsigned)idx, err);
-    } else {
-        snprintf(msg, sizeof(msg), "automation_id=%s idx=%u ok=1", automation_id, (unsigned)idx);
+    char id[GW_AUTOMATION_ID_MAX];
+    automation_id_from_msg(e->msg, id, sizeof(id));
+    // An edited rule starts clean: pending delays, debounce and "for" waits are dropped.
+    rule_run_drop(id, strcmp(e->type, "automation_removed") == 0);
+    if (!apply_automation_delta(id)) {
+        reload_automation_cache();
     }
-    gw_event_bus_publish("rules.action", "rules", "", 0, msg);
 }
 
-typedef struct {
-    uint8_t endpoint;
-    bool has_endpoint;
-    char cmd_buf[32];
-    const char *cmd;
-    bool has_cmd;
-    uint16_t cluster_id;
-    bool has_cluster;
-    uint16_t attr_id;
-    bool has_attr;
-} event_payload_view_t;
+static uint64_t now_ms(void)
+{
+    return (uint64_t)(esp_timer_get_time() / 1000ULL);
+}
 
-static void build_payload_view_from_event(const gw_event_t *e, event_payload_view_t *out)
+static rule_run_t *rule_run_find(const char *id)
 {
-    memset(out, 0, sizeof(*out));
-    if (!e) return;
+    for (size_t i = 0; i < s_runs_count; i++) {
+        if (strcmp(s_runs[i].id, id) == 0) {
+            return &s_runs[i];
+        }
+    }
+    return NULL;
+}
 
-    if (e->payload_flags & GW_EVENT_PAYLOAD_HAS_ENDPOINT) {
-        out->endpoint = e->payload_endpoint;
-        out->has_endpoint = true;
+static rule_run_t *rule_run_get(const char *id)
+{
+    rule_run_t *run = rule_run_find(id);
+    if (run || !id[0]) {
+        return run;
     }
-    if (e->payload_flags & GW_EVENT_PAYLOAD_HAS_CMD) {
-        strlcpy(out->cmd_buf, e->payload_cmd, sizeof(out->cmd_buf));
-        out->cmd = out->cmd_buf;
-        out->has_cmd = out->cmd_buf[0] != '\0';
+    if (s_runs_count == s_runs_cap) {
+        // No realloc: the old array must stay readable until the swap under the lock.
+        const size_t cap = s_runs_cap ? s_runs_cap * 2 : 8;
+        rule_run_t *grown = (rule_run_t *)malloc(cap * sizeof(*grown));
+        if (!grown) {
+            return NULL;
+        }
+        if (s_runs_count) {
+            memcpy(grown, s_runs, s_runs_count * sizeof(*grown));
+        }
+        portENTER_CRITICAL(&s_runs_lock);
+        rule_run_t *old = s_runs;
+        s_runs = grown;
+        s_runs_cap = cap;
+        portEXIT_CRITICAL(&s_runs_lock);
+        free(old);
+    }
+    rule_run_t fresh = {0};
+    strlcpy(fresh.id, id, sizeof(fresh.id));
+    fresh.stats_epoch = s_stats_epoch;
+    portENTER_CRITICAL(&s_runs_lock);
+    run = &s_runs[s_runs_count];
+    *run = fresh;
+    s_runs_count++;
+    portEXIT_CRITICAL(&s_runs_lock);
+    return run;
+}
+
+static gw_rules_counters_t *rule_counters(rule_run_t *run)
+{
+    if (!run) {
+        return NULL;
     }
-    if (e->payload_flags & GW_EVENT_PAYLOAD_HAS_CLUSTER) {
-        out->cluster_id = e->payload_cluster;
-        out->has_cluster = true;
+    const uint32_t epoch = s_stats_epoch;
+    if (run->stats_epoch != epoch) {
+        memset(&run->counters, 0, sizeof(run->counters));
+        run->stats_epoch = epoch;
+    }
+    return &run->counters;
+}
+
+static void stats_latency(rule_run_t *run)
+{
+    gw_rules_counters_t *c = rule_counters(run);
+    if (!c) {
+        return;
     }
-    if (e->payload_flags & GW_EVENT_PAYLOAD_HAS_ATTR) {
-        out->attr_id = e->payload_attr;
-        out->has_attr = true;
+    const uint64_t now = now_ms();
+    const uint64_t ms = now > s_run_origin_ms ? now - s_run_origin_ms : 0;
+    unsigned bucket = 0;
+    if (ms) {
+        bucket = ms >= (1ull << (GW_RULES_LATENCY_BUCKETS - 2)) ? GW_RULES_LATENCY_BUCKETS - 1
+                                                                : 32u - (unsigned)__builtin_clz((uint32_t)ms);
     }
+    c->latency_hist[bucket]++;
 }
 
-static gw_auto_evt_type_t evt_type_from_event(const gw_event_t *e)
+size_t gw_rules_stats_snapshot(gw_rules_stats_t *out, size_t max_out)
 {
-    if (strcmp(e->type, "zigbee.command") == 0) return GW_AUTO_EVT_ZIGBEE_COMMAND;
-    if (strcmp(e->type, "zigbee.attr_report") == 0) return GW_AUTO_EVT_ZIGBEE_ATTR_REPORT;
-    if (strcmp(e->type, "device.join") == 0) return GW_AUTO_EVT_DEVICE_JOIN;
-    if (strcmp(e->type, "device.leave") == 0) return GW_AUTO_EVT_DEVICE_LEAVE;
-    return 0;
+    // One entry per critical section, so the rules task never waits for more than one
+    // copy. A removal in between moves the last entry into the gap: the snapshot may
+    // then miss that entry or show it twice until the next read.
+    size_t total;
+    for (size_t i = 0;; i++) {
+        portENTER_CRITICAL(&s_runs_lock);
+        total = s_runs_count;
+        const bool copy = out && i < total && i < max_out;
+        if (copy) {
+            memcpy(out[i].id, s_runs[i].id, sizeof(out[i].id));
+            if (s_runs[i].stats_epoch == s_stats_epoch) {
+                out[i].counters = s_runs[i].counters;
+            } else {
+                memset(&out[i].counters, 0, sizeof(out[i].counters));
+            }
+        }
+        portEXIT_CRITICAL(&s_runs_lock);
+        if (!copy) {
+            break;
+        }
+    }
+    return total;
 }
 
-static bool trigger_matches(const gw_automation_entry_t *entry,
-                            const gw_auto_bin_trigger_v2_t *t,
-                            gw_auto_evt_type_t evt_type,
-                            const gw_event_t *e,
-                            const event_payload_view_t *pv)
+void gw_rules_stats_reset(void)
 {
-    if (t->event_type != evt_type) return false;
-    if (t->device_uid_off && strcmp(strtab_at(entry, t->device_uid_off), e->device_uid) != 0) return false;
-    if (t->endpoint && (!pv->has_endpoint || pv->endpoint != t->endpoint)) return false;
+    s_stats_epoch++;
+}
 
-    if (evt_type == GW_AUTO_EVT_ZIGBEE_COMMAND) {
-        if (t->cmd_off && (!pv->has_cmd || strcmp(strtab_at(entry, t->cmd_off), pv->cmd) != 0)) return false;
-        if (t->cluster_id && (!pv->has_cluster || pv->cluster_id != t->cluster_id)) return false;
-    } else if (evt_type == GW_AUTO_EVT_ZIGBEE_ATTR_REPORT) {
-        if (t->cluster_id && (!pv->has_cluster || pv->cluster_id != t->cluster_id)) return false;
-        if (t->attr_id && (!pv->has_attr || pv->attr_id != t->attr_id)) return false;
+static void wait_timer_cb(gw_timer_t *timer, void *arg)
+{
+    (void)timer;
+    rule_wait_t *w = (rule_wait_t *)arg;
+    w->fired = true;
+    if (!s_waits_fired) {
+        s_waits_fired = true;
+        // A full queue means the task is awake anyway and checks the flag after each event.
+        (void)xQueueSend(s_q, &s_timer_wake, 0);
     }
-    return true;
 }
 
-static bool state_to_number_bool(const gw_state_item_t *s, double *out_n, bool *out_b)
+static rule_wait_t *wait_find(rule_wait_kind_t kind, const char *id)
 {
-    if (!s) return false;
-    switch (s->value_type) {
-        case GW_STATE_VALUE_BOOL:
-            *out_n = s->value_bool ? 1.0 : 0.0;
-            *out_b = s->value_bool;
-            return true;
-        case GW_STATE_VALUE_F32:
-            *out_n = s->value_f32;
-            *out_b = fabs(s->value_f32) > 1e-6;
-            return true;
-        case GW_STATE_VALUE_U32:
-            *out_n = s->value_u32;
-            *out_b = s->value_u32 != 0;
-            return true;
-        case GW_STATE_VALUE_U64:
-            *out_n = s->value_u64;
-            *out_b = s->value_u64 != 0;
-            return true;
-        default:
-            return false;
+    for (rule_wait_t *w = s_waits; w; w = w->next) {
+        if (w->kind == kind && strcmp(w->id, id) == 0) {
+            return w;
+        }
     }
+    return NULL;
 }
 
-static bool conditions_pass(const gw_automation_entry_t *entry)
+// wait_new() prepends, so the last match is the oldest.
+static rule_wait_t *wait_find_oldest(rule_wait_kind_t kind, const char *id)
 {
-    if (entry->conditions_count == 0) return true;
+    rule_wait_t *found = NULL;
+    for (rule_wait_t *w = s_waits; w; w = w->next) {
+        if (w->kind == kind && strcmp(w->id, id) == 0) {
+            found = w;
+        }
+    }
+    return found;
+}
 
-    for (uint8_t i = 0; i < entry->conditions_count; i++) {
-        const gw_auto_bin_condition_v2_t *co = &entry->conditions[i];
-        const char *uid_s = strtab_at(entry, co->device_uid_off);
-        const char *key = strtab_at(entry, co->key_off);
-        if (!uid_s[0] || !key[0]) return false;
+static rule_wait_t *wait_new(rule_wait_kind_t kind, const char *id, const char *device_uid, uint16_t short_addr)
+{
+    rule_wait_t *w = (rule_wait_t *)calloc(1, sizeof(*w));
+    if (!w) {
+        return NULL;
+    }
+    w->kind = (uint8_t)kind;
+    strlcpy(w->id, id, sizeof(w->id));
+    strlcpy(w->device_uid, device_uid ? device_uid : "", sizeof(w->device_uid));
+    w->short_addr = short_addr;
+    w->next = s_waits;
+    s_waits = w;
+    return w;
+}
 
-        gw_device_uid_t uid = {0};
-        strlcpy(uid.uid, uid_s, sizeof(uid.uid));
-        gw_state_item_t st = {0};
-        if (gw_state_store_get_any(&uid, key, &st) != ESP_OK) return false;
+static void wait_unlink(rule_wait_t *w)
+{
+    for (rule_wait_t **pp = &s_waits; *pp; pp = &(*pp)->next) {
+        if (*pp == w) {
+            *pp = w->next;
+            w->next = NULL;
+            return;
+        }
+    }
+}
 
-        double actual_n = 0;
-        bool actual_b = false;
-        if (!state_to_number_bool(&st, &actual_n, &actual_b)) return false;
+// Once cancel returns the callback cannot touch `w` any more (see gw_timers_cancel()).
+static void wait_free(rule_wait_t *w)
+{
+    gw_timers_cancel(&w->timer);
+    wait_unlink(w);
+    free(w);
+}
 
-        const gw_auto_op_t op = (gw_auto_op_t)co->op;
-        if (co->val_type == GW_AUTO_VAL_BOOL) {
-            bool exp = co->v.b != 0;
-            if ((op == GW_AUTO_OP_EQ && actual_b != exp) || (op == GW_AUTO_OP_NE && actual_b == exp)) return false;
-        } else {
-            double exp = co->v.f64;
-            double act = actual_n;
-            if ((op == GW_AUTO_OP_EQ && fabs(act - exp) > 1e-6) ||
-                (op == GW_AUTO_OP_NE && fabs(act - exp) < 1e-6) ||
-                (op == GW_AUTO_OP_GT && act <= exp) ||
-                (op == GW_AUTO_OP_LT && act >= exp) ||
-                (op == GW_AUTO_OP_GE && act < exp) ||
-                (op == GW_AUTO_OP_LE && act > exp)) {
-                return false;
-            }
+static esp_err_t wait_arm(rule_wait_t *w, uint32_t delay_ms)
+{
+    gw_timers_cancel(&w->timer);
+    w->fired = false;
+    esp_err_t err = gw_timers_arm(&w->timer, delay_ms, wait_timer_cb, w);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "%s: timer arm failed: %s", w->id, esp_err_to_name(err));
+    }
+    return err;
+}
+
+// Drop the waits of automation `id`: all of them when `kind` is 0.
+static size_t waits_drop(rule_wait_kind_t kind, const char *id)
+{
+    size_t dropped = 0;
+    rule_wait_t *w = s_waits;
+    while (w) {
+        rule_wait_t *next = w->next;
+        if ((!kind || w->kind == kind) && strcmp(w->id, id) == 0) {
+            wait_free(w);
+            dropped++;
         }
+        w = next;
     }
-    return true;
+    return dropped;
 }
 
-static void index_trigger(rules_cache_t *cache,
-                          const gw_automation_entry_t *entry,
-                          const gw_auto_bin_trigger_v2_t *t,
-                          uint8_t auto_idx)
+static void rule_run_drop(const char *id, bool forget)
 {
-    trigger_key_t k = {0};
-    k.evt_type = t->event_type;
+    if (!id[0]) {
+        return;
+    }
+    waits_drop(0, id);
+    rule_run_t *run = rule_run_find(id);
+    if (!run) {
+        return;
+    }
+    if (forget) {
+        portENTER_CRITICAL(&s_runs_lock);
+        *run = s_runs[--s_runs_count];
+        portEXIT_CRITICAL(&s_runs_lock);
+    } else {
+        run->running = 0;
+        run->queued = 0;
+    }
+}
 
-    if (t->device_uid_off) {
-        const char *uid = strtab_at(entry, t->device_uid_off);
-        if (uid[0]) {
-            k.has_uid = 1;
-            k.uid_hash = fnv1a32(uid);
+// Run actions from `pos` up to the end or the next delay action. A delay parks the
+// rest of the run on a DELAY wait and returns true: the run is still in progress.
+// `run` only feeds the stats and may be NULL.
+static bool execute_actions(const rules_cache_t *cache, const gw_auto_bin_automation_v2_t *a, rule_run_t *run,
+                            const char *device_uid, uint16_t short_addr, uint32_t pos)
+{
+    const char *automation_id = strtab_at(cache, a->id_off);
+    gw_rules_counters_t *c = rule_counters(run);
+    if (pos == 0) {
+        publish_rules_fired(device_uid, short_addr, automation_id);
+        if (c) {
+            c->fires++;
         }
     }
-    if (t->endpoint) {
-        k.has_endpoint = 1;
-        k.endpoint = t->endpoint;
-    }
 
-    if (t->event_type == GW_AUTO_EVT_ZIGBEE_COMMAND) {
-        if (t->cmd_off) {
-            const char *cmd = strtab_at(entry, t->cmd_off);
-            if (cmd[0]) {
-                k.has_cmd = 1;
-                k.cmd_hash = fnv1a32(cmd);
+    const gw_auto_bin_action_v2_t *actions = &cache->set->actions[a->actions_index];
+    gw_action_step_t step;
+    for (uint32_t ai = pos; ai < a->actions_count; ai += step.count) {
+        if (actions[ai].kind == GW_AUTO_ACT_DELAY) {
+            rule_wait_t *w = wait_new(RULE_WAIT_DELAY, automation_id, device_uid, short_addr);
+            if (!w || wait_arm(w, actions[ai].arg0_u32) != ESP_OK) {
+                if (w) {
+                    wait_free(w);
+                }
+                publish_rules_action(automation_id, ai, "delay failed", 0);
+                if (c) {
+                    c->action_failures++;
+                }
+                stats_latency(run);
+                return false;
+            }
+            w->next_action = ai + 1;
+            publish_rules_action(automation_id, ai, NULL, 0);
+            stats_latency(run);
+            return true;
+        }
+
+        char errbuf[96] = {0};
+        uint32_t saved = 0;
+        gw_action_plan_step(cache->set, actions, a->actions_count, ai, &step);
+        esp_err_t rc = gw_action_exec_step(cache->set, actions, &step, &saved, errbuf, sizeof(errbuf));
+        if (rc != ESP_OK) {
+            publish_rules_action(automation_id, ai, errbuf[0] ? errbuf : "exec failed", 0);
+            if (c) {
+                c->action_failures++;
             }
+            break;
         }
-        if (t->cluster_id) {
-            k.has_cluster = 1;
-            k.cluster_id = t->cluster_id;
+        publish_rules_action(automation_id, ai, NULL, saved);
+    }
+    stats_latency(run);
+    return false;
+}
+
+// Carry a started run on from `pos`; when it completes, start the queued ones, each
+// with the device that triggered it.
+static void run_continue(const rules_cache_t *cache, const gw_auto_bin_automation_v2_t *a, rule_run_t *run,
+                         const char *device_uid, uint16_t short_addr, uint32_t pos)
+{
+    char queued_uid[GW_DEVICE_UID_STRLEN];
+    while (!execute_actions(cache, a, run, device_uid, short_addr, pos)) {
+        if (!run) {
+            return;
+        }
+        if (run->running) {
+            run->running--;
+        }
+        if (!run->queued) {
+            return;
         }
-    } else if (t->event_type == GW_AUTO_EVT_ZIGBEE_ATTR_REPORT) {
-        if (t->cluster_id) {
-            k.has_cluster = 1;
-            k.cluster_id = t->cluster_id;
+        run->queued--;
+        run->running++;
+        pos = 0;
+        rule_wait_t *q = wait_find_oldest(RULE_WAIT_QUEUED, run->id);
+        if (q) {
+            strlcpy(queued_uid, q->device_uid, sizeof(queued_uid));
+            device_uid = queued_uid;
+            short_addr = q->short_addr;
+            wait_free(q);
+        }
+    }
+}
+
+// Apply throttle and mode to a run whose triggers and conditions already passed.
+// A run is in progress from here until its last action, delays included.
+static void start_run(const rules_cache_t *cache, const gw_auto_bin_automation_v2_t *a, rule_run_t *run,
+                      const char *device_uid, uint16_t short_addr)
+{
+    if (!run) {
+        run_continue(cache, a, NULL, device_uid, short_addr, 0);
+        return;
+    }
+
+    const uint64_t now = now_ms();
+    if (a->throttle_ms && run->last_run_ms && now - run->last_run_ms < a->throttle_ms) {
+        return;
+    }
+    const uint16_t max_runs = a->max_runs ? a->max_runs : 1;
+    if (run->running >= max_runs) {
+        if (a->mode == GW_AUTO_MODE_QUEUED && run->queued < max_runs &&
+            wait_new(RULE_WAIT_QUEUED, run->id, device_uid, short_addr)) {
+            run->queued++;
         }
-        if (t->attr_id) {
-            k.has_attr = 1;
-            k.attr_id = t->attr_id;
+        if (a->mode != GW_AUTO_MODE_RESTART) {
+            return; // single/parallel at the limit drop the trigger
         }
+        // Runs only stay in progress while parked on a delay: dropping those stops them.
+        waits_drop(RULE_WAIT_DELAY, run->id);
+        waits_drop(RULE_WAIT_QUEUED, run->id);
+        run->running = 0;
+        run->queued = 0;
     }
 
-    trigger_index_insert(cache, &k, auto_idx);
+    run->last_run_ms = now;
+    run->running++;
+    run_continue(cache, a, run, device_uid, short_addr, 0);
 }
 
-static void rebuild_trigger_index(rules_cache_t *cache)
+// Every matching trigger pushes the deadline out; the run happens once they stop.
+static void debounce_arm(const gw_auto_bin_automation_v2_t *a, const char *id, const gw_event_t *e)
 {
-    trigger_index_clear(cache);
+    rule_wait_t *w = wait_find(RULE_WAIT_DEBOUNCE, id);
+    if (!w) {
+        w = wait_new(RULE_WAIT_DEBOUNCE, id, e->device_uid, e->short_addr);
+    }
+    if (!w) {
+        return;
+    }
+    strlcpy(w->device_uid, e->device_uid, sizeof(w->device_uid));
+    w->short_addr = e->short_addr;
+    if (wait_arm(w, a->debounce_ms) != ESP_OK) {
+        wait_free(w);
+    }
+}
 
-    for (uint8_t i = 0; i < cache->count && i < 32; i++) {
-        const gw_automation_entry_t *entry = &cache->autos[i];
-        if (!entry->enabled) {
+// The first match starts the wait; later matches while conditions hold leave it running.
+static void for_arm(const gw_auto_bin_trigger_v2_t *t, const char *id, const gw_event_t *e)
+{
+    if (wait_find(RULE_WAIT_FOR, id)) {
+        return;
+    }
+    rule_wait_t *w = wait_new(RULE_WAIT_FOR, id, e->device_uid, e->short_addr);
+    if (w && wait_arm(w, (uint32_t)t->for_s * 1000u) != ESP_OK) {
+        wait_free(w);
+    }
+}
+
+static time_t wall_now(void)
+{
+    return (time_t)(gw_net_time_now_ms() / 1000ULL);
+}
+
+// Earliest occurrence of any time trigger of `a` strictly after `from`, 0 if it has none.
+static time_t time_triggers_next(const gw_auto_compiled_t *set, const gw_auto_bin_automation_v2_t *a, time_t from)
+{
+    time_t best = 0;
+    struct tm base;
+    localtime_r(&from, &base);
+    for (uint32_t ti = 0; ti < a->triggers_count; ti++) {
+        const gw_auto_bin_trigger_v2_t *t = &set->triggers[a->triggers_index + ti];
+        if (t->event_type != GW_AUTO_EVT_TIME) {
             continue;
         }
-        for (uint8_t ti = 0; ti < entry->triggers_count; ti++) {
-            index_trigger(cache, entry, &entry->triggers[ti], i);
+        for (int day = 0; day < 8; day++) {
+            struct tm c = base;
+            c.tm_mday += day;
+            c.tm_hour = t->attr_id / 60u;
+            c.tm_min = t->attr_id % 60u;
+            c.tm_sec = 0;
+            c.tm_isdst = -1;
+            const time_t at = mktime(&c); // also fills tm_wday
+            if (at <= from || (t->endpoint && (t->endpoint & (1u << c.tm_wday)) == 0)) {
+                continue;
+            }
+            if (!best || at < best) {
+                best = at;
+            }
+            break;
         }
     }
+    return best;
 }
 
-static void reload_automation_cache(void)
+// Long waits are cut into GW_RULES_TIME_MAX_WAIT_MS pieces so clock corrections
+// (NTP, timezone) are picked up; the wait only fires the rule once due_wall is reached.
+static void time_wait_arm(rule_wait_t *w, const gw_auto_compiled_t *set, const gw_auto_bin_automation_v2_t *a, time_t after)
 {
-    rules_cache_t *dst = s_cache_use_a ? &s_cache_b : &s_cache_a;
-    memset(dst, 0, sizeof(*dst));
-    dst->count = gw_automation_store_list(dst->autos, GW_AUTOMATION_CAP);
-    rebuild_trigger_index(dst);
+    uint32_t delay_ms = GW_RULES_CLOCK_RETRY_MS;
+    w->due_wall = 0;
+    if (gw_net_time_is_synced()) {
+        const time_t now = wall_now();
+        w->due_wall = time_triggers_next(set, a, after > now ? after : now);
+        if (w->due_wall) {
+            const uint64_t ms = (uint64_t)(w->due_wall - now) * 1000u;
+            delay_ms = ms > GW_RULES_TIME_MAX_WAIT_MS ? GW_RULES_TIME_MAX_WAIT_MS : (uint32_t)ms;
+        }
+    }
+    if (wait_arm(w, delay_ms) != ESP_OK) {
+        wait_free(w);
+    }
+}
 
-    portENTER_CRITICAL(&s_cache_lock);
-    s_cache = dst;
-    s_cache_use_a = !s_cache_use_a;
-    portEXIT_CRITICAL(&s_cache_lock);
+static bool has_time_trigger(const gw_auto_compiled_t *set, const gw_auto_bin_automation_v2_t *a)
+{
+    for (uint32_t ti = 0; ti < a->triggers_count; ti++) {
+        if (set->triggers[a->triggers_index + ti].event_type == GW_AUTO_EVT_TIME) {
+            return true;
+        }
+    }
+    return false;
 }
 
-static uint32_t lookup_candidate_mask(const rules_cache_t *cache,
-                                      const gw_event_t *e,
-                                      const event_payload_view_t *pv,
-                                      gw_auto_evt_type_t evt_type)
+// Re-arm every time trigger after a cache or clock change.
+static void time_triggers_sync(void)
 {
-    if (!cache || !e) {
-        return 0;
+    if (!s_time_dirty) {
+        return;
+    }
+    s_time_dirty = false;
+    rule_wait_t *w = s_waits;
+    while (w) {
+        rule_wait_t *next = w->next;
+        if (w->kind == RULE_WAIT_TIME) {
+            wait_free(w);
+        }
+        w = next;
     }
 
-    const bool ev_has_uid = e->device_uid[0] != '\0';
-    const uint32_t ev_uid_hash = ev_has_uid ? fnv1a32(e->device_uid) : 0;
-
-    uint32_t mask = 0;
-    trigger_key_t k = {0};
-    k.evt_type = evt_type;
-
-    if (evt_type == GW_AUTO_EVT_ZIGBEE_COMMAND) {
-        const bool has_uid = ev_has_uid;
-        const bool has_ep = pv->has_endpoint;
-        const bool has_cmd = pv->has_cmd && pv->cmd && pv->cmd[0];
-        const bool has_cluster = pv->has_cluster;
-        const uint32_t ev_cmd_hash = has_cmd ? fnv1a32(pv->cmd) : 0;
-
-        for (uint8_t u = 0; u <= (has_uid ? 1 : 0); u++) {
-            for (uint8_t ep = 0; ep <= (has_ep ? 1 : 0); ep++) {
-                for (uint8_t c = 0; c <= (has_cmd ? 1 : 0); c++) {
-                    for (uint8_t cl = 0; cl <= (has_cluster ? 1 : 0); cl++) {
-                        memset(&k, 0, sizeof(k));
-                        k.evt_type = evt_type;
-                        if (u) {
-                            k.has_uid = 1;
-                            k.uid_hash = ev_uid_hash;
-                        }
-                        if (ep) {
-                            k.has_endpoint = 1;
-                            k.endpoint = pv->endpoint;
-                        }
-                        if (c) {
-                            k.has_cmd = 1;
-                            k.cmd_hash = ev_cmd_hash;
-                        }
-                        if (cl) {
-                            k.has_cluster = 1;
-                            k.cluster_id = pv->cluster_id;
-                        }
-                        mask |= trigger_index_lookup(cache, &k);
-                    }
-                }
-            }
+    rules_cache_t *cache = rules_cache_get();
+    for (uint32_t i = 0; cache && i < cache->set->hdr.automation_count; i++) {
+        const gw_auto_bin_automation_v2_t *a = &cache->set->autos[i];
+        if (!a->enabled || !has_time_trigger(cache->set, a)) {
+            continue;
         }
-    } else if (evt_type == GW_AUTO_EVT_ZIGBEE_ATTR_REPORT) {
-        const bool has_uid = ev_has_uid;
-        const bool has_ep = pv->has_endpoint;
-        const bool has_cluster = pv->has_cluster;
-        const bool has_attr = pv->has_attr;
-
-        for (uint8_t u = 0; u <= (has_uid ? 1 : 0); u++) {
-            for (uint8_t ep = 0; ep <= (has_ep ? 1 : 0); ep++) {
-                for (uint8_t cl = 0; cl <= (has_cluster ? 1 : 0); cl++) {
-                    for (uint8_t a = 0; a <= (has_attr ? 1 : 0); a++) {
-                        memset(&k, 0, sizeof(k));
-                        k.evt_type = evt_type;
-                        if (u) {
-                            k.has_uid = 1;
-                            k.uid_hash = ev_uid_hash;
-                        }
-                        if (ep) {
-                            k.has_endpoint = 1;
-                            k.endpoint = pv->endpoint;
-                        }
-                        if (cl) {
-                            k.has_cluster = 1;
-                            k.cluster_id = pv->cluster_id;
-                        }
-                        if (a) {
-                            k.has_attr = 1;
-                            k.attr_id = pv->attr_id;
-                        }
-                        mask |= trigger_index_lookup(cache, &k);
-                    }
-                }
-            }
+        w = wait_new(RULE_WAIT_TIME, strtab_at(cache, a->id_off), "", 0);
+        if (w) {
+            time_wait_arm(w, cache->set, a, 0);
         }
-    } else {
-        const bool has_uid = ev_has_uid;
-        const bool has_ep = pv->has_endpoint;
-
-        for (uint8_t u = 0; u <= (has_uid ? 1 : 0); u++) {
-            for (uint8_t ep = 0; ep <= (has_ep ? 1 : 0); ep++) {
-                memset(&k, 0, sizeof(k));
-                k.evt_type = evt_type;
-                if (u) {
-                    k.has_uid = 1;
-                    k.uid_hash = ev_uid_hash;
+    }
+    rules_cache_put(cache);
+}
+
+// Handle one fired wait, detached from the list. Conditions are checked when the run
+// happens, against the rule as it is now.
+static void wait_fire(const rules_cache_t *cache, rule_wait_t *w)
+{
+    const int idx = cache ? gw_auto_compiled_find(cache->set, w->id) : -1;
+    const gw_auto_bin_automation_v2_t *a = idx >= 0 ? &cache->set->autos[idx] : NULL;
+    if (!a || !a->enabled) {
+        free(w);
+        return;
+    }
+
+    switch (w->kind) {
+        case RULE_WAIT_DELAY:
+            run_continue(cache, a, rule_run_find(w->id), w->device_uid, w->short_addr, w->next_action);
+            break;
+        case RULE_WAIT_TIME: {
+            const time_t due = w->due_wall;
+            // Back on the list first: the run below may drop other waits of this rule.
+            w->next = s_waits;
+            s_waits = w;
+            const bool ran = due && wall_now() + 1 >= due;
+            if (ran) {
+                rule_run_t *run = rule_run_get(w->id);
+                gw_rules_counters_t *c = rule_counters(run);
+                if (c) {
+                    c->matches++;
                 }
-                if (ep) {
-                    k.has_endpoint = 1;
-                    k.endpoint = pv->endpoint;
+                if (gw_rules_conditions_pass(cache->set, a, gw_state_store_get_any)) {
+                    start_run(cache, a, run, "", 0);
+                } else if (c) {
+                    c->cond_rejects++;
                 }
-                mask |= trigger_index_lookup(cache, &k);
             }
+            // An early piece of a long wait re-arms toward the same occurrence; only a
+            // handled one moves on (time_triggers_next() searches strictly after `after`).
+            time_wait_arm(w, cache->set, a, ran || !due ? due : due - 1);
+            return;
+        }
+        default: {
+            rule_run_t *run = rule_run_get(w->id);
+            gw_rules_counters_t *c = rule_counters(run);
+            if (gw_rules_conditions_pass(cache->set, a, gw_state_store_get_any)) {
+                start_run(cache, a, run, w->device_uid, w->short_addr);
+            } else if (c) {
+                c->cond_rejects++;
+            }
+            break;
         }
     }
-
-    return mask;
+    free(w);
 }
 
-static void process_event(const gw_event_t *e)
+// One fired wait at a time: handling a wait may free others (restart mode, edits).
+static void waits_run_fired(void)
 {
-    if (!e || !e->type[0] || strcmp(e->source, "rules") == 0) {
+    if (!s_waits_fired) {
         return;
     }
+    s_waits_fired = false;
+    rules_cache_t *cache = rules_cache_get();
+    for (;;) {
+        rule_wait_t *w = s_waits;
+        while (w && !w->fired) {
+            w = w->next;
+        }
+        if (!w) {
+            break;
+        }
+        wait_unlink(w);
+        w->fired = false;
+        s_run_origin_ms = now_ms();
+        wait_fire(cache, w);
+    }
+    rules_cache_put(cache);
+}
 
-    const gw_auto_evt_type_t evt_type = evt_type_from_event(e);
-    if (!evt_type) {
-        return;
+// How long the rules task may block: until the next binding retry. Timed waits wake
+// it through the queue.
+static TickType_t rules_next_wait(void)
+{
+    if (s_bindings_dirty || s_time_dirty) {
+        return 0;
+    }
+    if (!s_bindings_retry_ms) {
+        return portMAX_DELAY;
     }
+    const uint64_t now = now_ms();
+    return s_bindings_retry_ms <= now ? 0 : pdMS_TO_TICKS(s_bindings_retry_ms - now) + 1;
+}
 
-    const rules_cache_t *cache = NULL;
-    portENTER_CRITICAL(&s_cache_lock);
-    cache = s_cache;
-    portEXIT_CRITICAL(&s_cache_lock);
+static void bindings_sync_due(void)
+{
+    if (!s_bindings_dirty && (!s_bindings_retry_ms || now_ms() < s_bindings_retry_ms)) {
+        return;
+    }
+    s_bindings_dirty = false;
+    s_bindings_retry_ms = 0;
+    rules_cache_t *cache = rules_cache_get();
+    if (cache) {
+        // Placement goes second: rules that became bindings are not pushed to the C6.
+        bool ok = gw_auto_bindings_sync(cache->set);
+        ok = gw_auto_placement_sync(cache->set) && ok;
+        if (!ok) {
+            s_bindings_retry_ms = now_ms() + GW_RULES_BIND_RETRY_MS;
+        }
+    }
+    rules_cache_put(cache);
+}
 
-    if (!cache || cache->count == 0) {
+static void process_event_cached(const rules_cache_t *cache, const gw_event_t *e, gw_auto_evt_type_t evt_type)
+{
+    if (cache->set->hdr.automation_count == 0) {
         return;
     }
 
-    event_payload_view_t pv;
-    build_payload_view_from_event(e, &pv);
+    gw_rules_event_view_t pv;
+    gw_rules_event_view(e, &pv);
 
-    uint32_t candidate_mask = lookup_candidate_mask(cache, e, &pv, evt_type);
-    if (candidate_mask == 0) {
+    if (!gw_rules_index_candidates(&cache->ix, e, &pv, evt_type)) {
         return;
     }
 
-    for (uint8_t i = 0; i < cache->count && i < 32; i++) {
-        if ((candidate_mask & (1u << i)) == 0) {
+    for (uint32_t slot = 0; slot < cache->ix.slot_cap; slot++) {
+        if ((cache->ix.candidates[slot / 32u] & (1u << (slot % 32u))) == 0) {
+            continue;
+        }
+        const uint32_t auto_idx = cache->ix.slot_auto[slot];
+        if (auto_idx >= cache->set->hdr.automation_count) {
             continue;
         }
 
-        const gw_automation_entry_t *entry = &cache->autos[i];
-        if (!entry->enabled) {
+        const gw_auto_bin_automation_v2_t *a = &cache->set->autos[auto_idx];
+        if (!a->enabled) {
             continue;
         }
 
-        bool matched = false;
-        for (uint8_t ti = 0; ti < entry->triggers_count; ti++) {
-            if (trigger_matches(entry, &entry->triggers[ti], evt_type, e, &pv)) {
-                matched = true;
-                break;
-            }
+        const char *id = strtab_at(cache, a->id_off);
+        rule_run_t *run = rule_run_get(id);
+        gw_rules_counters_t *c = rule_counters(run);
+        if (c) {
+            c->candidates++;
         }
-        if (!matched) {
+        const gw_auto_bin_trigger_v2_t *t = gw_rules_matching_trigger(cache->set, a, evt_type, e, &pv);
+        if (!t) {
             continue;
         }
-        if (!conditions_pass(entry)) {
+        if (c) {
+            c->matches++;
+        }
+        if (gw_auto_bindings_offloaded(id)) {
+            continue; // the source device already sent it straight to the target
+        }
+        if (gw_auto_placement_on_c6(id)) {
+            continue; // the C6 ran it next to the Zigbee stack
+        }
+
+        if (a->debounce_ms) {
+            debounce_arm(a, id, e);
+            continue;
+        }
+        if (!gw_rules_conditions_pass(cache->set, a, gw_state_store_get_any)) {
+            if (c) {
+                c->cond_rejects++;
+            }
+            if (t->for_s) {
+                waits_drop(RULE_WAIT_FOR, id); // the state it waited on is gone
+            }
             continue;
         }
+        if (t->for_s) {
+            for_arm(t, id, e);
+            continue;
+        }
+        start_run(cache, a, run, e->device_uid, e->short_addr);
+    }
+}
 
-        publish_rules_fired(e, entry->id);
+static void process_event(const gw_event_t *e)
+{
+    if (!e || !e->type[0] || strcmp(e->source, "rules") == 0) {
+        return;
+    }
 
-        for (uint8_t ai = 0; ai < entry->actions_count; ai++) {
-            char errbuf[96] = {0};
-            gw_auto_compiled_t temp_compiled = {
-                .strings = (char *)entry->string_table,
-                .hdr.strings_size = entry->string_table_size,
-            };
+    const gw_auto_evt_type_t evt_type = gw_rules_evt_type(e);
+    if (!evt_type) {
+        return;
+    }
 
-            esp_err_t rc = gw_action_exec_compiled(&temp_compiled, &entry->actions[ai], errbuf, sizeof(errbuf));
-            if (rc != ESP_OK) {
-                publish_rules_action(entry->id, ai, false, errbuf[0] ? errbuf : "exec failed");
-                break;
-            }
-            publish_rules_action(entry->id, ai, true, NULL);
-        }
+    rules_cache_t *cache = rules_cache_get();
+    if (!cache) {
+        return;
     }
+    s_run_origin_ms = e->ts_ms;
+    process_event_cached(cache, e, evt_type);
+    rules_cache_put(cache);
+}
+
+static bool is_automation_change(const gw_event_t *e)
+{
+    return strcmp(e->type, "automation_saved") == 0 ||
+           strcmp(e->type, "automation_removed") == 0 ||
+           strcmp(e->type, "automation_enabled") == 0;
 }
 
 static void rules_task(void *arg)
 {
     gw_event_t e;
     for (;;) {
-        if (xQueueReceive(s_q, &e, portMAX_DELAY) == pdTRUE) {
+        const bool got = xQueueReceive(s_q, &e, rules_next_wait()) == pdTRUE;
+        waits_run_fired();
+        bindings_sync_due();
+        time_triggers_sync();
+        if (got && strcmp(e.type, "rules.timer") != 0) {
+            if (s_resync_pending) {
+                s_resync_pending = false;
+                reload_automation_cache();
+            }
+            // Changes are applied here, in queue order, so events published before
+            // a save still see the rules they were published under.
+            if (is_automation_change(&e)) {
+                handle_automation_change(&e);
+                continue;
+            }
+            if (strcmp(e.type, "net_time.synced") == 0 || strcmp(e.type, "net_time.tz_updated") == 0) {
+                s_time_dirty = true; // wall clock or timezone moved under the time triggers
+            }
             process_event(&e);
         }
     }
@@ -578,14 +1045,11 @@ static void rules_task(void *arg)
 static void rules_event_listener(const gw_event_t *event, void *user_ctx)
 {
     (void)user_ctx;
-    if (event && (strcmp(event->type, "automation_saved") == 0 ||
-                  strcmp(event->type, "automation_removed") == 0 ||
-                  strcmp(event->type, "automation_enabled") == 0)) {
-        reload_automation_cache();
-    }
-
     if (s_inited && s_q && event) {
         if (xQueueSend(s_q, event, 0) != pdTRUE) {
+            if (is_automation_change(event)) {
+                s_resync_pending = true;
+            }
             ESP_LOGW(TAG, "rules event queue overflow");
         }
     }
@@ -616,6 +1080,17 @@ esp_err_t gw_rules_init(void)
         return ESP_ERR_NO_MEM;
     }
 
+    strlcpy(s_timer_wake.type, "rules.timer", sizeof(s_timer_wake.type));
+    strlcpy(s_timer_wake.source, "rules", sizeof(s_timer_wake.source));
+
+    // Build the first cache before the task runs so it starts with a binding sync pending.
+    esp_err_t bind_err = gw_auto_bindings_init();
+    if (bind_err != ESP_OK) {
+        ESP_LOGW(TAG, "binding offload disabled: %s", esp_err_to_name(bind_err));
+    }
+    gw_event_bus_add_listener(rules_event_listener, NULL);
+    reload_automation_cache();
+
     BaseType_t task_ok = xTaskCreateWithCaps(rules_task,
                                              "rules",
                                              4096,
@@ -643,9 +1118,6 @@ esp_err_t gw_rules_init(void)
         return ESP_FAIL;
     }
 
-    gw_event_bus_add_listener(rules_event_listener, NULL);
-    reload_automation_cache();
-
     s_inited = true;
     ESP_LOGI(TAG, "rules engine initialized (indexed)");
     return ESP_OK;
@@ -0,0 +1,490 @@
+#include "gw_core/rules_index.h"
+
+#include <math.h>
+#include <string.h>
+
+#include "esp_log.h"
+
+static const char *TAG = "gw_rules_ix";
+
+#define GW_RULE_INDEX_MIN_CAP 8
+
+static uint32_t fnv1a32(const char *s)
+{
+    uint32_t h = 2166136261u;
+    if (!s) {
+        return h;
+    }
+    while (*s) {
+        h ^= (uint8_t)(*s++);
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static bool trigger_key_equals(const gw_rules_trigger_key_t *a, const gw_rules_trigger_key_t *b)
+{
+    return a->evt_type == b->evt_type &&
+           a->endpoint == b->endpoint &&
+           a->cluster_id == b->cluster_id &&
+           a->attr_id == b->attr_id &&
+           a->uid_hash == b->uid_hash &&
+           a->cmd_hash == b->cmd_hash &&
+           a->has_uid == b->has_uid &&
+           a->has_endpoint == b->has_endpoint &&
+           a->has_cluster == b->has_cluster &&
+           a->has_attr == b->has_attr &&
+           a->has_cmd == b->has_cmd;
+}
+
+static uint32_t fnv1a32_u32(uint32_t h, uint32_t v)
+{
+    for (int i = 0; i < 4; i++) {
+        h ^= (uint8_t)(v >> (8 * i));
+        h *= 16777619u;
+    }
+    return h;
+}
+
+// Field by field: the struct has padding, which initializers and copies leave undefined.
+static uint32_t trigger_key_hash(const gw_rules_trigger_key_t *k)
+{
+    uint32_t h = 2166136261u;
+    h = fnv1a32_u32(h, (uint32_t)k->evt_type | (uint32_t)k->endpoint << 8 | (uint32_t)k->cluster_id << 16);
+    h = fnv1a32_u32(h, (uint32_t)k->attr_id | (uint32_t)k->has_uid << 16 | (uint32_t)k->has_endpoint << 17 |
+                           (uint32_t)k->has_cluster << 18 | (uint32_t)k->has_attr << 19 | (uint32_t)k->has_cmd << 20);
+    h = fnv1a32_u32(h, k->uid_hash);
+    return fnv1a32_u32(h, k->cmd_hash);
+}
+
+static const uint32_t *trigger_index_lookup(const gw_rules_index_t *ix, const gw_rules_trigger_key_t *key)
+{
+    if (!ix || !key || ix->index_cap == 0) {
+        return NULL;
+    }
+
+    const size_t cap_mask = ix->index_cap - 1;
+    uint32_t pos = trigger_key_hash(key) & cap_mask;
+    for (size_t i = 0; i < ix->index_cap; i++) {
+        const gw_rules_index_slot_t *slot = &ix->slots[pos];
+        if (!slot->used) {
+            return NULL;
+        }
+        if (trigger_key_equals(&slot->key, key)) {
+            return &ix->masks[(size_t)pos * ix->mask_words];
+        }
+        pos = (pos + 1u) & cap_mask;
+    }
+    return NULL;
+}
+
+static void trigger_index_insert(gw_rules_index_t *ix, const gw_rules_trigger_key_t *key, uint32_t rule_slot)
+{
+    if (!ix || !key || rule_slot >= ix->slot_cap) {
+        return;
+    }
+
+    const size_t cap_mask = ix->index_cap - 1;
+    uint32_t pos = trigger_key_hash(key) & cap_mask;
+    for (size_t i = 0; i < ix->index_cap; i++) {
+        gw_rules_index_slot_t *slot = &ix->slots[pos];
+        if (!slot->used || trigger_key_equals(&slot->key, key)) {
+            if (!slot->used) {
+                slot->used = true;
+                slot->key = *key;
+                ix->index_used++;
+            }
+            ix->masks[(size_t)pos * ix->mask_words + rule_slot / 32u] |= (1u << (rule_slot % 32u));
+            return;
+        }
+        pos = (pos + 1u) & cap_mask;
+    }
+
+    // Index is kept at most half full, so this is unreachable.
+    ESP_LOGW(TAG, "trigger index full, rule_slot=%u dropped", (unsigned)rule_slot);
+}
+
+// Keys are never unlinked (that would break probe chains); an emptied mask just stops matching.
+static void trigger_index_clear_bit(gw_rules_index_t *ix, const gw_rules_trigger_key_t *key, uint32_t rule_slot)
+{
+    uint32_t *m = (uint32_t *)trigger_index_lookup(ix, key);
+    if (m) {
+        m[rule_slot / 32u] &= ~(1u << (rule_slot % 32u));
+    }
+}
+
+static void candidates_or(const gw_rules_index_t *ix, const gw_rules_trigger_key_t *key)
+{
+    const uint32_t *m = trigger_index_lookup(ix, key);
+    if (!m) {
+        return;
+    }
+    for (size_t w = 0; w < ix->mask_words; w++) {
+        ix->candidates[w] |= m[w];
+    }
+}
+
+static void trigger_key_build(const gw_auto_compiled_t *set, const gw_auto_bin_trigger_v2_t *t, gw_rules_trigger_key_t *out)
+{
+    gw_rules_trigger_key_t k = {0};
+    k.evt_type = t->event_type;
+
+    if (t->device_uid_off) {
+        const char *uid = gw_auto_compiled_str(set, t->device_uid_off);
+        if (uid[0]) {
+            k.has_uid = 1;
+            k.uid_hash = fnv1a32(uid);
+        }
+    }
+    if (t->endpoint) {
+        k.has_endpoint = 1;
+        k.endpoint = t->endpoint;
+    }
+
+    if (t->event_type == GW_AUTO_EVT_ZIGBEE_COMMAND) {
+        if (t->cmd_off) {
+            const char *cmd = gw_auto_compiled_str(set, t->cmd_off);
+            if (cmd[0]) {
+                k.has_cmd = 1;
+                k.cmd_hash = fnv1a32(cmd);
+            }
+        }
+        if (t->cluster_id) {
+            k.has_cluster = 1;
+            k.cluster_id = t->cluster_id;
+        }
+    } else if (t->event_type == GW_AUTO_EVT_ZIGBEE_ATTR_REPORT) {
+        if (t->cluster_id) {
+            k.has_cluster = 1;
+            k.cluster_id = t->cluster_id;
+        }
+        if (t->attr_id) {
+            k.has_attr = 1;
+            k.attr_id = t->attr_id;
+        }
+    }
+
+    *out = k;
+}
+
+void gw_rules_index_geometry(const gw_auto_compiled_t *set, size_t *index_cap, size_t *mask_words)
+{
+    size_t cap = GW_RULE_INDEX_MIN_CAP;
+    while (cap < (size_t)set->hdr.trigger_count_total * 2u) {
+        cap <<= 1;
+    }
+    *index_cap = cap;
+    *mask_words = (set->hdr.automation_count + 32u) / 32u;
+}
+
+size_t gw_rules_index_block_size(size_t index_cap, size_t mask_words)
+{
+    return index_cap * sizeof(gw_rules_index_slot_t) +
+           (index_cap + 1u) * mask_words * sizeof(uint32_t) +
+           mask_words * 32u * sizeof(uint32_t);
+}
+
+void gw_rules_index_attach(gw_rules_index_t *ix, void *block, size_t index_cap, size_t mask_words)
+{
+    ix->slots = (gw_rules_index_slot_t *)block;
+    ix->index_cap = index_cap;
+    ix->masks = (uint32_t *)(ix->slots + index_cap);
+    ix->mask_words = mask_words;
+    ix->candidates = ix->masks + index_cap * mask_words;
+    ix->slot_auto = ix->candidates + mask_words;
+    ix->slot_cap = mask_words * 32u;
+}
+
+void gw_rules_index_automation(gw_rules_index_t *ix, const gw_auto_compiled_t *set, uint32_t auto_idx, uint32_t rule_slot, bool add)
+{
+    const gw_auto_bin_automation_v2_t *a = &set->autos[auto_idx];
+    if (!a->enabled) {
+        return;
+    }
+    for (uint32_t ti = 0; ti < a->triggers_count; ti++) {
+        if (set->triggers[a->triggers_index + ti].event_type == GW_AUTO_EVT_TIME) {
+            continue; // driven by the clock, never by a bus event
+        }
+        gw_rules_trigger_key_t k;
+        trigger_key_build(set, &set->triggers[a->triggers_index + ti], &k);
+        if (add) {
+            trigger_index_insert(ix, &k, rule_slot);
+        } else {
+            trigger_index_clear_bit(ix, &k, rule_slot);
+        }
+    }
+}
+
+void gw_rules_index_fill(gw_rules_index_t *ix, const gw_auto_compiled_t *set)
+{
+    for (size_t i = 0; i < ix->slot_cap; i++) {
+        ix->slot_auto[i] = i < set->hdr.automation_count ? (uint32_t)i : GW_RULE_NO_AUTO;
+    }
+    for (uint32_t i = 0; i < set->hdr.automation_count; i++) {
+        gw_rules_index_automation(ix, set, i, i, true);
+    }
+}
+
+int gw_rules_index_slot_of(const gw_rules_index_t *ix, uint32_t auto_idx)
+{
+    for (size_t i = 0; i < ix->slot_cap; i++) {
+        if (ix->slot_auto[i] == auto_idx) {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+void gw_rules_event_view(const gw_event_t *e, gw_rules_event_view_t *out)
+{
+    memset(out, 0, sizeof(*out));
+    if (!e) return;
+
+    if (e->payload_flags & GW_EVENT_PAYLOAD_HAS_ENDPOINT) {
+        out->endpoint = e->payload_endpoint;
+        out->has_endpoint = true;
+    }
+    if (e->payload_flags & GW_EVENT_PAYLOAD_HAS_CMD) {
+        strlcpy(out->cmd_buf, e->payload_cmd, sizeof(out->cmd_buf));
+        out->cmd = out->cmd_buf;
+        out->has_cmd = out->cmd_buf[0] != '\0';
+    }
+    if (e->payload_flags & GW_EVENT_PAYLOAD_HAS_CLUSTER) {
+        out->cluster_id = e->payload_cluster;
+        out->has_cluster = true;
+    }
+    if (e->payload_flags & GW_EVENT_PAYLOAD_HAS_ATTR) {
+        out->attr_id = e->payload_attr;
+        out->has_attr = true;
+    }
+}
+
+gw_auto_evt_type_t gw_rules_evt_type(const gw_event_t *e)
+{
+    if (strcmp(e->type, "zigbee.command") == 0) return GW_AUTO_EVT_ZIGBEE_COMMAND;
+    if (strcmp(e->type, "zigbee.attr_report") == 0) return GW_AUTO_EVT_ZIGBEE_ATTR_REPORT;
+    if (strcmp(e->type, "device.join") == 0) return GW_AUTO_EVT_DEVICE_JOIN;
+    if (strcmp(e->type, "device.leave") == 0) return GW_AUTO_EVT_DEVICE_LEAVE;
+    return 0;
+}
+
+bool gw_rules_index_candidates(const gw_rules_index_t *ix,
+                               const gw_event_t *e,
+                               const gw_rules_event_view_t *pv,
+                               gw_auto_evt_type_t evt_type)
+{
+    if (!ix || !e || ix->mask_words == 0) {
+        return false;
+    }
+    memset(ix->candidates, 0, ix->mask_words * sizeof(uint32_t));
+
+    const bool ev_has_uid = e->device_uid[0] != '\0';
+    const uint32_t ev_uid_hash = ev_has_uid ? fnv1a32(e->device_uid) : 0;
+
+    gw_rules_trigger_key_t k = {0};
+    k.evt_type = evt_type;
+
+    if (evt_type == GW_AUTO_EVT_ZIGBEE_COMMAND) {
+        const bool has_uid = ev_has_uid;
+        const bool has_ep = pv->has_endpoint;
+        const bool has_cmd = pv->has_cmd && pv->cmd && pv->cmd[0];
+        const bool has_cluster = pv->has_cluster;
+        const uint32_t ev_cmd_hash = has_cmd ? fnv1a32(pv->cmd) : 0;
+
+        for (uint8_t u = 0; u <= (has_uid ? 1 : 0); u++) {
+            for (uint8_t ep = 0; ep <= (has_ep ? 1 : 0); ep++) {
+                for (uint8_t c = 0; c <= (has_cmd ? 1 : 0); c++) {
+                    for (uint8_t cl = 0; cl <= (has_cluster ? 1 : 0); cl++) {
+                        memset(&k, 0, sizeof(k));
+                        k.evt_type = evt_type;
+                        if (u) {
+                            k.has_uid = 1;
+                            k.uid_hash = ev_uid_hash;
+                        }
+                        if (ep) {
+                            k.has_endpoint = 1;
+                            k.endpoint = pv->endpoint;
+                        }
+                        if (c) {
+                            k.has_cmd = 1;
+                            k.cmd_hash = ev_cmd_hash;
+                        }
+                        if (cl) {
+                            k.has_cluster = 1;
+                            k.cluster_id = pv->cluster_id;
+                        }
+                        candidates_or(ix, &k);
+                    }
+                }
+            }
+        }
+    } else if (evt_type == GW_AUTO_EVT_ZIGBEE_ATTR_REPORT) {
+        const bool has_uid = ev_has_uid;
+        const bool has_ep = pv->has_endpoint;
+        const bool has_cluster = pv->has_cluster;
+        const bool has_attr = pv->has_attr;
+
+        for (uint8_t u = 0; u <= (has_uid ? 1 : 0); u++) {
+            for (uint8_t ep = 0; ep <= (has_ep ? 1 : 0); ep++) {
+                for (uint8_t cl = 0; cl <= (has_cluster ? 1 : 0); cl++) {
+                    for (uint8_t a = 0; a <= (has_attr ? 1 : 0); a++) {
+                        memset(&k, 0, sizeof(k));
+                        k.evt_type = evt_type;
+                        if (u) {
+                            k.has_uid = 1;
+                            k.uid_hash = ev_uid_hash;
+                        }
+                        if (ep) {
+                            k.has_endpoint = 1;
+                            k.endpoint = pv->endpoint;
+                        }
+                        if (cl) {
+                            k.has_cluster = 1;
+                            k.cluster_id = pv->cluster_id;
+                        }
+                        if (a) {
+                            k.has_attr = 1;
+                            k.attr_id = pv->attr_id;
+                        }
+                        candidates_or(ix, &k);
+                    }
+                }
+            }
+        }
+    } else {
+        const bool has_uid = ev_has_uid;
+        const bool has_ep = pv->has_endpoint;
+
+        for (uint8_t u = 0; u <= (has_uid ? 1 : 0); u++) {
+            for (uint8_t ep = 0; ep <= (has_ep ? 1 : 0); ep++) {
+                memset(&k, 0, sizeof(k));
+                k.evt_type = evt_type;
+                if (u) {
+                    k.has_uid = 1;
+                    k.uid_hash = ev_uid_hash;
+                }
+                if (ep) {
+                    k.has_endpoint = 1;
+                    k.endpoint = pv->endpoint;
+                }
+                candidates_or(ix, &k);
+            }
+        }
+    }
+
+    for (size_t w = 0; w < ix->mask_words; w++) {
+        if (ix->candidates[w]) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool trigger_matches(const gw_auto_compiled_t *set,
+                            const gw_auto_bin_trigger_v2_t *t,
+                            gw_auto_evt_type_t evt_type,
+                            const gw_event_t *e,
+                            const gw_rules_event_view_t *pv)
+{
+    if (t->event_type != evt_type) return false;
+    if (t->device_uid_off && strcmp(gw_auto_compiled_str(set, t->device_uid_off), e->device_uid) != 0) return false;
+    if (t->endpoint && (!pv->has_endpoint || pv->endpoint != t->endpoint)) return false;
+
+    if (evt_type == GW_AUTO_EVT_ZIGBEE_COMMAND) {
+        if (t->cmd_off && (!pv->has_cmd || strcmp(gw_auto_compiled_str(set, t->cmd_off), pv->cmd) != 0)) return false;
+        if (t->cluster_id && (!pv->has_cluster || pv->cluster_id != t->cluster_id)) return false;
+    } else if (evt_type == GW_AUTO_EVT_ZIGBEE_ATTR_REPORT) {
+        if (t->cluster_id && (!pv->has_cluster || pv->cluster_id != t->cluster_id)) return false;
+        if (t->attr_id && (!pv->has_attr || pv->attr_id != t->attr_id)) return false;
+    }
+    return true;
+}
+
+const gw_auto_bin_trigger_v2_t *gw_rules_matching_trigger(const gw_auto_compiled_t *set,
+                                                          const gw_auto_bin_automation_v2_t *a,
+                                                          gw_auto_evt_type_t evt_type,
+                                                          const gw_event_t *e,
+                                                          const gw_rules_event_view_t *pv)
+{
+    for (uint32_t ti = 0; ti < a->triggers_count; ti++) {
+        const gw_auto_bin_trigger_v2_t *t = &set->triggers[a->triggers_index + ti];
+        if (trigger_matches(set, t, evt_type, e, pv)) {
+            return t;
+        }
+    }
+    return NULL;
+}
+
+bool gw_rules_triggers_match(const gw_auto_compiled_t *set,
+                             const gw_auto_bin_automation_v2_t *a,
+                             gw_auto_evt_type_t evt_type,
+                             const gw_event_t *e,
+                             const gw_rules_event_view_t *pv)
+{
+    return gw_rules_matching_trigger(set, a, evt_type, e, pv) != NULL;
+}
+
+static bool state_to_number_bool(const gw_state_item_t *s, double *out_n, bool *out_b)
+{
+    if (!s) return false;
+    switch (s->value_type) {
+        case GW_STATE_VALUE_BOOL:
+            *out_n = s->value_bool ? 1.0 : 0.0;
+            *out_b = s->value_bool;
+            return true;
+        case GW_STATE_VALUE_F32:
+            *out_n = s->value_f32;
+            *out_b = fabs(s->value_f32) > 1e-6;
+            return true;
+        case GW_STATE_VALUE_U32:
+            *out_n = s->value_u32;
+            *out_b = s->value_u32 != 0;
+            return true;
+        case GW_STATE_VALUE_U64:
+            *out_n = s->value_u64;
+            *out_b = s->value_u64 != 0;
+            return true;
+        default:
+            return false;
+    }
+}
+
+bool gw_rules_conditions_pass(const gw_auto_compiled_t *set, const gw_auto_bin_automation_v2_t *a, gw_rules_state_get_fn get_state)
+{
+    if (a->conditions_count == 0) return true;
+    if (!get_state) return false;
+
+    for (uint32_t i = 0; i < a->conditions_count; i++) {
+        const gw_auto_bin_condition_v2_t *co = &set->conditions[a->conditions_index + i];
+        const char *uid_s = gw_auto_compiled_str(set, co->device_uid_off);
+        const char *key = gw_auto_compiled_str(set, co->key_off);
+        if (!uid_s[0] || !key[0]) return false;
+
+        gw_device_uid_t uid = {0};
+        strlcpy(uid.uid, uid_s, sizeof(uid.uid));
+        gw_state_item_t st = {0};
+        if (get_state(&uid, key, &st) != ESP_OK) return false;
+
+        double actual_n = 0;
+        bool actual_b = false;
+        if (!state_to_number_bool(&st, &actual_n, &actual_b)) return false;
+
+        const gw_auto_op_t op = (gw_auto_op_t)co->op;
+        if (co->val_type == GW_AUTO_VAL_BOOL) {
+            bool exp = co->v.b != 0;
+            if ((op == GW_AUTO_OP_EQ && actual_b != exp) || (op == GW_AUTO_OP_NE && actual_b == exp)) return false;
+        } else {
+            double exp = co->v.f64;
+            double act = actual_n;
+            if ((op == GW_AUTO_OP_EQ && fabs(act - exp) > 1e-6) ||
+                (op == GW_AUTO_OP_NE && fabs(act - exp) < 1e-6) ||
+                (op == GW_AUTO_OP_GT && act <= exp) ||
+                (op == GW_AUTO_OP_LT && act >= exp) ||
+                (op == GW_AUTO_OP_GE && act < exp) ||
+                (op == GW_AUTO_OP_LE && act > exp)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
@@ -13,6 +13,7 @@
 #include "gw_core/event_bus.h"
 #include "gw_core/sensor_store.h"
 #include "gw_core/state_store.h"
+#include "gw_core/zb_attr_map.h"
 #include "gw_core/zb_model.h"
 
 static const char *TAG = "gw_runtime_sync";
@@ -71,242 +72,64 @@ static bool resolve_uid(const gw_event_t *e, gw_device_uid_t *out_uid)
 }
 
 
-static bool value_as_bool(const gw_event_t *e, bool *out)
+static void store_attr_value(const gw_device_uid_t *uid, const gw_event_t *e, uint8_t endpoint, const gw_zb_attr_value_t *av)
 {
-    if (!e || !out) {
-        return false;
-    }
-    switch ((gw_event_value_type_t)e->payload_value_type) {
-        case GW_EVENT_VALUE_BOOL:
-            *out = (e->payload_value_bool != 0);
-            return true;
-        case GW_EVENT_VALUE_I64:
-            *out = (e->payload_value_i64 != 0);
-            return true;
-        case GW_EVENT_VALUE_F64:
-            *out = (e->payload_value_f64 != 0.0);
-            return true;
-        default:
-            return false;
-    }
-}
-
-static bool value_as_i64(const gw_event_t *e, int64_t *out)
-{
-    if (!e || !out) {
-        return false;
-    }
-    switch ((gw_event_value_type_t)e->payload_value_type) {
-        case GW_EVENT_VALUE_I64:
-            *out = e->payload_value_i64;
-            return true;
-        case GW_EVENT_VALUE_BOOL:
-            *out = e->payload_value_bool ? 1 : 0;
-            return true;
-        case GW_EVENT_VALUE_F64:
-            *out = (int64_t)e->payload_value_f64;
-            return true;
-        default:
-            return false;
-    }
-}
-
-static void process_attr_report(const gw_device_uid_t *uid, const gw_event_t *e)
-{
-    if (!uid || uid->uid[0] == '\0' || !e) {
-        return;
-    }
-    if (!(e->payload_flags & GW_EVENT_PAYLOAD_HAS_CLUSTER) || !(e->payload_flags & GW_EVENT_PAYLOAD_HAS_ATTR)) {
-        return;
-    }
-
-    const uint16_t cluster = e->payload_cluster;
-    const uint16_t attr = e->payload_attr;
-    const uint8_t endpoint = (e->payload_flags & GW_EVENT_PAYLOAD_HAS_ENDPOINT) ? e->payload_endpoint : 0;
-
-    // Temperature (0x0402/0x0000), hundredths of Celsius.
-    if (cluster == 0x0402 && attr == 0x0000) {
+    const gw_zb_attr_desc_t *d = av->desc;
+    if (d->flags & GW_ZB_ATTR_F_SENSOR) {
         gw_sensor_value_t v = {0};
         v.uid = *uid;
         v.short_addr = e->short_addr;
         v.endpoint = e->payload_endpoint;
-        v.cluster_id = cluster;
-        v.attr_id = attr;
+        v.cluster_id = d->cluster;
+        v.attr_id = d->attr;
         v.ts_ms = e->ts_ms;
-        float celsius = 0.0f;
-
-        if ((gw_event_value_type_t)e->payload_value_type == GW_EVENT_VALUE_F64) {
-            celsius = (float)e->payload_value_f64;
+        if (d->zcl_type == GW_ZCL_TYPE_S16) {
             v.value_type = GW_SENSOR_VALUE_I32;
-            v.value_i32 = (int32_t)(celsius * 100.0f);
-            (void)gw_sensor_store_upsert(&v);
-            (void)gw_state_store_set_f32(uid, endpoint, "temperature_c", celsius, e->ts_ms);
+            v.value_i32 = av->raw;
         } else {
-            int64_t raw = 0;
-            if (value_as_i64(e, &raw)) {
-                v.value_type = GW_SENSOR_VALUE_I32;
-                v.value_i32 = (int32_t)raw;
-                (void)gw_sensor_store_upsert(&v);
-                (void)gw_state_store_set_f32(uid, endpoint, "temperature_c", ((float)v.value_i32) / 100.0f, e->ts_ms);
-            }
-        }
-        return;
-    }
-
-    // Humidity (0x0405/0x0000), hundredths of percent.
-    if (cluster == 0x0405 && attr == 0x0000) {
-        gw_sensor_value_t v = {0};
-        v.uid = *uid;
-        v.short_addr = e->short_addr;
-        v.endpoint = e->payload_endpoint;
-        v.cluster_id = cluster;
-        v.attr_id = attr;
-        v.ts_ms = e->ts_ms;
-        float humidity = 0.0f;
-
-        if ((gw_event_value_type_t)e->payload_value_type == GW_EVENT_VALUE_F64) {
-            humidity = (float)e->payload_value_f64;
-            v.value_type = GW_SENSOR_VALUE_U32;
-            v.value_u32 = (uint32_t)(humidity * 100.0f);
-            (void)gw_sensor_store_upsert(&v);
-            (void)gw_state_store_set_f32(uid, endpoint, "humidity_pct", humidity, e->ts_ms);
-        } else {
-            int64_t raw = 0;
-            if (value_as_i64(e, &raw) && raw >= 0) {
-                v.value_type = GW_SENSOR_VALUE_U32;
-                v.value_u32 = (uint32_t)raw;
-                (void)gw_sensor_store_upsert(&v);
-                (void)gw_state_store_set_f32(uid, endpoint, "humidity_pct", ((float)v.value_u32) / 100.0f, e->ts_ms);
-            }
-        }
-        return;
-    }
-
-    // Battery percentage (0x0001/0x0021).
-    if (cluster == 0x0001 && attr == 0x0021) {
-        int64_t pct = 0;
-        if (value_as_i64(e, &pct) && pct >= 0) {
-            gw_sensor_value_t v = {0};
-            v.uid = *uid;
-            v.short_addr = e->short_addr;
-            v.endpoint = e->payload_endpoint;
-            v.cluster_id = cluster;
-            v.attr_id = attr;
-            v.value_type = GW_SENSOR_VALUE_U32;
-            v.value_u32 = (uint32_t)pct;
-            v.ts_ms = e->ts_ms;
-            (void)gw_sensor_store_upsert(&v);
-            (void)gw_state_store_set_u32(uid, endpoint, "battery_pct", (uint32_t)pct, e->ts_ms);
-        }
-        return;
-    }
-
-    // Battery voltage (0x0001/0x0020), normalize to millivolts.
-    if (cluster == 0x0001 && attr == 0x0020) {
-        int64_t raw = 0;
-        if (value_as_i64(e, &raw) && raw >= 0) {
-            uint32_t mv = (uint32_t)raw;
-            gw_sensor_value_t v = {0};
-            v.uid = *uid;
-            v.short_addr = e->short_addr;
-            v.endpoint = e->payload_endpoint;
-            v.cluster_id = cluster;
-            v.attr_id = attr;
             v.value_type = GW_SENSOR_VALUE_U32;
-            v.value_u32 = mv;
-            v.ts_ms = e->ts_ms;
-            (void)gw_sensor_store_upsert(&v);
-            (void)gw_state_store_set_u32(uid, endpoint, "battery_mv", mv, e->ts_ms);
+            v.value_u32 = (uint32_t)av->raw;
         }
-        return;
+        (void)gw_sensor_store_upsert(&v);
     }
 
-    // On/off (0x0006/0x0000).
-    if (cluster == 0x0006 && attr == 0x0000) {
-        bool onoff = false;
-        if (value_as_bool(e, &onoff)) {
-            (void)gw_state_store_set_bool(uid, endpoint, "onoff", onoff, e->ts_ms);
-        }
-        return;
-    }
-
-    // Current level (0x0008/0x0000).
-    if (cluster == 0x0008 && attr == 0x0000) {
-        int64_t lvl = 0;
-        if (value_as_i64(e, &lvl) && lvl >= 0) {
-            gw_sensor_value_t v = {0};
-            v.uid = *uid;
-            v.short_addr = e->short_addr;
-            v.endpoint = e->payload_endpoint;
-            v.cluster_id = cluster;
-            v.attr_id = attr;
-            v.value_type = GW_SENSOR_VALUE_U32;
-            v.value_u32 = (uint32_t)lvl;
-            v.ts_ms = e->ts_ms;
-            (void)gw_sensor_store_upsert(&v);
-            (void)gw_state_store_set_u32(uid, endpoint, "level", (uint32_t)lvl, e->ts_ms);
-        }
-        return;
+    switch ((gw_zb_attr_kind_t)d->kind) {
+        case GW_ZB_ATTR_KIND_BOOL:
+            (void)gw_state_store_set_bool(uid, endpoint, d->state_key, av->value != 0.0, e->ts_ms);
+            break;
+        case GW_ZB_ATTR_KIND_U32:
+            (void)gw_state_store_set_u32(uid, endpoint, d->state_key, (uint32_t)av->value, e->ts_ms);
+            break;
+        case GW_ZB_ATTR_KIND_F32:
+            (void)gw_state_store_set_f32(uid, endpoint, d->state_key, (float)av->value, e->ts_ms);
+            break;
     }
+}
 
-    // Color X/Y and color temperature (0x0300).
-    if (cluster == 0x0300 && (attr == 0x0003 || attr == 0x0004 || attr == 0x0007)) {
-        int64_t raw = 0;
-        if (value_as_i64(e, &raw) && raw >= 0) {
-            gw_sensor_value_t v = {0};
-            v.uid = *uid;
-            v.short_addr = e->short_addr;
-            v.endpoint = e->payload_endpoint;
-            v.cluster_id = cluster;
-            v.attr_id = attr;
-            v.value_type = GW_SENSOR_VALUE_U32;
-            v.value_u32 = (uint32_t)raw;
-            v.ts_ms = e->ts_ms;
-            (void)gw_sensor_store_upsert(&v);
-            if (attr == 0x0003) {
-                (void)gw_state_store_set_u32(uid, endpoint, "color_x", (uint32_t)raw, e->ts_ms);
-            } else if (attr == 0x0004) {
-                (void)gw_state_store_set_u32(uid, endpoint, "color_y", (uint32_t)raw, e->ts_ms);
-            } else {
-                (void)gw_state_store_set_u32(uid, endpoint, "color_temp_mireds", (uint32_t)raw, e->ts_ms);
-            }
-        }
+static void process_attr_report(const gw_device_uid_t *uid, const gw_event_t *e)
+{
+    if (!uid || uid->uid[0] == '\0' || !e) {
         return;
     }
-
-    // Occupancy (0x0406/0x0000).
-    if (cluster == 0x0406 && attr == 0x0000) {
-        bool occ = false;
-        if (value_as_bool(e, &occ)) {
-            (void)gw_state_store_set_bool(uid, endpoint, "occupancy", occ, e->ts_ms);
-        }
+    if (!(e->payload_flags & GW_EVENT_PAYLOAD_HAS_CLUSTER) || !(e->payload_flags & GW_EVENT_PAYLOAD_HAS_ATTR)) {
         return;
     }
 
-    // Illuminance raw (0x0400/0x0000).
-    if (cluster == 0x0400 && attr == 0x0000) {
-        int64_t raw = 0;
-        if (value_as_i64(e, &raw) && raw >= 0) {
-            (void)gw_state_store_set_u32(uid, endpoint, "illuminance_raw", (uint32_t)raw, e->ts_ms);
-        }
-        return;
-    }
+    const uint16_t cluster = e->payload_cluster;
+    const uint16_t attr = e->payload_attr;
+    const uint8_t endpoint = (e->payload_flags & GW_EVENT_PAYLOAD_HAS_ENDPOINT) ? e->payload_endpoint : 0;
 
-    // Pressure raw (0x0403/0x0000).
-    if (cluster == 0x0403 && attr == 0x0000) {
-        int64_t raw = 0;
-        if (value_as_i64(e, &raw)) {
-            gw_sensor_value_t v = {0};
-            v.uid = *uid;
-            v.short_addr = e->short_addr;
-            v.endpoint = e->payload_endpoint;
-            v.cluster_id = cluster;
-            v.attr_id = attr;
-            v.value_type = GW_SENSOR_VALUE_I32;
-            v.value_i32 = (int32_t)raw;
-            v.ts_ms = e->ts_ms;
-            (void)gw_sensor_store_upsert(&v);
-            (void)gw_state_store_set_f32(uid, endpoint, "pressure_raw", (float)raw, e->ts_ms);
+    // Known attributes: the event carries the normalized value, the table says where it goes.
+    gw_zb_attr_value_t av = {0};
+    if (gw_zb_attr_find(cluster, attr)) {
+        if (gw_zb_attr_from_event(cluster,
+                                  attr,
+                                  (gw_event_value_type_t)e->payload_value_type,
+                                  e->payload_value_bool != 0,
+                                  e->payload_value_i64,
+                                  e->payload_value_f64,
+                                  &av)) {
+            store_attr_value(uid, e, endpoint, &av);
         }
         return;
     }
@@ -6,16 +6,44 @@
 
 #include "esp_heap_caps.h"
 #include "esp_log.h"
+#include "esp_random.h"
 #include "freertos/FreeRTOS.h"
 
 static const char *TAG = "gw_state_store";
 
+#define GW_STATE_LOG_CAP  256 // change log entries: the index behind gw_state_store_changes_page()
+#define GW_STATE_GONE_CAP 32  // removed items remembered for deltas
+
+// One entry per change, in version order. An entry is stale once a later change to
+// the same slot has bumped the item's version; removals point into s_gone instead.
+typedef struct {
+    uint32_t version;
+    uint16_t ref; // item slot, or s_gone slot when `removed`
+    bool removed;
+} state_log_entry_t;
+
+typedef struct {
+    gw_device_uid_t uid;
+    uint8_t endpoint;
+    char key[GW_STATE_KEY_MAX];
+    uint32_t version;
+} state_gone_t;
+
 static bool s_inited;
 static gw_state_item_t *s_items;
-static size_t s_item_count;
+static size_t s_item_count; // high-water mark; removed slots are empty (uid "") until reused
 static size_t s_item_cap;
+static size_t s_free_count;
 static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
 
+static uint32_t s_version; // last version handed out
+static uint32_t s_floor;   // changes up to here may be gone from the log: deltas need since >= s_floor
+static state_log_entry_t *s_log;
+static size_t s_log_head;
+static size_t s_log_count;
+static state_gone_t *s_gone;
+static size_t s_gone_next;
+
 static bool uid_equals(const gw_device_uid_t *a, const gw_device_uid_t *b)
 {
     if (a == NULL || b == NULL) {
@@ -49,13 +77,10 @@ static size_t find_idx_locked(const gw_device_uid_t *uid, uint8_t endpoint, cons
 
 static size_t find_oldest_idx_locked(void)
 {
-    if (s_item_count == 0) {
-        return (size_t)-1;
-    }
-    size_t oldest = 0;
-    uint64_t oldest_ts = s_items[0].ts_ms;
-    for (size_t i = 1; i < s_item_count; i++) {
-        if (s_items[i].ts_ms < oldest_ts) {
+    size_t oldest = (size_t)-1;
+    uint64_t oldest_ts = UINT64_MAX;
+    for (size_t i = 0; i < s_item_count; i++) {
+        if (s_items[i].uid.uid[0] != '\0' && s_items[i].ts_ms < oldest_ts) {
             oldest = i;
             oldest_ts = s_items[i].ts_ms;
         }
@@ -63,6 +88,51 @@ static size_t find_oldest_idx_locked(void)
     return oldest;
 }
 
+static size_t find_free_idx_locked(void)
+{
+    for (size_t i = 0; s_free_count > 0 && i < s_item_count; i++) {
+        if (s_items[i].uid.uid[0] == '\0') {
+            return i;
+        }
+    }
+    return (size_t)-1;
+}
+
+static void log_push_locked(uint32_t version, size_t ref, bool removed)
+{
+    if (s_log_count == GW_STATE_LOG_CAP) {
+        s_floor = s_log[s_log_head].version; // a delta from before this would miss it
+        s_log_head = (s_log_head + 1) % GW_STATE_LOG_CAP;
+        s_log_count--;
+    }
+    s_log[(s_log_head + s_log_count) % GW_STATE_LOG_CAP] = (state_log_entry_t){
+        .version = version,
+        .ref = (uint16_t)ref,
+        .removed = removed,
+    };
+    s_log_count++;
+}
+
+static void note_changed_locked(size_t idx)
+{
+    s_items[idx].version = ++s_version;
+    log_push_locked(s_items[idx].version, idx, false);
+}
+
+static void note_removed_locked(const gw_state_item_t *item)
+{
+    state_gone_t *g = &s_gone[s_gone_next];
+    if (g->version > s_floor) {
+        s_floor = g->version; // the tombstone being reused is lost to older deltas
+    }
+    g->uid = item->uid;
+    g->endpoint = item->endpoint;
+    strlcpy(g->key, item->key, sizeof(g->key));
+    g->version = ++s_version;
+    log_push_locked(g->version, s_gone_next, true);
+    s_gone_next = (s_gone_next + 1) % GW_STATE_GONE_CAP;
+}
+
 static void state_value_to_str(const gw_state_item_t *item, char *out, size_t out_size)
 {
     if (!out || out_size == 0) {
@@ -122,21 +192,38 @@ esp_err_t gw_state_store_init(void)
 {
     portENTER_CRITICAL(&s_lock);
     if (s_items == NULL) {
-        s_items = (gw_state_item_t *)heap_caps_calloc(GW_STATE_MAX_ITEMS, sizeof(gw_state_item_t), MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
-        if (!s_items) {
-            s_items = (gw_state_item_t *)heap_caps_calloc(GW_STATE_MAX_ITEMS, sizeof(gw_state_item_t), MALLOC_CAP_8BIT);
+        // Items, change log and tombstones in one block.
+        const size_t total = GW_STATE_MAX_ITEMS * sizeof(gw_state_item_t) +
+                             GW_STATE_LOG_CAP * sizeof(state_log_entry_t) +
+                             GW_STATE_GONE_CAP * sizeof(state_gone_t);
+        uint8_t *mem = (uint8_t *)heap_caps_calloc(1, total, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+        if (!mem) {
+            mem = (uint8_t *)heap_caps_calloc(1, total, MALLOC_CAP_8BIT);
         }
-        if (!s_items) {
+        if (!mem) {
             portEXIT_CRITICAL(&s_lock);
             ESP_LOGE(TAG, "alloc failed for %u items", (unsigned)GW_STATE_MAX_ITEMS);
             return ESP_ERR_NO_MEM;
         }
+        s_items = (gw_state_item_t *)mem;
+        s_log = (state_log_entry_t *)(mem + GW_STATE_MAX_ITEMS * sizeof(gw_state_item_t));
+        s_gone = (state_gone_t *)((uint8_t *)s_log + GW_STATE_LOG_CAP * sizeof(state_log_entry_t));
         s_item_cap = GW_STATE_MAX_ITEMS;
+        // Random start: a version a client kept from before a reboot falls outside
+        // [s_floor, s_version] and gets a full listing instead of a bogus delta.
+        s_version = esp_random() & 0x3fffffffu;
     }
 
     s_inited = true;
     s_item_count = 0;
+    s_free_count = 0;
     memset(s_items, 0, s_item_cap * sizeof(gw_state_item_t));
+    // Versions keep counting across re-inits so clients holding one see everything as new.
+    s_floor = s_version;
+    s_log_head = 0;
+    s_log_count = 0;
+    memset(s_gone, 0, GW_STATE_GONE_CAP * sizeof(state_gone_t));
+    s_gone_next = 0;
     portEXIT_CRITICAL(&s_lock);
 
     ESP_LOGI(TAG, "initialized cap=%u", (unsigned)s_item_cap);
@@ -163,10 +250,11 @@ static esp_err_t upsert_item(const gw_state_item_t *item)
     size_t idx = find_idx_locked(&item->uid, item->endpoint, item->key);
     if (idx != (size_t)-1) {
         if (state_value_equals(&s_items[idx], item)) {
-            s_items[idx].ts_ms = item->ts_ms;
+            s_items[idx].ts_ms = item->ts_ms; // a refresh, not a change: no new version
             op = OP_NONE;
         } else {
             s_items[idx] = *item;
+            note_changed_locked(idx);
             op = OP_UPDATE;
         }
         count_after = s_item_count;
@@ -174,8 +262,15 @@ static esp_err_t upsert_item(const gw_state_item_t *item)
         goto log_and_return;
     }
 
-    if (s_item_count < s_item_cap) {
-        s_items[s_item_count++] = *item;
+    idx = find_free_idx_locked();
+    if (idx != (size_t)-1) {
+        s_free_count--;
+    } else if (s_item_count < s_item_cap) {
+        idx = s_item_count++;
+    }
+    if (idx != (size_t)-1) {
+        s_items[idx] = *item;
+        note_changed_locked(idx);
         op = OP_INSERT;
         count_after = s_item_count;
         portEXIT_CRITICAL(&s_lock);
@@ -189,7 +284,9 @@ static esp_err_t upsert_item(const gw_state_item_t *item)
     }
     evicted = s_items[idx];
     has_evicted = true;
+    note_removed_locked(&evicted);
     s_items[idx] = *item;
+    note_changed_locked(idx);
     op = OP_EVICT;
     count_after = s_item_count;
     portEXIT_CRITICAL(&s_lock);
@@ -371,6 +468,104 @@ size_t gw_state_store_list(const gw_device_uid_t *uid, uint8_t endpoint, gw_stat
     return written;
 }
 
+size_t gw_state_store_list_page(size_t *cursor, gw_state_item_t *out, size_t max_out)
+{
+    if (!s_inited || cursor == NULL || out == NULL || max_out == 0) {
+        return 0;
+    }
+
+    size_t written = 0;
+    portENTER_CRITICAL(&s_lock);
+    size_t i = *cursor;
+    for (; i < s_item_count && written < max_out; i++) {
+        if (s_items[i].uid.uid[0] != '\0') {
+            out[written++] = s_items[i];
+        }
+    }
+    *cursor = i;
+    portEXIT_CRITICAL(&s_lock);
+    return written;
+}
+
+uint32_t gw_state_store_version(void)
+{
+    portENTER_CRITICAL(&s_lock);
+    const uint32_t v = s_version;
+    portEXIT_CRITICAL(&s_lock);
+    return v;
+}
+
+esp_err_t gw_state_store_changes_page(uint32_t *cursor, gw_state_item_t *out, size_t max_out, size_t *out_count)
+{
+    if (out_count) {
+        *out_count = 0;
+    }
+    if (!s_inited || cursor == NULL || out == NULL || max_out == 0 || out_count == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    size_t written = 0;
+    portENTER_CRITICAL(&s_lock);
+    if (*cursor < s_floor) {
+        portEXIT_CRITICAL(&s_lock);
+        return ESP_ERR_INVALID_STATE;
+    }
+    // Versions ascend along the ring: binary search for the first entry after the cursor.
+    size_t lo = 0;
+    size_t hi = s_log_count;
+    while (lo < hi) {
+        const size_t mid = lo + (hi - lo) / 2;
+        if (s_log[(s_log_head + mid) % GW_STATE_LOG_CAP].version <= *cursor) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    for (size_t i = lo; i < s_log_count && written < max_out; i++) {
+        const state_log_entry_t *e = &s_log[(s_log_head + i) % GW_STATE_LOG_CAP];
+        *cursor = e->version;
+        if (e->removed) {
+            // Still this removal: reusing the tombstone would have raised s_floor past it.
+            const state_gone_t *g = &s_gone[e->ref];
+            gw_state_item_t *o = &out[written++];
+            memset(o, 0, sizeof(*o));
+            o->uid = g->uid;
+            o->endpoint = g->endpoint;
+            strlcpy(o->key, g->key, sizeof(o->key));
+            o->value_type = GW_STATE_VALUE_REMOVED;
+            o->version = g->version;
+        } else if (s_items[e->ref].version == e->version) {
+            out[written++] = s_items[e->ref]; // otherwise a later entry has its newer value
+        }
+    }
+    portEXIT_CRITICAL(&s_lock);
+    *out_count = written;
+    return ESP_OK;
+}
+
+size_t gw_state_store_remove_uid(const gw_device_uid_t *uid)
+{
+    if (!s_inited || uid == NULL || uid->uid[0] == '\0') {
+        return 0;
+    }
+
+    size_t removed = 0;
+    portENTER_CRITICAL(&s_lock);
+    for (size_t i = 0; i < s_item_count; i++) {
+        if (uid_equals(&s_items[i].uid, uid)) {
+            note_removed_locked(&s_items[i]);
+            memset(&s_items[i], 0, sizeof(s_items[i]));
+            s_free_count++;
+            removed++;
+        }
+    }
+    portEXIT_CRITICAL(&s_lock);
+    if (removed) {
+        ESP_LOGD(TAG, "state remove uid=%s items=%u", uid->uid, (unsigned)removed);
+    }
+    return removed;
+}
+
 size_t gw_state_store_list_uid(const gw_device_uid_t *uid, gw_state_item_t *out, size_t max_out)
 {
     if (!s_inited || uid == NULL || out == NULL || max_out == 0) {
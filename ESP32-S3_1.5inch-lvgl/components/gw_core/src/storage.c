@@ -358,6 +358,11 @@ esp_err_t gw_storage_save(gw_storage_t *storage)
         return ESP_ERR_INVALID_STATE;
     }
 
+    // Before the write: the cached data has changed even if persisting it fails.
+    portENTER_CRITICAL(&storage->lock);
+    storage->content_version++;
+    portEXIT_CRITICAL(&storage->lock);
+
     switch (storage->backend) {
         case GW_STORAGE_NVS:
             return nvs_backend_save(storage);
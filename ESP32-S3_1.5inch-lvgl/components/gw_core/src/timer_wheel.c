@@ -0,0 +1,161 @@
+#include "gw_core/timer_wheel.h"
+
+#include <string.h>
+
+#define SLOT_MASK (GW_TIMER_WHEEL_SLOTS - 1u)
+
+static unsigned level_index(uint64_t tick, unsigned level)
+{
+    return (unsigned)(tick >> (level * GW_TIMER_WHEEL_SLOT_BITS)) & SLOT_MASK;
+}
+
+static void slot_push(gw_timer_t **head, gw_timer_t *t)
+{
+    t->next = *head;
+    if (t->next) {
+        t->next->pprev = &t->next;
+    }
+    *head = t;
+    t->pprev = head;
+}
+
+static void slot_unlink(gw_timer_t *t)
+{
+    *t->pprev = t->next;
+    if (t->next) {
+        t->next->pprev = t->pprev;
+    }
+    t->next = NULL;
+    t->pprev = NULL;
+}
+
+// Level 0 holds the next 64 ticks one per slot; level N holds timers 64^N..64^(N+1)
+// ticks out, hashed by their level-N digit, and is cascaded down when the digit below wraps.
+static void wheel_insert(gw_timer_wheel_t *w, gw_timer_t *t)
+{
+    if (t->expires < w->next_tick) {
+        slot_push(&w->slots[0][level_index(w->next_tick, 0)], t); // overdue: next tick
+        return;
+    }
+    const uint64_t delta = t->expires - w->next_tick;
+    unsigned level = 0;
+    while (level + 1 < GW_TIMER_WHEEL_LEVELS && delta >= (1ull << ((level + 1) * GW_TIMER_WHEEL_SLOT_BITS))) {
+        level++;
+    }
+    slot_push(&w->slots[level][level_index(t->expires, level)], t);
+}
+
+static unsigned cascade(gw_timer_wheel_t *w, unsigned level)
+{
+    const unsigned idx = level_index(w->next_tick, level);
+    gw_timer_t *list = w->slots[level][idx];
+    w->slots[level][idx] = NULL;
+    while (list) {
+        gw_timer_t *t = list;
+        list = t->next;
+        t->next = NULL;
+        wheel_insert(w, t);
+    }
+    return idx;
+}
+
+void gw_timer_wheel_init(gw_timer_wheel_t *w, uint32_t tick_ms, uint64_t now_ms)
+{
+    memset(w, 0, sizeof(*w));
+    w->tick_ms = tick_ms ? tick_ms : 1;
+    w->next_tick = now_ms / w->tick_ms + 1;
+}
+
+void gw_timer_wheel_arm(gw_timer_wheel_t *w, gw_timer_t *t, uint64_t now_ms, uint32_t delay_ms, gw_timer_cb_t cb, void *arg)
+{
+    gw_timer_wheel_cancel(w, t);
+    // Round up so a timer never fires early.
+    uint64_t expires = (now_ms + delay_ms + w->tick_ms - 1) / w->tick_ms;
+    if (expires <= now_ms / w->tick_ms) {
+        expires = now_ms / w->tick_ms + 1;
+    }
+    if (expires > w->next_tick && expires - w->next_tick > GW_TIMER_WHEEL_MAX_TICKS) {
+        expires = w->next_tick + GW_TIMER_WHEEL_MAX_TICKS;
+    }
+    t->expires = expires;
+    t->cb = cb;
+    t->arg = arg;
+    wheel_insert(w, t);
+    w->armed++;
+}
+
+void gw_timer_wheel_cancel(gw_timer_wheel_t *w, gw_timer_t *t)
+{
+    if (!t || !t->pprev) {
+        return;
+    }
+    slot_unlink(t);
+    w->armed--;
+}
+
+size_t gw_timer_wheel_advance(gw_timer_wheel_t *w, uint64_t now_ms)
+{
+    const uint64_t target = now_ms / w->tick_ms;
+    size_t fired = 0;
+    while (w->next_tick <= target) {
+        if (w->armed == 0) {
+            w->next_tick = target + 1; // nothing to cascade, skip the idle ticks
+            break;
+        }
+        const unsigned idx = level_index(w->next_tick, 0);
+        for (unsigned level = 1; idx == 0 && level < GW_TIMER_WHEEL_LEVELS; level++) {
+            if (cascade(w, level) != 0) {
+                break;
+            }
+        }
+
+        // Detach the slot first: callbacks may re-arm into it or cancel later entries.
+        gw_timer_t *work = w->slots[0][idx];
+        w->slots[0][idx] = NULL;
+        if (work) {
+            work->pprev = &work;
+        }
+        w->next_tick++;
+        while (work) {
+            gw_timer_t *t = work;
+            slot_unlink(t);
+            w->armed--;
+            fired++;
+            if (t->cb) {
+                t->cb(t, t->arg);
+            }
+        }
+    }
+    return fired;
+}
+
+uint64_t gw_timer_wheel_next_due_ms(const gw_timer_wheel_t *w)
+{
+    if (w->armed == 0) {
+        return UINT64_MAX;
+    }
+    uint64_t best = UINT64_MAX;
+    for (unsigned i = 0; i < GW_TIMER_WHEEL_SLOTS; i++) {
+        const uint64_t tick = w->next_tick + i;
+        if (w->slots[0][level_index(tick, 0)]) {
+            best = tick;
+            break;
+        }
+    }
+    for (unsigned level = 1; level < GW_TIMER_WHEEL_LEVELS; level++) {
+        const unsigned shift = level * GW_TIMER_WHEEL_SLOT_BITS;
+        const uint64_t cur = w->next_tick >> shift;
+        // The current slot was cascaded when its digit came up, unless that is the very next tick.
+        const unsigned first = (w->next_tick & ((1ull << shift) - 1)) == 0 ? 0 : 1;
+        for (unsigned i = first; i <= GW_TIMER_WHEEL_SLOTS; i++) {
+            if (w->slots[level][(unsigned)(cur + i) & SLOT_MASK]) {
+                const uint64_t tick = (cur + i) << shift;
+                if (tick < best) {
+                    best = tick;
+                }
+                break;
+            }
+        }
+    }
+    return best == UINT64_MAX ? UINT64_MAX : best * w->tick_ms;
+}
@@ -0,0 +1,159 @@
+#include "gw_core/timers.h"
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "freertos/timers.h"
+#include "freertos/idf_additions.h"
+
+static const char *TAG = "gw_timers";
+
+#define GW_TIMERS_TASK_PRIO  8 // above the rules task, so deadlines do not queue behind rule runs
+#define GW_TIMERS_TASK_STACK 4096
+#define GW_TIMERS_MAX_SLEEP_MS (60u * 60u * 1000u) // keeps pdMS_TO_TICKS() in range
+
+static gw_timer_wheel_t s_wheel;
+static SemaphoreHandle_t s_lock; // recursive: callbacks arm and cancel timers
+static TimerHandle_t s_wake;     // one-shot, due at s_wake_ms
+static uint64_t s_wake_ms = UINT64_MAX;
+static TaskHandle_t s_task;
+static bool s_inited;
+
+static uint64_t now_ms(void)
+{
+    return (uint64_t)(esp_timer_get_time() / 1000ULL);
+}
+
+// Called with s_lock held.
+static void wake_at(uint64_t due_ms)
+{
+    if (due_ms == UINT64_MAX) {
+        xTimerStop(s_wake, 0);
+        s_wake_ms = UINT64_MAX;
+        return;
+    }
+    const uint64_t now = now_ms();
+    uint64_t sleep_ms = due_ms > now ? due_ms - now : 0;
+    if (sleep_ms > GW_TIMERS_MAX_SLEEP_MS) {
+        sleep_ms = GW_TIMERS_MAX_SLEEP_MS; // the task just wakes and reprograms
+    }
+    const TickType_t ticks = pdMS_TO_TICKS((uint32_t)sleep_ms) + 1;
+    if (xTimerChangePeriod(s_wake, ticks, 0) == pdPASS) {
+        s_wake_ms = due_ms;
+    } else {
+        // Timer command queue full: let the task run now and reprogram.
+        s_wake_ms = UINT64_MAX;
+        xTaskNotifyGive(s_task);
+    }
+}
+
+static void wake_cb(TimerHandle_t timer)
+{
+    (void)timer;
+    xTaskNotifyGive(s_task);
+}
+
+static void timers_task(void *arg)
+{
+    (void)arg;
+    for (;;) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        xSemaphoreTakeRecursive(s_lock, portMAX_DELAY);
+        s_wake_ms = UINT64_MAX;
+        gw_timer_wheel_advance(&s_wheel, now_ms());
+        wake_at(gw_timer_wheel_next_due_ms(&s_wheel));
+        xSemaphoreGiveRecursive(s_lock);
+    }
+}
+
+esp_err_t gw_timers_init(void)
+{
+    if (s_inited) {
+        return ESP_OK;
+    }
+
+    gw_timer_wheel_init(&s_wheel, GW_TIMERS_TICK_MS, now_ms());
+    s_lock = xSemaphoreCreateRecursiveMutex();
+    if (!s_lock) {
+        return ESP_ERR_NO_MEM;
+    }
+    s_wake = xTimerCreate("gw_timers", 1, pdFALSE, NULL, wake_cb);
+    if (!s_wake) {
+        vSemaphoreDelete(s_lock);
+        s_lock = NULL;
+        return ESP_ERR_NO_MEM;
+    }
+
+    BaseType_t task_ok = xTaskCreateWithCaps(timers_task,
+                                             "timers",
+                                             GW_TIMERS_TASK_STACK,
+                                             NULL,
+                                             GW_TIMERS_TASK_PRIO,
+                                             &s_task,
+                                             MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    if (task_ok != pdPASS) {
+        task_ok = xTaskCreateWithCaps(timers_task,
+                                      "timers",
+                                      GW_TIMERS_TASK_STACK,
+                                      NULL,
+                                      GW_TIMERS_TASK_PRIO,
+                                      &s_task,
+                                      MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    }
+    if (task_ok != pdPASS) {
+        xTimerDelete(s_wake, 0);
+        vSemaphoreDelete(s_lock);
+        s_wake = NULL;
+        s_lock = NULL;
+        return ESP_FAIL;
+    }
+
+    s_inited = true;
+    ESP_LOGI(TAG, "timer service started (%u ms ticks)", (unsigned)GW_TIMERS_TICK_MS);
+    return ESP_OK;
+}
+
+esp_err_t gw_timers_arm(gw_timer_t *t, uint32_t delay_ms, gw_timer_cb_t cb, void *arg)
+{
+    if (!s_inited) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (!t || !cb) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    xSemaphoreTakeRecursive(s_lock, portMAX_DELAY);
+    gw_timer_wheel_arm(&s_wheel, t, now_ms(), delay_ms, cb, arg);
+    // The new timer is the earliest one iff it is due before the programmed wake-up,
+    // so arming stays O(1) without asking the wheel. Callbacks skip this: the task
+    // reprograms once the whole tick is done.
+    const uint64_t due_ms = t->expires * s_wheel.tick_ms;
+    if (due_ms < s_wake_ms && xTaskGetCurrentTaskHandle() != s_task) {
+        wake_at(due_ms);
+    }
+    xSemaphoreGiveRecursive(s_lock);
+    return ESP_OK;
+}
+
+void gw_timers_cancel(gw_timer_t *t)
+{
+    if (!s_inited || !t) {
+        return;
+    }
+    // A wake-up left for a cancelled timer just finds nothing due.
+    xSemaphoreTakeRecursive(s_lock, portMAX_DELAY);
+    gw_timer_wheel_cancel(&s_wheel, t);
+    xSemaphoreGiveRecursive(s_lock);
+}
+
+bool gw_timers_pending(const gw_timer_t *t)
+{
+    if (!s_inited || !t) {
+        return false;
+    }
+    xSemaphoreTakeRecursive(s_lock, portMAX_DELAY);
+    const bool armed = gw_timer_armed(t);
+    xSemaphoreGiveRecursive(s_lock);
+    return armed;
+}
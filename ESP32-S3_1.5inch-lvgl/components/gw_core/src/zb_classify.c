@@ -206,3 +206,18 @@ size_t gw_zb_endpoint_reports(const gw_zb_endpoint_t *ep, const char **out, size
 
     return copy_items(items, n, out, max_out);
 }
+
+uint16_t gw_zb_endpoint_auto_group(const gw_zb_endpoint_t *ep)
+{
+    if (!ep || !cluster_list_has(ep->in_clusters, ep->in_cluster_count, ZCL_CLUSTER_GROUPS)) {
+        return 0;
+    }
+    // Same split as discovery: an On/Off client is a switch, otherwise an On/Off server is a light.
+    if (cluster_list_has(ep->out_clusters, ep->out_cluster_count, ZCL_CLUSTER_ONOFF)) {
+        return GW_ZB_GROUP_SWITCHES;
+    }
+    if (cluster_list_has(ep->in_clusters, ep->in_cluster_count, ZCL_CLUSTER_ONOFF)) {
+        return GW_ZB_GROUP_LIGHTS;
+    }
+    return 0;
+}
@@ -88,8 +88,136 @@ static bool gw_http_uri_looks_like_asset(const char *uri)
     return (dot != NULL && (slash == NULL || dot > slash));
 }
 
-static esp_err_t gw_http_send_spiffs_file(httpd_req_t *req, const char *uri_path)
+static bool gw_http_accepts_gzip(httpd_req_t *req)
 {
+    char value[128];
+    esp_err_t err = httpd_req_get_hdr_value_str(req, "Accept-Encoding", value, sizeof(value));
+    // A truncated value is still searched; "gzip" is normally listed first.
+    if (err != ESP_OK && err != ESP_ERR_HTTPD_RESULT_TRUNC) {
+        return false;
+    }
+    return strstr(value, "gzip") != NULL;
+}
+
+// A request handed to a REST worker keeps its socket open until the worker answers, and
+// so does every request waiting in the worker queue. Budget one socket for each of those
+// plus the page/asset connection and the WebSocket, so parked requests never push the
+// browser's own connections out through the LRU purge. httpd itself needs three more lwIP
+// sockets (listener, control socket, spare).
+#define GW_HTTP_MAX_OPEN_SOCKETS (CONFIG_GW_HTTP_REST_WORKERS + CONFIG_GW_HTTP_REST_QUEUE_LEN + 2)
+_Static_assert(GW_HTTP_MAX_OPEN_SOCKETS <= CONFIG_LWIP_MAX_SOCKETS - 3,
+               "raise CONFIG_LWIP_MAX_SOCKETS to REST workers + queue length + 5");
+
+// Whole-file cache for the hottest web assets, kept in PSRAM so repeat page loads skip
+// SPIFFS. Entries are keyed by URI path and whether the client accepted gzip, so a hit
+// needs no stat() at all. Least recently used files are evicted to stay under the byte
+// budget. Only touched from the httpd task.
+#define GW_HTTP_CACHE_SLOTS 8
+#define GW_HTTP_CACHE_BUDGET (512 * 1024)
+#define GW_HTTP_CACHE_FILE_MAX (192 * 1024)
+
+typedef struct {
+    char uri[48];
+    bool accept_gzip; // key: the client accepted gzip
+    bool gzip;        // data is the .gz variant
+    uint8_t *data;
+    size_t len;
+    uint32_t last_use;
+} gw_http_cached_file_t;
+
+static gw_http_cached_file_t s_cache[GW_HTTP_CACHE_SLOTS];
+static size_t s_cache_bytes;
+static uint32_t s_cache_clock;
+
+static const gw_http_cached_file_t *gw_http_cache_get(const char *uri, bool accept_gzip)
+{
+    for (size_t i = 0; i < GW_HTTP_CACHE_SLOTS; i++) {
+        if (s_cache[i].data && s_cache[i].accept_gzip == accept_gzip && strcmp(s_cache[i].uri, uri) == 0) {
+            s_cache[i].last_use = ++s_cache_clock;
+            return &s_cache[i];
+        }
+    }
+    return NULL;
+}
+
+static void gw_http_cache_evict(gw_http_cached_file_t *e)
+{
+    s_cache_bytes -= e->len;
+    heap_caps_free(e->data);
+    *e = (gw_http_cached_file_t){0};
+}
+
+// Reads all of `f` (`size` bytes) into a new cache entry. NULL when the file is too big
+// for the cache or PSRAM is short; the caller then streams it instead.
+static const gw_http_cached_file_t *gw_http_cache_load(const char *uri, bool accept_gzip, bool gzip, FILE *f,
+                                                       size_t size)
+{
+    if (size == 0 || size > GW_HTTP_CACHE_FILE_MAX || strlen(uri) >= sizeof(s_cache[0].uri)) {
+        return NULL;
+    }
+    uint8_t *data = (uint8_t *)heap_caps_malloc(size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (!data) {
+        return NULL;
+    }
+    if (fread(data, 1, size, f) != size) {
+        heap_caps_free(data);
+        return NULL;
+    }
+
+    gw_http_cached_file_t *slot = NULL;
+    for (;;) {
+        gw_http_cached_file_t *lru = NULL;
+        slot = NULL;
+        for (size_t i = 0; i < GW_HTTP_CACHE_SLOTS; i++) {
+            if (!s_cache[i].data) {
+                slot = slot ? slot : &s_cache[i];
+            } else if (!lru || s_cache[i].last_use < lru->last_use) {
+                lru = &s_cache[i];
+            }
+        }
+        if (slot && s_cache_bytes + size <= GW_HTTP_CACHE_BUDGET) {
+            break;
+        }
+        gw_http_cache_evict(lru); // size <= budget, so something is cached here
+    }
+
+    strlcpy(slot->uri, uri, sizeof(slot->uri));
+    slot->accept_gzip = accept_gzip;
+    slot->gzip = gzip;
+    slot->data = data;
+    slot->len = size;
+    slot->last_use = ++s_cache_clock;
+    s_cache_bytes += size;
+    return slot;
+}
+
+static void gw_http_set_file_headers(httpd_req_t *req, const char *uri_path, bool gzip)
+{
+    httpd_resp_set_type(req, gw_http_content_type_from_path(uri_path));
+    if (gzip) {
+        httpd_resp_set_hdr(req, "Content-Encoding", "gzip");
+    }
+    httpd_resp_set_hdr(req, "Vary", "Accept-Encoding");
+    // Vite puts content-hashed bundles under /assets/, so they never change in place;
+    // everything else (index.html) must be revalidated to pick up new builds.
+    if (strncmp(uri_path, "/assets/", 8) == 0) {
+        httpd_resp_set_hdr(req, "Cache-Control", "public, max-age=31536000, immutable");
+    } else {
+        httpd_resp_set_hdr(req, "Cache-Control", "no-cache");
+    }
+}
+
+// Serves `uri_path` from the cache, or from SPIFFS on a miss. A file that does not exist
+// gets index.html when `spa_fallback` is set (client-side routes), a 404 otherwise.
+static esp_err_t gw_http_send_spiffs_file(httpd_req_t *req, const char *uri_path, bool spa_fallback)
+{
+    const bool accept_gzip = gw_http_accepts_gzip(req);
+    const gw_http_cached_file_t *cached = gw_http_cache_get(uri_path, accept_gzip);
+    if (cached) {
+        gw_http_set_file_headers(req, uri_path, cached->gzip);
+        return httpd_resp_send(req, (const char *)cached->data, (ssize_t)cached->len);
+    }
+
     if (!s_spiffs_mounted) {
         esp_err_t mnt_err = gw_http_spiffs_init();
         if (mnt_err != ESP_OK) {
@@ -100,18 +228,43 @@ static esp_err_t gw_http_send_spiffs_file(httpd_req_t *req, const char *uri_path
 
     char fullpath[256];
     int n = snprintf(fullpath, sizeof(fullpath), "/www%s", uri_path);
-    if (n <= 0 || n >= (int)sizeof(fullpath)) {
+    if (n <= 0 || n >= (int)sizeof(fullpath) - 3) {
         httpd_resp_send_err(req, HTTPD_414_URI_TOO_LONG, "path too long");
         return ESP_OK;
     }
 
+    // The web build writes a .gz next to each text asset; prefer it when the client
+    // accepts gzip (every browser does).
+    struct stat st;
+    bool gzip = false;
+    if (accept_gzip) {
+        strcat(fullpath, ".gz");
+        gzip = stat(fullpath, &st) == 0 && S_ISREG(st.st_mode);
+        if (!gzip) {
+            fullpath[n] = '\0';
+        }
+    }
+    if (!gzip && (stat(fullpath, &st) != 0 || !S_ISREG(st.st_mode))) {
+        if (spa_fallback) {
+            return gw_http_send_spiffs_file(req, "/index.html", false);
+        }
+        httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "not found");
+        return ESP_OK;
+    }
+
     FILE *f = fopen(fullpath, "rb");
     if (f == NULL) {
         httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "not found");
         return ESP_OK;
     }
+    gw_http_set_file_headers(req, uri_path, gzip);
 
-    httpd_resp_set_type(req, gw_http_content_type_from_path(fullpath));
+    cached = gw_http_cache_load(uri_path, accept_gzip, gzip, f, (size_t)st.st_size);
+    if (cached) {
+        fclose(f);
+        return httpd_resp_send(req, (const char *)cached->data, (ssize_t)cached->len);
+    }
+    rewind(f);
 
     uint8_t buf[1024];
     while (true) {
@@ -137,7 +290,7 @@ static esp_err_t static_get_handler(httpd_req_t *req)
 {
     const char *uri = req->uri;
     if (strcmp(uri, "/") == 0) {
-        return gw_http_send_spiffs_file(req, "/index.html");
+        return gw_http_send_spiffs_file(req, "/index.html", false);
     }
 
     // Strip query (defensive; typically not present in req->uri).
@@ -155,23 +308,8 @@ static esp_err_t static_get_handler(httpd_req_t *req)
         return ESP_OK;
     }
 
-    // If file exists -> serve it.
-    char fullpath[256];
-    n = snprintf(fullpath, sizeof(fullpath), "/www%s", path);
-    if (n > 0 && n < (int)sizeof(fullpath)) {
-        struct stat st;
-        if (stat(fullpath, &st) == 0 && S_ISREG(st.st_mode)) {
-            return gw_http_send_spiffs_file(req, path);
-        }
-    }
-
-    // SPA fallback: if it's not an asset path, serve index.html for client-side routing.
-    if (!gw_http_uri_looks_like_asset(path)) {
-        return gw_http_send_spiffs_file(req, "/index.html");
-    }
-
-    httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "not found");
-    return ESP_OK;
+    // Missing files that are not asset paths are client-side routes: serve index.html.
+    return gw_http_send_spiffs_file(req, path, !gw_http_uri_looks_like_asset(path));
 }
 
 esp_err_t gw_http_start(void)
@@ -186,11 +324,10 @@ esp_err_t gw_http_start(void)
     config.uri_match_fn = httpd_uri_match_wildcard;
     // Keep HTTP below Zigbee/rules so UI traffic cannot delay automations.
     config.task_priority = 4;
-    // Keep room for one browser tab + one WS socket.
-    config.max_open_sockets = 2;
+    config.max_open_sockets = GW_HTTP_MAX_OPEN_SOCKETS;
     config.lru_purge_enable = true;
     // REST + WS + SPA wildcard handlers.
-    config.max_uri_handlers = 20;
+    config.max_uri_handlers = 24;
     // Keep enough stack headroom for SPIFFS/HTTP handlers and flash/cache-critical paths.
     config.stack_size = 5120;
     config.recv_wait_timeout = 4;
@@ -11,7 +11,12 @@
 #include "esp_err.h"
 #include "esp_http_server.h"
 #include "esp_log.h"
+#include "esp_random.h"
 #include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/idf_additions.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
 
 #include "gw_core/action_exec.h"
 #include "gw_core/automation_store.h"
@@ -21,22 +26,55 @@
 #include "gw_core/event_bus.h"
 #include "gw_core/group_store.h"
 #include "gw_core/project_settings.h"
+#include "gw_core/rules_engine.h"
 #include "gw_core/state_store.h"
 #include "gw_zigbee/gw_zigbee.h"
 
 
 #define GW_HTTP_MAX_BODY (16 * 1024)
 #define GW_HTTP_ID_BUFFER 128
+// Window of the chunked CBOR responses: one httpd_resp_send_chunk() per fill.
+#define GW_HTTP_STREAM_WINDOW 1024
+#define GW_HTTP_ETAG_MAX 32
+
+// Slow handlers (UART round-trips, automation compile, big encodes) run on a small worker
+// pool so the httpd task keeps serving static files and WebSocket traffic meanwhile.
+// The worker stacks stay in internal RAM: handlers touch NVS/SPIFFS like httpd does.
+#define GW_REST_WORKERS CONFIG_GW_HTTP_REST_WORKERS
+#define GW_REST_WORK_Q_LEN CONFIG_GW_HTTP_REST_QUEUE_LEN
+#define GW_REST_WORKER_STACK 6144
+#define GW_REST_WORKER_PRIO 4
+
+static const char *TAG = "gw_rest";
+
+typedef esp_err_t (*gw_rest_handler_fn)(httpd_req_t *req);
+
+typedef struct {
+    httpd_req_t *req; // async copy, completed by the worker
+    gw_rest_handler_fn handler;
+} gw_rest_job_t;
+
+static QueueHandle_t s_rest_jobs;
+static TaskHandle_t s_rest_workers[GW_REST_WORKERS];
+
+// Store versions restart on every boot; this salt keeps an ETag cached before a
+// reboot from matching whatever the same version number means now.
+static uint32_t s_etag_boot;
+
+// Rate limit for device flatbuffer resyncs; the handler runs on any REST worker.
+static portMUX_TYPE s_fb_sync_lock = portMUX_INITIALIZER_UNLOCKED;
+static int64_t s_last_fb_sync_us;
 
 static bool gw_http_percent_decode(const char *src, char *dst, size_t dst_size);
 static bool gw_http_extract_id(const char *uri, const char *prefix, char *out, size_t out_size);
 static esp_err_t gw_http_recv_body(httpd_req_t *req, uint8_t **out_buf, size_t *out_len);
 static esp_err_t gw_http_send_cbor_payload(httpd_req_t *req, const uint8_t *buf, size_t len);
 static esp_err_t gw_action_exec_from_cbor(const uint8_t *buf, size_t len, char *err, size_t err_size);
-static const char *automation_string_at(const gw_automation_entry_t *entry, uint32_t off);
 static const char *automation_evt_type_to_str(uint8_t type);
 static const char *automation_op_to_str(uint8_t op);
-static esp_err_t cbor_write_automation_definition(gw_cbor_writer_t *w, const gw_automation_entry_t *entry);
+static esp_err_t cbor_write_automation_definition(gw_cbor_writer_t *w,
+                                                  const gw_auto_compiled_t *set,
+                                                  const gw_auto_bin_automation_v2_t *a);
 static esp_err_t api_devices_flatbuffer_get_handler(httpd_req_t *req);
 static esp_err_t api_devices_post_handler(httpd_req_t *req);
 static esp_err_t api_devices_remove_post_handler(httpd_req_t *req);
@@ -46,7 +84,9 @@ static esp_err_t api_automation_detail_patch_handler(httpd_req_t *req);
 static esp_err_t api_automation_detail_delete_handler(httpd_req_t *req);
 static esp_err_t api_automation_post_handler(httpd_req_t *req);
 static esp_err_t api_actions_post_handler(httpd_req_t *req);
+static esp_err_t api_actions_batch_post_handler(httpd_req_t *req);
 static esp_err_t api_state_get_handler(httpd_req_t *req);
+static esp_err_t api_rules_stats_get_handler(httpd_req_t *req);
 static esp_err_t api_groups_get_handler(httpd_req_t *req);
 static esp_err_t api_groups_post_handler(httpd_req_t *req);
 static esp_err_t api_group_items_get_handler(httpd_req_t *req);
@@ -56,6 +96,78 @@ static esp_err_t api_settings_post_handler(httpd_req_t *req);
 static esp_err_t gw_http_send_group_store_error(httpd_req_t *req, esp_err_t err, const char *not_found_msg, const char *no_mem_msg);
 static esp_err_t gw_http_send_cbor_ok(httpd_req_t *req);
 
+static bool gw_rest_on_worker(void)
+{
+    const TaskHandle_t self = xTaskGetCurrentTaskHandle();
+    for (size_t i = 0; i < GW_REST_WORKERS; i++) {
+        if (s_rest_workers[i] == self) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void gw_rest_worker_task(void *arg)
+{
+    (void)arg;
+    gw_rest_job_t job;
+    for (;;) {
+        if (xQueueReceive(s_rest_jobs, &job, portMAX_DELAY) != pdTRUE) {
+            continue;
+        }
+        (void)job.handler(job.req);
+        if (httpd_req_async_handler_complete(job.req) != ESP_OK) {
+            ESP_LOGW(TAG, "async request complete failed");
+        }
+    }
+}
+
+static esp_err_t gw_rest_workers_start(void)
+{
+    if (s_rest_jobs) {
+        return ESP_OK;
+    }
+    s_rest_jobs = xQueueCreate(GW_REST_WORK_Q_LEN, sizeof(gw_rest_job_t));
+    if (!s_rest_jobs) {
+        return ESP_ERR_NO_MEM;
+    }
+    for (size_t i = 0; i < GW_REST_WORKERS; i++) {
+        char name[16];
+        (void)snprintf(name, sizeof(name), "rest_w%u", (unsigned)i);
+        if (xTaskCreateWithCaps(gw_rest_worker_task, name, GW_REST_WORKER_STACK, NULL, GW_REST_WORKER_PRIO,
+                                &s_rest_workers[i], MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT) != pdPASS) {
+            // The ones already running keep serving; none at all means handlers run inline.
+            ESP_LOGW(TAG, "rest worker %u not started", (unsigned)i);
+            break;
+        }
+    }
+    return ESP_OK;
+}
+
+// First line of a slow handler: on the httpd task, hand the request to a worker that
+// calls `handler` again; on a worker (or without one) just run it. A full queue gets
+// 503 + Retry-After instead of stalling the server. Returns true when the request has
+// been taken care of here.
+static bool gw_rest_defer(httpd_req_t *req, gw_rest_handler_fn handler)
+{
+    if (gw_rest_on_worker() || !s_rest_jobs || !s_rest_workers[0]) {
+        return false;
+    }
+    if (uxQueueSpacesAvailable(s_rest_jobs) == 0) {
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        httpd_resp_set_hdr(req, "Retry-After", "1");
+        httpd_resp_send(req, "busy", HTTPD_RESP_USE_STRLEN);
+        return true;
+    }
+    gw_rest_job_t job = {.handler = handler};
+    if (httpd_req_async_handler_begin(req, &job.req) != ESP_OK) {
+        return false;
+    }
+    // Only the httpd task enqueues, so the space checked above is still there.
+    (void)xQueueSend(s_rest_jobs, &job, 0);
+    return true;
+}
+
 static int hex_digit(int c)
 {
     if (c >= '0' && c <= '9') {
@@ -169,6 +281,58 @@ static esp_err_t gw_http_send_cbor_payload(httpd_req_t *req, const uint8_t *buf,
     return httpd_resp_send(req, (const char *)buf, len);
 }
 
+static esp_err_t gw_http_chunk_sink(void *ctx, const uint8_t *data, size_t len)
+{
+    return httpd_resp_send_chunk((httpd_req_t *)ctx, (const char *)data, len);
+}
+
+// Chunked CBOR response: peak memory is one window, whatever the document size.
+static void gw_http_stream_begin(httpd_req_t *req, gw_cbor_writer_t *w)
+{
+    httpd_resp_set_type(req, "application/cbor");
+    gw_cbor_writer_init_stream(w, GW_HTTP_STREAM_WINDOW, gw_http_chunk_sink, req);
+}
+
+// Flush the tail and close the chunked response. Once the first chunk is out the
+// status line is gone too, so a later failure can only abort the connection.
+static esp_err_t gw_http_stream_end(httpd_req_t *req, gw_cbor_writer_t *w, esp_err_t rc)
+{
+    if (rc == ESP_OK) rc = gw_cbor_writer_flush(w);
+    if (rc == ESP_OK) rc = httpd_resp_send_chunk(req, NULL, 0);
+    const size_t flushed = w->flushed;
+    gw_cbor_writer_free(w);
+    if (rc == ESP_OK) {
+        return ESP_OK;
+    }
+    if (flushed == 0) {
+        return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "cbor encode failure");
+    }
+    return ESP_FAIL;
+}
+
+// Conditional GET on a store's content version. When If-None-Match already names
+// the current version a bare 304 goes out and this returns true; otherwise the ETag
+// is set on the response to come. `etag` must outlive the response (httpd keeps the
+// pointer), and `version` must be read before the data it describes.
+static bool gw_http_not_modified(httpd_req_t *req, char kind, uint32_t version, char *etag, size_t etag_size)
+{
+    (void)snprintf(etag, etag_size, "\"%08x-%c%u\"", (unsigned)s_etag_boot, kind, (unsigned)version);
+    httpd_resp_set_hdr(req, "ETag", etag);
+    // Cacheable, but revalidated on every use: the data behind it changes at any time.
+    httpd_resp_set_hdr(req, "Cache-Control", "no-cache");
+
+    char inm[96];
+    if (httpd_req_get_hdr_value_str(req, "If-None-Match", inm, sizeof(inm)) != ESP_OK) {
+        return false;
+    }
+    if (strcmp(inm, "*") != 0 && strstr(inm, etag) == NULL) {
+        return false;
+    }
+    httpd_resp_set_status(req, "304 Not Modified");
+    httpd_resp_send(req, NULL, 0);
+    return true;
+}
+
 static esp_err_t gw_action_exec_from_cbor(const uint8_t *buf, size_t len, char *err, size_t err_size)
 {
     if (!buf || len == 0) {
@@ -219,44 +383,6 @@ static bool cbor_slice_to_u8(const gw_cbor_slice_t *s, uint8_t *out)
     return true;
 }
 
-static bool cbor_slice_to_i32(const gw_cbor_slice_t *s, int32_t *out)
-{
-    if (!s || !out) return false;
-    int64_t iv = 0;
-    if (gw_cbor_slice_to_i64(s, &iv) && iv >= INT32_MIN && iv <= INT32_MAX) {
-        *out = (int32_t)iv;
-        return true;
-    }
-    uint64_t uv = 0;
-    if (gw_cbor_slice_to_u64(s, &uv) && uv <= INT32_MAX) {
-        *out = (int32_t)uv;
-        return true;
-    }
-    return false;
-}
-
-static bool cbor_slice_to_bool(const gw_cbor_slice_t *s, bool *out)
-{
-    if (!s || !out || !s->ptr || s->len == 0) {
-        return false;
-    }
-    gw_cbor_reader_t r;
-    gw_cbor_reader_init(&r, s->ptr, s->len);
-    uint8_t b = 0;
-    if (!gw_cbor_read_u8(&r, &b)) {
-        return false;
-    }
-    if (b == 0xf4) {
-        *out = false;
-        return true;
-    }
-    if (b == 0xf5) {
-        *out = true;
-        return true;
-    }
-    return false;
-}
-
 static bool cbor_array_slices(const gw_cbor_slice_t *arr, gw_cbor_slice_t **out_items, uint32_t *out_count)
 {
     if (!arr || !out_items || !out_count || !arr->ptr || arr->len == 0) return false;
@@ -295,14 +421,6 @@ static bool cbor_array_slices(const gw_cbor_slice_t *arr, gw_cbor_slice_t **out_
     return true;
 }
 
-static const char *automation_string_at(const gw_automation_entry_t *entry, uint32_t off)
-{
-    if (!entry || off == 0 || off >= entry->string_table_size) {
-        return "";
-    }
-    return entry->string_table + off;
-}
-
 static const char *automation_evt_type_to_str(uint8_t type)
 {
     switch (type) {
@@ -355,11 +473,43 @@ static esp_err_t cbor_write_hex16_key(gw_cbor_writer_t *w, const char *key, uint
     return gw_cbor_writer_text(w, buf);
 }
 
+// {"type":"time","at":"HH:MM"[,"days":[...]]}, see compile_time_trigger().
+static esp_err_t cbor_write_time_trigger(gw_cbor_writer_t *w, const gw_auto_bin_trigger_v2_t *trigger)
+{
+    char at[8];
+    snprintf(at, sizeof(at), "%02u:%02u", (unsigned)(trigger->attr_id / 60u) % 24u, (unsigned)(trigger->attr_id % 60u));
+    uint8_t days = 0;
+    for (unsigned d = 0; d < 7; d++) {
+        if (trigger->endpoint & (1u << d)) days++;
+    }
+
+    esp_err_t rc = gw_cbor_writer_map(w, days ? 3 : 2);
+    if (rc != ESP_OK) return rc;
+    rc = gw_cbor_writer_text(w, "type");
+    if (rc != ESP_OK) return rc;
+    rc = gw_cbor_writer_text(w, "time");
+    if (rc != ESP_OK) return rc;
+    rc = gw_cbor_writer_text(w, "at");
+    if (rc != ESP_OK) return rc;
+    rc = gw_cbor_writer_text(w, at);
+    if (rc != ESP_OK || !days) return rc;
+    rc = gw_cbor_writer_text(w, "days");
+    if (rc != ESP_OK) return rc;
+    rc = gw_cbor_writer_array(w, days);
+    for (unsigned d = 0; d < 7 && rc == ESP_OK; d++) {
+        if (trigger->endpoint & (1u << d)) rc = gw_cbor_writer_u64(w, d);
+    }
+    return rc;
+}
+
 static esp_err_t cbor_write_automation_trigger(gw_cbor_writer_t *w,
                                               const gw_auto_bin_trigger_v2_t *trigger,
-                                              const gw_automation_entry_t *entry)
+                                              const gw_auto_compiled_t *set)
 {
-    if (!w || !trigger || !entry) return ESP_ERR_INVALID_ARG;
+    if (!w || !trigger || !set) return ESP_ERR_INVALID_ARG;
+    if (trigger->event_type == GW_AUTO_EVT_TIME) {
+        return cbor_write_time_trigger(w, trigger);
+    }
 
     uint8_t match_pairs = 0;
     if (trigger->device_uid_off) match_pairs++;
@@ -372,7 +522,7 @@ static esp_err_t cbor_write_automation_trigger(gw_cbor_writer_t *w,
         if (trigger->attr_id) match_pairs++;
     }
 
-    esp_err_t rc = gw_cbor_writer_map(w, 3);
+    esp_err_t rc = gw_cbor_writer_map(w, trigger->for_s ? 4 : 3);
     if (rc != ESP_OK) return rc;
     rc = gw_cbor_writer_text(w, "type");
     if (rc != ESP_OK) return rc;
@@ -382,6 +532,12 @@ static esp_err_t cbor_write_automation_trigger(gw_cbor_writer_t *w,
     if (rc != ESP_OK) return rc;
     rc = gw_cbor_writer_text(w, automation_evt_type_to_str(trigger->event_type));
     if (rc != ESP_OK) return rc;
+    if (trigger->for_s) {
+        rc = gw_cbor_writer_text(w, "for_s");
+        if (rc != ESP_OK) return rc;
+        rc = gw_cbor_writer_u64(w, trigger->for_s);
+        if (rc != ESP_OK) return rc;
+    }
     rc = gw_cbor_writer_text(w, "match");
     if (rc != ESP_OK) return rc;
     rc = gw_cbor_writer_map(w, match_pairs);
@@ -390,7 +546,7 @@ static esp_err_t cbor_write_automation_trigger(gw_cbor_writer_t *w,
     if (trigger->device_uid_off) {
         rc = gw_cbor_writer_text(w, "device_uid");
         if (rc != ESP_OK) return rc;
-        rc = gw_cbor_writer_text(w, automation_string_at(entry, trigger->device_uid_off));
+        rc = gw_cbor_writer_text(w, gw_auto_compiled_str(set, trigger->device_uid_off));
         if (rc != ESP_OK) return rc;
     }
     if (trigger->endpoint) {
@@ -403,7 +559,7 @@ static esp_err_t cbor_write_automation_trigger(gw_cbor_writer_t *w,
         if (trigger->cmd_off) {
             rc = gw_cbor_writer_text(w, "payload.cmd");
             if (rc != ESP_OK) return rc;
-            rc = gw_cbor_writer_text(w, automation_string_at(entry, trigger->cmd_off));
+            rc = gw_cbor_writer_text(w, gw_auto_compiled_str(set, trigger->cmd_off));
             if (rc != ESP_OK) return rc;
         }
         if (trigger->cluster_id) {
@@ -425,9 +581,9 @@ static esp_err_t cbor_write_automation_trigger(gw_cbor_writer_t *w,
 
 static esp_err_t cbor_write_automation_condition(gw_cbor_writer_t *w,
                                                 const gw_auto_bin_condition_v2_t *cond,
-                                                const gw_automation_entry_t *entry)
+                                                const gw_auto_compiled_t *set)
 {
-    if (!w || !cond || !entry) return ESP_ERR_INVALID_ARG;
+    if (!w || !cond || !set) return ESP_ERR_INVALID_ARG;
 
     esp_err_t rc = gw_cbor_writer_map(w, 4);
     if (rc != ESP_OK) return rc;
@@ -445,11 +601,11 @@ static esp_err_t cbor_write_automation_condition(gw_cbor_writer_t *w,
     if (rc != ESP_OK) return rc;
     rc = gw_cbor_writer_text(w, "device_uid");
     if (rc != ESP_OK) return rc;
-    rc = gw_cbor_writer_text(w, automation_string_at(entry, cond->device_uid_off));
+    rc = gw_cbor_writer_text(w, gw_auto_compiled_str(set, cond->device_uid_off));
     if (rc != ESP_OK) return rc;
     rc = gw_cbor_writer_text(w, "key");
     if (rc != ESP_OK) return rc;
-    rc = gw_cbor_writer_text(w, automation_string_at(entry, cond->key_off));
+    rc = gw_cbor_writer_text(w, gw_auto_compiled_str(set, cond->key_off));
     if (rc != ESP_OK) return rc;
     rc = gw_cbor_writer_text(w, "value");
     if (rc != ESP_OK) return rc;
@@ -463,10 +619,23 @@ static esp_err_t cbor_write_automation_condition(gw_cbor_writer_t *w,
 
 static esp_err_t cbor_write_automation_action(gw_cbor_writer_t *w,
                                              const gw_auto_bin_action_v2_t *action,
-                                             const gw_automation_entry_t *entry)
+                                             const gw_auto_compiled_t *set)
 {
-    if (!w || !action || !entry) return ESP_ERR_INVALID_ARG;
-    const char *cmd = automation_string_at(entry, action->cmd_off);
+    if (!w || !action || !set) return ESP_ERR_INVALID_ARG;
+    const char *cmd = gw_auto_compiled_str(set, action->cmd_off);
+
+    if (action->kind == GW_AUTO_ACT_DELAY) {
+        esp_err_t rc = gw_cbor_writer_map(w, 2);
+        if (rc != ESP_OK) return rc;
+        rc = gw_cbor_writer_text(w, "type");
+        if (rc != ESP_OK) return rc;
+        rc = gw_cbor_writer_text(w, "delay");
+        if (rc != ESP_OK) return rc;
+        rc = gw_cbor_writer_text(w, "ms");
+        if (rc != ESP_OK) return rc;
+        return gw_cbor_writer_u64(w, action->arg0_u32);
+    }
+    const bool level_cmd = strcmp(cmd, "level.move_to_level") == 0 || strcmp(cmd, "level.move_to_level_with_on_off") == 0;
 
     uint8_t pairs = 2; // type, cmd
     if (action->kind == GW_AUTO_ACT_BIND) {
@@ -475,12 +644,12 @@ static esp_err_t cbor_write_automation_action(gw_cbor_writer_t *w,
         pairs += 2;
     } else if (action->kind == GW_AUTO_ACT_GROUP) {
         pairs += 1;
-        if (strcmp(cmd, "level.move_to_level") == 0) pairs += 2;
+        if (level_cmd) pairs += 2;
         else if (strcmp(cmd, "color.move_to_color_xy") == 0) pairs += 3;
         else if (strcmp(cmd, "color.move_to_color_temperature") == 0) pairs += 2;
     } else if (action->kind == GW_AUTO_ACT_DEVICE) {
         pairs += 2;
-        if (strcmp(cmd, "level.move_to_level") == 0) pairs += 2;
+        if (level_cmd) pairs += 2;
         else if (strcmp(cmd, "color.move_to_color_xy") == 0) pairs += 3;
         else if (strcmp(cmd, "color.move_to_color_temperature") == 0) pairs += 2;
     }
@@ -499,7 +668,7 @@ static esp_err_t cbor_write_automation_action(gw_cbor_writer_t *w,
     if (action->kind == GW_AUTO_ACT_BIND) {
         rc = gw_cbor_writer_text(w, "src_device_uid");
         if (rc != ESP_OK) return rc;
-        rc = gw_cbor_writer_text(w, automation_string_at(entry, action->uid_off));
+        rc = gw_cbor_writer_text(w, gw_auto_compiled_str(set, action->uid_off));
         if (rc != ESP_OK) return rc;
         rc = gw_cbor_writer_text(w, "src_endpoint");
         if (rc != ESP_OK) return rc;
@@ -509,7 +678,7 @@ static esp_err_t cbor_write_automation_action(gw_cbor_writer_t *w,
         if (rc != ESP_OK) return rc;
         rc = gw_cbor_writer_text(w, "dst_device_uid");
         if (rc != ESP_OK) return rc;
-        rc = gw_cbor_writer_text(w, automation_string_at(entry, action->uid2_off));
+        rc = gw_cbor_writer_text(w, gw_auto_compiled_str(set, action->uid2_off));
         if (rc != ESP_OK) return rc;
         rc = gw_cbor_writer_text(w, "dst_endpoint");
         if (rc != ESP_OK) return rc;
@@ -530,7 +699,7 @@ static esp_err_t cbor_write_automation_action(gw_cbor_writer_t *w,
     if (action->kind == GW_AUTO_ACT_GROUP) {
         rc = cbor_write_hex16_key(w, "group_id", action->u16_0);
         if (rc != ESP_OK) return rc;
-        if (strcmp(cmd, "level.move_to_level") == 0) {
+        if (level_cmd) {
             rc = gw_cbor_writer_text(w, "level");
             if (rc != ESP_OK) return rc;
             rc = gw_cbor_writer_u64(w, action->arg0_u32);
@@ -570,13 +739,13 @@ static esp_err_t cbor_write_automation_action(gw_cbor_writer_t *w,
     if (action->kind == GW_AUTO_ACT_DEVICE) {
         rc = gw_cbor_writer_text(w, "device_uid");
         if (rc != ESP_OK) return rc;
-        rc = gw_cbor_writer_text(w, automation_string_at(entry, action->uid_off));
+        rc = gw_cbor_writer_text(w, gw_auto_compiled_str(set, action->uid_off));
         if (rc != ESP_OK) return rc;
         rc = gw_cbor_writer_text(w, "endpoint");
         if (rc != ESP_OK) return rc;
         rc = gw_cbor_writer_u64(w, action->endpoint);
         if (rc != ESP_OK) return rc;
-        if (strcmp(cmd, "level.move_to_level") == 0) {
+        if (level_cmd) {
             rc = gw_cbor_writer_text(w, "level");
             if (rc != ESP_OK) return rc;
             rc = gw_cbor_writer_u64(w, action->arg0_u32);
@@ -614,11 +783,13 @@ static esp_err_t cbor_write_automation_action(gw_cbor_writer_t *w,
     return ESP_OK;
 }
 
-static esp_err_t cbor_write_automation_definition(gw_cbor_writer_t *w, const gw_automation_entry_t *entry)
+static esp_err_t cbor_write_automation_definition(gw_cbor_writer_t *w,
+                                                  const gw_auto_compiled_t *set,
+                                                  const gw_auto_bin_automation_v2_t *a)
 {
-    if (!w || !entry) return ESP_ERR_INVALID_ARG;
+    if (!w || !set || !a) return ESP_ERR_INVALID_ARG;
 
-    esp_err_t rc = gw_cbor_writer_map(w, 8);
+    esp_err_t rc = gw_cbor_writer_map(w, 11);
     if (rc != ESP_OK) return rc;
     rc = gw_cbor_writer_text(w, "v");
     if (rc != ESP_OK) return rc;
@@ -626,45 +797,57 @@ static esp_err_t cbor_write_automation_definition(gw_cbor_writer_t *w, const gw_
     if (rc != ESP_OK) return rc;
     rc = gw_cbor_writer_text(w, "id");
     if (rc != ESP_OK) return rc;
-    rc = gw_cbor_writer_text(w, entry->id);
+    rc = gw_cbor_writer_text(w, gw_auto_compiled_str(set, a->id_off));
     if (rc != ESP_OK) return rc;
     rc = gw_cbor_writer_text(w, "name");
     if (rc != ESP_OK) return rc;
-    rc = gw_cbor_writer_text(w, entry->name);
+    rc = gw_cbor_writer_text(w, gw_auto_compiled_str(set, a->name_off));
     if (rc != ESP_OK) return rc;
     rc = gw_cbor_writer_text(w, "enabled");
     if (rc != ESP_OK) return rc;
-    rc = gw_cbor_writer_bool(w, entry->enabled);
+    rc = gw_cbor_writer_bool(w, a->enabled != 0);
     if (rc != ESP_OK) return rc;
     rc = gw_cbor_writer_text(w, "mode");
     if (rc != ESP_OK) return rc;
-    rc = gw_cbor_writer_text(w, "single");
+    rc = gw_cbor_writer_text(w, gw_auto_mode_to_str(a->mode));
+    if (rc != ESP_OK) return rc;
+    rc = gw_cbor_writer_text(w, "max_runs");
+    if (rc != ESP_OK) return rc;
+    rc = gw_cbor_writer_u64(w, a->max_runs);
+    if (rc != ESP_OK) return rc;
+    rc = gw_cbor_writer_text(w, "debounce_ms");
+    if (rc != ESP_OK) return rc;
+    rc = gw_cbor_writer_u64(w, a->debounce_ms);
+    if (rc != ESP_OK) return rc;
+    rc = gw_cbor_writer_text(w, "throttle_ms");
+    if (rc != ESP_OK) return rc;
+    rc = gw_cbor_writer_u64(w, a->throttle_ms);
     if (rc != ESP_OK) return rc;
 
     rc = gw_cbor_writer_text(w, "triggers");
     if (rc != ESP_OK) return rc;
-    rc = gw_cbor_writer_array(w, entry->triggers_count);
+    rc = gw_cbor_writer_array(w, a->triggers_count);
     if (rc != ESP_OK) return rc;
-    for (uint8_t i = 0; i < entry->triggers_count; i++) {
-        rc = cbor_write_automation_trigger(w, &entry->triggers[i], entry);
+    for (uint32_t i = 0; i < a->triggers_count; i++) {
+        rc = cbor_write_automation_trigger(w, &set->triggers[a->triggers_index + i], set);
         if (rc != ESP_OK) return rc;
     }
 
     rc = gw_cbor_writer_text(w, "conditions");
     if (rc != ESP_OK) return rc;
-    rc = gw_cbor_writer_array(w, entry->conditions_count);
+    rc = gw_cbor_writer_array(w, a->conditions_count);
     if (rc != ESP_OK) return rc;
-    for (uint8_t i = 0; i < entry->conditions_count; i++) {
-        rc = cbor_write_automation_condition(w, &entry->conditions[i], entry);
+    for (uint32_t i = 0; i < a->conditions_count; i++) {
+        rc = cbor_write_automation_condition(w, &set->conditions[a->conditions_index + i], set);
         if (rc != ESP_OK) return rc;
     }
 
     rc = gw_cbor_writer_text(w, "actions");
     if (rc != ESP_OK) return rc;
-    rc = gw_cbor_writer_array(w, entry->actions_count);
+    rc = gw_cbor_writer_array(w, a->actions_count);
     if (rc != ESP_OK) return rc;
-    for (uint8_t i = 0; i < entry->actions_count; i++) {
-        rc = cbor_write_automation_action(w, &entry->actions[i], entry);
+    for (uint32_t i = 0; i < a->actions_count; i++) {
+        rc = cbor_write_automation_action(w, &set->actions[a->actions_index + i], set);
         if (rc != ESP_OK) return rc;
     }
 
@@ -673,7 +856,14 @@ static esp_err_t cbor_write_automation_definition(gw_cbor_writer_t *w, const gw_
 
 static esp_err_t api_devices_flatbuffer_get_handler(httpd_req_t *req)
 {
-    static int64_t s_last_fb_sync_us = 0;
+    if (gw_rest_defer(req, api_devices_flatbuffer_get_handler)) {
+        return ESP_OK;
+    }
+    char etag[GW_HTTP_ETAG_MAX];
+    const uint32_t version = gw_device_fb_store_version();
+    if (version != 0 && gw_http_not_modified(req, 'd', version, etag, sizeof(etag))) {
+        return ESP_OK;
+    }
     size_t len = 0;
     uint8_t *buf = NULL;
     if (gw_device_fb_store_copy(&buf, &len) != ESP_OK || !buf || len == 0) {
@@ -681,9 +871,16 @@ static esp_err_t api_devices_flatbuffer_get_handler(httpd_req_t *req)
             free(buf);
             buf = NULL;
         }
+        // Check and claim the slot in one step so two workers never both start a sync.
         int64_t now_us = esp_timer_get_time();
+        bool sync = false;
+        portENTER_CRITICAL(&s_fb_sync_lock);
         if (now_us - s_last_fb_sync_us > 1000000) {
             s_last_fb_sync_us = now_us;
+            sync = true;
+        }
+        portEXIT_CRITICAL(&s_fb_sync_lock);
+        if (sync) {
             (void)gw_zigbee_sync_device_fb();
         }
         httpd_resp_set_status(req, "202 Accepted");
@@ -701,6 +898,9 @@ static esp_err_t api_devices_flatbuffer_get_handler(httpd_req_t *req)
 
 static esp_err_t api_devices_post_handler(httpd_req_t *req)
 {
+    if (gw_rest_defer(req, api_devices_post_handler)) {
+        return ESP_OK;
+    }
     // Body (CBOR): { device_uid: string, name: string }
     uint8_t *buf = NULL;
     size_t len = 0;
@@ -761,6 +961,9 @@ static esp_err_t api_devices_post_handler(httpd_req_t *req)
 
 static esp_err_t api_devices_remove_post_handler(httpd_req_t *req)
 {
+    if (gw_rest_defer(req, api_devices_remove_post_handler)) {
+        return ESP_OK;
+    }
     // Body (CBOR): { device_uid: string }
     uint8_t *buf = NULL;
     size_t len = 0;
@@ -836,6 +1039,9 @@ static esp_err_t gw_http_send_cbor_ok(httpd_req_t *req)
 
 static esp_err_t api_network_permit_join_post_handler(httpd_req_t *req)
 {
+    if (gw_rest_defer(req, api_network_permit_join_post_handler)) {
+        return ESP_OK;
+    }
     // Body (CBOR): { seconds?: number } (default 180)
     uint8_t seconds = 180;
     uint8_t *buf = NULL;
@@ -876,54 +1082,60 @@ static esp_err_t api_network_permit_join_post_handler(httpd_req_t *req)
 
 static esp_err_t api_automations_get_handler(httpd_req_t *req)
 {
-    const size_t max_autos = 32;
-    gw_automation_meta_t *metas = (gw_automation_meta_t *)calloc(max_autos, sizeof(gw_automation_meta_t));
-    if (!metas) {
-        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "out of memory");
+    if (gw_rest_defer(req, api_automations_get_handler)) {
         return ESP_OK;
     }
-    size_t count = gw_automation_store_list_meta(metas, max_autos);
+    const gw_auto_compiled_t *set = gw_automation_store_acquire();
+    if (!set) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "automations not ready");
+        return ESP_OK;
+    }
+    char etag[GW_HTTP_ETAG_MAX];
+    if (gw_http_not_modified(req, 'a', gw_automation_store_version(set), etag, sizeof(etag))) {
+        gw_automation_store_release(set);
+        return ESP_OK;
+    }
+    const size_t count = set->hdr.automation_count;
     gw_cbor_writer_t w;
-    gw_cbor_writer_init(&w);
+    gw_http_stream_begin(req, &w);
     esp_err_t rc = gw_cbor_writer_map(&w, 1);
     if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, "automations");
     if (rc == ESP_OK) rc = gw_cbor_writer_array(&w, count);
     if (rc == ESP_OK) {
         for (size_t i = 0; i < count; i++) {
-            const gw_automation_meta_t *meta = &metas[i];
-            gw_automation_entry_t entry = {0};
-            rc = gw_automation_store_get(meta->id, &entry);
-            if (rc != ESP_OK) break;
+            const gw_auto_bin_automation_v2_t *a = &set->autos[i];
 
             rc = gw_cbor_writer_map(&w, 4);
             if (rc != ESP_OK) break;
             rc = gw_cbor_writer_text(&w, "id");
             if (rc != ESP_OK) break;
-            rc = gw_cbor_writer_text(&w, entry.id);
+            rc = gw_cbor_writer_text(&w, gw_auto_compiled_str(set, a->id_off));
             if (rc != ESP_OK) break;
             rc = gw_cbor_writer_text(&w, "name");
             if (rc != ESP_OK) break;
-            rc = gw_cbor_writer_text(&w, entry.name);
+            rc = gw_cbor_writer_text(&w, gw_auto_compiled_str(set, a->name_off));
             if (rc != ESP_OK) break;
             rc = gw_cbor_writer_text(&w, "enabled");
             if (rc != ESP_OK) break;
-            rc = gw_cbor_writer_bool(&w, entry.enabled);
+            rc = gw_cbor_writer_bool(&w, a->enabled != 0);
             if (rc != ESP_OK) break;
             rc = gw_cbor_writer_text(&w, "automation");
             if (rc != ESP_OK) break;
-            rc = cbor_write_automation_definition(&w, &entry);
+            rc = cbor_write_automation_definition(&w, set, a);
             if (rc != ESP_OK) break;
         }
     }
-    free(metas);
-    esp_err_t send_err = (rc == ESP_OK) ? gw_http_send_cbor_payload(req, w.buf, w.len)
-                                       : httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "cbor encode failure");
-    gw_cbor_writer_free(&w);
+    // The set stays pinned while chunks go out; the store just keeps this generation.
+    esp_err_t send_err = gw_http_stream_end(req, &w, rc);
+    gw_automation_store_release(set);
     return send_err;
 }
 
 static esp_err_t api_automation_detail_patch_handler(httpd_req_t *req)
 {
+    if (gw_rest_defer(req, api_automation_detail_patch_handler)) {
+        return ESP_OK;
+    }
     char id_buf[GW_AUTOMATION_ID_MAX] = {0};
     if (!gw_http_extract_id(req->uri, "/api/automations", id_buf, sizeof(id_buf))) {
         httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "missing automation id");
@@ -965,6 +1177,9 @@ static esp_err_t api_automation_detail_patch_handler(httpd_req_t *req)
 
 static esp_err_t api_automation_detail_delete_handler(httpd_req_t *req)
 {
+    if (gw_rest_defer(req, api_automation_detail_delete_handler)) {
+        return ESP_OK;
+    }
     char id_buf[GW_AUTOMATION_ID_MAX] = {0};
     if (!gw_http_extract_id(req->uri, "/api/automations", id_buf, sizeof(id_buf))) {
         httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "missing automation id");
@@ -990,6 +1205,9 @@ static esp_err_t api_automation_detail_delete_handler(httpd_req_t *req)
 
 static esp_err_t api_automation_post_handler(httpd_req_t *req)
 {
+    if (gw_rest_defer(req, api_automation_post_handler)) {
+        return ESP_OK;
+    }
     uint8_t *buf = NULL;
     size_t len = 0;
     if (gw_http_recv_body(req, &buf, &len) != ESP_OK) {
@@ -1043,6 +1261,9 @@ static esp_err_t api_automation_post_handler(httpd_req_t *req)
 
 static esp_err_t api_actions_post_handler(httpd_req_t *req)
 {
+    if (gw_rest_defer(req, api_actions_post_handler)) {
+        return ESP_OK;
+    }
     uint8_t *buf = NULL;
     size_t len = 0;
     if (gw_http_recv_body(req, &buf, &len) != ESP_OK) {
@@ -1096,81 +1317,290 @@ static esp_err_t api_actions_post_handler(httpd_req_t *req)
     return send_err;
 }
 
+// Body: { "actions": [ ... ] } or the bare array. Every entry gets its own result; the
+// request itself only fails when the batch cannot run at all.
+static esp_err_t api_actions_batch_post_handler(httpd_req_t *req)
+{
+    if (gw_rest_defer(req, api_actions_batch_post_handler)) {
+        return ESP_OK;
+    }
+    uint8_t *buf = NULL;
+    size_t len = 0;
+    if (gw_http_recv_body(req, &buf, &len) != ESP_OK) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "invalid cbor");
+        return ESP_OK;
+    }
+    gw_cbor_slice_t actions_s = {.ptr = buf, .len = len};
+    if ((buf[0] >> 5) == 5 && !cbor_map_find_val_buf(buf, len, "actions", &actions_s)) {
+        free(buf);
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "missing actions");
+        return ESP_OK;
+    }
+    gw_cbor_slice_t *items = NULL;
+    uint32_t count = 0;
+    if (!cbor_array_slices(&actions_s, &items, &count)) {
+        free(buf);
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "actions must be array");
+        return ESP_OK;
+    }
+    if (count == 0 || count > GW_ACTION_BATCH_MAX) {
+        free(items);
+        free(buf);
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "actions: 1..64 entries");
+        return ESP_OK;
+    }
+
+    gw_action_result_t *results = (gw_action_result_t *)calloc(count, sizeof(*results));
+    if (!results) {
+        free(items);
+        free(buf);
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "no mem");
+        return ESP_OK;
+    }
+    uint32_t frames = 0;
+    esp_err_t err = gw_action_exec_batch_cbor(items, count, results, &frames);
+    free(items);
+    free(buf);
+    if (err != ESP_OK && err != ESP_ERR_TIMEOUT) {
+        free(results);
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "batch failed");
+        return ESP_OK;
+    }
+
+    bool all_ok = true;
+    for (uint32_t i = 0; i < count; i++) {
+        all_ok = all_ok && results[i].rc == ESP_OK;
+    }
+    gw_cbor_writer_t w;
+    gw_cbor_writer_init(&w);
+    esp_err_t rc = gw_cbor_writer_map(&w, 3);
+    if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, "ok");
+    if (rc == ESP_OK) rc = gw_cbor_writer_bool(&w, all_ok);
+    if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, "frames");
+    if (rc == ESP_OK) rc = gw_cbor_writer_u64(&w, frames);
+    if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, "results");
+    if (rc == ESP_OK) rc = gw_cbor_writer_array(&w, count);
+    for (uint32_t i = 0; i < count && rc == ESP_OK; i++) {
+        const bool ok = results[i].rc == ESP_OK;
+        rc = gw_cbor_writer_map(&w, ok ? 1 : 2);
+        if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, "ok");
+        if (rc == ESP_OK) rc = gw_cbor_writer_bool(&w, ok);
+        if (!ok) {
+            if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, "err");
+            if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, results[i].err);
+        }
+    }
+    free(results);
+    esp_err_t send_err = (rc == ESP_OK) ? gw_http_send_cbor_payload(req, w.buf, w.len)
+                                       : httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "cbor encode failure");
+    gw_cbor_writer_free(&w);
+    return send_err;
+}
+
+static esp_err_t cbor_write_state_item(gw_cbor_writer_t *w, const gw_state_item_t *item)
+{
+    const bool removed = item->value_type == GW_STATE_VALUE_REMOVED;
+    esp_err_t rc = gw_cbor_writer_map(w, removed ? 4 : 5);
+    if (rc == ESP_OK) rc = gw_cbor_writer_text(w, "device_id");
+    if (rc == ESP_OK) rc = gw_cbor_writer_text(w, item->uid.uid);
+    if (rc == ESP_OK) rc = gw_cbor_writer_text(w, "endpoint_id");
+    if (rc == ESP_OK) rc = gw_cbor_writer_u64(w, item->endpoint);
+    if (rc == ESP_OK) rc = gw_cbor_writer_text(w, "key");
+    if (rc == ESP_OK) rc = gw_cbor_writer_text(w, item->key);
+    if (removed) {
+        if (rc == ESP_OK) rc = gw_cbor_writer_text(w, "removed");
+        if (rc == ESP_OK) rc = gw_cbor_writer_bool(w, true);
+        return rc;
+    }
+    if (rc == ESP_OK) rc = gw_cbor_writer_text(w, "value");
+    if (rc == ESP_OK) {
+        switch (item->value_type) {
+            case GW_STATE_VALUE_BOOL:
+                rc = gw_cbor_writer_bool(w, item->value_bool);
+                break;
+            case GW_STATE_VALUE_F32:
+                rc = gw_cbor_writer_f64(w, (double)item->value_f32);
+                break;
+            case GW_STATE_VALUE_U32:
+                rc = gw_cbor_writer_u64(w, item->value_u32);
+                break;
+            case GW_STATE_VALUE_U64:
+                rc = gw_cbor_writer_u64(w, item->value_u64);
+                break;
+            case GW_STATE_VALUE_TEXT:
+                rc = gw_cbor_writer_text(w, item->value_text);
+                break;
+            default:
+                rc = gw_cbor_writer_null(w);
+                break;
+        }
+    }
+    if (rc == ESP_OK) rc = gw_cbor_writer_text(w, "ts_ms");
+    if (rc == ESP_OK) rc = gw_cbor_writer_u64(w, item->ts_ms);
+    return rc;
+}
+
+static bool state_uid_listed(const gw_device_t *devices, size_t dev_count, const gw_device_uid_t *uid, size_t *hint)
+{
+    // Items of one device usually sit together in the store: try the last hit first.
+    if (*hint < dev_count && strncmp(devices[*hint].device_uid.uid, uid->uid, sizeof(uid->uid)) == 0) {
+        return true;
+    }
+    for (size_t i = 0; i < dev_count; i++) {
+        if (strncmp(devices[i].device_uid.uid, uid->uid, sizeof(uid->uid)) == 0) {
+            *hint = i;
+            return true;
+        }
+    }
+    return false;
+}
+
 static esp_err_t api_state_get_handler(httpd_req_t *req)
 {
+    if (gw_rest_defer(req, api_state_get_handler)) {
+        return ESP_OK;
+    }
+    // Query: ?since=<version> returns only what changed after that version (removed
+    // items as { removed: true }). The reply's "version" is the next `since`; "full"
+    // tells the client to replace its state instead, when the change log no longer
+    // reaches back that far or the version predates a reboot.
     static const size_t kMaxDevices = 64;
-    static const size_t kMaxStateItems = 1024;
+    static const size_t kPageItems = 8;
     static const char *kWeatherUid = "0xWEATHER000000001";
 
+    bool has_since = false;
+    uint32_t since = 0;
+    char query[32];
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK) {
+        char val[16];
+        if (httpd_query_key_value(query, "since", val, sizeof(val)) == ESP_OK) {
+            char *end = NULL;
+            const unsigned long v = strtoul(val, &end, 10);
+            has_since = end && end != val && *end == '\0' && v <= UINT32_MAX;
+            since = has_since ? (uint32_t)v : 0;
+        }
+    }
+
+    // Streamed straight from the store a page at a time: the device list, one page and
+    // the CBOR window are all that is held, however many items there are.
     gw_device_t *devices = (gw_device_t *)calloc(kMaxDevices, sizeof(gw_device_t));
-    gw_state_item_t *items = (gw_state_item_t *)calloc(kMaxStateItems, sizeof(gw_state_item_t));
-    if (!devices || !items) {
+    gw_state_item_t *page = (gw_state_item_t *)calloc(kPageItems, sizeof(gw_state_item_t));
+    if (!devices || !page) {
         free(devices);
-        free(items);
+        free(page);
         httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "out of memory");
         return ESP_OK;
     }
-
     const size_t dev_count = gw_device_registry_list(devices, kMaxDevices);
-    bool has_weather_uid = false;
-    size_t total = 0;
-    for (size_t i = 0; i < dev_count && total < kMaxStateItems; i++) {
-        if (strncmp(devices[i].device_uid.uid, kWeatherUid, sizeof(devices[i].device_uid.uid)) == 0) {
-            has_weather_uid = true;
-        }
-        const size_t left = kMaxStateItems - total;
-        total += gw_state_store_list_uid(&devices[i].device_uid, &items[total], left);
-    }
-    if (!has_weather_uid && total < kMaxStateItems) {
-        gw_device_uid_t weather_uid = {0};
-        strlcpy(weather_uid.uid, kWeatherUid, sizeof(weather_uid.uid));
-        const size_t left = kMaxStateItems - total;
-        total += gw_state_store_list_uid(&weather_uid, &items[total], left);
+
+    // Read before the walk: whatever changes during it comes again in the next delta.
+    const uint32_t version = gw_state_store_version();
+    bool full = !has_since || since > version;
+    uint32_t cursor = since;
+    size_t n = 0;
+    if (!full && gw_state_store_changes_page(&cursor, page, kPageItems, &n) != ESP_OK) {
+        full = true;
     }
 
     gw_cbor_writer_t w;
-    gw_cbor_writer_init(&w);
-    esp_err_t rc = gw_cbor_writer_map(&w, 1);
+    gw_http_stream_begin(req, &w);
+    esp_err_t rc = gw_cbor_writer_map(&w, 3);
+    if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, "full");
+    if (rc == ESP_OK) rc = gw_cbor_writer_bool(&w, full);
     if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, "items");
-    if (rc == ESP_OK) rc = gw_cbor_writer_array(&w, total);
-    for (size_t i = 0; rc == ESP_OK && i < total; i++) {
-        rc = gw_cbor_writer_map(&w, 5);
-        if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, "device_id");
-        if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, items[i].uid.uid);
-        if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, "endpoint_id");
-        if (rc == ESP_OK) rc = gw_cbor_writer_u64(&w, items[i].endpoint);
-        if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, "key");
-        if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, items[i].key);
-        if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, "value");
-        if (rc == ESP_OK) {
-            switch (items[i].value_type) {
-                case GW_STATE_VALUE_BOOL:
-                    rc = gw_cbor_writer_bool(&w, items[i].value_bool);
-                    break;
-                case GW_STATE_VALUE_F32:
-                    rc = gw_cbor_writer_f64(&w, (double)items[i].value_f32);
-                    break;
-                case GW_STATE_VALUE_U32:
-                    rc = gw_cbor_writer_u64(&w, items[i].value_u32);
-                    break;
-                case GW_STATE_VALUE_U64:
-                    rc = gw_cbor_writer_u64(&w, items[i].value_u64);
-                    break;
-                case GW_STATE_VALUE_TEXT:
-                    rc = gw_cbor_writer_text(&w, items[i].value_text);
-                    break;
-                default:
-                    rc = gw_cbor_writer_null(&w);
-                    break;
+    if (rc == ESP_OK) rc = gw_cbor_writer_array_indef(&w);
+
+    size_t slot_cursor = 0;
+    size_t hint = 0;
+    if (full) {
+        n = gw_state_store_list_page(&slot_cursor, page, kPageItems);
+    }
+    while (rc == ESP_OK && n > 0) {
+        for (size_t i = 0; rc == ESP_OK && i < n; i++) {
+            const gw_state_item_t *item = &page[i];
+            if (item->value_type != GW_STATE_VALUE_REMOVED &&
+                strncmp(item->uid.uid, kWeatherUid, sizeof(item->uid.uid)) != 0 &&
+                !state_uid_listed(devices, dev_count, &item->uid, &hint)) {
+                continue; // not a registered device
             }
+            rc = cbor_write_state_item(&w, item);
+        }
+        if (rc != ESP_OK) {
+            break;
+        }
+        if (full) {
+            n = gw_state_store_list_page(&slot_cursor, page, kPageItems);
+        } else if (gw_state_store_changes_page(&cursor, page, kPageItems, &n) != ESP_OK) {
+            rc = ESP_FAIL; // the log moved past us mid-walk: the client retries and gets a full listing
         }
-        if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, "ts_ms");
-        if (rc == ESP_OK) rc = gw_cbor_writer_u64(&w, items[i].ts_ms);
     }
+    if (rc == ESP_OK) rc = gw_cbor_writer_break(&w);
+    if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, "version");
+    if (rc == ESP_OK) rc = gw_cbor_writer_u64(&w, full ? version : cursor);
 
     free(devices);
-    free(items);
+    free(page);
+    return gw_http_stream_end(req, &w, rc);
+}
 
+static esp_err_t api_rules_stats_get_handler(httpd_req_t *req)
+{
+    // Query: ?reset=1 clears the counters once they are read (one profiling window per call).
+    bool reset = false;
+    char query[32];
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK) {
+        char val[8];
+        if (httpd_query_key_value(query, "reset", val, sizeof(val)) == ESP_OK) {
+            reset = strcmp(val, "1") == 0 || strcmp(val, "true") == 0;
+        }
+    }
+
+    // Rules that first trigger between the two calls are left for the next read.
+    const size_t cap = gw_rules_stats_snapshot(NULL, 0);
+    gw_rules_stats_t *stats = cap ? (gw_rules_stats_t *)calloc(cap, sizeof(gw_rules_stats_t)) : NULL;
+    if (cap && !stats) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "out of memory");
+        return ESP_OK;
+    }
+    size_t count = stats ? gw_rules_stats_snapshot(stats, cap) : 0;
+    if (count > cap) {
+        count = cap;
+    }
+    if (reset) {
+        gw_rules_stats_reset();
+    }
+
+    gw_cbor_writer_t w;
+    gw_cbor_writer_init(&w);
+    esp_err_t rc = gw_cbor_writer_map(&w, 2);
+    if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, "reset");
+    if (rc == ESP_OK) rc = gw_cbor_writer_bool(&w, reset);
+    if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, "rules");
+    if (rc == ESP_OK) rc = gw_cbor_writer_array(&w, count);
+    for (size_t i = 0; rc == ESP_OK && i < count; i++) {
+        const gw_rules_counters_t *c = &stats[i].counters;
+        rc = gw_cbor_writer_map(&w, 7);
+        if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, "id");
+        if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, stats[i].id);
+        if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, "candidates");
+        if (rc == ESP_OK) rc = gw_cbor_writer_u64(&w, c->candidates);
+        if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, "matches");
+        if (rc == ESP_OK) rc = gw_cbor_writer_u64(&w, c->matches);
+        if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, "cond_rejects");
+        if (rc == ESP_OK) rc = gw_cbor_writer_u64(&w, c->cond_rejects);
+        if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, "fires");
+        if (rc == ESP_OK) rc = gw_cbor_writer_u64(&w, c->fires);
+        if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, "action_failures");
+        if (rc == ESP_OK) rc = gw_cbor_writer_u64(&w, c->action_failures);
+        // latency_hist[0]: < 1 ms, [i]: [2^(i-1), 2^i) ms, last bucket open-ended.
+        if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, "latency_hist");
+        if (rc == ESP_OK) rc = gw_cbor_writer_array(&w, GW_RULES_LATENCY_BUCKETS);
+        for (size_t b = 0; rc == ESP_OK && b < GW_RULES_LATENCY_BUCKETS; b++) {
+            rc = gw_cbor_writer_u64(&w, c->latency_hist[b]);
+        }
+    }
+
+    free(stats);
     esp_err_t send_err = (rc == ESP_OK) ? gw_http_send_cbor_payload(req, w.buf, w.len)
                                         : httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "cbor encode failure");
     gw_cbor_writer_free(&w);
@@ -1179,6 +1609,10 @@ static esp_err_t api_state_get_handler(httpd_req_t *req)
 
 static esp_err_t api_groups_get_handler(httpd_req_t *req)
 {
+    char etag[GW_HTTP_ETAG_MAX];
+    if (gw_http_not_modified(req, 'g', gw_group_store_version(), etag, sizeof(etag))) {
+        return ESP_OK;
+    }
     const size_t max_groups = 24;
     gw_group_entry_t *groups = (gw_group_entry_t *)calloc(max_groups, sizeof(gw_group_entry_t));
     if (!groups) {
@@ -1221,21 +1655,27 @@ static esp_err_t api_groups_post_handler(httpd_req_t *req)
         return ESP_OK;
     }
 
-    gw_cbor_slice_t op_s = {0};
-    char op[16] = {0};
-    if (!cbor_map_find_val_buf(buf, len, "op", &op_s) || !cbor_text_copy(&op_s, op, sizeof(op))) {
+    typedef struct {
+        char op[16];
+        char id[GW_GROUP_ID_MAX];
+        char name[GW_GROUP_NAME_MAX];
+    } body_t;
+    static const gw_cbor_field_t fields[] = {
+        GW_CBOR_FIELD("op", GW_CBOR_FIELD_TEXT, body_t, op),
+        GW_CBOR_FIELD("id", GW_CBOR_FIELD_TEXT, body_t, id),
+        GW_CBOR_FIELD("name", GW_CBOR_FIELD_TEXT, body_t, name),
+    };
+    body_t body = {0};
+    const bool decoded = gw_cbor_decode_map(buf, len, fields, sizeof(fields) / sizeof(fields[0]), &body, NULL, NULL);
+    const char *op = body.op;
+    const char *id = body.id;
+    const char *name = body.name;
+    if (!decoded || !op[0]) {
         free(buf);
-        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "missing op");
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, decoded ? "missing op" : "bad group request");
         return ESP_OK;
     }
 
-    gw_cbor_slice_t id_s = {0};
-    gw_cbor_slice_t name_s = {0};
-    char id[GW_GROUP_ID_MAX] = {0};
-    char name[GW_GROUP_NAME_MAX] = {0};
-    if (cbor_map_find_val_buf(buf, len, "id", &id_s)) (void)cbor_text_copy(&id_s, id, sizeof(id));
-    if (cbor_map_find_val_buf(buf, len, "name", &name_s)) (void)cbor_text_copy(&name_s, name, sizeof(name));
-
     esp_err_t err = ESP_ERR_INVALID_ARG;
     gw_group_entry_t created = {0};
     if (strcmp(op, "create") == 0) {
@@ -1275,6 +1715,10 @@ static esp_err_t api_groups_post_handler(httpd_req_t *req)
 
 static esp_err_t api_group_items_get_handler(httpd_req_t *req)
 {
+    char etag[GW_HTTP_ETAG_MAX];
+    if (gw_http_not_modified(req, 'i', gw_group_store_version(), etag, sizeof(etag))) {
+        return ESP_OK;
+    }
     const size_t max_items = 256;
     gw_group_item_t *items = (gw_group_item_t *)calloc(max_items, sizeof(gw_group_item_t));
     if (!items) {
@@ -1320,45 +1764,51 @@ static esp_err_t api_group_items_post_handler(httpd_req_t *req)
         return ESP_OK;
     }
 
-    gw_cbor_slice_t op_s = {0};
-    char op[16] = {0};
-    if (!cbor_map_find_val_buf(buf, len, "op", &op_s) || !cbor_text_copy(&op_s, op, sizeof(op))) {
+    typedef struct {
+        char op[16];
+        char group_id[GW_GROUP_ID_MAX];
+        gw_device_uid_t uid;
+        uint8_t endpoint;
+        uint32_t order;
+        char label[32];
+    } body_t;
+    enum { F_OP, F_GROUP_ID, F_DEVICE_UID, F_ENDPOINT_ID, F_ORDER, F_LABEL };
+    static const gw_cbor_field_t fields[] = {
+        [F_OP] = GW_CBOR_FIELD("op", GW_CBOR_FIELD_TEXT, body_t, op),
+        [F_GROUP_ID] = GW_CBOR_FIELD("group_id", GW_CBOR_FIELD_TEXT, body_t, group_id),
+        [F_DEVICE_UID] = GW_CBOR_FIELD("device_uid", GW_CBOR_FIELD_TEXT, body_t, uid.uid),
+        [F_ENDPOINT_ID] = GW_CBOR_FIELD_RANGE("endpoint_id", GW_CBOR_FIELD_U8, body_t, endpoint, 1, 255),
+        [F_ORDER] = GW_CBOR_FIELD("order", GW_CBOR_FIELD_U32, body_t, order),
+        [F_LABEL] = GW_CBOR_FIELD("label", GW_CBOR_FIELD_TEXT, body_t, label),
+    };
+    body_t body = {0};
+    uint32_t has = 0;
+    int bad = -1;
+    if (!gw_cbor_decode_map(buf, len, fields, sizeof(fields) / sizeof(fields[0]), &body, &has, &bad)) {
         free(buf);
-        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "missing op");
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST,
+                            bad == F_DEVICE_UID || bad == F_ENDPOINT_ID ? "bad device_uid/endpoint_id" : "bad group item request");
         return ESP_OK;
     }
-
-    gw_cbor_slice_t uid_s = {0};
-    gw_cbor_slice_t ep_s = {0};
-    if (!cbor_map_find_val_buf(buf, len, "device_uid", &uid_s) || !cbor_map_find_val_buf(buf, len, "endpoint_id", &ep_s)) {
+    const char *op = body.op;
+    if (!op[0]) {
         free(buf);
-        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "missing device_uid/endpoint_id");
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "missing op");
         return ESP_OK;
     }
-
-    gw_device_uid_t uid = {0};
-    uint8_t endpoint = 0;
-    if (!cbor_text_copy(&uid_s, uid.uid, sizeof(uid.uid)) || !cbor_slice_to_u8(&ep_s, &endpoint) || endpoint == 0) {
+    if (!(has & (1u << F_DEVICE_UID)) || !(has & (1u << F_ENDPOINT_ID)) || !body.uid.uid[0]) {
         free(buf);
-        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "bad device_uid/endpoint_id");
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "missing device_uid/endpoint_id");
         return ESP_OK;
     }
 
-    gw_cbor_slice_t group_s = {0};
-    char group_id[GW_GROUP_ID_MAX] = {0};
-    if (cbor_map_find_val_buf(buf, len, "group_id", &group_s)) {
-        (void)cbor_text_copy(&group_s, group_id, sizeof(group_id));
-    }
-
-    gw_cbor_slice_t order_s = {0};
-    uint32_t order = 0;
-    bool has_order = false;
-    if (cbor_map_find_val_buf(buf, len, "order", &order_s)) {
-        has_order = cbor_slice_to_u32(&order_s, &order);
-    }
-    gw_cbor_slice_t label_s = {0};
-    char label[32] = {0};
-    const bool has_label = cbor_map_find_val_buf(buf, len, "label", &label_s) && cbor_text_copy(&label_s, label, sizeof(label));
+    const gw_device_uid_t uid = body.uid;
+    const uint8_t endpoint = body.endpoint;
+    const char *group_id = body.group_id;
+    const uint32_t order = body.order;
+    const bool has_order = (has & (1u << F_ORDER)) != 0;
+    const char *label = body.label;
+    const bool has_label = (has & (1u << F_LABEL)) != 0;
 
     esp_err_t err = ESP_ERR_INVALID_ARG;
     if (strcmp(op, "set") == 0) {
@@ -1396,6 +1846,10 @@ static esp_err_t api_group_items_post_handler(httpd_req_t *req)
 
 static esp_err_t api_settings_get_handler(httpd_req_t *req)
 {
+    char etag[GW_HTTP_ETAG_MAX];
+    if (gw_http_not_modified(req, 's', gw_project_settings_version(), etag, sizeof(etag))) {
+        return ESP_OK;
+    }
     gw_project_settings_t cfg = {0};
     esp_err_t err = gw_project_settings_get(&cfg);
     if (err != ESP_OK) {
@@ -1441,50 +1895,21 @@ static esp_err_t api_settings_post_handler(httpd_req_t *req)
         return ESP_OK;
     }
 
-    gw_cbor_slice_t s = {0};
-    uint32_t u32 = 0;
-    int32_t i32 = 0;
-    bool b = false;
-
-    if (cbor_map_find_val_buf(buf, len, "screensaver_timeout_ms", &s)) {
-        if (!cbor_slice_to_u32(&s, &u32)) {
-            free(buf);
-            httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "bad screensaver_timeout_ms");
-            return ESP_OK;
-        }
-        next.screensaver_timeout_ms = u32;
-    }
-    if (cbor_map_find_val_buf(buf, len, "weather_success_interval_ms", &s)) {
-        if (!cbor_slice_to_u32(&s, &u32)) {
-            free(buf);
-            httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "bad weather_success_interval_ms");
-            return ESP_OK;
-        }
-        next.weather_success_interval_ms = u32;
-    }
-    if (cbor_map_find_val_buf(buf, len, "weather_retry_interval_ms", &s)) {
-        if (!cbor_slice_to_u32(&s, &u32)) {
-            free(buf);
-            httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "bad weather_retry_interval_ms");
-            return ESP_OK;
-        }
-        next.weather_retry_interval_ms = u32;
-    }
-    if (cbor_map_find_val_buf(buf, len, "timezone_auto", &s)) {
-        if (!cbor_slice_to_bool(&s, &b)) {
-            free(buf);
-            httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "bad timezone_auto");
-            return ESP_OK;
-        }
-        next.timezone_auto = b;
-    }
-    if (cbor_map_find_val_buf(buf, len, "timezone_offset_min", &s)) {
-        if (!cbor_slice_to_i32(&s, &i32)) {
-            free(buf);
-            httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "bad timezone_offset_min");
-            return ESP_OK;
-        }
-        next.timezone_offset_min = (int16_t)i32;
+    // Keys that are present overwrite the current value; ranges are checked by validate() below.
+    static const gw_cbor_field_t fields[] = {
+        GW_CBOR_FIELD("screensaver_timeout_ms", GW_CBOR_FIELD_U32, gw_project_settings_t, screensaver_timeout_ms),
+        GW_CBOR_FIELD("weather_success_interval_ms", GW_CBOR_FIELD_U32, gw_project_settings_t, weather_success_interval_ms),
+        GW_CBOR_FIELD("weather_retry_interval_ms", GW_CBOR_FIELD_U32, gw_project_settings_t, weather_retry_interval_ms),
+        GW_CBOR_FIELD("timezone_auto", GW_CBOR_FIELD_BOOL, gw_project_settings_t, timezone_auto),
+        GW_CBOR_FIELD("timezone_offset_min", GW_CBOR_FIELD_I16, gw_project_settings_t, timezone_offset_min),
+    };
+    int bad = -1;
+    if (!gw_cbor_decode_map(buf, len, fields, sizeof(fields) / sizeof(fields[0]), &next, NULL, &bad)) {
+        free(buf);
+        char msg[48];
+        snprintf(msg, sizeof(msg), "bad %s", bad >= 0 ? fields[bad].key : "settings");
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, msg);
+        return ESP_OK;
     }
     free(buf);
 
@@ -1508,6 +1933,10 @@ esp_err_t gw_http_register_rest_endpoints(httpd_handle_t server)
     if (!server) {
         return ESP_ERR_INVALID_ARG;
     }
+    s_etag_boot = esp_random();
+    if (gw_rest_workers_start() != ESP_OK) {
+        ESP_LOGW(TAG, "rest workers unavailable; slow handlers run on the httpd task");
+    }
 
     static const httpd_uri_t api_devices_flatbuffer_get_uri = {
         .uri = "/api/devices/flatbuffer",
@@ -1551,12 +1980,24 @@ esp_err_t gw_http_register_rest_endpoints(httpd_handle_t server)
         .handler = api_actions_post_handler,
         .user_ctx = NULL,
     };
+    static const httpd_uri_t api_actions_batch_post_uri = {
+        .uri = "/api/actions/batch",
+        .method = HTTP_POST,
+        .handler = api_actions_batch_post_handler,
+        .user_ctx = NULL,
+    };
     static const httpd_uri_t api_state_get_uri = {
         .uri = "/api/state",
         .method = HTTP_GET,
         .handler = api_state_get_handler,
         .user_ctx = NULL,
     };
+    static const httpd_uri_t api_rules_stats_get_uri = {
+        .uri = "/api/rules/stats",
+        .method = HTTP_GET,
+        .handler = api_rules_stats_get_handler,
+        .user_ctx = NULL,
+    };
     static const httpd_uri_t api_devices_remove_post_uri = {
         .uri = "/api/devices/remove",
         .method = HTTP_POST,
@@ -1634,10 +2075,18 @@ esp_err_t gw_http_register_rest_endpoints(httpd_handle_t server)
     if (err != ESP_OK) {
         return err;
     }
+    err = httpd_register_uri_handler(server, &api_actions_batch_post_uri);
+    if (err != ESP_OK) {
+        return err;
+    }
     err = httpd_register_uri_handler(server, &api_state_get_uri);
     if (err != ESP_OK) {
         return err;
     }
+    err = httpd_register_uri_handler(server, &api_rules_stats_get_uri);
+    if (err != ESP_OK) {
+        return err;
+    }
     err = httpd_register_uri_handler(server, &api_devices_remove_post_uri);
     if (err != ESP_OK) {
         return err;
@@ -9,34 +9,111 @@
 #include "esp_err.h"
 #include "esp_heap_caps.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/idf_additions.h"
 #include "freertos/queue.h"
 #include "freertos/task.h"
 
+#include "gw_core/cbor.h"
 #include "gw_core/event_bus.h"
+#include "gw_core/group_store.h"
+#include "gw_core/zb_attr_map.h"
 
 static const char *TAG = "gw_ws";
 static const bool kWsUsePsram = true;
 
+#define GW_WS_MAX_CLIENTS 2
+#define GW_WS_EVENT_Q_CAP 4
+#define GW_WS_EVENT_TASK_PRIO 2
+#define GW_WS_EVENT_TASK_STACK 4096
+// Per-client outbound queue. A client that cannot keep up first has its pending
+// device.state frames coalesced per (device, endpoint, key); past either hard limit
+// it is disconnected so it cannot hold back the others.
+#define GW_WS_CLIENT_Q_CAP 32
+#define GW_WS_CLIENT_Q_MAX_BYTES (16 * 1024)
+#define GW_WS_COALESCE_KEY_MAX 64
+// Clients that subscribe with "batch": true get queued events packed into one CBOR
+// array frame, sent once the oldest has waited the flush interval or the batch is full.
+#define GW_WS_BATCH_FLUSH_MS CONFIG_GW_WS_BATCH_FLUSH_MS
+#define GW_WS_BATCH_MAX_BYTES CONFIG_GW_WS_BATCH_MAX_BYTES
+#define GW_WS_BATCH_HDR_MAX 2 // array header for up to GW_WS_CLIENT_Q_CAP items
+// Every event kind encodes well below this (msg is 128 chars), so events are built on
+// the stack; anything larger falls back to a size pass plus an exact allocation.
+#define GW_WS_EVENT_ENC_MAX 512
+
+// One encoded frame, shared by every client queue it sits in.
+typedef struct {
+    uint32_t refs; // guarded by s_client_lock
+    size_t len;
+    char coalesce_key[GW_WS_COALESCE_KEY_MAX]; // "" = never coalesced
+    uint8_t data[];
+} ws_msg_t;
+
+// Outbound event kinds, as bits for the per-client filters.
+typedef enum {
+    WS_KIND_NONE = 0,
+    WS_KIND_AUTOM_FIRED = 1u << 0,
+    WS_KIND_AUTOM_RESULT = 1u << 1,
+    WS_KIND_DEVICE_EVENT = 1u << 2,
+    WS_KIND_DEVICE_STATE = 1u << 3,
+    WS_KIND_GATEWAY_EVENT = 1u << 4,
+} ws_kind_t;
+
+#define WS_KIND_ALL 0x1fu
+
+static const struct {
+    const char *name;
+    ws_kind_t kind;
+} kWsKinds[] = {
+    {"automation.fired", WS_KIND_AUTOM_FIRED},
+    {"automation.result", WS_KIND_AUTOM_RESULT},
+    {"device.event", WS_KIND_DEVICE_EVENT},
+    {"device.state", WS_KIND_DEVICE_STATE},
+    {"gateway.event", WS_KIND_GATEWAY_EVENT},
+};
+
+#define GW_WS_FILTER_MAX_DEVICES 16
+#define GW_WS_FILTER_MAX_MEMBERS 32
+#define GW_WS_GROUP_ITEMS_MAX 256
+
+typedef struct {
+    char uid[GW_DEVICE_UID_STRLEN];
+    uint8_t endpoint; // 0 = any endpoint
+} ws_target_t;
+
+// What a client asked for with {"type":"subscribe", "kinds":[..], "devices":[..], "group":".."}.
+// Omitted fields do not restrict; events without a device always pass the device/group
+// part. A group is resolved to its endpoints by the event task and re-resolved whenever
+// the group store changes.
+typedef struct {
+    uint8_t kinds;
+    bool batch;
+    uint8_t device_count;
+    ws_target_t devices[GW_WS_FILTER_MAX_DEVICES];
+    char group_id[GW_GROUP_ID_MAX];
+} ws_filter_t;
+
 typedef struct {
     int fd;
     bool subscribed_events;
+    ws_filter_t filter;
+    bool members_valid;
+    uint32_t members_version;
+    uint8_t member_count;
+    ws_target_t members[GW_WS_FILTER_MAX_MEMBERS];
+    ws_msg_t *inflight; // handed to httpd, released by ws_transfer_done_cb
+    ws_msg_t *q[GW_WS_CLIENT_Q_CAP];
+    uint8_t q_head;
+    uint8_t q_count;
+    size_t q_bytes;
+    ws_msg_t *batch_buf;   // reused for every batch frame; NULL = batching off
+    uint64_t batch_due_ms; // 0 = nothing waiting
 } gw_ws_client_t;
 
-typedef struct {
-    uint8_t *buf;
-    size_t len;
-    size_t cap;
-} cbor_wr_t;
-
 static httpd_handle_t s_server;
 static portMUX_TYPE s_client_lock = portMUX_INITIALIZER_UNLOCKED;
 
-#define GW_WS_MAX_CLIENTS 2
-#define GW_WS_EVENT_Q_CAP 4
-#define GW_WS_EVENT_TASK_PRIO 2
-#define GW_WS_EVENT_TASK_STACK 4096
 static gw_ws_client_t s_clients[GW_WS_MAX_CLIENTS];
 static QueueHandle_t s_event_q;
 static TaskHandle_t s_event_task;
@@ -61,192 +138,313 @@ static void ws_refresh_out_queue_binding(void)
     }
 }
 
-static void ws_client_remove_fd(int fd)
-{
-    portENTER_CRITICAL(&s_client_lock);
-    for (size_t i = 0; i < GW_WS_MAX_CLIENTS; i++) {
-        if (s_clients[i].fd == fd) {
-            s_clients[i] = (gw_ws_client_t){0};
-            break;
-        }
-    }
-    portEXIT_CRITICAL(&s_client_lock);
-    ws_refresh_out_queue_binding();
-}
-
-static bool ws_client_add_fd(int fd)
+static uint64_t now_ms(void)
 {
-    bool ok = false;
-    portENTER_CRITICAL(&s_client_lock);
-    for (size_t i = 0; i < GW_WS_MAX_CLIENTS; i++) {
-        if (s_clients[i].fd == fd) {
-            s_clients[i].subscribed_events = true;
-            ok = true;
-            break;
-        }
-    }
-    if (!ok) {
-        for (size_t i = 0; i < GW_WS_MAX_CLIENTS; i++) {
-            if (s_clients[i].fd == 0) {
-                s_clients[i].fd = fd;
-                s_clients[i].subscribed_events = true;
-                ok = true;
-                break;
-            }
-        }
-    }
-    portEXIT_CRITICAL(&s_client_lock);
-    if (ok) {
-        ws_refresh_out_queue_binding();
-    }
-    return ok;
+    return (uint64_t)(esp_timer_get_time() / 1000ULL);
 }
 
-static bool cbor_wr_reserve(cbor_wr_t *w, size_t add)
+static ws_msg_t *ws_msg_alloc(size_t cap)
 {
-    if (!w) return false;
-    if (w->len + add <= w->cap) return true;
-    size_t new_cap = w->cap ? w->cap : 128;
-    while (new_cap < w->len + add) new_cap *= 2;
-    uint8_t *nb = NULL;
+    ws_msg_t *m = NULL;
     if (kWsUsePsram) {
-        nb = (uint8_t *)heap_caps_realloc(w->buf, new_cap, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+        m = (ws_msg_t *)heap_caps_malloc(sizeof(*m) + cap, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
     }
-    if (!nb) {
-        nb = (uint8_t *)heap_caps_realloc(w->buf, new_cap, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    if (!m) {
+        m = (ws_msg_t *)heap_caps_malloc(sizeof(*m) + cap, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
     }
-    if (!nb) {
-        nb = (uint8_t *)heap_caps_realloc(w->buf, new_cap, MALLOC_CAP_8BIT);
+    if (!m) {
+        m = (ws_msg_t *)heap_caps_malloc(sizeof(*m) + cap, MALLOC_CAP_8BIT);
     }
-    if (!nb) return false;
-    w->buf = nb;
-    w->cap = new_cap;
-    return true;
+    if (!m) return NULL;
+    m->refs = 1;
+    m->len = 0;
+    m->coalesce_key[0] = '\0';
+    return m;
 }
 
-static bool cbor_wr_u8(cbor_wr_t *w, uint8_t v)
+static ws_msg_t *ws_msg_new(const uint8_t *buf, size_t len, const char *coalesce_key)
 {
-    if (!cbor_wr_reserve(w, 1)) return false;
-    w->buf[w->len++] = v;
-    return true;
+    ws_msg_t *m = ws_msg_alloc(len);
+    if (!m) return NULL;
+    m->len = len;
+    strlcpy(m->coalesce_key, coalesce_key ? coalesce_key : "", sizeof(m->coalesce_key));
+    memcpy(m->data, buf, len);
+    return m;
 }
 
-static bool cbor_wr_mem(cbor_wr_t *w, const void *src, size_t n)
+static void ws_msg_release(ws_msg_t *m)
 {
-    if (!cbor_wr_reserve(w, n)) return false;
-    memcpy(w->buf + w->len, src, n);
-    w->len += n;
-    return true;
-}
-
-static bool cbor_wr_uint(cbor_wr_t *w, uint8_t major, uint64_t v)
-{
-    if (v < 24) {
-        return cbor_wr_u8(w, (uint8_t)((major << 5) | (uint8_t)v));
-    }
-    if (v <= 0xff) {
-        if (!cbor_wr_u8(w, (uint8_t)((major << 5) | 24))) return false;
-        return cbor_wr_u8(w, (uint8_t)v);
-    }
-    if (v <= 0xffff) {
-        uint8_t b[2] = {(uint8_t)(v >> 8), (uint8_t)v};
-        if (!cbor_wr_u8(w, (uint8_t)((major << 5) | 25))) return false;
-        return cbor_wr_mem(w, b, sizeof(b));
-    }
-    if (v <= 0xffffffffULL) {
-        uint8_t b[4] = {(uint8_t)(v >> 24), (uint8_t)(v >> 16), (uint8_t)(v >> 8), (uint8_t)v};
-        if (!cbor_wr_u8(w, (uint8_t)((major << 5) | 26))) return false;
-        return cbor_wr_mem(w, b, sizeof(b));
+    if (!m) return;
+    portENTER_CRITICAL(&s_client_lock);
+    const uint32_t refs = --m->refs;
+    portEXIT_CRITICAL(&s_client_lock);
+    if (refs == 0) {
+        free(m);
     }
-    uint8_t b[8] = {
-        (uint8_t)(v >> 56), (uint8_t)(v >> 48), (uint8_t)(v >> 40), (uint8_t)(v >> 32),
-        (uint8_t)(v >> 24), (uint8_t)(v >> 16), (uint8_t)(v >> 8), (uint8_t)v};
-    if (!cbor_wr_u8(w, (uint8_t)((major << 5) | 27))) return false;
-    return cbor_wr_mem(w, b, sizeof(b));
 }
 
-static bool cbor_wr_text(cbor_wr_t *w, const char *s)
+// Called with s_client_lock held.
+static gw_ws_client_t *ws_client_find_locked(int fd)
 {
-    if (!s) s = "";
-    size_t n = strlen(s);
-    if (!cbor_wr_uint(w, 3, n)) return false;
-    return cbor_wr_mem(w, s, n);
+    for (size_t i = 0; i < GW_WS_MAX_CLIENTS; i++) {
+        if (s_clients[i].fd == fd) {
+            return &s_clients[i];
+        }
+    }
+    return NULL;
 }
 
-static bool cbor_wr_bool(cbor_wr_t *w, bool v)
+// Clears a client slot and returns its queued frames (and batch buffer) in `out`, which
+// must hold GW_WS_CLIENT_Q_CAP + 1 entries, for the caller to release outside the lock.
+// An in-flight frame stays with httpd: its completion callback releases it.
+// Called with s_client_lock held.
+static size_t ws_client_clear_locked(gw_ws_client_t *c, ws_msg_t **out)
 {
-    return cbor_wr_u8(w, (uint8_t)((7 << 5) | (v ? 21 : 20)));
+    size_t n = 0;
+    for (uint8_t i = 0; i < c->q_count; i++) {
+        out[n++] = c->q[(c->q_head + i) % GW_WS_CLIENT_Q_CAP];
+    }
+    if (c->batch_buf) {
+        out[n++] = c->batch_buf;
+    }
+    *c = (gw_ws_client_t){0};
+    return n;
 }
 
-static bool cbor_wr_null(cbor_wr_t *w)
+static void ws_client_remove_fd(int fd)
 {
-    return cbor_wr_u8(w, (uint8_t)((7 << 5) | 22));
+    ws_msg_t *drop[GW_WS_CLIENT_Q_CAP + 1];
+    size_t drop_count = 0;
+    portENTER_CRITICAL(&s_client_lock);
+    gw_ws_client_t *c = ws_client_find_locked(fd);
+    if (c) {
+        drop_count = ws_client_clear_locked(c, drop);
+    }
+    portEXIT_CRITICAL(&s_client_lock);
+    for (size_t i = 0; i < drop_count; i++) {
+        ws_msg_release(drop[i]);
+    }
+    ws_refresh_out_queue_binding();
 }
 
-static bool cbor_wr_i64(cbor_wr_t *w, int64_t v)
+static bool ws_client_add_fd(int fd)
 {
-    if (v >= 0) {
-        return cbor_wr_uint(w, 0, (uint64_t)v);
+    bool ok = false;
+    portENTER_CRITICAL(&s_client_lock);
+    gw_ws_client_t *c = ws_client_find_locked(fd);
+    if (!c) {
+        c = ws_client_find_locked(0);
+        if (c) {
+            c->fd = fd;
+        }
     }
-    return cbor_wr_uint(w, 1, (uint64_t)(-1 - v));
+    if (c) {
+        if (!c->subscribed_events) {
+            c->filter = (ws_filter_t){.kinds = WS_KIND_ALL};
+        }
+        c->subscribed_events = true;
+        ok = true;
+    }
+    portEXIT_CRITICAL(&s_client_lock);
+    if (ok) {
+        ws_refresh_out_queue_binding();
+    }
+    return ok;
 }
 
-static bool cbor_wr_f64(cbor_wr_t *w, double v)
-{
-    union {
-        double d;
-        uint64_t u;
-    } u = {0};
-    u.d = v;
-    uint8_t b[8] = {
-        (uint8_t)(u.u >> 56), (uint8_t)(u.u >> 48), (uint8_t)(u.u >> 40), (uint8_t)(u.u >> 32),
-        (uint8_t)(u.u >> 24), (uint8_t)(u.u >> 16), (uint8_t)(u.u >> 8), (uint8_t)u.u};
-    if (!cbor_wr_u8(w, (uint8_t)((7 << 5) | 27))) return false;
-    return cbor_wr_mem(w, b, sizeof(b));
-}
+static void ws_client_pump(int fd);
 
 static void ws_transfer_done_cb(esp_err_t err, int socket, void *arg)
 {
-    (void)err;
-    (void)socket;
-    free(arg);
+    ws_msg_t *m = (ws_msg_t *)arg;
+    bool still_ours = false;
+    portENTER_CRITICAL(&s_client_lock);
+    gw_ws_client_t *c = ws_client_find_locked(socket);
+    if (c && c->inflight == m) {
+        c->inflight = NULL;
+        still_ours = true;
+    }
+    portEXIT_CRITICAL(&s_client_lock);
+    ws_msg_release(m);
+
+    if (!still_ours) return;
+    if (err != ESP_OK) {
+        ws_client_remove_fd(socket);
+        return;
+    }
+    ws_client_pump(socket);
 }
 
-static esp_err_t ws_send_cbor_async(int fd, const uint8_t *buf, size_t len)
+// Hands the next queued frame to httpd unless one is already in flight, so each
+// client has at most one async send outstanding and its backlog stays in its own queue.
+static void ws_client_pump(int fd)
 {
-    if (!s_server || !buf || len == 0) {
-        return ESP_ERR_INVALID_STATE;
-    }
+    if (!s_server) return;
     if (httpd_ws_get_fd_info(s_server, fd) != HTTPD_WS_CLIENT_WEBSOCKET) {
         ws_client_remove_fd(fd);
-        return ESP_ERR_INVALID_STATE;
+        return;
     }
 
-    uint8_t *copy = NULL;
-    if (kWsUsePsram) {
-        copy = (uint8_t *)heap_caps_malloc(len, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
-    }
-    if (!copy) {
-        copy = (uint8_t *)heap_caps_malloc(len, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    ws_msg_t *m = NULL;
+    ws_msg_t *parts[GW_WS_CLIENT_Q_CAP];
+    size_t part_count = 0;
+    const uint64_t now = now_ms();
+    portENTER_CRITICAL(&s_client_lock);
+    gw_ws_client_t *c = ws_client_find_locked(fd);
+    // A batch that is neither due nor full keeps waiting, also when a completion pumps.
+    const bool held = c && c->batch_buf && c->batch_due_ms > now && c->q_bytes < GW_WS_BATCH_MAX_BYTES;
+    if (c && !c->inflight && c->q_count > 0 && !held) {
+        c->batch_due_ms = 0;
+        // Pack as many queued frames as fit into one batch; the batch buffer is free
+        // whenever nothing is in flight (the client slot holds its only reference).
+        size_t batch_bytes = 0;
+        const bool can_batch = c->batch_buf && c->batch_buf->refs == 1;
+        while (c->q_count > 0) {
+            ws_msg_t *head = c->q[c->q_head];
+            if (part_count > 0 && (!can_batch || batch_bytes + head->len > GW_WS_BATCH_MAX_BYTES)) break;
+            c->q[c->q_head] = NULL;
+            c->q_head = (uint8_t)((c->q_head + 1) % GW_WS_CLIENT_Q_CAP);
+            c->q_count--;
+            c->q_bytes -= head->len;
+            batch_bytes += head->len;
+            parts[part_count++] = head;
+        }
+        if (part_count == 1) {
+            m = parts[0];
+        } else {
+            m = c->batch_buf;
+            m->refs++; // the in-flight reference
+        }
+        c->inflight = m;
     }
-    if (!copy) {
-        copy = (uint8_t *)heap_caps_malloc(len, MALLOC_CAP_8BIT);
+    portEXIT_CRITICAL(&s_client_lock);
+    if (!m) return;
+
+    if (part_count > 1) {
+        // Built outside the lock: nobody else touches the buffer while it is marked in flight.
+        gw_cbor_writer_t hdr;
+        gw_cbor_writer_init_fixed(&hdr, m->data, GW_WS_BATCH_HDR_MAX);
+        (void)gw_cbor_writer_array(&hdr, part_count); // fits: part_count <= GW_WS_CLIENT_Q_CAP
+        size_t len = hdr.len;
+        for (size_t i = 0; i < part_count; i++) {
+            memcpy(m->data + len, parts[i]->data, parts[i]->len);
+            len += parts[i]->len;
+            ws_msg_release(parts[i]);
+        }
+        m->len = len;
     }
-    if (!copy) return ESP_ERR_NO_MEM;
-    memcpy(copy, buf, len);
 
     httpd_ws_frame_t frame = {
         .type = HTTPD_WS_TYPE_BINARY,
-        .payload = copy,
-        .len = len,
+        .payload = m->data,
+        .len = m->len,
     };
-    esp_err_t err = httpd_ws_send_data_async(s_server, fd, &frame, ws_transfer_done_cb, copy);
+    esp_err_t err = httpd_ws_send_data_async(s_server, fd, &frame, ws_transfer_done_cb, m);
     if (err != ESP_OK) {
-        free(copy);
+        portENTER_CRITICAL(&s_client_lock);
+        c = ws_client_find_locked(fd);
+        if (c && c->inflight == m) {
+            c->inflight = NULL;
+        }
+        portEXIT_CRITICAL(&s_client_lock);
+        ws_msg_release(m);
         ws_client_remove_fd(fd);
-        return err;
     }
-    return ESP_OK;
+}
+
+// Queues `m` for one client. A pending frame with the same coalesce key is replaced
+// in place, so a lagging client gets the latest value without growing its queue.
+static void ws_client_enqueue(int fd, ws_msg_t *m)
+{
+    ws_msg_t *replaced = NULL;
+    ws_msg_t *drop[GW_WS_CLIENT_Q_CAP + 1];
+    size_t drop_count = 0;
+    bool overflow = false;
+    bool hold = false;
+    unsigned queued = 0;
+
+    portENTER_CRITICAL(&s_client_lock);
+    gw_ws_client_t *c = ws_client_find_locked(fd);
+    if (!c || !c->subscribed_events) {
+        portEXIT_CRITICAL(&s_client_lock);
+        return;
+    }
+    if (m->coalesce_key[0]) {
+        for (uint8_t i = 0; i < c->q_count; i++) {
+            const uint8_t slot = (uint8_t)((c->q_head + i) % GW_WS_CLIENT_Q_CAP);
+            if (strcmp(c->q[slot]->coalesce_key, m->coalesce_key) == 0) {
+                replaced = c->q[slot];
+                c->q_bytes = c->q_bytes - replaced->len + m->len;
+                c->q[slot] = m;
+                m->refs++;
+                break;
+            }
+        }
+    }
+    if (!replaced) {
+        if (c->q_count >= GW_WS_CLIENT_Q_CAP || c->q_bytes + m->len > GW_WS_CLIENT_Q_MAX_BYTES) {
+            overflow = true;
+            queued = c->q_count;
+            drop_count = ws_client_clear_locked(c, drop);
+        } else {
+            c->q[(c->q_head + c->q_count) % GW_WS_CLIENT_Q_CAP] = m;
+            c->q_count++;
+            c->q_bytes += m->len;
+            m->refs++;
+        }
+    }
+    if (!overflow && c->batch_buf) {
+        // Hold the frame for the batch until it is due or full; ws_flush_due_batches()
+        // sends it from the event task.
+        if (c->batch_due_ms == 0) {
+            c->batch_due_ms = now_ms() + GW_WS_BATCH_FLUSH_MS;
+        }
+        hold = c->q_bytes < GW_WS_BATCH_MAX_BYTES;
+    }
+    portEXIT_CRITICAL(&s_client_lock);
+
+    ws_msg_release(replaced);
+    if (overflow) {
+        for (size_t i = 0; i < drop_count; i++) {
+            ws_msg_release(drop[i]);
+        }
+        ESP_LOGW(TAG, "WS client fd=%d too slow (%u frames queued); disconnecting", fd, queued);
+        (void)httpd_sess_trigger_close(s_server, fd);
+        ws_refresh_out_queue_binding();
+        return;
+    }
+    if (!hold) {
+        ws_client_pump(fd);
+    }
+}
+
+// Sends the batches whose flush time has passed; returns how long the event task may
+// sleep before the next one is due.
+static TickType_t ws_flush_due_batches(void)
+{
+    const uint64_t now = now_ms();
+    uint64_t next_due = UINT64_MAX;
+    int due_fds[GW_WS_MAX_CLIENTS];
+    size_t due_count = 0;
+    portENTER_CRITICAL(&s_client_lock);
+    for (size_t i = 0; i < GW_WS_MAX_CLIENTS; i++) {
+        const gw_ws_client_t *c = &s_clients[i];
+        if (c->fd == 0 || c->batch_due_ms == 0) continue;
+        if (c->batch_due_ms <= now) {
+            due_fds[due_count++] = c->fd;
+        } else if (c->batch_due_ms < next_due) {
+            next_due = c->batch_due_ms;
+        }
+    }
+    portEXIT_CRITICAL(&s_client_lock);
+
+    for (size_t i = 0; i < due_count; i++) {
+        ws_client_pump(due_fds[i]);
+    }
+    // A batch still waiting behind an in-flight frame goes out from the completion
+    // callback, so it does not need another wake-up here.
+    if (next_due == UINT64_MAX) return portMAX_DELAY;
+    return pdMS_TO_TICKS((uint32_t)(next_due - now)) + 1;
 }
 
 static bool msg_kv_get(const char *msg, const char *key, char *out, size_t out_size)
@@ -268,52 +466,9 @@ static bool msg_kv_get(const char *msg, const char *key, char *out, size_t out_s
 
 static void map_state_key(uint16_t cluster, uint16_t attr, char *out, size_t out_size)
 {
-    if (cluster == 0x0006 && attr == 0x0000) {
-        strlcpy(out, "onoff", out_size);
-        return;
-    }
-    if (cluster == 0x0008 && attr == 0x0000) {
-        strlcpy(out, "level", out_size);
-        return;
-    }
-    if (cluster == 0x0300 && attr == 0x0003) {
-        strlcpy(out, "color_x", out_size);
-        return;
-    }
-    if (cluster == 0x0300 && attr == 0x0004) {
-        strlcpy(out, "color_y", out_size);
-        return;
-    }
-    if (cluster == 0x0300 && attr == 0x0007) {
-        strlcpy(out, "color_temp_mireds", out_size);
-        return;
-    }
-    if (cluster == 0x0402 && attr == 0x0000) {
-        strlcpy(out, "temperature_c", out_size);
-        return;
-    }
-    if (cluster == 0x0405 && attr == 0x0000) {
-        strlcpy(out, "humidity_pct", out_size);
-        return;
-    }
-    if (cluster == 0x0001 && attr == 0x0021) {
-        strlcpy(out, "battery_pct", out_size);
-        return;
-    }
-    if (cluster == 0x0001 && attr == 0x0020) {
-        strlcpy(out, "battery_mv", out_size);
-        return;
-    }
-    if (cluster == 0x0406 && attr == 0x0000) {
-        strlcpy(out, "occupancy", out_size);
-        return;
-    }
-    if (cluster == 0x0400 && attr == 0x0000) {
-        strlcpy(out, "illuminance_raw", out_size);
-        return;
-    }
-    if (cluster == 0x0403 && attr == 0x0000) {
-        strlcpy(out, "pressure_raw", out_size);
+    const gw_zb_attr_desc_t *d = gw_zb_attr_find(cluster, attr);
+    if (d) {
+        strlcpy(out, d->state_key, out_size);
         return;
     }
     (void)snprintf(out, out_size, "cluster_%04x_attr_%04x", (unsigned)cluster, (unsigned)attr);
@@ -330,12 +485,83 @@ static bool is_state_event_type(const char *type)
            (strcmp(type, "device.state") == 0);
 }
 
-static bool ws_encode_event(const gw_event_t *e, cbor_wr_t *w)
+static const char *ws_kind_name(ws_kind_t kind)
+{
+    for (size_t i = 0; i < sizeof(kWsKinds) / sizeof(kWsKinds[0]); i++) {
+        if (kWsKinds[i].kind == kind) return kWsKinds[i].name;
+    }
+    return NULL;
+}
+
+static bool is_device_join_type(const char *type)
+{
+    return strcmp(type, "device.join") == 0 || strcmp(type, "zigbee.device_join") == 0;
+}
+
+static bool is_device_leave_type(const char *type)
+{
+    return strcmp(type, "device.leave") == 0 || strcmp(type, "zigbee.device_leave") == 0;
+}
+
+// Which outbound kind `e` becomes, if any. Cheap enough to run on every event, so the
+// per-client filters can be checked before anything is encoded.
+static ws_kind_t ws_event_kind(const gw_event_t *e)
+{
+    if (strcmp(e->type, "rules.fired") == 0) {
+        return WS_KIND_AUTOM_FIRED;
+    }
+    if (strcmp(e->type, "rules.action") == 0) {
+        return WS_KIND_AUTOM_RESULT;
+    }
+    if (strcmp(e->type, "zigbee.command") == 0) {
+        return WS_KIND_DEVICE_EVENT;
+    }
+    if (is_state_event_type(e->type) ||
+        (strcmp(e->type, "zigbee.read_attr_resp") == 0 &&
+         (e->payload_flags & GW_EVENT_PAYLOAD_HAS_VALUE) &&
+         (e->payload_flags & GW_EVENT_PAYLOAD_HAS_ENDPOINT) &&
+         (e->payload_flags & GW_EVENT_PAYLOAD_HAS_CLUSTER) &&
+         (e->payload_flags & GW_EVENT_PAYLOAD_HAS_ATTR))) {
+        return WS_KIND_DEVICE_STATE;
+    }
+    if (is_device_join_type(e->type) || is_device_leave_type(e->type)) {
+        return WS_KIND_DEVICE_EVENT;
+    }
+    if (strncmp(e->type, "zigbee.", 7) == 0 || strncmp(e->type, "zigbee_", 7) == 0 ||
+        strncmp(e->type, "device.", 7) == 0 || strncmp(e->type, "automation.", 11) == 0 ||
+        strncmp(e->type, "settings.", 9) == 0) {
+        return WS_KIND_GATEWAY_EVENT;
+    }
+    return WS_KIND_NONE;
+}
+
+static esp_err_t ws_kv_text(gw_cbor_writer_t *w, const char *key, const char *value)
+{
+    esp_err_t rc = gw_cbor_writer_text(w, key);
+    if (rc == ESP_OK) rc = gw_cbor_writer_text(w, value);
+    return rc;
+}
+
+static esp_err_t ws_kv_u64(gw_cbor_writer_t *w, const char *key, uint64_t value)
 {
-    if (!e || !w) return false;
+    esp_err_t rc = gw_cbor_writer_text(w, key);
+    if (rc == ESP_OK) rc = gw_cbor_writer_u64(w, value);
+    return rc;
+}
+
+static esp_err_t ws_kv_bool(gw_cbor_writer_t *w, const char *key, bool value)
+{
+    esp_err_t rc = gw_cbor_writer_text(w, key);
+    if (rc == ESP_OK) rc = gw_cbor_writer_bool(w, value);
+    return rc;
+}
 
-    const char *out_type = NULL;
-    enum {DATA_AUTOM_FIRED, DATA_AUTOM_RESULT, DATA_DEVICE_EVENT, DATA_DEVICE_STATE, DATA_GENERIC} data_kind;
+static esp_err_t ws_encode_event(const gw_event_t *e, ws_kind_t kind, gw_cbor_writer_t *w, char *coalesce_key, size_t coalesce_key_size)
+{
+    if (!e || !w || !coalesce_key || coalesce_key_size == 0) return ESP_ERR_INVALID_ARG;
+    coalesce_key[0] = '\0';
+
+    const char *out_type = ws_kind_name(kind);
     char automation_id[GW_AUTOMATION_ID_MAX] = {0};
     bool ok = false;
     bool has_ok = false;
@@ -346,15 +572,11 @@ static bool ws_encode_event(const gw_event_t *e, cbor_wr_t *w)
     char state_key[40] = {0};
     const char *device_event_name = "command";
 
-    if (strcmp(e->type, "rules.fired") == 0) {
-        out_type = "automation.fired";
-        data_kind = DATA_AUTOM_FIRED;
-        if (!msg_kv_get(e->msg, "automation_id", automation_id, sizeof(automation_id))) return false;
-    } else if (strcmp(e->type, "rules.action") == 0) {
+    if (kind == WS_KIND_AUTOM_FIRED) {
+        if (!msg_kv_get(e->msg, "automation_id", automation_id, sizeof(automation_id))) return ESP_ERR_NOT_FOUND;
+    } else if (kind == WS_KIND_AUTOM_RESULT) {
         char tmp[16] = {0};
-        out_type = "automation.result";
-        data_kind = DATA_AUTOM_RESULT;
-        if (!msg_kv_get(e->msg, "automation_id", automation_id, sizeof(automation_id))) return false;
+        if (!msg_kv_get(e->msg, "automation_id", automation_id, sizeof(automation_id))) return ESP_ERR_NOT_FOUND;
         if (msg_kv_get(e->msg, "ok", tmp, sizeof(tmp))) {
             has_ok = true;
             ok = (strcmp(tmp, "1") == 0 || strcmp(tmp, "true") == 0);
@@ -368,171 +590,348 @@ static bool ws_encode_event(const gw_event_t *e, cbor_wr_t *w)
             err_ptr += 4;
             if (*err_ptr) err = err_ptr;
         }
-    } else if (strcmp(e->type, "zigbee.command") == 0) {
-        out_type = "device.event";
-        data_kind = DATA_DEVICE_EVENT;
-        device_event_name = "command";
-        if (e->payload_flags & GW_EVENT_PAYLOAD_HAS_CMD) {
+    } else if (kind == WS_KIND_DEVICE_EVENT) {
+        if (is_device_join_type(e->type)) {
+            device_event_name = "join";
+        } else if (is_device_leave_type(e->type)) {
+            device_event_name = "leave";
+        } else if (e->payload_flags & GW_EVENT_PAYLOAD_HAS_CMD) {
             strlcpy(cmd, e->payload_cmd, sizeof(cmd));
         }
-    } else if (is_state_event_type(e->type) ||
-               (strcmp(e->type, "zigbee.read_attr_resp") == 0 &&
-                (e->payload_flags & GW_EVENT_PAYLOAD_HAS_VALUE) &&
-                (e->payload_flags & GW_EVENT_PAYLOAD_HAS_ENDPOINT) &&
-                (e->payload_flags & GW_EVENT_PAYLOAD_HAS_CLUSTER) &&
-                (e->payload_flags & GW_EVENT_PAYLOAD_HAS_ATTR))) {
-        out_type = "device.state";
-        data_kind = DATA_DEVICE_STATE;
+    } else if (kind == WS_KIND_DEVICE_STATE) {
         if ((e->payload_flags & GW_EVENT_PAYLOAD_HAS_CMD) && e->payload_cmd[0] != '\0') {
             strlcpy(state_key, e->payload_cmd, sizeof(state_key));
         } else {
             map_state_key(e->payload_cluster, e->payload_attr, state_key, sizeof(state_key));
         }
-    } else if (strcmp(e->type, "device.join") == 0 || strcmp(e->type, "zigbee.device_join") == 0) {
-        out_type = "device.event";
-        data_kind = DATA_DEVICE_EVENT;
-        device_event_name = "join";
-    } else if (strcmp(e->type, "device.leave") == 0 || strcmp(e->type, "zigbee.device_leave") == 0) {
-        out_type = "device.event";
-        data_kind = DATA_DEVICE_EVENT;
-        device_event_name = "leave";
-    } else if (strncmp(e->type, "zigbee.", 7) == 0 || strncmp(e->type, "zigbee_", 7) == 0 ||
-               strncmp(e->type, "device.", 7) == 0 || strncmp(e->type, "automation.", 11) == 0 ||
-               strncmp(e->type, "settings.", 9) == 0) {
-        out_type = "gateway.event";
-        data_kind = DATA_GENERIC;
-    } else {
-        return false;
+        (void)snprintf(coalesce_key, coalesce_key_size, "%s/%u/%s",
+                       e->device_uid, (unsigned)e->payload_endpoint, state_key);
+    } else if (kind != WS_KIND_GATEWAY_EVENT) {
+        return ESP_ERR_NOT_SUPPORTED;
     }
 
     // envelope: { ts_ms, type, data }
-    if (!cbor_wr_uint(w, 5, 3)) return false;
-    if (!cbor_wr_text(w, "ts_ms") || !cbor_wr_uint(w, 0, e->ts_ms)) return false;
-    if (!cbor_wr_text(w, "type") || !cbor_wr_text(w, out_type)) return false;
-    if (!cbor_wr_text(w, "data")) return false;
+    esp_err_t rc = gw_cbor_writer_map(w, 3);
+    if (rc == ESP_OK) rc = ws_kv_u64(w, "ts_ms", e->ts_ms);
+    if (rc == ESP_OK) rc = ws_kv_text(w, "type", out_type);
+    if (rc == ESP_OK) rc = gw_cbor_writer_text(w, "data");
+    if (rc != ESP_OK) return rc;
 
-    if (data_kind == DATA_AUTOM_FIRED) {
-        if (!cbor_wr_uint(w, 5, 1)) return false;
-        if (!cbor_wr_text(w, "automation_id") || !cbor_wr_text(w, automation_id)) return false;
-        return true;
+    if (kind == WS_KIND_AUTOM_FIRED) {
+        rc = gw_cbor_writer_map(w, 1);
+        if (rc == ESP_OK) rc = ws_kv_text(w, "automation_id", automation_id);
+        return rc;
     }
-    if (data_kind == DATA_AUTOM_RESULT) {
+    if (kind == WS_KIND_AUTOM_RESULT) {
         uint64_t pairs = 2;
         if (has_action_idx) pairs++;
         if (err) pairs++;
-        if (!cbor_wr_uint(w, 5, pairs)) return false;
-        if (!cbor_wr_text(w, "automation_id") || !cbor_wr_text(w, automation_id)) return false;
-        if (!cbor_wr_text(w, "ok") || !cbor_wr_bool(w, has_ok ? ok : false)) return false;
-        if (has_action_idx) {
-            if (!cbor_wr_text(w, "action_idx") || !cbor_wr_uint(w, 0, action_idx)) return false;
-        }
-        if (err) {
-            if (!cbor_wr_text(w, "err") || !cbor_wr_text(w, err)) return false;
-        }
-        return true;
+        rc = gw_cbor_writer_map(w, pairs);
+        if (rc == ESP_OK) rc = ws_kv_text(w, "automation_id", automation_id);
+        if (rc == ESP_OK) rc = ws_kv_bool(w, "ok", has_ok ? ok : false);
+        if (rc == ESP_OK && has_action_idx) rc = ws_kv_u64(w, "action_idx", action_idx);
+        if (rc == ESP_OK && err) rc = ws_kv_text(w, "err", err);
+        return rc;
     }
-    if (data_kind == DATA_DEVICE_EVENT) {
+    if (kind == WS_KIND_DEVICE_EVENT) {
         uint64_t pairs = 3;
         if (e->payload_flags & GW_EVENT_PAYLOAD_HAS_ENDPOINT) pairs++;
         if (cmd[0]) pairs++;
-        if (!cbor_wr_uint(w, 5, pairs)) return false;
-        if (!cbor_wr_text(w, "device_id") || !cbor_wr_text(w, e->device_uid)) return false;
-        if (!cbor_wr_text(w, "event") || !cbor_wr_text(w, device_event_name)) return false;
-        if (!cbor_wr_text(w, "source") || !cbor_wr_text(w, "zigbee")) return false;
-        if (e->payload_flags & GW_EVENT_PAYLOAD_HAS_ENDPOINT) {
-            if (!cbor_wr_text(w, "endpoint_id") || !cbor_wr_uint(w, 0, e->payload_endpoint)) return false;
+        rc = gw_cbor_writer_map(w, pairs);
+        if (rc == ESP_OK) rc = ws_kv_text(w, "device_id", e->device_uid);
+        if (rc == ESP_OK) rc = ws_kv_text(w, "event", device_event_name);
+        if (rc == ESP_OK) rc = ws_kv_text(w, "source", "zigbee");
+        if (rc == ESP_OK && (e->payload_flags & GW_EVENT_PAYLOAD_HAS_ENDPOINT)) {
+            rc = ws_kv_u64(w, "endpoint_id", e->payload_endpoint);
         }
-        if (cmd[0]) {
-            if (!cbor_wr_text(w, "cmd") || !cbor_wr_text(w, cmd)) return false;
-        }
-        return true;
+        if (rc == ESP_OK && cmd[0]) rc = ws_kv_text(w, "cmd", cmd);
+        return rc;
     }
-    if (data_kind == DATA_GENERIC) {
+    if (kind == WS_KIND_GATEWAY_EVENT) {
         uint64_t pairs = 4;
         if (e->device_uid[0] != '\0') pairs++;
         if (e->short_addr != 0) pairs++;
         if (e->payload_flags & GW_EVENT_PAYLOAD_HAS_ENDPOINT) pairs++;
         if (e->payload_flags & GW_EVENT_PAYLOAD_HAS_CLUSTER) pairs++;
         if (e->payload_flags & GW_EVENT_PAYLOAD_HAS_ATTR) pairs++;
-        if (!cbor_wr_uint(w, 5, pairs)) return false;
-        if (!cbor_wr_text(w, "event_type") || !cbor_wr_text(w, e->type)) return false;
-        if (!cbor_wr_text(w, "source") || !cbor_wr_text(w, e->source)) return false;
-        if (!cbor_wr_text(w, "msg") || !cbor_wr_text(w, e->msg)) return false;
-        if (!cbor_wr_text(w, "has_value") || !cbor_wr_bool(w, (e->payload_flags & GW_EVENT_PAYLOAD_HAS_VALUE) != 0)) return false;
-        if (e->device_uid[0] != '\0') {
-            if (!cbor_wr_text(w, "device_id") || !cbor_wr_text(w, e->device_uid)) return false;
-        }
-        if (e->short_addr != 0) {
-            if (!cbor_wr_text(w, "short_addr") || !cbor_wr_uint(w, 0, e->short_addr)) return false;
+        rc = gw_cbor_writer_map(w, pairs);
+        if (rc == ESP_OK) rc = ws_kv_text(w, "event_type", e->type);
+        if (rc == ESP_OK) rc = ws_kv_text(w, "source", e->source);
+        if (rc == ESP_OK) rc = ws_kv_text(w, "msg", e->msg);
+        if (rc == ESP_OK) rc = ws_kv_bool(w, "has_value", (e->payload_flags & GW_EVENT_PAYLOAD_HAS_VALUE) != 0);
+        if (rc == ESP_OK && e->device_uid[0] != '\0') rc = ws_kv_text(w, "device_id", e->device_uid);
+        if (rc == ESP_OK && e->short_addr != 0) rc = ws_kv_u64(w, "short_addr", e->short_addr);
+        if (rc == ESP_OK && (e->payload_flags & GW_EVENT_PAYLOAD_HAS_ENDPOINT)) {
+            rc = ws_kv_u64(w, "endpoint_id", e->payload_endpoint);
         }
-        if (e->payload_flags & GW_EVENT_PAYLOAD_HAS_ENDPOINT) {
-            if (!cbor_wr_text(w, "endpoint_id") || !cbor_wr_uint(w, 0, e->payload_endpoint)) return false;
+        if (rc == ESP_OK && (e->payload_flags & GW_EVENT_PAYLOAD_HAS_CLUSTER)) {
+            rc = ws_kv_u64(w, "cluster", e->payload_cluster);
         }
-        if (e->payload_flags & GW_EVENT_PAYLOAD_HAS_CLUSTER) {
-            if (!cbor_wr_text(w, "cluster") || !cbor_wr_uint(w, 0, e->payload_cluster)) return false;
+        if (rc == ESP_OK && (e->payload_flags & GW_EVENT_PAYLOAD_HAS_ATTR)) {
+            rc = ws_kv_u64(w, "attr", e->payload_attr);
         }
-        if (e->payload_flags & GW_EVENT_PAYLOAD_HAS_ATTR) {
-            if (!cbor_wr_text(w, "attr") || !cbor_wr_uint(w, 0, e->payload_attr)) return false;
-        }
-        return true;
+        return rc;
     }
 
-    if (!cbor_wr_uint(w, 5, 4)) return false;
-    if (!cbor_wr_text(w, "device_id") || !cbor_wr_text(w, e->device_uid)) return false;
-    if (!cbor_wr_text(w, "endpoint_id") || !cbor_wr_uint(w, 0, e->payload_endpoint)) return false;
-    if (!cbor_wr_text(w, "key") || !cbor_wr_text(w, state_key)) return false;
-    if (!cbor_wr_text(w, "value")) return false;
+    rc = gw_cbor_writer_map(w, 4);
+    if (rc == ESP_OK) rc = ws_kv_text(w, "device_id", e->device_uid);
+    if (rc == ESP_OK) rc = ws_kv_u64(w, "endpoint_id", e->payload_endpoint);
+    if (rc == ESP_OK) rc = ws_kv_text(w, "key", state_key);
+    if (rc == ESP_OK) rc = gw_cbor_writer_text(w, "value");
+    if (rc != ESP_OK) return rc;
     if (!(e->payload_flags & GW_EVENT_PAYLOAD_HAS_VALUE)) {
-        return cbor_wr_null(w);
+        return gw_cbor_writer_null(w);
     }
     switch ((gw_event_value_type_t)e->payload_value_type) {
         case GW_EVENT_VALUE_BOOL:
-            return cbor_wr_bool(w, e->payload_value_bool != 0);
+            return gw_cbor_writer_bool(w, e->payload_value_bool != 0);
         case GW_EVENT_VALUE_I64:
-            return cbor_wr_i64(w, e->payload_value_i64);
+            return gw_cbor_writer_i64(w, e->payload_value_i64);
         case GW_EVENT_VALUE_F64:
-            return cbor_wr_f64(w, e->payload_value_f64);
+            return gw_cbor_writer_f64(w, e->payload_value_f64);
         case GW_EVENT_VALUE_TEXT:
-            return cbor_wr_text(w, e->payload_value_text);
+            return gw_cbor_writer_text(w, e->payload_value_text);
         default:
-            return cbor_wr_null(w);
+            return gw_cbor_writer_null(w);
     }
 }
 
-static void ws_event_task_fn(void *arg)
+static bool ws_target_match(const ws_target_t *t, size_t count, const char *uid, uint8_t endpoint)
 {
-    (void)arg;
-    gw_event_t e;
-    for (;;) {
-        if (xQueueReceive(s_event_q, &e, portMAX_DELAY) != pdTRUE) {
-            continue;
+    for (size_t i = 0; i < count; i++) {
+        if (strcmp(t[i].uid, uid) == 0 && (t[i].endpoint == 0 || endpoint == 0 || t[i].endpoint == endpoint)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Called with s_client_lock held.
+static bool ws_client_wants_locked(const gw_ws_client_t *c, ws_kind_t kind, const gw_event_t *e)
+{
+    const ws_filter_t *f = &c->filter;
+    if (!(f->kinds & kind)) return false;
+    if (e->device_uid[0] == '\0' || (f->device_count == 0 && f->group_id[0] == '\0')) return true;
+
+    const uint8_t endpoint = (e->payload_flags & GW_EVENT_PAYLOAD_HAS_ENDPOINT) ? e->payload_endpoint : 0;
+    if (ws_target_match(f->devices, f->device_count, e->device_uid, endpoint)) return true;
+    return f->group_id[0] != '\0' && ws_target_match(c->members, c->member_count, e->device_uid, endpoint);
+}
+
+// Re-resolves group filters whose member list is missing or older than the group store.
+static void ws_refresh_group_members(void)
+{
+    bool needed = false;
+    const uint32_t version = gw_group_store_version();
+    portENTER_CRITICAL(&s_client_lock);
+    for (size_t i = 0; i < GW_WS_MAX_CLIENTS; i++) {
+        const gw_ws_client_t *c = &s_clients[i];
+        if (c->fd != 0 && c->filter.group_id[0] != '\0' && (!c->members_valid || c->members_version != version)) {
+            needed = true;
         }
-        gw_event_bus_record_event(&e);
+    }
+    portEXIT_CRITICAL(&s_client_lock);
+    if (!needed) return;
 
-        int fds[GW_WS_MAX_CLIENTS];
-        size_t fd_count = 0;
+    gw_group_item_t *items = (gw_group_item_t *)calloc(GW_WS_GROUP_ITEMS_MAX, sizeof(gw_group_item_t));
+    if (!items) return; // retried on the next event
+    const size_t item_count = gw_group_store_list_items(items, GW_WS_GROUP_ITEMS_MAX);
+
+    for (size_t i = 0; i < GW_WS_MAX_CLIENTS; i++) {
+        int fd = 0;
+        char group_id[GW_GROUP_ID_MAX] = {0};
         portENTER_CRITICAL(&s_client_lock);
-        for (size_t i = 0; i < GW_WS_MAX_CLIENTS; i++) {
-            if (s_clients[i].fd != 0 && s_clients[i].subscribed_events) {
-                fds[fd_count++] = s_clients[i].fd;
-            }
+        const gw_ws_client_t *c = &s_clients[i];
+        if (c->fd != 0 && c->filter.group_id[0] != '\0' && (!c->members_valid || c->members_version != version)) {
+            fd = c->fd;
+            strlcpy(group_id, c->filter.group_id, sizeof(group_id));
         }
         portEXIT_CRITICAL(&s_client_lock);
-        if (fd_count == 0) continue;
+        if (fd == 0) continue;
 
-        cbor_wr_t w = {0};
-        if (!ws_encode_event(&e, &w)) {
-            free(w.buf);
-            continue;
+        ws_target_t members[GW_WS_FILTER_MAX_MEMBERS];
+        size_t member_count = 0;
+        for (size_t j = 0; j < item_count && member_count < GW_WS_FILTER_MAX_MEMBERS; j++) {
+            if (strcmp(items[j].group_id, group_id) != 0) continue;
+            strlcpy(members[member_count].uid, items[j].device_uid.uid, sizeof(members[member_count].uid));
+            members[member_count].endpoint = items[j].endpoint;
+            member_count++;
         }
-        for (size_t i = 0; i < fd_count; i++) {
-            esp_err_t err = ws_send_cbor_async(fds[i], w.buf, w.len);
-            if (err == ESP_ERR_NO_MEM) {
-                ESP_LOGW(TAG, "WS send OOM; dropping event");
-                break;
+
+        portENTER_CRITICAL(&s_client_lock);
+        gw_ws_client_t *cur = &s_clients[i];
+        if (cur->fd == fd && strcmp(cur->filter.group_id, group_id) == 0) {
+            memcpy(cur->members, members, member_count * sizeof(members[0]));
+            cur->member_count = (uint8_t)member_count;
+            cur->members_version = version;
+            cur->members_valid = true;
+        }
+        portEXIT_CRITICAL(&s_client_lock);
+    }
+    free(items);
+}
+
+static bool ws_read_text(gw_cbor_reader_t *r, char *out, size_t out_size)
+{
+    uint8_t b = 0;
+    const uint8_t *ptr = NULL;
+    size_t len = 0;
+    if (!gw_cbor_read_u8(r, &b) || (b >> 5) != 3) return false;
+    if (!gw_cbor_read_text_span(r, b & 0x1f, &ptr, &len)) return false;
+    if (len >= out_size) len = out_size - 1;
+    memcpy(out, ptr, len);
+    out[len] = '\0';
+    return true;
+}
+
+// Reads a definite-length array header; returns false for anything else.
+static bool ws_read_array(gw_cbor_reader_t *r, const gw_cbor_slice_t *s, uint64_t *out_count)
+{
+    uint8_t b = 0;
+    gw_cbor_reader_init(r, s->ptr, s->len);
+    if (!gw_cbor_read_u8(r, &b) || (b >> 5) != 4) return false;
+    return gw_cbor_read_uint_arg(r, b & 0x1f, out_count);
+}
+
+// Parses a {"type":"subscribe", ...} message into `f`; false if it is not one.
+static bool ws_parse_subscribe(const uint8_t *buf, size_t len, ws_filter_t *f)
+{
+    gw_cbor_slice_t v = {0};
+    const uint8_t *type = NULL;
+    size_t type_len = 0;
+    if (!gw_cbor_map_find(buf, len, "type", &v) || !gw_cbor_slice_to_text_span(&v, &type, &type_len)) return false;
+    if (type_len != 9 || memcmp(type, "subscribe", 9) != 0) return false;
+
+    *f = (ws_filter_t){.kinds = WS_KIND_ALL};
+    gw_cbor_reader_t r;
+    uint64_t count = 0;
+    if (gw_cbor_map_find(buf, len, "kinds", &v)) {
+        if (!ws_read_array(&r, &v, &count)) return false;
+        f->kinds = 0;
+        for (uint64_t i = 0; i < count; i++) {
+            char name[24];
+            if (!ws_read_text(&r, name, sizeof(name))) return false;
+            for (size_t k = 0; k < sizeof(kWsKinds) / sizeof(kWsKinds[0]); k++) {
+                if (strcmp(kWsKinds[k].name, name) == 0) f->kinds |= kWsKinds[k].kind;
             }
         }
-        free(w.buf);
+    }
+    if (gw_cbor_map_find(buf, len, "devices", &v)) {
+        if (!ws_read_array(&r, &v, &count)) return false;
+        for (uint64_t i = 0; i < count; i++) {
+            char uid[GW_DEVICE_UID_STRLEN];
+            if (!ws_read_text(&r, uid, sizeof(uid))) return false;
+            if (f->device_count < GW_WS_FILTER_MAX_DEVICES && uid[0]) {
+                strlcpy(f->devices[f->device_count++].uid, uid, sizeof(f->devices[0].uid));
+            }
+        }
+    }
+    if (gw_cbor_map_find(buf, len, "group", &v)) {
+        gw_cbor_reader_init(&r, v.ptr, v.len);
+        if (!ws_read_text(&r, f->group_id, sizeof(f->group_id))) return false;
+    }
+    if (gw_cbor_map_find(buf, len, "batch", &v) && !gw_cbor_slice_to_bool(&v, &f->batch)) return false;
+    return true;
+}
+
+static void ws_client_set_filter(int fd, const ws_filter_t *f)
+{
+    // The batch buffer is allocated here, outside the lock; batching stays off without it.
+    ws_msg_t *batch_buf = f->batch ? ws_msg_alloc(GW_WS_BATCH_HDR_MAX + GW_WS_BATCH_MAX_BYTES) : NULL;
+    if (f->batch && !batch_buf) {
+        ESP_LOGW(TAG, "WS batch buffer OOM; fd=%d gets single frames", fd);
+    }
+
+    ws_msg_t *unused = batch_buf;
+    portENTER_CRITICAL(&s_client_lock);
+    gw_ws_client_t *c = ws_client_find_locked(fd);
+    if (c) {
+        c->filter = *f;
+        c->members_valid = false;
+        c->member_count = 0;
+        if (batch_buf && !c->batch_buf) {
+            c->batch_buf = batch_buf;
+            unused = NULL;
+        } else if (!batch_buf && c->batch_buf) {
+            unused = c->batch_buf; // an in-flight batch keeps its own reference
+            c->batch_buf = NULL;
+        }
+    }
+    portEXIT_CRITICAL(&s_client_lock);
+    ws_msg_release(unused);
+}
+
+// Typical events encode into a stack buffer, so the shared frame is the only heap
+// block; an oversized one is measured first and encoded straight into its frame.
+static ws_msg_t *ws_msg_encode_event(const gw_event_t *e, ws_kind_t kind)
+{
+    uint8_t enc[GW_WS_EVENT_ENC_MAX];
+    char coalesce_key[GW_WS_COALESCE_KEY_MAX];
+    gw_cbor_writer_t w;
+    gw_cbor_writer_init_fixed(&w, enc, sizeof(enc));
+    esp_err_t rc = ws_encode_event(e, kind, &w, coalesce_key, sizeof(coalesce_key));
+    ws_msg_t *m = NULL;
+    if (rc == ESP_OK) {
+        m = ws_msg_new(enc, w.len, coalesce_key);
+    } else if (rc == ESP_ERR_INVALID_SIZE) {
+        gw_cbor_writer_init_measure(&w);
+        rc = ws_encode_event(e, kind, &w, coalesce_key, sizeof(coalesce_key));
+        const size_t len = w.len;
+        m = rc == ESP_OK ? ws_msg_alloc(len) : NULL;
+        if (m) {
+            gw_cbor_writer_init_fixed(&w, m->data, len);
+            rc = ws_encode_event(e, kind, &w, coalesce_key, sizeof(coalesce_key));
+            m->len = w.len;
+            strlcpy(m->coalesce_key, coalesce_key, sizeof(m->coalesce_key));
+        }
+    }
+    if (rc != ESP_OK) {
+        ws_msg_release(m);
+        return NULL;
+    }
+    if (!m) {
+        ESP_LOGW(TAG, "WS event OOM; dropping event");
+    }
+    return m;
+}
+
+static void ws_dispatch_event(const gw_event_t *e)
+{
+    const ws_kind_t kind = ws_event_kind(e);
+    if (kind == WS_KIND_NONE) return;
+    ws_refresh_group_members();
+
+    // Filter first: nothing is encoded unless some client wants the event.
+    int fds[GW_WS_MAX_CLIENTS];
+    size_t fd_count = 0;
+    portENTER_CRITICAL(&s_client_lock);
+    for (size_t i = 0; i < GW_WS_MAX_CLIENTS; i++) {
+        if (s_clients[i].fd != 0 && s_clients[i].subscribed_events && ws_client_wants_locked(&s_clients[i], kind, e)) {
+            fds[fd_count++] = s_clients[i].fd;
+        }
+    }
+    portEXIT_CRITICAL(&s_client_lock);
+    if (fd_count == 0) return;
+
+    ws_msg_t *m = ws_msg_encode_event(e, kind);
+    if (!m) return;
+    for (size_t i = 0; i < fd_count; i++) {
+        ws_client_enqueue(fds[i], m);
+    }
+    ws_msg_release(m);
+}
+
+static void ws_event_task_fn(void *arg)
+{
+    (void)arg;
+    gw_event_t e;
+    TickType_t wait = portMAX_DELAY;
+    for (;;) {
+        if (xQueueReceive(s_event_q, &e, wait) == pdTRUE) {
+            gw_event_bus_record_event(&e);
+            ws_dispatch_event(&e);
+        }
+        wait = ws_flush_due_batches();
     }
 }
 
@@ -571,6 +970,12 @@ static esp_err_t ws_handler(httpd_req_t *req)
         if (!buf) return ESP_ERR_NO_MEM;
         frame.payload = buf;
         err = httpd_ws_recv_frame(req, &frame, frame.len);
+        if (err == ESP_OK) {
+            ws_filter_t filter;
+            if (ws_parse_subscribe(buf, frame.len, &filter)) {
+                ws_client_set_filter(fd, &filter);
+            }
+        }
         free(buf);
         if (err != ESP_OK) return err;
     }
@@ -657,9 +1062,15 @@ void gw_ws_unregister(void)
     if (!s_server) return;
 
     gw_event_bus_set_out_queue(NULL);
-    portENTER_CRITICAL(&s_client_lock);
-    memset(s_clients, 0, sizeof(s_clients));
-    portEXIT_CRITICAL(&s_client_lock);
+    for (size_t i = 0; i < GW_WS_MAX_CLIENTS; i++) {
+        ws_msg_t *drop[GW_WS_CLIENT_Q_CAP + 1];
+        portENTER_CRITICAL(&s_client_lock);
+        const size_t drop_count = ws_client_clear_locked(&s_clients[i], drop);
+        portEXIT_CRITICAL(&s_client_lock);
+        for (size_t j = 0; j < drop_count; j++) {
+            ws_msg_release(drop[j]);
+        }
+    }
 
     if (s_event_task) {
         vTaskDelete(s_event_task);
@@ -676,5 +1087,3 @@ void gw_ws_unregister(void)
     }
     s_server = NULL;
 }
-
-
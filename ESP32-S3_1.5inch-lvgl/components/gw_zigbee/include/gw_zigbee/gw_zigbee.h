@@ -1,6 +1,7 @@
 #pragma once
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 #include "esp_err.h"
@@ -20,6 +21,7 @@ typedef enum {
 typedef struct {
     uint8_t level;          // 0..254
     uint16_t transition_ms; // 0 = immediate
+    bool with_onoff;        // send Move to Level (with On/Off): level 0 turns off, above 0 turns on
 } gw_zigbee_level_t;
 
 typedef struct {
@@ -41,6 +43,27 @@ esp_err_t gw_zigbee_sync_device_fb(void);
 bool gw_zigbee_bootstrap_ready(void);
 // True when initial read_attr warmup task has queued all startup reads.
 bool gw_zigbee_state_warmup_ready(void);
+
+// Warm-up priority hint. The warm-up reads hinted endpoints first (VISIBLE before NEAR) and
+// holds the others back, so a natural attribute report can make their read unnecessary.
+// Without a hint everything is read in registry order.
+typedef enum {
+    GW_ZIGBEE_WARMUP_PRIO_VISIBLE = 0, // on screen now
+    GW_ZIGBEE_WARMUP_PRIO_NEAR = 1,    // one navigation step away
+    GW_ZIGBEE_WARMUP_PRIO_LOW = 2,     // everything else (not listed in the hint)
+} gw_zigbee_warmup_prio_t;
+
+typedef struct {
+    gw_device_uid_t uid;
+    uint8_t endpoint;
+    uint8_t prio; // gw_zigbee_warmup_prio_t
+} gw_zigbee_warmup_hint_t;
+
+#define GW_ZIGBEE_WARMUP_HINT_MAX 64
+
+// Replace the hint; it may change at any time while the warm-up runs. Entries past
+// GW_ZIGBEE_WARMUP_HINT_MAX are dropped, so list the most important ones first.
+void gw_zigbee_warmup_set_hint(const gw_zigbee_warmup_hint_t *hints, size_t count);
 // Set user device name on C6 by UID.
 esp_err_t gw_zigbee_set_device_name(const gw_device_uid_t *uid, const char *name);
 // Remove device from C6 device registry by UID.
@@ -85,6 +108,20 @@ esp_err_t gw_zigbee_group_color_move_to_temp(uint16_t group_id, gw_zigbee_color_
 esp_err_t gw_zigbee_read_onoff_state(const gw_device_uid_t *uid, uint8_t endpoint);
 // Request current value for any attribute from a specific endpoint.
 esp_err_t gw_zigbee_read_attr(const gw_device_uid_t *uid, uint8_t endpoint, uint16_t cluster_id, uint16_t attr_id);
+// Request several attributes of one cluster in a single ZCL Read Attributes frame.
+// ESP_ERR_NO_MEM: reads already fill their share of the C6 command queue, ask again later.
+#define GW_ZIGBEE_READ_ATTRS_MAX 8
+esp_err_t gw_zigbee_read_attrs(const gw_device_uid_t *uid, uint8_t endpoint, uint16_t cluster_id, const uint16_t *attr_ids, size_t count);
+
+// Pipelined commands. Between begin and end, the commands the calling task issues go
+// out without waiting for their response, several in flight at once; other tasks'
+// commands wait until end. Each command left in flight takes the next entry of `results`
+// (see gw_zigbee_pipeline_next()), which holds its final status once end returns. A
+// command whose status is already final when it returns (e.g. it failed before being
+// sent) takes no entry.
+esp_err_t gw_zigbee_pipeline_begin(esp_err_t *results, size_t cap);
+size_t gw_zigbee_pipeline_next(void);
+void gw_zigbee_pipeline_end(void);
 
 // Scenes (group-based).
 esp_err_t gw_zigbee_scene_store(uint16_t group_id, uint8_t scene_id);
@@ -94,6 +131,10 @@ esp_err_t gw_zigbee_scene_recall(uint16_t group_id, uint8_t scene_id);
 esp_err_t gw_zigbee_bind(const gw_device_uid_t *src_uid, uint8_t src_endpoint, uint16_t cluster_id, const gw_device_uid_t *dst_uid, uint8_t dst_endpoint);
 esp_err_t gw_zigbee_unbind(const gw_device_uid_t *src_uid, uint8_t src_endpoint, uint16_t cluster_id, const gw_device_uid_t *dst_uid, uint8_t dst_endpoint);
 
+// Replace the automations the C6 runs locally with a packed GWAR bundle (len 0 clears
+// them). Returns ESP_OK once the C6 has verified and activated the whole bundle.
+esp_err_t gw_zigbee_rules_push(const uint8_t *bundle, size_t len);
+
 // Management / diagnostics primitives.
 // Request a remote device's APS binding table (Mgmt_Bind_req). Results are published via event bus.
 esp_err_t gw_zigbee_binding_table_req(const gw_device_uid_t *uid, uint8_t start_index);
@@ -8,6 +8,7 @@
 #include "esp_check.h"
 #include "esp_heap_caps.h"
 #include "esp_log.h"
+#include "esp_rom_crc.h"
 #include "esp_timer.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/portmacro.h"
@@ -21,6 +22,7 @@
 #include "gw_core/device_storage.h"
 #include "gw_core/runtime_sync.h"
 #include "gw_core/state_store.h"
+#include "gw_core/zb_attr_map.h"
 
 static const char *TAG = "gw_zigbee_uart";
 
@@ -51,6 +53,37 @@ static const char *TAG = "gw_zigbee_uart";
 #define GW_DEVICE_FB_IDLE_TIMEOUT_US (3000000LL)
 #define GW_DEVICE_FB_RETRY_GAP_US    (1000000LL)
 #define GW_DEVICE_FB_RETRY_MAX       6
+// State warm-up: endpoints outside the UI hint wait this long before their first read,
+// then go out one endpoint per gap.
+#define GW_WARMUP_LOW_PRIO_DELAY_MS  3000
+#define GW_WARMUP_LOW_PRIO_GAP_MS    100
+// A read the C6 refused as BUSY (its command queue holds its share of reads) goes out
+// again after a backoff that doubles per attempt. The warm-up waits meanwhile, so it never
+// keeps more reads outstanding than the C6 accepts.
+#define GW_WARMUP_BUSY_BACKOFF_MS     200
+#define GW_WARMUP_BUSY_BACKOFF_MAX_MS 3200
+#define GW_WARMUP_BUSY_RETRY_MAX      8
+
+// Pipelined commands (gw_zigbee_pipeline_begin/end): the owning task holds s_cmd_lock for
+// the whole run and keeps up to GW_UART_PIPELINE_DEPTH requests in flight. The C6 serves
+// CMD_REQ frames in arrival order; the depth keeps them inside its 1 KiB RX buffer.
+#define GW_UART_PIPELINE_DEPTH 4
+
+typedef struct {
+    uint16_t seq;
+    uint16_t status;
+    size_t slot; // index into s_pipe.results
+    bool active; // sent, slot not collected yet (guarded by s_wait_lock)
+    bool done;   // response arrived, status is valid (guarded by s_wait_lock)
+} gw_uart_pipe_req_t;
+
+static struct {
+    TaskHandle_t owner;
+    esp_err_t *results;
+    size_t cap;
+    size_t next;
+    gw_uart_pipe_req_t inflight[GW_UART_PIPELINE_DEPTH];
+} s_pipe;
 
 static TaskHandle_t s_rx_task;
 static SemaphoreHandle_t s_init_lock;
@@ -80,8 +113,13 @@ static int64_t s_device_fb_last_chunk_us;
 static int64_t s_device_fb_last_retry_us;
 static uint8_t s_device_fb_retry_count;
 static TaskHandle_t s_initial_state_sync_task;
+static uint16_t s_rules_transfer_id;
 static bool s_initial_state_sync_done;
 static bool s_initial_state_sync_started;
+static portMUX_TYPE s_warmup_hint_lock = portMUX_INITIALIZER_UNLOCKED;
+static gw_zigbee_warmup_hint_t s_warmup_hint[GW_ZIGBEE_WARMUP_HINT_MAX];
+static size_t s_warmup_hint_count;
+static uint32_t s_warmup_hint_gen;
 static esp_err_t uart_send_frame(uint8_t msg_type, uint16_t seq, const void *payload, uint16_t payload_len);
 static esp_err_t send_cmd_wait_rsp(gw_uart_cmd_req_v1_t *req);
 static esp_err_t request_snapshot_sync(void);
@@ -144,6 +182,8 @@ static const char *msg_type_name(uint8_t t)
             return "SNAPSHOT";
         case GW_UART_MSG_DEVICE_FB:
             return "DEVICE_FB";
+        case GW_UART_MSG_RULES_BUNDLE:
+            return "RULES_BUNDLE";
         default:
             return "UNKNOWN";
     }
@@ -198,6 +238,18 @@ static const char *cmd_id_name(uint8_t cmd_id)
             return "WIFI_CONFIG_SET";
         case GW_UART_CMD_NET_SERVICES_START:
             return "NET_SERVICES_START";
+        case GW_UART_CMD_BIND:
+            return "BIND";
+        case GW_UART_CMD_UNBIND:
+            return "UNBIND";
+        case GW_UART_CMD_RULES_COMMIT:
+            return "RULES_COMMIT";
+        case GW_UART_CMD_GROUP_ONOFF:
+            return "GROUP_ONOFF";
+        case GW_UART_CMD_GROUP_LEVEL:
+            return "GROUP_LEVEL";
+        case GW_UART_CMD_READ_ATTRS:
+            return "READ_ATTRS";
         default:
             return "UNKNOWN";
     }
@@ -494,30 +546,135 @@ static bool state_key_present_and_valid(const gw_device_uid_t *uid, uint8_t endp
     return true;
 }
 
-static void queue_read_attr_if_missing(const gw_device_uid_t *uid,
-                                       const gw_zb_endpoint_t *ep,
-                                       uint16_t cluster_id,
-                                       uint16_t attr_id,
-                                       const char *state_key,
-                                       uint32_t *ok_count,
-                                       uint32_t *missing_count)
+// Queue one READ_ATTRS for the attributes of `rows` (one cluster) that have no valid state
+// yet on this endpoint. Returns the number of attributes requested.
+static size_t queue_cluster_reads(const gw_device_uid_t *uid,
+                                  const gw_zb_endpoint_t *ep,
+                                  const gw_zb_attr_desc_t *rows,
+                                  size_t row_count)
 {
-    if (!uid || !ep) {
-        return;
+    uint16_t attrs[GW_ZIGBEE_READ_ATTRS_MAX];
+    size_t n = 0;
+    for (size_t i = 0; i < row_count && n < GW_ZIGBEE_READ_ATTRS_MAX; i++) {
+        if (!state_key_present_and_valid(uid, ep->endpoint, rows[i].state_key)) {
+            attrs[n++] = rows[i].attr;
+        }
     }
-    if (!endpoint_has_in_cluster(ep, cluster_id)) {
-        return;
+    if (n == 0) {
+        return 0;
     }
-    if (state_key_present_and_valid(uid, ep->endpoint, state_key)) {
-        return;
+    (void)gw_zigbee_read_attrs(uid, ep->endpoint, rows[0].cluster, attrs, n);
+    return n;
+}
+
+// Read the missing mapped attributes of every cluster the endpoint implements, one frame
+// per cluster, pipelined over the UART. Frames the C6 refused as busy are sent again after
+// a backoff. Returns the number of frames the C6 accepted; refusals add to `busy_count`.
+static uint32_t queue_endpoint_reads(const gw_device_uid_t *uid,
+                                     const gw_zb_endpoint_t *ep,
+                                     uint32_t *missing_count,
+                                     uint32_t *busy_count)
+{
+    size_t table_count = 0;
+    const gw_zb_attr_desc_t *table = gw_zb_attr_table(&table_count);
+    esp_err_t results[GW_ZB_MAX_CLUSTERS];
+    size_t run_first[GW_ZB_MAX_CLUSTERS]; // table rows of each cluster still to send
+    size_t run_len[GW_ZB_MAX_CLUSTERS];
+    size_t frame_run[GW_ZB_MAX_CLUSTERS]; // run each pipelined frame was built from
+    size_t runs = 0;
+
+    for (size_t i = 0; i < table_count;) {
+        size_t run = 1;
+        while (i + run < table_count && table[i + run].cluster == table[i].cluster) {
+            run++;
+        }
+        if (endpoint_has_in_cluster(ep, table[i].cluster) && runs < GW_ZB_MAX_CLUSTERS) {
+            run_first[runs] = i;
+            run_len[runs] = run;
+            runs++;
+        }
+        i += run;
     }
-    if (missing_count) {
-        (*missing_count)++;
+
+    uint32_t ok = 0;
+    uint32_t backoff_ms = GW_WARMUP_BUSY_BACKOFF_MS;
+    for (int attempt = 0; runs > 0; attempt++) {
+        if (attempt > 0) {
+            if (attempt > GW_WARMUP_BUSY_RETRY_MAX) {
+                ESP_LOGW(TAG, "warm-up reads refused: uid=%s ep=%u clusters=%u",
+                         uid->uid, (unsigned)ep->endpoint, (unsigned)runs);
+                break;
+            }
+            vTaskDelay(pdMS_TO_TICKS(backoff_ms));
+            backoff_ms = backoff_ms * 2 > GW_WARMUP_BUSY_BACKOFF_MAX_MS ? GW_WARMUP_BUSY_BACKOFF_MAX_MS : backoff_ms * 2;
+        }
+        if (gw_zigbee_pipeline_begin(results, GW_ZB_MAX_CLUSTERS) != ESP_OK) {
+            break;
+        }
+        for (size_t r = 0; r < runs; r++) {
+            const size_t frame = gw_zigbee_pipeline_next();
+            const size_t n = queue_cluster_reads(uid, ep, &table[run_first[r]], run_len[r]);
+            if (attempt == 0) {
+                *missing_count += (uint32_t)n;
+            }
+            if (gw_zigbee_pipeline_next() > frame) {
+                frame_run[frame] = r;
+            }
+        }
+        const size_t frames = gw_zigbee_pipeline_next();
+        gw_zigbee_pipeline_end();
+
+        // Keep the refused runs, in order, for the next attempt (frame_run[f] >= f >= kept).
+        size_t kept = 0;
+        for (size_t f = 0; f < frames; f++) {
+            if (results[f] == ESP_OK) {
+                ok++;
+            } else if (results[f] == ESP_ERR_NO_MEM) {
+                (*busy_count)++;
+                run_first[kept] = run_first[frame_run[f]];
+                run_len[kept] = run_len[frame_run[f]];
+                kept++;
+            }
+        }
+        runs = kept;
     }
-    if (gw_zigbee_read_attr(uid, ep->endpoint, cluster_id, attr_id) == ESP_OK && ok_count) {
-        (*ok_count)++;
+    return ok;
+}
+
+static uint8_t warmup_prio_of(const gw_zb_endpoint_t *ep, const gw_zigbee_warmup_hint_t *hint, size_t hint_count)
+{
+    for (size_t i = 0; i < hint_count; i++) {
+        if (hint[i].endpoint == ep->endpoint && strncmp(hint[i].uid.uid, ep->uid.uid, sizeof(ep->uid.uid)) == 0) {
+            return hint[i].prio;
+        }
     }
-    vTaskDelay(pdMS_TO_TICKS(10));
+    return GW_ZIGBEE_WARMUP_PRIO_LOW;
+}
+
+// Re-rank the endpoints when the UI published a new hint since the last call. Returns the
+// new hint length, or SIZE_MAX when the hint did not change.
+static size_t warmup_refresh_prio(const gw_zb_endpoint_t *eps,
+                                  size_t ep_count,
+                                  uint8_t *prio,
+                                  gw_zigbee_warmup_hint_t *hint,
+                                  uint32_t *seen_gen)
+{
+    size_t hint_count = 0;
+    portENTER_CRITICAL(&s_warmup_hint_lock);
+    const uint32_t gen = s_warmup_hint_gen;
+    if (gen != *seen_gen) {
+        hint_count = s_warmup_hint_count;
+        memcpy(hint, s_warmup_hint, hint_count * sizeof(hint[0]));
+    }
+    portEXIT_CRITICAL(&s_warmup_hint_lock);
+    if (gen == *seen_gen) {
+        return SIZE_MAX;
+    }
+    *seen_gen = gen;
+    for (size_t i = 0; i < ep_count; i++) {
+        prio[i] = warmup_prio_of(&eps[i], hint, hint_count);
+    }
+    return hint_count;
 }
 
 static void initial_state_sync_task(void *arg)
@@ -526,19 +683,21 @@ static void initial_state_sync_task(void *arg)
     uint32_t ok_count = 0;
     uint32_t missing_before = 0;
     uint32_t missing_after = 0;
+    uint32_t deferred = 0;
+    uint32_t busy = 0;
+    const int64_t t0_us = esp_timer_get_time();
+    int64_t hinted_us = -1;
+    int64_t first_pass_us = 0;
 
     gw_device_t *devices = (gw_device_t *)calloc(GW_DEVICE_MAX_DEVICES, sizeof(gw_device_t));
-    if (!devices) {
-        ESP_LOGW(TAG, "initial state sync: no mem for device list");
-        s_initial_state_sync_started = false;
-        s_initial_state_sync_task = NULL;
-        vTaskDelete(NULL);
-        return;
-    }
-
     gw_zb_endpoint_t *eps = (gw_zb_endpoint_t *)calloc(GW_ZB_MAX_ENDPOINTS, sizeof(gw_zb_endpoint_t));
-    if (!eps) {
+    gw_zigbee_warmup_hint_t *hint = (gw_zigbee_warmup_hint_t *)calloc(GW_ZIGBEE_WARMUP_HINT_MAX, sizeof(gw_zigbee_warmup_hint_t));
+    uint8_t prio[GW_ZB_MAX_ENDPOINTS];
+    uint8_t done[GW_ZB_MAX_ENDPOINTS];
+    if (!devices || !eps || !hint) {
         ESP_LOGW(TAG, "initial state sync: no mem for endpoint list");
+        free(hint);
+        free(eps);
         free(devices);
         s_initial_state_sync_started = false;
         s_initial_state_sync_task = NULL;
@@ -546,39 +705,76 @@ static void initial_state_sync_task(void *arg)
         return;
     }
 
+    // One flat endpoint list, so the scheduler can pick across devices.
     size_t dev_count = gw_device_registry_list(devices, GW_DEVICE_MAX_DEVICES);
+    size_t ep_count = 0;
+    for (size_t i = 0; i < dev_count && ep_count < GW_ZB_MAX_ENDPOINTS; i++) {
+        ep_count += gw_device_registry_list_endpoints(&devices[i].device_uid, &eps[ep_count], GW_ZB_MAX_ENDPOINTS - ep_count);
+    }
+    free(devices);
+
+    uint32_t seen_gen = UINT32_MAX;
+    size_t hint_count = 0;
     for (int pass = 0; pass < 2; pass++) {
         uint32_t *missing_ctr = (pass == 0) ? &missing_before : &missing_after;
-        for (size_t i = 0; i < dev_count; i++) {
-            size_t ep_count = gw_device_registry_list_endpoints(&devices[i].device_uid, eps, GW_ZB_MAX_ENDPOINTS);
-            for (size_t ei = 0; ei < ep_count; ei++) {
-                // Actuators
-                queue_read_attr_if_missing(&devices[i].device_uid, &eps[ei], 0x0006, 0x0000, "onoff", &ok_count, missing_ctr);
-                queue_read_attr_if_missing(&devices[i].device_uid, &eps[ei], 0x0008, 0x0000, "level", &ok_count, missing_ctr);
-                queue_read_attr_if_missing(&devices[i].device_uid, &eps[ei], 0x0300, 0x0003, "color_x", &ok_count, missing_ctr);
-                queue_read_attr_if_missing(&devices[i].device_uid, &eps[ei], 0x0300, 0x0004, "color_y", &ok_count, missing_ctr);
-                queue_read_attr_if_missing(&devices[i].device_uid, &eps[ei], 0x0300, 0x0007, "color_temp_mireds", &ok_count, missing_ctr);
-                // Sensors and battery
-                queue_read_attr_if_missing(&devices[i].device_uid, &eps[ei], 0x0402, 0x0000, "temperature_c", &ok_count, missing_ctr);
-                queue_read_attr_if_missing(&devices[i].device_uid, &eps[ei], 0x0405, 0x0000, "humidity_pct", &ok_count, missing_ctr);
-                queue_read_attr_if_missing(&devices[i].device_uid, &eps[ei], 0x0001, 0x0021, "battery_pct", &ok_count, missing_ctr);
-                queue_read_attr_if_missing(&devices[i].device_uid, &eps[ei], 0x0001, 0x0020, "battery_mv", &ok_count, missing_ctr);
-                queue_read_attr_if_missing(&devices[i].device_uid, &eps[ei], 0x0406, 0x0000, "occupancy", &ok_count, missing_ctr);
+        bool low_started = false;
+        memset(done, 0, sizeof(done));
+        for (;;) {
+            const size_t n = warmup_refresh_prio(eps, ep_count, prio, hint, &seen_gen);
+            if (n != SIZE_MAX) {
+                hint_count = n;
+            }
+
+            size_t best = SIZE_MAX;
+            for (size_t i = 0; i < ep_count; i++) {
+                if (!done[i] && (best == SIZE_MAX || prio[i] < prio[best])) {
+                    best = i;
+                }
+            }
+            if (best == SIZE_MAX) {
+                break;
+            }
+
+            // With a hint in place, the rest waits: a device that reports on its own in the
+            // meantime fills the state store and queue_cluster_reads() then skips it.
+            if (prio[best] == GW_ZIGBEE_WARMUP_PRIO_LOW && hint_count > 0 && pass == 0) {
+                if (!low_started) {
+                    low_started = true;
+                    hinted_us = esp_timer_get_time() - t0_us;
+                    vTaskDelay(pdMS_TO_TICKS(GW_WARMUP_LOW_PRIO_DELAY_MS));
+                    continue; // the hint may have moved meanwhile
+                }
+                deferred++;
+                vTaskDelay(pdMS_TO_TICKS(GW_WARMUP_LOW_PRIO_GAP_MS));
             }
+
+            done[best] = 1;
+            ok_count += queue_endpoint_reads(&eps[best].uid, &eps[best], missing_ctr, &busy);
         }
-        vTaskDelay(pdMS_TO_TICKS(900));
-        if (pass == 1 && missing_after == 0) {
-            break;
+        if (pass == 0) {
+            first_pass_us = esp_timer_get_time() - t0_us;
+            if (missing_before == 0) {
+                break;
+            }
         }
+        vTaskDelay(pdMS_TO_TICKS(900));
     }
 
+    free(hint);
     free(eps);
-    free(devices);
 
-    ESP_LOGI(TAG, "initial state sync done: read_attr queued=%u missing(before=%u after=%u)",
+    ESP_LOGI(TAG, "initial state sync done: devices=%u endpoints=%u read frames=%u busy=%u attrs missing(before=%u after=%u) "
+                  "deferred=%u hinted=%dms first pass=%ums total=%ums",
+             (unsigned)dev_count,
+             (unsigned)ep_count,
              (unsigned)ok_count,
+             (unsigned)busy,
              (unsigned)missing_before,
-             (unsigned)missing_after);
+             (unsigned)missing_after,
+             (unsigned)deferred,
+             (int)(hinted_us < 0 ? -1 : hinted_us / 1000),
+             (unsigned)(first_pass_us / 1000),
+             (unsigned)((esp_timer_get_time() - t0_us) / 1000));
     s_initial_state_sync_done = true;
     s_initial_state_sync_started = false;
     s_initial_state_sync_task = NULL;
@@ -804,6 +1000,14 @@ static void handle_rx_frame(const gw_uart_proto_frame_t *frame)
             s_wait_active = false;
             match = true;
         }
+        for (size_t i = 0; i < GW_UART_PIPELINE_DEPTH && !match; i++) {
+            gw_uart_pipe_req_t *p = &s_pipe.inflight[i];
+            if (p->active && !p->done && p->seq == frame->seq) {
+                p->status = rsp.status;
+                p->done = true;
+                match = true;
+            }
+        }
         portEXIT_CRITICAL(&s_wait_lock);
         if (match) {
             xSemaphoreGive(s_rsp_sem);
@@ -999,10 +1203,86 @@ static esp_err_t ensure_started(void)
     return ESP_OK;
 }
 
+// Move answered pipeline requests into their result slots. Waits until fewer than
+// `max_active` are still outstanding; a request unanswered for a full response timeout
+// is given up as ESP_ERR_TIMEOUT.
+static void pipe_collect(size_t max_active)
+{
+    for (;;) {
+        size_t active = 0;
+        portENTER_CRITICAL(&s_wait_lock);
+        for (size_t i = 0; i < GW_UART_PIPELINE_DEPTH; i++) {
+            gw_uart_pipe_req_t *p = &s_pipe.inflight[i];
+            if (p->active && p->done) {
+                s_pipe.results[p->slot] = map_status_to_err(p->status);
+                p->active = false;
+            }
+            if (p->active) {
+                active++;
+            }
+        }
+        portEXIT_CRITICAL(&s_wait_lock);
+        if (active < max_active) {
+            return;
+        }
+        if (xSemaphoreTake(s_rsp_sem, pdMS_TO_TICKS(GW_UART_RESP_TIMEOUTMS)) != pdTRUE) {
+            portENTER_CRITICAL(&s_wait_lock);
+            for (size_t i = 0; i < GW_UART_PIPELINE_DEPTH; i++) {
+                gw_uart_pipe_req_t *p = &s_pipe.inflight[i];
+                if (p->active && !p->done) {
+                    s_pipe.results[p->slot] = ESP_ERR_TIMEOUT;
+                    p->active = false;
+                }
+            }
+            portEXIT_CRITICAL(&s_wait_lock);
+        }
+    }
+}
+
+static esp_err_t pipe_send(gw_uart_cmd_req_v1_t *req)
+{
+    if (s_pipe.next >= s_pipe.cap) {
+        return ESP_ERR_NO_MEM;
+    }
+    pipe_collect(GW_UART_PIPELINE_DEPTH);
+
+    uint16_t seq = ++s_seq;
+    req->req_id = seq;
+    const size_t slot = s_pipe.next++;
+    s_pipe.results[slot] = ESP_OK;
+    GW_UART_TRACE_I("UART CMD %s(%u) req_id=%u uid=%s ep=%u pipelined slot=%u",
+                    cmd_id_name(req->cmd_id), (unsigned)req->cmd_id, (unsigned)req->req_id,
+                    req->device_uid, (unsigned)req->endpoint, (unsigned)slot);
+
+    gw_uart_pipe_req_t *p = NULL;
+    portENTER_CRITICAL(&s_wait_lock);
+    for (size_t i = 0; i < GW_UART_PIPELINE_DEPTH; i++) {
+        if (!s_pipe.inflight[i].active) {
+            p = &s_pipe.inflight[i];
+            *p = (gw_uart_pipe_req_t){.seq = seq, .slot = slot, .active = true};
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&s_wait_lock);
+
+    esp_err_t err = uart_send_frame(GW_UART_MSG_CMD_REQ, seq, req, sizeof(*req));
+    if (err != ESP_OK) {
+        portENTER_CRITICAL(&s_wait_lock);
+        p->active = false;
+        portEXIT_CRITICAL(&s_wait_lock);
+        s_pipe.results[slot] = err;
+    }
+    return err;
+}
+
 static esp_err_t send_cmd_wait_rsp(gw_uart_cmd_req_v1_t *req)
 {
     ESP_RETURN_ON_ERROR(ensure_started(), TAG, "uart start failed");
 
+    if (s_pipe.owner != NULL && s_pipe.owner == xTaskGetCurrentTaskHandle()) {
+        return pipe_send(req);
+    }
+
     if (xSemaphoreTake(s_cmd_lock, pdMS_TO_TICKS(GW_UART_RESP_TIMEOUTMS)) != pdTRUE) {
         return ESP_ERR_TIMEOUT;
     }
@@ -1056,6 +1336,48 @@ static esp_err_t send_cmd_wait_rsp(gw_uart_cmd_req_v1_t *req)
     return map_status_to_err(rsp.status);
 }
 
+esp_err_t gw_zigbee_pipeline_begin(esp_err_t *results, size_t cap)
+{
+    if (!results || cap == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    ESP_RETURN_ON_ERROR(ensure_started(), TAG, "uart start failed");
+    if (s_pipe.owner == xTaskGetCurrentTaskHandle()) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (xSemaphoreTake(s_cmd_lock, pdMS_TO_TICKS(GW_UART_RESP_TIMEOUTMS)) != pdTRUE) {
+        return ESP_ERR_TIMEOUT;
+    }
+    while (xSemaphoreTake(s_rsp_sem, 0) == pdTRUE) {
+    }
+    portENTER_CRITICAL(&s_wait_lock);
+    memset(s_pipe.inflight, 0, sizeof(s_pipe.inflight));
+    portEXIT_CRITICAL(&s_wait_lock);
+    s_pipe.results = results;
+    s_pipe.cap = cap;
+    s_pipe.next = 0;
+    s_pipe.owner = xTaskGetCurrentTaskHandle();
+    return ESP_OK;
+}
+
+size_t gw_zigbee_pipeline_next(void)
+{
+    return s_pipe.owner == xTaskGetCurrentTaskHandle() ? s_pipe.next : 0;
+}
+
+void gw_zigbee_pipeline_end(void)
+{
+    if (s_pipe.owner == NULL || s_pipe.owner != xTaskGetCurrentTaskHandle()) {
+        return;
+    }
+    pipe_collect(1);
+    s_pipe.owner = NULL;
+    s_pipe.results = NULL;
+    s_pipe.cap = 0;
+    s_pipe.next = 0;
+    xSemaphoreGive(s_cmd_lock);
+}
+
 static void fill_uid(char dst[19], const gw_device_uid_t *uid)
 {
     if (!dst) {
@@ -1103,6 +1425,23 @@ bool gw_zigbee_state_warmup_ready(void)
     return s_initial_state_sync_done;
 }
 
+void gw_zigbee_warmup_set_hint(const gw_zigbee_warmup_hint_t *hints, size_t count)
+{
+    if (!hints) {
+        count = 0;
+    }
+    if (count > GW_ZIGBEE_WARMUP_HINT_MAX) {
+        count = GW_ZIGBEE_WARMUP_HINT_MAX;
+    }
+    portENTER_CRITICAL(&s_warmup_hint_lock);
+    if (count > 0) {
+        memcpy(s_warmup_hint, hints, count * sizeof(s_warmup_hint[0]));
+    }
+    s_warmup_hint_count = count;
+    s_warmup_hint_gen++;
+    portEXIT_CRITICAL(&s_warmup_hint_lock);
+}
+
 esp_err_t gw_zigbee_set_device_name(const gw_device_uid_t *uid, const char *name)
 {
     if (!uid || !uid->uid[0] || !name) {
@@ -1205,6 +1544,7 @@ esp_err_t gw_zigbee_level_move_to_level(const gw_device_uid_t *uid, uint8_t endp
     req.endpoint = endpoint;
     req.param0 = level.level;
     req.param1 = (int32_t)(level.transition_ms / 100);
+    req.param2 = level.with_onoff ? 1 : 0;
     return send_cmd_wait_rsp(&req);
 }
 
@@ -1233,16 +1573,22 @@ esp_err_t gw_zigbee_color_move_to_temp(const gw_device_uid_t *uid, uint8_t endpo
 
 esp_err_t gw_zigbee_group_onoff_cmd(uint16_t group_id, gw_zigbee_onoff_cmd_t cmd)
 {
-    (void)group_id;
-    (void)cmd;
-    return ESP_ERR_NOT_SUPPORTED;
+    gw_uart_cmd_req_v1_t req = {0};
+    req.cmd_id = GW_UART_CMD_GROUP_ONOFF;
+    req.short_addr = group_id;
+    req.param0 = (int32_t)cmd;
+    return send_cmd_wait_rsp(&req);
 }
 
 esp_err_t gw_zigbee_group_level_move_to_level(uint16_t group_id, gw_zigbee_level_t level)
 {
-    (void)group_id;
-    (void)level;
-    return ESP_ERR_NOT_SUPPORTED;
+    gw_uart_cmd_req_v1_t req = {0};
+    req.cmd_id = GW_UART_CMD_GROUP_LEVEL;
+    req.short_addr = group_id;
+    req.param0 = level.level;
+    req.param1 = (int32_t)(level.transition_ms / 100);
+    req.param2 = level.with_onoff ? 1 : 0;
+    return send_cmd_wait_rsp(&req);
 }
 
 esp_err_t gw_zigbee_group_color_move_to_xy(uint16_t group_id, gw_zigbee_color_xy_t color)
@@ -1275,6 +1621,25 @@ esp_err_t gw_zigbee_read_attr(const gw_device_uid_t *uid, uint8_t endpoint, uint
     return send_cmd_wait_rsp(&req);
 }
 
+esp_err_t gw_zigbee_read_attrs(const gw_device_uid_t *uid, uint8_t endpoint, uint16_t cluster_id, const uint16_t *attr_ids, size_t count)
+{
+    if (!attr_ids || count == 0 || count > GW_ZIGBEE_READ_ATTRS_MAX || count > GW_UART_READ_ATTRS_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    gw_uart_cmd_req_v1_t req = {0};
+    req.cmd_id = GW_UART_CMD_READ_ATTRS;
+    fill_uid(req.device_uid, uid);
+    req.endpoint = endpoint;
+    req.cluster_id = cluster_id;
+    req.attr_id = attr_ids[0];
+    req.param0 = (int32_t)count;
+    for (size_t i = 0; i < count; i++) {
+        req.value_blob[2 * i] = (char)(attr_ids[i] & 0xFF);
+        req.value_blob[2 * i + 1] = (char)(attr_ids[i] >> 8);
+    }
+    return send_cmd_wait_rsp(&req);
+}
+
 esp_err_t gw_zigbee_scene_store(uint16_t group_id, uint8_t scene_id)
 {
     (void)group_id;
@@ -1289,24 +1654,34 @@ esp_err_t gw_zigbee_scene_recall(uint16_t group_id, uint8_t scene_id)
     return ESP_ERR_NOT_SUPPORTED;
 }
 
+static esp_err_t send_bind_req(uint8_t cmd_id,
+                               const gw_device_uid_t *src_uid,
+                               uint8_t src_endpoint,
+                               uint16_t cluster_id,
+                               const gw_device_uid_t *dst_uid,
+                               uint8_t dst_endpoint)
+{
+    if (!src_uid || !dst_uid || src_endpoint == 0 || dst_endpoint == 0 || cluster_id == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    gw_uart_cmd_req_v1_t req = {0};
+    req.cmd_id = cmd_id;
+    fill_uid(req.device_uid, src_uid);
+    req.endpoint = src_endpoint;
+    req.cluster_id = cluster_id;
+    fill_uid(req.value_text, dst_uid);
+    req.param0 = dst_endpoint;
+    return send_cmd_wait_rsp(&req);
+}
+
 esp_err_t gw_zigbee_bind(const gw_device_uid_t *src_uid, uint8_t src_endpoint, uint16_t cluster_id, const gw_device_uid_t *dst_uid, uint8_t dst_endpoint)
 {
-    (void)src_uid;
-    (void)src_endpoint;
-    (void)cluster_id;
-    (void)dst_uid;
-    (void)dst_endpoint;
-    return ESP_ERR_NOT_SUPPORTED;
+    return send_bind_req(GW_UART_CMD_BIND, src_uid, src_endpoint, cluster_id, dst_uid, dst_endpoint);
 }
 
 esp_err_t gw_zigbee_unbind(const gw_device_uid_t *src_uid, uint8_t src_endpoint, uint16_t cluster_id, const gw_device_uid_t *dst_uid, uint8_t dst_endpoint)
 {
-    (void)src_uid;
-    (void)src_endpoint;
-    (void)cluster_id;
-    (void)dst_uid;
-    (void)dst_endpoint;
-    return ESP_ERR_NOT_SUPPORTED;
+    return send_bind_req(GW_UART_CMD_UNBIND, src_uid, src_endpoint, cluster_id, dst_uid, dst_endpoint);
 }
 
 esp_err_t gw_zigbee_binding_table_req(const gw_device_uid_t *uid, uint8_t start_index)
@@ -1316,12 +1691,31 @@ esp_err_t gw_zigbee_binding_table_req(const gw_device_uid_t *uid, uint8_t start_
     return ESP_ERR_NOT_SUPPORTED;
 }
 
+esp_err_t gw_zigbee_rules_push(const uint8_t *bundle, size_t len)
+{
+    if (!bundle && len > 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    ESP_RETURN_ON_ERROR(ensure_started(), TAG, "uart start failed");
 
+    const uint16_t transfer_id = ++s_rules_transfer_id;
+    gw_uart_device_fb_chunk_v1_t ch = {0};
+    ch.transfer_id = transfer_id;
+    ch.total_len = (uint32_t)len;
+    for (size_t off = 0; off < len; off += ch.chunk_len) {
+        const size_t left = len - off;
+        ch.offset = (uint32_t)off;
+        ch.chunk_len = (uint8_t)(left < sizeof(ch.data) ? left : sizeof(ch.data));
+        ch.flags = (off == 0 ? GW_UART_DEVICE_FB_FLAG_BEGIN : 0) | (off + ch.chunk_len == len ? GW_UART_DEVICE_FB_FLAG_END : 0);
+        memcpy(ch.data, bundle + off, ch.chunk_len);
+        ESP_RETURN_ON_ERROR(uart_send_frame(GW_UART_MSG_RULES_BUNDLE, ++s_seq, &ch, sizeof(ch)), TAG, "rules chunk send failed");
+    }
 
-
-
-
-
-
-
-
+    // The C6 only swaps its rules once the whole bundle arrived and checks out.
+    gw_uart_cmd_req_v1_t req = {0};
+    req.cmd_id = GW_UART_CMD_RULES_COMMIT;
+    req.param0 = transfer_id;
+    req.param1 = (int32_t)len;
+    req.param2 = (int32_t)(len ? esp_rom_crc32_le(0, bundle, len) : 0);
+    return send_cmd_wait_rsp(&req);
+}
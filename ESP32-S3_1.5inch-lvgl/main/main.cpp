@@ -13,6 +13,8 @@
 #include "gw_core/sensor_store.h"
 #include "gw_core/state_store.h"
 #include "gw_core/rules_engine.h"
+#include "gw_core/timers.h"
+#include "gw_core/device_availability.h"
 #include "gw_core/runtime_sync.h"
 #include "gw_core/net_time.h"
 #include "gw_core/zb_model.h"
@@ -140,7 +142,9 @@ extern "C" void app_main(void)
     ESP_ERROR_CHECK(gw_automation_store_init());
     ESP_ERROR_CHECK(gw_group_store_init());
     ESP_ERROR_CHECK(gw_project_settings_init());
+    ESP_ERROR_CHECK(gw_timers_init());
     ESP_ERROR_CHECK(gw_rules_init());
+    ESP_ERROR_CHECK(gw_device_availability_init());
     ESP_ERROR_CHECK(gw_runtime_sync_init());
     ESP_ERROR_CHECK(gw_net_time_init(NULL));
     ESP_ERROR_CHECK(s3_weather_service_start());
@@ -184,6 +184,7 @@ void ui_tick_cb(lv_timer_t *timer)
         {
             if (ui_store_apply_event(s_store, &events[i]))
             {
+                ui_store_publish_warmup_hint(s_store);
                 s_render_requested = true;
             }
         }
@@ -250,6 +251,7 @@ void ui_app_init(void)
 
     ui_store_init(s_store);
     ui_store_reload(s_store);
+    ui_store_publish_warmup_hint(s_store);
 
     lv_obj_t *scr = lv_screen_active();
     ui_screen_devices_init(scr);
@@ -286,6 +288,7 @@ extern "C" void LVGL_knob_event(void *event)
     {
         if (ui_store_next_group(s_store))
         {
+            ui_store_publish_warmup_hint(s_store);
             request_render();
         }
     }
@@ -293,6 +296,7 @@ extern "C" void LVGL_knob_event(void *event)
     {
         if (ui_store_prev_group(s_store))
         {
+            ui_store_publish_warmup_hint(s_store);
             request_render();
         }
     }
@@ -4,6 +4,7 @@
 #include <stdlib.h>
 
 #include "esp_heap_caps.h"
+#include "gw_core/timer_wheel.h"
 
 namespace
 {
@@ -15,7 +16,9 @@ typedef struct
     char key[24];
     bool pending;
     bool error;
-    uint64_t pending_since_ms;
+    bool arm_queued;
+    int16_t arm_next; // next entry waiting for its timeout to be armed, -1 = end
+    gw_timer_t timer;
 
     bool has_bool;
     bool bool_value;
@@ -26,18 +29,50 @@ typedef struct
 } ack_entry_t;
 
 static constexpr size_t kMaxAckEntries = 96;
+static constexpr uint32_t kWheelTickMs = 50;
 static ack_entry_t *s_entries = nullptr;
 
+// Pending timeouts live on a private timing wheel advanced by the UI poll, so a poll
+// only touches entries that were just begun or just expired. begin() does not know
+// the time, so new entries are queued and armed by the next poll.
+static gw_timer_wheel_t *s_wheel = nullptr;
+static bool s_wheel_ready = false;
+static int16_t s_arm_head = -1;
+
 bool ensure_entries()
 {
-    if (s_entries) {
+    if (s_entries && s_wheel) {
         return true;
     }
-    s_entries = (ack_entry_t *)heap_caps_calloc(kMaxAckEntries, sizeof(ack_entry_t), MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (!s_entries) {
+        s_entries = (ack_entry_t *)heap_caps_calloc(kMaxAckEntries, sizeof(ack_entry_t), MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    }
     if (!s_entries) {
         s_entries = (ack_entry_t *)calloc(kMaxAckEntries, sizeof(ack_entry_t));
     }
-    return s_entries != nullptr;
+    if (!s_wheel) {
+        s_wheel = (gw_timer_wheel_t *)heap_caps_calloc(1, sizeof(gw_timer_wheel_t), MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    }
+    if (!s_wheel) {
+        s_wheel = (gw_timer_wheel_t *)calloc(1, sizeof(gw_timer_wheel_t));
+    }
+    return s_entries != nullptr && s_wheel != nullptr;
+}
+
+void ack_timeout_cb(gw_timer_t *timer, void *arg)
+{
+    (void)timer;
+    ack_entry_t *e = (ack_entry_t *)arg;
+    e->pending = false;
+    e->error = true;
+}
+
+void settle(ack_entry_t *e)
+{
+    e->pending = false;
+    if (s_wheel_ready) {
+        gw_timer_wheel_cancel(s_wheel, &e->timer);
+    }
 }
 
 ack_entry_t *find_entry(const char *device_uid, uint8_t endpoint, const char *key)
@@ -97,6 +132,8 @@ void ui_control_ack_reset(void)
     if (s_entries) {
         memset(s_entries, 0, kMaxAckEntries * sizeof(ack_entry_t));
     }
+    s_wheel_ready = false; // the wheel is re-initialised (emptied) by the next poll
+    s_arm_head = -1;
 }
 
 bool ui_control_ack_begin(const char *device_uid, uint8_t endpoint, const char *key)
@@ -110,7 +147,11 @@ bool ui_control_ack_begin(const char *device_uid, uint8_t endpoint, const char *
     }
     e->pending = true;
     e->error = false;
-    e->pending_since_ms = 0;
+    if (!e->arm_queued) {
+        e->arm_queued = true;
+        e->arm_next = s_arm_head;
+        s_arm_head = (int16_t)(e - s_entries);
+    }
     return true;
 }
 
@@ -120,7 +161,7 @@ void ui_control_ack_fail(const char *device_uid, uint8_t endpoint, const char *k
     if (!e) {
         return;
     }
-    e->pending = false;
+    settle(e);
     e->error = true;
 }
 
@@ -153,20 +194,19 @@ void ui_control_ack_poll_timeouts(uint64_t now_ms, uint32_t timeout_ms)
     if (!ensure_entries() || timeout_ms == 0) {
         return;
     }
-    for (size_t i = 0; i < kMaxAckEntries; ++i) {
-        ack_entry_t *e = &s_entries[i];
-        if (!e->used || !e->pending) {
-            continue;
-        }
-        if (e->pending_since_ms == 0) {
-            e->pending_since_ms = now_ms;
-            continue;
-        }
-        if (now_ms > e->pending_since_ms && (now_ms - e->pending_since_ms) >= timeout_ms) {
-            e->pending = false;
-            e->error = true;
+    if (!s_wheel_ready) {
+        gw_timer_wheel_init(s_wheel, kWheelTickMs, now_ms);
+        s_wheel_ready = true;
+    }
+    while (s_arm_head >= 0) {
+        ack_entry_t *e = &s_entries[s_arm_head];
+        s_arm_head = e->arm_next;
+        e->arm_queued = false;
+        if (e->used && e->pending) {
+            gw_timer_wheel_arm(s_wheel, &e->timer, now_ms, timeout_ms, ack_timeout_cb, e);
         }
     }
+    gw_timer_wheel_advance(s_wheel, now_ms);
 }
 
 void ui_control_ack_confirm_bool(const char *device_uid, uint8_t endpoint, const char *key, bool has_value, bool value)
@@ -175,9 +215,8 @@ void ui_control_ack_confirm_bool(const char *device_uid, uint8_t endpoint, const
     if (!e) {
         return;
     }
-    e->pending = false;
+    settle(e);
     e->error = false;
-    e->pending_since_ms = 0;
     e->has_bool = has_value;
     e->bool_value = value;
 }
@@ -203,9 +242,8 @@ void ui_control_ack_confirm_u32(const char *device_uid, uint8_t endpoint, const
     if (!e) {
         return;
     }
-    e->pending = false;
+    settle(e);
     e->error = false;
-    e->pending_since_ms = 0;
     e->has_u32 = has_value;
     e->u32_value = value;
 }
@@ -231,9 +269,8 @@ void ui_control_ack_confirm_f32(const char *device_uid, uint8_t endpoint, const
     if (!e) {
         return;
     }
-    e->pending = false;
+    settle(e);
     e->error = false;
-    e->pending_since_ms = 0;
     e->has_f32 = has_value;
     e->f32_value = value;
 }
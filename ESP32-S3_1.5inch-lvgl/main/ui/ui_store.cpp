@@ -5,6 +5,7 @@
 
 #include "esp_attr.h"
 #include "gw_core/zb_classify.h"
+#include "gw_zigbee/gw_zigbee.h"
 
 namespace
 {
@@ -16,6 +17,7 @@ EXT_RAM_BSS_ATTR static gw_device_t s_devices_snapshot[UI_STORE_DEVICE_CAP];
 EXT_RAM_BSS_ATTR static gw_zb_endpoint_t s_eps_snapshot[UI_STORE_ENDPOINT_CAP];
 EXT_RAM_BSS_ATTR static gw_group_entry_t s_groups_snapshot[UI_STORE_GROUP_CAP];
 EXT_RAM_BSS_ATTR static gw_group_item_t s_group_items_snapshot[UI_GROUP_ITEM_SNAPSHOT_CAP];
+EXT_RAM_BSS_ATTR static gw_zigbee_warmup_hint_t s_warmup_hint[GW_ZIGBEE_WARMUP_HINT_MAX];
 
 size_t find_group_idx(ui_store_t *store, const char *group_id)
 {
@@ -174,6 +176,17 @@ bool apply_value_from_event(ui_endpoint_vm_t *ep, const gw_event_t *event)
     return false;
 }
 
+size_t add_group_hint(const ui_group_vm_t *group, uint8_t prio, size_t count)
+{
+    for (size_t i = 0; i < group->item_count && count < GW_ZIGBEE_WARMUP_HINT_MAX; ++i) {
+        gw_zigbee_warmup_hint_t *h = &s_warmup_hint[count++];
+        h->uid = group->items[i].uid;
+        h->endpoint = group->items[i].endpoint_id;
+        h->prio = prio;
+    }
+    return count;
+}
+
 void sort_group_items_by_order(ui_group_vm_t *group)
 {
     if (!group || group->item_count < 2) {
@@ -384,3 +397,25 @@ const ui_group_item_vm_t *ui_store_active_item(const ui_store_t *store)
     }
     return &group->items[group->active_item_idx];
 }
+
+void ui_store_publish_warmup_hint(const ui_store_t *store)
+{
+    if (!store || gw_zigbee_state_warmup_ready()) {
+        return;
+    }
+    size_t count = 0;
+    const size_t n = store->group_count;
+    if (n > 0 && store->active_group_idx < n) {
+        const size_t active = store->active_group_idx;
+        count = add_group_hint(&store->groups[active], GW_ZIGBEE_WARMUP_PRIO_VISIBLE, count);
+        const size_t next = (active + 1) % n;
+        const size_t prev = (active + n - 1) % n;
+        if (next != active) {
+            count = add_group_hint(&store->groups[next], GW_ZIGBEE_WARMUP_PRIO_NEAR, count);
+        }
+        if (prev != active && prev != next) {
+            count = add_group_hint(&store->groups[prev], GW_ZIGBEE_WARMUP_PRIO_NEAR, count);
+        }
+    }
+    gw_zigbee_warmup_set_hint(s_warmup_hint, count);
+}
@@ -78,3 +78,6 @@ bool ui_store_next_item(ui_store_t *store);
 bool ui_store_prev_item(ui_store_t *store);
 const ui_group_vm_t *ui_store_active_group(const ui_store_t *store);
 const ui_group_item_vm_t *ui_store_active_item(const ui_store_t *store);
+// Hand the state warm-up the endpoints worth reading first: the active group, then the
+// groups one knob step away. No-op once the warm-up has finished.
+void ui_store_publish_warmup_hint(const ui_store_t *store);
@@ -0,0 +1,281 @@
+// bench_cbor_decode.c - one-pass descriptor decoding vs a gw_cbor_map_find() per key
+//
+// Both sides fill the same struct from the same descriptor table; the per-key side is
+// how action payloads and automation maps were read before gw_cbor_decode_map(). The
+// compile time of a whole automation is reported on its own, for tracking.
+#include <stddef.h>
+#include <stdlib.h>
+
+#include "gw_core/automation_compiled.h"
+#include "gw_core/cbor.h"
+#include "host_bench.h"
+
+// ---- an /api/actions payload and its decode table (as action_exec.c has it) ----
+
+typedef struct {
+    char type[16];
+    char cmd[40];
+    char device_uid[24];
+    char uid[24];
+    char src_device_uid[24];
+    char dst_device_uid[24];
+    uint16_t group_id;
+    uint16_t cluster_id;
+    uint16_t transition_ms;
+    uint16_t mireds;
+    uint8_t scene_id;
+    uint8_t endpoint;
+    uint8_t src_endpoint;
+    uint8_t dst_endpoint;
+    uint8_t level;
+} action_req_t;
+
+static const gw_cbor_field_t s_action_fields[] = {
+    GW_CBOR_FIELD("type", GW_CBOR_FIELD_TEXT, action_req_t, type),
+    GW_CBOR_FIELD("cmd", GW_CBOR_FIELD_TEXT, action_req_t, cmd),
+    GW_CBOR_FIELD("device_uid", GW_CBOR_FIELD_TEXT, action_req_t, device_uid),
+    GW_CBOR_FIELD("uid", GW_CBOR_FIELD_TEXT, action_req_t, uid),
+    GW_CBOR_FIELD("src_device_uid", GW_CBOR_FIELD_TEXT, action_req_t, src_device_uid),
+    GW_CBOR_FIELD("dst_device_uid", GW_CBOR_FIELD_TEXT, action_req_t, dst_device_uid),
+    GW_CBOR_FIELD_RANGE("group_id", GW_CBOR_FIELD_U16, action_req_t, group_id, 1, 0xFFFE),
+    GW_CBOR_FIELD_RANGE("cluster_id", GW_CBOR_FIELD_U16, action_req_t, cluster_id, 1, 0xFFFF),
+    GW_CBOR_FIELD_RANGE("transition_ms", GW_CBOR_FIELD_U16, action_req_t, transition_ms, 0, 60000),
+    GW_CBOR_FIELD_RANGE("mireds", GW_CBOR_FIELD_U16, action_req_t, mireds, 1, 1000),
+    GW_CBOR_FIELD_RANGE("scene_id", GW_CBOR_FIELD_U8, action_req_t, scene_id, 1, 255),
+    GW_CBOR_FIELD_RANGE("endpoint", GW_CBOR_FIELD_U8, action_req_t, endpoint, 1, 240),
+    GW_CBOR_FIELD_RANGE("src_endpoint", GW_CBOR_FIELD_U8, action_req_t, src_endpoint, 1, 240),
+    GW_CBOR_FIELD_RANGE("dst_endpoint", GW_CBOR_FIELD_U8, action_req_t, dst_endpoint, 1, 240),
+    GW_CBOR_FIELD_RANGE("level", GW_CBOR_FIELD_U8, action_req_t, level, 0, 254),
+};
+
+// ---- the automation root map, with the keys the compiler reads ----
+
+typedef struct {
+    gw_cbor_slice_t id;
+    gw_cbor_slice_t name;
+    gw_cbor_slice_t enabled;
+    gw_cbor_slice_t triggers;
+    gw_cbor_slice_t conditions;
+    gw_cbor_slice_t actions;
+    gw_cbor_slice_t mode;
+    gw_cbor_slice_t max_runs;
+    gw_cbor_slice_t debounce_ms;
+    gw_cbor_slice_t throttle_ms;
+} root_keys_t;
+
+static const gw_cbor_field_t s_root_fields[] = {
+    GW_CBOR_FIELD("id", GW_CBOR_FIELD_ITEM, root_keys_t, id),
+    GW_CBOR_FIELD("name", GW_CBOR_FIELD_ITEM, root_keys_t, name),
+    GW_CBOR_FIELD("enabled", GW_CBOR_FIELD_ITEM, root_keys_t, enabled),
+    GW_CBOR_FIELD("triggers", GW_CBOR_FIELD_ITEM, root_keys_t, triggers),
+    GW_CBOR_FIELD("conditions", GW_CBOR_FIELD_ITEM, root_keys_t, conditions),
+    GW_CBOR_FIELD("actions", GW_CBOR_FIELD_ITEM, root_keys_t, actions),
+    GW_CBOR_FIELD("mode", GW_CBOR_FIELD_ITEM, root_keys_t, mode),
+    GW_CBOR_FIELD("max_runs", GW_CBOR_FIELD_ITEM, root_keys_t, max_runs),
+    GW_CBOR_FIELD("debounce_ms", GW_CBOR_FIELD_ITEM, root_keys_t, debounce_ms),
+    GW_CBOR_FIELD("throttle_ms", GW_CBOR_FIELD_ITEM, root_keys_t, throttle_ms),
+};
+
+// The per-key baseline: one scan of the map per listed key, then the same conversion.
+static bool decode_by_find(const uint8_t *buf, size_t len, const gw_cbor_field_t *fields, size_t n, void *out)
+{
+    for (size_t i = 0; i < n; i++) {
+        const gw_cbor_field_t *f = &fields[i];
+        gw_cbor_slice_t v;
+        if (!gw_cbor_map_find(buf, len, f->key, &v)) continue;
+        uint8_t *dst = (uint8_t *)out + f->offset;
+        const uint8_t *p = NULL;
+        size_t n_text = 0;
+        uint64_t u = 0;
+        switch (f->type) {
+        case GW_CBOR_FIELD_ITEM:
+            *(gw_cbor_slice_t *)dst = v;
+            break;
+        case GW_CBOR_FIELD_TEXT:
+            if (!gw_cbor_slice_to_text_span(&v, &p, &n_text) || n_text >= f->size) return false;
+            memcpy(dst, p, n_text);
+            dst[n_text] = '\0';
+            break;
+        case GW_CBOR_FIELD_U8:
+        case GW_CBOR_FIELD_U16:
+            if (!gw_cbor_slice_to_u64(&v, &u) || (int64_t)u < f->min || (int64_t)u > f->max) return false;
+            if (f->type == GW_CBOR_FIELD_U8) {
+                *dst = (uint8_t)u;
+            } else {
+                *(uint16_t *)dst = (uint16_t)u;
+            }
+            break;
+        default:
+            return false;
+        }
+    }
+    return true;
+}
+
+// ---- payloads ----
+
+static esp_err_t kv_text(gw_cbor_writer_t *w, const char *k, const char *v)
+{
+    esp_err_t rc = gw_cbor_writer_text(w, k);
+    return rc == ESP_OK ? gw_cbor_writer_text(w, v) : rc;
+}
+
+static esp_err_t kv_u64(gw_cbor_writer_t *w, const char *k, uint64_t v)
+{
+    esp_err_t rc = gw_cbor_writer_text(w, k);
+    return rc == ESP_OK ? gw_cbor_writer_u64(w, v) : rc;
+}
+
+// {"type":"zigbee","cmd":"level.move_to_level","device_uid":...,"endpoint":1,
+//  "level":128,"transition_ms":500}: the last keys sit at the end of the map.
+static esp_err_t write_action(gw_cbor_writer_t *w, const char *cmd, uint32_t dev)
+{
+    char uid[24];
+    snprintf(uid, sizeof(uid), "0x00124b00%08x", (unsigned)dev);
+    const bool level = strcmp(cmd, "level.move_to_level") == 0;
+    esp_err_t rc = gw_cbor_writer_map(w, level ? 6 : 4);
+    if (rc == ESP_OK) rc = kv_text(w, "type", "zigbee");
+    if (rc == ESP_OK) rc = kv_text(w, "cmd", cmd);
+    if (rc == ESP_OK) rc = kv_text(w, "device_uid", uid);
+    if (rc == ESP_OK) rc = kv_u64(w, "endpoint", 1);
+    if (rc == ESP_OK && level) rc = kv_u64(w, "level", 128);
+    if (rc == ESP_OK && level) rc = kv_u64(w, "transition_ms", 500);
+    return rc;
+}
+
+// "Evening scene": a switch press or 19:30 on weekdays, only while the hall is dark
+// and someone is home; then six lights set, with the root options after the arrays.
+static esp_err_t write_automation(gw_cbor_writer_t *w)
+{
+    esp_err_t rc = gw_cbor_writer_map(w, 8);
+    if (rc == ESP_OK) rc = kv_text(w, "id", "evening_scene_living_room");
+    if (rc == ESP_OK) rc = kv_text(w, "name", "Evening scene: living room and hall");
+    if (rc == ESP_OK) rc = gw_cbor_writer_text(w, "enabled");
+    if (rc == ESP_OK) rc = gw_cbor_writer_bool(w, true);
+
+    if (rc == ESP_OK) rc = gw_cbor_writer_text(w, "triggers");
+    if (rc == ESP_OK) rc = gw_cbor_writer_array(w, 2);
+    if (rc == ESP_OK) rc = gw_cbor_writer_map(w, 3);
+    if (rc == ESP_OK) rc = kv_text(w, "type", "event");
+    if (rc == ESP_OK) rc = kv_text(w, "event_type", "zigbee.command");
+    if (rc == ESP_OK) rc = gw_cbor_writer_text(w, "match");
+    if (rc == ESP_OK) rc = gw_cbor_writer_map(w, 4);
+    if (rc == ESP_OK) rc = kv_text(w, "device_uid", "0x00124b0000000001");
+    if (rc == ESP_OK) rc = kv_u64(w, "payload.endpoint", 2);
+    if (rc == ESP_OK) rc = kv_u64(w, "payload.cluster", 6);
+    if (rc == ESP_OK) rc = kv_text(w, "payload.cmd", "on");
+    if (rc == ESP_OK) rc = gw_cbor_writer_map(w, 3);
+    if (rc == ESP_OK) rc = kv_text(w, "type", "time");
+    if (rc == ESP_OK) rc = kv_text(w, "at", "19:30");
+    if (rc == ESP_OK) rc = gw_cbor_writer_text(w, "days");
+    if (rc == ESP_OK) rc = gw_cbor_writer_array(w, 5);
+    for (uint64_t d = 1; rc == ESP_OK && d <= 5; d++) {
+        rc = gw_cbor_writer_u64(w, d);
+    }
+
+    if (rc == ESP_OK) rc = gw_cbor_writer_text(w, "conditions");
+    if (rc == ESP_OK) rc = gw_cbor_writer_array(w, 2);
+    static const char *const k_refs[2][3] = {
+        {"0x00124b0000000010", "illuminance", "<"},
+        {"0x00124b0000000011", "occupancy", "=="},
+    };
+    for (size_t i = 0; rc == ESP_OK && i < 2; i++) {
+        rc = gw_cbor_writer_map(w, 4);
+        if (rc == ESP_OK) rc = kv_text(w, "type", "state");
+        if (rc == ESP_OK) rc = gw_cbor_writer_text(w, "ref");
+        if (rc == ESP_OK) rc = gw_cbor_writer_map(w, 2);
+        if (rc == ESP_OK) rc = kv_text(w, "device_uid", k_refs[i][0]);
+        if (rc == ESP_OK) rc = kv_text(w, "key", k_refs[i][1]);
+        if (rc == ESP_OK) rc = kv_text(w, "op", k_refs[i][2]);
+        if (rc == ESP_OK && i == 0) rc = kv_u64(w, "value", 30);
+        if (rc == ESP_OK && i == 1) rc = gw_cbor_writer_text(w, "value");
+        if (rc == ESP_OK && i == 1) rc = gw_cbor_writer_bool(w, true);
+    }
+
+    if (rc == ESP_OK) rc = gw_cbor_writer_text(w, "actions");
+    if (rc == ESP_OK) rc = gw_cbor_writer_array(w, 6);
+    for (uint32_t i = 0; rc == ESP_OK && i < 6; i++) {
+        rc = write_action(w, i % 2 ? "onoff.on" : "level.move_to_level", 0x100 + i);
+    }
+
+    if (rc == ESP_OK) rc = kv_text(w, "mode", "restart");
+    if (rc == ESP_OK) rc = kv_u64(w, "debounce_ms", 250);
+    return rc;
+}
+
+// ---- timing ----
+
+typedef bool (*decode_fn_t)(const uint8_t *buf, size_t len, const gw_cbor_field_t *fields, size_t n, void *out);
+
+static bool decode_once(const uint8_t *buf, size_t len, const gw_cbor_field_t *fields, size_t n, void *out)
+{
+    uint32_t present = 0;
+    int bad = 0;
+    return gw_cbor_decode_map(buf, len, fields, n, out, &present, &bad);
+}
+
+static int compare(const char *what, const uint8_t *buf, size_t len, const gw_cbor_field_t *fields, size_t n,
+                   size_t out_size, uint32_t iters)
+{
+    static const struct {
+        const char *name;
+        decode_fn_t fn;
+    } k_ways[] = {{"one pass", decode_once}, {"find per key", decode_by_find}};
+    uint8_t results[2][256];
+    for (size_t k = 0; k < 2; k++) {
+        uint64_t t0 = host_bench_now_ns();
+        for (uint32_t i = 0; i < iters; i++) {
+            memset(results[k], 0, out_size);
+            if (!k_ways[k].fn(buf, len, fields, n, results[k])) {
+                printf("%s: %s decode failed\n", what, k_ways[k].name);
+                return 1;
+            }
+        }
+        char label[64];
+        snprintf(label, sizeof(label), "%s, %s", what, k_ways[k].name);
+        host_bench_report(label, host_bench_now_ns() - t0, iters);
+    }
+    if (memcmp(results[0], results[1], out_size) != 0) {
+        printf("%s: the two decodes disagree\n", what);
+        return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    const uint32_t iters = host_bench_iters(argc, argv, 1000000);
+    int rc = 0;
+
+    gw_cbor_writer_t action;
+    gw_cbor_writer_t autom;
+    gw_cbor_writer_init(&action);
+    gw_cbor_writer_init(&autom);
+    if (write_action(&action, "level.move_to_level", 0xa1) != ESP_OK || write_automation(&autom) != ESP_OK) {
+        return 1;
+    }
+    printf("action payload %zu bytes, automation %zu bytes\n", action.len, autom.len);
+
+    rc |= compare("action payload", action.buf, action.len, s_action_fields,
+                  sizeof(s_action_fields) / sizeof(s_action_fields[0]), sizeof(action_req_t), iters);
+    rc |= compare("automation root", autom.buf, autom.len, s_root_fields,
+                  sizeof(s_root_fields) / sizeof(s_root_fields[0]), sizeof(root_keys_t), iters);
+
+    const uint32_t compiles = iters / 10 ? iters / 10 : 1;
+    char err[64] = {0};
+    uint64_t t0 = host_bench_now_ns();
+    for (uint32_t i = 0; i < compiles; i++) {
+        gw_auto_compiled_t out = {0};
+        if (gw_auto_compile_cbor(autom.buf, autom.len, &out, err, sizeof(err)) != ESP_OK) {
+            printf("compile failed: %s\n", err);
+            rc = 1;
+            break;
+        }
+        gw_auto_compiled_free(&out);
+    }
+    host_bench_report("automation compile (gw_auto_compile_cbor)", host_bench_now_ns() - t0, compiles);
+
+    gw_cbor_writer_free(&action);
+    gw_cbor_writer_free(&autom);
+    return rc;
+}
@@ -0,0 +1,404 @@
+// bench_rules_match.c - per-event matching cost and trigger-to-command latency by placement
+//
+// Device-local placement runs rules on the C6 through the same gw_core/rules_index
+// matcher the S3 uses; the C6 engine it replaced checked every rule's triggers on
+// every event. This times both matchers for growing rule counts.
+//
+// It then follows one trigger to its command for each placement. On the S3 the
+// trigger arrives as an EVT frame, is matched, and the command goes back as a
+// CMD_REQ the S3 waits a CMD_RSP for (gw_zigbee_uart.c, included as built for the
+// S3). On the C6 only the match remains before the command is queued locally.
+// Wire time comes from mock_uart.c at the link baud rate; the radio side is the same
+// for both placements and left out.
+#include <stdlib.h>
+
+#include "gw_core/automation_compiled.h"
+#include "gw_core/cbor.h"
+#include "gw_core/rules_index.h"
+#include "host_bench.h"
+#include "host_stubs.h"
+
+#include "../../components/gw_zigbee/src/gw_zigbee_uart.c"
+
+#define DEVICES 64
+
+static void device_uid(uint32_t dev, char *out, size_t len)
+{
+    snprintf(out, len, "0x00124b00%08x", (unsigned)dev);
+}
+
+// Rule i: "device i % DEVICES, endpoint 1 + (i / DEVICES) % 4 sends on -> lamp on".
+static esp_err_t add_rule(gw_auto_compiled_t *set, uint32_t i)
+{
+    char id[16];
+    char src[24];
+    char dst[24];
+    snprintf(id, sizeof(id), "r%u", (unsigned)i);
+    device_uid(i % DEVICES, src, sizeof(src));
+    device_uid(1000 + i, dst, sizeof(dst));
+
+    gw_cbor_writer_t w;
+    gw_cbor_writer_init(&w);
+    esp_err_t rc = gw_cbor_writer_map(&w, 4);
+    if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, "id");
+    if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, id);
+    if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, "name");
+    if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, id);
+    if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, "triggers");
+    if (rc == ESP_OK) rc = gw_cbor_writer_array(&w, 1);
+    if (rc == ESP_OK) rc = gw_cbor_writer_map(&w, 3);
+    if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, "type");
+    if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, "event");
+    if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, "event_type");
+    if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, "zigbee.command");
+    if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, "match");
+    if (rc == ESP_OK) rc = gw_cbor_writer_map(&w, 3);
+    if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, "device_uid");
+    if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, src);
+    if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, "payload.endpoint");
+    if (rc == ESP_OK) rc = gw_cbor_writer_u64(&w, 1 + (i / DEVICES) % 4);
+    if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, "payload.cmd");
+    if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, "on");
+    if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, "actions");
+    if (rc == ESP_OK) rc = gw_cbor_writer_array(&w, 1);
+    if (rc == ESP_OK) rc = gw_cbor_writer_map(&w, 4);
+    if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, "type");
+    if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, "zigbee");
+    if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, "cmd");
+    if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, "onoff.on");
+    if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, "device_uid");
+    if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, dst);
+    if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, "endpoint");
+    if (rc == ESP_OK) rc = gw_cbor_writer_u64(&w, 1);
+
+    gw_auto_compiled_t one = {0};
+    gw_auto_compiled_t next = {0};
+    char err[64];
+    if (rc == ESP_OK) rc = gw_auto_compile_cbor(w.buf, w.len, &one, err, sizeof(err));
+    if (rc == ESP_OK) rc = gw_auto_compiled_merge(set, &one, NULL, &next);
+    if (rc == ESP_OK) {
+        gw_auto_compiled_free(set);
+        *set = next;
+    }
+    gw_auto_compiled_free(&one);
+    gw_cbor_writer_free(&w);
+    return rc;
+}
+
+static void make_event(uint32_t n, gw_event_t *e)
+{
+    memset(e, 0, sizeof(*e));
+    strlcpy(e->type, "zigbee.command", sizeof(e->type));
+    device_uid(n % DEVICES, e->device_uid, sizeof(e->device_uid));
+    e->payload_flags = GW_EVENT_PAYLOAD_HAS_ENDPOINT | GW_EVENT_PAYLOAD_HAS_CMD | GW_EVENT_PAYLOAD_HAS_CLUSTER;
+    e->payload_endpoint = (uint8_t)(1 + (n / DEVICES) % 4);
+    e->payload_cluster = 0x0006;
+    strlcpy(e->payload_cmd, "on", sizeof(e->payload_cmd));
+}
+
+// ---- the C6 end of the link and the rest of gw_core, for gw_zigbee_uart.c ----
+
+static gw_uart_proto_parser_t s_c6_parser;
+static gw_event_t s_published; // last event gw_zigbee_uart.c put on the bus
+static uint32_t s_commands;
+
+// Answers each CMD_REQ with OK, as the C6 does once the command is queued.
+static void c6_rx(const uint8_t *data, size_t len)
+{
+    size_t off = 0;
+    while (off < len) {
+        gw_uart_proto_frame_t frame;
+        bool ready = false;
+        size_t consumed = 0;
+        esp_err_t err = gw_uart_proto_parser_feed(&s_c6_parser, &data[off], len - off, &frame, &ready, &consumed);
+        if (consumed == 0) {
+            break;
+        }
+        off += consumed;
+        if (err != ESP_OK || !ready || frame.msg_type != GW_UART_MSG_CMD_REQ) {
+            continue;
+        }
+        gw_uart_cmd_req_v1_t req;
+        memcpy(&req, frame.payload, sizeof(req));
+        s_commands++;
+        gw_uart_cmd_rsp_v1_t rsp = {.req_id = req.req_id, .status = GW_UART_STATUS_OK};
+        gw_uart_proto_frame_t out = {
+            .ver = GW_UART_PROTO_VERSION_V1,
+            .msg_type = GW_UART_MSG_CMD_RSP,
+            .seq = frame.seq,
+            .payload_len = sizeof(rsp),
+        };
+        memcpy(out.payload, &rsp, sizeof(rsp));
+        mock_uart_wire(GW_UART_PROTO_HEADER_SIZE + sizeof(rsp) + GW_UART_PROTO_CRC_SIZE);
+        handle_rx_frame(&out);
+    }
+}
+
+// Same fields as event_bus.c fills in; the rules task would get this event.
+void gw_event_bus_publish_zb(const char *type, const char *source, const char *device_uid, uint16_t short_addr,
+                             const char *msg, uint8_t endpoint, const char *cmd, uint16_t cluster_id, uint16_t attr_id,
+                             gw_event_value_type_t value_type, bool value_bool, int64_t value_i64, double value_f64,
+                             const char *value_text, const uint8_t *payload_cbor, size_t payload_len)
+{
+    gw_event_t *e = &s_published;
+    memset(e, 0, sizeof(*e));
+    strlcpy(e->type, type, sizeof(e->type));
+    strlcpy(e->source, source, sizeof(e->source));
+    strlcpy(e->device_uid, device_uid, sizeof(e->device_uid));
+    e->short_addr = short_addr;
+    e->payload_flags = (endpoint ? GW_EVENT_PAYLOAD_HAS_ENDPOINT : 0) | (cmd && cmd[0] ? GW_EVENT_PAYLOAD_HAS_CMD : 0) |
+                       (cluster_id ? GW_EVENT_PAYLOAD_HAS_CLUSTER : 0) | (attr_id ? GW_EVENT_PAYLOAD_HAS_ATTR : 0);
+    e->payload_endpoint = endpoint;
+    e->payload_cluster = cluster_id;
+    e->payload_attr = attr_id;
+    strlcpy(e->payload_cmd, cmd ? cmd : "", sizeof(e->payload_cmd));
+}
+
+size_t gw_device_registry_list(gw_device_t *out_devices, size_t max_devices)
+{
+    return 0;
+}
+
+size_t gw_device_registry_list_endpoints(const gw_device_uid_t *uid, gw_zb_endpoint_t *out_eps, size_t max_eps)
+{
+    return 0;
+}
+
+esp_err_t gw_state_store_get(const gw_device_uid_t *uid, uint8_t endpoint, const char *key, gw_state_item_t *out)
+{
+    return ESP_ERR_NOT_FOUND;
+}
+
+esp_err_t gw_device_fb_store_set(const uint8_t *buf, size_t len)
+{
+    return ESP_OK;
+}
+
+esp_err_t gw_runtime_sync_snapshot_begin(uint16_t total_devices)
+{
+    return ESP_OK;
+}
+
+esp_err_t gw_runtime_sync_snapshot_upsert_device(const gw_device_t *device)
+{
+    return ESP_OK;
+}
+
+esp_err_t gw_runtime_sync_snapshot_upsert_endpoint(const gw_zb_endpoint_t *endpoint)
+{
+    return ESP_OK;
+}
+
+esp_err_t gw_runtime_sync_snapshot_remove_device(const gw_device_uid_t *uid)
+{
+    return ESP_OK;
+}
+
+esp_err_t gw_runtime_sync_snapshot_end(void)
+{
+    return ESP_OK;
+}
+
+// ---- matchers ----
+
+static uint32_t match_indexed(const gw_auto_compiled_t *set, const gw_rules_index_t *ix, const gw_event_t *e)
+{
+    gw_rules_event_view_t pv;
+    gw_rules_event_view(e, &pv);
+    const gw_auto_evt_type_t et = gw_rules_evt_type(e);
+    uint32_t hits = 0;
+    if (!gw_rules_index_candidates(ix, e, &pv, et)) return 0;
+    for (uint32_t slot = 0; slot < ix->slot_cap; slot++) {
+        if ((ix->candidates[slot / 32u] & (1u << (slot % 32u))) == 0) continue;
+        const uint32_t idx = ix->slot_auto[slot];
+        if (idx < set->hdr.automation_count && gw_rules_matching_trigger(set, &set->autos[idx], et, e, &pv)) hits++;
+    }
+    return hits;
+}
+
+static uint32_t match_scan(const gw_auto_compiled_t *set, const gw_event_t *e)
+{
+    gw_rules_event_view_t pv;
+    gw_rules_event_view(e, &pv);
+    const gw_auto_evt_type_t et = gw_rules_evt_type(e);
+    uint32_t hits = 0;
+    for (uint32_t i = 0; i < set->hdr.automation_count; i++) {
+        if (gw_rules_triggers_match(set, &set->autos[i], et, e, &pv)) hits++;
+    }
+    return hits;
+}
+
+// First automation the index matches for `e`, or -1.
+static int match_first(const gw_auto_compiled_t *set, const gw_rules_index_t *ix, const gw_event_t *e)
+{
+    gw_rules_event_view_t pv;
+    gw_rules_event_view(e, &pv);
+    const gw_auto_evt_type_t et = gw_rules_evt_type(e);
+    if (!gw_rules_index_candidates(ix, e, &pv, et)) return -1;
+    for (uint32_t slot = 0; slot < ix->slot_cap; slot++) {
+        if ((ix->candidates[slot / 32u] & (1u << (slot % 32u))) == 0) continue;
+        const uint32_t idx = ix->slot_auto[slot];
+        if (idx < set->hdr.automation_count && gw_rules_matching_trigger(set, &set->autos[idx], et, e, &pv)) {
+            return (int)idx;
+        }
+    }
+    return -1;
+}
+
+// The C6's EVT frame for `e`, as its UART bridge sends it.
+static size_t c6_evt_frame(const gw_event_t *e, uint16_t seq, uint8_t *out, size_t out_size)
+{
+    gw_uart_evt_v1_t evt = {.evt_id = GW_UART_EVT_COMMAND, .endpoint = e->payload_endpoint,
+                            .cluster_id = e->payload_cluster};
+    strlcpy(evt.event_type, e->type, sizeof(evt.event_type));
+    strlcpy(evt.cmd, e->payload_cmd, sizeof(evt.cmd));
+    strlcpy(evt.device_uid, e->device_uid, sizeof(evt.device_uid));
+    gw_uart_proto_frame_t frame = {
+        .ver = GW_UART_PROTO_VERSION_V1,
+        .msg_type = GW_UART_MSG_EVT,
+        .seq = seq,
+        .payload_len = sizeof(evt),
+    };
+    memcpy(frame.payload, &evt, sizeof(evt));
+    size_t len = 0;
+    return gw_uart_proto_build_frame(&frame, out, out_size, &len) == ESP_OK ? len : 0;
+}
+
+typedef struct {
+    uint64_t cpu_ns;  // host time spent in the code on the path
+    uint64_t wire_us; // modeled UART time
+    uint32_t commands;
+} latency_t;
+
+// S3 placement: EVT frame in, match on the S3, CMD_REQ out and its CMD_RSP back.
+static latency_t trigger_to_command_s3(const gw_auto_compiled_t *set, const gw_rules_index_t *ix, uint32_t rules,
+                                       uint32_t iters)
+{
+    latency_t l = {0};
+    gw_uart_proto_parser_t s3_parser;
+    gw_uart_proto_parser_init(&s3_parser);
+    gw_uart_proto_parser_init(&s_c6_parser);
+    mock_uart_set_sink(c6_rx);
+    s_commands = 0;
+    for (uint32_t i = 0; i < iters; i++) {
+        gw_event_t trigger;
+        make_event(i % rules, &trigger);
+        uint8_t raw[GW_UART_PROTO_MAX_FRAME_SIZE];
+        const int64_t t0_us = esp_timer_get_time();
+        const uint64_t t0 = host_bench_now_ns();
+        const size_t len = c6_evt_frame(&trigger, (uint16_t)i, raw, sizeof(raw));
+        mock_uart_wire(len);
+
+        gw_uart_proto_frame_t frame;
+        bool ready = false;
+        size_t consumed = 0;
+        if (gw_uart_proto_parser_feed(&s3_parser, raw, len, &frame, &ready, &consumed) != ESP_OK || !ready) break;
+        handle_rx_frame(&frame);
+        const int idx = match_first(set, ix, &s_published);
+        if (idx < 0) break;
+        gw_device_uid_t dst;
+        device_uid(1000 + (uint32_t)idx, dst.uid, sizeof(dst.uid));
+        if (gw_zigbee_onoff_cmd(&dst, 1, GW_ZIGBEE_ONOFF_CMD_ON) != ESP_OK) break;
+        l.cpu_ns += host_bench_now_ns() - t0;
+        l.wire_us += (uint64_t)(esp_timer_get_time() - t0_us);
+    }
+    l.commands = s_commands;
+    mock_uart_set_sink(NULL);
+    return l;
+}
+
+// C6 placement: the ZCL event is matched where it arrives; the command is queued locally.
+static latency_t trigger_to_command_c6(const gw_auto_compiled_t *set, const gw_rules_index_t *ix, uint32_t rules,
+                                       uint32_t iters)
+{
+    latency_t l = {0};
+    for (uint32_t i = 0; i < iters; i++) {
+        gw_event_t trigger;
+        make_event(i % rules, &trigger);
+        const uint64_t t0 = host_bench_now_ns();
+        const int idx = match_first(set, ix, &trigger);
+        l.cpu_ns += host_bench_now_ns() - t0;
+        l.commands += idx >= 0;
+    }
+    return l;
+}
+
+static void latency_report(const char *what, const latency_t *l, uint32_t iters)
+{
+    printf("%-48s %10.1f ns/op cpu %8.2f ms wire\n", what, iters ? (double)l->cpu_ns / iters : 0.0,
+           iters ? (double)l->wire_us / iters / 1000.0 : 0.0);
+}
+
+int main(int argc, char **argv)
+{
+    static const uint32_t k_counts[] = {16, 64, 256, 1024};
+    const uint32_t iters = host_bench_iters(argc, argv, 200000);
+    const uint32_t e2e_iters = iters / 20 ? iters / 20 : 1;
+    int rc = 0;
+
+    mock_uart_set_baud(GW_UART_BAUD);
+
+    gw_auto_compiled_t set = {0};
+    if (gw_auto_compiled_merge(NULL, NULL, NULL, &set) != ESP_OK) return 1;
+    uint32_t have = 0;
+    for (size_t c = 0; c < sizeof(k_counts) / sizeof(k_counts[0]); c++) {
+        const uint32_t n = k_counts[c];
+        if (iters < 1000 && n > 64) break; // smoke run: small sets only
+        while (have < n) {
+            if (add_rule(&set, have++) != ESP_OK) return 1;
+        }
+
+        size_t index_cap = 0;
+        size_t mask_words = 0;
+        gw_rules_index_geometry(&set, &index_cap, &mask_words);
+        void *block = calloc(1, gw_rules_index_block_size(index_cap, mask_words));
+        if (!block) return 1;
+        gw_rules_index_t ix;
+        gw_rules_index_attach(&ix, block, index_cap, mask_words);
+        gw_rules_index_fill(&ix, &set);
+
+        gw_event_t events[256];
+        for (uint32_t i = 0; i < 256; i++) {
+            make_event(i * 7, &events[i]);
+        }
+
+        uint32_t hits_ix = 0;
+        uint64_t t0 = host_bench_now_ns();
+        for (uint32_t i = 0; i < iters; i++) {
+            hits_ix += match_indexed(&set, &ix, &events[i & 255]);
+        }
+        const uint64_t ns_ix = host_bench_now_ns() - t0;
+
+        uint32_t hits_scan = 0;
+        t0 = host_bench_now_ns();
+        for (uint32_t i = 0; i < iters; i++) {
+            hits_scan += match_scan(&set, &events[i & 255]);
+        }
+        const uint64_t ns_scan = host_bench_now_ns() - t0;
+
+        char what[64];
+        snprintf(what, sizeof(what), "%4u rules, indexed", (unsigned)n);
+        host_bench_report(what, ns_ix, iters);
+        snprintf(what, sizeof(what), "%4u rules, scan", (unsigned)n);
+        host_bench_report(what, ns_scan, iters);
+        if (hits_ix != hits_scan) {
+            printf("mismatch: indexed %u hits, scan %u hits\n", (unsigned)hits_ix, (unsigned)hits_scan);
+            rc = 1;
+        }
+
+        const latency_t s3 = trigger_to_command_s3(&set, &ix, n, e2e_iters);
+        const latency_t c6 = trigger_to_command_c6(&set, &ix, n, e2e_iters);
+        snprintf(what, sizeof(what), "%4u rules, trigger->command, S3 placement", (unsigned)n);
+        latency_report(what, &s3, e2e_iters);
+        snprintf(what, sizeof(what), "%4u rules, trigger->command, C6 placement", (unsigned)n);
+        latency_report(what, &c6, e2e_iters);
+        if (s3.commands != e2e_iters || c6.commands != e2e_iters) {
+            printf("lost commands: S3 %u, C6 %u of %u\n", (unsigned)s3.commands, (unsigned)c6.commands,
+                   (unsigned)e2e_iters);
+            rc = 1;
+        }
+        free(block);
+    }
+    gw_auto_compiled_free(&set);
+    return rc;
+}
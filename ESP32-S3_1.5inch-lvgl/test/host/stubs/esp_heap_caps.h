@@ -0,0 +1,33 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#define MALLOC_CAP_8BIT     (1u << 2)
+#define MALLOC_CAP_DMA      (1u << 3)
+#define MALLOC_CAP_SPIRAM   (1u << 10)
+#define MALLOC_CAP_INTERNAL (1u << 11)
+
+// Every capability is plain heap on the host.
+static inline void *heap_caps_malloc(size_t size, uint32_t caps)
+{
+    (void)caps;
+    return malloc(size);
+}
+
+static inline void *heap_caps_calloc(size_t n, size_t size, uint32_t caps)
+{
+    (void)caps;
+    return calloc(n, size);
+}
+
+static inline void heap_caps_free(void *ptr)
+{
+    free(ptr);
+}
+
+static inline size_t heap_caps_get_free_size(uint32_t caps)
+{
+    (void)caps;
+    return 0;
+}
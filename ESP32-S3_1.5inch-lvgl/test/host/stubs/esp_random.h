@@ -0,0 +1,6 @@
+#pragma once
+
+#include <stdint.h>
+
+// Returns the value set with host_random_set() (see host_stubs.h).
+uint32_t esp_random(void);
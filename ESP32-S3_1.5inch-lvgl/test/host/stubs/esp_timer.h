@@ -0,0 +1,6 @@
+#pragma once
+
+#include <stdint.h>
+
+// Microseconds on the fake monotonic clock (see host_ticks_advance()).
+int64_t esp_timer_get_time(void);
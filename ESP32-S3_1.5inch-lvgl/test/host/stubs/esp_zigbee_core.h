@@ -0,0 +1,13 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "freertos/FreeRTOS.h"
+
+// The few Zigbee stack calls the C6 command scheduler makes; tests define them.
+typedef void (*esp_zb_callback_t)(uint8_t param);
+
+void esp_zb_scheduler_alarm(esp_zb_callback_t cb, uint8_t param, uint32_t time);
+bool esp_zb_lock_acquire(TickType_t block_ticks);
+void esp_zb_lock_release(void);
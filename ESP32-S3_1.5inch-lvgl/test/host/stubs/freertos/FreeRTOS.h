@@ -0,0 +1,35 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Host stand-in: ticks are milliseconds and everything but critical sections is
+// single-threaded. Critical sections share one recursive lock, so a test may run
+// a reader on a second thread against code that only relies on them.
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned UBaseType_t;
+typedef void *TaskHandle_t;
+typedef void *QueueHandle_t;
+typedef void *SemaphoreHandle_t;
+
+typedef struct {
+    int unused;
+} portMUX_TYPE;
+
+void host_critical_enter(void);
+void host_critical_exit(void);
+
+#define portMUX_INITIALIZER_UNLOCKED {0}
+#define portENTER_CRITICAL(m)        ((void)(m), host_critical_enter())
+#define portEXIT_CRITICAL(m)         ((void)(m), host_critical_exit())
+#define portMAX_DELAY                0xffffffffu
+#define portTICK_PERIOD_MS           1
+#define configTICK_RATE_HZ           1000
+#define pdMS_TO_TICKS(x)             ((TickType_t)(x))
+#define pdTICKS_TO_MS(x)             ((uint32_t)(x))
+#define pdTRUE                       1
+#define pdFALSE                      0
+#define pdPASS                       1
+#define pdFAIL                       0
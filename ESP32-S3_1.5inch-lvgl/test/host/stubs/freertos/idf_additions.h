@@ -0,0 +1,33 @@
+#pragma once
+
+#include "esp_heap_caps.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+
+// Memory capabilities are ignored on the host.
+static inline QueueHandle_t xQueueCreateWithCaps(UBaseType_t length, UBaseType_t item_size, uint32_t caps)
+{
+    (void)caps;
+    return xQueueCreate(length, item_size);
+}
+
+static inline void vQueueDeleteWithCaps(QueueHandle_t q)
+{
+    vQueueDelete(q);
+}
+
+// Tasks never run on the host: tests call the task's steps themselves.
+static inline BaseType_t xTaskCreateWithCaps(void (*fn)(void *), const char *name, uint32_t stack, void *arg,
+                                             UBaseType_t prio, TaskHandle_t *out, uint32_t caps)
+{
+    (void)fn;
+    (void)name;
+    (void)stack;
+    (void)arg;
+    (void)prio;
+    (void)caps;
+    if (out) {
+        *out = NULL;
+    }
+    return pdPASS;
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+// Timing helpers for the host benchmarks. Every benchmark takes --smoke, which
+// ctest passes to run a few iterations as a build-and-run check only.
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+static inline uint64_t host_bench_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static inline uint32_t host_bench_iters(int argc, char **argv, uint32_t full)
+{
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--smoke") == 0) return full / 1000 ? full / 1000 : 1;
+    }
+    return full;
+}
+
+static inline void host_bench_report(const char *what, uint64_t ns, uint32_t iters)
+{
+    printf("%-48s %10.1f ns/op\n", what, iters ? (double)ns / iters : 0.0);
+}
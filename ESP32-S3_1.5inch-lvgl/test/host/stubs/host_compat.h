@@ -0,0 +1,6 @@
+#pragma once
+
+// Force-included into every host build: newlib extras the firmware relies on.
+#include <stddef.h>
+
+size_t strlcpy(char *dst, const char *src, size_t size);
@@ -0,0 +1,352 @@
+// host_stubs.c - ESP-IDF and FreeRTOS stand-ins for host tests
+#include "host_stubs.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_err.h"
+#include "esp_random.h"
+#include "esp_rom_crc.h"
+#include "esp_spiffs.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "nvs.h"
+
+const char *esp_err_to_name(esp_err_t code)
+{
+    switch (code) {
+    case ESP_OK: return "ESP_OK";
+    case ESP_FAIL: return "ESP_FAIL";
+    case ESP_ERR_NO_MEM: return "ESP_ERR_NO_MEM";
+    case ESP_ERR_INVALID_ARG: return "ESP_ERR_INVALID_ARG";
+    case ESP_ERR_INVALID_STATE: return "ESP_ERR_INVALID_STATE";
+    case ESP_ERR_INVALID_SIZE: return "ESP_ERR_INVALID_SIZE";
+    case ESP_ERR_NOT_FOUND: return "ESP_ERR_NOT_FOUND";
+    case ESP_ERR_TIMEOUT: return "ESP_ERR_TIMEOUT";
+    case ESP_ERR_INVALID_CRC: return "ESP_ERR_INVALID_CRC";
+    case ESP_ERR_INVALID_VERSION: return "ESP_ERR_INVALID_VERSION";
+    case ESP_ERR_NVS_NOT_FOUND: return "ESP_ERR_NVS_NOT_FOUND";
+    default: return "ESP_ERR_UNKNOWN";
+    }
+}
+
+size_t strlcpy(char *dst, const char *src, size_t size)
+{
+    const size_t len = strlen(src);
+    if (size) {
+        const size_t n = len < size - 1 ? len : size - 1;
+        memcpy(dst, src, n);
+        dst[n] = '\0';
+    }
+    return len;
+}
+
+uint32_t esp_rom_crc32_le(uint32_t crc, const uint8_t *buf, uint32_t len)
+{
+    crc = ~crc;
+    for (uint32_t i = 0; i < len; i++) {
+        crc ^= buf[i];
+        for (int b = 0; b < 8; b++) {
+            crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1u)));
+        }
+    }
+    return ~crc;
+}
+
+static uint32_t s_random;
+
+void host_random_set(uint32_t value)
+{
+    s_random = value;
+}
+
+uint32_t esp_random(void)
+{
+    return s_random;
+}
+
+esp_err_t esp_vfs_spiffs_register(const esp_vfs_spiffs_conf_t *conf)
+{
+    (void)conf;
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+// ---- FreeRTOS ----
+
+static TickType_t s_ticks;
+static TaskHandle_t s_current_task;
+static int s_mutex_token;
+
+static pthread_once_t s_critical_once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t s_critical;
+
+static void critical_init(void)
+{
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&s_critical, &attr);
+    pthread_mutexattr_destroy(&attr);
+}
+
+void host_critical_enter(void)
+{
+    pthread_once(&s_critical_once, critical_init);
+    pthread_mutex_lock(&s_critical);
+}
+
+void host_critical_exit(void)
+{
+    pthread_mutex_unlock(&s_critical);
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+    return s_ticks;
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    s_ticks += ticks;
+}
+
+void host_ticks_advance(uint32_t ms)
+{
+    s_ticks += ms;
+}
+
+void host_task_set_current(TaskHandle_t task)
+{
+    s_current_task = task;
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+    return s_current_task;
+}
+
+BaseType_t xTaskCreate(void (*fn)(void *), const char *name, uint32_t stack, void *arg, UBaseType_t prio,
+                       TaskHandle_t *out)
+{
+    (void)fn;
+    (void)name;
+    (void)stack;
+    (void)arg;
+    (void)prio;
+    if (out) {
+        *out = NULL;
+    }
+    return pdPASS;
+}
+
+void vTaskDelete(TaskHandle_t task)
+{
+    (void)task;
+}
+
+int64_t esp_timer_get_time(void)
+{
+    return (int64_t)s_ticks * 1000;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void)
+{
+    return &s_mutex_token;
+}
+
+// A binary semaphore holds at most one give; like the queues, an empty take fails at once.
+SemaphoreHandle_t xSemaphoreCreateBinary(void)
+{
+    return calloc(1, sizeof(int));
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t wait)
+{
+    (void)wait;
+    if (sem == NULL || sem == &s_mutex_token) {
+        return pdTRUE;
+    }
+    int *given = sem;
+    if (!*given) {
+        return pdFALSE;
+    }
+    *given = 0;
+    return pdTRUE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem)
+{
+    if (sem != NULL && sem != &s_mutex_token) {
+        *(int *)sem = 1;
+    }
+    return pdTRUE;
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t sem)
+{
+    if (sem != &s_mutex_token) {
+        free(sem);
+    }
+}
+
+typedef struct {
+    size_t cap;
+    size_t item_size;
+    size_t head;
+    size_t count;
+    uint8_t items[];
+} host_queue_t;
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size)
+{
+    host_queue_t *q = calloc(1, sizeof(*q) + (size_t)length * item_size);
+    if (q) {
+        q->cap = length;
+        q->item_size = item_size;
+    }
+    return q;
+}
+
+BaseType_t xQueueSend(QueueHandle_t handle, const void *item, TickType_t wait)
+{
+    host_queue_t *q = handle;
+    (void)wait;
+    if (!q || q->count == q->cap) {
+        return pdFALSE;
+    }
+    memcpy(&q->items[((q->head + q->count) % q->cap) * q->item_size], item, q->item_size);
+    q->count++;
+    return pdTRUE;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t handle, void *item, TickType_t wait)
+{
+    host_queue_t *q = handle;
+    (void)wait;
+    if (!q || q->count == 0) {
+        return pdFALSE;
+    }
+    memcpy(item, &q->items[q->head * q->item_size], q->item_size);
+    q->head = (q->head + 1) % q->cap;
+    q->count--;
+    return pdTRUE;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t handle)
+{
+    const host_queue_t *q = handle;
+    return q ? (UBaseType_t)q->count : 0;
+}
+
+UBaseType_t uxQueueSpacesAvailable(QueueHandle_t handle)
+{
+    const host_queue_t *q = handle;
+    return q ? (UBaseType_t)(q->cap - q->count) : 0;
+}
+
+void vQueueDelete(QueueHandle_t handle)
+{
+    free(handle);
+}
+
+// ---- NVS ----
+
+typedef struct mock_nvs_entry {
+    struct mock_nvs_entry *next;
+    char key[16];
+    size_t len;
+    uint8_t data[];
+} mock_nvs_entry_t;
+
+static mock_nvs_entry_t *s_nvs;
+
+static mock_nvs_entry_t **nvs_find(const char *key)
+{
+    mock_nvs_entry_t **pp = &s_nvs;
+    while (*pp && strcmp((*pp)->key, key) != 0) {
+        pp = &(*pp)->next;
+    }
+    return pp;
+}
+
+void mock_nvs_reset(void)
+{
+    while (s_nvs) {
+        mock_nvs_entry_t *e = s_nvs;
+        s_nvs = e->next;
+        free(e);
+    }
+}
+
+esp_err_t nvs_open(const char *ns, nvs_open_mode_t mode, nvs_handle_t *out)
+{
+    (void)ns;
+    (void)mode;
+    *out = 1;
+    return ESP_OK;
+}
+
+void nvs_close(nvs_handle_t h)
+{
+    (void)h;
+}
+
+esp_err_t nvs_set_blob(nvs_handle_t h, const char *key, const void *value, size_t len)
+{
+    (void)nvs_erase_key(h, key);
+    mock_nvs_entry_t *e = (mock_nvs_entry_t *)calloc(1, sizeof(*e) + len);
+    if (!e) return ESP_ERR_NO_MEM;
+    strlcpy(e->key, key, sizeof(e->key));
+    e->len = len;
+    memcpy(e->data, value, len);
+    e->next = s_nvs;
+    s_nvs = e;
+    return ESP_OK;
+}
+
+esp_err_t nvs_get_blob(nvs_handle_t h, const char *key, void *out, size_t *len)
+{
+    (void)h;
+    mock_nvs_entry_t *e = *nvs_find(key);
+    if (!e) return ESP_ERR_NVS_NOT_FOUND;
+    if (!out) {
+        *len = e->len;
+        return ESP_OK;
+    }
+    if (*len < e->len) return ESP_ERR_NVS_INVALID_LENGTH;
+    memcpy(out, e->data, e->len);
+    *len = e->len;
+    return ESP_OK;
+}
+
+esp_err_t nvs_set_u32(nvs_handle_t h, const char *key, uint32_t value)
+{
+    return nvs_set_blob(h, key, &value, sizeof(value));
+}
+
+esp_err_t nvs_get_u32(nvs_handle_t h, const char *key, uint32_t *out)
+{
+    size_t len = sizeof(*out);
+    return nvs_get_blob(h, key, out, &len);
+}
+
+esp_err_t nvs_erase_key(nvs_handle_t h, const char *key)
+{
+    (void)h;
+    mock_nvs_entry_t **pp = nvs_find(key);
+    if (!*pp) return ESP_ERR_NVS_NOT_FOUND;
+    mock_nvs_entry_t *e = *pp;
+    *pp = e->next;
+    free(e);
+    return ESP_OK;
+}
+
+esp_err_t nvs_commit(nvs_handle_t h)
+{
+    (void)h;
+    return ESP_OK;
+}
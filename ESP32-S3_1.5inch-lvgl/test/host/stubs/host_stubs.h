@@ -0,0 +1,63 @@
+#pragma once
+
+// Controls for the host stand-ins of ESP-IDF services.
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_http_server.h"
+#include "esp_partition.h"
+#include "freertos/FreeRTOS.h"
+
+// RAM-backed flash partition. Writes behave like NOR flash (they can only
+// clear bits) and offsets are checked against the erase/size bounds.
+const esp_partition_t *mock_partition_add(const char *label, size_t size, size_t erase_size);
+uint8_t *mock_partition_data(const esp_partition_t *part);
+void mock_partition_reset(void);
+
+// Power loss: after `bytes` more bytes reach flash every write and erase fails
+// and the write crossing the budget is torn. mock_partition_power_on() restores it.
+void mock_partition_cut_power_after(size_t bytes);
+void mock_partition_power_on(void);
+size_t mock_partition_bytes_written(void);
+
+// In-memory NVS shared by every namespace handle.
+void mock_nvs_reset(void);
+
+// Fake monotonic clock behind xTaskGetTickCount() and esp_timer_get_time();
+// vTaskDelay() advances it.
+void host_ticks_advance(uint32_t ms);
+
+// Handle xTaskGetCurrentTaskHandle() returns, NULL until set.
+void host_task_set_current(TaskHandle_t task);
+
+// Value every esp_random() call returns until the next set.
+void host_random_set(uint32_t value);
+
+// Recording httpd (mock_httpd.c): handlers registered so far, found by URI and method.
+void mock_httpd_reset(void);
+const httpd_uri_t *mock_httpd_find(const char *uri, int method);
+void mock_httpd_req_init(httpd_req_t *r, const char *uri, int method);
+// Request header as the client sent it; `field` and `value` must outlive the request.
+void mock_httpd_req_add_hdr(httpd_req_t *r, const char *field, const char *value);
+// Response header set by the handler, NULL when absent.
+const char *mock_httpd_resp_hdr(const httpd_req_t *r, const char *field);
+
+// WebSocket side of the recording httpd. Frames passed to httpd_ws_send_data_async()
+// go to `sink` right away; their completion callbacks only run from
+// mock_httpd_ws_complete(), as httpd runs them once the socket write is done.
+typedef void (*mock_httpd_ws_sink_t)(int fd, const uint8_t *data, size_t len);
+void mock_httpd_ws_set_sink(mock_httpd_ws_sink_t sink);
+// Completes every send outstanding when called; returns how many.
+size_t mock_httpd_ws_complete(void);
+// True once httpd_sess_trigger_close() was called for `fd`; closed fds stop being WebSocket clients.
+bool mock_httpd_ws_closed(int fd);
+
+// Recording UART driver (mock_uart.c): bytes passed to uart_write_bytes() go to `sink`
+// right away; uart_read_bytes() never returns any.
+typedef void (*mock_uart_sink_t)(const uint8_t *data, size_t len);
+void mock_uart_set_sink(mock_uart_sink_t sink);
+// Wire time at `baud`, 10 bits a byte: bytes written, and bytes the test reports as
+// received with mock_uart_wire(), advance the fake clock. 0 (the default) turns it off.
+void mock_uart_set_baud(uint32_t baud);
+void mock_uart_wire(size_t bytes);
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+
+static int s_host_failures;
+
+#define CHECK(cond)                                                                  \
+    do {                                                                             \
+        if (!(cond)) {                                                               \
+            printf("%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #cond);           \
+            s_host_failures++;                                                       \
+        }                                                                            \
+    } while (0)
+
+#define CHECK_EQ(a, b)                                                               \
+    do {                                                                             \
+        long long a_ = (long long)(a);                                               \
+        long long b_ = (long long)(b);                                               \
+        if (a_ != b_) {                                                              \
+            printf("%s:%d: CHECK_EQ failed: %s (%lld) != %s (%lld)\n", __FILE__,     \
+                   __LINE__, #a, a_, #b, b_);                                        \
+            s_host_failures++;                                                       \
+        }                                                                            \
+    } while (0)
+
+#define RUN_TEST(fn)                                                                 \
+    do {                                                                             \
+        int before_ = s_host_failures;                                               \
+        fn();                                                                        \
+        printf("%s %s\n", s_host_failures == before_ ? "ok  " : "FAIL", #fn);        \
+    } while (0)
+
+#define HOST_TEST_RESULT() (s_host_failures ? EXIT_FAILURE : EXIT_SUCCESS)
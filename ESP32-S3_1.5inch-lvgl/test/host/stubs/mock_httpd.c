@@ -0,0 +1,284 @@
+// mock_httpd.c - recording esp_http_server stand-in for handler tests
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+
+#include "esp_http_server.h"
+#include "host_stubs.h"
+
+#define MOCK_HTTPD_MAX_URIS    48
+#define MOCK_HTTPD_MAX_SENDS   16
+#define MOCK_HTTPD_MAX_CLOSED  16
+
+typedef struct {
+    int fd;
+    transfer_complete_cb cb;
+    void *arg;
+} mock_ws_send_t;
+
+static httpd_uri_t s_uris[MOCK_HTTPD_MAX_URIS];
+static size_t s_uri_count;
+static mock_httpd_ws_sink_t s_ws_sink;
+static mock_ws_send_t s_ws_sends[MOCK_HTTPD_MAX_SENDS];
+static size_t s_ws_send_count;
+static int s_ws_closed[MOCK_HTTPD_MAX_CLOSED];
+static size_t s_ws_closed_count;
+
+void mock_httpd_reset(void)
+{
+    s_uri_count = 0;
+    s_ws_sink = NULL;
+    s_ws_send_count = 0;
+    s_ws_closed_count = 0;
+}
+
+const httpd_uri_t *mock_httpd_find(const char *uri, int method)
+{
+    for (size_t i = 0; i < s_uri_count; i++) {
+        if ((int)s_uris[i].method == method && strcmp(s_uris[i].uri, uri) == 0) {
+            return &s_uris[i];
+        }
+    }
+    return NULL;
+}
+
+void mock_httpd_req_init(httpd_req_t *r, const char *uri, int method)
+{
+    memset(r, 0, sizeof(*r));
+    snprintf((char *)r->uri, sizeof(r->uri), "%s", uri);
+    r->method = method;
+}
+
+void mock_httpd_req_add_hdr(httpd_req_t *r, const char *field, const char *value)
+{
+    for (size_t i = 0; i < MOCK_HTTPD_MAX_HDRS; i++) {
+        if (!r->req_hdrs[i].name) {
+            r->req_hdrs[i].name = field;
+            r->req_hdrs[i].value = value;
+            return;
+        }
+    }
+}
+
+const char *mock_httpd_resp_hdr(const httpd_req_t *r, const char *field)
+{
+    for (size_t i = 0; i < MOCK_HTTPD_MAX_HDRS && r->resp_hdrs[i].name; i++) {
+        if (strcasecmp(r->resp_hdrs[i].name, field) == 0) {
+            return r->resp_hdr_values[i];
+        }
+    }
+    return NULL;
+}
+
+// httpd reads the header values when the status line goes out: they only have to live until then.
+static void send_headers(httpd_req_t *r)
+{
+    if (r->sent || r->body_len) {
+        return;
+    }
+    for (size_t i = 0; i < MOCK_HTTPD_MAX_HDRS && r->resp_hdrs[i].name; i++) {
+        snprintf(r->resp_hdr_values[i], sizeof(r->resp_hdr_values[i]), "%s", r->resp_hdrs[i].value);
+    }
+}
+
+esp_err_t httpd_register_uri_handler(httpd_handle_t handle, const httpd_uri_t *uri_handler)
+{
+    if (!handle || !uri_handler || s_uri_count == MOCK_HTTPD_MAX_URIS) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    for (size_t i = 0; i < s_uri_count; i++) {
+        if (s_uris[i].method == uri_handler->method && strcmp(s_uris[i].uri, uri_handler->uri) == 0) {
+            s_uris[i] = *uri_handler; // registering again after a "reboot"
+            return ESP_OK;
+        }
+    }
+    s_uris[s_uri_count++] = *uri_handler;
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_set_type(httpd_req_t *r, const char *type)
+{
+    r->type = type;
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_set_status(httpd_req_t *r, const char *status)
+{
+    r->status = status;
+    return ESP_OK;
+}
+
+// Like httpd, only the pointers are kept.
+esp_err_t httpd_resp_set_hdr(httpd_req_t *r, const char *field, const char *value)
+{
+    for (size_t i = 0; i < MOCK_HTTPD_MAX_HDRS; i++) {
+        if (!r->resp_hdrs[i].name) {
+            r->resp_hdrs[i].name = field;
+            r->resp_hdrs[i].value = value;
+            return ESP_OK;
+        }
+    }
+    return ESP_ERR_NO_MEM;
+}
+
+esp_err_t httpd_resp_send(httpd_req_t *r, const char *buf, ssize_t buf_len)
+{
+    if (r->sent) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    send_headers(r);
+    r->body_len = buf_len < 0 ? (buf ? strlen(buf) : 0) : (size_t)buf_len;
+    r->sent = true;
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_send_chunk(httpd_req_t *r, const char *buf, ssize_t buf_len)
+{
+    if (r->sent) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    const size_t n = buf_len < 0 ? (buf ? strlen(buf) : 0) : (size_t)buf_len;
+    send_headers(r);
+    r->body_len += n;
+    r->sent = buf == NULL || n == 0;
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_sendstr(httpd_req_t *r, const char *str)
+{
+    return httpd_resp_send(r, str, HTTPD_RESP_USE_STRLEN);
+}
+
+esp_err_t httpd_resp_send_err(httpd_req_t *req, httpd_err_code_t error, const char *msg)
+{
+    req->err = (int)error + 1;
+    return httpd_resp_send(req, msg, HTTPD_RESP_USE_STRLEN);
+}
+
+int httpd_req_recv(httpd_req_t *r, char *buf, size_t buf_len)
+{
+    return -1;
+}
+
+esp_err_t httpd_req_get_hdr_value_str(httpd_req_t *r, const char *field, char *val, size_t val_size)
+{
+    for (size_t i = 0; i < MOCK_HTTPD_MAX_HDRS && r->req_hdrs[i].name; i++) {
+        if (strcasecmp(r->req_hdrs[i].name, field) == 0) {
+            const int n = snprintf(val, val_size, "%s", r->req_hdrs[i].value);
+            return n >= 0 && (size_t)n < val_size ? ESP_OK : ESP_ERR_HTTPD_RESULT_TRUNC;
+        }
+    }
+    return ESP_ERR_NOT_FOUND;
+}
+
+esp_err_t httpd_req_get_url_query_str(httpd_req_t *r, char *buf, size_t buf_len)
+{
+    const char *q = strchr(r->uri, '?');
+    if (!q) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    const int n = snprintf(buf, buf_len, "%s", q + 1);
+    return n >= 0 && (size_t)n < buf_len ? ESP_OK : ESP_ERR_HTTPD_RESULT_TRUNC;
+}
+
+esp_err_t httpd_query_key_value(const char *qry, const char *key, char *val, size_t val_size)
+{
+    const size_t key_len = strlen(key);
+    for (const char *p = qry; p && *p; p = strchr(p, '&') ? strchr(p, '&') + 1 : NULL) {
+        if (strncmp(p, key, key_len) == 0 && p[key_len] == '=') {
+            const char *v = p + key_len + 1;
+            const size_t n = strcspn(v, "&");
+            snprintf(val, val_size, "%.*s", (int)n, v);
+            return n < val_size ? ESP_OK : ESP_ERR_HTTPD_RESULT_TRUNC;
+        }
+    }
+    return ESP_ERR_NOT_FOUND;
+}
+
+esp_err_t httpd_req_async_handler_begin(httpd_req_t *r, httpd_req_t **out)
+{
+    *out = r;
+    return ESP_OK;
+}
+
+esp_err_t httpd_req_async_handler_complete(httpd_req_t *r)
+{
+    return ESP_OK;
+}
+
+int httpd_req_to_sockfd(httpd_req_t *r)
+{
+    return r->fd;
+}
+
+esp_err_t httpd_sess_trigger_close(httpd_handle_t handle, int sockfd)
+{
+    if (!mock_httpd_ws_closed(sockfd) && s_ws_closed_count < MOCK_HTTPD_MAX_CLOSED) {
+        s_ws_closed[s_ws_closed_count++] = sockfd;
+    }
+    return ESP_OK;
+}
+
+// With max_len 0 only the type and length are reported, as httpd does.
+esp_err_t httpd_ws_recv_frame(httpd_req_t *req, httpd_ws_frame_t *pkt, size_t max_len)
+{
+    pkt->type = req->ws_type;
+    pkt->final = true;
+    pkt->len = req->ws_len;
+    if (max_len == 0) {
+        return ESP_OK;
+    }
+    if (max_len < req->ws_len || !pkt->payload) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    memcpy(pkt->payload, req->ws_payload, req->ws_len);
+    return ESP_OK;
+}
+
+esp_err_t httpd_ws_send_data_async(httpd_handle_t handle, int socket, httpd_ws_frame_t *frame,
+                                   transfer_complete_cb callback, void *arg)
+{
+    if (s_ws_send_count == MOCK_HTTPD_MAX_SENDS) {
+        return ESP_ERR_NO_MEM;
+    }
+    if (s_ws_sink) {
+        s_ws_sink(socket, frame->payload, frame->len);
+    }
+    s_ws_sends[s_ws_send_count++] = (mock_ws_send_t){socket, callback, arg};
+    return ESP_OK;
+}
+
+httpd_ws_client_info_t httpd_ws_get_fd_info(httpd_handle_t hd, int fd)
+{
+    return fd > 0 && !mock_httpd_ws_closed(fd) ? HTTPD_WS_CLIENT_WEBSOCKET : HTTPD_WS_CLIENT_INVALID;
+}
+
+void mock_httpd_ws_set_sink(mock_httpd_ws_sink_t sink)
+{
+    s_ws_sink = sink;
+}
+
+size_t mock_httpd_ws_complete(void)
+{
+    // A callback may send the next frame; that one waits for the next call.
+    mock_ws_send_t done[MOCK_HTTPD_MAX_SENDS];
+    const size_t n = s_ws_send_count;
+    memcpy(done, s_ws_sends, n * sizeof(done[0]));
+    s_ws_send_count = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (done[i].cb) {
+            done[i].cb(ESP_OK, done[i].fd, done[i].arg);
+        }
+    }
+    return n;
+}
+
+bool mock_httpd_ws_closed(int fd)
+{
+    for (size_t i = 0; i < s_ws_closed_count; i++) {
+        if (s_ws_closed[i] == fd) {
+            return true;
+        }
+    }
+    return false;
+}
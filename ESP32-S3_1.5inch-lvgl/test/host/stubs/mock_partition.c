@@ -0,0 +1,149 @@
+// mock_partition.c - RAM-backed esp_partition with power-loss injection
+#include "host_stubs.h"
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MOCK_PARTITION_MAX 4
+
+typedef struct {
+    esp_partition_t part;
+    uint8_t *data;
+} mock_partition_t;
+
+static mock_partition_t s_parts[MOCK_PARTITION_MAX];
+static size_t s_part_count;
+static bool s_cut_armed;
+static size_t s_budget;
+static size_t s_written;
+
+static mock_partition_t *mock_from(const esp_partition_t *part)
+{
+    for (size_t i = 0; i < s_part_count; i++) {
+        if (&s_parts[i].part == part) return &s_parts[i];
+    }
+    return NULL;
+}
+
+const esp_partition_t *mock_partition_add(const char *label, size_t size, size_t erase_size)
+{
+    if (s_part_count >= MOCK_PARTITION_MAX) return NULL;
+    mock_partition_t *m = &s_parts[s_part_count];
+    m->data = (uint8_t *)malloc(size);
+    if (!m->data) return NULL;
+    memset(m->data, 0xFF, size);
+    m->part = (esp_partition_t){
+        .type = ESP_PARTITION_TYPE_DATA,
+        .subtype = ESP_PARTITION_SUBTYPE_DATA_UNDEFINED,
+        .size = (uint32_t)size,
+        .erase_size = (uint32_t)erase_size,
+    };
+    strlcpy(m->part.label, label, sizeof(m->part.label));
+    s_part_count++;
+    return &m->part;
+}
+
+uint8_t *mock_partition_data(const esp_partition_t *part)
+{
+    mock_partition_t *m = mock_from(part);
+    return m ? m->data : NULL;
+}
+
+void mock_partition_reset(void)
+{
+    for (size_t i = 0; i < s_part_count; i++) {
+        free(s_parts[i].data);
+    }
+    memset(s_parts, 0, sizeof(s_parts));
+    s_part_count = 0;
+    mock_partition_power_on();
+    s_written = 0;
+}
+
+void mock_partition_cut_power_after(size_t bytes)
+{
+    s_cut_armed = true;
+    s_budget = bytes;
+}
+
+void mock_partition_power_on(void)
+{
+    s_cut_armed = false;
+    s_budget = 0;
+}
+
+size_t mock_partition_bytes_written(void)
+{
+    return s_written;
+}
+
+const esp_partition_t *esp_partition_find_first(esp_partition_type_t type, esp_partition_subtype_t subtype, const char *label)
+{
+    for (size_t i = 0; i < s_part_count; i++) {
+        const esp_partition_t *p = &s_parts[i].part;
+        if (type != ESP_PARTITION_TYPE_ANY && p->type != type) continue;
+        if (subtype != ESP_PARTITION_SUBTYPE_ANY && p->subtype != subtype) continue;
+        if (label && strcmp(p->label, label) != 0) continue;
+        return p;
+    }
+    return NULL;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t *part, size_t offset, void *dst, size_t size)
+{
+    mock_partition_t *m = mock_from(part);
+    if (!m || !dst) return ESP_ERR_INVALID_ARG;
+    if (offset > part->size || size > part->size - offset) return ESP_ERR_INVALID_SIZE;
+    memcpy(dst, m->data + offset, size);
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_write(const esp_partition_t *part, size_t offset, const void *src, size_t size)
+{
+    mock_partition_t *m = mock_from(part);
+    if (!m || !src) return ESP_ERR_INVALID_ARG;
+    if (offset > part->size || size > part->size - offset) return ESP_ERR_INVALID_SIZE;
+
+    size_t n = size;
+    if (s_cut_armed && n > s_budget) n = s_budget;
+    const uint8_t *in = (const uint8_t *)src;
+    for (size_t i = 0; i < n; i++) {
+        m->data[offset + i] &= in[i]; // NOR flash only clears bits
+    }
+    s_written += n;
+    if (s_cut_armed) {
+        s_budget -= n;
+        if (n < size) return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_erase_range(const esp_partition_t *part, size_t offset, size_t size)
+{
+    mock_partition_t *m = mock_from(part);
+    if (!m) return ESP_ERR_INVALID_ARG;
+    if (offset % part->erase_size || size % part->erase_size) return ESP_ERR_INVALID_SIZE;
+    if (offset > part->size || size > part->size - offset) return ESP_ERR_INVALID_SIZE;
+    if (s_cut_armed && s_budget == 0) return ESP_FAIL;
+    memset(m->data + offset, 0xFF, size);
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_mmap(const esp_partition_t *part, size_t offset, size_t size,
+                             esp_partition_mmap_memory_t memory, const void **out_ptr,
+                             esp_partition_mmap_handle_t *out_handle)
+{
+    (void)memory;
+    mock_partition_t *m = mock_from(part);
+    if (!m || !out_ptr || !out_handle) return ESP_ERR_INVALID_ARG;
+    if (offset > part->size || size > part->size - offset) return ESP_ERR_INVALID_SIZE;
+    *out_ptr = m->data + offset;
+    *out_handle = 1;
+    return ESP_OK;
+}
+
+void esp_partition_munmap(esp_partition_mmap_handle_t handle)
+{
+    (void)handle;
+}
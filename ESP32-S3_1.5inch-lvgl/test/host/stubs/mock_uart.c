@@ -0,0 +1,99 @@
+// mock_uart.c - recording UART driver stand-in for link tests
+#include "driver/uart.h"
+#include "host_stubs.h"
+
+static mock_uart_sink_t s_sink;
+static uint32_t s_baud;
+static uint64_t s_wire_us;
+static uint64_t s_wire_ms_done; // whole milliseconds already passed to the clock
+
+void mock_uart_set_sink(mock_uart_sink_t sink)
+{
+    s_sink = sink;
+}
+
+void mock_uart_set_baud(uint32_t baud)
+{
+    s_baud = baud;
+}
+
+void mock_uart_wire(size_t bytes)
+{
+    if (!s_baud) {
+        return;
+    }
+    s_wire_us += (uint64_t)bytes * 10u * 1000000u / s_baud;
+    if (s_wire_us / 1000 > s_wire_ms_done) {
+        host_ticks_advance((uint32_t)(s_wire_us / 1000 - s_wire_ms_done));
+        s_wire_ms_done = s_wire_us / 1000;
+    }
+}
+
+esp_err_t uart_driver_install(uart_port_t port, int rx_buffer_size, int tx_buffer_size, int queue_size,
+                              QueueHandle_t *uart_queue, int intr_alloc_flags)
+{
+    (void)port;
+    (void)rx_buffer_size;
+    (void)tx_buffer_size;
+    (void)queue_size;
+    (void)intr_alloc_flags;
+    if (uart_queue) {
+        *uart_queue = NULL;
+    }
+    return ESP_OK;
+}
+
+esp_err_t uart_driver_delete(uart_port_t port)
+{
+    (void)port;
+    return ESP_OK;
+}
+
+bool uart_is_driver_installed(uart_port_t port)
+{
+    (void)port;
+    return true;
+}
+
+esp_err_t uart_param_config(uart_port_t port, const uart_config_t *cfg)
+{
+    (void)port;
+    (void)cfg;
+    return ESP_OK;
+}
+
+esp_err_t uart_set_pin(uart_port_t port, int tx, int rx, int rts, int cts)
+{
+    (void)port;
+    (void)tx;
+    (void)rx;
+    (void)rts;
+    (void)cts;
+    return ESP_OK;
+}
+
+int uart_write_bytes(uart_port_t port, const void *src, size_t size)
+{
+    (void)port;
+    mock_uart_wire(size);
+    if (s_sink) {
+        s_sink((const uint8_t *)src, size);
+    }
+    return (int)size;
+}
+
+int uart_read_bytes(uart_port_t port, void *buf, uint32_t length, TickType_t ticks_to_wait)
+{
+    (void)port;
+    (void)buf;
+    (void)length;
+    (void)ticks_to_wait;
+    return 0;
+}
+
+esp_err_t uart_wait_tx_done(uart_port_t port, TickType_t ticks_to_wait)
+{
+    (void)port;
+    (void)ticks_to_wait;
+    return ESP_OK;
+}
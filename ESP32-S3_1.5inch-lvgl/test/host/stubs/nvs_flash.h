@@ -0,0 +1,4 @@
+#pragma once
+
+#include "esp_err.h"
+#include "nvs.h"
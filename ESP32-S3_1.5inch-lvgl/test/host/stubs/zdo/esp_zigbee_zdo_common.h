@@ -0,0 +1,9 @@
+#pragma once
+
+// ZDP status codes as the Zigbee SDK defines them.
+typedef enum {
+    ESP_ZB_ZDP_STATUS_SUCCESS = 0x00,
+    ESP_ZB_ZDP_STATUS_DEVICE_NOT_FOUND = 0x81,
+    ESP_ZB_ZDP_STATUS_NOT_SUPPORTED = 0x84,
+    ESP_ZB_ZDP_STATUS_TIMEOUT = 0x85,
+} esp_zb_zdp_status_t;
@@ -0,0 +1,317 @@
+// test_action_batch.c - /api/actions/batch execution: planned frames, pipelined results
+//
+// gw_action_exec_batch_cbor() runs against a recording Zigbee link. While a pipeline is
+// open every command takes one result entry, as gw_zigbee_uart.c hands them out, and
+// its status is only filled in by pipeline_end().
+#include <string.h>
+
+#include "gw_core/action_exec.h"
+#include "gw_core/cbor.h"
+#include "gw_core/zb_model.h"
+#include "gw_zigbee/gw_zigbee.h"
+#include "host_test.h"
+
+#define GROUP_ID    0x0101
+#define GROUP_SIZE  16 // devices 0..15, endpoint 1
+#define MAX_SENDS   64
+
+typedef struct {
+    bool group;
+    uint16_t group_id;
+    char uid[GW_DEVICE_UID_STRLEN];
+    int op; // gw_zigbee_onoff_cmd_t, or 100 + level for a level move
+    bool with_onoff;
+    bool pipelined;
+} send_t;
+
+static send_t s_sends[MAX_SENDS];
+static size_t s_send_count;
+static esp_err_t *s_pipe;
+static size_t s_pipe_cap;
+static size_t s_pipe_next;
+static bool s_pipe_open;
+static int s_pipe_runs;
+static esp_err_t s_group_status = ESP_OK; // far-side status of a groupcast
+static int s_fail_dev = -1;               // far-side ESP_FAIL for this device
+
+static void uid_of(uint32_t dev, char *out, size_t len)
+{
+    snprintf(out, len, "0x00124b00%08x", (unsigned)dev);
+}
+
+static uint32_t dev_of(const char *uid)
+{
+    return (uint32_t)strtoul(uid + 10, NULL, 16);
+}
+
+// ---- fakes: the Zigbee link and the device model ----
+
+static esp_err_t record(const send_t *s, esp_err_t far_status)
+{
+    if (s_send_count < MAX_SENDS) {
+        s_sends[s_send_count] = *s;
+        s_sends[s_send_count].pipelined = s_pipe_open;
+        s_send_count++;
+    }
+    if (!s_pipe_open) {
+        return far_status;
+    }
+    CHECK(s_pipe_next < s_pipe_cap);
+    if (s_pipe_next < s_pipe_cap) {
+        s_pipe[s_pipe_next++] = far_status;
+    }
+    return ESP_OK;
+}
+
+static esp_err_t unicast_status(const gw_device_uid_t *uid)
+{
+    return s_fail_dev >= 0 && dev_of(uid->uid) == (uint32_t)s_fail_dev ? ESP_FAIL : ESP_OK;
+}
+
+esp_err_t gw_zigbee_onoff_cmd(const gw_device_uid_t *uid, uint8_t endpoint, gw_zigbee_onoff_cmd_t cmd)
+{
+    send_t s = {.op = (int)cmd};
+    strlcpy(s.uid, uid->uid, sizeof(s.uid));
+    return record(&s, unicast_status(uid));
+}
+
+esp_err_t gw_zigbee_level_move_to_level(const gw_device_uid_t *uid, uint8_t endpoint, gw_zigbee_level_t level)
+{
+    send_t s = {.op = 100 + level.level, .with_onoff = level.with_onoff};
+    strlcpy(s.uid, uid->uid, sizeof(s.uid));
+    return record(&s, unicast_status(uid));
+}
+
+esp_err_t gw_zigbee_group_onoff_cmd(uint16_t group_id, gw_zigbee_onoff_cmd_t cmd)
+{
+    const send_t s = {.group = true, .group_id = group_id, .op = (int)cmd};
+    return record(&s, s_group_status);
+}
+
+esp_err_t gw_zigbee_group_level_move_to_level(uint16_t group_id, gw_zigbee_level_t level)
+{
+    const send_t s = {.group = true, .group_id = group_id, .op = 100 + level.level, .with_onoff = level.with_onoff};
+    return record(&s, s_group_status);
+}
+
+esp_err_t gw_zigbee_color_move_to_xy(const gw_device_uid_t *uid, uint8_t endpoint, gw_zigbee_color_xy_t color)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t gw_zigbee_color_move_to_temp(const gw_device_uid_t *uid, uint8_t endpoint, gw_zigbee_color_temp_t temp)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t gw_zigbee_group_color_move_to_xy(uint16_t group_id, gw_zigbee_color_xy_t color)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t gw_zigbee_group_color_move_to_temp(uint16_t group_id, gw_zigbee_color_temp_t temp)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t gw_zigbee_scene_store(uint16_t group_id, uint8_t scene_id)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t gw_zigbee_scene_recall(uint16_t group_id, uint8_t scene_id)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t gw_zigbee_bind(const gw_device_uid_t *src_uid, uint8_t src_endpoint, uint16_t cluster_id,
+                         const gw_device_uid_t *dst_uid, uint8_t dst_endpoint)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t gw_zigbee_unbind(const gw_device_uid_t *src_uid, uint8_t src_endpoint, uint16_t cluster_id,
+                           const gw_device_uid_t *dst_uid, uint8_t dst_endpoint)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t gw_zigbee_pipeline_begin(esp_err_t *results, size_t cap)
+{
+    CHECK(!s_pipe_open);
+    s_pipe = results;
+    s_pipe_cap = cap;
+    s_pipe_next = 0;
+    s_pipe_open = true;
+    s_pipe_runs++;
+    return ESP_OK;
+}
+
+size_t gw_zigbee_pipeline_next(void)
+{
+    return s_pipe_next;
+}
+
+void gw_zigbee_pipeline_end(void)
+{
+    CHECK(s_pipe_open);
+    s_pipe_open = false;
+}
+
+uint16_t gw_zb_model_endpoint_group(const gw_device_uid_t *uid, uint8_t endpoint)
+{
+    return endpoint == 1 && dev_of(uid->uid) < GROUP_SIZE ? GROUP_ID : 0;
+}
+
+size_t gw_zb_model_group_size(uint16_t group_id)
+{
+    return group_id == GROUP_ID ? GROUP_SIZE : 0;
+}
+
+// ---- helpers ----
+
+typedef struct {
+    gw_cbor_writer_t w[GW_ACTION_BATCH_MAX];
+    gw_cbor_slice_t items[GW_ACTION_BATCH_MAX];
+    gw_action_result_t results[GW_ACTION_BATCH_MAX];
+    uint32_t count;
+    uint32_t frames;
+} batch_t;
+
+// {"type":"zigbee","cmd":cmd,"device_uid":...,"endpoint":1[,"level":level]}; a NULL cmd
+// leaves it out, which the decoder rejects.
+static void add(batch_t *b, const char *cmd, uint32_t dev, int level)
+{
+    char uid[GW_DEVICE_UID_STRLEN];
+    uid_of(dev, uid, sizeof(uid));
+    gw_cbor_writer_t *w = &b->w[b->count];
+    gw_cbor_writer_init(w);
+    esp_err_t rc = gw_cbor_writer_map(w, 3 + (cmd != NULL) + (level >= 0));
+    if (rc == ESP_OK) rc = gw_cbor_writer_text(w, "type");
+    if (rc == ESP_OK) rc = gw_cbor_writer_text(w, "zigbee");
+    if (rc == ESP_OK && cmd) {
+        rc = gw_cbor_writer_text(w, "cmd");
+        if (rc == ESP_OK) rc = gw_cbor_writer_text(w, cmd);
+    }
+    if (rc == ESP_OK) rc = gw_cbor_writer_text(w, "device_uid");
+    if (rc == ESP_OK) rc = gw_cbor_writer_text(w, uid);
+    if (rc == ESP_OK) rc = gw_cbor_writer_text(w, "endpoint");
+    if (rc == ESP_OK) rc = gw_cbor_writer_u64(w, 1);
+    if (rc == ESP_OK && level >= 0) {
+        rc = gw_cbor_writer_text(w, "level");
+        if (rc == ESP_OK) rc = gw_cbor_writer_u64(w, (uint64_t)level);
+    }
+    CHECK_EQ(rc, ESP_OK);
+    b->items[b->count] = (gw_cbor_slice_t){w->buf, w->len};
+    b->count++;
+}
+
+static void run(batch_t *b)
+{
+    s_send_count = 0;
+    s_pipe_runs = 0;
+    CHECK_EQ(gw_action_exec_batch_cbor(b->items, b->count, b->results, &b->frames), ESP_OK);
+    CHECK(!s_pipe_open);
+    CHECK_EQ(s_pipe_runs, 1);
+    for (uint32_t i = 0; i < b->count; i++) {
+        gw_cbor_writer_free(&b->w[i]);
+    }
+}
+
+static size_t count_ok(const batch_t *b)
+{
+    size_t n = 0;
+    for (uint32_t i = 0; i < b->count; i++) {
+        n += b->results[i].rc == ESP_OK;
+    }
+    return n;
+}
+
+// ---- tests ----
+
+static void test_all_off_is_one_groupcast_and_four_unicasts(void)
+{
+    // "All lights off" from the UI: the group's 16 lights and 4 more, 20 entries.
+    static batch_t b;
+    memset(&b, 0, sizeof(b));
+    for (uint32_t dev = 0; dev < 20; dev++) {
+        add(&b, "onoff.off", dev, -1);
+    }
+    run(&b);
+    printf("20 onoff.off entries: %u Zigbee frames, one pipelined batch\n", (unsigned)b.frames);
+    CHECK_EQ(b.frames, 5);
+    CHECK_EQ(s_send_count, 5);
+    CHECK(s_sends[0].group && s_sends[0].group_id == GROUP_ID && s_sends[0].op == GW_ZIGBEE_ONOFF_CMD_OFF);
+    for (size_t i = 0; i < s_send_count; i++) {
+        CHECK(s_sends[i].pipelined);
+        if (i > 0) {
+            CHECK(!s_sends[i].group);
+            CHECK_EQ(dev_of(s_sends[i].uid), 15 + i);
+        }
+    }
+    CHECK_EQ(count_ok(&b), 20);
+}
+
+static void test_refused_groupcast_is_replayed_per_device(void)
+{
+    static batch_t b;
+    memset(&b, 0, sizeof(b));
+    for (uint32_t dev = 0; dev < GROUP_SIZE; dev++) {
+        add(&b, "onoff.on", dev, -1);
+    }
+    s_group_status = ESP_ERR_NOT_SUPPORTED;
+    run(&b);
+    s_group_status = ESP_OK;
+    CHECK_EQ(b.frames, 1 + GROUP_SIZE);
+    CHECK_EQ(s_send_count, 1 + GROUP_SIZE);
+    for (size_t i = 1; i < s_send_count; i++) {
+        CHECK(!s_sends[i].group && !s_sends[i].pipelined); // after the pipeline closed
+        CHECK_EQ(dev_of(s_sends[i].uid), i - 1);
+    }
+    CHECK_EQ(count_ok(&b), GROUP_SIZE);
+}
+
+static void test_results_map_back_to_entries(void)
+{
+    // A bad entry is reported and skipped; a far-side failure lands on its own entry.
+    static batch_t b;
+    memset(&b, 0, sizeof(b));
+    add(&b, "onoff.on", 20, -1);
+    add(&b, NULL, 21, -1);
+    add(&b, "onoff.on", 22, -1);
+    add(&b, "onoff.on", 23, -1);
+    s_fail_dev = 22;
+    run(&b);
+    s_fail_dev = -1;
+    CHECK_EQ(b.frames, 3);
+    CHECK_EQ(b.results[0].rc, ESP_OK);
+    CHECK(b.results[1].rc != ESP_OK && b.results[1].err[0] != '\0');
+    CHECK_EQ(b.results[2].rc, ESP_FAIL);
+    CHECK_EQ(b.results[3].rc, ESP_OK);
+}
+
+static void test_on_then_level_is_one_frame(void)
+{
+    static batch_t b;
+    memset(&b, 0, sizeof(b));
+    add(&b, "onoff.on", 30, -1);
+    add(&b, "level.move_to_level", 30, 128);
+    add(&b, "onoff.off", 31, -1);
+    add(&b, "onoff.off", 31, -1);
+    run(&b);
+    CHECK_EQ(b.frames, 2);
+    CHECK_EQ(s_send_count, 2);
+    CHECK_EQ(s_sends[0].op, 100 + 128);
+    CHECK(s_sends[0].with_onoff);
+    CHECK_EQ(s_sends[1].op, GW_ZIGBEE_ONOFF_CMD_OFF);
+    CHECK_EQ(count_ok(&b), 4);
+}
+
+int main(void)
+{
+    RUN_TEST(test_all_off_is_one_groupcast_and_four_unicasts);
+    RUN_TEST(test_refused_groupcast_is_replayed_per_device);
+    RUN_TEST(test_results_map_back_to_entries);
+    RUN_TEST(test_on_then_level_is_one_frame);
+    return HOST_TEST_RESULT();
+}
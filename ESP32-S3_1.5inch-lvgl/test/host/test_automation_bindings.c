@@ -0,0 +1,170 @@
+// test_automation_bindings.c - which switch rules may be offloaded to ZDO bindings
+#include <string.h>
+
+#include "gw_core/automation_compiled.h"
+#include "gw_core/cbor.h"
+#include "host_test.h"
+
+#define SWITCH "0x00124b0000000001"
+#define LAMP_A "0x00124b00000000a1"
+#define LAMP_B "0x00124b00000000b1"
+
+typedef struct {
+    const char *id;
+    const char *src_uid;
+    uint8_t src_ep;
+    const char *trigger_cmd;
+    const char *action_cmd;
+    const char *dst_uid[2]; // second may be NULL
+    uint32_t debounce_ms;
+} rule_t;
+
+static gw_auto_compiled_t s_set;
+
+static esp_err_t write_rule(gw_cbor_writer_t *w, const rule_t *r)
+{
+    const size_t n_dst = r->dst_uid[1] ? 2 : 1;
+    esp_err_t rc = gw_cbor_writer_map(w, r->debounce_ms ? 5 : 4);
+    if (rc == ESP_OK) rc = gw_cbor_writer_text(w, "id");
+    if (rc == ESP_OK) rc = gw_cbor_writer_text(w, r->id);
+    if (rc == ESP_OK) rc = gw_cbor_writer_text(w, "name");
+    if (rc == ESP_OK) rc = gw_cbor_writer_text(w, r->id);
+    if (rc == ESP_OK && r->debounce_ms) {
+        rc = gw_cbor_writer_text(w, "debounce_ms");
+        if (rc == ESP_OK) rc = gw_cbor_writer_u64(w, r->debounce_ms);
+    }
+    if (rc == ESP_OK) rc = gw_cbor_writer_text(w, "triggers");
+    if (rc == ESP_OK) rc = gw_cbor_writer_array(w, 1);
+    if (rc == ESP_OK) rc = gw_cbor_writer_map(w, 3);
+    if (rc == ESP_OK) rc = gw_cbor_writer_text(w, "type");
+    if (rc == ESP_OK) rc = gw_cbor_writer_text(w, "event");
+    if (rc == ESP_OK) rc = gw_cbor_writer_text(w, "event_type");
+    if (rc == ESP_OK) rc = gw_cbor_writer_text(w, "zigbee.command");
+    if (rc == ESP_OK) rc = gw_cbor_writer_text(w, "match");
+    if (rc == ESP_OK) rc = gw_cbor_writer_map(w, 3);
+    if (rc == ESP_OK) rc = gw_cbor_writer_text(w, "device_uid");
+    if (rc == ESP_OK) rc = gw_cbor_writer_text(w, r->src_uid);
+    if (rc == ESP_OK) rc = gw_cbor_writer_text(w, "payload.endpoint");
+    if (rc == ESP_OK) rc = gw_cbor_writer_u64(w, r->src_ep);
+    if (rc == ESP_OK) rc = gw_cbor_writer_text(w, "payload.cmd");
+    if (rc == ESP_OK) rc = gw_cbor_writer_text(w, r->trigger_cmd);
+    if (rc == ESP_OK) rc = gw_cbor_writer_text(w, "actions");
+    if (rc == ESP_OK) rc = gw_cbor_writer_array(w, n_dst);
+    for (size_t i = 0; rc == ESP_OK && i < n_dst; i++) {
+        rc = gw_cbor_writer_map(w, 4);
+        if (rc == ESP_OK) rc = gw_cbor_writer_text(w, "type");
+        if (rc == ESP_OK) rc = gw_cbor_writer_text(w, "zigbee");
+        if (rc == ESP_OK) rc = gw_cbor_writer_text(w, "cmd");
+        if (rc == ESP_OK) rc = gw_cbor_writer_text(w, r->action_cmd);
+        if (rc == ESP_OK) rc = gw_cbor_writer_text(w, "device_uid");
+        if (rc == ESP_OK) rc = gw_cbor_writer_text(w, r->dst_uid[i]);
+        if (rc == ESP_OK) rc = gw_cbor_writer_text(w, "endpoint");
+        if (rc == ESP_OK) rc = gw_cbor_writer_u64(w, 1);
+    }
+    return rc;
+}
+
+// Replace s_set with the compiled `rules`.
+static void load_rules(const rule_t *rules, size_t n)
+{
+    gw_auto_compiled_free(&s_set);
+    CHECK_EQ(gw_auto_compiled_merge(NULL, NULL, NULL, &s_set), ESP_OK);
+    for (size_t i = 0; i < n; i++) {
+        gw_cbor_writer_t w;
+        gw_cbor_writer_init(&w);
+        CHECK_EQ(write_rule(&w, &rules[i]), ESP_OK);
+        gw_auto_compiled_t one = {0};
+        gw_auto_compiled_t next = {0};
+        char err[64] = {0};
+        CHECK_EQ(gw_auto_compile_cbor(w.buf, w.len, &one, err, sizeof(err)), ESP_OK);
+        CHECK_EQ(gw_auto_compiled_merge(&s_set, &one, NULL, &next), ESP_OK);
+        gw_auto_compiled_free(&one);
+        gw_auto_compiled_free(&s_set);
+        s_set = next;
+        gw_cbor_writer_free(&w);
+    }
+}
+
+static size_t bindings_of(const char *id)
+{
+    gw_auto_binding_t out[4];
+    const int idx = gw_auto_compiled_find(&s_set, id);
+    CHECK(idx >= 0);
+    return idx < 0 ? 0 : gw_auto_compiled_bindings(&s_set, (uint32_t)idx, out, 4);
+}
+
+static void test_single_command_stays_on_gateway(void)
+{
+    // Binding on/off would also forward "off" and "toggle", which no rule asks for.
+    const rule_t rules[] = {
+        {"on", SWITCH, 1, "on", "onoff.on", {LAMP_A}},
+    };
+    load_rules(rules, 1);
+    CHECK_EQ(bindings_of("on"), 0);
+}
+
+static void test_full_mirror_is_offloaded(void)
+{
+    const rule_t rules[] = {
+        {"on", SWITCH, 1, "on", "onoff.on", {LAMP_A, LAMP_B}},
+        {"off", SWITCH, 1, "off", "onoff.off", {LAMP_A, LAMP_B}},
+        {"toggle", SWITCH, 1, "toggle", "onoff.toggle", {LAMP_A, LAMP_B}},
+        {"other_ep", SWITCH, 2, "on", "onoff.on", {LAMP_A}},
+    };
+    load_rules(rules, 4);
+    CHECK_EQ(bindings_of("on"), 2);
+    CHECK_EQ(bindings_of("off"), 2);
+    CHECK_EQ(bindings_of("toggle"), 2);
+    CHECK_EQ(bindings_of("other_ep"), 0); // endpoint 2 only maps "on"
+}
+
+static void test_different_targets_stay_on_gateway(void)
+{
+    const rule_t rules[] = {
+        {"on", SWITCH, 1, "on", "onoff.on", {LAMP_A, LAMP_B}},
+        {"off", SWITCH, 1, "off", "onoff.off", {LAMP_A}},
+        {"toggle", SWITCH, 1, "toggle", "onoff.toggle", {LAMP_A}},
+    };
+    load_rules(rules, 3);
+    CHECK_EQ(bindings_of("on"), 0);
+    CHECK_EQ(bindings_of("off"), 0);
+    CHECK_EQ(bindings_of("toggle"), 0);
+}
+
+static void test_crossed_commands_stay_on_gateway(void)
+{
+    // "off" turns the lamp on: a binding would forward it as off.
+    const rule_t rules[] = {
+        {"on", SWITCH, 1, "on", "onoff.on", {LAMP_A}},
+        {"off", SWITCH, 1, "off", "onoff.on", {LAMP_A}},
+        {"toggle", SWITCH, 1, "toggle", "onoff.toggle", {LAMP_A}},
+    };
+    load_rules(rules, 3);
+    CHECK_EQ(bindings_of("on"), 0);
+    CHECK_EQ(bindings_of("off"), 0);
+    CHECK_EQ(bindings_of("toggle"), 0);
+}
+
+static void test_gateway_policy_breaks_the_mirror(void)
+{
+    const rule_t rules[] = {
+        {"on", SWITCH, 1, "on", "onoff.on", {LAMP_A}},
+        {"off", SWITCH, 1, "off", "onoff.off", {LAMP_A}, 500},
+        {"toggle", SWITCH, 1, "toggle", "onoff.toggle", {LAMP_A}},
+    };
+    load_rules(rules, 3);
+    CHECK_EQ(bindings_of("on"), 0);
+    CHECK_EQ(bindings_of("off"), 0);
+    CHECK_EQ(bindings_of("toggle"), 0);
+}
+
+int main(void)
+{
+    RUN_TEST(test_single_command_stays_on_gateway);
+    RUN_TEST(test_full_mirror_is_offloaded);
+    RUN_TEST(test_different_targets_stay_on_gateway);
+    RUN_TEST(test_crossed_commands_stay_on_gateway);
+    RUN_TEST(test_gateway_policy_breaks_the_mirror);
+    gw_auto_compiled_free(&s_set);
+    return HOST_TEST_RESULT();
+}
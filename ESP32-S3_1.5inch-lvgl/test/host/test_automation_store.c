@@ -0,0 +1,226 @@
+// test_automation_store.c - dual-slot flash store: alternation, reboots and power loss
+#include "../../components/gw_core/src/automation_store.c"
+
+#include "gw_core/cbor.h"
+#include "host_stubs.h"
+#include "host_test.h"
+
+#define PART_SIZE  (64 * 1024)
+#define ERASE_SIZE 4096
+
+static const esp_partition_t *s_mock;
+
+// Forget everything held in RAM, as a reset would; flash contents stay.
+static void store_reboot(void)
+{
+    mock_partition_power_on();
+    s_initialized = false;
+    s_gen = NULL;
+    s_slot_users[0] = NULL;
+    s_slot_users[1] = NULL;
+    s_part = NULL;
+    s_slot_size = 0;
+    s_seq = 0;
+    s_version = 0;
+}
+
+static void store_fresh(void)
+{
+    store_reboot();
+    mock_partition_reset();
+    mock_nvs_reset();
+    s_mock = mock_partition_add(AUTOMATION_PARTITION_LABEL, PART_SIZE, ERASE_SIZE);
+}
+
+// {"id":id,"name":id,"triggers":[{"type":"event","event_type":"zigbee.command"}],
+//  "actions":[{"type":"delay","ms":ms}]}
+static esp_err_t put_automation(const char *id, uint32_t ms)
+{
+    gw_cbor_writer_t w;
+    gw_cbor_writer_init(&w);
+    esp_err_t rc = gw_cbor_writer_map(&w, 4);
+    if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, "id");
+    if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, id);
+    if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, "name");
+    if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, id);
+    if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, "triggers");
+    if (rc == ESP_OK) rc = gw_cbor_writer_array(&w, 1);
+    if (rc == ESP_OK) rc = gw_cbor_writer_map(&w, 2);
+    if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, "type");
+    if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, "event");
+    if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, "event_type");
+    if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, "zigbee.command");
+    if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, "actions");
+    if (rc == ESP_OK) rc = gw_cbor_writer_array(&w, 1);
+    if (rc == ESP_OK) rc = gw_cbor_writer_map(&w, 2);
+    if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, "type");
+    if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, "delay");
+    if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, "ms");
+    if (rc == ESP_OK) rc = gw_cbor_writer_u64(&w, ms);
+    if (rc == ESP_OK) rc = gw_automation_store_put_cbor(w.buf, w.len);
+    gw_cbor_writer_free(&w);
+    return rc;
+}
+
+// Delay of automation `id` in the current set, 0 when absent.
+static uint32_t current_delay(const char *id)
+{
+    const gw_auto_compiled_t *set = gw_automation_store_acquire();
+    uint32_t ms = 0;
+    int idx = set ? gw_auto_compiled_find(set, id) : -1;
+    if (idx >= 0) {
+        const gw_auto_bin_automation_v2_t *a = &set->autos[idx];
+        ms = set->actions[a->actions_index].arg0_u32;
+    }
+    gw_automation_store_release(set);
+    return ms;
+}
+
+static size_t current_count(void)
+{
+    const gw_auto_compiled_t *set = gw_automation_store_acquire();
+    size_t n = set ? set->hdr.automation_count : 0;
+    gw_automation_store_release(set);
+    return n;
+}
+
+static int current_slot(void)
+{
+    return s_gen ? s_gen->slot : -2;
+}
+
+static void test_slots_alternate(void)
+{
+    store_fresh();
+    CHECK_EQ(gw_automation_store_init(), ESP_OK);
+    CHECK_EQ(current_count(), 0);
+    CHECK_EQ(current_slot(), -1); // nothing on flash yet: empty heap set
+
+    for (uint32_t i = 1; i <= 200; i++) {
+        char id[16];
+        snprintf(id, sizeof(id), "a%u", (unsigned)(i % 7));
+        CHECK_EQ(put_automation(id, i), ESP_OK);
+        CHECK_EQ(current_slot(), (int)((i - 1) % 2));
+        CHECK_EQ(s_seq, i);
+        if (i % 3 == 0) {
+            CHECK_EQ(gw_automation_store_set_enabled(id, false), ESP_OK);
+            i++;
+            CHECK_EQ(current_slot(), (int)((i - 1) % 2));
+        }
+        if (i % 25 == 0) {
+            const int slot = current_slot();
+            const size_t count = current_count();
+            store_reboot();
+            CHECK_EQ(gw_automation_store_init(), ESP_OK);
+            CHECK_EQ(current_slot(), slot);
+            CHECK_EQ(current_count(), count);
+            CHECK_EQ(s_seq, i);
+        }
+    }
+    CHECK_EQ(current_count(), 7);
+
+    store_reboot();
+    CHECK_EQ(gw_automation_store_init(), ESP_OK);
+    CHECK_EQ(current_count(), 7);
+    CHECK(current_delay("a0") != 0);
+}
+
+// Power fails after `budget` bytes of the next save reach flash.
+static void save_with_power_cut(size_t budget, bool expect_new)
+{
+    store_fresh();
+    CHECK_EQ(gw_automation_store_init(), ESP_OK);
+    CHECK_EQ(put_automation("light", 100), ESP_OK); // slot 0, seq 1
+    CHECK_EQ(put_automation("light", 200), ESP_OK); // slot 1, seq 2
+    CHECK_EQ(current_slot(), 1);
+
+    const size_t before = mock_partition_bytes_written();
+    mock_partition_cut_power_after(budget);
+    esp_err_t rc = put_automation("light", 300); // slot 0, seq 3
+    CHECK_EQ(rc == ESP_OK, expect_new);
+    CHECK(mock_partition_bytes_written() - before <= budget);
+
+    store_reboot();
+    CHECK_EQ(gw_automation_store_init(), ESP_OK);
+    CHECK_EQ(current_delay("light"), expect_new ? 300 : 200);
+    CHECK_EQ(current_slot(), expect_new ? 0 : 1);
+    CHECK_EQ(s_seq, expect_new ? 3 : 2);
+
+    // The store keeps working after the interrupted save and writes the other slot next.
+    CHECK_EQ(put_automation("light", 400), ESP_OK);
+    CHECK_EQ(current_slot(), expect_new ? 1 : 0);
+    store_reboot();
+    CHECK_EQ(gw_automation_store_init(), ESP_OK);
+    CHECK_EQ(current_delay("light"), 400);
+}
+
+static void test_power_loss_during_erase(void)
+{
+    save_with_power_cut(0, false);
+}
+
+static void test_power_loss_mid_body(void)
+{
+    save_with_power_cut(40, false);
+}
+
+static void test_power_loss_between_body_and_header(void)
+{
+    // Measure the body of the save, then replay it with the power failing right after it.
+    store_fresh();
+    CHECK_EQ(gw_automation_store_init(), ESP_OK);
+    CHECK_EQ(put_automation("light", 100), ESP_OK);
+    CHECK_EQ(put_automation("light", 200), ESP_OK);
+    const size_t before = mock_partition_bytes_written();
+    CHECK_EQ(put_automation("light", 300), ESP_OK);
+    const size_t body = mock_partition_bytes_written() - before - sizeof(automation_slot_hdr_t);
+
+    save_with_power_cut(body, false);
+    save_with_power_cut(body + sizeof(automation_slot_hdr_t) - 1, false);
+    save_with_power_cut(body + sizeof(automation_slot_hdr_t), true);
+}
+
+static void test_corrupt_newest_slot_falls_back(void)
+{
+    store_fresh();
+    CHECK_EQ(gw_automation_store_init(), ESP_OK);
+    CHECK_EQ(put_automation("light", 100), ESP_OK); // slot 0
+    CHECK_EQ(put_automation("light", 200), ESP_OK); // slot 1
+    const size_t slot1_body = s_slot_size + AUTOMATION_SLOT_HDR_SIZE;
+
+    store_reboot();
+    mock_partition_data(s_mock)[slot1_body + 8] ^= 0x01; // bit rot inside the blob
+    CHECK_EQ(gw_automation_store_init(), ESP_OK);
+    CHECK_EQ(current_slot(), 0);
+    CHECK_EQ(current_delay("light"), 100);
+}
+
+static void test_reader_blocks_slot_reuse(void)
+{
+    store_fresh();
+    CHECK_EQ(gw_automation_store_init(), ESP_OK);
+    CHECK_EQ(put_automation("light", 100), ESP_OK); // slot 0
+    const gw_auto_compiled_t *held = gw_automation_store_acquire();
+    CHECK_EQ(put_automation("light", 200), ESP_OK); // slot 1
+
+    // Slot 0 is still mapped by `held`: the next save must not erase it under the reader.
+    CHECK_EQ(put_automation("light", 300), ESP_ERR_TIMEOUT);
+    CHECK_EQ(current_delay("light"), 200);
+    CHECK_EQ(held->actions[held->autos[0].actions_index].arg0_u32, 100);
+
+    gw_automation_store_release(held);
+    CHECK_EQ(put_automation("light", 300), ESP_OK);
+    CHECK_EQ(current_slot(), 0);
+    CHECK_EQ(current_delay("light"), 300);
+}
+
+int main(void)
+{
+    RUN_TEST(test_slots_alternate);
+    RUN_TEST(test_power_loss_during_erase);
+    RUN_TEST(test_power_loss_mid_body);
+    RUN_TEST(test_power_loss_between_body_and_header);
+    RUN_TEST(test_corrupt_newest_slot_falls_back);
+    RUN_TEST(test_reader_blocks_slot_reuse);
+    return HOST_TEST_RESULT();
+}
@@ -0,0 +1,383 @@
+// test_c6_zb_sched.c - the C6 command scheduler: priority order, in-flight limits,
+// per-destination FIFO with backoff, eviction, TSN/token completion, deadline reclaim
+//
+// Includes the C6 zb_sched.c directly. The Zigbee stack is reduced to the alarm the
+// scheduler arms: tests run the pump by hand, as the Zigbee task would, and move the
+// fake clock with host_ticks_advance().
+#include "../../../ESP32-C6_Zigbee_Gateway/components/gw_zigbee/src/zb_sched.c"
+
+#include <string.h>
+
+#include "host_stubs.h"
+#include "host_test.h"
+
+#define MAX_SENDS 128
+
+// ---- fakes for the Zigbee stack ----
+
+static uint32_t s_alarms;
+
+void esp_zb_scheduler_alarm(esp_zb_callback_t cb, uint8_t param, uint32_t time)
+{
+    s_alarms++;
+}
+
+bool esp_zb_lock_acquire(TickType_t block_ticks)
+{
+    return true;
+}
+
+void esp_zb_lock_release(void)
+{
+}
+
+// ---- requests: the context is an id, sends and completions are recorded ----
+
+static int s_ids[MAX_SENDS];
+static int s_sent[MAX_SENDS];
+static uint16_t s_sent_token[MAX_SENDS];
+static size_t s_sent_n;
+static uint8_t s_tsn;
+static int s_done_id;
+static uint16_t s_done_token;
+static esp_err_t s_done_status;
+static uint32_t s_done_n;
+
+static uint8_t fake_send(void *ctx, uint16_t token)
+{
+    if (s_sent_n < MAX_SENDS) {
+        s_sent_token[s_sent_n] = token;
+        s_sent[s_sent_n++] = *(int *)ctx;
+    }
+    return ++s_tsn;
+}
+
+static void fake_done(void *ctx, uint16_t token, esp_err_t status)
+{
+    s_done_id = *(int *)ctx;
+    s_done_token = token;
+    s_done_status = status;
+    s_done_n++;
+}
+
+static const zb_sched_ops_t s_zcl_ops = {"zcl", false, fake_send, fake_done};
+static const zb_sched_ops_t s_zdo_ops = {"zdo", true, fake_send, fake_done};
+
+static void *ctx_of(int id)
+{
+    s_ids[id] = id;
+    return &s_ids[id];
+}
+
+static esp_err_t submit(gw_zigbee_cmd_class_t cls, uint16_t dst, int id)
+{
+    return zb_sched_submit(cls, false, dst, 3, &s_zcl_ops, ctx_of(id), NULL);
+}
+
+static void pump(void)
+{
+    zb_sched_pump_cb(0);
+}
+
+// TSN the scheduler recorded for the n-th send.
+static uint8_t tsn_of_send(size_t n)
+{
+    return (uint8_t)(n + 1);
+}
+
+static void reset(void)
+{
+    memset(s_sched, 0, sizeof(s_sched));
+    memset(&s_sched_stats, 0, sizeof(s_sched_stats));
+    memset(s_sched_wait_sum_ms, 0, sizeof(s_sched_wait_sum_ms));
+    memset(s_sched_done_sum_ms, 0, sizeof(s_sched_done_sum_ms));
+    memset(s_sched_wait_n, 0, sizeof(s_sched_wait_n));
+    s_sched_seq = 0;
+    s_sched_kick_armed = false;
+    s_sched_tick_armed = false;
+    s_sched_log_ms = (uint64_t)(esp_timer_get_time() / 1000);
+    s_sched_log_sent = 0;
+    s_alarms = 0;
+    s_sent_n = 0;
+    s_tsn = 0;
+    s_done_id = -1;
+    s_done_token = 0;
+    s_done_status = ESP_OK;
+    s_done_n = 0;
+}
+
+static gw_zigbee_sched_stats_t stats(void)
+{
+    gw_zigbee_sched_stats_t st;
+    gw_zigbee_sched_get_stats(&st);
+    return st;
+}
+
+// ---- tests ----
+
+static void test_classes_go_out_in_priority_then_fifo_order(void)
+{
+    reset();
+    for (int i = 0; i < 4; i++) {
+        CHECK_EQ(submit(GW_ZIGBEE_CMD_CLASS_POLL, (uint16_t)(0x100 + i), 10 + i), ESP_OK);
+    }
+    CHECK_EQ(submit(GW_ZIGBEE_CMD_CLASS_DISCOVERY, 0x200, 20), ESP_OK);
+    for (int i = 0; i < 3; i++) {
+        CHECK_EQ(submit(GW_ZIGBEE_CMD_CLASS_USER, (uint16_t)(0x300 + i), 30 + i), ESP_OK);
+    }
+    CHECK(s_alarms >= 1);
+
+    // Users first, then discovery, then polls in submit order, up to 6 on air.
+    pump();
+    const int want[] = {30, 31, 32, 20, 10, 11};
+    CHECK_EQ(s_sent_n, ZB_SCHED_MAX_INFLIGHT);
+    for (size_t i = 0; i < ZB_SCHED_MAX_INFLIGHT; i++) {
+        CHECK_EQ(s_sent[i], want[i]);
+    }
+    gw_zigbee_sched_stats_t st = stats();
+    CHECK_EQ(st.cls[GW_ZIGBEE_CMD_CLASS_POLL].queued, 2);
+    CHECK_EQ(st.cls[GW_ZIGBEE_CMD_CLASS_POLL].inflight, 2);
+
+    // A completion frees one of the six: the next poll goes.
+    gw_zigbee_on_zcl_send_status(tsn_of_send(0), ESP_OK);
+    pump();
+    CHECK_EQ(s_sent_n, 7);
+    CHECK_EQ(s_sent[6], 12);
+}
+
+static void test_one_in_flight_per_destination(void)
+{
+    reset();
+    CHECK_EQ(submit(GW_ZIGBEE_CMD_CLASS_USER, 0x1234, 1), ESP_OK);
+    CHECK_EQ(submit(GW_ZIGBEE_CMD_CLASS_USER, 0x1234, 2), ESP_OK);
+    CHECK_EQ(submit(GW_ZIGBEE_CMD_CLASS_USER, 0x1234, 3), ESP_OK);
+    // Group 0x1234 is a different destination from device 0x1234.
+    CHECK_EQ(zb_sched_submit(GW_ZIGBEE_CMD_CLASS_USER, true, 0x1234, 1, &s_zcl_ops, ctx_of(4), NULL), ESP_OK);
+    pump();
+    CHECK_EQ(s_sent_n, 2);
+    CHECK_EQ(s_sent[0], 1);
+    CHECK_EQ(s_sent[1], 4);
+
+    pump();
+    CHECK_EQ(s_sent_n, 2);
+    gw_zigbee_on_zcl_send_status(tsn_of_send(0), ESP_OK);
+    CHECK_EQ(s_done_n, 1);
+    CHECK_EQ(s_done_id, 1);
+    CHECK_EQ(s_done_status, ESP_OK);
+    pump();
+    CHECK_EQ(s_sent_n, 3);
+    CHECK_EQ(s_sent[2], 2);
+    gw_zigbee_on_zcl_send_status(tsn_of_send(2), ESP_OK);
+    pump();
+    CHECK_EQ(s_sent_n, 4);
+    CHECK_EQ(s_sent[3], 3);
+}
+
+static void test_retry_backoff_holds_the_destination_in_order(void)
+{
+    reset();
+    CHECK_EQ(submit(GW_ZIGBEE_CMD_CLASS_USER, 0x10, 1), ESP_OK);
+    CHECK_EQ(submit(GW_ZIGBEE_CMD_CLASS_USER, 0x10, 2), ESP_OK);
+    CHECK_EQ(submit(GW_ZIGBEE_CMD_CLASS_USER, 0x20, 3), ESP_OK);
+    pump();
+    CHECK_EQ(s_sent_n, 2); // 1 and 3
+
+    // 1 fails: it waits out its backoff and 2 must not overtake it meanwhile.
+    gw_zigbee_on_zcl_send_status(tsn_of_send(0), ESP_FAIL);
+    CHECK_EQ(s_done_n, 0);
+    pump();
+    CHECK_EQ(s_sent_n, 2);
+    host_ticks_advance(ZB_SCHED_BACKOFF_MS - 1);
+    pump();
+    CHECK_EQ(s_sent_n, 2);
+    host_ticks_advance(1);
+    pump();
+    CHECK_EQ(s_sent_n, 3);
+    CHECK_EQ(s_sent[2], 1);
+
+    // Second failure: the backoff doubles.
+    gw_zigbee_on_zcl_send_status(tsn_of_send(2), ESP_FAIL);
+    host_ticks_advance(2 * ZB_SCHED_BACKOFF_MS - 1);
+    pump();
+    CHECK_EQ(s_sent_n, 3);
+    host_ticks_advance(1);
+    pump();
+    CHECK_EQ(s_sent_n, 4);
+    CHECK_EQ(s_sent[3], 1);
+
+    // Third failure is final (3 attempts): the owner hears about it, then 2 goes.
+    gw_zigbee_on_zcl_send_status(tsn_of_send(3), ESP_FAIL);
+    CHECK_EQ(s_done_n, 1);
+    CHECK_EQ(s_done_id, 1);
+    CHECK_EQ(s_done_status, ESP_FAIL);
+    pump();
+    CHECK_EQ(s_sent_n, 5);
+    CHECK_EQ(s_sent[4], 2);
+
+    gw_zigbee_sched_stats_t st = stats();
+    CHECK_EQ(st.cls[GW_ZIGBEE_CMD_CLASS_USER].sent, 5);
+    CHECK_EQ(st.cls[GW_ZIGBEE_CMD_CLASS_USER].retries, 2);
+    CHECK_EQ(st.cls[GW_ZIGBEE_CMD_CLASS_USER].failed, 1);
+}
+
+static void test_full_queue_evicts_the_newest_least_urgent_entry(void)
+{
+    reset();
+    // Polls may hold 16 slots; the 17th is refused while slots are still free.
+    for (int i = 0; i < ZB_SCHED_POLL_SLOTS; i++) {
+        CHECK_EQ(submit(GW_ZIGBEE_CMD_CLASS_POLL, (uint16_t)(0x100 + i), i), ESP_OK);
+    }
+    CHECK_EQ(submit(GW_ZIGBEE_CMD_CLASS_POLL, 0x1ff, 99), ESP_ERR_NO_MEM);
+    for (int i = 0; i < ZB_SCHED_SLOTS - ZB_SCHED_POLL_SLOTS; i++) {
+        CHECK_EQ(submit(GW_ZIGBEE_CMD_CLASS_DISCOVERY, (uint16_t)(0x200 + i), 20 + i), ESP_OK);
+    }
+    CHECK_EQ(s_done_n, 0);
+
+    // Full. A user command displaces the newest poll, which is told ESP_ERR_NO_MEM.
+    CHECK_EQ(submit(GW_ZIGBEE_CMD_CLASS_USER, 0x300, 60), ESP_OK);
+    CHECK_EQ(s_done_n, 1);
+    CHECK_EQ(s_done_id, ZB_SCHED_POLL_SLOTS - 1);
+    CHECK_EQ(s_done_status, ESP_ERR_NO_MEM);
+    CHECK_EQ(submit(GW_ZIGBEE_CMD_CLASS_AUTOMATION, 0x301, 61), ESP_OK);
+    CHECK_EQ(s_done_id, ZB_SCHED_POLL_SLOTS - 2);
+
+    // The newcomers go out first; the polls that were displaced never do.
+    pump();
+    CHECK_EQ(s_sent_n, ZB_SCHED_MAX_INFLIGHT);
+    CHECK_EQ(s_sent[0], 60);
+    CHECK_EQ(s_sent[1], 61);
+    gw_zigbee_sched_stats_t st = stats();
+    CHECK_EQ(st.cls[GW_ZIGBEE_CMD_CLASS_POLL].dropped, 3); // the refused 17th and two evictions
+    CHECK_EQ(st.cls[GW_ZIGBEE_CMD_CLASS_POLL].queued, ZB_SCHED_POLL_SLOTS - 2);
+
+    // Entries on air are never displaced: fill up again with everything already sent.
+    reset();
+    for (int i = 0; i < ZB_SCHED_MAX_INFLIGHT; i++) {
+        CHECK_EQ(submit(GW_ZIGBEE_CMD_CLASS_POLL, (uint16_t)(0x100 + i), i), ESP_OK);
+    }
+    pump();
+    for (int i = ZB_SCHED_MAX_INFLIGHT; i < ZB_SCHED_SLOTS; i++) {
+        CHECK_EQ(submit(GW_ZIGBEE_CMD_CLASS_DISCOVERY, (uint16_t)(0x200 + i), i), ESP_OK);
+    }
+    CHECK_EQ(submit(GW_ZIGBEE_CMD_CLASS_USER, 0x300, 60), ESP_OK);
+    CHECK_EQ(s_done_id, ZB_SCHED_SLOTS - 1); // newest discovery, not a poll on air
+    CHECK_EQ(stats().cls[GW_ZIGBEE_CMD_CLASS_POLL].inflight, ZB_SCHED_MAX_INFLIGHT);
+
+    // An equally urgent entry cannot displace anything.
+    reset();
+    for (int i = 0; i < ZB_SCHED_SLOTS; i++) {
+        CHECK_EQ(submit(GW_ZIGBEE_CMD_CLASS_USER, (uint16_t)(0x100 + i), i), ESP_OK);
+    }
+    CHECK_EQ(submit(GW_ZIGBEE_CMD_CLASS_USER, 0x200, 40), ESP_ERR_NO_MEM);
+    CHECK_EQ(submit(GW_ZIGBEE_CMD_CLASS_POLL, 0x201, 41), ESP_ERR_NO_MEM);
+    CHECK_EQ(s_done_n, 0);
+    st = stats();
+    CHECK_EQ(st.cls[GW_ZIGBEE_CMD_CLASS_USER].dropped, 1);
+    CHECK_EQ(st.cls[GW_ZIGBEE_CMD_CLASS_POLL].dropped, 1);
+}
+
+static void test_completion_matches_tsn_and_token(void)
+{
+    reset();
+    CHECK_EQ(submit(GW_ZIGBEE_CMD_CLASS_USER, 0x10, 1), ESP_OK);
+    uint16_t zdo_token = 0;
+    CHECK_EQ(zb_sched_submit(GW_ZIGBEE_CMD_CLASS_DISCOVERY, false, 0x20, 2, &s_zdo_ops, ctx_of(2), &zdo_token),
+             ESP_OK);
+    pump();
+    CHECK_EQ(s_sent_n, 2);
+    CHECK_EQ(s_sent_token[1], zdo_token);
+
+    // A send status for a TSN nobody holds, or for the ZDO request's TSN, is stale.
+    gw_zigbee_on_zcl_send_status(0x77, ESP_OK);
+    gw_zigbee_on_zcl_send_status(tsn_of_send(1), ESP_OK);
+    gw_zigbee_sched_stats_t st = stats();
+    CHECK_EQ(st.stale, 2);
+    CHECK_EQ(st.cls[GW_ZIGBEE_CMD_CLASS_DISCOVERY].inflight, 1);
+
+    gw_zigbee_on_zcl_send_status(tsn_of_send(0), ESP_OK);
+    CHECK_EQ(s_done_n, 1);
+    CHECK_EQ(s_done_id, 1);
+    st = stats();
+    CHECK_EQ(st.cls[GW_ZIGBEE_CMD_CLASS_USER].ok, 1);
+    CHECK_EQ(st.cls[GW_ZIGBEE_CMD_CLASS_USER].inflight, 0);
+
+    // A ZDO timeout is retried under the same token; the caller drops that response.
+    void *ctx = NULL;
+    CHECK(!zb_sched_zdo_done(zdo_token, ESP_ZB_ZDP_STATUS_TIMEOUT, &ctx));
+    host_ticks_advance(ZB_SCHED_BACKOFF_MS);
+    pump();
+    CHECK_EQ(s_sent_n, 3);
+    CHECK_EQ(s_sent_token[2], zdo_token);
+
+    // Any other status is final and hands the context back instead of calling done().
+    CHECK(zb_sched_zdo_done(zdo_token, ESP_ZB_ZDP_STATUS_SUCCESS, &ctx));
+    CHECK(ctx == &s_ids[2]);
+    CHECK_EQ(s_done_n, 1);
+
+    // Slots 0 and 1 are free again. Whoever gets the ZDO request's slot gets a new
+    // token; the old one is stale from now on.
+    uint16_t next_token = 0;
+    CHECK_EQ(submit(GW_ZIGBEE_CMD_CLASS_USER, 0x30, 4), ESP_OK);
+    CHECK_EQ(zb_sched_submit(GW_ZIGBEE_CMD_CLASS_DISCOVERY, false, 0x20, 1, &s_zdo_ops, ctx_of(3), &next_token),
+             ESP_OK);
+    CHECK(next_token != zdo_token);
+    CHECK_EQ(next_token & (ZB_SCHED_SLOTS - 1), zdo_token & (ZB_SCHED_SLOTS - 1));
+    pump();
+    ctx = &s_ids[0];
+    CHECK(zb_sched_zdo_done(zdo_token, ESP_ZB_ZDP_STATUS_SUCCESS, &ctx));
+    CHECK(ctx == NULL);
+    CHECK_EQ(stats().stale, 3);
+    CHECK(zb_sched_zdo_done(next_token, ESP_ZB_ZDP_STATUS_DEVICE_NOT_FOUND, &ctx));
+    CHECK(ctx == &s_ids[3]);
+    CHECK_EQ(stats().cls[GW_ZIGBEE_CMD_CLASS_DISCOVERY].failed, 1);
+}
+
+static void test_leaked_entry_is_reclaimed_at_the_deadline(void)
+{
+    reset();
+    CHECK_EQ(submit(GW_ZIGBEE_CMD_CLASS_USER, 0x10, 1), ESP_OK);
+    CHECK_EQ(submit(GW_ZIGBEE_CMD_CLASS_USER, 0x10, 2), ESP_OK);
+    pump();
+    CHECK_EQ(s_sent_n, 1);
+    const uint16_t token = s_sent_token[0];
+
+    // No send status ever arrives: the pump's tick gives up on it at the deadline.
+    host_ticks_advance(ZB_SCHED_DEADLINE_MS - 1);
+    zb_sched_pump_cb(1);
+    CHECK_EQ(s_done_n, 0);
+    CHECK_EQ(s_sent_n, 1);
+    host_ticks_advance(1);
+    zb_sched_pump_cb(1);
+    CHECK_EQ(s_done_n, 1);
+    CHECK_EQ(s_done_id, 1);
+    CHECK_EQ(s_done_token, token);
+    CHECK_EQ(s_done_status, ESP_ERR_TIMEOUT);
+
+    // The destination is free again, and not retried: a leak is final.
+    CHECK_EQ(s_sent_n, 2);
+    CHECK_EQ(s_sent[1], 2);
+    gw_zigbee_sched_stats_t st = stats();
+    CHECK_EQ(st.cls[GW_ZIGBEE_CMD_CLASS_USER].leaked, 1);
+    CHECK_EQ(st.cls[GW_ZIGBEE_CMD_CLASS_USER].failed, 1);
+    CHECK_EQ(st.cls[GW_ZIGBEE_CMD_CLASS_USER].retries, 0);
+    CHECK_EQ(st.cls[GW_ZIGBEE_CMD_CLASS_USER].inflight, 1);
+
+    // The late status finds nothing; 2 still completes by its own TSN.
+    gw_zigbee_on_zcl_send_status(tsn_of_send(0), ESP_OK);
+    CHECK_EQ(stats().stale, 1);
+    gw_zigbee_on_zcl_send_status(tsn_of_send(1), ESP_OK);
+    st = stats();
+    CHECK_EQ(st.cls[GW_ZIGBEE_CMD_CLASS_USER].ok, 1);
+    CHECK_EQ(st.cls[GW_ZIGBEE_CMD_CLASS_USER].inflight + st.cls[GW_ZIGBEE_CMD_CLASS_USER].queued, 0);
+}
+
+int main(void)
+{
+    RUN_TEST(test_classes_go_out_in_priority_then_fifo_order);
+    RUN_TEST(test_one_in_flight_per_destination);
+    RUN_TEST(test_retry_backoff_holds_the_destination_in_order);
+    RUN_TEST(test_full_queue_evicts_the_newest_least_urgent_entry);
+    RUN_TEST(test_completion_matches_tsn_and_token);
+    RUN_TEST(test_leaked_entry_is_reclaimed_at_the_deadline);
+    return HOST_TEST_RESULT();
+}
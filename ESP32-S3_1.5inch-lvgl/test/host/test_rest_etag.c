@@ -0,0 +1,424 @@
+// test_rest_etag.c - conditional GETs: ETag per store content version, 304 on a match
+//
+// The handlers run as registered, over the real group, settings and device flatbuffer
+// stores (NVS in RAM); the automation store is faked down to its version. The last
+// test reports, per endpoint, the body bytes and handler time of a 200 and a 304.
+#include "../../components/gw_http/src/gw_rest.c"
+
+#include "gw_core/cbor.h"
+#include "gw_core/storage.h"
+#include "host_bench.h"
+#include "host_stubs.h"
+#include "host_test.h"
+
+// ---- fakes for what the conditional GETs never reach ----
+
+static gw_auto_compiled_t s_autos;
+static uint32_t s_autos_version = 1;
+
+const gw_auto_compiled_t *gw_automation_store_acquire(void)
+{
+    return &s_autos;
+}
+
+void gw_automation_store_release(const gw_auto_compiled_t *set)
+{
+}
+
+uint32_t gw_automation_store_version(const gw_auto_compiled_t *set)
+{
+    return s_autos_version;
+}
+
+esp_err_t gw_automation_store_put_cbor(const uint8_t *buf, size_t len)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t gw_automation_store_remove(const char *id)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t gw_automation_store_set_enabled(const char *id, bool enabled)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t gw_action_exec_cbor(const uint8_t *buf, size_t len, char *err, size_t err_size)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t gw_action_exec_batch_cbor(const gw_cbor_slice_t *items, uint32_t count, gw_action_result_t *results,
+                                    uint32_t *frames)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+size_t gw_device_registry_list(gw_device_t *out_devices, size_t max_devices)
+{
+    return 0;
+}
+
+void gw_event_bus_publish(const char *type, const char *source, const char *device_uid, uint16_t short_addr,
+                          const char *msg)
+{
+}
+
+size_t gw_rules_stats_snapshot(gw_rules_stats_t *out, size_t max_out)
+{
+    return 0;
+}
+
+void gw_rules_stats_reset(void)
+{
+}
+
+size_t gw_state_store_list_page(size_t *cursor, gw_state_item_t *out, size_t max_out)
+{
+    return 0;
+}
+
+uint32_t gw_state_store_version(void)
+{
+    return 0;
+}
+
+esp_err_t gw_state_store_changes_page(uint32_t *cursor, gw_state_item_t *out, size_t max_out, size_t *out_count)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t gw_zigbee_sync_device_fb(void)
+{
+    return ESP_OK;
+}
+
+esp_err_t gw_zigbee_set_device_name(const gw_device_uid_t *uid, const char *name)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t gw_zigbee_remove_device(const gw_device_uid_t *uid)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t gw_zigbee_permit_join(uint8_t seconds)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+// ---- helpers ----
+
+typedef struct {
+    const char *status; // "200 OK" unless the handler set one
+    char etag[GW_HTTP_ETAG_MAX];
+    bool no_cache;
+    size_t body_len;
+} reply_t;
+
+static int s_server; // any non-NULL handle
+
+static void boot(uint32_t salt)
+{
+    host_random_set(salt);
+    CHECK_EQ(gw_http_register_rest_endpoints(&s_server), ESP_OK);
+}
+
+// GET `uri`, sending If-None-Match when `inm` is not NULL.
+static reply_t get(const char *uri, const char *inm)
+{
+    reply_t out = {0};
+    const httpd_uri_t *h = mock_httpd_find(uri, HTTP_GET);
+    CHECK(h != NULL);
+    if (!h) {
+        return out;
+    }
+    httpd_req_t req;
+    mock_httpd_req_init(&req, uri, HTTP_GET);
+    if (inm) {
+        mock_httpd_req_add_hdr(&req, "If-None-Match", inm);
+    }
+    CHECK_EQ(h->handler(&req), ESP_OK);
+    CHECK(req.sent);
+    out.status = req.status ? req.status : "200 OK";
+    const char *etag = mock_httpd_resp_hdr(&req, "ETag");
+    snprintf(out.etag, sizeof(out.etag), "%s", etag ? etag : "");
+    const char *cc = mock_httpd_resp_hdr(&req, "Cache-Control");
+    out.no_cache = cc && strcmp(cc, "no-cache") == 0;
+    out.body_len = req.body_len;
+    return out;
+}
+
+static bool is_304(const reply_t *r)
+{
+    return strcmp(r->status, "304 Not Modified") == 0 && r->body_len == 0;
+}
+
+static bool is_full(const reply_t *r)
+{
+    return strcmp(r->status, "200 OK") == 0 && r->body_len > 0;
+}
+
+// The full response carries an ETag that a revalidation then matches.
+static void check_revalidates(const char *uri, reply_t *full)
+{
+    *full = get(uri, NULL);
+    CHECK(is_full(full));
+    CHECK(full->etag[0] == '"');
+    CHECK(full->no_cache);
+
+    reply_t again = get(uri, full->etag);
+    CHECK(is_304(&again));
+    CHECK_EQ(strcmp(again.etag, full->etag), 0);
+}
+
+// ---- tests ----
+
+static void test_storage_save_bumps_version(void)
+{
+    static const gw_storage_desc_t desc = {
+        .namespace = "t_ver", .key = "items", .item_size = 4, .max_items = 4, .magic = 0x54455354, .version = 1,
+    };
+    gw_storage_t st;
+    CHECK_EQ(gw_storage_init(&st, &desc, GW_STORAGE_NVS), ESP_OK);
+    CHECK_EQ(st.content_version, 0);
+    for (uint32_t i = 1; i <= 3; i++) {
+        st.count = i;
+        CHECK_EQ(gw_storage_save(&st), ESP_OK);
+        CHECK_EQ(st.content_version, i);
+    }
+    free(st.data);
+}
+
+static void test_settings(void)
+{
+    reply_t full;
+    check_revalidates("/api/settings", &full);
+
+    gw_project_settings_t cfg;
+    CHECK_EQ(gw_project_settings_get(&cfg), ESP_OK);
+    cfg.screensaver_timeout_ms += 1000;
+    CHECK_EQ(gw_project_settings_set(&cfg), ESP_OK);
+
+    reply_t changed = get("/api/settings", full.etag);
+    CHECK(is_full(&changed));
+    CHECK(strcmp(changed.etag, full.etag) != 0);
+    reply_t again = get("/api/settings", changed.etag);
+    CHECK(is_304(&again));
+}
+
+static void test_groups_and_items(void)
+{
+    reply_t groups;
+    reply_t items;
+    check_revalidates("/api/groups", &groups);
+    check_revalidates("/api/groups/items", &items);
+    CHECK(strcmp(groups.etag, items.etag) != 0); // same version, different endpoint
+
+    gw_group_entry_t created = {0};
+    CHECK_EQ(gw_group_store_create(NULL, "Kitchen", &created), ESP_OK);
+    reply_t r = get("/api/groups", groups.etag);
+    CHECK(is_full(&r));
+    check_revalidates("/api/groups", &groups);
+
+    // An endpoint change saves only the items storage; both endpoints still move on.
+    gw_device_uid_t uid = {0};
+    strlcpy(uid.uid, "0x00124b00000000a1", sizeof(uid.uid));
+    CHECK_EQ(gw_group_store_set_endpoint(created.id, &uid, 1), ESP_OK);
+    r = get("/api/groups/items", items.etag);
+    CHECK(is_full(&r));
+    r = get("/api/groups", groups.etag);
+    CHECK(is_full(&r));
+}
+
+static void test_device_flatbuffer(void)
+{
+    // Nothing synced yet: no version, no ETag, a 202 to retry.
+    reply_t r = get("/api/devices/flatbuffer", NULL);
+    CHECK_EQ(strcmp(r.status, "202 Accepted"), 0);
+    CHECK_EQ(r.etag[0], '\0');
+
+    static const uint8_t fb1[] = {1, 2, 3, 4};
+    static const uint8_t fb2[] = {5, 6, 7, 8, 9};
+    CHECK_EQ(gw_device_fb_store_set(fb1, sizeof(fb1)), ESP_OK);
+    reply_t full;
+    check_revalidates("/api/devices/flatbuffer", &full);
+    CHECK_EQ(full.body_len, sizeof(fb1));
+
+    CHECK_EQ(gw_device_fb_store_set(fb2, sizeof(fb2)), ESP_OK);
+    r = get("/api/devices/flatbuffer", full.etag);
+    CHECK(is_full(&r));
+    CHECK_EQ(r.body_len, sizeof(fb2));
+}
+
+static void test_automations(void)
+{
+    reply_t full;
+    check_revalidates("/api/automations", &full);
+    s_autos_version++;
+    reply_t r = get("/api/automations", full.etag);
+    CHECK(is_full(&r));
+}
+
+static void test_if_none_match_forms(void)
+{
+    reply_t full = get("/api/settings", NULL);
+    char list[96];
+    snprintf(list, sizeof(list), "\"stale\", %s", full.etag);
+
+    reply_t r = get("/api/settings", "*");
+    CHECK(is_304(&r));
+    r = get("/api/settings", list);
+    CHECK(is_304(&r));
+    r = get("/api/settings", "\"stale\"");
+    CHECK(is_full(&r));
+    r = get("/api/settings", "");
+    CHECK(is_full(&r));
+}
+
+static void test_boot_salt(void)
+{
+    // Versions restart at boot: the same number must not match an ETag from before.
+    reply_t before = get("/api/settings", NULL);
+    boot(0x2222);
+    reply_t after = get("/api/settings", before.etag);
+    CHECK(is_full(&after));
+    CHECK(strcmp(after.etag, before.etag) != 0);
+    reply_t again = get("/api/settings", after.etag);
+    CHECK(is_304(&again));
+}
+
+// {"id":"a<n>","name":"a<n>","triggers":[{"type":"event","event_type":"zigbee.command"}],
+//  "actions":[{"type":"zigbee","cmd":"onoff.toggle","device_uid":...,"endpoint":1}]}
+static void add_automation(uint32_t n)
+{
+    char id[16];
+    char uid[24];
+    snprintf(id, sizeof(id), "a%u", (unsigned)n);
+    snprintf(uid, sizeof(uid), "0x00124b00%08x", (unsigned)n);
+
+    gw_cbor_writer_t w;
+    gw_cbor_writer_init(&w);
+    esp_err_t rc = gw_cbor_writer_map(&w, 4);
+    if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, "id");
+    if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, id);
+    if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, "name");
+    if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, id);
+    if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, "triggers");
+    if (rc == ESP_OK) rc = gw_cbor_writer_array(&w, 1);
+    if (rc == ESP_OK) rc = gw_cbor_writer_map(&w, 2);
+    if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, "type");
+    if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, "event");
+    if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, "event_type");
+    if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, "zigbee.command");
+    if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, "actions");
+    if (rc == ESP_OK) rc = gw_cbor_writer_array(&w, 1);
+    if (rc == ESP_OK) rc = gw_cbor_writer_map(&w, 4);
+    if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, "type");
+    if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, "zigbee");
+    if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, "cmd");
+    if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, "onoff.toggle");
+    if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, "device_uid");
+    if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, uid);
+    if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, "endpoint");
+    if (rc == ESP_OK) rc = gw_cbor_writer_u64(&w, 1);
+    CHECK_EQ(rc, ESP_OK);
+
+    gw_auto_compiled_t one = {0};
+    gw_auto_compiled_t next = {0};
+    char err[64] = {0};
+    CHECK_EQ(gw_auto_compile_cbor(w.buf, w.len, &one, err, sizeof(err)), ESP_OK);
+    CHECK_EQ(gw_auto_compiled_merge(&s_autos, &one, NULL, &next), ESP_OK);
+    gw_auto_compiled_free(&one);
+    gw_auto_compiled_free(&s_autos);
+    gw_cbor_writer_free(&w);
+    s_autos = next;
+    s_autos_version++;
+}
+
+// Mean handler time of `iters` GETs of `uri` with If-None-Match `inm`, in ns.
+static uint64_t handler_ns(const char *uri, const char *inm, uint32_t iters)
+{
+    const httpd_uri_t *h = mock_httpd_find(uri, HTTP_GET);
+    uint64_t total = 0;
+    for (uint32_t i = 0; i < iters; i++) {
+        httpd_req_t req;
+        mock_httpd_req_init(&req, uri, HTTP_GET);
+        if (inm) {
+            mock_httpd_req_add_hdr(&req, "If-None-Match", inm);
+        }
+        const uint64_t t0 = host_bench_now_ns();
+        h->handler(&req);
+        total += host_bench_now_ns() - t0;
+    }
+    return total / iters;
+}
+
+static void test_report_bytes_and_handler_time(void)
+{
+    // Something worth not resending: 16 automations, 8 groups of 4 endpoints, and the
+    // flatbuffer a 64-device network produces (about 120 bytes a device).
+    for (uint32_t n = 0; n < 16; n++) {
+        add_automation(n);
+    }
+    for (uint32_t g = 0; g < 8; g++) {
+        char id[16];
+        char name[16];
+        snprintf(id, sizeof(id), "room_%u", (unsigned)g);
+        snprintf(name, sizeof(name), "Room %u", (unsigned)g);
+        gw_group_entry_t created = {0};
+        CHECK_EQ(gw_group_store_create(id, name, &created), ESP_OK);
+        for (uint32_t k = 0; k < 4; k++) {
+            gw_device_uid_t uid = {0};
+            snprintf(uid.uid, sizeof(uid.uid), "0x00124b00%08x", (unsigned)(g * 4 + k));
+            CHECK_EQ(gw_group_store_set_endpoint(created.id, &uid, 1), ESP_OK);
+        }
+    }
+    static uint8_t fb[64 * 120];
+    for (size_t i = 0; i < sizeof(fb); i++) {
+        fb[i] = (uint8_t)(i * 31u);
+    }
+    CHECK_EQ(gw_device_fb_store_set(fb, sizeof(fb)), ESP_OK);
+
+    static const char *const k_uris[] = {
+        "/api/devices/flatbuffer", "/api/automations", "/api/groups", "/api/groups/items", "/api/settings",
+    };
+    const uint32_t iters = 200;
+    printf("  %-24s %9s %9s %12s %12s\n", "endpoint", "200 body", "304 body", "200 handler", "304 handler");
+    for (size_t i = 0; i < sizeof(k_uris) / sizeof(k_uris[0]); i++) {
+        const reply_t full = get(k_uris[i], NULL);
+        const reply_t cached = get(k_uris[i], full.etag);
+        CHECK(is_full(&full));
+        CHECK(is_304(&cached));
+        const uint64_t full_ns = handler_ns(k_uris[i], NULL, iters);
+        const uint64_t cached_ns = handler_ns(k_uris[i], full.etag, iters);
+        printf("  %-24s %7zu B %7zu B %9.1f us %9.1f us\n", k_uris[i], full.body_len, cached.body_len,
+               full_ns / 1000.0, cached_ns / 1000.0);
+    }
+    CHECK_EQ(get("/api/devices/flatbuffer", NULL).body_len, sizeof(fb));
+}
+
+int main(void)
+{
+    mock_nvs_reset();
+    mock_httpd_reset();
+    CHECK_EQ(gw_project_settings_init(), ESP_OK);
+    CHECK_EQ(gw_group_store_init(), ESP_OK);
+    CHECK_EQ(gw_device_fb_store_init(), ESP_OK);
+    CHECK_EQ(gw_auto_compiled_merge(NULL, NULL, NULL, &s_autos), ESP_OK);
+    boot(0x1111);
+
+    RUN_TEST(test_storage_save_bumps_version);
+    RUN_TEST(test_settings);
+    RUN_TEST(test_groups_and_items);
+    RUN_TEST(test_device_flatbuffer);
+    RUN_TEST(test_automations);
+    RUN_TEST(test_if_none_match_forms);
+    RUN_TEST(test_boot_salt);
+    RUN_TEST(test_report_bytes_and_handler_time);
+    gw_auto_compiled_free(&s_autos);
+    return HOST_TEST_RESULT();
+}
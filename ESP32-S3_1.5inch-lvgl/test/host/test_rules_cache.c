@@ -0,0 +1,476 @@
+// test_rules_cache.c - rule edits applied as cache deltas while another thread matches events
+//
+// The test thread plays the rules task and feeds saves, removes and toggles through
+// handle_automation_change(); a reader thread keeps calling process_event(), holds
+// cache versions across edits and reads the stats as GET /api/rules/stats does. Built with AddressSanitizer: a version freed while a
+// reader still holds it, or never freed at all, fails the run.
+#include "../../components/gw_core/src/rules_engine.c"
+
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "gw_core/cbor.h"
+#include "host_stubs.h"
+#include "host_test.h"
+
+#define RULES   48 // ids in play; the rules task pre-sizes its run table for them
+#define DEVICES 16
+#define EDITS   3000
+
+// ---- fake store: refcounted generations, like automation_store.c ----
+
+typedef struct {
+    gw_auto_compiled_t set; // first: the acquired pointer is the generation
+    uint32_t version;
+    int refs; // s_store_lock; the store owns one while current
+} store_gen_t;
+
+static pthread_mutex_t s_store_lock = PTHREAD_MUTEX_INITIALIZER;
+static store_gen_t *s_gen;
+static size_t s_gens_made;
+static size_t s_gens_freed;
+
+const gw_auto_compiled_t *gw_automation_store_acquire(void)
+{
+    pthread_mutex_lock(&s_store_lock);
+    store_gen_t *g = s_gen;
+    g->refs++;
+    pthread_mutex_unlock(&s_store_lock);
+    return &g->set;
+}
+
+void gw_automation_store_release(const gw_auto_compiled_t *set)
+{
+    if (!set) {
+        return;
+    }
+    store_gen_t *g = (store_gen_t *)set;
+    pthread_mutex_lock(&s_store_lock);
+    const bool last = --g->refs == 0;
+    if (last) {
+        s_gens_freed++;
+    }
+    pthread_mutex_unlock(&s_store_lock);
+    if (last) {
+        gw_auto_compiled_free(&g->set);
+        free(g);
+    }
+}
+
+uint32_t gw_automation_store_version(const gw_auto_compiled_t *set)
+{
+    return ((const store_gen_t *)set)->version;
+}
+
+// Make `next` the current generation; the old one lives on while acquired.
+static void store_publish(const gw_auto_compiled_t *next)
+{
+    store_gen_t *g = calloc(1, sizeof(*g));
+    CHECK(g != NULL);
+    g->set = *next;
+    g->refs = 1;
+    pthread_mutex_lock(&s_store_lock);
+    store_gen_t *old = s_gen;
+    g->version = old ? old->version + 1u : 1u;
+    s_gen = g;
+    s_gens_made++;
+    pthread_mutex_unlock(&s_store_lock);
+    if (old) {
+        gw_automation_store_release(&old->set);
+    }
+}
+
+// ---- fakes for the engine's other collaborators ----
+
+static atomic_uint s_fired;
+static atomic_uint s_executed;
+
+esp_err_t gw_timers_arm(gw_timer_t *t, uint32_t delay_ms, gw_timer_cb_t cb, void *arg)
+{
+    return ESP_OK;
+}
+
+void gw_timers_cancel(gw_timer_t *t)
+{
+}
+
+bool gw_net_time_is_synced(void)
+{
+    return false;
+}
+
+uint64_t gw_net_time_now_ms(void)
+{
+    return 0;
+}
+
+void gw_event_bus_publish(const char *type, const char *source, const char *device_uid, uint16_t short_addr,
+                          const char *msg)
+{
+    if (strcmp(type, "rules.fired") == 0) {
+        atomic_fetch_add(&s_fired, 1);
+    }
+}
+
+esp_err_t gw_event_bus_add_listener(gw_event_bus_listener_t cb, void *user_ctx)
+{
+    return ESP_OK;
+}
+
+void gw_action_plan_step(const gw_auto_compiled_t *compiled, const gw_auto_bin_action_v2_t *actions, uint32_t count,
+                         uint32_t pos, gw_action_step_t *out)
+{
+    memset(out, 0, sizeof(*out));
+    out->kind = GW_ACTION_STEP_SINGLE;
+    out->count = 1;
+    out->lead = pos;
+}
+
+esp_err_t gw_action_exec_step(const gw_auto_compiled_t *compiled, const gw_auto_bin_action_v2_t *actions,
+                              const gw_action_step_t *step, uint32_t *frames_saved, char *err, size_t err_size)
+{
+    atomic_fetch_add(&s_executed, 1);
+    return ESP_OK;
+}
+
+esp_err_t gw_state_store_get_any(const gw_device_uid_t *uid, const char *key, gw_state_item_t *out)
+{
+    return ESP_ERR_NOT_FOUND;
+}
+
+esp_err_t gw_auto_bindings_init(void)
+{
+    return ESP_OK;
+}
+
+bool gw_auto_bindings_sync(const gw_auto_compiled_t *set)
+{
+    return true;
+}
+
+bool gw_auto_bindings_offloaded(const char *automation_id)
+{
+    return false;
+}
+
+bool gw_auto_placement_sync(const gw_auto_compiled_t *set)
+{
+    return true;
+}
+
+bool gw_auto_placement_on_c6(const char *automation_id)
+{
+    return false;
+}
+
+// ---- helpers ----
+
+static void device_uid(uint32_t dev, char *out, size_t len)
+{
+    snprintf(out, len, "0x00124b00%08x", (unsigned)dev);
+}
+
+// {"id":"r<n>","name":"r<n>","triggers":[{"type":"event","event_type":"zigbee.command",
+//  "match":{"device_uid":...,"payload.endpoint":ep,"payload.cmd":"on"}}],
+//  "actions":[{"type":"zigbee","cmd":"onoff.on","device_uid":...,"endpoint":1}]}
+static void compile_rule(uint32_t n, uint32_t dev, uint32_t ep, gw_auto_compiled_t *out)
+{
+    char id[16];
+    char src[24];
+    char dst[24];
+    snprintf(id, sizeof(id), "r%u", (unsigned)n);
+    device_uid(dev, src, sizeof(src));
+    device_uid(1000 + n, dst, sizeof(dst));
+
+    gw_cbor_writer_t w;
+    gw_cbor_writer_init(&w);
+    esp_err_t rc = gw_cbor_writer_map(&w, 4);
+    if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, "id");
+    if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, id);
+    if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, "name");
+    if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, id);
+    if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, "triggers");
+    if (rc == ESP_OK) rc = gw_cbor_writer_array(&w, 1);
+    if (rc == ESP_OK) rc = gw_cbor_writer_map(&w, 3);
+    if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, "type");
+    if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, "event");
+    if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, "event_type");
+    if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, "zigbee.command");
+    if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, "match");
+    if (rc == ESP_OK) rc = gw_cbor_writer_map(&w, 3);
+    if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, "device_uid");
+    if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, src);
+    if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, "payload.endpoint");
+    if (rc == ESP_OK) rc = gw_cbor_writer_u64(&w, ep);
+    if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, "payload.cmd");
+    if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, "on");
+    if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, "actions");
+    if (rc == ESP_OK) rc = gw_cbor_writer_array(&w, 1);
+    if (rc == ESP_OK) rc = gw_cbor_writer_map(&w, 4);
+    if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, "type");
+    if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, "zigbee");
+    if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, "cmd");
+    if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, "onoff.on");
+    if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, "device_uid");
+    if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, dst);
+    if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, "endpoint");
+    if (rc == ESP_OK) rc = gw_cbor_writer_u64(&w, 1);
+    CHECK_EQ(rc, ESP_OK);
+
+    char err[64] = {0};
+    CHECK_EQ(gw_auto_compile_cbor(w.buf, w.len, out, err, sizeof(err)), ESP_OK);
+    gw_cbor_writer_free(&w);
+}
+
+static void make_event(uint32_t dev, uint32_t ep, gw_event_t *e)
+{
+    memset(e, 0, sizeof(*e));
+    strlcpy(e->type, "zigbee.command", sizeof(e->type));
+    strlcpy(e->source, "zigbee", sizeof(e->source));
+    device_uid(dev, e->device_uid, sizeof(e->device_uid));
+    e->payload_flags = GW_EVENT_PAYLOAD_HAS_ENDPOINT | GW_EVENT_PAYLOAD_HAS_CMD | GW_EVENT_PAYLOAD_HAS_CLUSTER;
+    e->payload_endpoint = (uint8_t)ep;
+    e->payload_cluster = 0x0006;
+    strlcpy(e->payload_cmd, "on", sizeof(e->payload_cmd));
+}
+
+// The change event the store publishes, handled as rules_task() does.
+static void change(const char *type, const char *id)
+{
+    gw_event_t e = {0};
+    strlcpy(e.type, type, sizeof(e.type));
+    strlcpy(e.source, "automation", sizeof(e.source));
+    if (strcmp(type, "automation_removed") == 0) {
+        strlcpy(e.msg, id, sizeof(e.msg));
+    } else {
+        snprintf(e.msg, sizeof(e.msg), "id=%s", id);
+    }
+    handle_automation_change(&e);
+}
+
+static void save_rule(uint32_t n, uint32_t dev, uint32_t ep)
+{
+    gw_auto_compiled_t one = {0};
+    gw_auto_compiled_t next = {0};
+    compile_rule(n, dev, ep, &one);
+    const gw_auto_compiled_t *cur = gw_automation_store_acquire();
+    CHECK_EQ(gw_auto_compiled_merge(cur, &one, NULL, &next), ESP_OK);
+    gw_automation_store_release(cur);
+    gw_auto_compiled_free(&one);
+    store_publish(&next);
+    char id[16];
+    snprintf(id, sizeof(id), "r%u", (unsigned)n);
+    change("automation_saved", id);
+}
+
+// False when `n` is not in the set.
+static bool remove_rule(uint32_t n)
+{
+    char id[16];
+    snprintf(id, sizeof(id), "r%u", (unsigned)n);
+    const gw_auto_compiled_t *cur = gw_automation_store_acquire();
+    gw_auto_compiled_t next = {0};
+    const bool present = gw_auto_compiled_find(cur, id) >= 0;
+    if (present) {
+        CHECK_EQ(gw_auto_compiled_merge(cur, NULL, id, &next), ESP_OK);
+    }
+    gw_automation_store_release(cur);
+    if (present) {
+        store_publish(&next);
+        change("automation_removed", id);
+    }
+    return present;
+}
+
+// Same as gw_automation_store_set_enabled(): a packed copy with one flag flipped.
+static bool toggle_rule(uint32_t n)
+{
+    char id[16];
+    snprintf(id, sizeof(id), "r%u", (unsigned)n);
+    const gw_auto_compiled_t *cur = gw_automation_store_acquire();
+    gw_auto_compiled_t next = {0};
+    const int idx = gw_auto_compiled_find(cur, id);
+    if (idx >= 0) {
+        CHECK_EQ(gw_auto_compiled_merge(cur, NULL, NULL, &next), ESP_OK);
+        next.autos[idx].enabled ^= 1u;
+    }
+    gw_automation_store_release(cur);
+    if (idx >= 0) {
+        store_publish(&next);
+        change("automation_enabled", id);
+    }
+    return idx >= 0;
+}
+
+static uint32_t s_lcg = 12345;
+
+static uint32_t rnd(uint32_t n)
+{
+    s_lcg = s_lcg * 1103515245u + 12345u;
+    return (s_lcg >> 16) % n;
+}
+
+// Automation indices the index of `cache` offers for `e`, as a bitmap.
+static void candidates_of(rules_cache_t *cache, const gw_event_t *e, uint64_t *out)
+{
+    gw_rules_event_view_t pv;
+    gw_rules_event_view(e, &pv);
+    *out = 0;
+    if (!gw_rules_index_candidates(&cache->ix, e, &pv, gw_rules_evt_type(e))) {
+        return;
+    }
+    for (uint32_t slot = 0; slot < cache->ix.slot_cap; slot++) {
+        if (cache->ix.candidates[slot / 32u] & (1u << (slot % 32u))) {
+            const uint32_t idx = cache->ix.slot_auto[slot];
+            CHECK(idx < cache->set->hdr.automation_count);
+            *out |= 1ull << (idx < 64 ? idx : 63);
+        }
+    }
+}
+
+// ---- reader thread ----
+
+static atomic_bool s_stop;
+static atomic_uint s_events;
+static atomic_uint s_stale_reads; // events matched against a version that was already replaced
+
+static void *reader_main(void *arg)
+{
+    (void)arg;
+    uint32_t n = 0;
+    while (!atomic_load(&s_stop)) {
+        // Hold one version across a few events, as a slow reader would.
+        rules_cache_t *held = rules_cache_get();
+        for (int i = 0; i < 8; i++, n++) {
+            gw_event_t e;
+            make_event(n % DEVICES, 1 + (n / DEVICES) % 4, &e);
+            process_event(&e);
+            atomic_fetch_add(&s_events, 1);
+        }
+        if (held) {
+            CHECK_EQ(held->set_version, gw_automation_store_version(held->set));
+            portENTER_CRITICAL(&s_cache_lock);
+            const bool replaced = held != s_cache;
+            portEXIT_CRITICAL(&s_cache_lock);
+            if (replaced) {
+                atomic_fetch_add(&s_stale_reads, 1);
+            }
+            for (uint32_t i = 0; i < held->set->hdr.automation_count; i++) {
+                CHECK(gw_auto_compiled_find(held->set, strtab_at(held, held->set->autos[i].id_off)) == (int)i);
+            }
+        }
+        rules_cache_put(held);
+
+        // The REST side reads the stats meanwhile.
+        gw_rules_stats_t stats[RULES];
+        const size_t total = gw_rules_stats_snapshot(stats, RULES);
+        CHECK(total <= RULES);
+        for (size_t i = 0; i < total; i++) {
+            CHECK(stats[i].id[0] == 'r');
+        }
+    }
+    return NULL;
+}
+
+// ---- tests ----
+
+static void test_edits_while_matching(void)
+{
+    // Run records are created by the reader and dropped by the rules task; sizing the
+    // table up front keeps it from growing while both use it, as it never does on the
+    // device, where both are the rules task.
+    char id[16];
+    for (uint32_t n = 0; n < RULES; n++) {
+        snprintf(id, sizeof(id), "r%u", (unsigned)n);
+        CHECK(rule_run_get(id) != NULL);
+    }
+
+    pthread_t reader;
+    CHECK_EQ(pthread_create(&reader, NULL, reader_main, NULL), 0);
+
+    size_t saves = 0, removes = 0, toggles = 0;
+    for (uint32_t i = 0; i < EDITS; i++) {
+        const uint32_t n = rnd(RULES);
+        const uint32_t op = rnd(10);
+        if (op < 5) {
+            save_rule(n, rnd(DEVICES), 1 + rnd(4));
+            saves++;
+        } else if (op < 8) {
+            removes += remove_rule(n);
+        } else {
+            toggles += toggle_rule(n);
+        }
+        // Let the reader see some versions before the next edit replaces them.
+        if ((i & 15) == 0) {
+            sched_yield();
+        }
+    }
+
+    atomic_store(&s_stop, true);
+    CHECK_EQ(pthread_join(reader, NULL), 0);
+    printf("  %zu saves, %zu removes, %zu toggles; %u events matched (%u on a replaced version), %u runs\n",
+           saves, removes, toggles, atomic_load(&s_events), atomic_load(&s_stale_reads), atomic_load(&s_fired));
+    CHECK(removes > 0 && toggles > 0);
+    CHECK(atomic_load(&s_events) > 0);
+    CHECK(atomic_load(&s_fired) > 0);
+
+    // Every replaced version was reclaimed: only the current generation is still alive,
+    // held by the store and by the published cache.
+    CHECK_EQ(s_gens_made - s_gens_freed, 1);
+    CHECK_EQ(s_gen->refs, 2);
+    CHECK_EQ(s_cache->refs, 1);
+    CHECK(s_cache->set == &s_gen->set);
+    CHECK_EQ(s_cache->set_version, s_gen->version);
+
+    // The index built by deltas offers the same automations as a full rebuild. Keys
+    // whose rules went away stay in the delta index until a rebuild, within the density bound.
+    rules_cache_t *rebuilt = rules_cache_build(gw_automation_store_acquire());
+    CHECK(rebuilt != NULL);
+    CHECK(s_cache->ix.index_used >= rebuilt->ix.index_used);
+    CHECK(s_cache->ix.index_used * 2u <= s_cache->ix.index_cap);
+    for (uint32_t dev = 0; dev < DEVICES; dev++) {
+        for (uint32_t ep = 1; ep <= 4; ep++) {
+            gw_event_t e;
+            make_event(dev, ep, &e);
+            uint64_t delta = 0, full = 0;
+            candidates_of(s_cache, &e, &delta);
+            candidates_of(rebuilt, &e, &full);
+            CHECK_EQ(delta, full);
+        }
+    }
+    size_t live = 0;
+    for (uint32_t slot = 0; slot < s_cache->ix.slot_cap; slot++) {
+        live += s_cache->ix.slot_auto[slot] != GW_RULE_NO_AUTO;
+    }
+    CHECK_EQ(live, s_gen->set.hdr.automation_count);
+    rules_cache_put(rebuilt);
+    CHECK_EQ(s_gens_made - s_gens_freed, 1);
+
+    gw_rules_stats_t stats[RULES];
+    uint32_t fires = 0;
+    CHECK_EQ(gw_rules_stats_snapshot(stats, RULES), s_runs_count);
+    for (size_t i = 0; i < s_runs_count; i++) {
+        CHECK(strcmp(stats[i].id, s_runs[i].id) == 0);
+        fires += stats[i].counters.fires;
+    }
+    CHECK(fires > 0 && fires <= atomic_load(&s_fired));
+}
+
+int main(void)
+{
+    gw_auto_compiled_t empty = {0};
+    CHECK_EQ(gw_auto_compiled_merge(NULL, NULL, NULL, &empty), ESP_OK);
+    store_publish(&empty);
+    CHECK_EQ(gw_rules_init(), ESP_OK);
+    for (uint32_t n = 0; n < RULES / 2; n++) {
+        save_rule(n, n % DEVICES, 1 + n % 4);
+    }
+
+    RUN_TEST(test_edits_while_matching);
+
+    // Leave nothing for LeakSanitizer but what the engine and the store still publish.
+    rules_cache_publish(NULL);
+    gw_automation_store_release(&s_gen->set);
+    CHECK_EQ(s_gens_made, s_gens_freed);
+    return HOST_TEST_RESULT();
+}
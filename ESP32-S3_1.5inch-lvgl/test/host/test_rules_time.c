@@ -0,0 +1,258 @@
+// test_rules_time.c - wall-clock triggers through the rules engine and a real timer wheel
+//
+// The engine cuts waits longer than GW_RULES_TIME_MAX_WAIT_MS into pieces; every
+// occurrence must still run exactly once, on its minute.
+#include "../../components/gw_core/src/rules_engine.c"
+
+#include "gw_core/cbor.h"
+#include "host_stubs.h"
+#include "host_test.h"
+
+#define MONDAY_0000 1767571200ull // 2026-01-05 00:00:00 UTC
+#define HOUR_S      3600ull
+#define DAY_S       (24ull * HOUR_S)
+#define MAX_FIRES   16
+
+// ---- fakes for the engine's collaborators ----
+
+static gw_auto_compiled_t s_set;
+static gw_timer_wheel_t s_wheel;
+static uint64_t s_wall_ms;
+static uint64_t s_fired_at[MAX_FIRES]; // wall seconds of each rules.fired
+static size_t s_fired;
+
+static uint64_t mono_ms(void)
+{
+    return (uint64_t)(esp_timer_get_time() / 1000);
+}
+
+esp_err_t gw_timers_arm(gw_timer_t *t, uint32_t delay_ms, gw_timer_cb_t cb, void *arg)
+{
+    gw_timer_wheel_arm(&s_wheel, t, mono_ms(), delay_ms, cb, arg);
+    return ESP_OK;
+}
+
+void gw_timers_cancel(gw_timer_t *t)
+{
+    gw_timer_wheel_cancel(&s_wheel, t);
+}
+
+bool gw_net_time_is_synced(void)
+{
+    return true;
+}
+
+uint64_t gw_net_time_now_ms(void)
+{
+    return s_wall_ms;
+}
+
+const gw_auto_compiled_t *gw_automation_store_acquire(void)
+{
+    return &s_set;
+}
+
+void gw_automation_store_release(const gw_auto_compiled_t *set)
+{
+    (void)set;
+}
+
+uint32_t gw_automation_store_version(const gw_auto_compiled_t *set)
+{
+    (void)set;
+    return 1;
+}
+
+void gw_event_bus_publish(const char *type, const char *source, const char *device_uid, uint16_t short_addr,
+                          const char *msg)
+{
+    if (strcmp(type, "rules.fired") == 0 && s_fired < MAX_FIRES) {
+        s_fired_at[s_fired++] = s_wall_ms / 1000u;
+    }
+}
+
+esp_err_t gw_event_bus_add_listener(gw_event_bus_listener_t cb, void *user_ctx)
+{
+    return ESP_OK;
+}
+
+void gw_action_plan_step(const gw_auto_compiled_t *compiled, const gw_auto_bin_action_v2_t *actions, uint32_t count,
+                         uint32_t pos, gw_action_step_t *out)
+{
+    memset(out, 0, sizeof(*out));
+    out->kind = GW_ACTION_STEP_SINGLE;
+    out->count = 1;
+    out->lead = pos;
+}
+
+esp_err_t gw_action_exec_step(const gw_auto_compiled_t *compiled, const gw_auto_bin_action_v2_t *actions,
+                              const gw_action_step_t *step, uint32_t *frames_saved, char *err, size_t err_size)
+{
+    return ESP_OK;
+}
+
+esp_err_t gw_state_store_get_any(const gw_device_uid_t *uid, const char *key, gw_state_item_t *out)
+{
+    return ESP_ERR_NOT_FOUND;
+}
+
+esp_err_t gw_auto_bindings_init(void)
+{
+    return ESP_OK;
+}
+
+bool gw_auto_bindings_sync(const gw_auto_compiled_t *set)
+{
+    return true;
+}
+
+bool gw_auto_bindings_offloaded(const char *automation_id)
+{
+    return false;
+}
+
+bool gw_auto_placement_sync(const gw_auto_compiled_t *set)
+{
+    return true;
+}
+
+bool gw_auto_placement_on_c6(const char *automation_id)
+{
+    return false;
+}
+
+// ---- helpers ----
+
+// {"id":"t","name":"t","triggers":[{"type":"time","at":at[,"days":[day]]}],
+//  "actions":[{"type":"zigbee","cmd":"onoff.on","device_uid":...,"endpoint":1}]}
+static void load_time_rule(const char *at, int day)
+{
+    gw_cbor_writer_t w;
+    gw_cbor_writer_init(&w);
+    esp_err_t rc = gw_cbor_writer_map(&w, 4);
+    if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, "id");
+    if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, "t");
+    if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, "name");
+    if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, "t");
+    if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, "triggers");
+    if (rc == ESP_OK) rc = gw_cbor_writer_array(&w, 1);
+    if (rc == ESP_OK) rc = gw_cbor_writer_map(&w, day >= 0 ? 3 : 2);
+    if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, "type");
+    if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, "time");
+    if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, "at");
+    if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, at);
+    if (rc == ESP_OK && day >= 0) {
+        rc = gw_cbor_writer_text(&w, "days");
+        if (rc == ESP_OK) rc = gw_cbor_writer_array(&w, 1);
+        if (rc == ESP_OK) rc = gw_cbor_writer_u64(&w, (uint64_t)day);
+    }
+    if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, "actions");
+    if (rc == ESP_OK) rc = gw_cbor_writer_array(&w, 1);
+    if (rc == ESP_OK) rc = gw_cbor_writer_map(&w, 4);
+    if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, "type");
+    if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, "zigbee");
+    if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, "cmd");
+    if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, "onoff.on");
+    if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, "device_uid");
+    if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, "0x00124b00000000a1");
+    if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, "endpoint");
+    if (rc == ESP_OK) rc = gw_cbor_writer_u64(&w, 1);
+    CHECK_EQ(rc, ESP_OK);
+
+    gw_auto_compiled_t one = {0};
+    gw_auto_compiled_t next = {0};
+    char err[64] = {0};
+    CHECK_EQ(gw_auto_compile_cbor(w.buf, w.len, &one, err, sizeof(err)), ESP_OK);
+    CHECK_EQ(gw_auto_compiled_merge(NULL, &one, NULL, &next), ESP_OK);
+    gw_auto_compiled_free(&one);
+    gw_cbor_writer_free(&w);
+
+    // The published cache still points at the old set until the reload swaps it out.
+    gw_auto_compiled_t old = s_set;
+    s_set = next;
+    reload_automation_cache();
+    gw_auto_compiled_free(&old);
+    s_fired = 0;
+}
+
+// One pass of rules_task() with the queue drained.
+static void rules_step(void)
+{
+    gw_event_t e;
+    while (xQueueReceive(s_q, &e, 0) == pdTRUE) {
+    }
+    waits_run_fired();
+    bindings_sync_due();
+    time_triggers_sync();
+}
+
+// Let `seconds` pass on both clocks, waking the engine whenever the wheel has work.
+static void run_for(uint64_t seconds)
+{
+    const uint64_t end = mono_ms() + seconds * 1000u;
+    rules_step();
+    while (mono_ms() < end) {
+        uint64_t next = gw_timer_wheel_next_due_ms(&s_wheel);
+        if (next > end) {
+            next = end;
+        }
+        const uint64_t step = next - mono_ms();
+        host_ticks_advance((uint32_t)step);
+        s_wall_ms += step;
+        gw_timer_wheel_advance(&s_wheel, mono_ms());
+        rules_step();
+    }
+}
+
+static void set_wall(uint64_t wall_s)
+{
+    s_wall_ms = wall_s * 1000u;
+}
+
+// ---- tests ----
+
+static void test_daily_trigger_more_than_six_hours_away(void)
+{
+    set_wall(MONDAY_0000 + 8 * HOUR_S);
+    load_time_rule("20:00", -1); // 12 h away: two pieces before the first run
+    run_for(3 * DAY_S);
+    CHECK_EQ(s_fired, 3);
+    for (size_t i = 0; i < s_fired; i++) {
+        CHECK_EQ(s_fired_at[i], MONDAY_0000 + i * DAY_S + 20 * HOUR_S);
+    }
+}
+
+static void test_daily_trigger_within_six_hours(void)
+{
+    set_wall(MONDAY_0000 + 19 * HOUR_S + 59 * 60 + 30);
+    load_time_rule("20:00", -1);
+    run_for(2 * DAY_S);
+    CHECK_EQ(s_fired, 2);
+    CHECK_EQ(s_fired_at[0], MONDAY_0000 + 20 * HOUR_S);
+    CHECK_EQ(s_fired_at[1], MONDAY_0000 + DAY_S + 20 * HOUR_S);
+}
+
+static void test_weekly_trigger_days_away(void)
+{
+    // Monday 07:15 only, armed on a Tuesday: six days of pieces, then one run.
+    set_wall(MONDAY_0000 + DAY_S + 9 * HOUR_S);
+    load_time_rule("07:15", 1);
+    run_for(13 * DAY_S);
+    CHECK_EQ(s_fired, 2);
+    CHECK_EQ(s_fired_at[0], MONDAY_0000 + 7 * DAY_S + 7 * HOUR_S + 15 * 60);
+    CHECK_EQ(s_fired_at[1], MONDAY_0000 + 14 * DAY_S + 7 * HOUR_S + 15 * 60);
+}
+
+int main(void)
+{
+    setenv("TZ", "UTC0", 1);
+    tzset();
+    gw_timer_wheel_init(&s_wheel, GW_TIMERS_TICK_MS, mono_ms());
+    CHECK_EQ(gw_auto_compiled_merge(NULL, NULL, NULL, &s_set), ESP_OK);
+    CHECK_EQ(gw_rules_init(), ESP_OK);
+
+    RUN_TEST(test_daily_trigger_more_than_six_hours_away);
+    RUN_TEST(test_daily_trigger_within_six_hours);
+    RUN_TEST(test_weekly_trigger_days_away);
+    return HOST_TEST_RESULT();
+}
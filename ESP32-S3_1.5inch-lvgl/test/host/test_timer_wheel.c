@@ -0,0 +1,182 @@
+// test_timer_wheel.c - 10k timers across every wheel level: none early, late, lost or doubled
+#include <stdlib.h>
+#include <string.h>
+
+#include "gw_core/timer_wheel.h"
+#include "host_test.h"
+
+#define TICK_MS   10
+#define N_TIMERS  10000
+#define MAX_DELAY (46u * 3600u * 1000u) // just inside the ~46.6 h range, so nothing is clamped
+#define MAX_SLEEP (3600u * 1000u)       // timers.c wakes at least hourly
+
+typedef struct {
+    gw_timer_t t;
+    uint64_t due_ms; // tick the expected firing falls on, 0 while not armed
+    uint32_t arms;
+    uint32_t fires;
+    uint32_t cancels; // moved or cancelled while armed
+    uint32_t rearms;  // left to do from the callback
+} tracked_t;
+
+static gw_timer_wheel_t s_wheel;
+static tracked_t s_timers[N_TIMERS];
+static uint64_t s_now;
+static uint32_t s_errors;
+static uint64_t s_seed = 0x9e3779b97f4a7c15ull;
+
+static uint32_t rnd(void)
+{
+    s_seed ^= s_seed << 13;
+    s_seed ^= s_seed >> 7;
+    s_seed ^= s_seed << 17;
+    return (uint32_t)s_seed;
+}
+
+// Short, hours and day-long delays in equal parts: every level sees traffic.
+static uint32_t rnd_delay(void)
+{
+    switch (rnd() % 3) {
+    case 0: return rnd() % 2000;
+    case 1: return rnd() % (8u * 3600u * 1000u);
+    default: return rnd() % MAX_DELAY;
+    }
+}
+
+static void arm(tracked_t *tr, uint32_t delay_ms);
+
+static void cancel(tracked_t *tr)
+{
+    gw_timer_wheel_cancel(&s_wheel, &tr->t);
+    tr->cancels += tr->due_ms != 0;
+    tr->due_ms = 0;
+    tr->rearms = 0;
+}
+
+static void on_fire(gw_timer_t *t, void *arg)
+{
+    tracked_t *tr = arg;
+    if (&tr->t != t || tr->due_ms == 0 || s_now != tr->due_ms) {
+        if (s_errors++ < 5) {
+            printf("timer %d fired at %llu, due %llu\n", (int)(tr - s_timers), (unsigned long long)s_now,
+                   (unsigned long long)tr->due_ms);
+        }
+    }
+    tr->due_ms = 0;
+    tr->fires++;
+    if (tr->rearms) {
+        tr->rearms--;
+        arm(tr, rnd_delay());
+    }
+    // Cancel someone else now and then, including timers due in this very tick.
+    if (rnd() % 8 == 0) {
+        tracked_t *victim = &s_timers[rnd() % N_TIMERS];
+        if (victim != tr) {
+            cancel(victim);
+        }
+    }
+}
+
+static void arm(tracked_t *tr, uint32_t delay_ms)
+{
+    gw_timer_wheel_arm(&s_wheel, &tr->t, s_now, delay_ms, on_fire, tr);
+    tr->cancels += tr->due_ms != 0;
+    tr->arms++;
+    uint64_t due = (s_now + delay_ms + TICK_MS - 1) / TICK_MS;
+    if (due <= s_now / TICK_MS) {
+        due = s_now / TICK_MS + 1;
+    }
+    tr->due_ms = due * TICK_MS;
+}
+
+static size_t pending(void)
+{
+    size_t n = 0;
+    for (size_t i = 0; i < N_TIMERS; i++) {
+        n += s_timers[i].due_ms != 0;
+    }
+    return n;
+}
+
+// Sleep to the wheel's next due time (capped like the timer task) and advance.
+static size_t run_until(uint64_t end_ms)
+{
+    size_t fired = 0;
+    while (s_now < end_ms) {
+        uint64_t next = gw_timer_wheel_next_due_ms(&s_wheel);
+        if (next > s_now + MAX_SLEEP) {
+            next = s_now + MAX_SLEEP;
+        }
+        s_now = next < end_ms ? next : end_ms;
+        fired += gw_timer_wheel_advance(&s_wheel, s_now);
+        CHECK_EQ(s_wheel.armed, pending());
+    }
+    return fired;
+}
+
+static void test_ten_thousand_timers(void)
+{
+    s_now = 123457; // not tick aligned
+    gw_timer_wheel_init(&s_wheel, TICK_MS, s_now);
+    for (size_t i = 0; i < N_TIMERS; i++) {
+        s_timers[i].rearms = i % 4 == 0 ? 2 : 0;
+        arm(&s_timers[i], rnd_delay());
+    }
+    CHECK_EQ(s_wheel.armed, N_TIMERS);
+
+    // Move and cancel some timers from outside a callback too.
+    for (size_t i = 0; i < N_TIMERS; i += 7) {
+        if (i % 2) {
+            arm(&s_timers[i], rnd_delay());
+        } else {
+            cancel(&s_timers[i]);
+        }
+    }
+
+    // Partway in, arm more from "outside" at an odd time, then run everything out.
+    run_until(s_now + 5u * 3600u * 1000u + 3);
+    for (size_t i = 0; i < N_TIMERS; i += 13) {
+        if (!gw_timer_armed(&s_timers[i].t)) {
+            arm(&s_timers[i], rnd_delay());
+        }
+    }
+    run_until(s_now + 3u * MAX_DELAY);
+
+    CHECK_EQ(s_errors, 0);
+    CHECK_EQ(s_wheel.armed, 0);
+    CHECK_EQ(pending(), 0);
+    CHECK_EQ(gw_timer_wheel_next_due_ms(&s_wheel), UINT64_MAX);
+    // Every arm ended in exactly one firing or cancellation.
+    uint32_t fires = 0;
+    for (size_t i = 0; i < N_TIMERS; i++) {
+        CHECK_EQ(s_timers[i].fires + s_timers[i].cancels, s_timers[i].arms);
+        fires += s_timers[i].fires;
+    }
+    CHECK(fires > N_TIMERS);
+}
+
+static void test_long_delay_fires_on_its_tick(void)
+{
+    // A single timer more than 6 h out must not wait for a later cascade.
+    static const uint32_t k_delays[] = {
+        6u * 3600u * 1000u + 10, 7u * 3600u * 1000u + 1234, 23u * 3600u * 1000u + 59999, MAX_DELAY,
+    };
+    for (size_t i = 0; i < sizeof(k_delays) / sizeof(k_delays[0]); i++) {
+        s_now = 1000u * 3600u * 1000u + i * 7;
+        gw_timer_wheel_init(&s_wheel, TICK_MS, s_now);
+        memset(&s_timers[0], 0, sizeof(s_timers[0]));
+        arm(&s_timers[0], k_delays[i]);
+        const uint64_t due = s_timers[0].due_ms;
+        CHECK_EQ(run_until(due - 1), 0);
+        CHECK_EQ(run_until(due), 1);
+        CHECK_EQ(s_timers[0].fires, 1);
+    }
+    CHECK_EQ(s_errors, 0);
+}
+
+int main(void)
+{
+    RUN_TEST(test_ten_thousand_timers);
+    RUN_TEST(test_long_delay_fires_on_its_tick);
+    return HOST_TEST_RESULT();
+}
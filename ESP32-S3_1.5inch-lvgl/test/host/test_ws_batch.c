@@ -0,0 +1,332 @@
+// test_ws_batch.c - WebSocket batching: CBOR array framing, the byte cap split, frame counts
+//
+// Events go through ws_dispatch_event() and ws_flush_due_batches() as the event task
+// runs them; frames are captured at httpd_ws_send_data_async() in mock_httpd.c.
+#include "../../components/gw_http/src/gw_ws.c"
+
+#include "host_stubs.h"
+#include "host_test.h"
+
+#define FD_PLAIN   11 // single frames
+#define FD_BATCHED 12 // {"batch": true}
+#define MAX_FRAMES 512
+#define MAX_ITEMS  512
+#define WS_HDR_SHORT 2 // server frames are unmasked: 2 bytes up to 125, then 4 up to 64 KiB
+
+// ---- fakes for what the event path reaches outside gw_http ----
+
+void gw_event_bus_record_event(const gw_event_t *e)
+{
+}
+
+void gw_event_bus_set_out_queue(QueueHandle_t q)
+{
+}
+
+size_t gw_group_store_list_items(gw_group_item_t *out, size_t max_out)
+{
+    return 0;
+}
+
+uint32_t gw_group_store_version(void)
+{
+    return 0;
+}
+
+// ---- captured frames ----
+
+typedef struct {
+    int fd;
+    size_t len;
+    uint8_t *data;
+} frame_t;
+
+typedef struct {
+    size_t frames;
+    size_t wire_bytes; // payload plus WebSocket header
+} traffic_t;
+
+static frame_t s_frames[MAX_FRAMES];
+static size_t s_frame_count;
+static int s_server_handle;
+
+static void sink(int fd, const uint8_t *data, size_t len)
+{
+    CHECK(s_frame_count < MAX_FRAMES);
+    if (s_frame_count == MAX_FRAMES) {
+        return;
+    }
+    frame_t *f = &s_frames[s_frame_count++];
+    f->fd = fd;
+    f->len = len;
+    f->data = malloc(len);
+    memcpy(f->data, data, len);
+}
+
+static void frames_clear(void)
+{
+    for (size_t i = 0; i < s_frame_count; i++) {
+        free(s_frames[i].data);
+    }
+    s_frame_count = 0;
+}
+
+static size_t frames_for(int fd)
+{
+    size_t n = 0;
+    for (size_t i = 0; i < s_frame_count; i++) {
+        n += s_frames[i].fd == fd;
+    }
+    return n;
+}
+
+static traffic_t traffic_for(int fd)
+{
+    traffic_t t = {0};
+    for (size_t i = 0; i < s_frame_count; i++) {
+        if (s_frames[i].fd == fd) {
+            t.frames++;
+            t.wire_bytes += s_frames[i].len + (s_frames[i].len <= 125 ? WS_HDR_SHORT : WS_HDR_SHORT + 2);
+        }
+    }
+    return t;
+}
+
+// Every event in the frames sent to `fd`, in order: the items of a batch, or the
+// frame itself when it is a single event (a CBOR map).
+static size_t items_for(int fd, gw_cbor_slice_t *out, size_t max_out)
+{
+    size_t n = 0;
+    for (size_t i = 0; i < s_frame_count; i++) {
+        const frame_t *f = &s_frames[i];
+        if (f->fd != fd) continue;
+        CHECK(f->len > 0);
+        if ((f->data[0] >> 5) == 5) {
+            if (n < max_out) out[n++] = (gw_cbor_slice_t){f->data, f->len};
+            continue;
+        }
+        gw_cbor_reader_t r;
+        gw_cbor_reader_init(&r, f->data, f->len);
+        uint8_t ib = 0;
+        uint64_t count = 0;
+        CHECK(gw_cbor_read_u8(&r, &ib) && (ib >> 5) == 4);
+        CHECK(gw_cbor_read_uint_arg(&r, ib & 0x1f, &count));
+        CHECK(count > 1); // a lone event goes out as-is
+        for (uint64_t k = 0; k < count; k++) {
+            const uint8_t *start = r.p;
+            CHECK(gw_cbor_skip_item(&r));
+            CHECK_EQ(*start >> 5, 5);
+            if (n < max_out) out[n++] = (gw_cbor_slice_t){start, (size_t)(r.p - start)};
+        }
+        CHECK(r.p == r.end);
+    }
+    return n;
+}
+
+static uint64_t item_ts(const gw_cbor_slice_t *item)
+{
+    gw_cbor_slice_t v = {0};
+    uint64_t ts = UINT64_MAX;
+    CHECK(gw_cbor_map_find(item->ptr, item->len, "ts_ms", &v));
+    gw_cbor_reader_t r;
+    gw_cbor_reader_init(&r, v.ptr, v.len);
+    uint8_t ib = 0;
+    CHECK(gw_cbor_read_u8(&r, &ib) && gw_cbor_read_uint_arg(&r, ib & 0x1f, &ts));
+    return ts;
+}
+
+// ---- driving the event task ----
+
+static void connect(int fd, bool batch)
+{
+    const httpd_uri_t *h = mock_httpd_find("/ws", HTTP_GET);
+    CHECK(h != NULL);
+    httpd_req_t req;
+    mock_httpd_req_init(&req, "/ws", HTTP_GET);
+    req.fd = fd;
+    CHECK_EQ(h->handler(&req), ESP_OK);
+
+    // {"type":"subscribe","batch":batch}
+    gw_cbor_writer_t w;
+    gw_cbor_writer_init(&w);
+    esp_err_t rc = gw_cbor_writer_map(&w, 2);
+    if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, "type");
+    if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, "subscribe");
+    if (rc == ESP_OK) rc = gw_cbor_writer_text(&w, "batch");
+    if (rc == ESP_OK) rc = gw_cbor_writer_bool(&w, batch);
+    CHECK_EQ(rc, ESP_OK);
+    mock_httpd_req_init(&req, "/ws", 0);
+    req.fd = fd;
+    req.ws_type = HTTPD_WS_TYPE_BINARY;
+    req.ws_payload = w.buf;
+    req.ws_len = w.len;
+    CHECK_EQ(h->handler(&req), ESP_OK);
+    gw_cbor_writer_free(&w);
+}
+
+static void setup(bool plain, bool batched)
+{
+    gw_ws_unregister();
+    mock_httpd_reset();
+    frames_clear();
+    CHECK_EQ(gw_ws_register(&s_server_handle), ESP_OK);
+    mock_httpd_ws_set_sink(sink);
+    if (plain) connect(FD_PLAIN, false);
+    if (batched) connect(FD_BATCHED, true);
+}
+
+// A switch press: a device event that is never coalesced.
+static void publish(uint32_t n)
+{
+    gw_event_t e = {0};
+    e.v = 1;
+    e.id = n;
+    e.ts_ms = n;
+    strlcpy(e.type, "zigbee.command", sizeof(e.type));
+    strlcpy(e.source, "zigbee", sizeof(e.source));
+    snprintf(e.device_uid, sizeof(e.device_uid), "0x00124b00%08x", (unsigned)(n % 64));
+    e.payload_flags = GW_EVENT_PAYLOAD_HAS_ENDPOINT | GW_EVENT_PAYLOAD_HAS_CMD | GW_EVENT_PAYLOAD_HAS_CLUSTER;
+    e.payload_endpoint = 1;
+    e.payload_cluster = 0x0006;
+    strlcpy(e.payload_cmd, n % 2 ? "off" : "on", sizeof(e.payload_cmd));
+    ws_dispatch_event(&e);
+    (void)ws_flush_due_batches();
+}
+
+static void advance(uint32_t ms)
+{
+    host_ticks_advance(ms);
+    (void)ws_flush_due_batches();
+}
+
+// ---- tests ----
+
+static void test_unbatched_client_gets_single_frames(void)
+{
+    setup(true, false);
+    for (uint32_t i = 0; i < 5; i++) {
+        publish(i);
+        CHECK_EQ(frames_for(FD_PLAIN), i + 1); // out at once, no flush timer
+        mock_httpd_ws_complete();
+    }
+    for (size_t i = 0; i < s_frame_count; i++) {
+        CHECK_EQ(s_frames[i].data[0] >> 5, 5);
+    }
+}
+
+static void test_batch_is_an_array_of_the_single_frames(void)
+{
+    setup(true, true);
+    for (uint32_t i = 0; i < 6; i++) {
+        publish(i);
+        mock_httpd_ws_complete();
+        advance(2);
+    }
+    // Held until the flush time, counted from the first event.
+    CHECK_EQ(frames_for(FD_BATCHED), 0);
+    advance(GW_WS_BATCH_FLUSH_MS - 12 - 1);
+    CHECK_EQ(frames_for(FD_BATCHED), 0);
+    advance(1);
+    CHECK_EQ(frames_for(FD_BATCHED), 1);
+    CHECK_EQ(frames_for(FD_PLAIN), 6);
+
+    gw_cbor_slice_t plain[8];
+    gw_cbor_slice_t batched[8];
+    CHECK_EQ(items_for(FD_PLAIN, plain, 8), 6);
+    CHECK_EQ(items_for(FD_BATCHED, batched, 8), 6);
+    for (size_t i = 0; i < 6; i++) {
+        CHECK_EQ(item_ts(&batched[i]), i);
+        CHECK_EQ(batched[i].len, plain[i].len);
+        CHECK(memcmp(batched[i].ptr, plain[i].ptr, plain[i].len) == 0);
+    }
+
+    // A lone event in a batch window goes out bare, not as a one-item array.
+    mock_httpd_ws_complete();
+    publish(100);
+    advance(GW_WS_BATCH_FLUSH_MS);
+    CHECK_EQ(frames_for(FD_BATCHED), 2);
+    CHECK_EQ(s_frames[s_frame_count - 1].fd, FD_BATCHED);
+    CHECK_EQ(s_frames[s_frame_count - 1].data[0] >> 5, 5);
+}
+
+static void test_burst_splits_at_the_byte_cap(void)
+{
+    setup(false, true);
+    // More than two batches' worth with no completions: the first goes out once the
+    // queue reaches the cap, the rest waits behind it, still under the 32-frame queue.
+    const uint32_t n = GW_WS_CLIENT_Q_CAP;
+    size_t sent_before_full = SIZE_MAX;
+    for (uint32_t i = 0; i < n; i++) {
+        publish(i);
+        if (sent_before_full == SIZE_MAX && frames_for(FD_BATCHED) > 0) {
+            sent_before_full = i;
+        }
+    }
+    CHECK(sent_before_full < n);
+    CHECK_EQ(frames_for(FD_BATCHED), 1);
+    CHECK(!mock_httpd_ws_closed(FD_BATCHED));
+
+    // The rest is under the cap: the completion frees the batch buffer, and the rest
+    // goes out in the next batch at its flush time.
+    CHECK_EQ(mock_httpd_ws_complete(), 1);
+    CHECK_EQ(frames_for(FD_BATCHED), 1);
+    advance(GW_WS_BATCH_FLUSH_MS);
+    CHECK_EQ(frames_for(FD_BATCHED), 2);
+    CHECK_EQ(mock_httpd_ws_complete(), 1);
+
+    gw_cbor_slice_t items[MAX_ITEMS];
+    const size_t got = items_for(FD_BATCHED, items, MAX_ITEMS);
+    CHECK_EQ(got, n);
+    for (uint32_t i = 0; i < n && i < got; i++) {
+        CHECK_EQ(item_ts(&items[i]), i);
+    }
+    for (size_t i = 0; i < s_frame_count; i++) {
+        CHECK(s_frames[i].len <= GW_WS_BATCH_HDR_MAX + GW_WS_BATCH_MAX_BYTES);
+    }
+    // Nothing left behind or timed.
+    advance(GW_WS_BATCH_FLUSH_MS);
+    CHECK_EQ(mock_httpd_ws_complete(), 0);
+    CHECK_EQ(s_clients[0].batch_due_ms, 0);
+}
+
+// Switch traffic from a 64-device network: presses 5 ms apart in bursts of 16, a
+// quiet 200 ms between bursts, each send done 1 ms after it starts.
+static void test_frames_and_bytes_batched_vs_unbatched(void)
+{
+    setup(true, true);
+    uint32_t n = 0;
+    for (uint32_t burst = 0; burst < 16; burst++) {
+        for (uint32_t k = 0; k < 16; k++) {
+            publish(n++);
+            advance(1);
+            mock_httpd_ws_complete();
+            advance(4);
+        }
+        for (uint32_t t = 0; t < 200; t++) {
+            advance(1);
+            mock_httpd_ws_complete();
+        }
+    }
+    const traffic_t plain = traffic_for(FD_PLAIN);
+    const traffic_t batched = traffic_for(FD_BATCHED);
+    printf("%u events: unbatched %zu frames / %zu bytes, batched %zu frames / %zu bytes\n", (unsigned)n,
+           plain.frames, plain.wire_bytes, batched.frames, batched.wire_bytes);
+
+    gw_cbor_slice_t items[MAX_ITEMS];
+    CHECK_EQ(items_for(FD_PLAIN, items, MAX_ITEMS), n);
+    CHECK_EQ(items_for(FD_BATCHED, items, MAX_ITEMS), n);
+    CHECK_EQ(plain.frames, n);
+    CHECK(batched.frames * 3 <= plain.frames);
+    CHECK(batched.wire_bytes < plain.wire_bytes);
+}
+
+int main(void)
+{
+    RUN_TEST(test_unbatched_client_gets_single_frames);
+    RUN_TEST(test_batch_is_an_array_of_the_single_frames);
+    RUN_TEST(test_burst_splits_at_the_byte_cap);
+    RUN_TEST(test_frames_and_bytes_batched_vs_unbatched);
+    gw_ws_unregister();
+    frames_clear();
+    return HOST_TEST_RESULT();
+}
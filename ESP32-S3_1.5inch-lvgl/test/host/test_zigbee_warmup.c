@@ -0,0 +1,443 @@
+// test_zigbee_warmup.c - state warm-up of a 64-device network against a model of the C6
+//
+// Includes gw_zigbee_uart.c directly and runs initial_state_sync_task() to the end. The
+// UART goes to a model of the C6 command scheduler: 32 slots of which reads may hold 16,
+// 6 reads on air with one per device, each done C6_READ_MS after it went out. A READ_ATTRS
+// is answered as soon as the model took (OK) or refused (BUSY) it, as the C6 does. Sent
+// bytes cost their wire time at the link baud rate; a response costs its wire time only
+// when the S3 waits for it, pipelined ones arrive while the next request goes out.
+#include <string.h>
+
+#include "host_stubs.h"
+#include "host_test.h"
+
+#include "../../components/gw_zigbee/src/gw_zigbee_uart.c"
+
+#define NET_DEVICES     64
+#define C6_POLL_SLOTS   16
+#define C6_MODEL_SLOTS  512 // an unbounded C6 queues everything
+#define C6_MAX_INFLIGHT 6
+#define C6_READ_MS      250 // APS ack plus the response from a routed device
+
+// Lights (0..47) serve On/Off, Level and Color; sensors (48..63) Power, Temperature and
+// Humidity. Three clusters each, every one with attributes in the map.
+#define NET_LIGHTS   48
+#define DEV_CLUSTERS 3
+
+static const uint16_t s_light_clusters[DEV_CLUSTERS] = {0x0006, 0x0008, 0x0300};
+static const uint16_t s_sensor_clusters[DEV_CLUSTERS] = {0x0001, 0x0402, 0x0405};
+
+typedef struct {
+    bool used;
+    bool on_air;
+    uint32_t dev;
+    uint8_t k; // cluster index on the device
+    uint64_t sent_ms;
+} c6_slot_t;
+
+static c6_slot_t s_c6[C6_MODEL_SLOTS];
+static uint64_t s_c6_ms;
+static uint64_t s_c6_last_done_ms;
+static bool s_c6_refuse_all;
+static bool s_c6_unbounded;
+static size_t s_dev_count = NET_DEVICES;
+static bool s_present[NET_DEVICES][DEV_CLUSTERS]; // state arrived for the cluster
+static uint32_t s_accepted[NET_DEVICES][DEV_CLUSTERS];
+static uint32_t s_refused;
+static uint32_t s_frames;
+static uint32_t s_wire_bytes;
+static gw_uart_proto_parser_t s_parser;
+static int s_task_token;
+
+static const uint16_t *clusters_of(uint32_t dev)
+{
+    return dev < NET_LIGHTS ? s_light_clusters : s_sensor_clusters;
+}
+
+static void uid_of(uint32_t dev, char *out, size_t len)
+{
+    snprintf(out, len, "0x00124b00%08x", (unsigned)dev);
+}
+
+static uint32_t dev_of(const char *uid)
+{
+    return (uint32_t)strtoul(uid + 10, NULL, 16);
+}
+
+static int cluster_index(uint32_t dev, uint16_t cluster)
+{
+    for (int k = 0; k < DEV_CLUSTERS; k++) {
+        if (clusters_of(dev)[k] == cluster) {
+            return k;
+        }
+    }
+    return -1;
+}
+
+// ---- the C6 end of the link ----
+
+static void c6_start_reads(void)
+{
+    size_t on_air = 0;
+    for (size_t i = 0; i < C6_MODEL_SLOTS; i++) {
+        on_air += s_c6[i].used && s_c6[i].on_air;
+    }
+    // Slots are taken in order and never reordered, so slot order is FIFO enough here.
+    for (size_t i = 0; i < C6_MODEL_SLOTS && on_air < C6_MAX_INFLIGHT; i++) {
+        c6_slot_t *s = &s_c6[i];
+        if (!s->used || s->on_air) {
+            continue;
+        }
+        bool dst_busy = false;
+        for (size_t j = 0; j < C6_MODEL_SLOTS; j++) {
+            dst_busy |= s_c6[j].used && s_c6[j].on_air && s_c6[j].dev == s->dev;
+        }
+        if (!dst_busy) {
+            s->on_air = true;
+            s->sent_ms = s_c6_ms;
+            on_air++;
+        }
+    }
+}
+
+// Runs the model up to `now_ms`: reads complete in time order and free their slot.
+static void c6_advance(uint64_t now_ms)
+{
+    for (;;) {
+        c6_start_reads();
+        c6_slot_t *next = NULL;
+        for (size_t i = 0; i < C6_MODEL_SLOTS; i++) {
+            c6_slot_t *s = &s_c6[i];
+            if (s->used && s->on_air && (next == NULL || s->sent_ms < next->sent_ms)) {
+                next = s;
+            }
+        }
+        if (next == NULL || next->sent_ms + C6_READ_MS > now_ms) {
+            break;
+        }
+        s_c6_ms = next->sent_ms + C6_READ_MS;
+        s_c6_last_done_ms = s_c6_ms;
+        s_present[next->dev][next->k] = true;
+        *next = (c6_slot_t){0};
+    }
+    s_c6_ms = now_ms;
+    c6_start_reads();
+}
+
+static gw_uart_status_t c6_submit_read(const gw_uart_cmd_req_v1_t *req)
+{
+    const uint32_t dev = dev_of(req->device_uid);
+    const int k = cluster_index(dev, req->cluster_id);
+    CHECK(dev < s_dev_count && k >= 0);
+    if (dev >= s_dev_count || k < 0) {
+        return GW_UART_STATUS_INVALID_ARGS;
+    }
+    c6_advance((uint64_t)(esp_timer_get_time() / 1000));
+    size_t used = 0;
+    c6_slot_t *free_slot = NULL;
+    for (size_t i = 0; i < C6_MODEL_SLOTS; i++) {
+        if (s_c6[i].used) {
+            used++;
+        } else if (free_slot == NULL) {
+            free_slot = &s_c6[i];
+        }
+    }
+    if (s_c6_refuse_all || (!s_c6_unbounded && used >= C6_POLL_SLOTS) || free_slot == NULL) {
+        s_refused++;
+        return GW_UART_STATUS_BUSY;
+    }
+    *free_slot = (c6_slot_t){.used = true, .dev = dev, .k = (uint8_t)k};
+    s_accepted[dev][k]++;
+    c6_start_reads();
+    return GW_UART_STATUS_OK;
+}
+
+static void c6_rx(const uint8_t *data, size_t len)
+{
+    size_t off = 0;
+    while (off < len) {
+        gw_uart_proto_frame_t frame;
+        bool ready = false;
+        size_t consumed = 0;
+        esp_err_t err = gw_uart_proto_parser_feed(&s_parser, &data[off], len - off, &frame, &ready, &consumed);
+        if (consumed == 0) {
+            break;
+        }
+        off += consumed;
+        if (err != ESP_OK || !ready || frame.msg_type != GW_UART_MSG_CMD_REQ) {
+            continue;
+        }
+        gw_uart_cmd_req_v1_t req;
+        memcpy(&req, frame.payload, sizeof(req));
+        CHECK(req.cmd_id == GW_UART_CMD_READ_ATTRS || req.cmd_id == GW_UART_CMD_READ_ATTR);
+        s_frames++;
+        s_wire_bytes += (uint32_t)len;
+
+        gw_uart_cmd_rsp_v1_t rsp = {.req_id = req.req_id, .status = (uint16_t)c6_submit_read(&req)};
+        gw_uart_proto_frame_t out = {
+            .ver = GW_UART_PROTO_VERSION_V1,
+            .msg_type = GW_UART_MSG_CMD_RSP,
+            .seq = frame.seq,
+            .payload_len = sizeof(rsp),
+        };
+        memcpy(out.payload, &rsp, sizeof(rsp));
+        if (s_pipe.owner == NULL) {
+            mock_uart_wire(GW_UART_PROTO_HEADER_SIZE + sizeof(rsp) + GW_UART_PROTO_CRC_SIZE);
+        }
+        handle_rx_frame(&out);
+    }
+}
+
+// ---- fakes: device registry, state store and the rest of gw_core ----
+
+size_t gw_device_registry_list(gw_device_t *out_devices, size_t max_devices)
+{
+    size_t n = s_dev_count < max_devices ? s_dev_count : max_devices;
+    for (size_t i = 0; i < n; i++) {
+        out_devices[i] = (gw_device_t){.short_addr = (uint16_t)(0x1000 + i)};
+        uid_of((uint32_t)i, out_devices[i].device_uid.uid, sizeof(out_devices[i].device_uid.uid));
+    }
+    return n;
+}
+
+size_t gw_device_registry_list_endpoints(const gw_device_uid_t *uid, gw_zb_endpoint_t *out_eps, size_t max_eps)
+{
+    if (max_eps == 0) {
+        return 0;
+    }
+    const uint32_t dev = dev_of(uid->uid);
+    out_eps[0] = (gw_zb_endpoint_t){.uid = *uid, .short_addr = (uint16_t)(0x1000 + dev), .endpoint = 1};
+    out_eps[0].in_cluster_count = DEV_CLUSTERS + 1;
+    out_eps[0].in_clusters[0] = 0x0000; // Basic: nothing mapped, never read
+    memcpy(&out_eps[0].in_clusters[1], clusters_of(dev), DEV_CLUSTERS * sizeof(uint16_t));
+    return 1;
+}
+
+esp_err_t gw_state_store_get(const gw_device_uid_t *uid, uint8_t endpoint, const char *key, gw_state_item_t *out)
+{
+    const gw_zb_attr_desc_t *row = NULL;
+    size_t count = 0;
+    const gw_zb_attr_desc_t *table = gw_zb_attr_table(&count);
+    for (size_t i = 0; i < count && row == NULL; i++) {
+        if (strcmp(table[i].state_key, key) == 0) {
+            row = &table[i];
+        }
+    }
+    const uint32_t dev = dev_of(uid->uid);
+    const int k = row ? cluster_index(dev, row->cluster) : -1;
+    if (dev >= s_dev_count || k < 0 || !s_present[dev][k]) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    *out = (gw_state_item_t){.uid = *uid, .endpoint = endpoint, .value_type = GW_STATE_VALUE_U32};
+    strlcpy(out->key, key, sizeof(out->key));
+    return ESP_OK;
+}
+
+void gw_event_bus_publish_zb(const char *type, const char *source, const char *device_uid, uint16_t short_addr,
+                             const char *msg, uint8_t endpoint, const char *cmd, uint16_t cluster_id, uint16_t attr_id,
+                             gw_event_value_type_t value_type, bool value_bool, int64_t value_i64, double value_f64,
+                             const char *value_text, const uint8_t *payload_cbor, size_t payload_len)
+{
+}
+
+esp_err_t gw_device_fb_store_set(const uint8_t *buf, size_t len)
+{
+    return ESP_OK;
+}
+
+esp_err_t gw_runtime_sync_snapshot_begin(uint16_t total_devices)
+{
+    return ESP_OK;
+}
+
+esp_err_t gw_runtime_sync_snapshot_upsert_device(const gw_device_t *device)
+{
+    return ESP_OK;
+}
+
+esp_err_t gw_runtime_sync_snapshot_upsert_endpoint(const gw_zb_endpoint_t *endpoint)
+{
+    return ESP_OK;
+}
+
+esp_err_t gw_runtime_sync_snapshot_remove_device(const gw_device_uid_t *uid)
+{
+    return ESP_OK;
+}
+
+esp_err_t gw_runtime_sync_snapshot_end(void)
+{
+    return ESP_OK;
+}
+
+// ---- helpers ----
+
+static void reset(size_t dev_count)
+{
+    memset(s_c6, 0, sizeof(s_c6));
+    memset(s_present, 0, sizeof(s_present));
+    memset(s_accepted, 0, sizeof(s_accepted));
+    s_c6_ms = (uint64_t)(esp_timer_get_time() / 1000);
+    s_c6_last_done_ms = s_c6_ms;
+    s_c6_refuse_all = false;
+    s_c6_unbounded = false;
+    s_dev_count = dev_count;
+    s_refused = 0;
+    s_frames = 0;
+    s_wire_bytes = 0;
+    gw_uart_proto_parser_init(&s_parser);
+    s_initial_state_sync_done = false;
+    s_initial_state_sync_started = false;
+    host_task_set_current(&s_task_token);
+    mock_uart_set_sink(c6_rx);
+    mock_uart_set_baud(GW_UART_BAUD);
+}
+
+// Runs the warm-up task to its end; returns the simulated time it took, in ms.
+static uint32_t run_warmup(void)
+{
+    const int64_t t0_us = esp_timer_get_time();
+    initial_state_sync_task(NULL);
+    CHECK(s_initial_state_sync_done);
+    return (uint32_t)((esp_timer_get_time() - t0_us) / 1000);
+}
+
+// Pass 0 of the warm-up without a hint: every endpoint through queue_endpoint_reads().
+static uint32_t run_first_pass(uint32_t *missing)
+{
+    gw_zb_endpoint_t ep;
+    uint32_t ok = 0;
+    uint32_t busy = 0;
+    for (uint32_t d = 0; d < s_dev_count; d++) {
+        gw_device_uid_t uid;
+        uid_of(d, uid.uid, sizeof(uid.uid));
+        CHECK_EQ(gw_device_registry_list_endpoints(&uid, &ep, 1), 1);
+        ok += queue_endpoint_reads(&uid, &ep, missing, &busy);
+    }
+    CHECK_EQ(busy, 0);
+    return ok;
+}
+
+// Pass 0 as it was before per-cluster frames: one blocking READ_ATTR per missing mapped
+// attribute, 10 ms apart.
+static uint32_t run_first_pass_per_attribute(uint32_t *missing)
+{
+    size_t count = 0;
+    const gw_zb_attr_desc_t *table = gw_zb_attr_table(&count);
+    gw_zb_endpoint_t ep;
+    uint32_t ok = 0;
+    for (uint32_t d = 0; d < s_dev_count; d++) {
+        gw_device_uid_t uid;
+        uid_of(d, uid.uid, sizeof(uid.uid));
+        CHECK_EQ(gw_device_registry_list_endpoints(&uid, &ep, 1), 1);
+        for (size_t i = 0; i < count; i++) {
+            if (!endpoint_has_in_cluster(&ep, table[i].cluster) ||
+                state_key_present_and_valid(&uid, ep.endpoint, table[i].state_key)) {
+                continue;
+            }
+            (*missing)++;
+            ok += gw_zigbee_read_attr(&uid, ep.endpoint, table[i].cluster, table[i].attr) == ESP_OK;
+            vTaskDelay(pdMS_TO_TICKS(10));
+        }
+    }
+    return ok;
+}
+
+typedef struct {
+    uint32_t frames;
+    uint32_t attrs;
+    uint32_t bytes;
+    uint32_t link_ms;  // UART busy: request bytes, awaited responses, gaps
+    uint32_t state_ms; // until the C6 finished the last read
+} warmup_cost_t;
+
+static warmup_cost_t measure_first_pass(bool per_attribute)
+{
+    reset(NET_DEVICES);
+    s_c6_unbounded = true;
+    const uint64_t t0_ms = (uint64_t)(esp_timer_get_time() / 1000);
+    warmup_cost_t c = {0};
+    c.frames = per_attribute ? run_first_pass_per_attribute(&c.attrs) : run_first_pass(&c.attrs);
+    c.link_ms = (uint32_t)((uint64_t)(esp_timer_get_time() / 1000) - t0_ms);
+    c.bytes = s_wire_bytes;
+    c6_advance((uint64_t)(esp_timer_get_time() / 1000) + 1000u * 1000u);
+    c.state_ms = (uint32_t)(s_c6_last_done_ms - t0_ms);
+    CHECK_EQ(c.frames, s_frames);
+    return c;
+}
+
+// ---- tests ----
+
+static void test_64_devices_lose_no_read(void)
+{
+    reset(NET_DEVICES);
+    const uint32_t ms = run_warmup();
+    c6_advance((uint64_t)(esp_timer_get_time() / 1000) + 10 * C6_READ_MS);
+
+    uint32_t missing = 0;
+    uint32_t accepted = 0;
+    uint32_t repeated = 0;
+    for (uint32_t d = 0; d < NET_DEVICES; d++) {
+        for (int k = 0; k < DEV_CLUSTERS; k++) {
+            missing += !s_present[d][k];
+            accepted += s_accepted[d][k];
+            repeated += s_accepted[d][k] > 1;
+        }
+    }
+    printf("  %u devices, %u cluster reads: %u frames, %u refused as busy and sent again, %u read twice, %u ms\n",
+           (unsigned)NET_DEVICES, (unsigned)(NET_DEVICES * DEV_CLUSTERS), (unsigned)s_frames, (unsigned)s_refused,
+           (unsigned)repeated, (unsigned)ms);
+    CHECK_EQ(missing, 0);
+    // The 16 read slots fill long before 192 reads are queued: refusals must have happened.
+    CHECK(s_refused > 0);
+    CHECK_EQ(s_frames, accepted + s_refused);
+    // Only refused frames go out again. The second pass may ask again for reads still
+    // queued on the C6 when it starts, which are at most the reads' share of the queue.
+    CHECK(accepted <= NET_DEVICES * DEV_CLUSTERS + C6_POLL_SLOTS);
+    CHECK(repeated <= C6_POLL_SLOTS);
+}
+
+static void test_refusals_give_up_after_the_retry_limit(void)
+{
+    reset(2);
+    s_c6_refuse_all = true;
+    const uint32_t ms = run_warmup();
+
+    // Both passes try each endpoint's three clusters 1 + GW_WARMUP_BUSY_RETRY_MAX times.
+    CHECK_EQ(s_refused, 2 * 2 * DEV_CLUSTERS * (1 + GW_WARMUP_BUSY_RETRY_MAX));
+    uint32_t backoff_ms = 0;
+    for (uint32_t b = GW_WARMUP_BUSY_BACKOFF_MS, i = 0; i < GW_WARMUP_BUSY_RETRY_MAX; i++) {
+        backoff_ms += b;
+        b = b * 2 > GW_WARMUP_BUSY_BACKOFF_MAX_MS ? GW_WARMUP_BUSY_BACKOFF_MAX_MS : b * 2;
+    }
+    // Four endpoint runs of backoff, the 900 ms pause after each pass and ~16 ms per frame.
+    CHECK(ms >= 4 * backoff_ms + 2 * 900);
+    CHECK(ms < 4 * backoff_ms + 2 * 900 + s_frames * 20);
+}
+
+static void test_64_devices_one_frame_per_cluster(void)
+{
+    const warmup_cost_t cl = measure_first_pass(false);
+    const warmup_cost_t at = measure_first_pass(true);
+    printf("  first pass, %u devices, C6 taking every read:\n", (unsigned)NET_DEVICES);
+    printf("    per cluster, pipelined:  %3u frames %6u B  %u attrs  link %5u ms  state %5u ms\n", (unsigned)cl.frames,
+           (unsigned)cl.bytes, (unsigned)cl.attrs, (unsigned)cl.link_ms, (unsigned)cl.state_ms);
+    printf("    per attribute, blocking: %3u frames %6u B  %u attrs  link %5u ms  state %5u ms\n", (unsigned)at.frames,
+           (unsigned)at.bytes, (unsigned)at.attrs, (unsigned)at.link_ms, (unsigned)at.state_ms);
+
+    // 48 lights x (1 + 1 + 3) attributes plus 16 sensors x (2 + 1 + 1), in 3 frames each.
+    CHECK_EQ(cl.attrs, 48 * 5 + 16 * 4);
+    CHECK_EQ(at.attrs, cl.attrs);
+    CHECK_EQ(cl.frames, NET_DEVICES * DEV_CLUSTERS);
+    CHECK_EQ(at.frames, at.attrs);
+    CHECK(cl.link_ms < at.link_ms);
+    CHECK(cl.state_ms < at.state_ms);
+}
+
+int main(void)
+{
+    RUN_TEST(test_64_devices_lose_no_read);
+    RUN_TEST(test_64_devices_one_frame_per_cluster);
+    RUN_TEST(test_refusals_give_up_after_the_retry_limit);
+    return HOST_TEST_RESULT();
+}
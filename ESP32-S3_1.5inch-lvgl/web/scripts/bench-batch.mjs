@@ -0,0 +1,91 @@
+// Wall time of N actions sent one POST /api/actions at a time, as the UI did, against
+// the same list in one POST /api/actions/batch, on a running gateway.
+//
+//   npm run bench:batch -- http://192.168.4.1 --uids 0x00124b00...,0x00124b00... \
+//       [--cmd onoff.off] [--endpoint 1] [--count 20] [--runs 5]
+//
+// The uids are cycled to make up --count entries. Runs alternate between the two ways so
+// drift in Wi-Fi or Zigbee load hits both alike; the medians are reported.
+import { cborDecode, cborEncode } from '../src/cbor.js'
+
+function parseArgs(argv) {
+	const out = { base: null, uids: [], cmd: 'onoff.off', endpoint: 1, count: 20, runs: 5 }
+	for (let i = 0; i < argv.length; i++) {
+		const a = argv[i]
+		const [flag, inline] = a.startsWith('--') && a.includes('=') ? a.split(/=(.*)/s) : [a, null]
+		const value = () => (inline !== null ? inline : argv[++i])
+		if (flag === '--uids') out.uids = String(value()).split(',').filter(Boolean)
+		else if (flag === '--cmd') out.cmd = value()
+		else if (flag === '--endpoint') out.endpoint = Number(value())
+		else if (flag === '--count') out.count = Number(value())
+		else if (flag === '--runs') out.runs = Number(value())
+		else if (!out.base) out.base = a.replace(/\/+$/, '')
+	}
+	if (!out.base || out.uids.length === 0 || !(out.count >= 1 && out.count <= 64) || !(out.runs >= 1)) {
+		console.error('Usage: npm run bench:batch -- http://<gateway> --uids <uid,...> [--cmd onoff.off] [--endpoint 1] [--count 20] [--runs 5]')
+		process.exit(2)
+	}
+	return out
+}
+
+async function post(base, path, body) {
+	const res = await fetch(`${base}${path}`, {
+		method: 'POST',
+		headers: { Accept: 'application/cbor', 'Content-Type': 'application/cbor' },
+		body: cborEncode(body),
+	})
+	const buf = await res.arrayBuffer()
+	if (!res.ok) throw new Error(`POST ${path} failed: ${res.status} ${Buffer.from(buf).toString('utf8').trim()}`)
+	return buf.byteLength ? cborDecode(buf) : null
+}
+
+async function timed(fn) {
+	const t0 = process.hrtime.bigint()
+	const out = await fn()
+	return { ms: Number(process.hrtime.bigint() - t0) / 1e6, out }
+}
+
+function median(xs) {
+	const s = [...xs].sort((a, b) => a - b)
+	return s[Math.floor(s.length / 2)]
+}
+
+async function main() {
+	const opt = parseArgs(process.argv.slice(2))
+	const actions = Array.from({ length: opt.count }, (_, i) => ({
+		type: 'zigbee',
+		cmd: opt.cmd,
+		device_uid: opt.uids[i % opt.uids.length],
+		endpoint: opt.endpoint,
+	}))
+
+	const seq = []
+	const batch = []
+	let frames = null
+	for (let r = 0; r < opt.runs; r++) {
+		seq.push(
+			(
+				await timed(async () => {
+					for (const action of actions) await post(opt.base, '/api/actions', { action })
+				})
+			).ms,
+		)
+		const b = await timed(() => post(opt.base, '/api/actions/batch', { actions }))
+		const failed = (b.out?.results ?? []).findIndex((x) => !x?.ok)
+		if (failed >= 0) throw new Error(`batch entry ${failed + 1}: ${b.out.results[failed].err ?? 'failed'}`)
+		frames = b.out?.frames ?? frames
+		batch.push(b.ms)
+	}
+
+	const s = median(seq)
+	const b = median(batch)
+	console.log(`${opt.count} x ${opt.cmd} over ${opt.uids.length} device(s), ${opt.runs} runs, medians:`)
+	console.log(`  sequential /api/actions   ${s.toFixed(1).padStart(8)} ms  (${opt.count} requests)`)
+	console.log(`  /api/actions/batch        ${b.toFixed(1).padStart(8)} ms  (1 request, ${frames ?? '?'} Zigbee frames)`)
+	console.log(`  speed-up ${(s / b).toFixed(2)}x`)
+}
+
+main().catch((err) => {
+	console.error(err.message || err)
+	process.exit(1)
+})
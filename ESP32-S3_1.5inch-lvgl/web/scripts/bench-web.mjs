@@ -0,0 +1,132 @@
+// Page-load cost against a running gateway: bytes on the wire and time to first byte
+// for index.html and every asset it references, plain vs gzip, cold vs warm cache.
+//
+//   npm run bench:web -- http://192.168.4.1 [--runs 5]
+//
+// The cache is keyed by file, so the first pass of each encoding reads SPIFFS ("cold")
+// and later passes hit the PSRAM cache ("warm"). Reboot the gateway before a run.
+import http from 'node:http'
+
+function parseArgs(argv) {
+	const out = { base: null, runs: 5 }
+	for (let i = 0; i < argv.length; i++) {
+		const a = argv[i]
+		if (a === '--runs') {
+			out.runs = Number(argv[++i])
+		} else if (a.startsWith('--runs=')) {
+			out.runs = Number(a.slice('--runs='.length))
+		} else if (!out.base) {
+			out.base = a.replace(/\/+$/, '')
+		}
+	}
+	if (!out.base || !(out.runs >= 1)) {
+		console.error('Usage: npm run bench:web -- http://<gateway> [--runs N]')
+		process.exit(2)
+	}
+	return out
+}
+
+// One GET on a fresh connection, as a browser's first load opens them. fetch() would
+// decompress and hide the wire size, so this stays on node:http.
+function get(base, path, encoding) {
+	return new Promise((resolve, reject) => {
+		const t0 = process.hrtime.bigint()
+		let ttfb = 0
+		const req = http.get(
+			`${base}${path}`,
+			{ agent: false, headers: { 'Accept-Encoding': encoding } },
+			(res) => {
+				const chunks = []
+				res.once('data', () => {
+					ttfb = Number(process.hrtime.bigint() - t0) / 1e6
+				})
+				res.on('data', (c) => chunks.push(c))
+				res.on('end', () => {
+					const total = Number(process.hrtime.bigint() - t0) / 1e6
+					resolve({
+						status: res.statusCode,
+						bytes: Buffer.concat(chunks).length,
+						ttfb: ttfb || total,
+						total,
+						encoding: res.headers['content-encoding'] || '',
+						cache: res.headers['cache-control'] || '',
+						body: Buffer.concat(chunks),
+					})
+				})
+				res.on('error', reject)
+			},
+		)
+		req.on('error', reject)
+	})
+}
+
+function assetsOf(html) {
+	const refs = new Set()
+	for (const m of html.matchAll(/(?:src|href)="(\/[^"]+)"/g)) refs.add(m[1])
+	return [...refs]
+}
+
+function median(xs) {
+	const s = [...xs].sort((a, b) => a - b)
+	return s.length ? s[Math.floor(s.length / 2)] : 0
+}
+
+async function pass(base, paths, encoding) {
+	const rows = []
+	for (const p of paths) {
+		const r = await get(base, p, encoding)
+		if (r.status !== 200) throw new Error(`${p}: HTTP ${r.status}`)
+		rows.push({ path: p, ...r })
+	}
+	return rows
+}
+
+function summarize(label, passes) {
+	const bytes = passes[0].reduce((n, r) => n + r.bytes, 0)
+	const ttfb = passes.map((rows) => rows.reduce((n, r) => n + r.ttfb, 0))
+	const total = passes.map((rows) => rows.reduce((n, r) => n + r.total, 0))
+	const warmTtfb = ttfb.length > 1 ? median(ttfb.slice(1)) : ttfb[0]
+	const warmTotal = total.length > 1 ? median(total.slice(1)) : total[0]
+	console.log(
+		`${label.padEnd(8)} ${String(bytes).padStart(9)} B   cold TTFB ${ttfb[0].toFixed(1).padStart(7)} ms  load ${total[0]
+			.toFixed(1)
+			.padStart(7)} ms   warm TTFB ${warmTtfb.toFixed(1).padStart(7)} ms  load ${warmTotal.toFixed(1).padStart(7)} ms`,
+	)
+	return { bytes, warmTtfb, warmTotal }
+}
+
+async function main() {
+	const { base, runs } = parseArgs(process.argv.slice(2))
+	const index = await get(base, '/', 'identity')
+	if (index.status !== 200) throw new Error(`/: HTTP ${index.status}`)
+	const paths = ['/', ...assetsOf(index.body.toString('utf8'))]
+
+	const results = {}
+	for (const encoding of ['gzip', 'identity']) {
+		const passes = []
+		for (let i = 0; i < runs; i++) passes.push(await pass(base, paths, encoding))
+		results[encoding] = passes
+	}
+
+	console.log(`${paths.length} files, ${runs} passes each (TTFB and load are summed over the files)`)
+	for (const r of results.gzip[0]) {
+		const plain = results.identity[0].find((x) => x.path === r.path)
+		console.log(
+			`  ${r.path.padEnd(40)} ${String(plain.bytes).padStart(8)} -> ${String(r.bytes).padStart(8)} B  ${
+				r.encoding || 'identity'
+			}  ${r.cache || '(no Cache-Control)'}`,
+		)
+	}
+	const plain = summarize('identity', results.identity)
+	const gz = summarize('gzip', results.gzip)
+	const change = (a, b) => {
+		const pct = a ? (b / a - 1) * 100 : 0
+		return `${pct > 0 ? '+' : ''}${pct.toFixed(1)}%`
+	}
+	console.log(`gzip vs identity: bytes ${change(plain.bytes, gz.bytes)}, warm TTFB ${change(plain.warmTtfb, gz.warmTtfb)}, warm load ${change(plain.warmTotal, gz.warmTotal)}`)
+}
+
+main().catch((err) => {
+	console.error(err.message || err)
+	process.exit(1)
+})
@@ -74,7 +74,12 @@ export async function deleteCbor(path, overrides = {}) {
 	return fetchCbor(path, { method: 'DELETE', ...overrides, headers: { ...CBOR_HEADERS, ...(overrides.headers || {}) } })
 }
 
+// A list runs as one batch (planned and pipelined on the gateway); it rejects with the
+// first failing entry's error, after every entry has been tried.
 export async function execAction(payload) {
-	const body = Array.isArray(payload) ? { actions: payload } : { action: payload }
-	return postCbor('/api/actions', body)
+	if (!Array.isArray(payload)) return postCbor('/api/actions', { action: payload })
+	const res = await postCbor('/api/actions/batch', { actions: payload })
+	const failed = (res?.results ?? []).findIndex((r) => !r?.ok)
+	if (failed >= 0) throw new Error(`action ${failed + 1}: ${res.results[failed].err ?? 'failed'}`)
+	return res
 }
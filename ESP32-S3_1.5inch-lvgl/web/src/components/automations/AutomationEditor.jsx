@@ -96,6 +96,25 @@ export default function AutomationEditor({
 							<span className="muted">enabled</span>
 						</label>
 					</div>
+					<div className="row" style={{ marginTop: 6 }}>
+						<label className="muted">mode</label>
+						<select value={String(draft?.mode ?? 'single')} onChange={(e) => setField('mode', String(e.target.value))}>
+							<option value="single">single</option>
+							<option value="restart">restart</option>
+							<option value="queued">queued</option>
+							<option value="parallel">parallel</option>
+						</select>
+						{draft?.mode === 'queued' || draft?.mode === 'parallel' ? (
+							<>
+								<label className="muted" style={{ marginLeft: 10 }}>max runs</label>
+								<input type="number" min={1} value={draft?.max_runs ?? 10} onChange={(e) => setField('max_runs', Math.max(1, Number(e.target.value) || 1))} style={{ width: 70 }} />
+							</>
+						) : null}
+						<label className="muted" style={{ marginLeft: 10 }}>debounce ms</label>
+						<input type="number" min={0} value={draft?.debounce_ms ?? 0} onChange={(e) => setField('debounce_ms', Math.max(0, Number(e.target.value) || 0))} style={{ width: 90 }} />
+						<label className="muted" style={{ marginLeft: 10 }}>throttle ms</label>
+						<input type="number" min={0} value={draft?.throttle_ms ?? 0} onChange={(e) => setField('throttle_ms', Math.max(0, Number(e.target.value) || 0))} style={{ width: 90 }} />
+					</div>
 				</div>
 				<div className="row">
 					<button onClick={onTestActions} disabled={actions.length === 0}>Test actions</button>
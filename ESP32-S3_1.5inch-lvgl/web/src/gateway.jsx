@@ -2,7 +2,7 @@
 //gateway.jsx
 import { createContext, useCallback, useContext, useEffect, useMemo, useRef, useState } from 'react'
 import { fetchBinary, fetchCbor } from './api.js'
-import { cborDecode } from './cbor.js'
+import { cborDecode, cborEncode } from './cbor.js'
 import { parseDeviceBlob } from './deviceBlob.js'
 import { groupsReload } from './groupsStore.js'
 
@@ -30,6 +30,28 @@ function buildStateMap(items) {
 	return out
 }
 
+// Apply a /api/state?since= delta: changed items overwrite, removed ones are dropped.
+function mergeStateDelta(prev, items) {
+	const out = { ...prev }
+	;(Array.isArray(items) ? items : []).forEach((it) => {
+		const uid = normalizeUid(it?.device_id)
+		const epNum = Number(it?.endpoint_id ?? 0)
+		const ep = String(Number.isFinite(epNum) && epNum > 0 ? epNum : '')
+		const key = String(it?.key ?? '')
+		if (!uid || !ep || !key) return
+		const eps = { ...(out[uid] || {}) }
+		const keys = { ...(eps[ep] || {}) }
+		if (it?.removed) {
+			delete keys[key]
+		} else {
+			keys[key] = it?.value ?? null
+		}
+		eps[ep] = keys
+		out[uid] = eps
+	})
+	return out
+}
+
 const GatewayContext = createContext(null)
 
 export function GatewayProvider({ children }) {
@@ -42,6 +64,8 @@ export function GatewayProvider({ children }) {
 
 	const wsRef = useRef(null)
 	const reconnectTimerRef = useRef(null)
+	const wsFilterRef = useRef(null)
+	const stateVersionRef = useRef(null)
 
 	const applyDeviceList = useCallback((list) => {
 		const safeList = Array.isArray(list) ? list : []
@@ -63,9 +87,21 @@ export function GatewayProvider({ children }) {
 	}, [])
 
 	const loadStateSnapshot = useCallback(async () => {
-		const data = await fetchCbor('/api/state')
-		const next = buildStateMap(data?.items)
-		setDeviceStates(next)
+		// After the first load only what changed since the last version comes back.
+		const since = stateVersionRef.current
+		const data = await fetchCbor(since == null ? '/api/state' : `/api/state?since=${since}`)
+		const version = Number(data?.version)
+		stateVersionRef.current = Number.isFinite(version) ? version : null
+		if (since == null || data?.full) {
+			const next = buildStateMap(data?.items)
+			setDeviceStates(next)
+			return next
+		}
+		let next = null
+		setDeviceStates((prev) => {
+			next = mergeStateDelta(prev, data?.items)
+			return next
+		})
 		return next
 	}, [])
 
@@ -102,53 +138,60 @@ export function GatewayProvider({ children }) {
 				if (wsRef.current !== ws) return
 				attempts = 0
 				setWsStatus('connected')
+				ws.send(cborEncode(wsFilterRef.current || { type: 'subscribe', batch: true }))
+			}
+
+			// A frame holds one event envelope, or an array of them when batching is on.
+			const handleMessage = (msg) => {
+				if (!msg || typeof msg !== 'object') return
+				const type = String(msg?.type ?? '')
+				const data = msg?.data && typeof msg.data === 'object' ? msg.data : {}
+				if (!type) return
+
+				setEvents((prev) => {
+					const next = [...prev, msg]
+					return next.length > 30 ? next.slice(next.length - 30) : next
+				})
+
+				if (type === 'device.state') {
+					const uid = normalizeUid(data?.device_id ?? '')
+					const epNum = Number(data?.endpoint_id ?? data?.endpoint ?? 0)
+					const ep = String(Number.isFinite(epNum) && epNum > 0 ? epNum : '')
+					const key = String(data?.key ?? '')
+					if (!uid || !ep || !key) return
+					setDeviceStates((prev) => ({
+						...prev,
+						[uid]: {
+							...(prev[uid] || {}),
+							[ep]: {
+								...((prev[uid] && prev[uid][ep]) || {}),
+								[key]: data?.value ?? null,
+							},
+						},
+					}))
+				}
+				if (type === 'gateway.event') {
+					const evType = String(data?.event_type ?? '')
+					if (evType === 'device.changed') {
+						loadDevices().catch(() => {})
+						loadStateSnapshot().catch(() => {})
+					} else if (evType === 'automation.changed') {
+						loadAutomations().catch(() => {})
+					} else if (evType === 'group.changed') {
+						groupsReload().catch(() => {})
+					} else if (evType === 'settings.changed') {
+						loadSettings().catch(() => {})
+					}
+				}
 			}
 
 			ws.onmessage = (ev) => {
 				if (wsRef.current !== ws) return
 				try {
 					if (!(ev?.data instanceof ArrayBuffer)) return
-					const msg = cborDecode(ev.data)
-					if (!msg || typeof msg !== 'object') return
-					const type = String(msg?.type ?? '')
-					const data = msg?.data && typeof msg.data === 'object' ? msg.data : {}
-					if (!type) return
-
-					setEvents((prev) => {
-						const next = [...prev, msg]
-						return next.length > 30 ? next.slice(next.length - 30) : next
-					})
-
-					if (type === 'device.state') {
-						const uid = normalizeUid(data?.device_id ?? '')
-						const epNum = Number(data?.endpoint_id ?? data?.endpoint ?? 0)
-						const ep = String(Number.isFinite(epNum) && epNum > 0 ? epNum : '')
-						const key = String(data?.key ?? '')
-						if (!uid || !ep || !key) return
-						setDeviceStates((prev) => ({
-							...prev,
-							[uid]: {
-								...(prev[uid] || {}),
-								[ep]: {
-									...((prev[uid] && prev[uid][ep]) || {}),
-									[key]: data?.value ?? null,
-								},
-							},
-						}))
-					}
-					if (type === 'gateway.event') {
-						const evType = String(data?.event_type ?? '')
-						if (evType === 'device.changed') {
-							loadDevices().catch(() => {})
-							loadStateSnapshot().catch(() => {})
-						} else if (evType === 'automation.changed') {
-							loadAutomations().catch(() => {})
-						} else if (evType === 'group.changed') {
-							groupsReload().catch(() => {})
-						} else if (evType === 'settings.changed') {
-							loadSettings().catch(() => {})
-						}
-					}
+					const decoded = cborDecode(ev.data)
+					const msgs = Array.isArray(decoded) ? decoded : [decoded]
+					msgs.forEach(handleMessage)
 				} catch {
 					// ignore parse errors
 				}
@@ -177,6 +220,14 @@ export function GatewayProvider({ children }) {
 		}
 	}, [loadAutomations, loadDevices, loadStateSnapshot, loadSettings])
 
+	// Narrow the /ws stream server-side: { kinds?: [...], devices?: [uid...], group?: id, batch? }.
+	// null subscribes to everything again. Kept across reconnects.
+	const setWsFilter = useCallback((filter) => {
+		wsFilterRef.current = { type: 'subscribe', batch: true, ...(filter || {}) }
+		const ws = wsRef.current
+		if (ws && ws.readyState === WebSocket.OPEN) ws.send(cborEncode(wsFilterRef.current))
+	}, [])
+
 	useEffect(() => {
 		loadDevices().catch(() => {})
 		loadAutomations().catch(() => {})
@@ -195,8 +246,9 @@ export function GatewayProvider({ children }) {
 			reloadDevices: loadDevices,
 			reloadAutomations: loadAutomations,
 			reloadSettings: loadSettings,
+			setWsFilter,
 		}),
-		[devices, automations, events, deviceStates, projectSettings, wsStatus, loadDevices, loadAutomations, loadSettings],
+		[devices, automations, events, deviceStates, projectSettings, wsStatus, loadDevices, loadAutomations, loadSettings, setWsFilter],
 	)
 
 	return <GatewayContext.Provider value={value}>{children}</GatewayContext.Provider>
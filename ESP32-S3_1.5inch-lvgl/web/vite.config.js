@@ -1,7 +1,44 @@
+import fs from 'node:fs'
+import path from 'node:path'
+import { gzipSync } from 'node:zlib'
 import { defineConfig } from 'vite'
 import react from '@vitejs/plugin-react'
 
+// SPIFFS object names (leading '/' included) must fit CONFIG_SPIFFS_OBJ_NAME_LEN - 1.
+const SPIFFS_NAME_MAX = 31
+
+// Write a .gz next to every text asset in dist/; the gateway serves it with
+// Content-Encoding: gzip to clients that accept it.
+function gzipAssets() {
+  let outDir = ''
+  const walk = (dir) =>
+    fs.readdirSync(dir, { withFileTypes: true }).flatMap((d) => {
+      const p = path.join(dir, d.name)
+      return d.isDirectory() ? walk(p) : [p]
+    })
+  return {
+    name: 'gw-gzip-assets',
+    apply: 'build',
+    configResolved(cfg) {
+      outDir = path.resolve(cfg.root, cfg.build.outDir)
+    },
+    closeBundle() {
+      for (const file of walk(outDir)) {
+        if (!/\.(html|js|css|svg|json)$/.test(file)) continue
+        const name = '/' + path.relative(outDir, file).split(path.sep).join('/') + '.gz'
+        if (name.length > SPIFFS_NAME_MAX) {
+          this.warn(`${name}: name too long for SPIFFS, serving it uncompressed`)
+          continue
+        }
+        const raw = fs.readFileSync(file)
+        const gz = gzipSync(raw, { level: 9 })
+        if (gz.length < raw.length) fs.writeFileSync(file + '.gz', gz)
+      }
+    },
+  }
+}
+
 // https://vite.dev/config/
 export default defineConfig({
-  plugins: [react()],
+  plugins: [react(), gzipAssets()],
 })